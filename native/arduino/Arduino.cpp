@@ -0,0 +1,130 @@
+/*!
+ * \file      Arduino.cpp
+ *
+ * \brief     Subset of the Arduino core used by the sketch and lbm_api.cpp, host-native implementation
+ */
+
+#include <stdarg.h>
+
+#include "Arduino.h"
+
+extern "C" {
+#include "sim_clock.h"
+#include "smtc_hal_mcu.h"
+#include "smtc_hal_dbg_trace.h"
+}
+
+HardwareSerial Serial;
+
+unsigned long millis( void )
+{
+    return sim_clock_now_ms( );
+}
+
+unsigned long micros( void )
+{
+    return ( unsigned long ) sim_clock_now_us( );
+}
+
+void delay( unsigned long ms )
+{
+    hal_mcu_set_sleep_for_ms( ( int32_t ) ms );
+}
+
+void delayMicroseconds( unsigned int us )
+{
+    hal_mcu_wait_us( ( int32_t ) us );
+}
+
+void yield( void )
+{
+}
+
+// Serial shares the trace output (and its quiet switch) with the modem traces
+size_t HardwareSerial::print( const char* s )
+{
+    hal_trace_print( "%s", s );
+    return strlen( s );
+}
+
+size_t HardwareSerial::print( char c )
+{
+    hal_trace_print( "%c", c );
+    return 1;
+}
+
+size_t HardwareSerial::print( int value )
+{
+    return printf( "%d", value );
+}
+
+size_t HardwareSerial::print( unsigned int value )
+{
+    return printf( "%u", value );
+}
+
+size_t HardwareSerial::print( long value )
+{
+    return printf( "%ld", value );
+}
+
+size_t HardwareSerial::print( unsigned long value )
+{
+    return printf( "%lu", value );
+}
+
+size_t HardwareSerial::print( double value )
+{
+    return printf( "%.2f", value );
+}
+
+size_t HardwareSerial::println( void )
+{
+    return print( "\n" );
+}
+
+size_t HardwareSerial::println( const char* s )
+{
+    return print( s ) + println( );
+}
+
+size_t HardwareSerial::println( int value )
+{
+    return print( value ) + println( );
+}
+
+size_t HardwareSerial::println( unsigned int value )
+{
+    return print( value ) + println( );
+}
+
+size_t HardwareSerial::println( long value )
+{
+    return print( value ) + println( );
+}
+
+size_t HardwareSerial::println( unsigned long value )
+{
+    return print( value ) + println( );
+}
+
+size_t HardwareSerial::println( double value )
+{
+    return print( value ) + println( );
+}
+
+size_t HardwareSerial::printf( const char* fmt, ... )
+{
+    char    buf[256];
+    va_list args;
+    va_start( args, fmt );
+    int len = vsnprintf( buf, sizeof( buf ), fmt, args );
+    va_end( args );
+    hal_trace_print( "%s", buf );
+    return ( len > 0 ) ? ( size_t ) len : 0;
+}
+
+void HardwareSerial::flush( void )
+{
+    fflush( stdout );
+}
@@ -0,0 +1,60 @@
+/*!
+ * \file      Arduino.h
+ *
+ * \brief     Subset of the Arduino core used by the sketch and lbm_api.cpp, host-native implementation
+ *
+ * Time functions run on the virtual clock: delay() lets the modem timer and the radio irq fire exactly as
+ * they would during the same delay on the RAK3112.
+ */
+
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+unsigned long millis( void );
+unsigned long micros( void );
+void          delay( unsigned long ms );
+void          delayMicroseconds( unsigned int us );
+void          yield( void );
+
+// Sketch entry points, called by main_native.cpp
+void setup( void );
+void loop( void );
+
+class HardwareSerial
+{
+public:
+    void begin( unsigned long baud ) { ( void ) baud; }
+    void end( void ) {}
+    operator bool( ) const { return true; }
+
+    size_t print( const char* s );
+    size_t print( char c );
+    size_t print( int value );
+    size_t print( unsigned int value );
+    size_t print( long value );
+    size_t print( unsigned long value );
+    size_t print( double value );
+
+    size_t println( void );
+    size_t println( const char* s );
+    size_t println( int value );
+    size_t println( unsigned int value );
+    size_t println( long value );
+    size_t println( unsigned long value );
+    size_t println( double value );
+
+    size_t printf( const char* fmt, ... ) __attribute__( ( format( printf, 2, 3 ) ) );
+    void   flush( void );
+};
+
+extern HardwareSerial Serial;
+
+#endif  // ARDUINO_H
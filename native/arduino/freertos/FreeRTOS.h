@@ -0,0 +1,30 @@
+/*!
+ * \file      FreeRTOS.h
+ *
+ * \brief     FreeRTOS types used by the firmware, host-native implementation (1 tick = 1 ms)
+ */
+
+#ifndef INC_FREERTOS_H
+#define INC_FREERTOS_H
+
+#include <stdint.h>
+
+typedef uint32_t TickType_t;
+typedef int      BaseType_t;
+typedef unsigned UBaseType_t;
+
+#define configTICK_RATE_HZ 1000
+#define portTICK_PERIOD_MS 1
+#define portMAX_DELAY ( ( TickType_t ) 0xFFFFFFFFUL )
+#define pdMS_TO_TICKS( ms ) ( ( TickType_t ) ( ms ) )
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+
+// Single-threaded host: there is no interrupt context, simulated irq run from the task that advances the clock
+#define xPortInIsrContext( ) pdFALSE
+#define portYIELD_FROM_ISR( woken ) ( ( void ) ( woken ) )
+
+#endif  // INC_FREERTOS_H
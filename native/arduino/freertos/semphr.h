@@ -0,0 +1,29 @@
+/*!
+ * \file      semphr.h
+ *
+ * \brief     FreeRTOS semaphore API used by the firmware, host-native implementation
+ *
+ * Only binary semaphores are provided. xSemaphoreTake() advances the virtual clock like ulTaskNotifyTake().
+ */
+
+#ifndef SEMAPHORE_H
+#define SEMAPHORE_H
+
+#include "FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct native_semaphore_s* SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateBinary( void );
+BaseType_t        xSemaphoreGive( SemaphoreHandle_t semaphore );
+BaseType_t        xSemaphoreGiveFromISR( SemaphoreHandle_t semaphore, BaseType_t* higher_priority_task_woken );
+BaseType_t        xSemaphoreTake( SemaphoreHandle_t semaphore, TickType_t ticks_to_wait );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SEMAPHORE_H
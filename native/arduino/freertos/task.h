@@ -0,0 +1,41 @@
+/*!
+ * \file      task.h
+ *
+ * \brief     FreeRTOS task API used by the firmware, host-native implementation
+ *
+ * The host build is single threaded: there is one task (the sketch) and blocking calls advance the virtual
+ * clock instead of yielding to a scheduler.
+ */
+
+#ifndef INC_TASK_H
+#define INC_TASK_H
+
+#include "FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void* TaskHandle_t;
+typedef void ( *TaskFunction_t )( void* );
+
+void vTaskDelay( const TickType_t ticks );
+void vTaskDelete( TaskHandle_t task );
+
+TickType_t xTaskGetTickCount( void );
+
+TaskHandle_t xTaskGetCurrentTaskHandle( void );
+
+/**
+ * Notifications target the only task. ulTaskNotifyTake() advances the virtual clock one event at a time so a
+ * notification given by a simulated irq ends the wait at the virtual time of that irq.
+ */
+uint32_t   ulTaskNotifyTake( BaseType_t clear_count_on_exit, TickType_t ticks_to_wait );
+BaseType_t xTaskNotifyGive( TaskHandle_t task );
+void       vTaskNotifyGiveFromISR( TaskHandle_t task, BaseType_t* higher_priority_task_woken );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // INC_TASK_H
@@ -0,0 +1,135 @@
+/*!
+ * \file      freertos_native.c
+ *
+ * \brief     FreeRTOS task API used by the firmware, host-native implementation
+ */
+
+#include <stddef.h>
+
+#include <stdlib.h>
+
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "sim_clock.h"
+#include "smtc_hal_mcu.h"
+
+struct native_semaphore_s
+{
+    uint32_t count;
+};
+
+static uint32_t notify_count = 0;
+
+// Any non-NULL value, there is a single task
+static int main_task;
+
+void vTaskDelay( const TickType_t ticks )
+{
+    hal_mcu_set_sleep_for_ms( ( int32_t ) ticks );
+}
+
+void vTaskDelete( TaskHandle_t task )
+{
+    ( void ) task;
+}
+
+TickType_t xTaskGetTickCount( void )
+{
+    return ( TickType_t ) sim_clock_now_ms( );
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle( void )
+{
+    return &main_task;
+}
+
+/**
+ * Advance the virtual clock event by event until *count becomes non-zero or the wait expires
+ */
+static void block_on( const volatile uint32_t* count, TickType_t ticks_to_wait )
+{
+    const uint64_t deadline_us =
+        ( ticks_to_wait == portMAX_DELAY ) ? SIM_CLOCK_NO_EVENT : sim_clock_now_us( ) + ( uint64_t ) ticks_to_wait * 1000u;
+
+    while( ( *count == 0 ) && ( sim_clock_now_us( ) < deadline_us ) )
+    {
+        uint64_t next_us = sim_clock_next_event_us( );
+        if( next_us == SIM_CLOCK_NO_EVENT )
+        {
+            if( deadline_us == SIM_CLOCK_NO_EVENT )
+            {
+                // Nothing can ever wake the task up
+                break;
+            }
+            next_us = deadline_us;
+        }
+        if( next_us > deadline_us )
+        {
+            next_us = deadline_us;
+        }
+        sim_clock_advance_us( ( next_us > sim_clock_now_us( ) ) ? next_us - sim_clock_now_us( ) : 0 );
+    }
+}
+
+uint32_t ulTaskNotifyTake( BaseType_t clear_count_on_exit, TickType_t ticks_to_wait )
+{
+    block_on( &notify_count, ticks_to_wait );
+
+    const uint32_t count = notify_count;
+    if( count != 0 )
+    {
+        notify_count = ( clear_count_on_exit != pdFALSE ) ? 0 : count - 1;
+    }
+    return count;
+}
+
+BaseType_t xTaskNotifyGive( TaskHandle_t task )
+{
+    ( void ) task;
+    notify_count++;
+    return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR( TaskHandle_t task, BaseType_t* higher_priority_task_woken )
+{
+    xTaskNotifyGive( task );
+    if( higher_priority_task_woken != NULL )
+    {
+        *higher_priority_task_woken = pdTRUE;
+    }
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary( void )
+{
+    return ( SemaphoreHandle_t ) calloc( 1, sizeof( struct native_semaphore_s ) );
+}
+
+BaseType_t xSemaphoreGive( SemaphoreHandle_t semaphore )
+{
+    if( semaphore->count != 0 )
+    {
+        return pdFAIL;
+    }
+    semaphore->count = 1;
+    return pdPASS;
+}
+
+BaseType_t xSemaphoreGiveFromISR( SemaphoreHandle_t semaphore, BaseType_t* higher_priority_task_woken )
+{
+    if( higher_priority_task_woken != NULL )
+    {
+        *higher_priority_task_woken = pdTRUE;
+    }
+    return xSemaphoreGive( semaphore );
+}
+
+BaseType_t xSemaphoreTake( SemaphoreHandle_t semaphore, TickType_t ticks_to_wait )
+{
+    block_on( &semaphore->count, ticks_to_wait );
+    if( semaphore->count == 0 )
+    {
+        return pdFAIL;
+    }
+    semaphore->count = 0;
+    return pdPASS;
+}
@@ -0,0 +1,252 @@
+/*!
+ * \file      bench_aggregation.cpp
+ *
+ * \brief     Uplink aggregation benchmark: application payload bytes per second of airtime
+ *
+ * Four simulated sensors produce 4 to 12 byte readings. In "direct" mode each reading is its own uplink through
+ * LoRaWANClass::send(), in "aggregated" mode it is queued with LoRaWANClass::queueRecord(). The simulated
+ * network server decodes what it receives, so only readings that actually reached it are counted, and the
+ * airtime is that of every data uplink put on the air, retransmissions included.
+ *
+ * Usage: program [-m direct|aggregated] [-d seconds] [-p period_s] [-b budget_s] [-s seed] [-u uplink_loss_%] [-v]
+ *   -m  send mode (default aggregated)
+ *   -d  simulated duration in seconds (default 21600)
+ *   -p  reading period of each sensor in seconds (default 60)
+ *   -b  latency budget of a reading in seconds, aggregated mode (default 300)
+ *   -s  seed of the modem random generator and of the network loss pattern (default 1)
+ *   -u  percentage of uplinks lost between the device and the gateway
+ *   -v  print the modem traces
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "bench_join.h"
+#include "lbm_api.h"
+
+extern "C" {
+#include "sim_clock.h"
+#include "sim_network.h"
+#include "smtc_hal_dbg_trace.h"
+#include "smtc_modem_hal_native.h"
+}
+
+#define NB_SENSORS 4
+#define DIRECT_PORT 2
+
+static const uint8_t reading_sizes[NB_SENSORS] = { 4, 6, 8, 12 };
+
+// Device side
+static uint32_t readings_generated = 0;
+static uint32_t readings_refused   = 0;
+
+// Server side
+static uint32_t readings_received = 0;
+static uint32_t reading_bytes     = 0;
+static uint32_t frames_received   = 0;
+static uint32_t malformed_frames  = 0;
+
+static void print_usage( const char* name )
+{
+    fprintf( stderr,
+             "usage: %s [-m direct|aggregated] [-d seconds] [-p period_s] [-b budget_s] [-s seed] [-u uplink_loss_%%] "
+             "[-v]\n",
+             name );
+}
+
+static void on_record( uint8_t type, const uint8_t* data, uint8_t size, void* context )
+{
+    ( void ) type;
+    ( void ) data;
+    ( void ) context;
+    readings_received++;
+    reading_bytes += size;
+}
+
+static void on_uplink( uint8_t fport, const uint8_t* payload, uint8_t size, uint32_t time_on_air_us )
+{
+    ( void ) time_on_air_us;
+    frames_received++;
+    if( fport == LBM_AGGREGATOR_PORT )
+    {
+        if( lbm_aggregator_decode( payload, size, on_record, NULL ) < 0 )
+        {
+            malformed_frames++;
+        }
+    }
+    else if( fport == DIRECT_PORT )
+    {
+        on_record( 0, payload, size, NULL );
+    }
+}
+
+static void make_reading( uint8_t sensor, uint8_t* reading )
+{
+    const uint32_t value = readings_generated;
+    for( uint8_t i = 0; i < reading_sizes[sensor]; i++ )
+    {
+        reading[i] = ( uint8_t ) ( value >> ( 8 * ( i % 4 ) ) );
+    }
+}
+
+int main( int argc, char** argv )
+{
+    bool     aggregated = true;
+    uint32_t duration_s = 21600;
+    uint32_t period_s   = 60;
+    uint32_t budget_s   = 300;
+    uint32_t seed       = 1;
+    bool     verbose    = false;
+
+    sim_network_config_t network_config;
+    sim_network_get_default_config( &network_config );
+
+    int opt;
+    while( ( opt = getopt( argc, argv, "m:d:p:b:s:u:v" ) ) != -1 )
+    {
+        switch( opt )
+        {
+        case 'm':
+            if( strcmp( optarg, "direct" ) == 0 )
+            {
+                aggregated = false;
+            }
+            else if( strcmp( optarg, "aggregated" ) != 0 )
+            {
+                print_usage( argv[0] );
+                return 1;
+            }
+            break;
+        case 'd':
+            duration_s = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'p':
+            period_s = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'b':
+            budget_s = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 's':
+            seed = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'u':
+            network_config.uplink_loss_percent = ( uint8_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'v':
+            verbose = true;
+            break;
+        default:
+            print_usage( argv[0] );
+            return 1;
+        }
+    }
+    if( period_s == 0 )
+    {
+        print_usage( argv[0] );
+        return 1;
+    }
+    network_config.seed = seed;
+
+    hal_trace_set_quiet( !verbose );
+    sim_clock_reset( );
+    smtc_modem_hal_native_set_seed( seed );
+    sim_network_configure( &network_config );
+    sim_network_set_uplink_handler( on_uplink );
+
+    lbm.init( );
+    bench_join_start( lbm, NULL );
+
+    // Sensors are spread over the period and start once the device has joined
+    const uint64_t end_us = ( uint64_t ) duration_s * 1000000ULL;
+    uint64_t       next_reading_us[NB_SENSORS];
+    bool           started = false;
+
+    while( sim_clock_now_us( ) < end_us )
+    {
+        uint32_t wait_ms = 1000;
+        if( started == true )
+        {
+            uint64_t next_us = end_us;
+            for( uint8_t sensor = 0; sensor < NB_SENSORS; sensor++ )
+            {
+                next_us = ( next_reading_us[sensor] < next_us ) ? next_reading_us[sensor] : next_us;
+            }
+            const uint64_t now_us = sim_clock_now_us( );
+            wait_ms               = ( next_us > now_us ) ? ( uint32_t ) ( ( next_us - now_us + 999 ) / 1000 ) : 0;
+        }
+        lbm.runEngineUntilEvent( wait_ms );
+
+        if( ( started == false ) && ( bench_joined( ) == true ) )
+        {
+            started = true;
+            for( uint8_t sensor = 0; sensor < NB_SENSORS; sensor++ )
+            {
+                next_reading_us[sensor] = sim_clock_now_us( ) + ( uint64_t ) period_s * 1000000ULL * sensor / NB_SENSORS;
+            }
+        }
+        if( started == false )
+        {
+            continue;
+        }
+
+        for( uint8_t sensor = 0; sensor < NB_SENSORS; sensor++ )
+        {
+            if( sim_clock_now_us( ) < next_reading_us[sensor] )
+            {
+                continue;
+            }
+            next_reading_us[sensor] += ( uint64_t ) period_s * 1000000ULL;
+
+            uint8_t reading[LBM_AGGREGATOR_MAX_RECORD_SIZE];
+            make_reading( sensor, reading );
+            readings_generated++;
+
+            const smtc_modem_return_code_t ret =
+                ( aggregated == true )
+                    ? lbm.lorawan.queueRecord( sensor, reading, reading_sizes[sensor], budget_s * 1000u )
+                    : lbm.lorawan.send( reading, reading_sizes[sensor], DIRECT_PORT, false );
+            if( ret != SMTC_MODEM_RC_OK )
+            {
+                readings_refused++;
+            }
+        }
+    }
+
+    sim_network_stats_t network;
+    sim_network_get_stats( &network );
+    const double airtime_s = ( double ) network.uplink_time_on_air_us / 1e6;
+
+    printf( "\n===== uplink aggregation benchmark =====\n" );
+    printf( "mode               : %s\n", ( aggregated == true ) ? "aggregated" : "direct" );
+    printf( "virtual time       : %.0f s (%u sensors every %u s", ( double ) sim_clock_now_us( ) / 1e6, NB_SENSORS,
+            period_s );
+    if( aggregated == true )
+    {
+        printf( ", budget %u s", budget_s );
+    }
+    printf( ")\n" );
+    printf( "readings           : %u generated, %u refused by the device, %u received (%u bytes)\n",
+            readings_generated, readings_refused, readings_received, reading_bytes );
+    printf( "data uplinks       : %u on air, %u new frames (%.2f readings/frame), %u malformed\n", network.uplinks,
+            frames_received, ( frames_received > 0 ) ? ( double ) readings_received / frames_received : 0.0,
+            malformed_frames );
+    printf( "airtime            : %.3f s\n", airtime_s );
+    printf( "payload efficiency : %.1f reading bytes per airtime second\n",
+            ( airtime_s > 0 ) ? ( double ) reading_bytes / airtime_s : 0.0 );
+    if( aggregated == true )
+    {
+        lbm_aggregator_stats_t stats;
+        lbm.lorawan.getAggregationStats( &stats );
+        printf( "aggregator         : %u full, %u deadline flushes, %u late, %u dropped, %u oversized, %u pending\n",
+                stats.full_flushes, stats.deadline_flushes, stats.records_late, stats.records_dropped,
+                stats.records_oversized, stats.pending );
+        printf( "                     %u duty-cycle holds, %u frames requeued\n", stats.duty_cycle_holds,
+                stats.frames_requeued );
+    }
+    return 0;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
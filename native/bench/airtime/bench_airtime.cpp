@@ -0,0 +1,322 @@
+/*!
+ * \file      bench_airtime.cpp
+ *
+ * \brief     Time on air of lbm_airtime against the floating-point reference formulas, and the duty-cycle planner
+ *
+ * Only lbm_airtime.cpp is linked, with the region and the duty-cycle status of the modem stubbed here.
+ *
+ * - Every EU868 and AS923 data rate, for every application payload size from 0 to the maximum of the data rate:
+ *   lbm_airtime_get() must match the reference of its modulation, the Semtech AN1200.13 formula in double
+ *   precision for LoRa, the bit count for FSK, and the 233.472 ms headers and 102.4 ms fragments for LR-FHSS.
+ *   One byte above the maximum, and an RFU data rate, must be refused.
+ * - LoRa frames at SF7 to SF12 on 125, 250 and 500 kHz, coding rates 4/5 to 4/8, PHY payloads of 0 to 255
+ *   bytes, with every combination of implicit / explicit header, CRC on / off and low data rate optimization
+ *   on / off: lbm_airtime_lora_frame_us() must match the reference.
+ * - lbm_airtime_earliest_send() with the duty-cycle status returning budget left, none, a wait, and an error.
+ *
+ * The LoRa symbol time is a whole number of microseconds at these bandwidths, so the integer formulas must be
+ * exact; FSK and LR-FHSS are allowed the rounding down to the microsecond.
+ *
+ * Usage: program [-v]
+ *   -v  print each data rate with its shortest and longest time on air
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "lbm_airtime.h"
+
+#define STACK_ID 0
+
+// Answers of the stubbed modem
+static smtc_modem_region_t      region           = SMTC_MODEM_REGION_EU_868;
+static int32_t                  duty_cycle_ms    = 0;
+static smtc_modem_return_code_t duty_cycle_rc    = SMTC_MODEM_RC_OK;
+static uint32_t                 duty_cycle_calls = 0;
+
+static uint32_t checks   = 0;
+static uint32_t failures = 0;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- MODEM CALLS OF LBM_AIRTIME ----------------------------------------------
+ */
+
+extern "C" smtc_modem_return_code_t smtc_modem_get_region( uint8_t stack_id, smtc_modem_region_t* region_out )
+{
+    ( void ) stack_id;
+    *region_out = region;
+    return SMTC_MODEM_RC_OK;
+}
+
+extern "C" smtc_modem_return_code_t smtc_modem_get_duty_cycle_status( uint8_t stack_id, int32_t* status_ms )
+{
+    ( void ) stack_id;
+    duty_cycle_calls++;
+    *status_ms = duty_cycle_ms;
+    return duty_cycle_rc;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- REFERENCE FORMULAS ------------------------------------------------------
+ */
+
+// Semtech AN1200.13, in seconds
+static double lora_reference_s( uint32_t sf, uint32_t bw_hz, uint32_t cr, uint32_t preamble, uint32_t phy_size,
+                                 bool implicit_header, bool crc, bool ldro )
+{
+    const double symbol_s = pow( 2.0, ( double ) sf ) / ( double ) bw_hz;
+    const double preamble_s = ( ( double ) preamble + 4.25 ) * symbol_s;
+    const double numerator  = 8.0 * phy_size - 4.0 * sf + 28.0 + ( crc ? 16.0 : 0.0 ) - ( implicit_header ? 20.0 : 0.0 );
+    const double symbols    = 8.0 + fmax( ceil( numerator / ( 4.0 * ( ( double ) sf - ( ldro ? 2.0 : 0.0 ) ) ) ) *
+                                              ( ( double ) cr + 4.0 ),
+                                          0.0 );
+    return preamble_s + symbols * symbol_s;
+}
+
+// Preamble, 3-byte sync word, length byte, payload and CRC-16
+static double fsk_reference_s( uint32_t bps, uint32_t preamble, uint32_t phy_size )
+{
+    return ( double ) ( preamble + 3 + 1 + phy_size + 2 ) * 8.0 / ( double ) bps;
+}
+
+// Headers of 233.472 ms, then the coded payload (PHY payload, CRC-16, 6 tail bits at rate cr/3) in fragments of
+// 48 bits led by 2 sync bits at 488.28125 bps, the last one shorter
+static double lr_fhss_reference_s( uint32_t cr, uint32_t headers, uint32_t phy_size )
+{
+    const double bit_s = 1.0 / 488.28125;
+    const double coded = ( 8.0 * ( phy_size + 2 ) + 6.0 ) * 3.0 / ( double ) cr;
+    const double full  = floor( coded / 48.0 );
+    const double last  = coded - 48.0 * full;
+    return headers * 0.233472 + full * 50.0 * bit_s + ( ( last > 0.0 ) ? ( last + 2.0 ) * bit_s : 0.0 );
+}
+
+static double reference_us( const lbm_airtime_datarate_t& dr, uint32_t phy_size )
+{
+    switch( dr.modulation )
+    {
+    case LBM_AIRTIME_FSK:
+        return fsk_reference_s( dr.fsk_bps, dr.preamble, phy_size ) * 1e6;
+    case LBM_AIRTIME_LR_FHSS:
+        return lr_fhss_reference_s( dr.cr, dr.preamble, phy_size ) * 1e6;
+    default:
+        return lora_reference_s( dr.sf, dr.bw_khz * 1000u, dr.cr, dr.preamble, phy_size, false, true,
+                                 lbm_airtime_ldro( dr ) != 0 ) *
+               1e6;
+    }
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- CHECKS ------------------------------------------------------------------
+ */
+
+static void check( bool condition, const char* what, uint32_t a, uint32_t b, uint32_t c )
+{
+    checks++;
+    if( condition == false )
+    {
+        if( failures < 20 )
+        {
+            printf( "  FAILED: %s (%u, %u, %u)\n", what, a, b, c );
+        }
+        failures++;
+    }
+}
+
+// Integer time on air against the reference: exact, or rounded down to the microsecond
+static bool matches( uint32_t time_us, double reference, bool exact )
+{
+    return ( exact == true ) ? ( fabs( ( double ) time_us - reference ) < 1e-6 )
+                             : ( ( double ) time_us <= reference + 1e-6 ) && ( reference - time_us < 1.0 );
+}
+
+// The constexpr tables have a copy in each translation unit, compare them by content
+static bool same_table( const lbm_airtime_datarate_t* a, const lbm_airtime_datarate_t* b )
+{
+    return ( a != nullptr ) && ( memcmp( a, b, sizeof( lbm_airtime_datarate_t ) * LBM_AIRTIME_NB_DATARATES ) == 0 );
+}
+
+static void check_region( smtc_modem_region_t checked, const char* name, const lbm_airtime_datarate_t* table,
+                          bool verbose )
+{
+    region = checked;
+    check( same_table( lbm_airtime_get_table( checked ), table ), "region table", checked, 0, 0 );
+
+    for( uint8_t datarate = 0; datarate < LBM_AIRTIME_NB_DATARATES; datarate++ )
+    {
+        const lbm_airtime_datarate_t& dr = table[datarate];
+        uint32_t                      time_us;
+
+        if( dr.max_payload == 0 )
+        {
+            check( lbm_airtime_get( STACK_ID, datarate, 0, &time_us ) == SMTC_MODEM_RC_INVALID, "RFU data rate",
+                   checked, datarate, 0 );
+            continue;
+        }
+
+        uint32_t shortest_us = 0;
+        for( uint32_t size = 0; size <= dr.max_payload; size++ )
+        {
+            const smtc_modem_return_code_t rc = lbm_airtime_get( STACK_ID, datarate, ( uint8_t ) size, &time_us );
+            check( rc == SMTC_MODEM_RC_OK, "size accepted", checked, datarate, size );
+            check( matches( time_us, reference_us( dr, size + LBM_AIRTIME_FRAME_OVERHEAD ),
+                            dr.modulation == LBM_AIRTIME_LORA ),
+                   "uplink time on air", checked, datarate, size );
+            if( size == 0 )
+            {
+                shortest_us = time_us;
+            }
+        }
+        if( dr.max_payload < 255 )
+        {
+            check( lbm_airtime_get( STACK_ID, datarate, dr.max_payload + 1, &time_us ) == SMTC_MODEM_RC_INVALID,
+                   "size refused", checked, datarate, dr.max_payload + 1u );
+        }
+        if( verbose == true )
+        {
+            ( void ) lbm_airtime_get( STACK_ID, datarate, dr.max_payload, &time_us );
+            printf( "  %s DR%-2u: %.1f ms (0 bytes) to %.1f ms (%u bytes)\n", name, datarate,
+                    ( double ) shortest_us / 1000.0, ( double ) time_us / 1000.0, dr.max_payload );
+        }
+    }
+    check( lbm_airtime_get( STACK_ID, LBM_AIRTIME_NB_DATARATES, 0, nullptr ) == SMTC_MODEM_RC_INVALID,
+           "data rate out of range", checked, LBM_AIRTIME_NB_DATARATES, 0 );
+}
+
+static uint32_t check_lora_frames( void )
+{
+    static const uint16_t bandwidths[] = { 125, 250, 500 };
+    uint32_t              frames       = 0;
+
+    for( uint8_t sf = 7; sf <= 12; sf++ )
+    {
+        for( uint16_t bw_khz : bandwidths )
+        {
+            for( uint8_t cr = 1; cr <= 4; cr++ )
+            {
+                const lbm_airtime_datarate_t dr = { LBM_AIRTIME_LORA, sf, bw_khz, cr, 8, 0, 255 };
+                for( uint32_t variant = 0; variant < 8; variant++ )
+                {
+                    const bool implicit_header = ( variant & 1 ) != 0;
+                    const bool crc             = ( variant & 2 ) != 0;
+                    const bool ldro            = ( variant & 4 ) != 0;
+                    for( uint32_t size = 0; size <= 255; size++ )
+                    {
+                        const double reference =
+                            lora_reference_s( sf, bw_khz * 1000u, cr, 8, size, implicit_header, crc, ldro ) * 1e6;
+                        check( matches( lbm_airtime_lora_frame_us( dr, size, implicit_header, crc, ldro ), reference,
+                                        true ),
+                               "LoRa frame (SF, kHz, size)", sf, bw_khz, size );
+                        frames++;
+                    }
+                }
+                // The optimization follows the 16 ms symbol time rule for uplinks
+                check( ( lbm_airtime_ldro( dr ) != 0 ) == ( ( 1000.0 * ( 1u << sf ) / bw_khz ) >= 16000.0 ),
+                       "LDRO rule (SF, kHz)", sf, bw_khz, 0 );
+            }
+        }
+    }
+    return frames;
+}
+
+static void check_earliest_send( void )
+{
+    region = SMTC_MODEM_REGION_EU_868;
+    uint32_t time_us;
+    ( void ) lbm_airtime_get( STACK_ID, 0, 51, &time_us );
+    const int32_t time_on_air_ms = ( int32_t ) ( ( time_us + 999 ) / 1000 );
+
+    struct
+    {
+        int32_t  status_ms;
+        uint32_t wait_ms;
+        int32_t  budget_after_ms;
+    } cases[] = {
+        { 36000, 0, 36000 - time_on_air_ms },  // budget left, more than the frame
+        { 1000, 0, 1000 - time_on_air_ms },    // budget left, less than the frame: sent, next one waits
+        { 0, 0, -time_on_air_ms },             // budget just exhausted
+        { -5000, 5000, -time_on_air_ms },      // band busy for 5 s
+    };
+
+    for( uint32_t i = 0; i < sizeof( cases ) / sizeof( cases[0] ); i++ )
+    {
+        duty_cycle_ms   = cases[i].status_ms;
+        duty_cycle_rc   = SMTC_MODEM_RC_OK;
+        uint32_t wait_ms = UINT32_MAX;
+        int32_t  budget  = INT32_MIN;
+        const smtc_modem_return_code_t rc = lbm_airtime_earliest_send( STACK_ID, 0, 51, &wait_ms, &budget );
+        check( ( rc == SMTC_MODEM_RC_OK ) && ( wait_ms == cases[i].wait_ms ) &&
+                   ( budget == cases[i].budget_after_ms ),
+               "earliest send (case, wait, budget)", i, wait_ms, ( uint32_t ) budget );
+
+        // The budget is optional
+        check( lbm_airtime_earliest_send( STACK_ID, 0, 51, &wait_ms, nullptr ) == SMTC_MODEM_RC_OK,
+               "earliest send without budget", i, 0, 0 );
+    }
+
+    // The modem error is passed on, an invalid uplink is refused before asking the modem
+    uint32_t wait_ms;
+    duty_cycle_rc = SMTC_MODEM_RC_NOT_INIT;
+    check( lbm_airtime_earliest_send( STACK_ID, 0, 51, &wait_ms, nullptr ) == SMTC_MODEM_RC_NOT_INIT,
+           "duty-cycle error passed on", 0, 0, 0 );
+    duty_cycle_rc                = SMTC_MODEM_RC_OK;
+    const uint32_t calls_before = duty_cycle_calls;
+    check( lbm_airtime_earliest_send( STACK_ID, 0, 52, &wait_ms, nullptr ) == SMTC_MODEM_RC_INVALID,
+           "oversized uplink refused", 0, 52, 0 );
+    check( duty_cycle_calls == calls_before, "no duty-cycle request for a refused uplink", 0, 0, 0 );
+
+    region = SMTC_MODEM_REGION_US_915;
+    check( lbm_airtime_earliest_send( STACK_ID, 0, 10, &wait_ms, nullptr ) == SMTC_MODEM_RC_INVALID,
+           "region not built in", 0, 0, 0 );
+}
+
+static void print_usage( const char* name )
+{
+    fprintf( stderr, "usage: %s [-v]\n", name );
+}
+
+int main( int argc, char** argv )
+{
+    bool verbose = false;
+
+    int opt;
+    while( ( opt = getopt( argc, argv, "v" ) ) != -1 )
+    {
+        switch( opt )
+        {
+        case 'v':
+            verbose = true;
+            break;
+        default:
+            print_usage( argv[0] );
+            return 1;
+        }
+    }
+
+    printf( "\n===== time on air =====\n" );
+    uint32_t before = checks;
+    check_region( SMTC_MODEM_REGION_EU_868, "EU868", LBM_AIRTIME_EU868, verbose );
+    printf( "EU868              : %u checks\n", checks - before );
+    before = checks;
+    check_region( SMTC_MODEM_REGION_AS_923, "AS923", LBM_AIRTIME_AS923, verbose );
+    check( same_table( lbm_airtime_get_table( SMTC_MODEM_REGION_AS_923_GRP3 ), LBM_AIRTIME_AS923 ), "AS923 group 3", 0,
+           0, 0 );
+    printf( "AS923              : %u checks\n", checks - before );
+    const uint32_t frames = check_lora_frames( );
+    printf( "LoRa frames        : %u (SF7-SF12, 125/250/500 kHz, CR 4/5-4/8, header, CRC and LDRO variants)\n",
+            frames );
+    before = checks;
+    check_earliest_send( );
+    printf( "earliest send      : %u checks\n", checks - before );
+    printf( "total              : %u checks, %u failed\n", checks, failures );
+
+    printf( "\n%s\n", ( failures == 0 ) ? "PASS" : "FAIL" );
+    return ( failures == 0 ) ? 0 : 1;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,407 @@
+/*!
+ * \file      bench_class_b.cpp
+ *
+ * \brief     Class B benchmark: beacon acquisition, ping-slot downlink latency and radio-on time per periodicity
+ *
+ * Once joined, the device switches to Class B with lbm.lorawan.startClassB() while the simulated network puts a
+ * beacon on the air every 128 s and answers DeviceTimeReq / PingSlotInfoReq. When the beacon is locked, the
+ * network sends application downlinks at random times, each one in the next ping slot of the device, for the
+ * beacon periods measured. An outage of the beacons (gateway off) can be injected to exercise missed-beacon
+ * recovery.
+ *
+ * It prints the acquisition time, the beacons received, missed and recovered, the radio-on time per beacon period
+ * and per ping slot measured by lbm_class_b.cpp (checked against the RX time of the radio model), the average
+ * current it adds for the RX current given, and the downlink latency from the network to the application against
+ * the 2^periodicity s ping period: run it for several periodicities to choose one.
+ *
+ * The bench fails if the beacon is never locked, if the network never acknowledged the periodicity, if a downlink
+ * reaches the application outside the slot it was sent in, if the measured radio-on time differs from the radio
+ * model by more than 2%, or, without beacon outage nor losses, if a downlink put on the air is not received. With
+ * an outage, the beacon must be received again by the end.
+ *
+ * Usage: program [-p periodicity] [-n periods] [-d downlinks] [-k periods] [-g period] [-o periods]
+ *                [-b beacon_loss_%] [-u downlink_loss_%] [-i rx_ma] [-s seed] [-v]
+ *   -p  ping-slot periodicity, a slot every 2^p s, 0 to 7 (default 3)
+ *   -n  beacon periods measured once the beacon is locked (default 10)
+ *   -d  downlinks sent per beacon period (default 2)
+ *   -k  an uplink every k beacon periods, 0 for none (default 4)
+ *   -g  beacon period of the measure at which the beacons stop, 0 for no outage (default 0)
+ *   -o  beacon periods without beacon from then on (default 2)
+ *   -b  percentage of beacons lost between the gateway and the device
+ *   -u  percentage of downlinks lost between the gateway and the device
+ *   -i  RX current of the radio in mA, to turn radio-on time into current (default 4.6)
+ *   -s  seed of the modem random generator and of the network loss pattern (default 1)
+ *   -v  print the modem traces
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "bench_join.h"
+#include "lbm_api.h"
+
+extern "C" {
+#include "sim_clock.h"
+#include "sim_network.h"
+#include "sim_radio.h"
+#include "smtc_hal_dbg_trace.h"
+#include "smtc_modem_hal.h"
+#include "smtc_modem_hal_native.h"
+}
+
+#define DOWNLINK_PORT 20
+#define UPLINK_PORT 2
+#define DOWNLINK_SIZE 8
+#define MAX_DOWNLINKS 1024
+
+#define BEACON_PERIOD_US ( ( uint64_t ) LBM_CLASS_B_BEACON_PERIOD_S * 1000000ULL )
+
+// Beacon periods given to the acquisition
+#define ACQUISITION_PERIODS 8
+
+// Network side
+static uint32_t downlinks_per_period = 2;
+static uint32_t sent                 = 0;  // downlinks handed to the network, lost ones included
+static uint32_t refused              = 0;
+static uint64_t queued_us[MAX_DOWNLINKS];
+static uint64_t slot_us[MAX_DOWNLINKS];
+
+// Application side
+static uint32_t             received   = 0;
+static uint32_t             duplicated = 0;
+static uint32_t             corrupted  = 0;
+static uint32_t             off_slot   = 0;  // received outside the slot the network chose
+static bool                 seen[MAX_DOWNLINKS];
+static lbm_uplink_latency_t latency;
+static uint64_t             latency_total_ms = 0;
+
+static void print_usage( const char* name )
+{
+    fprintf( stderr,
+             "usage: %s [-p periodicity] [-n periods] [-d downlinks] [-k periods] [-g period] [-o periods] "
+             "[-b beacon_loss_%%] [-u downlink_loss_%%] [-i rx_ma] [-s seed] [-v]\n",
+             name );
+}
+
+static void fill_payload( uint32_t index, uint8_t* payload )
+{
+    payload[0] = ( uint8_t ) index;
+    payload[1] = ( uint8_t ) ( index >> 8 );
+    for( uint8_t i = 2; i < DOWNLINK_SIZE; i++ )
+    {
+        payload[i] = ( uint8_t ) ( ( index * 13u ) + i );
+    }
+}
+
+static void on_downlink_due( void* context )
+{
+    ( void ) context;
+    uint8_t payload[DOWNLINK_SIZE];
+
+    if( sent >= MAX_DOWNLINKS )
+    {
+        return;
+    }
+    fill_payload( sent, payload );
+    queued_us[sent] = sim_clock_now_us( );
+    if( sim_network_send_ping_slot( DOWNLINK_PORT, payload, sizeof( payload ), &slot_us[sent] ) == false )
+    {
+        refused++;
+        slot_us[sent] = UINT64_MAX;
+    }
+    sent++;
+}
+
+static void on_beacons_stop( void* context )
+{
+    ( void ) context;
+    sim_network_stop_beacons( );
+}
+
+static void on_beacons_start( void* context )
+{
+    ( void ) context;
+    sim_network_start_beacons( );
+}
+
+static void on_downlink( lbm_dl_buffer_t* downlink )
+{
+    const uint64_t now_us = sim_clock_now_us( );
+
+    if( downlink->metadata.fport == DOWNLINK_PORT )
+    {
+        uint8_t        expected[DOWNLINK_SIZE];
+        const uint32_t index = ( uint32_t ) downlink->payload[0] | ( ( uint32_t ) downlink->payload[1] << 8 );
+        if( index < sent )
+        {
+            fill_payload( index, expected );
+        }
+        if( ( downlink->size != DOWNLINK_SIZE ) || ( index >= sent ) ||
+            ( memcmp( downlink->payload, expected, DOWNLINK_SIZE ) != 0 ) )
+        {
+            corrupted++;
+        }
+        else if( seen[index] == true )
+        {
+            duplicated++;
+        }
+        else
+        {
+            seen[index] = true;
+            received++;
+            // Received within the frame that started in its slot, processing included
+            if( ( now_us < slot_us[index] ) || ( ( now_us - slot_us[index] ) > 500000u ) )
+            {
+                off_slot++;
+            }
+            lbm_uplink_latency_add( &latency, &latency_total_ms, ( uint32_t ) ( ( now_us - queued_us[index] ) / 1000u ) );
+        }
+    }
+    lbm.releaseDownlink( downlink );
+}
+
+static void send_uplink( void )
+{
+    static uint8_t counter = 0;
+    const uint8_t  reading[2] = { 0xB0, counter++ };
+    ( void ) lbm.lorawan.send( reading, sizeof( reading ), UPLINK_PORT, false );
+}
+
+static void run_until( uint64_t end_us, uint32_t uplink_periods, uint64_t* next_uplink_us )
+{
+    while( sim_clock_now_us( ) < end_us )
+    {
+        const uint64_t now_us = sim_clock_now_us( );
+        if( ( uplink_periods > 0 ) && ( now_us >= *next_uplink_us ) )
+        {
+            send_uplink( );
+            *next_uplink_us += uplink_periods * BEACON_PERIOD_US;
+        }
+        const uint64_t until_us = ( ( uplink_periods > 0 ) && ( *next_uplink_us < end_us ) ) ? *next_uplink_us : end_us;
+        lbm.runEngineUntilEvent( ( until_us > now_us ) ? ( uint32_t ) ( ( until_us - now_us + 999 ) / 1000 ) : 0 );
+    }
+}
+
+static const char* state_name( lbm_class_b_state_t state )
+{
+    switch( state )
+    {
+    case LBM_CLASS_B_STATE_TIME_SYNC:
+        return "time sync";
+    case LBM_CLASS_B_STATE_ACQUISITION:
+        return "acquisition";
+    case LBM_CLASS_B_STATE_READY:
+        return "ready";
+    default:
+        return "off";
+    }
+}
+
+int main( int argc, char** argv )
+{
+    uint32_t periodicity    = 3;
+    uint32_t periods        = 10;
+    uint32_t uplink_periods = 4;
+    uint32_t outage_period  = 0;
+    uint32_t outage_periods = 2;
+    float    rx_ma          = 4.6f;
+    uint32_t seed           = 1;
+    bool     verbose        = false;
+
+    sim_network_config_t network_config;
+    sim_network_get_default_config( &network_config );
+
+    int opt;
+    while( ( opt = getopt( argc, argv, "p:n:d:k:g:o:b:u:i:s:v" ) ) != -1 )
+    {
+        switch( opt )
+        {
+        case 'p':
+            periodicity = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'n':
+            periods = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'd':
+            downlinks_per_period = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'k':
+            uplink_periods = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'g':
+            outage_period = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'o':
+            outage_periods = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'b':
+            network_config.beacon_loss_percent = ( uint8_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'u':
+            network_config.downlink_loss_percent = ( uint8_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'i':
+            rx_ma = strtof( optarg, NULL );
+            break;
+        case 's':
+            seed = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'v':
+            verbose = true;
+            break;
+        default:
+            print_usage( argv[0] );
+            return 1;
+        }
+    }
+    if( ( periodicity > 7 ) || ( periods == 0 ) || ( ( periods * downlinks_per_period ) > MAX_DOWNLINKS ) ||
+        ( outage_period >= periods ) || ( rx_ma <= 0.0f ) )
+    {
+        print_usage( argv[0] );
+        return 1;
+    }
+    network_config.seed = seed;
+
+    hal_trace_set_quiet( !verbose );
+    sim_clock_reset( );
+    smtc_modem_hal_native_set_seed( seed );
+    sim_network_configure( &network_config );
+
+    lbm.init( );
+    lbm.setDownlinkCallback( on_downlink );
+    if( bench_join( lbm, NULL ) == false )
+    {
+        return 1;
+    }
+
+    // The gateway sends beacons whatever the device does
+    sim_network_start_beacons( );
+    const uint64_t start_us = sim_clock_now_us( );
+    const smtc_modem_return_code_t rc =
+        lbm.lorawan.startClassB( ( smtc_modem_class_b_ping_slot_periodicity_t ) periodicity );
+    if( rc != SMTC_MODEM_RC_OK )
+    {
+        printf( "class B not started: %d\n\nFAIL\n", rc );
+        return 1;
+    }
+
+    // Acquisition: the uplink carries the DeviceTimeReq and PingSlotInfoReq
+    lbm_class_b_stats_t class_b;
+    uint64_t            next_uplink_us = sim_clock_now_us( );
+    do
+    {
+        run_until( sim_clock_now_us( ) + BEACON_PERIOD_US / 4, ( uplink_periods > 0 ) ? uplink_periods : 1,
+                   &next_uplink_us );
+        lbm.lorawan.getClassBStats( &class_b );
+    } while( ( class_b.state != LBM_CLASS_B_STATE_READY ) &&
+             ( sim_clock_now_us( ) - start_us < ACQUISITION_PERIODS * BEACON_PERIOD_US ) );
+    const lbm_class_b_stats_t acquisition = class_b;
+    if( acquisition.state != LBM_CLASS_B_STATE_READY )
+    {
+        printf( "beacon not locked after %u beacon periods, state %s, %u beacon windows\n\nFAIL\n",
+                ACQUISITION_PERIODS, state_name( acquisition.state ), acquisition.beacon_windows );
+        return 1;
+    }
+
+    // Measure from the next beacon period on
+    const uint64_t measure_us = ( ( sim_clock_now_us( ) / BEACON_PERIOD_US ) + 1 ) * BEACON_PERIOD_US;
+    run_until( measure_us, uplink_periods, &next_uplink_us );
+    lbm.lorawan.resetClassBStats( );
+    sim_radio_stats_t radio_start;
+    sim_radio_get_stats( &radio_start );
+    sim_network_stats_t network_start;
+    sim_network_get_stats( &network_start );
+
+    srand( seed );
+    for( uint32_t period = 0; period < periods; period++ )
+    {
+        for( uint32_t i = 0; i < downlinks_per_period; i++ )
+        {
+            const uint64_t at_us = measure_us + period * BEACON_PERIOD_US +
+                                   ( ( uint64_t ) rand( ) % BEACON_PERIOD_US );
+            sim_clock_schedule_at_us( at_us, on_downlink_due, NULL );
+        }
+    }
+    if( outage_period > 0 )
+    {
+        sim_clock_schedule_at_us( measure_us + outage_period * BEACON_PERIOD_US - 1000000u, on_beacons_stop, NULL );
+        sim_clock_schedule_at_us( measure_us + ( outage_period + outage_periods ) * BEACON_PERIOD_US - 1000000u,
+                                  on_beacons_start, NULL );
+    }
+
+    // The last downlinks may wait up to a ping period, a beacon period at most
+    const uint64_t end_us = measure_us + ( uint64_t ) ( periods + 1 ) * BEACON_PERIOD_US;
+    run_until( end_us, uplink_periods, &next_uplink_us );
+
+    lbm.lorawan.getClassBStats( &class_b );
+    sim_radio_stats_t radio;
+    sim_radio_get_stats( &radio );
+    sim_network_stats_t network;
+    sim_network_get_stats( &network );
+
+    const uint32_t on_air   = network.ping_slot_downlinks - network_start.ping_slot_downlinks;
+    const uint32_t lost     = network.ping_slot_lost - network_start.ping_slot_lost;
+    const uint64_t radio_rx = radio.time_in_mode_us[SIM_RADIO_MODE_RX] - radio_start.time_in_mode_us[SIM_RADIO_MODE_RX];
+    const uint64_t measured = class_b.beacon_rx_us + class_b.ping_slot_rx_us + class_b.class_a_rx_us;
+    const double   rx_error = ( radio_rx > 0 ) ? fabs( ( double ) measured - ( double ) radio_rx ) / ( double ) radio_rx : 0.0;
+    const double   period_s = ( double ) LBM_CLASS_B_BEACON_PERIOD_S;
+    const double   class_b_ua =
+        ( double ) class_b.rx_us_per_beacon_period / ( period_s * 1e6 ) * ( double ) rx_ma * 1000.0;
+    latency.average_ms = ( latency.count > 0 ) ? ( float ) latency_total_ms / latency.count : 0.0f;
+
+    printf( "\n===== class B benchmark =====\n" );
+    printf( "configuration      : ping slot every %u s, %u beacon periods, %u downlinks per period, uplink every %u "
+            "periods\n",
+            1u << periodicity, periods, downlinks_per_period, uplink_periods );
+    printf( "virtual time       : %.0f s\n", ( double ) sim_clock_now_us( ) / 1e6 );
+    printf( "acquisition        : beacon locked in %.1f s, %u time requests, ping slot info %s\n",
+            ( double ) acquisition.acquisition_ms / 1000.0, acquisition.time_requests,
+            ( acquisition.ping_slot_info_answered == true ) ? "answered" : "not answered" );
+    if( outage_period > 0 )
+    {
+        printf( "beacon outage      : periods %u to %u\n", outage_period, outage_period + outage_periods - 1 );
+    }
+    printf( "beacons            : %u windows, %u received, %u missed (%u in a row at most), %u losses, %u "
+            "recoveries, state %s\n",
+            class_b.beacon_windows, class_b.beacons_received, class_b.beacons_missed, class_b.max_missed_in_row,
+            class_b.losses, class_b.recoveries, state_name( class_b.state ) );
+    printf( "network            : %u beacons, %u lost, %u downlinks sent, %u on the air, %u lost, %u refused\n",
+            network.beacons - network_start.beacons, network.beacons_lost - network_start.beacons_lost, sent, on_air,
+            lost, refused );
+    printf( "ping slots         : %u opened, %u frames, %u class A windows\n", class_b.ping_slots,
+            class_b.ping_slot_frames, class_b.class_a_windows );
+    printf( "radio-on           : %.2f ms per beacon window, %.2f ms per ping slot, %.1f ms per beacon period\n",
+            ( double ) class_b.rx_us_per_beacon / 1000.0, ( double ) class_b.rx_us_per_ping_slot / 1000.0,
+            ( double ) class_b.rx_us_per_beacon_period / 1000.0 );
+    printf( "radio RX check     : %.1f ms measured, %.1f ms in the radio model (%.2f%%)\n", ( double ) measured / 1000.0,
+            ( double ) radio_rx / 1000.0, rx_error * 100.0 );
+    printf( "class B current    : %.2f uA on average at %.1f mA RX (%.1f uAh per day)\n", class_b_ua, ( double ) rx_ma,
+            class_b_ua * 24.0 );
+    printf( "application        : %u downlinks, %u duplicated, %u corrupted, %u outside their slot\n", received,
+            duplicated, corrupted, off_slot );
+    printf( "latency            : %u samples, min %u ms, avg %.0f ms, max %u ms, p50 <= %u ms, p95 <= %u ms "
+            "(ping period %u s)\n",
+            latency.count, latency.min_ms, ( double ) latency.average_ms, latency.max_ms,
+            lbm_uplink_latency_percentile( &latency, 50 ), lbm_uplink_latency_percentile( &latency, 95 ),
+            1u << periodicity );
+
+    bool passed = acquisition.ping_slot_info_answered && ( corrupted == 0 ) && ( duplicated == 0 ) &&
+                  ( off_slot == 0 ) && ( received > 0 ) && ( rx_error <= 0.02 );
+    if( ( outage_period == 0 ) && ( network_config.beacon_loss_percent == 0 ) &&
+        ( network_config.downlink_loss_percent == 0 ) )
+    {
+        passed &= ( received == on_air ) && ( class_b.beacons_missed == 0 );
+    }
+    if( outage_period > 0 )
+    {
+        passed &= ( class_b.recoveries > 0 ) && ( class_b.state == LBM_CLASS_B_STATE_READY );
+    }
+    printf( "\n%s\n", ( passed == true ) ? "PASS" : "FAIL" );
+    return ( passed == true ) ? 0 : 1;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
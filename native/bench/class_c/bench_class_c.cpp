@@ -0,0 +1,468 @@
+/*!
+ * \file      bench_class_c.cpp
+ *
+ * \brief     Class C receive benchmark: multicast downlink bursts drained in batches by a slow application
+ *
+ * Once joined, the device switches to Class C with lbm.lorawan.startClassC() and starts a Class C session of a
+ * multicast group. The simulated network then sends bursts of back-to-back multicast downlinks, each payload
+ * carrying its index. The application only looks at its downlinks every drain period, as a task busy elsewhere
+ * would:
+ *
+ * - ring: frames wait in the RX ring (lbm.peekFrames() / lbm.releaseFrames());
+ * - pool: frames come through the downlink callback, which keeps the pool buffers until the next drain, the way
+ *   the pooled delivery behaves when the application cannot release them at once.
+ *
+ * It prints the frames put on the air, received by the radio, queued and dropped by the ring, those reaching the
+ * application, the downlinks per second over the bursts and the RX done to application delay.
+ *
+ * The bench fails in ring mode if a frame reaches the application twice, out of order or corrupted, if a frame
+ * received by the radio is neither delivered nor counted as dropped, or if frames are dropped although the ring
+ * holds a whole burst. In pool mode, where a frame arriving with every buffer lent is dropped, it fails if a frame
+ * comes out of order or corrupted, or if a frame received by the radio is neither delivered nor counted as dropped
+ * by the pool.
+ *
+ * Usage: program [-m ring|pool] [-n frames] [-b bursts] [-p period_s] [-q ring_size] [-c drain_ms] [-l bytes]
+ *                [-r datarate] [-g gap_ms] [-u downlink_loss_%] [-s seed] [-v]
+ *   -m  delivery of the downlinks (default ring)
+ *   -n  frames per burst (default 32)
+ *   -b  bursts (default 10)
+ *   -p  period of the bursts in seconds (default 30)
+ *   -q  frames of the RX ring, a power of 2 (default 16)
+ *   -c  drain period of the application in ms (default 500)
+ *   -l  payload size, at least 4 (default 20)
+ *   -r  data rate of the multicast session, DR0 to DR5 (default 5)
+ *   -g  silence between two frames of a burst in ms (default 20)
+ *   -u  percentage of downlinks lost between the gateway and the device
+ *   -s  seed of the modem random generator and of the network loss pattern (default 1)
+ *   -v  print the modem traces
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "bench_join.h"
+#include "lbm_api.h"
+
+extern "C" {
+#include "sim_clock.h"
+#include "sim_network.h"
+#include "sim_radio.h"
+#include "smtc_hal_dbg_trace.h"
+#include "smtc_modem_hal.h"
+#include "smtc_modem_hal_native.h"
+}
+
+#define MC_GROUP 0
+#define MC_ADDRESS 0x01ABCDEFu
+#define MC_PORT 200
+#define MC_FREQ_HZ 869525000u
+
+// Silence before the first burst, and after the last one for the application to drain the ring
+#define SETTLE_S 5
+
+static const uint8_t mc_nwk_s_key[16] = { 0x4D, 0x43, 0x4E, 0x77, 0x6B, 0x53, 0x4B, 0x65,
+                                          0x79, 0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36 };
+static const uint8_t mc_app_s_key[16] = { 0x4D, 0x43, 0x41, 0x70, 0x70, 0x53, 0x4B, 0x65,
+                                          0x79, 0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36 };
+
+// Network side
+static uint32_t burst_frames   = 32;
+static uint32_t bursts         = 10;
+static uint32_t period_s       = 30;
+static uint8_t  payload_size   = 20;
+static uint8_t  sf             = 7;
+static uint32_t gap_ms         = 20;
+static uint32_t next_index     = 0;
+static uint32_t burst_sent     = 0;  // frames of the current burst
+static uint32_t bursts_sent    = 0;
+static uint32_t sent           = 0;  // frames handed to the network, lost ones included
+static uint32_t air_full       = 0;
+static uint64_t first_frame_us = 0;
+static uint64_t last_frame_us  = 0;
+
+// Application side
+static bool                 use_pool      = false;
+static lbm_dl_buffer_t*     held[LBM_DL_POOL_SIZE];
+static uint32_t             nb_held       = 0;
+static uint32_t             app_frames    = 0;
+static uint32_t             reordered     = 0;  // duplicated or older than one already delivered
+static uint32_t             corrupted     = 0;
+static uint32_t             gaps          = 0;  // frames skipped between two frames delivered
+static uint32_t             ring_skipped  = 0;  // same from the ring sequence numbers: frames dropped by the ring
+static uint32_t             drains        = 0;
+static uint32_t             largest_batch = 0;
+static bool                 first_index   = true;
+static uint32_t             last_index    = 0;
+static bool                 first_ring    = true;
+static uint32_t             last_sequence = 0;
+static lbm_uplink_latency_t app_latency;
+static uint64_t             app_latency_total_ms = 0;
+
+static void print_usage( const char* name )
+{
+    fprintf( stderr,
+             "usage: %s [-m ring|pool] [-n frames] [-b bursts] [-p period_s] [-q ring_size] [-c drain_ms] [-l bytes] "
+             "[-r datarate] [-g gap_ms] [-u downlink_loss_%%] [-s seed] [-v]\n",
+             name );
+}
+
+static void fill_payload( uint32_t index, uint8_t* payload )
+{
+    payload[0] = ( uint8_t ) index;
+    payload[1] = ( uint8_t ) ( index >> 8 );
+    payload[2] = ( uint8_t ) ( index >> 16 );
+    payload[3] = ( uint8_t ) ( index >> 24 );
+    for( uint8_t i = 4; i < payload_size; i++ )
+    {
+        payload[i] = ( uint8_t ) ( ( index * 7u ) + i );
+    }
+}
+
+static uint32_t frame_time_on_air_us( void )
+{
+    sim_radio_params_t params = {};
+    params.packet_type        = SIM_RADIO_PACKET_TYPE_LORA;
+    params.freq_hz            = MC_FREQ_HZ;
+    params.sf                 = sf;
+    params.bw_hz              = 125000;
+    params.cr                 = 1;
+    params.preamble_len       = 8;
+    params.iq_inverted        = true;
+    // MHDR | McAddr | FCtrl | FCnt | FPort | FRMPayload | MIC
+    return sim_radio_get_time_on_air_us( &params, ( uint8_t ) ( 1 + 4 + 1 + 2 + 1 + payload_size + 4 ) );
+}
+
+// One frame on the air at a time: the radio model holds SIM_RADIO_MAX_PENDING_FRAMES frames only
+static void on_frame_due( void* context )
+{
+    ( void ) context;
+    uint8_t        payload[242];
+    const uint64_t now_us = sim_clock_now_us( );
+
+    fill_payload( next_index, payload );
+    if( sim_network_send_multicast( MC_PORT, payload, payload_size, MC_FREQ_HZ, sf, now_us ) == false )
+    {
+        air_full++;
+    }
+    if( sent == 0 )
+    {
+        first_frame_us = now_us;
+    }
+    last_frame_us = now_us + frame_time_on_air_us( );
+    next_index++;
+    sent++;
+
+    if( ++burst_sent < burst_frames )
+    {
+        sim_clock_schedule_at_us( now_us + frame_time_on_air_us( ) + ( uint64_t ) gap_ms * 1000u, on_frame_due, NULL );
+        return;
+    }
+    burst_sent = 0;
+    if( ++bursts_sent < bursts )
+    {
+        sim_clock_schedule_at_us( now_us + ( uint64_t ) period_s * 1000000u, on_frame_due, NULL );
+    }
+}
+
+static void on_downlink( lbm_dl_buffer_t* downlink )
+{
+    // Kept until the application drains, like the ring
+    held[nb_held++] = downlink;
+}
+
+static void take_frame( const uint8_t* payload, uint8_t size, uint8_t fport, uint32_t rx_done_ms, uint32_t now_ms )
+{
+    if( ( fport != MC_PORT ) || ( size != payload_size ) )
+    {
+        corrupted++;
+        return;
+    }
+    uint8_t        expected[242];
+    const uint32_t index = ( uint32_t ) payload[0] | ( ( uint32_t ) payload[1] << 8 ) |
+                           ( ( uint32_t ) payload[2] << 16 ) | ( ( uint32_t ) payload[3] << 24 );
+    fill_payload( index, expected );
+    if( memcmp( payload, expected, size ) != 0 )
+    {
+        corrupted++;
+        return;
+    }
+    if( ( first_index == false ) && ( index <= last_index ) )
+    {
+        reordered++;
+        return;
+    }
+    gaps += ( first_index == true ) ? index : index - last_index - 1;
+    first_index = false;
+    last_index  = index;
+    app_frames++;
+    lbm_uplink_latency_add( &app_latency, &app_latency_total_ms, ( now_ms > rx_done_ms ) ? now_ms - rx_done_ms : 0 );
+}
+
+static void drain( void )
+{
+    const uint32_t now_ms = smtc_modem_hal_get_time_in_ms( );
+    uint32_t       batch  = 0;
+
+    drains++;
+    if( use_pool == true )
+    {
+        for( uint32_t i = 0; i < nb_held; i++ )
+        {
+            take_frame( held[i]->payload, held[i]->size, held[i]->metadata.fport, held[i]->metadata.timestamp,
+                        now_ms );
+            lbm.releaseDownlink( held[i] );
+        }
+        batch   = nb_held;
+        nb_held = 0;
+    }
+    else
+    {
+        const lbm_rx_frame_t* frames;
+        uint16_t              count;
+        while( ( count = lbm.peekFrames( &frames ) ) > 0 )
+        {
+            for( uint16_t i = 0; i < count; i++ )
+            {
+                const lbm_rx_frame_t* frame = &frames[i];
+                ring_skipped += ( first_ring == true ) ? frame->sequence : frame->sequence - last_sequence - 1;
+                first_ring    = false;
+                last_sequence = frame->sequence;
+                take_frame( frame->downlink.payload, frame->downlink.size, frame->downlink.metadata.fport,
+                            frame->rx_done_ms, now_ms );
+            }
+            lbm.releaseFrames( count );
+            batch += count;
+        }
+    }
+    if( batch > largest_batch )
+    {
+        largest_batch = batch;
+    }
+}
+
+static void print_latency( const char* name, const lbm_uplink_latency_t* latency )
+{
+    printf( "%-19s: %u samples, min %u ms, avg %.0f ms, max %u ms, p50 <= %u ms, p95 <= %u ms\n", name,
+            latency->count, latency->min_ms, ( double ) latency->average_ms, latency->max_ms,
+            lbm_uplink_latency_percentile( latency, 50 ), lbm_uplink_latency_percentile( latency, 95 ) );
+}
+
+int main( int argc, char** argv )
+{
+    uint32_t ring_size = 16;
+    uint32_t drain_ms  = 500;
+    uint32_t datarate  = 5;
+    uint32_t seed      = 1;
+    bool     verbose   = false;
+
+    sim_network_config_t network_config;
+    sim_network_get_default_config( &network_config );
+
+    int opt;
+    while( ( opt = getopt( argc, argv, "m:n:b:p:q:c:l:r:g:u:s:v" ) ) != -1 )
+    {
+        switch( opt )
+        {
+        case 'm':
+            if( strcmp( optarg, "pool" ) == 0 )
+            {
+                use_pool = true;
+            }
+            else if( strcmp( optarg, "ring" ) != 0 )
+            {
+                print_usage( argv[0] );
+                return 1;
+            }
+            break;
+        case 'n':
+            burst_frames = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'b':
+            bursts = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'p':
+            period_s = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'q':
+            ring_size = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'c':
+            drain_ms = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'l':
+            payload_size = ( uint8_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'r':
+            datarate = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'g':
+            gap_ms = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'u':
+            network_config.downlink_loss_percent = ( uint8_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 's':
+            seed = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'v':
+            verbose = true;
+            break;
+        default:
+            print_usage( argv[0] );
+            return 1;
+        }
+    }
+    if( ( burst_frames == 0 ) || ( bursts == 0 ) || ( period_s == 0 ) || ( drain_ms == 0 ) || ( datarate > 5 ) ||
+        ( payload_size < 4 ) || ( payload_size > 200 ) || ( ring_size == 0 ) || ( ring_size > LBM_RX_RING_MAX_SIZE ) ||
+        ( ( ring_size & ( ring_size - 1 ) ) != 0 ) )
+    {
+        print_usage( argv[0] );
+        return 1;
+    }
+    sf                  = ( uint8_t ) ( 12 - datarate );  // EU868 DR0-DR5, BW125
+    network_config.seed = seed;
+
+    static lbm_rx_frame_t storage[LBM_RX_RING_MAX_SIZE];
+
+    hal_trace_set_quiet( !verbose );
+    sim_clock_reset( );
+    smtc_modem_hal_native_set_seed( seed );
+    sim_network_configure( &network_config );
+    sim_network_set_multicast_group( MC_ADDRESS, mc_nwk_s_key, mc_app_s_key );
+
+    lbm.init( );
+    if( use_pool == true )
+    {
+        lbm.setDownlinkCallback( on_downlink );
+    }
+    if( bench_join( lbm, NULL ) == false )
+    {
+        return 1;
+    }
+
+    smtc_modem_return_code_t rc;
+    if( use_pool == true )
+    {
+        rc = lbm.lorawan.setClass( SMTC_MODEM_CLASS_C );
+    }
+    else
+    {
+        rc = lbm.lorawan.startClassC( storage, ( uint16_t ) ring_size );
+    }
+    if( rc == SMTC_MODEM_RC_OK )
+    {
+        rc = lbm.lorawan.setMulticastGroup( MC_GROUP, MC_ADDRESS, mc_nwk_s_key, mc_app_s_key );
+    }
+    if( rc == SMTC_MODEM_RC_OK )
+    {
+        rc = lbm.lorawan.startMulticastClassC( MC_GROUP, MC_FREQ_HZ, ( uint8_t ) datarate );
+    }
+    if( rc != SMTC_MODEM_RC_OK )
+    {
+        printf( "class C multicast session not started: %d\n\nFAIL\n", rc );
+        return 1;
+    }
+
+    sim_radio_stats_t radio_start;
+    sim_radio_get_stats( &radio_start );
+    lbm.resetRxRingStats( );
+    lbm.resetDownlinkPoolStats( );
+
+    const uint64_t start_us = sim_clock_now_us( ) + SETTLE_S * 1000000ULL;
+    sim_clock_schedule_at_us( start_us, on_frame_due, NULL );
+
+    // The application wakes up every drain period, whatever arrived meanwhile
+    uint64_t next_drain_us = sim_clock_now_us( ) + ( uint64_t ) drain_ms * 1000u;
+    uint64_t end_us        = UINT64_MAX;
+    while( sim_clock_now_us( ) < end_us )
+    {
+        const uint64_t now_us = sim_clock_now_us( );
+        lbm.runEngineUntilEvent( ( next_drain_us > now_us ) ? ( uint32_t ) ( ( next_drain_us - now_us + 999 ) / 1000 )
+                                                            : 0 );
+        if( sim_clock_now_us( ) >= next_drain_us )
+        {
+            drain( );
+            next_drain_us += ( uint64_t ) drain_ms * 1000u;
+        }
+        if( ( end_us == UINT64_MAX ) && ( bursts_sent == bursts ) )
+        {
+            end_us = last_frame_us + SETTLE_S * 1000000ULL;
+        }
+    }
+    drain( );
+
+    // Counters of the burst phase, taken before the ring stops
+    lbm_rx_ring_stats_t ring;
+    lbm.getRxRingStats( &ring );
+    lbm_dl_pool_stats_t pool;
+    lbm.getDownlinkPoolStats( &pool );
+    sim_radio_stats_t radio;
+    sim_radio_get_stats( &radio );
+    sim_network_stats_t network;
+    sim_network_get_stats( &network );
+
+    // Frames dropped after the last one delivered
+    ring_skipped += ( first_ring == true ) ? ring.received : ring.received - 1 - last_sequence;
+
+    const uint32_t rx_done = radio.rx_done_count - radio_start.rx_done_count;
+    const uint32_t missed  = radio.missed_count - radio_start.missed_count;
+    const double   burst_s = ( double ) ( last_frame_us - first_frame_us ) / 1e6;
+    app_latency.average_ms = ( app_latency.count > 0 ) ? ( float ) app_latency_total_ms / app_latency.count : 0.0f;
+
+    printf( "\n===== class C receive benchmark =====\n" );
+    printf( "mode               : %s, bursts of %u frames of %u bytes at SF%u every %u s, drain every %u ms\n",
+            ( use_pool == true ) ? "pool" : "ring", burst_frames, payload_size, sf, period_s, drain_ms );
+    if( use_pool == false )
+    {
+        printf( "ring               : %u frames of %u bytes\n", ring_size, ( unsigned ) sizeof( lbm_rx_frame_t ) );
+    }
+    printf( "virtual time       : %.0f s, %.1f s of bursts\n", ( double ) sim_clock_now_us( ) / 1e6, burst_s );
+    printf( "network            : %u frames sent, %u on the air, %u lost, %u refused (air full)\n", sent,
+            network.multicast_downlinks, network.multicast_lost, air_full );
+    printf( "radio              : %u received, %u missed\n", rx_done, missed );
+    if( use_pool == false )
+    {
+        printf( "ring               : %u received, %u dropped full, %u delivered, high watermark %u\n",
+                ring.received, ring.dropped, ring.delivered, ring.high_watermark );
+        printf( "throughput         : %.2f downlinks/s over %.1f s, busiest second %u\n",
+                ( double ) ring.downlinks_per_s, ( double ) ring.window_ms / 1000.0, ring.peak_per_s );
+    }
+    else
+    {
+        printf( "pool               : %u read, %u dropped (pool exhausted), peak %u of %u buffers\n",
+                pool.acquired, pool.exhausted, pool.peak_in_use, pool.capacity );
+        printf( "throughput         : %.2f downlinks/s over the bursts\n",
+                ( burst_s > 0 ) ? ( double ) app_frames / burst_s : 0.0 );
+    }
+    printf( "application        : %u frames in %u drains (largest batch %u), %u skipped, %u late or duplicated, "
+            "%u corrupted\n",
+            app_frames, drains, largest_batch, gaps, reordered, corrupted );
+    if( use_pool == false )
+    {
+        print_latency( "RX done to queued", &ring.rx_to_queue );
+    }
+    print_latency( "RX done to app", &app_latency );
+
+    bool passed = ( app_frames > 0 ) && ( corrupted == 0 );
+    if( use_pool == false )
+    {
+        passed &= ( reordered == 0 ) && ( ring.received == rx_done ) &&
+                  ( ring.delivered + ring.dropped == ring.received ) &&
+                  ( ring.depth == 0 ) && ( ring_skipped == ring.dropped ) && ( app_frames == ring.delivered );
+        if( ring_size >= burst_frames )
+        {
+            passed &= ( ring.dropped == 0 );
+        }
+    }
+    else
+    {
+        passed &= ( reordered == 0 ) && ( pool.acquired + pool.exhausted == rx_done ) && ( app_frames == pool.acquired );
+    }
+    printf( "\n%s\n", ( passed == true ) ? "PASS" : "FAIL" );
+    return ( passed == true ) ? 0 : 1;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,107 @@
+/*!
+ * \file      bench_join.cpp
+ *
+ * \brief     Join fixture of the host benches: EU868, the credentials of lbm_config.h, and the wait for JOINED
+ */
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <stdio.h>
+
+#include "bench_join.h"
+#include "lbm_config.h"
+
+extern "C" {
+#include "sim_clock.h"
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE VARIABLES -------------------------------------------------------
+ */
+
+// Credentials of lbm_config.h
+static const uint8_t default_dev_eui[8]  = USER_LORAWAN_DEVICE_EUI;
+static const uint8_t default_join_eui[8] = USER_LORAWAN_JOIN_EUI;
+static const uint8_t default_app_key[16] = USER_LORAWAN_APP_KEY;
+
+static bool             joined         = false;
+static LBMEventCallback bench_on_event = NULL;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DECLARATION -------------------------------------------
+ */
+
+static void on_event( smtc_modem_event_t* event );
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS DEFINITION ---------------------------------------------
+ */
+
+void bench_join_stack( LoRaWANClass* stack, const uint8_t* dev_eui, const uint8_t* join_eui, const uint8_t* app_key )
+{
+    if( dev_eui == NULL )
+    {
+        dev_eui  = default_dev_eui;
+        join_eui = default_join_eui;
+        app_key  = default_app_key;
+    }
+    stack->setRegion( REGION_EU868 );
+    stack->setDevEUI( dev_eui );
+    stack->setJoinEUI( join_eui );
+    stack->setAppKey( app_key );
+    stack->setNwkKey( app_key );
+    stack->join( );
+}
+
+void bench_join_start( LBMApi& lbm, LBMEventCallback callback )
+{
+    joined         = false;
+    bench_on_event = callback;
+    lbm.setEventCallback( on_event );
+    bench_join_stack( &lbm.lorawan, NULL, NULL, NULL );
+}
+
+bool bench_joined( void )
+{
+    return joined;
+}
+
+bool bench_join( LBMApi& lbm, LBMEventCallback callback )
+{
+    bench_join_start( lbm, callback );
+    while( ( joined == false ) && ( sim_clock_now_us( ) < BENCH_JOIN_TIMEOUT_S * 1000000ULL ) )
+    {
+        lbm.runEngineUntilEvent( 1000 );
+    }
+    if( joined == false )
+    {
+        printf( "not joined\n\nFAIL\n" );
+        return false;
+    }
+    return true;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DEFINITION --------------------------------------------
+ */
+
+static void on_event( smtc_modem_event_t* event )
+{
+    if( event->event_type == SMTC_MODEM_EVENT_JOINED )
+    {
+        joined = true;
+    }
+    if( bench_on_event != NULL )
+    {
+        bench_on_event( event );
+    }
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,67 @@
+/*!
+ * \file      bench_join.h
+ *
+ * \brief     Join fixture of the host benches: EU868, the credentials of lbm_config.h, and the wait for JOINED
+ *
+ * The benches keep lbm.init() and their own event handling. bench_join_start() puts a callback in front of the
+ * one of the bench that records SMTC_MODEM_EVENT_JOINED, then passes every event on.
+ */
+
+#ifndef BENCH_JOIN_H
+#define BENCH_JOIN_H
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "lbm_api.h"
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC CONSTANTS --------------------------------------------------------
+ */
+
+/**
+ * @brief Simulated time bench_join() waits for the join
+ */
+#define BENCH_JOIN_TIMEOUT_S 3600
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS PROTOTYPES --------------------------------------------
+ */
+
+/**
+ * @brief Set the region EU868 and the credentials of a stack, then request the join
+ *
+ * @param [in] dev_eui  DevEUI, NULL for the credentials of lbm_config.h (join_eui and app_key are then ignored)
+ * @param [in] app_key  AppKey, also the NwkKey
+ */
+void bench_join_stack( LoRaWANClass* stack, const uint8_t* dev_eui, const uint8_t* join_eui, const uint8_t* app_key );
+
+/**
+ * @brief Register the event callback and start the join of lbm.lorawan with the credentials of lbm_config.h
+ *
+ * @param [in] on_event Event callback of the bench, NULL if it only needs bench_joined()
+ */
+void bench_join_start( LBMApi& lbm, LBMEventCallback on_event );
+
+/**
+ * @brief true once lbm.lorawan got SMTC_MODEM_EVENT_JOINED
+ */
+bool bench_joined( void );
+
+/**
+ * @brief bench_join_start(), then run the engine until the device joins
+ *
+ * @return false, after printing "not joined" and FAIL, if it has not joined within BENCH_JOIN_TIMEOUT_S
+ */
+bool bench_join( LBMApi& lbm, LBMEventCallback on_event );
+
+#endif  // BENCH_JOIN_H
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,260 @@
+/*!
+ * \file      bench_energy.cpp
+ *
+ * \brief     Energy benchmark: charge per message and per day of a periodic uplink for a data rate, NbTrans and class
+ *
+ * Once joined, the device sends an uplink every period with a fixed data rate (CUSTOM ADR profile) and NbTrans,
+ * in class A or class C, and runs the engine in the low-power mode between them, as a battery-powered sensor
+ * would. The energy counters of lbm_energy.cpp are cleared after the join, so the figures are those of the steady
+ * state with the supply currents of the RAK3112 variant header.
+ *
+ * It prints the time and charge per radio and MCU state, per output power, the radio charge of an uplink (its
+ * repetitions and RX windows) and the total charge per message and per day, sleep included: run it for several
+ * data rates, NbTrans or both classes to compare them.
+ *
+ * The bench fails if an uplink is not sent, if the radio states do not add up to the time measured, or if the TX,
+ * RX or sleep time differs from that of the radio model by more than 2% (of the model time, or of the whole
+ * period for a state below it).
+ *
+ * Usage: program [-r dr] [-t nb_trans] [-c class] [-p period_s] [-n uplinks] [-l size] [-s seed] [-v]
+ *   -r  data rate of the uplinks, 0 to 5 (default 5)
+ *   -t  NbTrans, transmissions of each unconfirmed uplink, 1 to 15 (default 1)
+ *   -c  class, a or c (default a)
+ *   -p  uplink period in s (default 600)
+ *   -n  uplinks measured (default 20)
+ *   -l  payload size in bytes (default 12)
+ *   -s  seed of the modem random generator (default 1)
+ *   -v  print the modem traces
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "bench_join.h"
+#include "lbm_api.h"
+
+extern "C" {
+#include "sim_clock.h"
+#include "sim_network.h"
+#include "sim_radio.h"
+#include "smtc_hal_dbg_trace.h"
+#include "smtc_modem_hal.h"
+#include "smtc_modem_hal_native.h"
+}
+
+#define UPLINK_PORT 2
+#define MAX_PAYLOAD 51
+
+static uint32_t txdone = 0;
+
+static const char* const radio_names[] = { "sleep", "standby", "TX", "RX", "CAD" };
+static const char* const mcu_names[]   = { "active", "idle", "light sleep" };
+
+static void print_usage( const char* name )
+{
+    fprintf( stderr, "usage: %s [-r dr] [-t nb_trans] [-c class] [-p period_s] [-n uplinks] [-l size] [-s seed] [-v]\n",
+             name );
+}
+
+static void on_event( smtc_modem_event_t* event )
+{
+    if( event->event_type == SMTC_MODEM_EVENT_TXDONE )
+    {
+        txdone++;
+    }
+}
+
+static void on_downlink( lbm_dl_buffer_t* downlink )
+{
+    lbm.releaseDownlink( downlink );
+}
+
+static void run_until( uint64_t end_us )
+{
+    while( sim_clock_now_us( ) < end_us )
+    {
+        const uint64_t now_us = sim_clock_now_us( );
+        lbm.runEngineLowPower( ( uint32_t ) ( ( end_us - now_us + 999 ) / 1000 ) );
+    }
+}
+
+// Difference to the radio model, relative to its time or to the whole period below it
+static double model_error( uint64_t measured_us, uint64_t model_us, uint64_t elapsed_us )
+{
+    const double reference = ( double ) ( ( model_us > elapsed_us / 100 ) ? model_us : elapsed_us );
+    return ( reference > 0.0 ) ? fabs( ( double ) measured_us - ( double ) model_us ) / reference : 0.0;
+}
+
+int main( int argc, char** argv )
+{
+    uint32_t dr       = 5;
+    uint32_t nb_trans = 1;
+    bool     class_c  = false;
+    uint32_t period_s = 600;
+    uint32_t uplinks  = 20;
+    uint32_t size     = 12;
+    uint32_t seed     = 1;
+    bool     verbose  = false;
+
+    sim_network_config_t network_config;
+    sim_network_get_default_config( &network_config );
+
+    int opt;
+    while( ( opt = getopt( argc, argv, "r:t:c:p:n:l:s:v" ) ) != -1 )
+    {
+        switch( opt )
+        {
+        case 'r':
+            dr = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 't':
+            nb_trans = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'c':
+            class_c = ( optarg[0] == 'c' ) || ( optarg[0] == 'C' );
+            break;
+        case 'p':
+            period_s = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'n':
+            uplinks = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'l':
+            size = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 's':
+            seed = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'v':
+            verbose = true;
+            break;
+        default:
+            print_usage( argv[0] );
+            return 1;
+        }
+    }
+    if( ( dr > 5 ) || ( nb_trans == 0 ) || ( nb_trans > 15 ) || ( period_s == 0 ) || ( uplinks == 0 ) ||
+        ( size == 0 ) || ( size > MAX_PAYLOAD ) )
+    {
+        print_usage( argv[0] );
+        return 1;
+    }
+    network_config.seed = seed;
+
+    hal_trace_set_quiet( !verbose );
+    sim_clock_reset( );
+    smtc_modem_hal_native_set_seed( seed );
+    sim_network_configure( &network_config );
+
+    lbm.init( );
+    lbm.setDownlinkCallback( on_downlink );
+    if( bench_join( lbm, on_event ) == false )
+    {
+        return 1;
+    }
+
+    // Every uplink at the data rate given
+    uint8_t distribution[SMTC_MODEM_CUSTOM_ADR_DATA_LENGTH] = { 0 };
+    distribution[dr] = 100;
+    smtc_modem_return_code_t rc = lbm.lorawan.setADRProfile( SMTC_MODEM_ADR_PROFILE_CUSTOM, distribution );
+    if( rc == SMTC_MODEM_RC_OK )
+    {
+        rc = lbm.lorawan.setNbTrans( ( uint8_t ) nb_trans );
+    }
+    if( ( rc == SMTC_MODEM_RC_OK ) && ( class_c == true ) )
+    {
+        rc = lbm.lorawan.setClass( SMTC_MODEM_CLASS_C );
+    }
+    if( rc != SMTC_MODEM_RC_OK )
+    {
+        printf( "configuration refused: %d\n\nFAIL\n", rc );
+        return 1;
+    }
+
+    // Steady state from the end of the join on
+    run_until( sim_clock_now_us( ) + 1000000u );
+    lbm.resetEnergyStats( );
+    sim_radio_stats_t radio_start;
+    sim_radio_get_stats( &radio_start );
+    const uint32_t txdone_start = txdone;
+    const uint64_t start_us     = sim_clock_now_us( );
+
+    uint8_t payload[MAX_PAYLOAD];
+    for( uint32_t i = 0; i < uplinks; i++ )
+    {
+        memset( payload, ( int ) i, size );
+        ( void ) lbm.lorawan.send( payload, ( uint8_t ) size, UPLINK_PORT, false );
+        run_until( start_us + ( uint64_t ) ( i + 1 ) * period_s * 1000000ULL );
+    }
+
+    lbm_energy_stats_t energy;
+    lbm.getEnergyStats( &energy );
+    lbm_energy_profile_t profile;
+    lbm.getEnergyProfile( &profile );
+    sim_radio_stats_t radio;
+    sim_radio_get_stats( &radio );
+
+    uint64_t model_us[SIM_RADIO_MODE_NB];
+    for( int i = 0; i < SIM_RADIO_MODE_NB; i++ )
+    {
+        model_us[i] = radio.time_in_mode_us[i] - radio_start.time_in_mode_us[i];
+    }
+    uint64_t radio_total_us = 0;
+    for( int i = 0; i <= LBM_ENERGY_RADIO_CAD; i++ )
+    {
+        radio_total_us += energy.radio_us[i];
+    }
+    const double tx_error =
+        model_error( energy.radio_us[LBM_ENERGY_RADIO_TX], model_us[SIM_RADIO_MODE_TX], energy.elapsed_us );
+    const double rx_error =
+        model_error( energy.radio_us[LBM_ENERGY_RADIO_RX], model_us[SIM_RADIO_MODE_RX], energy.elapsed_us );
+    const double sleep_error =
+        model_error( energy.radio_us[LBM_ENERGY_RADIO_SLEEP], model_us[SIM_RADIO_MODE_SLEEP], energy.elapsed_us );
+
+    printf( "\n===== energy benchmark =====\n" );
+    printf( "configuration      : DR%u, NbTrans %u, class %s, %u-byte uplink every %u s, %u uplinks\n", dr, nb_trans,
+            ( class_c == true ) ? "C" : "A", size, period_s, uplinks );
+    printf( "virtual time       : %.0f s measured\n", ( double ) energy.elapsed_us / 1e6 );
+    printf( "radio              : %u transmissions, %u RX windows, %u CAD\n", energy.transmissions, energy.rx_windows,
+            energy.cads );
+    for( int i = 0; i <= LBM_ENERGY_RADIO_CAD; i++ )
+    {
+        printf( "  %-16s : %12.3f s  %10.3f uAh\n", radio_names[i], ( double ) energy.radio_us[i] / 1e6,
+                ( double ) energy.radio_uah[i] );
+    }
+    for( uint8_t i = 0; i < energy.tx_level_count; i++ )
+    {
+        const lbm_energy_tx_level_t* level = &energy.tx_levels[i];
+        printf( "  TX at %3d dBm    : %u transmissions, %.3f s, %.3f uAh (%.1f mA)\n", level->power_dbm,
+                level->transmissions, ( double ) level->time_us / 1e6, ( double ) level->charge_uah,
+                ( double ) lbm_energy_tx_current_ua( &profile, level->power_dbm ) / 1000.0 );
+    }
+    printf( "MCU\n" );
+    for( int i = 0; i <= LBM_ENERGY_MCU_SLEEP; i++ )
+    {
+        printf( "  %-16s : %12.3f s  %10.3f uAh\n", mcu_names[i], ( double ) energy.mcu_us[i] / 1e6,
+                ( double ) energy.mcu_uah[i] );
+    }
+    printf( "radio model check  : TX %.3f s (%.2f%%), RX %.3f s (%.2f%%), sleep %.3f s (%.2f%%)\n",
+            ( double ) model_us[SIM_RADIO_MODE_TX] / 1e6, tx_error * 100.0, ( double ) model_us[SIM_RADIO_MODE_RX] / 1e6,
+            rx_error * 100.0, ( double ) model_us[SIM_RADIO_MODE_SLEEP] / 1e6, sleep_error * 100.0 );
+    printf( "uplink radio charge: %u uplinks, last %.3f uAh, avg %.3f uAh, max %.3f uAh\n", energy.uplinks,
+            ( double ) energy.last_uplink_uah, ( double ) energy.avg_uplink_uah, ( double ) energy.max_uplink_uah );
+    printf( "total              : %.3f uAh, %.4f mWh at %u mV, %.1f uA on average\n", ( double ) energy.total_uah,
+            ( double ) energy.total_mwh, profile.supply_mv, ( double ) energy.average_ua );
+    printf( "per message        : %.3f uAh, sleep between uplinks included\n", ( double ) energy.uah_per_uplink );
+    printf( "per day            : %.1f uAh (%.2f mAh)\n", ( double ) energy.uah_per_day,
+            ( double ) energy.uah_per_day / 1000.0 );
+
+    const bool passed = ( txdone - txdone_start == uplinks ) && ( energy.uplinks == uplinks ) &&
+                        ( radio_total_us == energy.elapsed_us ) && ( tx_error <= 0.02 ) && ( rx_error <= 0.02 ) &&
+                        ( sleep_error <= 0.02 );
+    printf( "\n%s\n", ( passed == true ) ? "PASS" : "FAIL" );
+    return ( passed == true ) ? 0 : 1;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
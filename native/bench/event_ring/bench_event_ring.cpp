@@ -0,0 +1,357 @@
+/*!
+ * \file      bench_event_ring.cpp
+ *
+ * \brief     Event ring stress test: an engine thread against an application thread, ordering and overflows
+ *
+ * Only lbm_event_ring.cpp and lbm_dl_pool.cpp are linked, with the few modem and FreeRTOS calls they make
+ * implemented here on top of real threads, so the ring runs with a producer and a consumer on two cores as on
+ * the ESP32-S3. The producer pushes numbered events in bursts, every k-th one a DOWNDATA carrying a pool buffer
+ * whose payload holds the same number, and pauses between bursts. A burst longer than the ring overflows it when
+ * the consumer falls behind. The consumer keeps the last few downlink buffers before releasing them so that the
+ * pool runs out too.
+ *
+ * The bench fails if an event arrives out of order or twice, if a downlink payload does not match its event (a
+ * buffer reused before it was released), if the ring or pool counters do not match what both threads counted,
+ * or if a buffer is still lent at the end: a DOWNDATA dropped on overflow must give its buffer back. Every
+ * downlink must be read out of the modem, those dropped because the pool was exhausted included. Build it
+ * with -fsanitize=thread to check the memory ordering as well.
+ *
+ * Usage: program [-n events] [-k period] [-b burst] [-p pause_us] [-h held] [-w]
+ *   -n  events pushed (default 300000)
+ *   -k  a DOWNDATA every k events (default 4)
+ *   -b  events per burst (default 12)
+ *   -p  producer pause in us between bursts, 0 for none (default 20)
+ *   -h  downlink buffers the consumer keeps before releasing the oldest (default 1, so that a full ring
+ *       of DOWNDATA still leaves a buffer for the next one)
+ *   -w  block in lbm_event_ring_wait() instead of polling lbm_event_ring_pop()
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "lbm_event_ring.h"
+#include "lbm_dl_pool.h"
+#include "lbm_engine.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#define MAX_HELD LBM_DL_POOL_SIZE
+
+// Number carried by each event, and by the payload of a DOWNDATA
+#define SEQUENCE( event ) ( ( event )->event_data.lorawan_mac_time.gps_time_s )
+
+static uint32_t events          = 300000;
+static uint32_t downlink_period = 4;
+static uint32_t burst           = 12;
+static uint32_t pause_us        = 20;
+static uint32_t held_max        = 1;
+static bool     use_wait        = false;
+
+static std::atomic<bool> producer_done( false );
+
+// Producer side
+static uint32_t next_payload     = 0;  // number written by the next smtc_modem_get_downlink_data()
+static uint32_t pushed_ok        = 0;
+static uint32_t dropped          = 0;
+static uint32_t dropped_downlink = 0;
+static uint32_t dropped_buffers  = 0;  // of which with a pool buffer, to be released by the ring
+static uint32_t no_buffer        = 0;  // DOWNDATA pushed without buffer, the pool being exhausted
+static uint32_t modem_reads      = 0;  // downlinks read out of the modem
+
+// Consumer side
+static uint32_t received      = 0;
+static uint32_t gaps          = 0;  // events missing between two received ones
+static int64_t  last_received = -1;
+static uint32_t out_of_order  = 0;
+static uint32_t mismatched    = 0;
+static uint32_t downlinks     = 0;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- MODEM AND FREERTOS CALLS OF THE RING AND THE POOL ------------------------
+ */
+
+struct native_semaphore_s
+{
+    std::mutex              mutex;
+    std::condition_variable given_cv;
+    bool                    given;
+};
+
+extern "C" SemaphoreHandle_t xSemaphoreCreateBinary( void )
+{
+    SemaphoreHandle_t semaphore = new native_semaphore_s( );
+    semaphore->given            = false;
+    return semaphore;
+}
+
+extern "C" BaseType_t xSemaphoreGive( SemaphoreHandle_t semaphore )
+{
+    {
+        std::lock_guard<std::mutex> lock( semaphore->mutex );
+        semaphore->given = true;
+    }
+    semaphore->given_cv.notify_one( );
+    return pdPASS;
+}
+
+extern "C" BaseType_t xSemaphoreTake( SemaphoreHandle_t semaphore, TickType_t ticks_to_wait )
+{
+    std::unique_lock<std::mutex> lock( semaphore->mutex );
+    const auto                   given = [semaphore] { return semaphore->given; };
+    if( ticks_to_wait == portMAX_DELAY )
+    {
+        semaphore->given_cv.wait( lock, given );
+    }
+    else if( semaphore->given_cv.wait_for( lock, std::chrono::milliseconds( ticks_to_wait ), given ) == false )
+    {
+        return pdFAIL;
+    }
+    semaphore->given = false;
+    return pdPASS;
+}
+
+// The [basic_modem] flags wrap the HAL time, lbm_sleep.cpp is not linked
+extern "C" uint32_t __wrap_smtc_modem_hal_get_time_in_ms( void )
+{
+    return ( uint32_t ) std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now( ).time_since_epoch( ) )
+        .count( );
+}
+
+void lbm_engine_notify( void )
+{
+}
+
+extern "C" smtc_modem_return_code_t smtc_modem_get_downlink_data( uint8_t* buff, uint8_t* length,
+                                                                  smtc_modem_dl_metadata_t* metadata,
+                                                                  uint8_t*                  remaining_data_nb )
+{
+    modem_reads++;
+    memset( metadata, 0, sizeof( *metadata ) );
+    memcpy( buff, &next_payload, sizeof( next_payload ) );
+    *length            = sizeof( next_payload );
+    *remaining_data_nb = 0;
+    return SMTC_MODEM_RC_OK;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- THREADS -----------------------------------------------------------------
+ */
+
+static void produce( void )
+{
+    for( uint32_t i = 0; i < events; i++ )
+    {
+        smtc_modem_event_t event;
+        memset( &event, 0, sizeof( event ) );
+        lbm_dl_buffer_t* downlink = nullptr;
+
+        SEQUENCE( &event ) = i;
+        if( ( i % downlink_period ) == 0 )
+        {
+            event.event_type = SMTC_MODEM_EVENT_DOWNDATA;
+            next_payload     = i;
+            downlink         = lbm_dl_pool_read_downlink( );
+            if( downlink == nullptr )
+            {
+                no_buffer++;
+            }
+        }
+        else
+        {
+            event.event_type = SMTC_MODEM_EVENT_LORAWAN_MAC_TIME;
+        }
+
+        if( lbm_event_ring_push( &event, downlink ) == true )
+        {
+            pushed_ok++;
+        }
+        else
+        {
+            dropped++;
+            if( event.event_type == SMTC_MODEM_EVENT_DOWNDATA )
+            {
+                dropped_downlink++;
+                dropped_buffers += ( downlink != nullptr ) ? 1 : 0;
+            }
+        }
+
+        if( ( pause_us > 0 ) && ( ( ( i + 1 ) % burst ) == 0 ) )
+        {
+            std::this_thread::sleep_for( std::chrono::microseconds( pause_us ) );
+        }
+    }
+    producer_done.store( true, std::memory_order_release );
+}
+
+static void consume( void )
+{
+    lbm_dl_buffer_t* held[MAX_HELD];
+    uint32_t         held_count = 0;
+
+    for( ;; )
+    {
+        lbm_event_record_t record;
+        const bool         got =
+            ( use_wait == true ) ? lbm_event_ring_wait( &record, 10 ) : lbm_event_ring_pop( &record );
+        if( got == false )
+        {
+            if( producer_done.load( std::memory_order_acquire ) == true )
+            {
+                // Nothing can be published after the flag, but what was before it
+                if( lbm_event_ring_pop( &record ) == false )
+                {
+                    break;
+                }
+            }
+            else
+            {
+                continue;
+            }
+        }
+
+        const uint32_t sequence = SEQUENCE( &record.event );
+        if( ( int64_t ) sequence <= last_received )
+        {
+            out_of_order++;
+        }
+        else
+        {
+            gaps += ( uint32_t ) ( ( int64_t ) sequence - last_received - 1 );
+            last_received = sequence;
+        }
+        received++;
+
+        if( record.downlink != nullptr )
+        {
+            uint32_t payload;
+            memcpy( &payload, record.downlink->payload, sizeof( payload ) );
+            if( ( record.event.event_type != SMTC_MODEM_EVENT_DOWNDATA ) || ( payload != sequence ) ||
+                ( record.downlink->size != sizeof( payload ) ) )
+            {
+                mismatched++;
+            }
+            downlinks++;
+            if( held_max == 0 )
+            {
+                lbm_dl_pool_release( record.downlink );
+            }
+            else
+            {
+                if( held_count == held_max )
+                {
+                    lbm_dl_pool_release( held[0] );
+                    memmove( &held[0], &held[1], ( held_count - 1 ) * sizeof( held[0] ) );
+                    held_count--;
+                }
+                held[held_count++] = record.downlink;
+            }
+        }
+    }
+
+    for( uint32_t i = 0; i < held_count; i++ )
+    {
+        lbm_dl_pool_release( held[i] );
+    }
+}
+
+static void print_usage( const char* name )
+{
+    fprintf( stderr, "usage: %s [-n events] [-k period] [-b burst] [-p pause_us] [-h held] [-w]\n", name );
+}
+
+int main( int argc, char** argv )
+{
+    int opt;
+    while( ( opt = getopt( argc, argv, "n:k:b:p:h:w" ) ) != -1 )
+    {
+        switch( opt )
+        {
+        case 'n':
+            events = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'k':
+            downlink_period = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'b':
+            burst = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'p':
+            pause_us = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'h':
+            held_max = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'w':
+            use_wait = true;
+            break;
+        default:
+            print_usage( argv[0] );
+            return 1;
+        }
+    }
+    if( ( events == 0 ) || ( downlink_period == 0 ) || ( burst == 0 ) || ( held_max >= MAX_HELD ) )
+    {
+        print_usage( argv[0] );
+        return 1;
+    }
+
+    lbm_event_ring_enable( true );
+    lbm_event_ring_reset_stats( );
+    lbm_dl_pool_reset_stats( );
+
+    const auto  start = std::chrono::steady_clock::now( );
+    std::thread consumer( consume );
+    std::thread producer( produce );
+    producer.join( );
+    consumer.join( );
+    const double elapsed_s =
+        std::chrono::duration<double>( std::chrono::steady_clock::now( ) - start ).count( );
+
+    lbm_event_ring_stats_t ring;
+    lbm_event_ring_get_stats( &ring );
+    lbm_dl_pool_stats_t pool;
+    lbm_dl_pool_get_stats( &pool );
+
+    printf( "\n===== event ring stress test =====\n" );
+    printf( "configuration      : %u events, a DOWNDATA every %u, bursts of %u, %u us pause, %u buffers held, %s\n",
+            events, downlink_period, burst, pause_us, held_max, ( use_wait == true ) ? "wait" : "poll" );
+    printf( "host time          : %.3f s, %.2f M events/s\n", elapsed_s, ( double ) events / elapsed_s / 1e6 );
+    printf( "producer           : %u pushed, %u dropped (%u DOWNDATA, %u with a buffer), %u DOWNDATA without buffer\n",
+            pushed_ok, dropped, dropped_downlink, dropped_buffers, no_buffer );
+    printf( "consumer           : %u received, %u missing, %u out of order, %u downlinks, %u mismatched\n",
+            received, ( uint32_t ) ( gaps + ( ( int64_t ) events - 1 - last_received ) ), out_of_order, downlinks,
+            mismatched );
+    printf( "ring               : %u pushed, %u popped, %u overflows (%u DOWNDATA), high watermark %u of %u\n",
+            ring.pushed, ring.popped, ring.overflows, ring.downlink_overflows, ring.high_watermark,
+            LBM_EVENT_RING_SIZE );
+    printf( "pool               : %u acquired, %u released, %u exhausted, %u in use, %u invalid releases\n",
+            pool.acquired, pool.released, pool.exhausted, pool.in_use, pool.invalid_release );
+    printf( "modem              : %u downlinks read\n", modem_reads );
+
+    // Events missing on the consumer side, those dropped after the last one received included
+    const uint32_t missing = gaps + ( uint32_t ) ( ( int64_t ) events - 1 - last_received );
+
+    const bool passed = ( out_of_order == 0 ) && ( mismatched == 0 ) && ( received == pushed_ok ) &&
+                        ( missing == dropped ) &&
+                        ( ring.pushed == pushed_ok ) && ( ring.popped == received ) && ( ring.overflows == dropped ) &&
+                        ( ring.downlink_overflows == dropped_downlink ) && ( ring.depth == 0 ) &&
+                        ( pool.exhausted == no_buffer ) && ( pool.acquired + pool.exhausted == modem_reads ) &&
+                        ( pool.acquired == pool.released ) &&
+                        ( pool.in_use == 0 ) && ( pool.invalid_release == 0 ) && ( pushed_ok + dropped == events );
+    printf( "\n%s\n", ( passed == true ) ? "PASS" : "FAIL" );
+    return ( passed == true ) ? 0 : 1;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
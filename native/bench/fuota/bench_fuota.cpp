@@ -0,0 +1,471 @@
+/*!
+ * \file      bench_fuota.cpp
+ *
+ * \brief     FUOTA benchmark: multicast fragmentation sessions written into a file-backed OTA partition
+ *
+ * A simulated fragmentation server sends a random firmware image to lbm_fuota_handle_message() as the TS004
+ * messages of a multicast session: PackageVersionReq and FragSessionSetupReq in one downlink, the M fragments
+ * then the coded fragments, each one lost with the given probability, and a FragSessionStatusReq at the end. The
+ * OTA partition is the host stand-in of native/smtc_hal_native/sim_ota.h, backed by a file, so the image can be
+ * inspected after the run.
+ *
+ * For each loss rate and each session, it prints whether the image was rebuilt, the fragments received, the
+ * lost ones solved from coded fragments, the flash operations, the peak RAM of the session against the RAM
+ * reserved by the module, and the virtual time the flash was busy.
+ *
+ * The server builds its coded fragments with its own copy of the parity matrix of the TS004 reference decoder,
+ * not with lbm_upload_parity_row(). Before the sessions, both are checked against rows and coded fragments
+ * produced by the reference code, and against each other for every M up to 300.
+ *
+ * The bench fails if the parity matrix differs from the reference, if a session ends with an image that differs
+ * from the original, if a session without loss does not end with the image selected for the next boot, if the
+ * flash refused a program (missing erase), or if the RAM in use ever reaches the size of the image.
+ *
+ * Usage: program [-b bytes] [-f fragment_size] [-r redundancy_%] [-t sessions] [-o file] [-s seed] [-v]
+ *   -b  image size in bytes (default 262144)
+ *   -f  fragment size, up to LBM_FUOTA_MAX_FRAGMENT_SIZE (default 200)
+ *   -r  coded fragments in percent of the fragments (default 20)
+ *   -t  sessions per loss rate (default 3)
+ *   -o  file backing the OTA partition (default fuota_ota.bin)
+ *   -s  seed of the image and of the losses (default 1)
+ *   -v  print the FUOTA log and the progress
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "lbm_api.h"
+#include "lbm_fuota.h"
+#include "lbm_upload.h"
+#include "lbm_uplink.h"
+
+extern "C" {
+#include "sim_clock.h"
+#include "sim_ota.h"
+#include "smtc_hal_dbg_trace.h"
+}
+
+#define MAX_IMAGE ( 2 * 1024 * 1024 )
+
+// Parity rows checked against the reference rows of the bench, M = 2 to SWEEP_MAX_M, N = 1 to SWEEP_MAX_N
+#define SWEEP_MAX_M 300
+#define SWEEP_MAX_N 40
+
+/**
+ * @brief Line n of the parity matrix of m fragments, one character per fragment, output of the TS004 reference
+ */
+typedef struct reference_row_s
+{
+    uint16_t    n;
+    uint16_t    m;
+    const char* row;
+} reference_row_t;
+
+// A power of 2 (the reference draws from M + 1 values) and draws that hit a fragment twice (M = 10, N = 1)
+static const reference_row_t reference_rows[] = {
+    { 1, 10, "0010010000" },
+    { 2, 10, "1010110001" },
+    { 3, 10, "0101011100" },
+    { 1, 16, "1110110000100101" },
+    { 2, 16, "0010010110011001" },
+    { 3, 16, "1110000010101100" },
+    { 1, 37, "0000100111100011110010001101000110100" },
+    { 2, 37, "0000000011011000011100010101011001111" },
+};
+
+// Blob of reference_blob() in fragments of 2 bytes (M = 10, last one padded): coded fragments 1 to 3
+#define REFERENCE_BLOB_SIZE 19
+#define REFERENCE_FRAGMENT_SIZE 2
+static const uint8_t reference_coded[][REFERENCE_FRAGMENT_SIZE] = {
+    { 0x05, 0x07 },
+    { 0x0B, 0x03 },
+    { 0x0F, 0xA6 },
+};
+
+static const uint8_t loss_rates[] = { 0, 5, 10, 20 };
+
+static const char* status_names[] = { "stopped", "idle", "receiving", "done", "failed" };
+
+static uint8_t image[MAX_IMAGE];
+static uint8_t readback[MAX_IMAGE];
+
+static bool     verbose         = false;
+static uint32_t progress_events = 0;
+static bool     session_ended   = false;
+
+static void print_usage( const char* name )
+{
+    fprintf( stderr,
+             "usage: %s [-b bytes] [-f fragment_size] [-r redundancy_%%] [-t sessions] [-o file] [-s seed] [-v]\n",
+             name );
+}
+
+static void on_fuota( lbm_fuota_event_t event, const lbm_fuota_progress_t* progress, void* context )
+{
+    ( void ) context;
+    if( event == LBM_FUOTA_EVENT_DONE )
+    {
+        session_ended = true;
+        return;
+    }
+    if( event == LBM_FUOTA_EVENT_PROGRESS )
+    {
+        progress_events++;
+    }
+    if( ( verbose == true ) && ( progress->received > 0 ) && ( ( progress->received % 256 ) == 0 ) )
+    {
+        printf( "  progress         : %u received, %u / %u in place, %u missing, %u solved\n", progress->received,
+                progress->written, progress->fragments, progress->missing, progress->solved );
+    }
+}
+
+/**
+ * @brief PRBS23 of the TS004 reference decoder
+ */
+static int32_t reference_prbs23( int32_t value )
+{
+    const int32_t b0 = value & 0x01;
+    const int32_t b1 = ( value & 0x20 ) >> 5;
+    return ( value >> 1 ) + ( ( b0 ^ b1 ) << 22 );
+}
+
+/**
+ * @brief Line n (1 to R) of the parity matrix of m fragments as the TS004 reference decoder draws it, one byte
+ *        per fragment
+ */
+static void reference_parity_row( int32_t n, int32_t m, uint8_t* matrix_row )
+{
+    // Powers of 2 draw from m + 1 values
+    int32_t bits = 0;
+    for( uint8_t i = 0; i < 32; i++ )
+    {
+        bits += ( ( ( uint32_t ) m >> i ) & 1 );
+    }
+    const int32_t m_temp = ( bits == 1 ) ? 1 : 0;
+
+    int32_t x        = 1 + ( 1001 * n );
+    int32_t nb_coeff = 0;
+    memset( matrix_row, 0, m );
+    while( nb_coeff < ( m >> 1 ) )
+    {
+        int32_t r = 1 << 16;
+        while( r >= m )
+        {
+            x = reference_prbs23( x );
+            r = x % ( m + m_temp );
+        }
+        matrix_row[r] = 1;
+        nb_coeff += 1;
+    }
+}
+
+/**
+ * @brief Byte k of the reference blob: fragment i holds i + 1 then 0xA0 + i
+ */
+static bool reference_blob( uint32_t offset, uint8_t* buffer, uint16_t size, void* context )
+{
+    ( void ) context;
+    for( uint16_t k = 0; k < size; k++ )
+    {
+        const uint32_t byte = offset + k;
+        buffer[k]           = ( ( byte % 2 ) == 0 ) ? ( uint8_t ) ( byte / 2 + 1 ) : ( uint8_t ) ( 0xA0 + byte / 2 );
+    }
+    return true;
+}
+
+/**
+ * @brief Parity rows and coded fragments against the TS004 reference, false on the first mismatch
+ */
+static bool check_parity_matrix( uint32_t* nb_rows )
+{
+    static uint8_t matrix_row[LBM_FUOTA_MAX_FRAGMENTS];
+    static uint8_t row[LBM_UPLOAD_ROW_BYTES( LBM_FUOTA_MAX_FRAGMENTS )];
+    *nb_rows = 0;
+
+    for( size_t v = 0; v < sizeof( reference_rows ) / sizeof( reference_rows[0] ); v++ )
+    {
+        const reference_row_t* reference = &reference_rows[v];
+        reference_parity_row( reference->n, reference->m, matrix_row );
+        lbm_upload_parity_row( reference->n, reference->m, row );
+        for( uint16_t i = 0; i < reference->m; i++ )
+        {
+            const uint8_t expected = ( uint8_t ) ( reference->row[i] - '0' );
+            if( ( matrix_row[i] != expected ) || ( LBM_UPLOAD_GET_BIT( row, i ) != expected ) )
+            {
+                printf( "parity row N = %u of M = %u differs from the reference at fragment %u\n", reference->n,
+                        reference->m, i );
+                return false;
+            }
+        }
+        ( *nb_rows )++;
+    }
+
+    for( uint16_t m = 2; m <= SWEEP_MAX_M; m++ )
+    {
+        for( uint16_t n = 1; n <= SWEEP_MAX_N; n++ )
+        {
+            reference_parity_row( n, m, matrix_row );
+            lbm_upload_parity_row( n, m, row );
+            for( uint16_t i = 0; i < m; i++ )
+            {
+                if( LBM_UPLOAD_GET_BIT( row, i ) != matrix_row[i] )
+                {
+                    printf( "parity row N = %u of M = %u differs from the reference at fragment %u\n", n, m, i );
+                    return false;
+                }
+            }
+            ( *nb_rows )++;
+        }
+    }
+
+    // Coded fragments as sent, padding of the last fragment included
+    const uint16_t m = lbm_upload_fragments( REFERENCE_BLOB_SIZE, REFERENCE_FRAGMENT_SIZE );
+    for( uint16_t c = 0; c < sizeof( reference_coded ) / sizeof( reference_coded[0] ); c++ )
+    {
+        uint8_t        frame[LBM_UPLOAD_HEADER_SIZE + REFERENCE_FRAGMENT_SIZE];
+        const uint16_t length = lbm_upload_encode( 0, REFERENCE_BLOB_SIZE, REFERENCE_FRAGMENT_SIZE, m + c,
+                                                   reference_blob, NULL, frame );
+        if( ( length != sizeof( frame ) ) ||
+            ( memcmp( &frame[LBM_UPLOAD_HEADER_SIZE], reference_coded[c], REFERENCE_FRAGMENT_SIZE ) != 0 ) )
+        {
+            printf( "coded fragment %u of the reference blob differs from the reference\n", c + 1 );
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Fragment n of the session as the server builds it, 1 to M: fragment n, beyond: coded fragment n - M
+ */
+static void build_fragment( uint32_t size, uint16_t fragments, uint8_t fragment_size, uint16_t n, uint8_t* out )
+{
+    static uint8_t matrix_row[LBM_FUOTA_MAX_FRAGMENTS];
+    memset( out, 0, fragment_size );
+    if( n <= fragments )
+    {
+        const uint32_t offset = ( uint32_t ) ( n - 1 ) * fragment_size;
+        memcpy( out, &image[offset], ( size - offset < fragment_size ) ? size - offset : fragment_size );
+        return;
+    }
+    reference_parity_row( n - fragments, fragments, matrix_row );
+    for( uint16_t i = 0; i < fragments; i++ )
+    {
+        if( matrix_row[i] != 0 )
+        {
+            const uint32_t offset = ( uint32_t ) i * fragment_size;
+            const uint32_t length = ( size - offset < fragment_size ) ? size - offset : fragment_size;
+            for( uint32_t k = 0; k < length; k++ )
+            {
+                out[k] ^= image[offset + k];
+            }
+        }
+    }
+}
+
+/**
+ * @brief One session, false if it ended with a wrong image or a flash misuse
+ *
+ * @param [out] progress At the end of the session
+ */
+static bool run_session( uint32_t size, uint8_t fragment_size, uint16_t redundancy, uint8_t loss_percent,
+                         uint8_t frag_index, lbm_fuota_progress_t* progress )
+{
+    const uint16_t fragments  = ( uint16_t ) ( ( size + fragment_size - 1 ) / fragment_size );
+    const uint8_t  padding    = ( uint8_t ) ( ( uint32_t ) fragments * fragment_size - size );
+    const uint32_t descriptor = 0x20260001;
+
+    lbm_fuota_end( );
+    session_ended = false;
+    if( lbm_fuota_begin( on_fuota, NULL ) != SMTC_MODEM_RC_OK )
+    {
+        fprintf( stderr, "lbm_fuota_begin() failed\n" );
+        return false;
+    }
+
+    // PackageVersionReq and FragSessionSetupReq in one downlink
+    uint8_t downlink[3 + LBM_FUOTA_MAX_FRAGMENT_SIZE];
+    downlink[0]  = 0x00;
+    downlink[1]  = 0x02;
+    downlink[2]  = ( uint8_t ) ( ( frag_index << 4 ) | 0x01 );
+    downlink[3]  = ( uint8_t ) fragments;
+    downlink[4]  = ( uint8_t ) ( fragments >> 8 );
+    downlink[5]  = fragment_size;
+    downlink[6]  = 0x00;  // parity matrix, no block ack delay
+    downlink[7]  = padding;
+    downlink[8]  = ( uint8_t ) descriptor;
+    downlink[9]  = ( uint8_t ) ( descriptor >> 8 );
+    downlink[10] = ( uint8_t ) ( descriptor >> 16 );
+    downlink[11] = ( uint8_t ) ( descriptor >> 24 );
+    lbm_fuota_handle_message( 0, downlink, 12 );
+    lbm_fuota_get_progress( progress );
+    if( progress->status != LBM_FUOTA_RECEIVING )
+    {
+        fprintf( stderr, "session refused\n" );
+        return false;
+    }
+
+    // The server sends everything, whatever the devices already have
+    for( uint16_t n = 1; n <= fragments + redundancy; n++ )
+    {
+        if( ( ( uint32_t ) rand( ) % 100 ) < loss_percent )
+        {
+            continue;
+        }
+        const uint16_t index_and_n = ( uint16_t ) ( ( frag_index << 14 ) | n );
+        downlink[0]                = 0x08;
+        downlink[1]                = ( uint8_t ) index_and_n;
+        downlink[2]                = ( uint8_t ) ( index_and_n >> 8 );
+        build_fragment( size, fragments, fragment_size, n, &downlink[3] );
+        lbm_fuota_handle_message( 0, downlink, ( uint8_t ) ( 3 + fragment_size ) );
+    }
+
+    // FragSessionStatusReq, every participant answers
+    downlink[0] = 0x01;
+    downlink[1] = ( uint8_t ) ( ( frag_index << 1 ) | 0x01 );
+    lbm_fuota_handle_message( 0, downlink, 2 );
+    lbm_fuota_get_progress( progress );
+
+    if( progress->status != LBM_FUOTA_DONE )
+    {
+        return progress->status != LBM_FUOTA_FAILED;
+    }
+    return ( session_ended == true ) && ( sim_ota_get_boot_size( ) == size ) &&
+           ( sim_ota_read( 0, readback, size ) == true ) && ( memcmp( readback, image, size ) == 0 );
+}
+
+int main( int argc, char** argv )
+{
+    uint32_t    size               = 262144;
+    uint32_t    fragment_size      = 200;
+    uint32_t    redundancy_percent = 20;
+    uint32_t    sessions           = 3;
+    const char* path               = "fuota_ota.bin";
+    uint32_t    seed               = 1;
+
+    int opt;
+    while( ( opt = getopt( argc, argv, "b:f:r:t:o:s:v" ) ) != -1 )
+    {
+        switch( opt )
+        {
+        case 'b':
+            size = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'f':
+            fragment_size = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'r':
+            redundancy_percent = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 't':
+            sessions = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'o':
+            path = optarg;
+            break;
+        case 's':
+            seed = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'v':
+            verbose = true;
+            break;
+        default:
+            print_usage( argv[0] );
+            return 1;
+        }
+    }
+    if( ( size < 2 ) || ( size > MAX_IMAGE ) || ( fragment_size == 0 ) ||
+        ( fragment_size > LBM_FUOTA_MAX_FRAGMENT_SIZE ) || ( redundancy_percent > 100 ) || ( sessions == 0 ) ||
+        ( ( size + fragment_size - 1 ) / fragment_size > LBM_FUOTA_MAX_FRAGMENTS ) )
+    {
+        print_usage( argv[0] );
+        return 1;
+    }
+
+    srand( seed );
+    for( uint32_t i = 0; i < size; i++ )
+    {
+        image[i] = ( uint8_t ) rand( );
+    }
+    image[0] = SIM_OTA_IMAGE_MAGIC;
+
+    hal_trace_set_quiet( !verbose );
+    sim_clock_reset( );
+    if( sim_ota_set_file( path ) == false )
+    {
+        fprintf( stderr, "cannot open %s\n", path );
+        return 1;
+    }
+
+    const uint16_t fragments  = ( uint16_t ) ( ( size + fragment_size - 1 ) / fragment_size );
+    const uint16_t redundancy = ( uint16_t ) ( ( ( uint32_t ) fragments * redundancy_percent + 99 ) / 100 );
+
+    printf( "\n===== FUOTA benchmark =====\n" );
+    printf( "image              : %u bytes, %u fragments of %u bytes + %u coded, %u sessions per loss rate\n", size,
+            fragments, fragment_size, redundancy, sessions );
+    printf( "OTA partition      : %s, %u bytes\n", path, SIM_OTA_PARTITION_SIZE );
+
+    uint32_t   nb_rows = 0;
+    const bool matrix  = check_parity_matrix( &nb_rows );
+    printf( "parity matrix      : %s, %u rows and %u coded fragments checked against the TS004 reference\n",
+            ( matrix == true ) ? "ok" : "MISMATCH", nb_rows,
+            ( unsigned ) ( sizeof( reference_coded ) / sizeof( reference_coded[0] ) ) );
+
+    bool passed = matrix;
+    for( uint8_t l = 0; l < sizeof( loss_rates ); l++ )
+    {
+        for( uint32_t t = 0; t < sessions; t++ )
+        {
+            lbm_fuota_progress_t progress;
+            sim_ota_stats_t      flash;
+            lbm_uplink_stats_t   uplink_before;
+            lbm_uplink_stats_t   uplink_after;
+            lbm_uplink_get_stats( &uplink_before );
+            sim_ota_reset_stats( );
+            progress_events = 0;
+
+            const uint64_t host_start_us = sim_clock_host_elapsed_us( );
+            const bool     ok = run_session( size, ( uint8_t ) fragment_size, redundancy, loss_rates[l],
+                                             ( uint8_t ) ( t % 4 ), &progress );
+            const uint64_t host_us = sim_clock_host_elapsed_us( ) - host_start_us;
+            sim_ota_get_stats( &flash );
+            lbm_uplink_get_stats( &uplink_after );
+            // Nothing joined sends the answers: cancel them so the tickets last (numbered from 1, FUOTA is alone)
+            for( uint32_t ticket = uplink_before.submitted + 1; ticket <= uplink_after.submitted; ticket++ )
+            {
+                lbm_uplink_cancel( ticket );
+            }
+
+            const uint32_t sent = fragments + redundancy;
+            printf( "%2u %% loss, session %u: %s%s\n", loss_rates[l], t + 1, status_names[progress.status],
+                    ( ok == true ) ? "" : ", WRONG IMAGE" );
+            printf( "  fragments        : %u received of %u sent (%u coded), %u redundant, %u dropped\n",
+                    progress.received, sent, progress.coded, progress.redundant, progress.dropped );
+            printf( "  image            : %u / %u fragments in place, %u lost ones solved of %u in slots\n",
+                    progress.written, progress.fragments, progress.solved, progress.missing );
+            printf( "  flash            : %u erases, %u programs (%u bytes), %u reads, %.1f s busy, %u refused\n",
+                    flash.erases, flash.programs, flash.program_bytes, flash.reads, flash.busy_us / 1e6,
+                    flash.rejected );
+            printf( "  RAM              : %u bytes peak, %u reserved, %.2f %% of the image\n",
+                    progress.peak_ram_bytes, progress.ram_bytes, 100.0 * progress.peak_ram_bytes / size );
+            printf( "  answers          : %u uplinks queued, %u progress events, %.0f ms host time\n",
+                    uplink_after.submitted - uplink_before.submitted, progress_events, host_us / 1000.0 );
+
+            passed &= ( ok == true ) && ( flash.rejected == 0 ) && ( progress.peak_ram_bytes < size );
+            if( loss_rates[l] == 0 )
+            {
+                passed &= ( progress.status == LBM_FUOTA_DONE );
+            }
+        }
+    }
+    lbm_fuota_end( );
+    sim_ota_flush( );
+
+    printf( "\n%s\n", ( passed == true ) ? "PASS" : "FAIL" );
+    return ( passed == true ) ? 0 : 1;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,254 @@
+/*!
+ * \file      bench_lr_fhss.cpp
+ *
+ * \brief     LR-FHSS data rates: hop sequences of the sx126x driver and time on air against lbm_airtime
+ *
+ * For each EU868 LR-FHSS data rate (DR8-DR11, RP002-1.0.3: 3.9 kHz grid, CR1/3 with 3 headers or CR2/3 with 2,
+ * 137 or 336 kHz occupied channel width):
+ * - the time on air of the driver (sx126x_lr_fhss_get_time_on_air_in_ms) must equal lbm_airtime_phy_us(),
+ *   rounded up to the ms, for every PHY payload size the data rate allows
+ * - the hop count of the driver must be that of lbm_airtime_lr_fhss_hops()
+ * - every hop sequence id the driver offers generates hops inside the occupied channel width, and the same
+ *   sequence each time
+ * It also reports how many sequences share their first hops with another one and how evenly the grid
+ * channels are used. No radio is involved: the bench calls the frame processing of lr_fhss_mac.c directly.
+ *
+ * Usage: program [-d datarate] [-v]
+ *   -d  check one data rate, 8 to 11 (default all)
+ *   -v  print the hops of sequence 0 for the largest payload
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "lbm_airtime.h"
+
+extern "C" {
+#include "lr_fhss_mac.h"
+#include "sx126x_lr_fhss.h"
+}
+
+#define FIRST_LR_FHSS_DR 8
+#define LAST_LR_FHSS_DR 11
+#define GRID_HZ 3906
+#define CENTER_HZ 868300000u
+#define MAX_HOPS 128
+#define MAX_GRID 128
+
+// Hops compared to tell two sequences apart
+#define SIGNATURE_HOPS 16
+
+// RP002-1.0.3 LR-FHSS sync word
+static const uint8_t sync_word[LR_FHSS_SYNC_WORD_BYTES] = { 0x2C, 0x0F, 0x79, 0x95 };
+
+static void print_usage( const char* name )
+{
+    fprintf( stderr, "usage: %s [-d datarate] [-v]\n", name );
+}
+
+static void get_params( const lbm_airtime_datarate_t& dr, sx126x_lr_fhss_params_t* params )
+{
+    memset( params, 0, sizeof( *params ) );
+    memcpy( params->lr_fhss_params.sync_word, sync_word, sizeof( sync_word ) );
+    params->lr_fhss_params.modulation_type = LR_FHSS_V1_MODULATION_TYPE_GMSK_488;
+    params->lr_fhss_params.cr              = ( dr.cr == 1 ) ? LR_FHSS_V1_CR_1_3 : LR_FHSS_V1_CR_2_3;
+    params->lr_fhss_params.grid            = LR_FHSS_V1_GRID_3906_HZ;
+    params->lr_fhss_params.bw              = ( dr.bw_khz == 137 ) ? LR_FHSS_V1_BW_136719_HZ : LR_FHSS_V1_BW_335938_HZ;
+    params->lr_fhss_params.enable_hopping  = true;
+    params->lr_fhss_params.header_count    = dr.preamble;
+    params->center_freq_in_pll_steps       = sx126x_convert_freq_in_hz_to_pll_step( CENTER_HZ );
+    params->device_offset                  = 0;
+}
+
+/**
+ * @return Number of hops written to hops, 0 if the driver refuses the sequence id
+ */
+static uint32_t generate( const sx126x_lr_fhss_params_t* params, uint16_t id, uint16_t nb_hops, int16_t* hops,
+                          uint16_t* n_grid )
+{
+    lr_fhss_hop_params_t hop_params;
+    uint16_t             lfsr_state;
+    if( lr_fhss_get_hop_params( &params->lr_fhss_params, &hop_params, &lfsr_state, id ) != LR_FHSS_STATUS_OK )
+    {
+        return 0;
+    }
+    *n_grid = hop_params.n_grid;
+    for( uint16_t h = 0; h < nb_hops; h++ )
+    {
+        hops[h] = lr_fhss_get_next_freq_in_grid( &lfsr_state, &hop_params, &params->lr_fhss_params );
+    }
+    return nb_hops;
+}
+
+static bool check_time_on_air( uint8_t datarate, const lbm_airtime_datarate_t& dr,
+                               const sx126x_lr_fhss_params_t* params )
+{
+    uint32_t mismatches = 0;
+    for( uint32_t phy = LBM_AIRTIME_FRAME_OVERHEAD; phy <= ( uint32_t ) dr.max_payload + LBM_AIRTIME_FRAME_OVERHEAD; phy++ )
+    {
+        const uint32_t driver_ms = sx126x_lr_fhss_get_time_on_air_in_ms( params, ( uint16_t ) phy );
+        const uint32_t table_ms  = ( lbm_airtime_phy_us( dr, phy ) + 999 ) / 1000;
+
+        lr_fhss_digest_t digest;
+        lr_fhss_process_parameters( &params->lr_fhss_params, ( uint16_t ) phy, &digest );
+        if( ( driver_ms != table_ms ) || ( digest.nb_hops != lbm_airtime_lr_fhss_hops( dr, phy ) ) )
+        {
+            if( mismatches == 0 )
+            {
+                printf( "  DR%u, %u-byte PHY payload: driver %u ms / %u hops, lbm_airtime %u ms / %u hops\n",
+                        datarate, phy, driver_ms, digest.nb_hops, table_ms, lbm_airtime_lr_fhss_hops( dr, phy ) );
+            }
+            mismatches++;
+        }
+    }
+    printf( "time on air        : %u to %u ms for %u to %u bytes of application payload, %u mismatches\n",
+            ( lbm_airtime_uplink_us( dr, 0 ) + 999 ) / 1000, ( lbm_airtime_uplink_us( dr, dr.max_payload ) + 999 ) / 1000,
+            0, dr.max_payload, mismatches );
+    return mismatches == 0;
+}
+
+static bool check_hop_sequences( const lbm_airtime_datarate_t& dr, const sx126x_lr_fhss_params_t* params,
+                                 bool verbose )
+{
+    static int16_t  hops[MAX_HOPS];
+    static int16_t  again[MAX_HOPS];
+    static int16_t  signatures[1024][SIGNATURE_HOPS];
+    static uint32_t occupancy[MAX_GRID];
+
+    const uint32_t phy      = dr.max_payload + LBM_AIRTIME_FRAME_OVERHEAD;
+    const uint16_t nb_hops  = ( uint16_t ) lbm_airtime_lr_fhss_hops( dr, phy );
+    const uint32_t count    = lr_fhss_get_hop_sequence_count( &params->lr_fhss_params );
+    const int32_t  half_ocw = ( int32_t ) dr.bw_khz * 1000 / 2;
+    uint32_t       refused  = 0;
+    uint32_t       outside  = 0;
+    uint32_t       unstable = 0;
+    uint32_t       shared   = 0;
+    uint16_t       n_grid   = 0;
+    memset( occupancy, 0, sizeof( occupancy ) );
+    if( nb_hops > MAX_HOPS )
+    {
+        return false;
+    }
+
+    for( uint32_t id = 0; id < count; id++ )
+    {
+        if( ( generate( params, ( uint16_t ) id, nb_hops, hops, &n_grid ) == 0 ) || ( n_grid > MAX_GRID ) )
+        {
+            refused++;
+            continue;
+        }
+        generate( params, ( uint16_t ) id, nb_hops, again, &n_grid );
+        if( memcmp( hops, again, nb_hops * sizeof( hops[0] ) ) != 0 )
+        {
+            unstable++;
+        }
+
+        for( uint16_t h = 0; h < nb_hops; h++ )
+        {
+            const int32_t offset_hz = ( int32_t ) hops[h] * GRID_HZ;
+            if( ( offset_hz < -half_ocw ) || ( offset_hz > half_ocw ) )
+            {
+                outside++;
+            }
+            const int32_t channel = hops[h] + n_grid / 2;
+            if( ( channel >= 0 ) && ( channel < MAX_GRID ) )
+            {
+                occupancy[channel]++;
+            }
+        }
+
+        if( id < sizeof( signatures ) / sizeof( signatures[0] ) )
+        {
+            const uint16_t n = ( nb_hops < SIGNATURE_HOPS ) ? nb_hops : SIGNATURE_HOPS;
+            memset( signatures[id], 0, sizeof( signatures[id] ) );
+            memcpy( signatures[id], hops, n * sizeof( hops[0] ) );
+            for( uint32_t other = 0; other < id; other++ )
+            {
+                if( memcmp( signatures[id], signatures[other], sizeof( signatures[id] ) ) == 0 )
+                {
+                    shared++;
+                    break;
+                }
+            }
+        }
+
+        if( ( verbose == true ) && ( id == 0 ) )
+        {
+            printf( "sequence 0 (kHz)   :" );
+            for( uint16_t h = 0; h < nb_hops; h++ )
+            {
+                printf( " %+.1f", hops[h] * GRID_HZ / 1000.0 );
+            }
+            printf( "\n" );
+        }
+    }
+
+    uint32_t used = 0;
+    uint32_t min  = UINT32_MAX;
+    uint32_t max  = 0;
+    for( uint16_t c = 0; ( c <= n_grid ) && ( c < MAX_GRID ); c++ )
+    {
+        if( occupancy[c] == 0 )
+        {
+            continue;
+        }
+        used++;
+        min = ( occupancy[c] < min ) ? occupancy[c] : min;
+        max = ( occupancy[c] > max ) ? occupancy[c] : max;
+    }
+    printf( "hop sequences      : %u of %u hops each, %u refused, %u not reproducible, %u hops outside +/-%d kHz\n",
+            count, nb_hops, refused, unstable, outside, half_ocw / 1000 );
+    printf( "spread             : %u sequences share their first %u hops with another, %u grid channels used, "
+            "%u to %u hops each\n",
+            shared, SIGNATURE_HOPS, used, ( used > 0 ) ? min : 0, max );
+    return ( count > 0 ) && ( refused == 0 ) && ( unstable == 0 ) && ( outside == 0 );
+}
+
+int main( int argc, char** argv )
+{
+    uint8_t first   = FIRST_LR_FHSS_DR;
+    uint8_t last    = LAST_LR_FHSS_DR;
+    bool    verbose = false;
+
+    int opt;
+    while( ( opt = getopt( argc, argv, "d:v" ) ) != -1 )
+    {
+        switch( opt )
+        {
+        case 'd':
+            first = last = ( uint8_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'v':
+            verbose = true;
+            break;
+        default:
+            print_usage( argv[0] );
+            return 1;
+        }
+    }
+    if( ( first < FIRST_LR_FHSS_DR ) || ( last > LAST_LR_FHSS_DR ) )
+    {
+        print_usage( argv[0] );
+        return 1;
+    }
+
+    bool passed = true;
+    for( uint8_t datarate = first; datarate <= last; datarate++ )
+    {
+        const lbm_airtime_datarate_t& dr = LBM_AIRTIME_EU868[datarate];
+        sx126x_lr_fhss_params_t       params;
+        get_params( dr, &params );
+
+        printf( "\n===== EU868 DR%u: LR-FHSS CR%u/3, %u kHz, %u headers =====\n", datarate, dr.cr, dr.bw_khz,
+                dr.preamble );
+        passed &= check_time_on_air( datarate, dr, &params );
+        passed &= check_hop_sequences( dr, &params, verbose );
+    }
+
+    printf( "\n%s\n", ( passed == true ) ? "PASS" : "FAIL" );
+    return ( passed == true ) ? 0 : 1;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,268 @@
+/*!
+ * \file      bench_multistack.cpp
+ *
+ * \brief     Two LoRaWAN stacks on one radio: how the radio planner interleaves their TX and RX windows
+ *
+ * Stack 0 (lbm.lorawan, a private network) and stack 1 (lbm.lorawanStack(1), a public one) join with their own
+ * credentials, then each sends an uplink every period. The uplinks of stack 1 start offset ms after those of
+ * stack 0, by default inside the RX windows of stack 0, so the planner has to move or abort tasks. The simulated
+ * network server answers both devices; the frames it sees on the air are printed as a timeline, each marked
+ * when it falls in the RX windows of the other stack. Each stack reports its events on its own callback.
+ *
+ * Build with NUMBER_OF_STACKS=2 ([env:native_bench_multistack]).
+ *
+ * Usage: program [-d seconds] [-p period_s] [-o offset_ms] [-c] [-s seed] [-t timeline_lines] [-v]
+ *   -d  simulated duration in seconds (default 3600)
+ *   -p  uplink period of each stack in seconds (default 60)
+ *   -o  delay of the uplinks of stack 1 after those of stack 0 in ms (default 1500, between RX1 and RX2)
+ *   -c  confirmed uplinks, so every uplink has an RX1 downlink
+ *   -s  seed of the modem random generator (default 1)
+ *   -t  frames printed in the timeline (default 40)
+ *   -v  print the modem traces
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "bench_join.h"
+#include "lbm_api.h"
+
+extern "C" {
+#include "sim_clock.h"
+#include "sim_network.h"
+#include "smtc_hal_dbg_trace.h"
+#include "smtc_modem_hal_native.h"
+}
+
+#define NB_STACKS 2
+#define UPLINK_PORT 2
+#define UPLINK_SIZE 12
+
+// Stack 0 uses the credentials of lbm_config.h, stack 1 those of the second network
+static const uint8_t dev_eui_1[8]  = { 0x70, 0xB3, 0xD5, 0x7E, 0xD0, 0x00, 0x00, 0x02 };
+static const uint8_t join_eui_1[8] = { 0x70, 0xB3, 0xD5, 0x7E, 0xD0, 0x00, 0x00, 0x00 };
+static const uint8_t app_key_1[16] = { 0x2B, 0x7E, 0x15, 0x16, 0x28, 0xAE, 0xD2, 0xA6,
+                                       0xAB, 0xF7, 0x15, 0x88, 0x09, 0xCF, 0x4F, 0x3C };
+
+#define DEV_ADDR_1 0x260B5678
+
+// RX windows of an uplink, from its end: RX1 at 1 s, RX2 at 2 s (Join-Accept: 5 s and 6 s), one second each
+#define RX_WINDOWS_SPAN_US 3000000u
+#define JOIN_RX_WINDOWS_SPAN_US 7000000u
+
+typedef struct stack_state_s
+{
+    bool     joined;
+    uint32_t requested;  // uplinks handed to the modem
+    uint32_t refused;    // uplinks the modem refused (busy, duty cycle)
+    uint64_t next_uplink_us;
+    uint64_t rx_windows_end_us;  // end of the RX windows of its last frame on the air
+    uint32_t frames_in_other_windows;
+} stack_state_t;
+
+static stack_state_t stacks[NB_STACKS];
+static uint32_t      timeline_lines = 40;
+static uint32_t      timeline_count = 0;
+
+static void print_usage( const char* name )
+{
+    fprintf( stderr, "usage: %s [-d seconds] [-p period_s] [-o offset_ms] [-c] [-s seed] [-t timeline_lines] [-v]\n",
+             name );
+}
+
+static void on_event( uint8_t stack_id, smtc_modem_event_t* event )
+{
+    if( event->event_type == SMTC_MODEM_EVENT_JOINED )
+    {
+        stacks[stack_id].joined = true;
+    }
+}
+
+static void on_event_stack_0( smtc_modem_event_t* event )
+{
+    on_event( 0, event );
+}
+
+static void on_event_stack_1( smtc_modem_event_t* event )
+{
+    on_event( 1, event );
+}
+
+static void on_air( uint8_t device, bool downlink, const sim_radio_params_t* params, uint8_t size, uint64_t start_us,
+                    uint32_t time_on_air_us )
+{
+    if( device >= NB_STACKS )
+    {
+        return;
+    }
+
+    // The other stack could not listen while this frame was on the air
+    const uint8_t  other  = ( uint8_t ) ( 1 - device );
+    const bool     inside = start_us < stacks[other].rx_windows_end_us;
+    const uint64_t end_us = start_us + time_on_air_us;
+    if( inside == true )
+    {
+        stacks[device].frames_in_other_windows++;
+    }
+    if( downlink == false )
+    {
+        const bool join = ( size == 23 );
+        stacks[device].rx_windows_end_us = end_us + ( join ? JOIN_RX_WINDOWS_SPAN_US : RX_WINDOWS_SPAN_US );
+    }
+
+    if( timeline_count < timeline_lines )
+    {
+        timeline_count++;
+        printf( "%10.3f s  stack %u  %-8s %7.3f MHz SF%u %3u bytes %7.1f ms%s\n", ( double ) start_us / 1e6, device,
+                downlink ? "downlink" : "uplink", ( double ) params->freq_hz / 1e6, params->sf, size,
+                ( double ) time_on_air_us / 1e3, inside ? "  (in the RX windows of the other stack)" : "" );
+    }
+}
+
+static void join( LoRaWANClass* stack, const uint8_t* dev_eui, const uint8_t* join_eui, const uint8_t* app_key,
+                  bool public_network )
+{
+    stack->setNetworkType( public_network );
+    bench_join_stack( stack, dev_eui, join_eui, app_key );
+}
+
+int main( int argc, char** argv )
+{
+    uint32_t duration_s = 3600;
+    uint32_t period_s   = 60;
+    uint32_t offset_ms  = 1500;
+    bool     confirmed  = false;
+    uint32_t seed       = 1;
+    bool     verbose    = false;
+
+    int opt;
+    while( ( opt = getopt( argc, argv, "d:p:o:cs:t:v" ) ) != -1 )
+    {
+        switch( opt )
+        {
+        case 'd':
+            duration_s = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'p':
+            period_s = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'o':
+            offset_ms = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'c':
+            confirmed = true;
+            break;
+        case 's':
+            seed = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 't':
+            timeline_lines = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'v':
+            verbose = true;
+            break;
+        default:
+            print_usage( argv[0] );
+            return 1;
+        }
+    }
+    if( period_s == 0 )
+    {
+        print_usage( argv[0] );
+        return 1;
+    }
+    if( lbm.getNumberOfStacks( ) < NB_STACKS )
+    {
+        fprintf( stderr, "built with %u stack(s), needs NUMBER_OF_STACKS=%u\n", lbm.getNumberOfStacks( ), NB_STACKS );
+        return 1;
+    }
+
+    sim_network_config_t network_config;
+    sim_network_get_default_config( &network_config );
+    network_config.seed = seed;
+
+    hal_trace_set_quiet( !verbose );
+    sim_clock_reset( );
+    smtc_modem_hal_native_set_seed( seed );
+    sim_network_configure( &network_config );
+    sim_network_add_device( dev_eui_1, app_key_1, DEV_ADDR_1 );
+    sim_network_set_air_handler( on_air );
+
+    printf( "\n===== timeline of the frames on the air =====\n" );
+
+    LoRaWANClass* stack_0 = lbm.lorawanStack( 0 );
+    LoRaWANClass* stack_1 = lbm.lorawanStack( 1 );
+    lbm.init( );
+    stack_0->setEventCallback( on_event_stack_0 );
+    stack_1->setEventCallback( on_event_stack_1 );
+    join( stack_0, NULL, NULL, NULL, false );
+    join( stack_1, dev_eui_1, join_eui_1, app_key_1, true );
+
+    // Once both have joined, stack 1 sends offset_ms after stack 0
+    const uint64_t end_us  = ( uint64_t ) duration_s * 1000000ULL;
+    bool           started = false;
+    while( sim_clock_now_us( ) < end_us )
+    {
+        uint32_t wait_ms = 1000;
+        if( started == true )
+        {
+            const uint64_t next_us = ( stacks[0].next_uplink_us < stacks[1].next_uplink_us ) ? stacks[0].next_uplink_us
+                                                                                           : stacks[1].next_uplink_us;
+            const uint64_t now_us  = sim_clock_now_us( );
+            wait_ms                = ( next_us > now_us ) ? ( uint32_t ) ( ( next_us - now_us + 999 ) / 1000 ) : 0;
+        }
+        lbm.runEngineUntilEvent( wait_ms );
+
+        if( ( started == false ) && ( stacks[0].joined == true ) && ( stacks[1].joined == true ) )
+        {
+            started                  = true;
+            stacks[0].next_uplink_us = sim_clock_now_us( ) + 10000000ULL;
+            stacks[1].next_uplink_us = stacks[0].next_uplink_us + ( uint64_t ) offset_ms * 1000ULL;
+        }
+        if( started == false )
+        {
+            continue;
+        }
+
+        for( uint8_t id = 0; id < NB_STACKS; id++ )
+        {
+            if( sim_clock_now_us( ) < stacks[id].next_uplink_us )
+            {
+                continue;
+            }
+            stacks[id].next_uplink_us += ( uint64_t ) period_s * 1000000ULL;
+
+            uint8_t payload[UPLINK_SIZE];
+            memset( payload, id, sizeof( payload ) );
+            stacks[id].requested++;
+            if( lbm.lorawanStack( id )->send( payload, sizeof( payload ), UPLINK_PORT, confirmed ) != SMTC_MODEM_RC_OK )
+            {
+                stacks[id].refused++;
+            }
+        }
+    }
+
+    sim_network_stats_t network;
+    sim_network_get_stats( &network );
+
+    printf( "\n===== two stacks on one radio =====\n" );
+    printf( "virtual time       : %.0f s, an uplink every %u s per stack, stack 1 %u ms after stack 0, %s\n",
+            ( double ) sim_clock_now_us( ) / 1e6, period_s, offset_ms, confirmed ? "confirmed" : "unconfirmed" );
+    for( uint8_t id = 0; id < NB_STACKS; id++ )
+    {
+        lbm_stack_stats_t stats;
+        lbm.lorawanStack( id )->getStackStats( &stats );
+        printf( "stack %u            : %u joined, %u join fails, %u uplinks requested, %u refused\n", id,
+                stats.joined, stats.join_fails, stacks[id].requested, stacks[id].refused );
+        printf( "                     %u sent, %u not sent, %u downlinks, %u radio planner aborts\n", stats.tx_done,
+                stats.tx_not_sent, stats.downlinks, stats.planner_aborts );
+        printf( "                     server: %u uplinks, %u downlinks; %u frames in the RX windows of the other\n",
+                network.device_uplinks[id], network.device_downlinks[id], stacks[id].frames_in_other_windows );
+    }
+    return 0;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,345 @@
+/*!
+ * \file      bench_nvm.cpp
+ *
+ * \brief     Context store benchmark: flash writes of the lbm_nvm journal, and power loss at every write
+ *
+ * "modem" mode joins and sends an uplink every period through the simulated network, then reports the context
+ * stores of the modem and what they cost in flash: program and erase operations per uplink and the longest time
+ * the modem was blocked. A HAL writing every store through would erase and program a sector each time.
+ *
+ * "powerloss" mode drives the context store directly with a modem-like workload (a frame counter stored for
+ * every frame, settings now and then, keys on rejoin) and cuts the power during each program or erase in turn.
+ * After every cut the journal is mounted again and each context must come back as one of the versions stored,
+ * not older than the last transmission and at most LBM_NVM_MAX_DEFERRED stores behind. The workload then goes on
+ * from there and is checked once more after a clean reboot.
+ *
+ * Usage: program [-m modem|powerloss] [-d seconds] [-p period_s] [-s seed] [-v]
+ *   -m  mode (default modem)
+ *   -d  simulated duration in seconds, modem mode (default 86400)
+ *   -p  uplink period in seconds, modem mode (default 300)
+ *   -s  seed of the modem random generator (default 1)
+ *   -v  print the modem traces
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "bench_join.h"
+#include "lbm_api.h"
+#include "lbm_nvm.h"
+
+extern "C" {
+#include "sim_clock.h"
+#include "sim_network.h"
+#include "smtc_hal_dbg_trace.h"
+#include "smtc_modem_hal.h"
+#include "smtc_modem_hal_native.h"
+}
+
+#define UPLINK_PORT 2
+
+// Power loss workload
+#define WORKLOAD_STEPS 400
+#define WORKLOAD_RESUMED_STEPS 40
+#define NB_WORKLOAD_CONTEXTS 3
+
+typedef struct workload_context_s
+{
+    modem_context_type_t type;
+    uint16_t             size;
+    uint32_t             version;  // last version stored
+    uint32_t             durable;  // version stored before the last transmission or idle flush
+} workload_context_t;
+
+// Frame counters, settings, keys
+static workload_context_t workload[NB_WORKLOAD_CONTEXTS] = {
+    { CONTEXT_LORAWAN_STACK, 40, 0, 0 },
+    { CONTEXT_MODEM, 24, 0, 0 },
+    { CONTEXT_SECURE_ELEMENT, 220, 0, 0 },
+};
+
+static void print_usage( const char* name )
+{
+    fprintf( stderr, "usage: %s [-m modem|powerloss] [-d seconds] [-p period_s] [-s seed] [-v]\n", name );
+}
+
+static void print_stats( const lbm_nvm_stats_t* stats, uint32_t uplinks )
+{
+    const uint32_t operations = stats->flash_programs + stats->flash_erases;
+    printf( "context stores     : %u (%u unchanged)\n", stats->stores, stats->stores_unchanged );
+    printf( "journal            : %u change records, %u snapshots\n", stats->journal_records, stats->snapshots );
+    printf( "flash              : %u programs (%u bytes), %u erases\n", stats->flash_programs, stats->flash_bytes,
+            stats->flash_erases );
+    printf( "per uplink         : %.2f flash operations, %.2f erases (%u uplinks, %u transmissions)\n",
+            ( uplinks > 0 ) ? ( double ) operations / uplinks : 0.0,
+            ( uplinks > 0 ) ? ( double ) stats->flash_erases / uplinks : 0.0, uplinks, stats->transmissions );
+    printf( "longest write      : %.3f ms\n", stats->max_write_us / 1000.0 );
+    printf( "write-through HAL  : %u erases and %u programs, %.3f ms or more per store\n",
+            stats->stores - stats->stores_unchanged, stats->stores - stats->stores_unchanged,
+            ( SMTC_MODEM_HAL_NATIVE_FLASH_ERASE_US + SMTC_MODEM_HAL_NATIVE_FLASH_PROGRAM_US ) / 1000.0 );
+}
+
+static int run_modem( uint32_t duration_s, uint32_t period_s )
+{
+    lbm.init( );
+    bench_join_start( lbm, NULL );
+
+    const uint64_t end_us         = ( uint64_t ) duration_s * 1000000ULL;
+    uint64_t       next_uplink_us = 0;
+    uint32_t       counter        = 0;
+    while( sim_clock_now_us( ) < end_us )
+    {
+        lbm.runEngineUntilEvent( 1000 );
+        if( ( bench_joined( ) == false ) || ( sim_clock_now_us( ) < next_uplink_us ) )
+        {
+            continue;
+        }
+        next_uplink_us = sim_clock_now_us( ) + ( uint64_t ) period_s * 1000000ULL;
+        counter++;
+        lbm.lorawan.send( ( const uint8_t* ) &counter, sizeof( counter ), UPLINK_PORT, false );
+    }
+    lbm.syncNvm( );
+
+    sim_network_stats_t network;
+    sim_network_get_stats( &network );
+    lbm_nvm_stats_t stats;
+    lbm.getNvmStats( &stats );
+
+    printf( "\n===== context store benchmark =====\n" );
+    printf( "virtual time       : %.0f s (uplink every %u s)\n", ( double ) sim_clock_now_us( ) / 1e6, period_s );
+    print_stats( &stats, network.uplinks );
+    return 0;
+}
+
+static void fill_context( const workload_context_t* context, uint32_t version, uint8_t* data )
+{
+    // Counter first, check bytes last: a change spans the whole structure, as with the CRC of the modem contexts
+    memcpy( data, &version, sizeof( version ) );
+    for( uint16_t i = sizeof( version ); i < context->size; i++ )
+    {
+        data[i] = ( uint8_t ) ( version * 31u + i * 7u + context->type );
+    }
+}
+
+static void store_context( workload_context_t* context )
+{
+    uint8_t data[256];
+    context->version++;
+    fill_context( context, context->version, data );
+    smtc_modem_hal_context_store( context->type, 0, data, context->size );
+}
+
+static void mark_durable( smtc_modem_return_code_t ret )
+{
+    if( ( ret != SMTC_MODEM_RC_OK ) || smtc_modem_hal_native_flash_power_lost( ) )
+    {
+        return;
+    }
+    for( int c = 0; c < NB_WORKLOAD_CONTEXTS; c++ )
+    {
+        workload[c].durable = workload[c].version;
+    }
+}
+
+/**
+ * @brief Run the workload until its end or until the power goes
+ */
+static void run_workload( uint32_t first_step, uint32_t steps )
+{
+    for( uint32_t step = first_step; ( step < first_step + steps ) && !smtc_modem_hal_native_flash_power_lost( ); step++ )
+    {
+        store_context( &workload[0] );
+        if( ( step % 7 ) == 0 )
+        {
+            store_context( &workload[1] );
+        }
+        if( ( step % 97 ) == 96 )
+        {
+            store_context( &workload[2] );
+        }
+        if( ( step % 4 ) == 3 )
+        {
+            // What sx126x_set_tx() does before a frame goes out
+            mark_durable( lbm_nvm_flush( ) );
+        }
+        if( ( step % 25 ) == 24 )
+        {
+            mark_durable( lbm_nvm_idle( ) );
+        }
+    }
+}
+
+/**
+ * @brief Mount the journal again and check what the modem would read back
+ *
+ * @return Number of contexts restored wrong, each one reported
+ */
+static int check_restore( uint32_t cut, bool exact )
+{
+    smtc_modem_hal_native_flash_restore_power( );
+    lbm_nvm_init( );
+
+    int errors = 0;
+    for( int c = 0; c < NB_WORKLOAD_CONTEXTS; c++ )
+    {
+        workload_context_t* context = &workload[c];
+        uint8_t             restored[256];
+        uint8_t             expected[256];
+        smtc_modem_hal_context_restore( context->type, 0, restored, context->size );
+
+        uint32_t version = 0;
+        memcpy( &version, restored, sizeof( version ) );
+        fill_context( context, version, expected );
+        bool intact = ( memcmp( restored, expected, context->size ) == 0 );
+
+        // Blank: never written before the cut, as after a factory reset
+        memset( expected, 0xFF, context->size );
+        if( memcmp( restored, expected, context->size ) == 0 )
+        {
+            version = 0;
+            intact  = true;
+        }
+        const uint32_t oldest = exact ? context->version : context->durable;
+        if( ( intact == false ) || ( version < oldest ) || ( version > context->version ) ||
+            ( context->version - version > LBM_NVM_MAX_DEFERRED ) )
+        {
+            printf( "cut %u: context %d restored %s version %u, expected %u to %u\n", cut, context->type,
+                    intact ? "at" : "corrupted near", version, oldest, context->version );
+            errors++;
+        }
+
+        // The modem goes on with what it read back
+        context->version = version;
+        context->durable = version;
+    }
+    return errors;
+}
+
+static int run_power_loss( void )
+{
+    static uint8_t blank[SMTC_MODEM_HAL_NATIVE_FLASH_SIZE];
+    memset( blank, 0xFF, sizeof( blank ) );
+
+    // Reference run, to know how many flash operations there are to cut
+    smtc_modem_hal_native_flash_load( blank );
+    lbm_nvm_init( );
+    lbm_nvm_reset_stats( );
+    const uint32_t operations_before = smtc_modem_hal_native_flash_get_operation_count( );
+    run_workload( 0, WORKLOAD_STEPS );
+    const uint32_t operations = smtc_modem_hal_native_flash_get_operation_count( ) - operations_before;
+    lbm_nvm_stats_t reference;
+    lbm_nvm_get_stats( &reference );
+
+    int      failures     = 0;
+    uint32_t max_gap      = 0;
+    uint32_t discarded    = 0;
+    uint32_t fallback_cut = 0;
+    for( uint32_t cut = 1; cut <= operations; cut++ )
+    {
+        for( int c = 0; c < NB_WORKLOAD_CONTEXTS; c++ )
+        {
+            workload[c].version = 0;
+            workload[c].durable = 0;
+        }
+        smtc_modem_hal_native_flash_load( blank );
+        lbm_nvm_init( );
+        lbm_nvm_reset_stats( );
+
+        smtc_modem_hal_native_flash_cut_power_after( cut );
+        run_workload( 0, WORKLOAD_STEPS );
+        const uint32_t stored = workload[0].version;
+
+        int errors = check_restore( cut, false );
+        max_gap    = ( stored - workload[0].version > max_gap ) ? stored - workload[0].version : max_gap;
+        lbm_nvm_stats_t stats;
+        lbm_nvm_get_stats( &stats );
+        discarded += stats.discarded_records;
+        fallback_cut = ( stats.replayed_records == 0 ) ? cut : fallback_cut;
+
+        // Resume, then reboot cleanly: everything flushed must be there
+        run_workload( WORKLOAD_STEPS, WORKLOAD_RESUMED_STEPS );
+        lbm_nvm_flush( );
+        errors += check_restore( cut, true );
+        failures += ( errors > 0 ) ? 1 : 0;
+    }
+
+    printf( "\n===== context store power loss =====\n" );
+    printf( "workload           : %u steps, %u stores, %u flash operations\n", WORKLOAD_STEPS, reference.stores,
+            operations );
+    printf( "power cuts         : %u (one in each program and erase), %u failed\n", operations, failures );
+    printf( "incomplete records : %u discarded at boot\n", discarded );
+    printf( "frame counter gap  : %u stores at most (bound %d)\n", max_gap, LBM_NVM_MAX_DEFERRED );
+    if( fallback_cut != 0 )
+    {
+        printf( "empty journal      : last seen at cut %u (power lost before the first snapshot)\n", fallback_cut );
+    }
+    return ( failures == 0 ) ? 0 : 1;
+}
+
+int main( int argc, char** argv )
+{
+    bool     power_loss = false;
+    uint32_t duration_s = 86400;
+    uint32_t period_s   = 300;
+    uint32_t seed       = 1;
+    bool     verbose    = false;
+
+    int opt;
+    while( ( opt = getopt( argc, argv, "m:d:p:s:v" ) ) != -1 )
+    {
+        switch( opt )
+        {
+        case 'm':
+            if( strcmp( optarg, "powerloss" ) == 0 )
+            {
+                power_loss = true;
+            }
+            else if( strcmp( optarg, "modem" ) != 0 )
+            {
+                print_usage( argv[0] );
+                return 1;
+            }
+            break;
+        case 'd':
+            duration_s = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'p':
+            period_s = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 's':
+            seed = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'v':
+            verbose = true;
+            break;
+        default:
+            print_usage( argv[0] );
+            return 1;
+        }
+    }
+    if( period_s == 0 )
+    {
+        print_usage( argv[0] );
+        return 1;
+    }
+
+    hal_trace_set_quiet( !verbose );
+    sim_clock_reset( );
+    smtc_modem_hal_native_set_seed( seed );
+    smtc_modem_hal_native_set_nvm_file( NULL );
+    if( power_loss == true )
+    {
+        return run_power_loss( );
+    }
+
+    sim_network_config_t network_config;
+    sim_network_get_default_config( &network_config );
+    network_config.seed = seed;
+    sim_network_configure( &network_config );
+    return run_modem( duration_s, period_s );
+}
+
+/* --- EOF ------------------------------------------------------------------ */
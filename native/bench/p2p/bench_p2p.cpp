@@ -0,0 +1,257 @@
+/*!
+ * \file      bench_p2p.cpp
+ *
+ * \brief     P2P continuous receive next to LoRaWAN: frames per second and RX to application latency
+ *
+ * A simulated peer puts a P2P frame on the air every interval, numbered so the losses can be counted, while the
+ * device joins and sends a LoRaWAN uplink every period and a P2P frame of its own every tx period. The device
+ * listens with lbm.p2p.startReceive(): the radio planner gives the radio to the LoRaWAN TX and RX windows and
+ * to the P2P transmissions, and P2P receive windows fill the gaps, so the peer frames sent meanwhile are lost.
+ * The application reads the ring every poll period (0: after every engine wakeup), which sets the latency.
+ *
+ * Usage: program [-d seconds] [-i interval_ms] [-p period_s] [-t tx_period_s] [-a poll_ms] [-s seed] [-v]
+ *   -d  simulated duration in seconds (default 600)
+ *   -i  time between two peer frames in ms (default 500)
+ *   -p  LoRaWAN uplink period in seconds, 0 for P2P alone (default 30)
+ *   -t  P2P transmission period of the device in seconds, 0 for none (default 10)
+ *   -a  application poll period in ms (default 0)
+ *   -s  seed of the modem random generator (default 1)
+ *   -v  print the modem traces
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "bench_join.h"
+#include "lbm_api.h"
+
+extern "C" {
+#include "sim_clock.h"
+#include "sim_network.h"
+#include "sim_radio.h"
+#include "smtc_hal_dbg_trace.h"
+#include "smtc_modem_hal_native.h"
+}
+
+#define UPLINK_PORT 2
+#define UPLINK_SIZE 12
+#define PEER_FRAME_SIZE 16
+#define PEER_RSSI_DBM ( -70 )
+#define PEER_SNR_DB 8
+
+// Lead time of a peer frame in the air queue of the simulated radio
+#define PEER_LEAD_US 100000u
+
+// Proprietary MHDR: the simulated network server ignores the P2P frames of the device
+#define P2P_MHDR 0xE0
+
+static void print_usage( const char* name )
+{
+    fprintf( stderr, "usage: %s [-d seconds] [-i interval_ms] [-p period_s] [-t tx_period_s] [-a poll_ms] [-s seed] [-v]\n",
+             name );
+}
+
+static uint64_t earliest( uint64_t a, uint64_t b )
+{
+    return ( a < b ) ? a : b;
+}
+
+int main( int argc, char** argv )
+{
+    uint32_t duration_s  = 600;
+    uint32_t interval_ms = 500;
+    uint32_t period_s    = 30;
+    uint32_t tx_period_s = 10;
+    uint32_t poll_ms     = 0;
+    uint32_t seed        = 1;
+    bool     verbose     = false;
+
+    int opt;
+    while( ( opt = getopt( argc, argv, "d:i:p:t:a:s:v" ) ) != -1 )
+    {
+        switch( opt )
+        {
+        case 'd':
+            duration_s = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'i':
+            interval_ms = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'p':
+            period_s = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 't':
+            tx_period_s = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'a':
+            poll_ms = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 's':
+            seed = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'v':
+            verbose = true;
+            break;
+        default:
+            print_usage( argv[0] );
+            return 1;
+        }
+    }
+    if( interval_ms == 0 )
+    {
+        print_usage( argv[0] );
+        return 1;
+    }
+
+    sim_network_config_t network_config;
+    sim_network_get_default_config( &network_config );
+    network_config.seed = seed;
+
+    hal_trace_set_quiet( !verbose );
+    sim_clock_reset( );
+    smtc_modem_hal_native_set_seed( seed );
+    sim_network_configure( &network_config );
+
+    lbm.init( );
+
+    lbm_p2p_params_t p2p_params;
+    P2PClass::getDefaultParams( &p2p_params );
+    if( lbm.p2p.begin( &p2p_params ) != SMTC_MODEM_RC_OK )
+    {
+        fprintf( stderr, "P2P could not start\n" );
+        return 1;
+    }
+    lbm.p2p.startReceive( );
+
+    if( period_s != 0 )
+    {
+        bench_join_start( lbm, NULL );
+    }
+
+    // Peer frames as the simulated radio sees them
+    sim_radio_params_t peer;
+    memset( &peer, 0, sizeof( peer ) );
+    peer.packet_type  = SIM_RADIO_PACKET_TYPE_LORA;
+    peer.freq_hz      = p2p_params.frequency_hz;
+    peer.sf           = p2p_params.sf;
+    peer.bw_hz        = ( uint32_t ) p2p_params.bw_khz * 1000u;
+    peer.cr           = p2p_params.cr;
+    peer.preamble_len = p2p_params.preamble_len;
+    peer.crc_on       = p2p_params.crc_on;
+
+    const uint64_t end_us          = ( uint64_t ) duration_s * 1000000ULL;
+    const uint64_t never_us        = UINT64_MAX;
+    uint64_t       next_peer_us    = 1000000ULL;
+    uint64_t       next_uplink_us  = never_us;
+    uint64_t       next_p2p_tx_us  = ( tx_period_s != 0 ) ? ( uint64_t ) tx_period_s * 1000000ULL : never_us;
+    uint64_t       next_poll_us    = 0;
+    uint32_t       peer_sent       = 0;
+    uint32_t       peer_received   = 0;
+    uint32_t       out_of_order    = 0;
+    uint32_t       last_sequence   = 0;
+    uint32_t       uplinks_refused = 0;
+    uint32_t       p2p_refused     = 0;
+    int32_t        rssi_sum        = 0;
+
+    while( sim_clock_now_us( ) < end_us )
+    {
+        uint64_t next_us = earliest( next_peer_us - PEER_LEAD_US, earliest( next_uplink_us, next_p2p_tx_us ) );
+        if( poll_ms != 0 )
+        {
+            next_us = earliest( next_us, next_poll_us );
+        }
+        const uint64_t now_us  = sim_clock_now_us( );
+        const uint32_t wait_ms = ( next_us > now_us ) ? ( uint32_t ) ( ( next_us - now_us + 999 ) / 1000 ) : 0;
+        lbm.runEngineUntilEvent( wait_ms );
+
+        if( sim_clock_now_us( ) + PEER_LEAD_US >= next_peer_us )
+        {
+            uint8_t frame[PEER_FRAME_SIZE];
+            memset( frame, 0xA5, sizeof( frame ) );
+            frame[0] = P2P_MHDR;
+            memcpy( &frame[1], &peer_sent, sizeof( peer_sent ) );
+            sim_radio_push_frame( frame, sizeof( frame ), &peer, next_peer_us, PEER_RSSI_DBM, PEER_SNR_DB );
+            peer_sent++;
+            next_peer_us += ( uint64_t ) interval_ms * 1000ULL;
+        }
+
+        if( ( bench_joined( ) == true ) && ( next_uplink_us == never_us ) )
+        {
+            next_uplink_us = sim_clock_now_us( ) + ( uint64_t ) period_s * 1000000ULL;
+        }
+        if( sim_clock_now_us( ) >= next_uplink_us )
+        {
+            uint8_t payload[UPLINK_SIZE];
+            memset( payload, 0x42, sizeof( payload ) );
+            if( lbm.lorawan.send( payload, sizeof( payload ), UPLINK_PORT, false ) != SMTC_MODEM_RC_OK )
+            {
+                uplinks_refused++;
+            }
+            next_uplink_us += ( uint64_t ) period_s * 1000000ULL;
+        }
+
+        if( sim_clock_now_us( ) >= next_p2p_tx_us )
+        {
+            uint8_t payload[PEER_FRAME_SIZE];
+            memset( payload, 0x5A, sizeof( payload ) );
+            payload[0] = P2P_MHDR;
+            if( lbm.p2p.send( payload, sizeof( payload ) ) != SMTC_MODEM_RC_OK )
+            {
+                p2p_refused++;
+            }
+            next_p2p_tx_us += ( uint64_t ) tx_period_s * 1000000ULL;
+        }
+
+        if( ( poll_ms != 0 ) && ( sim_clock_now_us( ) < next_poll_us ) )
+        {
+            continue;
+        }
+        next_poll_us = sim_clock_now_us( ) + ( uint64_t ) poll_ms * 1000ULL;
+
+        lbm_p2p_frame_t frame;
+        while( lbm.p2p.read( &frame ) == true )
+        {
+            uint32_t sequence;
+            memcpy( &sequence, &frame.payload[1], sizeof( sequence ) );
+            if( ( peer_received > 0 ) && ( sequence <= last_sequence ) )
+            {
+                out_of_order++;
+            }
+            last_sequence = sequence;
+            peer_received++;
+            rssi_sum += frame.rssi_dbm;
+        }
+    }
+
+    lbm_p2p_stats_t   stats;
+    sim_radio_stats_t radio;
+    lbm_stack_stats_t lorawan;
+    lbm.p2p.getStats( &stats );
+    sim_radio_get_stats( &radio );
+    lbm.lorawan.getStackStats( &lorawan );
+
+    printf( "\n===== P2P continuous receive next to LoRaWAN =====\n" );
+    printf( "virtual time       : %.0f s, a peer frame every %u ms, LoRaWAN uplink every %u s, P2P TX every %u s\n",
+            ( double ) sim_clock_now_us( ) / 1e6, interval_ms, period_s, tx_period_s );
+    printf( "peer frames        : %u sent, %u read by the application (%.1f %%), %u out of order, mean RSSI %d dBm\n",
+            peer_sent, peer_received, ( peer_sent > 0 ) ? 100.0 * peer_received / peer_sent : 0.0, out_of_order,
+            ( peer_received > 0 ) ? ( int ) ( rssi_sum / ( int32_t ) peer_received ) : 0 );
+    printf( "receive            : %.2f frames/s, %u windows, %u aborted by LoRaWAN, %u CRC errors, %u ring overflows\n",
+            stats.rx_packets_per_s, stats.rx_windows, stats.rx_windows_aborted, stats.rx_crc_errors,
+            stats.rx_overflows );
+    printf( "ring               : depth %u, high watermark %u of %u\n", stats.rx_depth, stats.rx_high_watermark,
+            LBM_P2P_RX_RING_SIZE );
+    printf( "RX to application  : min %u ms, avg %u ms, max %u ms (poll every %u ms)\n", stats.latency_min_ms,
+            stats.latency_avg_ms, stats.latency_max_ms, poll_ms );
+    printf( "transmit           : %u queued, %u refused, %u sent (%.3f frames/s), %u aborted by the planner\n",
+            stats.tx_queued, p2p_refused, stats.tx_done, stats.tx_packets_per_s, stats.tx_aborted );
+    printf( "LoRaWAN            : %u joined, %u uplinks sent, %u not sent, %u refused, %u planner aborts\n",
+            lorawan.joined, lorawan.tx_done, lorawan.tx_not_sent, uplinks_refused, lorawan.planner_aborts );
+    printf( "radio              : %u frames missed while the radio was busy or asleep\n", radio.missed_count );
+    return 0;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
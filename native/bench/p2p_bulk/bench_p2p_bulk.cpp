@@ -0,0 +1,449 @@
+/*!
+ * \file      bench_p2p_bulk.cpp
+ *
+ * \brief     P2P bulk transfer looped back through the simulated radio: sustained throughput, retransmissions
+ *
+ * The device sends size bytes to a simulated peer with lbm.p2p.sendBulk(), then receives as many from it with
+ * lbm.p2p.receiveBulk(). The peer runs the other end of the protocol with the lbm_p2p_bulk_tx / rx functions
+ * the device uses: it sees the device frames through the transmit monitor of the simulated radio, and puts
+ * its own frames on the air LBM_P2P_BULK_TURNAROUND_MS after the last one, as the device does. A share of the
+ * frames is lost in each direction. Both ends check every byte they get against the pattern the other one
+ * sends; the program exits with 1 when a byte differs or a transfer ends without every byte delivered.
+ *
+ * Usage: program [-n bytes] [-l loss_percent] [-w window] [-b bitrate_bps] [-p period_s] [-s seed] [-v]
+ *   -n  bytes in each direction (default 32768)
+ *   -l  frames lost in each direction in percent (default 5)
+ *   -w  frames sent before an ACK (default 8)
+ *   -b  GFSK bitrate in bit/s (default 100000)
+ *   -p  LoRaWAN uplink period in seconds during the transfers, 0 for none (default 0)
+ *   -s  seed of the modem random generator and of the losses (default 1)
+ *   -v  print the modem traces
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "bench_join.h"
+#include "lbm_api.h"
+
+extern "C" {
+#include "sim_clock.h"
+#include "sim_network.h"
+#include "sim_radio.h"
+#include "smtc_hal_dbg_trace.h"
+#include "smtc_modem_hal_native.h"
+}
+
+#define UPLINK_PORT 2
+#define UPLINK_SIZE 12
+#define PEER_RSSI_DBM ( -60 )
+#define PEER_SNR_DB 10
+
+// Largest read of the device source: chunks are assembled from several reads
+#define SOURCE_READ_MAX 100
+
+// Lead time of a peer frame in the air queue of the simulated radio
+#define PEER_LEAD_US 5000u
+#define TURNAROUND_US ( ( uint64_t ) LBM_P2P_BULK_TURNAROUND_MS * 1000u )
+
+// Longest virtual time of one transfer before it is declared stuck
+#define TRANSFER_LIMIT_US 600000000ULL
+
+typedef enum peer_role_e
+{
+    PEER_RECEIVES,
+    PEER_SENDS,
+} peer_role_t;
+
+typedef struct peer_frame_s
+{
+    uint8_t  data[LBM_P2P_BULK_MAX_FRAME];
+    uint8_t  size;
+    uint64_t arrival_us;
+    bool     lost;
+} peer_frame_t;
+
+typedef struct pattern_s
+{
+    uint32_t size;      // bytes to send
+    uint32_t position;  // next byte sent, or expected
+    uint32_t wrong;     // bytes received that differ from the pattern, or out of place
+} pattern_t;
+
+static uint32_t              loss_percent;
+static uint32_t              loss_state;
+static lbm_p2p_bulk_params_t bulk_params;
+static sim_radio_params_t    peer_air;
+
+static peer_role_t       peer_role;
+static lbm_p2p_bulk_tx_t peer_tx;
+static lbm_p2p_bulk_rx_t peer_rx;
+static peer_frame_t      burst[LBM_P2P_BULK_MAX_WINDOW];  // peer frames not on the air yet
+static uint8_t           burst_count;
+static uint8_t           burst_pushed;
+static uint64_t          peer_ready_us;         // earliest start of the next peer frame
+static uint64_t          peer_ack_deadline_us;  // the peer sender waits for an ACK until then
+static uint32_t          frames_lost[2];        // to the peer, to the device
+
+static void print_usage( const char* name )
+{
+    fprintf( stderr, "usage: %s [-n bytes] [-l loss_percent] [-w window] [-b bitrate_bps] [-p period_s] [-s seed] [-v]\n",
+             name );
+}
+
+static uint64_t earliest( uint64_t a, uint64_t b )
+{
+    return ( a < b ) ? a : b;
+}
+
+static bool draw_loss( void )
+{
+    // xorshift32, independent of the modem random generator
+    loss_state ^= loss_state << 13;
+    loss_state ^= loss_state >> 17;
+    loss_state ^= loss_state << 5;
+    return ( loss_state % 100u ) < loss_percent;
+}
+
+static uint8_t pattern_byte( uint32_t offset )
+{
+    return ( uint8_t ) ( offset * 31u + ( offset >> 8 ) + 7u );
+}
+
+static int32_t pattern_source( uint8_t* buffer, uint16_t size, void* context )
+{
+    pattern_t* pattern = ( pattern_t* ) context;
+    uint32_t   count   = pattern->size - pattern->position;
+    count              = ( count < size ) ? count : size;
+    count              = ( count < SOURCE_READ_MAX ) ? count : SOURCE_READ_MAX;
+    for( uint32_t i = 0; i < count; i++ )
+    {
+        buffer[i] = pattern_byte( pattern->position + i );
+    }
+    pattern->position += count;
+    return ( int32_t ) count;
+}
+
+static bool pattern_sink( uint32_t offset, const uint8_t* data, uint16_t size, void* context )
+{
+    pattern_t* pattern = ( pattern_t* ) context;
+    if( offset != pattern->position )
+    {
+        pattern->wrong += size;
+    }
+    for( uint16_t i = 0; i < size; i++ )
+    {
+        if( data[i] != pattern_byte( offset + i ) )
+        {
+            pattern->wrong++;
+        }
+    }
+    pattern->position = offset + size;
+    return true;
+}
+
+static void queue_peer_frame( const uint8_t* data, uint8_t size, uint64_t arrival_us )
+{
+    if( burst_count >= LBM_P2P_BULK_MAX_WINDOW )
+    {
+        return;
+    }
+    peer_frame_t* frame = &burst[burst_count++];
+    memcpy( frame->data, data, size );
+    frame->size       = size;
+    frame->arrival_us = arrival_us;
+    frame->lost       = draw_loss( );
+    peer_ready_us     = arrival_us + sim_radio_get_time_on_air_us( &peer_air, size ) + TURNAROUND_US;
+}
+
+static void push_peer_frames( void )
+{
+    while( ( burst_pushed < burst_count ) && ( sim_clock_now_us( ) + PEER_LEAD_US >= burst[burst_pushed].arrival_us ) )
+    {
+        const peer_frame_t* frame = &burst[burst_pushed++];
+        if( frame->lost == true )
+        {
+            frames_lost[1]++;
+            continue;
+        }
+        sim_radio_push_frame( frame->data, frame->size, &peer_air, frame->arrival_us, PEER_RSSI_DBM, PEER_SNR_DB );
+    }
+    if( burst_pushed == burst_count )
+    {
+        burst_count  = 0;
+        burst_pushed = 0;
+    }
+}
+
+static void on_device_tx( const uint8_t* payload, uint8_t size, const sim_radio_params_t* params, uint64_t tx_end_us )
+{
+    if( ( params->packet_type != SIM_RADIO_PACKET_TYPE_GFSK ) || ( params->freq_hz != bulk_params.frequency_hz ) )
+    {
+        return;
+    }
+    if( draw_loss( ) == true )
+    {
+        frames_lost[0]++;
+        return;
+    }
+
+    peer_ready_us = tx_end_us + TURNAROUND_US;
+    if( peer_role == PEER_RECEIVES )
+    {
+        uint8_t ack[LBM_P2P_BULK_ACK_SIZE];
+        if( lbm_p2p_bulk_rx_on_frame( &peer_rx, payload, size, ack ) > 0 )
+        {
+            queue_peer_frame( ack, sizeof( ack ), peer_ready_us );
+        }
+    }
+    else if( peer_tx.waiting_ack == true )
+    {
+        lbm_p2p_bulk_tx_on_ack( &peer_tx, payload, size );
+    }
+}
+
+static void run_peer_sender( void )
+{
+    const uint64_t now_us = sim_clock_now_us( );
+    if( ( burst_count > 0 ) || ( peer_tx.done == true ) || ( peer_tx.failed == true ) )
+    {
+        return;
+    }
+    if( ( peer_tx.waiting_ack == true ) && ( now_us >= peer_ack_deadline_us ) )
+    {
+        lbm_p2p_bulk_tx_on_timeout( &peer_tx );
+        peer_ready_us = now_us;
+    }
+    if( ( peer_tx.waiting_ack == true ) || ( now_us + PEER_LEAD_US < peer_ready_us ) )
+    {
+        return;
+    }
+
+    // Next burst, back to back with the turnaround between frames
+    uint8_t  frame[LBM_P2P_BULK_MAX_FRAME];
+    uint8_t  size;
+    uint64_t arrival_us = ( peer_ready_us > now_us ) ? peer_ready_us : now_us;
+    while( ( burst_count < LBM_P2P_BULK_MAX_WINDOW ) && ( ( size = lbm_p2p_bulk_tx_next_frame( &peer_tx, frame ) ) > 0 ) )
+    {
+        queue_peer_frame( frame, size, arrival_us );
+        arrival_us = peer_ready_us;
+    }
+    peer_ack_deadline_us = peer_ready_us - TURNAROUND_US + ( uint64_t ) bulk_params.ack_timeout_ms * 1000u;
+}
+
+static bool run_transfer( lbm_p2p_bulk_status_t running, uint32_t period_s, uint32_t* uplinks_refused )
+{
+    static uint64_t next_uplink_us = UINT64_MAX;
+    const uint64_t  limit_us       = sim_clock_now_us( ) + TRANSFER_LIMIT_US;
+
+    while( lbm.p2p.getBulkStatus( ) == running )
+    {
+        if( sim_clock_now_us( ) >= limit_us )
+        {
+            lbm.p2p.abortBulk( );
+            lbm.runEngineUntilEvent( 1000 );
+            return false;
+        }
+
+        uint64_t next_us = next_uplink_us;
+        if( burst_count > 0 )
+        {
+            next_us = earliest( next_us, burst[burst_pushed].arrival_us - PEER_LEAD_US );
+        }
+        else if( ( peer_role == PEER_SENDS ) && ( peer_tx.done == false ) && ( peer_tx.failed == false ) )
+        {
+            next_us = earliest( next_us, peer_tx.waiting_ack ? peer_ack_deadline_us : peer_ready_us - PEER_LEAD_US );
+        }
+        const uint64_t now_us  = sim_clock_now_us( );
+        uint32_t       wait_ms = ( next_us > now_us ) ? ( uint32_t ) ( ( next_us - now_us + 999 ) / 1000 ) : 0;
+        wait_ms                = ( wait_ms < 1000 ) ? wait_ms : 1000;
+        lbm.runEngineUntilEvent( wait_ms );
+
+        if( peer_role == PEER_SENDS )
+        {
+            run_peer_sender( );
+        }
+        push_peer_frames( );
+
+        if( ( period_s != 0 ) && ( bench_joined( ) == true ) && ( next_uplink_us == UINT64_MAX ) )
+        {
+            next_uplink_us = sim_clock_now_us( ) + ( uint64_t ) period_s * 1000000ULL;
+        }
+        if( sim_clock_now_us( ) >= next_uplink_us )
+        {
+            uint8_t payload[UPLINK_SIZE];
+            memset( payload, 0x42, sizeof( payload ) );
+            if( lbm.lorawan.send( payload, sizeof( payload ), UPLINK_PORT, false ) != SMTC_MODEM_RC_OK )
+            {
+                ( *uplinks_refused )++;
+            }
+            next_uplink_us += ( uint64_t ) period_s * 1000000ULL;
+        }
+    }
+    return true;
+}
+
+static void print_stats( const char* label, const lbm_p2p_bulk_stats_t* stats, lbm_p2p_bulk_status_t status )
+{
+    const char* names[] = { "idle", "sending", "receiving", "done", "failed", "aborted" };
+    printf( "%-19s: %s after %u ms, %u bytes, %.1f kbit/s sustained (%.0f %% of the bitrate)\n", label,
+            names[status], stats->elapsed_ms, stats->bytes, stats->throughput_bps / 1000.0f,
+            100.0f * stats->throughput_bps / ( float ) bulk_params.bitrate_bps );
+    printf( "                     %u frames sent, %u retransmitted (%.1f %%), %u received, %u duplicates, "
+            "%u ACK timeouts, %u planner aborts\n",
+            stats->frames_sent, stats->frames_retransmitted, stats->retransmission_percent, stats->frames_received,
+            stats->duplicates, stats->ack_timeouts, stats->planner_aborts );
+}
+
+int main( int argc, char** argv )
+{
+    uint32_t size     = 32768;
+    uint32_t window   = 8;
+    uint32_t bitrate  = 100000;
+    uint32_t period_s = 0;
+    uint32_t seed     = 1;
+    bool     verbose  = false;
+
+    loss_percent = 5;
+
+    int opt;
+    while( ( opt = getopt( argc, argv, "n:l:w:b:p:s:v" ) ) != -1 )
+    {
+        switch( opt )
+        {
+        case 'n':
+            size = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'l':
+            loss_percent = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'w':
+            window = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'b':
+            bitrate = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'p':
+            period_s = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 's':
+            seed = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'v':
+            verbose = true;
+            break;
+        default:
+            print_usage( argv[0] );
+            return 1;
+        }
+    }
+    if( ( loss_percent >= 100 ) || ( window == 0 ) || ( window > LBM_P2P_BULK_MAX_WINDOW ) )
+    {
+        print_usage( argv[0] );
+        return 1;
+    }
+    loss_state = seed * 2654435761u + 1u;
+
+    sim_network_config_t network_config;
+    sim_network_get_default_config( &network_config );
+    network_config.seed = seed;
+
+    hal_trace_set_quiet( !verbose );
+    sim_clock_reset( );
+    smtc_modem_hal_native_set_seed( seed );
+    sim_network_configure( &network_config );
+    sim_radio_set_tx_monitor( on_device_tx );
+
+    lbm.init( );
+    if( lbm.p2p.begin( ) != SMTC_MODEM_RC_OK )
+    {
+        fprintf( stderr, "P2P could not start\n" );
+        return 1;
+    }
+    if( period_s != 0 )
+    {
+        bench_join_start( lbm, NULL );
+    }
+
+    P2PClass::getDefaultBulkParams( &bulk_params );
+    bulk_params.window      = ( uint8_t ) window;
+    bulk_params.bitrate_bps = bitrate;
+
+    // Peer frames as the simulated radio sees them
+    memset( &peer_air, 0, sizeof( peer_air ) );
+    peer_air.packet_type  = SIM_RADIO_PACKET_TYPE_GFSK;
+    peer_air.freq_hz      = bulk_params.frequency_hz;
+    peer_air.bitrate_bps  = bulk_params.bitrate_bps;
+    peer_air.preamble_len = 40;
+    peer_air.crc_on       = true;
+
+    uint32_t uplinks_refused = 0;
+
+    // Device to peer
+    pattern_t device_source = { size, 0, 0 };
+    pattern_t peer_sink     = { size, 0, 0 };
+    peer_role               = PEER_RECEIVES;
+    lbm_p2p_bulk_rx_init( &peer_rx, &bulk_params, pattern_sink, &peer_sink );
+    if( lbm.p2p.sendBulk( pattern_source, &device_source, &bulk_params ) != SMTC_MODEM_RC_OK )
+    {
+        fprintf( stderr, "bulk send refused\n" );
+        return 1;
+    }
+    const bool                  sent_in_time = run_transfer( LBM_P2P_BULK_SENDING, period_s, &uplinks_refused );
+    const lbm_p2p_bulk_status_t send_status  = lbm.p2p.getBulkStatus( );
+    lbm_p2p_bulk_stats_t        send_stats;
+    lbm.p2p.getBulkStats( &send_stats );
+
+    // Peer to device, the peer starts once the device listens
+    pattern_t peer_source = { size, 0, 0 };
+    pattern_t device_sink = { size, 0, 0 };
+    peer_role             = PEER_SENDS;
+    lbm_p2p_bulk_tx_init( &peer_tx, &bulk_params, 0x5A, pattern_source, &peer_source );
+    if( lbm.p2p.receiveBulk( pattern_sink, &device_sink, 5000, &bulk_params ) != SMTC_MODEM_RC_OK )
+    {
+        fprintf( stderr, "bulk receive refused\n" );
+        return 1;
+    }
+    peer_ready_us                                = sim_clock_now_us( ) + 50000u;
+    const bool                  received_in_time = run_transfer( LBM_P2P_BULK_RECEIVING, period_s, &uplinks_refused );
+    const lbm_p2p_bulk_status_t receive_status   = lbm.p2p.getBulkStatus( );
+    lbm_p2p_bulk_stats_t        receive_stats;
+    lbm.p2p.getBulkStats( &receive_stats );
+
+    const bool sent_ok = sent_in_time && ( send_status == LBM_P2P_BULK_DONE ) && ( peer_rx.complete == true ) &&
+                         ( peer_sink.position == size ) && ( peer_sink.wrong == 0 );
+    const bool received_ok = received_in_time && ( receive_status == LBM_P2P_BULK_DONE ) && ( peer_tx.done == true ) &&
+                             ( device_sink.position == size ) && ( device_sink.wrong == 0 );
+
+    sim_radio_stats_t radio;
+    lbm_stack_stats_t lorawan;
+    sim_radio_get_stats( &radio );
+    lbm.lorawan.getStackStats( &lorawan );
+
+    printf( "\n===== P2P bulk transfer through the simulated radio =====\n" );
+    printf( "settings           : %u bytes each way, GFSK %u bit/s, %u-byte frames, window %u, %u %% of the frames "
+            "lost each way\n",
+            size, bulk_params.bitrate_bps, bulk_params.chunk_size, bulk_params.window, loss_percent );
+    print_stats( "device to peer", &send_stats, send_status );
+    printf( "                     peer: %u bytes delivered, %u wrong, %u duplicates, %u ACKs sent\n",
+            peer_sink.position, peer_sink.wrong, peer_rx.duplicates, peer_rx.acks_sent );
+    print_stats( "peer to device", &receive_stats, receive_status );
+    printf( "                     peer: %u frames sent, %u retransmitted, %u ACK timeouts; device: %u bytes "
+            "delivered, %u wrong\n",
+            peer_tx.frames_sent, peer_tx.frames_retransmitted, peer_tx.ack_timeouts, device_sink.position,
+            device_sink.wrong );
+    printf( "losses             : %u frames to the peer, %u to the device\n", frames_lost[0], frames_lost[1] );
+    if( period_s != 0 )
+    {
+        printf( "LoRaWAN            : %u joined, %u uplinks sent, %u not sent, %u refused, %u planner aborts\n",
+                lorawan.joined, lorawan.tx_done, lorawan.tx_not_sent, uplinks_refused, lorawan.planner_aborts );
+    }
+    printf( "radio              : %u frames missed while the radio was busy or asleep\n", radio.missed_count );
+    printf( "result             : %s\n", ( sent_ok && received_ok ) ? "PASS" : "FAIL" );
+    return ( sent_ok && received_ok ) ? 0 : 1;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,829 @@
+/*!
+ * \file      bench_radio_planner.cpp
+ *
+ * \brief     Radio planner stress: decision time, requested to actual start delay, aborts and preemptions
+ *
+ * The bench runs the radio planner of the modem library (radio_planner.c) on its own instance, on top of the
+ * virtual SX126x, and feeds it a contended task mix. Each source has its own hook, and the hook id is the priority
+ * (the lower, the higher):
+ *
+ * - uplink:     LoRaWAN uplinks, TX as soon as possible, then RX1 and RX2 scheduled 1 s and 2 s after TX done;
+ * - relay:      relay wake-on-radio listening, a short RX window every second (CAD stands in as an RX window);
+ * - ping_slot:  class B ping slots, a scheduled RX window every 2^p s at a random slot;
+ * - alc_sync:   ALC Sync AppTimeReq uplinks, a TX scheduled at a random time;
+ * - background: a low-priority RX window queued again as soon as the previous one ends (-b), like P2P receive.
+ *
+ * Every task the planner launches is timed from its requested start (the enqueue for the tasks started as soon as
+ * possible) to its launch callback, in virtual time. A task the planner ends without launching it was dropped by
+ * arbitration; a task aborted after its launch was preempted. The host time spent in rp_task_enqueue() and in
+ * rp_callback() is the decision time of the planner (hook callbacks and the enqueues they make are not counted in
+ * rp_callback()). Host times depend on the PC: only their relative changes are meaningful.
+ *
+ * -w writes every enqueue of the run to a CSV file that -r replays, as is: the recorded mix, or one captured on
+ * the target, is then given to another version of the planner. -j writes the results as JSON for regression
+ * tracking. The bench fails if the planner calls a hook back for a task it did not have, twice for one task,
+ * never for a task, or launches a task after ending it.
+ *
+ * Usage: program [-d seconds] [-x load] [-p periodicity] [-b] [-r trace.csv] [-w trace.csv] [-j results.json]
+ *                [-l max_delay_ms] [-s seed] [-v]
+ *   -d  simulated duration in seconds (default 3600)
+ *   -x  load factor: uplinks and ALC Sync uplinks come x times more often (default 1)
+ *   -p  class B ping-slot periodicity, a slot every 2^p s (default 2)
+ *   -b  add the low-priority background receive
+ *   -r  replay the enqueues of a trace instead of generating the mix
+ *   -w  record the enqueues of the run
+ *   -j  write the results as JSON ("-" for the standard output)
+ *   -l  fail if a launched uplink starts more than max_delay_ms late (default 0: no limit)
+ *   -s  seed of the task mix (default 1)
+ *   -v  print every task
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+extern "C" {
+#include "radio_planner.h"
+#include "radio_planner_stats.h"
+#include "ralf_sx126x.h"
+#include "sim_clock.h"
+#include "sim_radio.h"
+#include "smtc_hal_dbg_trace.h"
+#include "smtc_hal_mcu.h"
+#include "smtc_modem_hal.h"
+}
+
+#define MAX_DECISIONS ( 1u << 20 )
+#define MAX_DELAYS ( 1u << 16 )
+#define PAYLOAD_SIZE 255
+
+// Proprietary MHDR: the simulated network server ignores the frames of the bench
+#define BENCH_MHDR 0xE0
+
+#define RX1_DELAY_MS 1000u
+#define RX2_DELAY_MS 2000u
+#define PING_SLOT_MS 30u
+
+typedef enum source_id_e
+{
+    SOURCE_UPLINK,
+    SOURCE_RX1,
+    SOURCE_RX2,
+    SOURCE_RELAY,
+    SOURCE_PING_SLOT,
+    SOURCE_ALC_SYNC,
+    SOURCE_BACKGROUND,
+    SOURCE_COUNT
+} source_id_t;
+
+typedef struct source_s
+{
+    const char* name;
+    uint8_t     hook;
+    bool        tx;
+    bool        low_priority;
+    uint8_t     sf;
+    uint8_t     size;         // TX payload
+    uint32_t    window_ms;    // RX window
+    uint32_t    interval_ms;  // mean time between two tasks, 0: started by another source only
+    uint32_t    lead_ms;      // scheduled tasks are enqueued this long before their start, 0: ASAP
+
+    // Counters
+    uint32_t enqueued;
+    uint32_t refused;       // rp_task_enqueue() failed
+    uint32_t hook_busy;     // due while the previous task of the hook was still there
+    uint32_t launched;
+    uint32_t done;          // TX done, RX timeout or RX packet
+    uint32_t dropped;       // aborted before their launch
+    uint32_t preempted;     // aborted after their launch
+    uint32_t aborted_in_row;
+    uint32_t max_aborted_in_row;
+    uint32_t delay_count;
+    int32_t  delays_us[MAX_DELAYS];
+} source_t;
+
+typedef struct hook_state_s
+{
+    int      source;  // -1: idle
+    bool     launched;
+    uint64_t requested_us;
+    uint32_t tx_done_ms;
+} hook_state_t;
+
+typedef struct decisions_s
+{
+    uint32_t count;
+    uint32_t ns[MAX_DECISIONS];
+} decisions_t;
+
+// Settings of a source, its counters at zero
+#define SOURCE( name, hook, tx, low_priority, sf, size, window_ms, interval_ms, lead_ms )                              \
+    {                                                                                                                  \
+        name, hook, tx, low_priority, sf, size, window_ms, interval_ms, lead_ms, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, { 0 }  \
+    }
+
+static source_t sources[SOURCE_COUNT] = {
+    SOURCE( "uplink", 0, true, false, 9, 24, 0, 30000, 0 ),
+    SOURCE( "rx1", 0, false, false, 9, 0, 20, 0, 0 ),
+    SOURCE( "rx2", 0, false, false, 12, 0, 40, 0, 0 ),
+    SOURCE( "relay", 1, false, false, 9, 0, 6, 1000, 50 ),
+    SOURCE( "ping_slot", 2, false, false, 9, 0, PING_SLOT_MS, 4000, 100 ),
+    SOURCE( "alc_sync", 3, true, false, 9, 8, 0, 60000, 500 ),
+    SOURCE( "background", 4, false, true, 7, 0, 500, 0, 0 ),
+};
+
+static radio_planner_t planner;
+static const ralf_t    bench_radio = RALF_SX126X_INSTANTIATE( NULL );
+static hook_state_t    hooks[RP_NB_HOOKS];
+static uint8_t         payloads[RP_NB_HOOKS][PAYLOAD_SIZE];
+static decisions_t     enqueue_ns;
+static decisions_t     callback_ns;
+static uint64_t        nested_ns   = 0;  // enqueues made by the hook callbacks during rp_callback()
+static bool            in_callback = false;
+static bool            verbose     = false;
+static bool            background  = false;
+
+// Planner misbehaviour
+static uint32_t unexpected_callbacks = 0;
+static uint32_t unexpected_launches  = 0;
+
+static FILE* record_file = NULL;
+static FILE* replay_file = NULL;
+
+static void print_usage( const char* name )
+{
+    fprintf( stderr,
+             "usage: %s [-d seconds] [-x load] [-p periodicity] [-b] [-r trace.csv] [-w trace.csv] [-j results.json] "
+             "[-l max_delay_ms] [-s seed] [-v]\n",
+             name );
+}
+
+static uint64_t host_ns( void )
+{
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return ( uint64_t ) now.tv_sec * 1000000000ULL + ( uint64_t ) now.tv_nsec;
+}
+
+static void add_decision( decisions_t* decisions, uint64_t ns )
+{
+    if( decisions->count < MAX_DECISIONS )
+    {
+        decisions->ns[decisions->count++] = ( ns > UINT32_MAX ) ? UINT32_MAX : ( uint32_t ) ns;
+    }
+}
+
+static uint32_t random_below( uint32_t bound )
+{
+    return ( bound > 0 ) ? ( uint32_t ) ( ( ( uint64_t ) rand( ) * bound ) / ( ( uint64_t ) RAND_MAX + 1 ) ) : 0;
+}
+
+// Exponential inter-arrival time of mean interval_ms
+static uint32_t random_interval_ms( uint32_t interval_ms )
+{
+    const double u = ( ( double ) rand( ) + 1.0 ) / ( ( double ) RAND_MAX + 2.0 );
+    return ( uint32_t ) ( -log( u ) * interval_ms ) + 1;
+}
+
+static void lora_params( const source_t* source, ralf_params_lora_t* lora )
+{
+    memset( lora, 0, sizeof( *lora ) );
+    lora->rf_freq_in_hz                   = 868100000;
+    lora->output_pwr_in_dbm               = 14;
+    lora->sync_word                       = 0x34;
+    lora->mod_params.sf                   = ( ral_lora_sf_t ) source->sf;
+    lora->mod_params.bw                   = RAL_LORA_BW_125_KHZ;
+    lora->mod_params.cr                   = RAL_LORA_CR_4_5;
+    lora->mod_params.ldro                 = ral_compute_lora_ldro( lora->mod_params.sf, lora->mod_params.bw );
+    lora->pkt_params.preamble_len_in_symb = 8;
+    lora->pkt_params.header_type          = RAL_LORA_PKT_EXPLICIT;
+    lora->pkt_params.pld_len_in_bytes     = source->tx ? source->size : PAYLOAD_SIZE;
+    lora->pkt_params.crc_is_on            = source->tx;
+    lora->pkt_params.invert_iq_is_on      = !source->tx;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PLANNER CALLBACKS -------------------------------------------------------
+ */
+
+static void launch( void* context )
+{
+    hook_state_t*    hook   = ( hook_state_t* ) context;
+    const uint8_t    id     = ( uint8_t ) ( hook - hooks );
+    const uint64_t   now_us = sim_clock_now_us( );
+    ralf_params_lora_t lora;
+
+    if( ( hook->source < 0 ) || ( hook->launched == true ) )
+    {
+        unexpected_launches++;
+        return;
+    }
+    source_t* source = &sources[hook->source];
+    hook->launched   = true;
+    source->launched++;
+    if( source->delay_count < MAX_DELAYS )
+    {
+        source->delays_us[source->delay_count++] = ( int32_t ) ( ( int64_t ) now_us - ( int64_t ) hook->requested_us );
+    }
+
+    lora_params( source, &lora );
+    smtc_modem_hal_start_radio_tcxo( );
+    smtc_modem_hal_set_ant_switch( source->tx );
+    if( source->tx )
+    {
+        if( ( ralf_setup_lora( &bench_radio, &lora ) != RAL_STATUS_OK ) ||
+            ( ral_set_dio_irq_params( &bench_radio.ral, RAL_IRQ_TX_DONE ) != RAL_STATUS_OK ) ||
+            ( ral_set_pkt_payload( &bench_radio.ral, payloads[id], source->size ) != RAL_STATUS_OK ) ||
+            ( ral_set_tx( &bench_radio.ral ) != RAL_STATUS_OK ) )
+        {
+            SMTC_MODEM_HAL_PANIC( );
+        }
+        rp_stats_set_tx_timestamp( &planner.stats, smtc_modem_hal_get_time_in_ms( ) );
+    }
+    else
+    {
+        if( ( ralf_setup_lora( &bench_radio, &lora ) != RAL_STATUS_OK ) ||
+            ( ral_set_dio_irq_params( &bench_radio.ral, RAL_IRQ_RX_DONE | RAL_IRQ_RX_TIMEOUT | RAL_IRQ_RX_HDR_ERROR |
+                                                            RAL_IRQ_RX_CRC_ERROR ) != RAL_STATUS_OK ) ||
+            ( ral_set_rx( &bench_radio.ral, source->window_ms ) != RAL_STATUS_OK ) )
+        {
+            SMTC_MODEM_HAL_PANIC( );
+        }
+        rp_stats_set_rx_timestamp( &planner.stats, smtc_modem_hal_get_time_in_ms( ) );
+    }
+}
+
+static bool enqueue( source_id_t id, uint32_t start_ms, bool asap );
+
+static void on_hook( void* context )
+{
+    hook_state_t* hook = ( hook_state_t* ) context;
+    const uint8_t id   = ( uint8_t ) ( hook - hooks );
+    uint32_t      irq_ms;
+    rp_status_t   status;
+
+    if( hook->source < 0 )
+    {
+        unexpected_callbacks++;
+        return;
+    }
+    rp_get_status( &planner, id, &irq_ms, &status );
+
+    const source_id_t s      = ( source_id_t ) hook->source;
+    source_t*         source = &sources[s];
+    const bool        was_launched = hook->launched;
+    hook->source             = -1;
+    hook->launched           = false;
+
+    if( status == RP_STATUS_TASK_ABORTED )
+    {
+        if( was_launched )
+        {
+            source->preempted++;
+        }
+        else
+        {
+            source->dropped++;
+        }
+        source->aborted_in_row++;
+        if( source->aborted_in_row > source->max_aborted_in_row )
+        {
+            source->max_aborted_in_row = source->aborted_in_row;
+        }
+    }
+    else
+    {
+        source->done++;
+        source->aborted_in_row = 0;
+        if( was_launched == false )
+        {
+            unexpected_callbacks++;  // ended without a launch
+        }
+    }
+    if( verbose )
+    {
+        printf( "%10.3f s  %-10s  status %d%s\n", ( double ) sim_clock_now_us( ) / 1e6, source->name, ( int ) status,
+                was_launched ? "" : " (not launched)" );
+    }
+
+    // The follow-ups of the generated mix: RX1 / RX2 after an uplink, background receive again
+    if( replay_file != NULL )
+    {
+        return;
+    }
+    if( ( s == SOURCE_UPLINK ) && ( status == RP_STATUS_TX_DONE ) )
+    {
+        hook->tx_done_ms = irq_ms;
+        enqueue( SOURCE_RX1, irq_ms + RX1_DELAY_MS, false );
+    }
+    else if( ( s == SOURCE_RX1 ) && ( status != RP_STATUS_RX_PACKET ) )
+    {
+        enqueue( SOURCE_RX2, hook->tx_done_ms + RX2_DELAY_MS, false );
+    }
+    else if( ( s == SOURCE_BACKGROUND ) && ( background == true ) )
+    {
+        enqueue( SOURCE_BACKGROUND, smtc_modem_hal_get_time_in_ms( ), true );
+    }
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- TASK MIX ----------------------------------------------------------------
+ */
+
+static bool enqueue( source_id_t id, uint32_t start_ms, bool asap )
+{
+    source_t*     source = &sources[id];
+    hook_state_t* hook   = &hooks[source->hook];
+    const uint32_t now_ms = smtc_modem_hal_get_time_in_ms( );
+
+    if( record_file != NULL )
+    {
+        if( asap )
+        {
+            fprintf( record_file, "%llu,%s,asap\n", ( unsigned long long ) sim_clock_now_us( ), source->name );
+        }
+        else
+        {
+            fprintf( record_file, "%llu,%s,%u\n", ( unsigned long long ) sim_clock_now_us( ), source->name, start_ms );
+        }
+    }
+    if( hook->source >= 0 )
+    {
+        source->hook_busy++;
+        return false;
+    }
+
+    ralf_params_lora_t lora;
+    lora_params( source, &lora );
+    rp_radio_params_t radio_params;
+    memset( &radio_params, 0, sizeof( radio_params ) );
+    radio_params.pkt_type = RAL_PKT_TYPE_LORA;
+    if( source->tx )
+    {
+        radio_params.tx.lora = lora;
+    }
+    else
+    {
+        radio_params.rx.lora          = lora;
+        radio_params.rx.timeout_in_ms = source->window_ms;
+    }
+
+    rp_task_t task;
+    memset( &task, 0, sizeof( task ) );
+    task.hook_id                    = source->hook;
+    task.type                       = source->tx ? RP_TASK_TYPE_TX_LORA : RP_TASK_TYPE_RX_LORA;
+    task.state                      = asap ? RP_TASK_STATE_ASAP : RP_TASK_STATE_SCHEDULE;
+    task.start_time_ms              = asap ? now_ms : start_ms;
+    task.duration_time_ms           = source->tx ? ral_get_lora_time_on_air_in_ms( &bench_radio.ral, &lora.pkt_params,
+                                                                                   &lora.mod_params )
+                                                 : source->window_ms;
+    task.schedule_task_low_priority = source->low_priority;
+    task.launch_task_callbacks      = launch;
+
+    uint8_t* payload = payloads[source->hook];
+    memset( payload, 0, PAYLOAD_SIZE );
+    payload[0] = BENCH_MHDR;
+    payload[1] = ( uint8_t ) id;
+
+    // Claimed before the call: the planner may launch or abort the task from inside it
+    hook->source       = id;
+    hook->launched     = false;
+    hook->requested_us = asap ? sim_clock_now_us( ) : ( uint64_t ) start_ms * 1000u;
+
+    const uint64_t         t0     = host_ns( );
+    const rp_hook_status_t status = rp_task_enqueue( &planner, &task, payload, PAYLOAD_SIZE, &radio_params );
+    const uint64_t         ns     = host_ns( ) - t0;
+    add_decision( &enqueue_ns, ns );
+    if( in_callback )
+    {
+        nested_ns += ns;
+    }
+    if( status != RP_HOOK_STATUS_OK )
+    {
+        source->refused++;
+        if( hook->source == id )
+        {
+            hook->source = -1;
+        }
+        return false;
+    }
+    source->enqueued++;
+    return true;
+}
+
+// A generated source is due: enqueue its task and draw the next one
+static void on_source_due( void* context )
+{
+    const source_id_t id     = ( source_id_t ) ( intptr_t ) context;
+    source_t*         source = &sources[id];
+    const uint32_t    now_ms = smtc_modem_hal_get_time_in_ms( );
+    uint32_t          next_ms;
+
+    if( id == SOURCE_PING_SLOT )
+    {
+        // Next ping period, at one of its 30 ms slots
+        const uint32_t period_start = ( ( now_ms + source->lead_ms ) / source->interval_ms + 1 ) * source->interval_ms;
+        const uint32_t slot_ms = period_start + random_below( source->interval_ms / PING_SLOT_MS ) * PING_SLOT_MS;
+        enqueue( id, slot_ms, false );
+        next_ms = period_start + source->interval_ms - source->lead_ms;
+    }
+    else if( id == SOURCE_RELAY )
+    {
+        enqueue( id, now_ms + source->lead_ms, false );
+        next_ms = now_ms + source->interval_ms;
+    }
+    else
+    {
+        enqueue( id, now_ms + source->lead_ms, source->lead_ms == 0 );
+        next_ms = now_ms + random_interval_ms( source->interval_ms );
+    }
+    sim_clock_schedule_at_us( ( uint64_t ) next_ms * 1000u, on_source_due, context );
+}
+
+// Replay: enqueue the current line of the trace, then wait for the next one
+static void on_replay_due( void* context )
+{
+    ( void ) context;
+    char line[128];
+
+    while( fgets( line, sizeof( line ), replay_file ) != NULL )
+    {
+        if( ( line[0] == '#' ) || ( line[0] == '\n' ) )
+        {
+            continue;
+        }
+        char               name[32];
+        char               start[32];
+        unsigned long long at_us;
+        if( sscanf( line, "%llu,%31[^,],%31s", &at_us, name, start ) != 3 )
+        {
+            fprintf( stderr, "bad trace line: %s", line );
+            continue;
+        }
+        int id = -1;
+        for( int i = 0; i < SOURCE_COUNT; i++ )
+        {
+            if( strcmp( name, sources[i].name ) == 0 )
+            {
+                id = i;
+            }
+        }
+        if( id < 0 )
+        {
+            fprintf( stderr, "unknown source in trace: %s\n", name );
+            continue;
+        }
+        if( at_us > sim_clock_now_us( ) )
+        {
+            // Not yet: read again when due
+            fseek( replay_file, -( long ) strlen( line ), SEEK_CUR );
+            sim_clock_schedule_at_us( at_us, on_replay_due, NULL );
+            return;
+        }
+        const bool asap = strcmp( start, "asap" ) == 0;
+        enqueue( ( source_id_t ) id, asap ? 0 : ( uint32_t ) strtoul( start, NULL, 0 ), asap );
+    }
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- RESULTS -----------------------------------------------------------------
+ */
+
+static int compare_u32( const void* a, const void* b )
+{
+    const uint32_t x = *( const uint32_t* ) a;
+    const uint32_t y = *( const uint32_t* ) b;
+    return ( x > y ) - ( x < y );
+}
+
+static int compare_i32( const void* a, const void* b )
+{
+    const int32_t x = *( const int32_t* ) a;
+    const int32_t y = *( const int32_t* ) b;
+    return ( x > y ) - ( x < y );
+}
+
+typedef struct summary_s
+{
+    uint32_t count;
+    double   min;
+    double   avg;
+    double   p50;
+    double   p95;
+    double   p99;
+    double   max;
+} summary_t;
+
+static summary_t summarize_decisions( decisions_t* decisions )
+{
+    summary_t s;
+    memset( &s, 0, sizeof( s ) );
+    s.count = decisions->count;
+    if( s.count == 0 )
+    {
+        return s;
+    }
+    qsort( decisions->ns, decisions->count, sizeof( uint32_t ), compare_u32 );
+    uint64_t total = 0;
+    for( uint32_t i = 0; i < decisions->count; i++ )
+    {
+        total += decisions->ns[i];
+    }
+    s.min = decisions->ns[0];
+    s.avg = ( double ) total / s.count;
+    s.p50 = decisions->ns[( s.count - 1 ) * 50 / 100];
+    s.p95 = decisions->ns[( s.count - 1 ) * 95 / 100];
+    s.p99 = decisions->ns[( s.count - 1 ) * 99 / 100];
+    s.max = decisions->ns[s.count - 1];
+    return s;
+}
+
+// Start delays in ms
+static summary_t summarize_delays( source_t* source )
+{
+    summary_t s;
+    memset( &s, 0, sizeof( s ) );
+    s.count = source->delay_count;
+    if( s.count == 0 )
+    {
+        return s;
+    }
+    qsort( source->delays_us, source->delay_count, sizeof( int32_t ), compare_i32 );
+    int64_t total = 0;
+    for( uint32_t i = 0; i < source->delay_count; i++ )
+    {
+        total += source->delays_us[i];
+    }
+    s.min = source->delays_us[0] / 1000.0;
+    s.avg = ( double ) total / s.count / 1000.0;
+    s.p50 = source->delays_us[( s.count - 1 ) * 50 / 100] / 1000.0;
+    s.p95 = source->delays_us[( s.count - 1 ) * 95 / 100] / 1000.0;
+    s.p99 = source->delays_us[( s.count - 1 ) * 99 / 100] / 1000.0;
+    s.max = source->delays_us[s.count - 1] / 1000.0;
+    return s;
+}
+
+static void json_summary( FILE* out, const char* name, const summary_t* s, bool last )
+{
+    fprintf( out,
+             "    \"%s\": {\"count\": %u, \"min\": %.3f, \"avg\": %.3f, \"p50\": %.3f, \"p95\": %.3f, \"p99\": %.3f, "
+             "\"max\": %.3f}%s\n",
+             name, s->count, s->min, s->avg, s->p50, s->p95, s->p99, s->max, last ? "" : "," );
+}
+
+int main( int argc, char** argv )
+{
+    uint32_t    duration_s   = 3600;
+    double      load         = 1.0;
+    uint32_t    periodicity  = 2;
+    const char* replay_path  = NULL;
+    const char* record_path  = NULL;
+    const char* json_path    = NULL;
+    uint32_t    max_delay_ms = 0;
+    uint32_t    seed         = 1;
+
+    int opt;
+    while( ( opt = getopt( argc, argv, "d:x:p:br:w:j:l:s:v" ) ) != -1 )
+    {
+        switch( opt )
+        {
+        case 'd':
+            duration_s = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'x':
+            load = strtod( optarg, NULL );
+            break;
+        case 'p':
+            periodicity = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'b':
+            background = true;
+            break;
+        case 'r':
+            replay_path = optarg;
+            break;
+        case 'w':
+            record_path = optarg;
+            break;
+        case 'j':
+            json_path = optarg;
+            break;
+        case 'l':
+            max_delay_ms = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 's':
+            seed = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'v':
+            verbose = true;
+            break;
+        default:
+            print_usage( argv[0] );
+            return 1;
+        }
+    }
+    if( ( duration_s == 0 ) || ( load <= 0.0 ) || ( periodicity > 7 ) )
+    {
+        print_usage( argv[0] );
+        return 1;
+    }
+    if( replay_path != NULL )
+    {
+        replay_file = fopen( replay_path, "r" );
+        if( replay_file == NULL )
+        {
+            perror( replay_path );
+            return 1;
+        }
+    }
+    if( record_path != NULL )
+    {
+        record_file = fopen( record_path, "w" );
+        if( record_file == NULL )
+        {
+            perror( record_path );
+            return 1;
+        }
+        fprintf( record_file, "# at_us,source,start_ms|asap\n" );
+    }
+
+    sources[SOURCE_UPLINK].interval_ms   = ( uint32_t ) ( sources[SOURCE_UPLINK].interval_ms / load );
+    sources[SOURCE_ALC_SYNC].interval_ms = ( uint32_t ) ( sources[SOURCE_ALC_SYNC].interval_ms / load );
+    sources[SOURCE_PING_SLOT].interval_ms = 1000u << periodicity;
+
+    hal_trace_set_quiet( true );
+    sim_clock_reset( );
+    srand( seed );
+    hal_mcu_init( );
+    for( int i = 0; i < RP_NB_HOOKS; i++ )
+    {
+        hooks[i].source = -1;
+    }
+
+    // A planner of its own on the virtual radio: the modem is not started
+    rp_init( &planner, &bench_radio );
+    ral_init( &bench_radio.ral );
+    bool hooked[RP_NB_HOOKS] = { false };
+    for( int i = 0; i < SOURCE_COUNT; i++ )
+    {
+        const uint8_t hook = sources[i].hook;
+        if( ( hooked[hook] == false ) && ( rp_hook_init( &planner, hook, on_hook, &hooks[hook] ) != RP_HOOK_STATUS_OK ) )
+        {
+            fprintf( stderr, "planner hook %u refused\n", hook );
+            return 1;
+        }
+        hooked[hook] = true;
+    }
+
+    if( replay_file != NULL )
+    {
+        on_replay_due( NULL );
+    }
+    else
+    {
+        // Random first occurrences so that the sources do not start in step
+        const source_id_t generated[] = { SOURCE_UPLINK, SOURCE_RELAY, SOURCE_PING_SLOT, SOURCE_ALC_SYNC };
+        for( size_t i = 0; i < sizeof( generated ) / sizeof( generated[0] ); i++ )
+        {
+            sim_clock_schedule_at_us( ( uint64_t ) ( 1000u + random_below( sources[generated[i]].interval_ms ) ) * 1000u,
+                                      on_source_due, ( void* ) ( intptr_t ) generated[i] );
+        }
+        if( background )
+        {
+            enqueue( SOURCE_BACKGROUND, smtc_modem_hal_get_time_in_ms( ), true );
+        }
+    }
+
+    // The engine loop of the modem, reduced to the planner
+    const uint64_t end_us = ( uint64_t ) duration_s * 1000000ULL;
+    while( sim_clock_now_us( ) < end_us )
+    {
+        uint64_t next_us = sim_clock_next_event_us( );
+        if( ( next_us == SIM_CLOCK_NO_EVENT ) || ( next_us > end_us ) )
+        {
+            next_us = end_us;
+        }
+        sim_clock_advance_us( ( next_us > sim_clock_now_us( ) ) ? next_us - sim_clock_now_us( ) : 0 );
+        while( rp_get_irq_flag( &planner ) == true )
+        {
+            nested_ns   = 0;
+            in_callback = true;
+            const uint64_t t0 = host_ns( );
+            rp_callback( &planner );
+            const uint64_t ns = host_ns( ) - t0;
+            in_callback       = false;
+            add_decision( &callback_ns, ( ns > nested_ns ) ? ns - nested_ns : 0 );
+        }
+    }
+    if( record_file != NULL )
+    {
+        fclose( record_file );
+    }
+    if( replay_file != NULL )
+    {
+        fclose( replay_file );
+    }
+
+    // Every enqueued task ends with one hook callback, but the ones still in the planner
+    uint32_t pending = 0;
+    for( int i = 0; i < RP_NB_HOOKS; i++ )
+    {
+        pending += ( hooks[i].source >= 0 ) ? 1 : 0;
+    }
+    uint32_t enqueued = 0;
+    uint32_t ended    = 0;
+    for( int i = 0; i < SOURCE_COUNT; i++ )
+    {
+        enqueued += sources[i].enqueued;
+        ended += sources[i].done + sources[i].dropped + sources[i].preempted;
+    }
+    const bool balanced = ( ended + pending == enqueued );
+
+    const summary_t enqueue_summary  = summarize_decisions( &enqueue_ns );
+    const summary_t callback_summary = summarize_decisions( &callback_ns );
+    summary_t       delays[SOURCE_COUNT];
+    for( int i = 0; i < SOURCE_COUNT; i++ )
+    {
+        delays[i] = summarize_delays( &sources[i] );
+    }
+
+    // With the JSON on the standard output, the report goes to the error output
+    FILE* report = ( ( json_path != NULL ) && ( strcmp( json_path, "-" ) == 0 ) ) ? stderr : stdout;
+    fprintf( report, "\n===== radio planner benchmark =====\n" );
+    fprintf( report, "task mix           : %s, %u s, load x%.2f, ping slot every %u s%s\n",
+            ( replay_path != NULL ) ? replay_path : "generated", duration_s, load, 1u << periodicity,
+            background ? ", background receive" : "" );
+    fprintf( report, "decision time      : rp_task_enqueue %u calls, avg %.0f ns, p99 %.0f ns, max %.0f ns\n",
+            enqueue_summary.count, enqueue_summary.avg, enqueue_summary.p99, enqueue_summary.max );
+    fprintf( report, "                     rp_callback %u calls, avg %.0f ns, p99 %.0f ns, max %.0f ns\n",
+            callback_summary.count, callback_summary.avg, callback_summary.p99, callback_summary.max );
+    fprintf( report, "\n%-11s %4s %8s %7s %6s %8s %8s %8s %9s %8s %9s %9s %9s\n", "source", "hook", "enqueued", "refused",
+            "busy", "launched", "dropped", "preempt", "abort %", "in row", "delay avg", "delay p95", "delay max" );
+    for( int i = 0; i < SOURCE_COUNT; i++ )
+    {
+        const source_t* s       = &sources[i];
+        const uint32_t  aborted = s->dropped + s->preempted;
+        fprintf( report, "%-11s %4u %8u %7u %6u %8u %8u %8u %8.2f%% %8u %7.2f ms %6.2f ms %6.2f ms\n", s->name, s->hook,
+                s->enqueued, s->refused, s->hook_busy, s->launched, s->dropped, s->preempted,
+                ( s->enqueued > 0 ) ? 100.0 * aborted / s->enqueued : 0.0, s->max_aborted_in_row, delays[i].avg,
+                delays[i].p95, delays[i].max );
+    }
+    fprintf( report, "\nplanner checks     : %u tasks enqueued, %u ended, %u pending, %u unexpected callbacks, %u unexpected "
+            "launches\n",
+            enqueued, ended, pending, unexpected_callbacks, unexpected_launches );
+
+    bool passed = balanced && ( unexpected_callbacks == 0 ) && ( unexpected_launches == 0 ) && ( enqueued > 0 );
+    if( max_delay_ms > 0 )
+    {
+        passed &= ( delays[SOURCE_UPLINK].max <= max_delay_ms );
+    }
+
+    if( json_path != NULL )
+    {
+        FILE* out = ( strcmp( json_path, "-" ) == 0 ) ? stdout : fopen( json_path, "w" );
+        if( out == NULL )
+        {
+            perror( json_path );
+            return 1;
+        }
+        fprintf( out, "{\n  \"bench\": \"radio_planner\",\n  \"mix\": \"%s\",\n  \"seed\": %u,\n  \"duration_s\": %u,\n",
+                 ( replay_path != NULL ) ? replay_path : "generated", seed, duration_s );
+        fprintf( out, "  \"load\": %.3f,\n  \"ping_slot_periodicity\": %u,\n  \"background\": %s,\n", load, periodicity,
+                 background ? "true" : "false" );
+        fprintf( out, "  \"decision_ns\": {\n" );
+        json_summary( out, "enqueue", &enqueue_summary, false );
+        json_summary( out, "callback", &callback_summary, true );
+        fprintf( out, "  },\n  \"sources\": [\n" );
+        for( int i = 0; i < SOURCE_COUNT; i++ )
+        {
+            const source_t* s = &sources[i];
+            fprintf( out,
+                     "   {\"name\": \"%s\", \"hook\": %u, \"enqueued\": %u, \"refused\": %u, \"hook_busy\": %u, "
+                     "\"launched\": %u, \"done\": %u, \"dropped\": %u, \"preempted\": %u, \"max_aborted_in_row\": %u, "
+                     "\"planner_aborts\": %u,\n    \"start_delay_ms\": {\"count\": %u, \"min\": %.3f, \"avg\": %.3f, "
+                     "\"p50\": %.3f, \"p95\": %.3f, \"p99\": %.3f, \"max\": %.3f}}%s\n",
+                     s->name, s->hook, s->enqueued, s->refused, s->hook_busy, s->launched, s->done, s->dropped,
+                     s->preempted, s->max_aborted_in_row, planner.stats.task_hook_aborted_nb[s->hook], delays[i].count,
+                     delays[i].min, delays[i].avg, delays[i].p50, delays[i].p95, delays[i].p99, delays[i].max,
+                     ( i == SOURCE_COUNT - 1 ) ? "" : "," );
+        }
+        fprintf( out, "  ],\n  \"checks\": {\"enqueued\": %u, \"ended\": %u, \"pending\": %u, "
+                      "\"unexpected_callbacks\": %u, \"unexpected_launches\": %u},\n  \"passed\": %s\n}\n",
+                 enqueued, ended, pending, unexpected_callbacks, unexpected_launches, passed ? "true" : "false" );
+        if( out != stdout )
+        {
+            fclose( out );
+        }
+    }
+
+    fprintf( report, "\n%s\n", ( passed == true ) ? "PASS" : "FAIL" );
+    return ( passed == true ) ? 0 : 1;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
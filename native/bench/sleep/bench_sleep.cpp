@@ -0,0 +1,401 @@
+/*!
+ * \file      bench_sleep.cpp
+ *
+ * \brief     Low-power run mode: wait decisions of lbm_sleep_plan() and wakeups of lbm_sleep_run_until_event()
+ *
+ * Only lbm_sleep.cpp is linked. The engine, the task notification and the modem HAL clock it relies on are
+ * replaced here by a fake clock that only moves while the task waits, and by a script of wakeup sources: the
+ * DIO1 irq of the radio, delivered to the modem through the irq callback it registered, and notifications of
+ * the API without any radio irq (lbm_engine_notify() from lbm_rx_ring_read_downlink() for instance).
+ *
+ * - lbm_sleep_plan(): a table of cases around LBM_SLEEP_MIN_MS and LBM_SLEEP_WAKEUP_GUARD_MS, then every engine
+ *   deadline and caller bound from 0 to 64 ms, forever included, against the rules of lbm_sleep.h: no wait when
+ *   work is pending or the deadline is now, a notification wait below the light-sleep threshold, a light sleep
+ *   ending LBM_SLEEP_WAKEUP_GUARD_MS before a modem deadline, and never past a deadline or the caller bound.
+ * - lbm_sleep_run_until_event(): light sleeps ended by the timer and by DIO1, API notifications during a light
+ *   sleep, which must neither end it nor reach the modem as a radio irq, short notification waits and pending
+ *   work, with the stats of lbm_sleep_get_stats().
+ *
+ * Usage: program [-v]
+ *   -v  print each run mode case
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "lbm_sleep.h"
+#include "lbm_engine.h"
+#include "lbm_energy.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define MAX_SCRIPT 8
+
+typedef enum source_e
+{
+    SOURCE_RADIO,         //!< DIO1 irq of the radio
+    SOURCE_NOTIFICATION,  //!< lbm_engine_notify() of the API, no radio irq
+} source_t;
+
+typedef struct wakeup_s
+{
+    uint32_t at_ms;
+    source_t source;
+} wakeup_t;
+
+// Fake clock and task
+static uint32_t now_ms       = 0;
+static uint32_t notify_count = 0;
+
+// Script of the wakeup sources of a run, by time
+static wakeup_t script[MAX_SCRIPT];
+static uint32_t script_size = 0;
+static uint32_t script_next = 0;
+
+// Engine and modem side
+static uint32_t engine_sleep_ms = 0;
+static uint32_t engine_waits    = 0;
+static uint32_t engine_wait_ms  = 0;
+static uint32_t modem_irqs      = 0;  // radio irqs the modem received
+static uint32_t mcu_sleeps      = 0;
+static uint32_t mcu_actives     = 0;
+static void ( *hal_radio_irq )( void* context ) = nullptr;  // what lbm_sleep registered in the HAL
+static void* hal_radio_context                  = nullptr;
+
+static bool     verbose  = false;
+static uint32_t checks   = 0;
+static uint32_t failures = 0;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- FAKE CLOCK AND TASK -----------------------------------------------------
+ */
+
+// Move the clock to the next scripted wakeup or to the deadline, whichever comes first, until notified
+static void wait_until( uint32_t deadline_ms )
+{
+    while( notify_count == 0 )
+    {
+        if( ( script_next < script_size ) && ( script[script_next].at_ms <= deadline_ms ) )
+        {
+            const wakeup_t* wakeup = &script[script_next++];
+            now_ms                 = ( wakeup->at_ms > now_ms ) ? wakeup->at_ms : now_ms;
+            if( wakeup->source == SOURCE_RADIO )
+            {
+                hal_radio_irq( hal_radio_context );
+            }
+            else
+            {
+                notify_count++;
+            }
+        }
+        else
+        {
+            now_ms = ( deadline_ms > now_ms ) ? deadline_ms : now_ms;
+            return;
+        }
+    }
+}
+
+extern "C" uint32_t ulTaskNotifyTake( BaseType_t clear_count_on_exit, TickType_t ticks_to_wait )
+{
+    if( ticks_to_wait > 0 )
+    {
+        wait_until( ( ticks_to_wait == portMAX_DELAY ) ? UINT32_MAX : now_ms + ticks_to_wait );
+    }
+    const uint32_t count = notify_count;
+    if( count != 0 )
+    {
+        notify_count = ( clear_count_on_exit != pdFALSE ) ? 0 : count - 1;
+    }
+    return count;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- ENGINE, ENERGY AND MODEM HAL CALLS OF LBM_SLEEP -------------------------
+ */
+
+uint32_t lbm_engine_run( void )
+{
+    return engine_sleep_ms;
+}
+
+bool lbm_engine_take_notification( void )
+{
+    return ulTaskNotifyTake( pdTRUE, 0 ) != 0;
+}
+
+uint32_t lbm_engine_wait( uint32_t wait_ms )
+{
+    const uint32_t start_ms = now_ms;
+    engine_waits++;
+    engine_wait_ms = wait_ms;
+    ( void ) ulTaskNotifyTake( pdTRUE, pdMS_TO_TICKS( wait_ms ) );
+    return now_ms - start_ms;
+}
+
+void lbm_energy_on_mcu( lbm_energy_mcu_t state )
+{
+    if( state == LBM_ENERGY_MCU_SLEEP )
+    {
+        mcu_sleeps++;
+    }
+    else
+    {
+        mcu_actives++;
+    }
+}
+
+// The radio irq of the modem ends with smtc_modem_hal_user_lbm_irq(), which notifies the engine task
+static void modem_radio_irq( void* context )
+{
+    ( void ) context;
+    modem_irqs++;
+    notify_count++;
+}
+
+// Real HAL functions behind the wraps of lbm_sleep.cpp
+extern "C" uint32_t smtc_modem_hal_get_time_in_ms( void )
+{
+    return now_ms;
+}
+
+extern "C" uint32_t smtc_modem_hal_get_time_in_s( void )
+{
+    return now_ms / 1000;
+}
+
+extern "C" void smtc_modem_hal_irq_config_radio_irq( void ( *callback )( void* context ), void* context )
+{
+    hal_radio_irq     = callback;
+    hal_radio_context = context;
+}
+
+extern "C" void __wrap_smtc_modem_hal_irq_config_radio_irq( void ( *callback )( void* context ), void* context );
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- CHECKS ------------------------------------------------------------------
+ */
+
+static void check( bool condition, const char* what, uint32_t a, uint32_t b )
+{
+    checks++;
+    if( condition == false )
+    {
+        if( failures < 20 )
+        {
+            printf( "  FAILED: %s (%u, %u)\n", what, a, b );
+        }
+        failures++;
+    }
+}
+
+static void check_plan_table( void )
+{
+    static const struct
+    {
+        uint32_t         engine_ms;
+        uint32_t         max_wait_ms;
+        bool             pending;
+        lbm_sleep_mode_t mode;
+        uint32_t         duration_ms;
+    } cases[] = {
+        { 1000, LBM_ENGINE_WAIT_FOREVER, true, LBM_SLEEP_MODE_NONE, 0 },  // work pending
+        { 0, LBM_ENGINE_WAIT_FOREVER, false, LBM_SLEEP_MODE_NONE, 0 },    // modem deadline now
+        { 1000, 0, false, LBM_SLEEP_MODE_NONE, 0 },                       // caller bound now
+        { LBM_SLEEP_MIN_MS + LBM_SLEEP_WAKEUP_GUARD_MS - 1, LBM_ENGINE_WAIT_FOREVER, false, LBM_SLEEP_MODE_WAIT,
+          LBM_SLEEP_MIN_MS + LBM_SLEEP_WAKEUP_GUARD_MS - 1 },  // too short for the guard
+        { LBM_SLEEP_MIN_MS + LBM_SLEEP_WAKEUP_GUARD_MS, LBM_ENGINE_WAIT_FOREVER, false, LBM_SLEEP_MODE_LIGHT,
+          LBM_SLEEP_MIN_MS },  // shortest light sleep before a modem deadline
+        { 1000, LBM_ENGINE_WAIT_FOREVER, false, LBM_SLEEP_MODE_LIGHT, 1000 - LBM_SLEEP_WAKEUP_GUARD_MS },
+        { 1000, 500, false, LBM_SLEEP_MODE_LIGHT, 500 },                                   // caller bound, no guard
+        { 1000, LBM_SLEEP_MIN_MS, false, LBM_SLEEP_MODE_LIGHT, LBM_SLEEP_MIN_MS },         // shortest caller bound
+        { 1000, LBM_SLEEP_MIN_MS - 1, false, LBM_SLEEP_MODE_WAIT, LBM_SLEEP_MIN_MS - 1 },  // below the threshold
+        { 500, 500, false, LBM_SLEEP_MODE_LIGHT, 500 - LBM_SLEEP_WAKEUP_GUARD_MS },        // equal: modem deadline
+    };
+
+    for( uint32_t i = 0; i < sizeof( cases ) / sizeof( cases[0] ); i++ )
+    {
+        const lbm_sleep_plan_t plan = lbm_sleep_plan( cases[i].engine_ms, cases[i].max_wait_ms, cases[i].pending );
+        check( ( plan.mode == cases[i].mode ) && ( plan.duration_ms == cases[i].duration_ms ),
+               "plan case (case, duration)", i, plan.duration_ms );
+    }
+}
+
+static void check_plan_rules( void )
+{
+    for( uint32_t engine_ms = 0; engine_ms <= 65; engine_ms++ )
+    {
+        for( uint32_t max_wait_ms = 0; max_wait_ms <= 65; max_wait_ms++ )
+        {
+            // 65 stands for forever on either side
+            const uint32_t engine = ( engine_ms == 65 ) ? LBM_ENGINE_WAIT_FOREVER : engine_ms;
+            const uint32_t bound  = ( max_wait_ms == 65 ) ? LBM_ENGINE_WAIT_FOREVER : max_wait_ms;
+            if( ( engine == LBM_ENGINE_WAIT_FOREVER ) && ( bound == LBM_ENGINE_WAIT_FOREVER ) )
+            {
+                continue;
+            }
+            const bool     engine_bound = ( engine <= bound );
+            const uint32_t wait_ms      = ( engine_bound == true ) ? engine : bound;
+
+            const lbm_sleep_plan_t pending = lbm_sleep_plan( engine, bound, true );
+            check( pending.mode == LBM_SLEEP_MODE_NONE, "pending work runs the engine", engine_ms, max_wait_ms );
+
+            const lbm_sleep_plan_t plan = lbm_sleep_plan( engine, bound, false );
+            switch( plan.mode )
+            {
+            case LBM_SLEEP_MODE_NONE:
+                check( wait_ms == 0, "no wait only when due now", engine_ms, max_wait_ms );
+                break;
+            case LBM_SLEEP_MODE_WAIT:
+                check( ( plan.duration_ms == wait_ms ) && ( wait_ms > 0 ) &&
+                           ( wait_ms < LBM_SLEEP_MIN_MS + ( ( engine_bound == true ) ? LBM_SLEEP_WAKEUP_GUARD_MS : 0 ) ),
+                       "notification wait below the threshold", engine_ms, max_wait_ms );
+                break;
+            case LBM_SLEEP_MODE_LIGHT:
+                check( plan.duration_ms >= LBM_SLEEP_MIN_MS, "light sleep long enough", engine_ms, max_wait_ms );
+                check( plan.duration_ms ==
+                           wait_ms - ( ( engine_bound == true ) ? LBM_SLEEP_WAKEUP_GUARD_MS : 0 ),
+                       "light sleep ends at the guard, or at the caller bound", engine_ms, max_wait_ms );
+                break;
+            }
+            check( plan.duration_ms <= wait_ms, "never past the deadline or the bound", engine_ms, max_wait_ms );
+        }
+    }
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- RUN MODE CASES ----------------------------------------------------------
+ */
+
+typedef struct run_case_s
+{
+    const char* name;
+    uint32_t    engine_ms;       //!< deadline returned by the engine
+    bool        pending;         //!< notified before the run
+    wakeup_t    wakeups[3];      //!< at_ms relative to the start, 0 ends the list
+    uint32_t    slept_ms;        //!< expected result
+    uint32_t    modem_irqs;      //!< radio irqs expected at the modem
+    uint32_t    light_sleeps;
+    uint32_t    wakeups_on_dio1;
+    uint32_t    engine_waits;
+} run_case_t;
+
+static void check_run( const run_case_t* run )
+{
+    const uint32_t start_ms = now_ms;
+    script_size             = 0;
+    script_next             = 0;
+    for( uint32_t i = 0; ( i < 3 ) && ( run->wakeups[i].at_ms != 0 ); i++ )
+    {
+        script[script_size]       = run->wakeups[i];
+        script[script_size].at_ms = start_ms + run->wakeups[i].at_ms;
+        script_size++;
+    }
+    notify_count    = ( run->pending == true ) ? 1 : 0;
+    engine_sleep_ms = run->engine_ms;
+    modem_irqs      = 0;
+    engine_waits    = 0;
+    mcu_sleeps      = 0;
+    mcu_actives     = 0;
+    lbm_sleep_reset_stats( );
+
+    const uint32_t slept_ms = lbm_sleep_run_until_event( LBM_ENGINE_WAIT_FOREVER );
+
+    lbm_sleep_stats_t stats;
+    lbm_sleep_get_stats( &stats );
+    if( verbose == true )
+    {
+        printf( "  %-34s: %4u ms, %u light sleeps (%u on DIO1, %u replays), %u waits, %u modem irqs\n", run->name,
+                slept_ms, stats.light_sleeps, stats.wakeups_on_dio1, stats.dio1_replays, engine_waits, modem_irqs );
+    }
+
+    check( slept_ms == run->slept_ms, run->name, slept_ms, run->slept_ms );
+    check( now_ms - start_ms == run->slept_ms, "fake clock moved by the time slept", now_ms - start_ms, run->slept_ms );
+    check( modem_irqs == run->modem_irqs, "radio irqs at the modem", modem_irqs, run->modem_irqs );
+    check( ( stats.light_sleeps == run->light_sleeps ) && ( mcu_sleeps == run->light_sleeps ) &&
+               ( mcu_actives == run->light_sleeps ),
+           "light sleeps, with the MCU energy states", stats.light_sleeps, mcu_sleeps );
+    check( ( stats.wakeups_on_dio1 == run->wakeups_on_dio1 ) &&
+               ( stats.wakeups_on_timer == run->light_sleeps - run->wakeups_on_dio1 ),
+           "wakeup causes", stats.wakeups_on_dio1, stats.wakeups_on_timer );
+    check( stats.dio1_replays == 0, "no radio irq replayed on the host", stats.dio1_replays, 0 );
+    check( ( engine_waits == run->engine_waits ) && ( stats.wait_time_ms == ( ( run->engine_waits > 0 ) ? slept_ms : 0 ) ),
+           "notification waits", engine_waits, stats.wait_time_ms );
+    check( stats.light_sleep_time_ms == ( ( run->light_sleeps > 0 ) ? slept_ms : 0 ), "light sleep time",
+           stats.light_sleep_time_ms, slept_ms );
+    check( stats.skipped_pending == ( ( run->pending == true ) ? 1u : 0u ), "skipped for pending work",
+           stats.skipped_pending, 0 );
+    check( stats.time_compensation_ms == 0, "no time compensation on the host", ( uint32_t ) stats.time_compensation_ms,
+           0 );
+    check( notify_count == 0, "notification taken by the run", notify_count, 0 );
+}
+
+static void check_run_mode( void )
+{
+    const uint32_t guard = LBM_SLEEP_WAKEUP_GUARD_MS;
+    const run_case_t runs[] = {
+        { "timer", 1000, false, { { 0, SOURCE_RADIO } }, 1000 - guard, 0, 1, 0, 0 },
+        { "DIO1", 1000, false, { { 300, SOURCE_RADIO } }, 300, 1, 1, 1, 0 },
+        { "API notification, timer", 1000, false, { { 300, SOURCE_NOTIFICATION } }, 1000 - guard, 0, 1, 0, 0 },
+        { "API notifications, then DIO1", 1000, false,
+          { { 200, SOURCE_NOTIFICATION }, { 400, SOURCE_NOTIFICATION }, { 600, SOURCE_RADIO } }, 600, 1, 1, 1, 0 },
+        { "DIO1 after the deadline", 1000, false, { { 1000, SOURCE_RADIO } }, 1000 - guard, 0, 1, 0, 0 },
+        { "short wait", LBM_SLEEP_MIN_MS, false, { { 0, SOURCE_RADIO } }, LBM_SLEEP_MIN_MS, 0, 0, 0, 1 },
+        { "short wait, API notification", LBM_SLEEP_MIN_MS, false, { { 2, SOURCE_NOTIFICATION } }, 2, 0, 0, 0, 1 },
+        { "pending work", 1000, true, { { 0, SOURCE_RADIO } }, 0, 0, 0, 0, 0 },
+    };
+
+    for( const run_case_t& run : runs )
+    {
+        check_run( &run );
+    }
+}
+
+static void print_usage( const char* name )
+{
+    fprintf( stderr, "usage: %s [-v]\n", name );
+}
+
+int main( int argc, char** argv )
+{
+    int opt;
+    while( ( opt = getopt( argc, argv, "v" ) ) != -1 )
+    {
+        switch( opt )
+        {
+        case 'v':
+            verbose = true;
+            break;
+        default:
+            print_usage( argv[0] );
+            return 1;
+        }
+    }
+
+    // As the modem does at init, through the wrap of lbm_sleep
+    __wrap_smtc_modem_hal_irq_config_radio_irq( modem_radio_irq, nullptr );
+    now_ms = 10000;
+
+    printf( "\n===== low-power run mode =====\n" );
+    uint32_t before = checks;
+    check_plan_table( );
+    check_plan_rules( );
+    printf( "lbm_sleep_plan()   : %u checks (MIN %u ms, guard %u ms)\n", checks - before, LBM_SLEEP_MIN_MS,
+            LBM_SLEEP_WAKEUP_GUARD_MS );
+    before = checks;
+    check_run_mode( );
+    printf( "run mode           : %u checks\n", checks - before );
+    printf( "total              : %u checks, %u failed\n", checks, failures );
+
+    printf( "\n%s\n", ( failures == 0 ) ? "PASS" : "FAIL" );
+    return ( failures == 0 ) ? 0 : 1;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
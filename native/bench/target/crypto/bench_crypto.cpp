@@ -0,0 +1,132 @@
+/*!
+ * \file      bench_crypto.cpp
+ *
+ * \brief     Per-frame crypto latency of the AES backends of the secure element
+ *
+ * Runs on the RAK3112 instead of the sketch of src/main.cpp and prints, for each backend, the time to compute
+ * the MIC of an uplink and to encrypt its payload, the two operations soft_se.c performs for every frame. The
+ * MIC is the AES-CMAC of the B0 block and the frame, the encryption one AES block per 16 bytes of payload.
+ * The known-answer tests are run first: a backend that fails them is not measured.
+ *
+ * pio run -e rak3112_bench_crypto -t upload -t monitor
+ */
+
+#include <Arduino.h>
+#include <string.h>
+
+#include "lbm_crypto.h"
+
+extern "C" {
+#include "aes.h"
+#include "cmac.h"
+}
+
+#define ITERATIONS 2000
+
+static const uint8_t key[16] = { 0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+                                 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c };
+
+// Application payload sizes: the limits of DR0-DR2 and of DR4-DR7 in EU868
+static const uint8_t payload_sizes[] = { 12, 51, 222 };
+
+static const char* const backend_names[LBM_CRYPTO_BACKEND_COUNT] = { "soft", "hardware", "table" };
+
+static uint8_t frame[16 + 13 + 222];
+
+static uint32_t elapsed_ns( uint32_t start_cycles, uint32_t iterations )
+{
+    return ( uint32_t ) ( ( uint64_t ) ( ESP.getCycleCount( ) - start_cycles ) * 1000u / getCpuFrequencyMhz( ) /
+                          iterations );
+}
+
+static uint32_t measure_mic( uint8_t payload_size )
+{
+    // B0 block, then MHDR, FHDR, FPort and payload
+    const uint32_t size = 16 + 9 + payload_size;
+    uint8_t        mic[16];
+    const uint32_t start = ESP.getCycleCount( );
+    for( uint32_t i = 0; i < ITERATIONS; i++ )
+    {
+        AES_CMAC_CTX context;
+        AES_CMAC_Init( &context );
+        AES_CMAC_SetKey( &context, key );
+        AES_CMAC_Update( &context, frame, size );
+        AES_CMAC_Final( mic, &context );
+    }
+    return elapsed_ns( start, ITERATIONS );
+}
+
+static uint32_t measure_encrypt( uint8_t payload_size )
+{
+    aes_context context;
+    uint8_t     block[16];
+    uint8_t     keystream[16];
+    aes_set_key( key, sizeof( key ), &context );
+
+    const uint32_t start = ESP.getCycleCount( );
+    for( uint32_t i = 0; i < ITERATIONS; i++ )
+    {
+        // Counter mode with the Ai blocks of the LoRaWAN payload encryption
+        memset( block, 0, sizeof( block ) );
+        block[0] = 0x01;
+        for( uint32_t offset = 0; offset < payload_size; offset += 16 )
+        {
+            block[15] = ( uint8_t ) ( offset / 16 + 1 );
+            aes_encrypt( block, keystream, &context );
+            for( uint32_t j = 0; ( j < 16 ) && ( ( offset + j ) < payload_size ); j++ )
+            {
+                frame[16 + 9 + offset + j] ^= keystream[j];
+            }
+        }
+    }
+    return elapsed_ns( start, ITERATIONS );
+}
+
+void setup( )
+{
+    Serial.begin( 115200 );
+    delay( 2000 );
+
+    for( uint32_t i = 0; i < sizeof( frame ); i++ )
+    {
+        frame[i] = ( uint8_t ) i;
+    }
+
+    lbm_crypto_init( );
+    Serial.printf( "\n===== secure element crypto benchmark (%u iterations, %u MHz) =====\n", ITERATIONS,
+                   getCpuFrequencyMhz( ) );
+
+    uint32_t results[LBM_CRYPTO_BACKEND_COUNT][sizeof( payload_sizes )][2] = {};
+    for( int backend = LBM_CRYPTO_BACKEND_SOFT; backend < LBM_CRYPTO_BACKEND_COUNT; backend++ )
+    {
+        const int failures = lbm_crypto_self_test( ( lbm_crypto_backend_t ) backend );
+        Serial.printf( "%-8s known-answer tests: %s\n", backend_names[backend],
+                       ( failures == 0 ) ? "pass" : ( failures < 0 ) ? "not available" : "FAIL" );
+        if( ( failures != 0 ) || ( lbm_crypto_set_backend( ( lbm_crypto_backend_t ) backend ) != SMTC_MODEM_RC_OK ) )
+        {
+            continue;
+        }
+        for( uint32_t i = 0; i < sizeof( payload_sizes ); i++ )
+        {
+            results[backend][i][0] = measure_mic( payload_sizes[i] );
+            results[backend][i][1] = measure_encrypt( payload_sizes[i] );
+        }
+    }
+
+    Serial.printf( "%-8s %-8s %12s %12s\n", "payload", "backend", "MIC (us)", "encrypt (us)" );
+    for( uint32_t i = 0; i < sizeof( payload_sizes ); i++ )
+    {
+        for( int backend = LBM_CRYPTO_BACKEND_SOFT; backend < LBM_CRYPTO_BACKEND_COUNT; backend++ )
+        {
+            Serial.printf( "%-8u %-8s %12.2f %12.2f\n", payload_sizes[i], backend_names[backend],
+                           results[backend][i][0] / 1000.0, results[backend][i][1] / 1000.0 );
+        }
+    }
+}
+
+void loop( )
+{
+    delay( 1000 );
+}
+
+/* --- EOF ------------------------------------------------------------------ */
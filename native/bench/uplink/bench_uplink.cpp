@@ -0,0 +1,350 @@
+/*!
+ * \file      bench_uplink.cpp
+ *
+ * \brief     Uplink ticket benchmark: pipelined uplinks, their completion status and request to TX / done latency
+ *
+ * Every period the application queues a burst of uplinks with LoRaWANClass::sendAsync() without waiting for the
+ * radio, a share of them confirmed, and optionally one plain send() in between that the tickets have to wait
+ * for. Tickets are read back either from their callback or by polling getUplinkResult(). The simulated network
+ * server checks that the uplinks it receives arrive in the order they were queued.
+ *
+ * The bench fails if a ticket never completes, if the tickets complete out of order, if the status counters do
+ * not add up, or if the server receives more ticket uplinks than the tickets report as transmitted (or, without
+ * uplink loss, fewer).
+ *
+ * Usage: program [-m callback|poll] [-d seconds] [-p period_s] [-n burst] [-c confirmed_%] [-x] [-s seed]
+ *                [-u uplink_loss_%] [-v]
+ *   -m  how tickets are read back (default callback)
+ *   -d  simulated duration in seconds (default 21600)
+ *   -p  period of the bursts in seconds (default 600)
+ *   -n  uplinks per burst (default 4, at most LBM_UPLINK_MAX_TICKETS)
+ *   -c  percentage of confirmed uplinks (default 25)
+ *   -x  also send() one uplink outside the tickets at each burst
+ *   -s  seed of the modem random generator and of the network loss pattern (default 1)
+ *   -u  percentage of uplinks lost between the device and the gateway
+ *   -v  print the modem traces
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "bench_join.h"
+#include "lbm_api.h"
+
+extern "C" {
+#include "sim_clock.h"
+#include "sim_network.h"
+#include "smtc_hal_dbg_trace.h"
+#include "smtc_modem_hal_native.h"
+}
+
+#define TICKET_PORT 20
+#define DIRECT_PORT 21
+#define PAYLOAD_SIZE 12
+
+// Time left after the last burst for the queued tickets to complete
+#define DRAIN_S 600
+
+static const char* status_names[] = { "queued", "in flight", "sent", "acked", "nacked", "dropped (duty cycle)",
+                                      "not sent", "refused", "cancelled" };
+
+// Device side
+static uint32_t            sequence          = 0;  // index of the next ticket, carried by its payload
+static lbm_uplink_ticket_t polled[2 * LBM_UPLINK_MAX_TICKETS];  // read back before a burst can recycle them
+static uint32_t            nb_polled         = 0;
+static uint32_t            completions       = 0;
+static uint32_t            out_of_order      = 0;
+static uint32_t            transmitted       = 0;
+static lbm_uplink_ticket_t last_completed    = LBM_UPLINK_NO_TICKET;
+static uint32_t            by_status[LBM_UPLINK_CANCELLED + 1];
+static uint32_t            direct_refused    = 0;
+static uint32_t            submit_failures   = 0;
+static uint32_t            lost_reads        = 0;
+
+// Server side
+static uint32_t ticket_frames    = 0;
+static uint32_t direct_frames    = 0;
+static uint32_t server_reordered = 0;
+static uint32_t last_sequence    = 0;
+static bool     first_frame      = true;
+
+static void print_usage( const char* name )
+{
+    fprintf( stderr,
+             "usage: %s [-m callback|poll] [-d seconds] [-p period_s] [-n burst] [-c confirmed_%%] [-x] [-s seed] "
+             "[-u uplink_loss_%%] [-v]\n",
+             name );
+}
+
+static void on_uplink( uint8_t fport, const uint8_t* payload, uint8_t size, uint32_t time_on_air_us )
+{
+    ( void ) time_on_air_us;
+    if( fport == DIRECT_PORT )
+    {
+        direct_frames++;
+        return;
+    }
+    if( ( fport != TICKET_PORT ) || ( size < 4 ) )
+    {
+        return;
+    }
+    const uint32_t index = ( uint32_t ) payload[0] | ( ( uint32_t ) payload[1] << 8 ) |
+                           ( ( uint32_t ) payload[2] << 16 ) | ( ( uint32_t ) payload[3] << 24 );
+    // Confirmed retransmissions repeat the same index
+    if( ( first_frame == false ) && ( index < last_sequence ) )
+    {
+        server_reordered++;
+    }
+    if( ( first_frame == true ) || ( index != last_sequence ) )
+    {
+        ticket_frames++;
+    }
+    first_frame   = false;
+    last_sequence = index;
+}
+
+static void on_completed( const lbm_uplink_result_t* result, void* context )
+{
+    ( void ) context;
+    completions++;
+    if( ( last_completed != LBM_UPLINK_NO_TICKET ) && ( ( int32_t ) ( result->ticket - last_completed ) < 0 ) )
+    {
+        out_of_order++;
+    }
+    last_completed = result->ticket;
+    if( result->status <= LBM_UPLINK_CANCELLED )
+    {
+        by_status[result->status]++;
+    }
+    if( ( result->status == LBM_UPLINK_SENT ) || ( result->status == LBM_UPLINK_ACKED ) ||
+        ( result->status == LBM_UPLINK_NACKED ) )
+    {
+        transmitted++;
+    }
+}
+
+static void poll_tickets( void )
+{
+    uint32_t kept = 0;
+    for( uint32_t i = 0; i < nb_polled; i++ )
+    {
+        lbm_uplink_result_t result;
+        if( lbm.lorawan.getUplinkResult( polled[i], &result ) != SMTC_MODEM_RC_OK )
+        {
+            lost_reads++;  // recycled before being read
+        }
+        else if( result.status < LBM_UPLINK_SENT )
+        {
+            polled[kept++] = polled[i];
+        }
+        else
+        {
+            on_completed( &result, NULL );
+        }
+    }
+    nb_polled = kept;
+}
+
+static void queue_burst( uint8_t burst, uint8_t confirmed_percent, bool poll, bool direct )
+{
+    if( direct == true )
+    {
+        // Taken by the modem before the tickets, which wait for its TXDONE
+        const uint8_t reading[4] = { 0xD1, 0xEC, 0x70, 0x00 };
+        if( lbm.lorawan.send( reading, sizeof( reading ), DIRECT_PORT, false ) != SMTC_MODEM_RC_OK )
+        {
+            direct_refused++;
+        }
+    }
+
+    for( uint8_t i = 0; i < burst; i++ )
+    {
+        uint8_t payload[PAYLOAD_SIZE] = { 0 };
+        payload[0]                    = ( uint8_t ) sequence;
+        payload[1]                    = ( uint8_t ) ( sequence >> 8 );
+        payload[2]                    = ( uint8_t ) ( sequence >> 16 );
+        payload[3]                    = ( uint8_t ) ( sequence >> 24 );
+        const bool confirmed          = ( ( sequence * 37 ) % 100 ) < confirmed_percent;
+        sequence++;
+
+        const lbm_uplink_ticket_t ticket = lbm.lorawan.sendAsync( payload, sizeof( payload ), TICKET_PORT, confirmed,
+                                                                  ( poll == true ) ? nullptr : on_completed, NULL );
+        if( ticket == LBM_UPLINK_NO_TICKET )
+        {
+            submit_failures++;
+        }
+        else if( poll == true )
+        {
+            polled[nb_polled++] = ticket;
+        }
+    }
+}
+
+static void print_latency( const char* name, const lbm_uplink_latency_t* latency )
+{
+    printf( "%-19s: %u samples, min %u ms, avg %.0f ms, max %u ms, p50 <= %u ms, p95 <= %u ms\n", name,
+            latency->count, latency->min_ms, ( double ) latency->average_ms, latency->max_ms,
+            lbm_uplink_latency_percentile( latency, 50 ), lbm_uplink_latency_percentile( latency, 95 ) );
+    printf( "                    " );
+    for( uint8_t n = 0; n < LBM_UPLINK_LATENCY_BUCKETS; n++ )
+    {
+        if( latency->buckets[n] != 0 )
+        {
+            printf( " <%ums:%u", 1u << n, latency->buckets[n] );
+        }
+    }
+    printf( "\n" );
+}
+
+int main( int argc, char** argv )
+{
+    bool     poll              = false;
+    bool     direct            = false;
+    uint32_t duration_s        = 21600;
+    uint32_t period_s          = 600;
+    uint32_t burst             = 4;
+    uint32_t confirmed_percent = 25;
+    uint32_t seed              = 1;
+    bool     verbose           = false;
+
+    sim_network_config_t network_config;
+    sim_network_get_default_config( &network_config );
+
+    int opt;
+    while( ( opt = getopt( argc, argv, "m:d:p:n:c:xs:u:v" ) ) != -1 )
+    {
+        switch( opt )
+        {
+        case 'm':
+            if( strcmp( optarg, "poll" ) == 0 )
+            {
+                poll = true;
+            }
+            else if( strcmp( optarg, "callback" ) != 0 )
+            {
+                print_usage( argv[0] );
+                return 1;
+            }
+            break;
+        case 'd':
+            duration_s = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'p':
+            period_s = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'n':
+            burst = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'c':
+            confirmed_percent = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'x':
+            direct = true;
+            break;
+        case 's':
+            seed = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'u':
+            network_config.uplink_loss_percent = ( uint8_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'v':
+            verbose = true;
+            break;
+        default:
+            print_usage( argv[0] );
+            return 1;
+        }
+    }
+    if( ( period_s == 0 ) || ( burst == 0 ) || ( burst > LBM_UPLINK_MAX_TICKETS ) || ( confirmed_percent > 100 ) )
+    {
+        print_usage( argv[0] );
+        return 1;
+    }
+    network_config.seed = seed;
+
+    hal_trace_set_quiet( !verbose );
+    sim_clock_reset( );
+    smtc_modem_hal_native_set_seed( seed );
+    sim_network_configure( &network_config );
+    sim_network_set_uplink_handler( on_uplink );
+
+    lbm.init( );
+    bench_join_start( lbm, NULL );
+
+    // Bursts start once the device has joined and stop DRAIN_S before the end
+    const uint64_t end_us        = ( uint64_t ) ( duration_s + DRAIN_S ) * 1000000ULL;
+    const uint64_t last_us       = ( uint64_t ) duration_s * 1000000ULL;
+    uint64_t       next_burst_us = 0;
+    bool           started       = false;
+
+    while( sim_clock_now_us( ) < end_us )
+    {
+        uint32_t       wait_ms = 1000;
+        const uint64_t now_us  = sim_clock_now_us( );
+        if( ( started == true ) && ( next_burst_us < last_us ) )
+        {
+            wait_ms = ( next_burst_us > now_us ) ? ( uint32_t ) ( ( next_burst_us - now_us + 999 ) / 1000 ) : 0;
+            wait_ms = ( wait_ms > 1000 ) ? 1000 : wait_ms;
+        }
+        lbm.runEngineUntilEvent( wait_ms );
+        if( poll == true )
+        {
+            poll_tickets( );
+        }
+
+        if( ( started == false ) && ( bench_joined( ) == true ) )
+        {
+            started       = true;
+            next_burst_us = sim_clock_now_us( );
+        }
+        if( ( started == false ) || ( sim_clock_now_us( ) < next_burst_us ) || ( next_burst_us >= last_us ) )
+        {
+            continue;
+        }
+        next_burst_us += ( uint64_t ) period_s * 1000000ULL;
+        queue_burst( ( uint8_t ) burst, ( uint8_t ) confirmed_percent, poll, direct );
+    }
+
+    lbm_uplink_stats_t stats;
+    lbm.lorawan.getUplinkStats( &stats );
+    const uint32_t completed_total = stats.sent + stats.acked + stats.nacked + stats.dropped_duty_cycle +
+                                     stats.not_sent + stats.refused + stats.cancelled;
+
+    printf( "\n===== uplink ticket benchmark =====\n" );
+    printf( "mode               : %s, bursts of %u every %u s, %u %% confirmed%s\n",
+            ( poll == true ) ? "poll" : "callback", burst, period_s, confirmed_percent,
+            ( direct == true ) ? ", one send() per burst" : "" );
+    printf( "virtual time       : %.0f s\n", ( double ) sim_clock_now_us( ) / 1e6 );
+    printf( "tickets            : %u queued, %u refused at submission, %u completed, %u still pending, "
+            "%u recycled unread\n",
+            stats.submitted, submit_failures, completions, stats.pending, lost_reads );
+    for( uint8_t s = LBM_UPLINK_SENT; s <= LBM_UPLINK_CANCELLED; s++ )
+    {
+        if( by_status[s] != 0 )
+        {
+            printf( "  %-17s: %u\n", status_names[s], by_status[s] );
+        }
+    }
+    printf( "hand-overs held    : %u by the modem busy, %u by the duty cycle\n", stats.modem_busy,
+            stats.duty_cycle_holds );
+    printf( "server             : %u ticket uplinks (%u out of order), %u send() uplinks, %u send() refused\n",
+            ticket_frames, server_reordered, direct_frames, direct_refused );
+    print_latency( "request to TX", &stats.to_tx );
+    print_latency( "request to done", &stats.to_done );
+
+    bool passed = ( stats.submitted > 0 ) && ( stats.pending == 0 ) && ( lost_reads == 0 ) &&
+                  ( completions == stats.submitted ) &&
+                  ( completed_total == completions ) && ( out_of_order == 0 ) && ( server_reordered == 0 ) &&
+                  ( stats.to_tx.count == transmitted ) && ( ticket_frames <= transmitted );
+    if( network_config.uplink_loss_percent == 0 )
+    {
+        passed &= ( ticket_frames == transmitted );
+    }
+    printf( "\n%s\n", ( passed == true ) ? "PASS" : "FAIL" );
+    return ( passed == true ) ? 0 : 1;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
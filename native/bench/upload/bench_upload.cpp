@@ -0,0 +1,331 @@
+/*!
+ * \file      bench_upload.cpp
+ *
+ * \brief     Large payload upload benchmark: encoder / decoder round trip, then a blob sent over the simulated network
+ *
+ * First the round trip of the coding alone: many times, the frames of a blob are built with lbm_upload_encode(),
+ * each one lost with the given probability, and the others pushed into lbm_upload_decoder_push(). It prints,
+ * for several loss rates, how often the fragments plus the coded fragments of the settings rebuild the blob,
+ * and how many frames beyond the fragments the decoder needed.
+ *
+ * Then the device joins and sends one blob with LoRaWANClass::upload(); the simulated application server feeds
+ * the frames it receives to a decoder. It prints the progress events, the time on air, the elapsed time and the
+ * goodput.
+ *
+ * The bench fails if a decoder ever rebuilds a blob that differs from the original, if the round trip without
+ * loss does not always complete, if the upload does not end with every frame transmitted or, without uplink
+ * loss, if the server cannot rebuild the blob.
+ *
+ * Usage: program [-b bytes] [-f fragment_size] [-r redundancy_%] [-i interval_ms] [-u uplink_loss_%] [-t trials]
+ *                [-s seed] [-v]
+ *   -b  blob size in bytes (default 4096)
+ *   -f  blob bytes per frame, 0 for what the data rate allows (default 0; 45 fits DR0 in EU868)
+ *   -r  coded fragments in percent of the fragments (default 25)
+ *   -i  least time between two frames in ms (default 0)
+ *   -u  percentage of uplinks lost between the device and the gateway (default 0)
+ *   -t  round trips per loss rate (default 1000)
+ *   -s  seed of the blob, of the losses, of the modem random generator and of the network (default 1)
+ *   -v  print the modem traces
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "bench_join.h"
+#include "lbm_api.h"
+
+extern "C" {
+#include "sim_clock.h"
+#include "sim_network.h"
+#include "smtc_hal_dbg_trace.h"
+#include "smtc_modem_hal_native.h"
+}
+
+#define MAX_BLOB ( 16 * 1024 )
+
+// Longest simulated upload
+#define TIMEOUT_S ( 2 * 86400 )
+
+// Fragment size of the round trip when -f leaves it to the data rate: DR5 in EU868
+#define ROUND_TRIP_FRAGMENT_SIZE ( 242 - LBM_UPLOAD_HEADER_SIZE )
+
+static const uint8_t loss_rates[] = { 0, 5, 10, 20, 30 };
+
+static const char* status_names[] = { "not started", "sending", "done", "failed", "aborted" };
+
+static uint8_t blob[MAX_BLOB];
+static uint8_t decoder_memory[LBM_UPLOAD_DECODER_MEMORY( LBM_UPLOAD_MAX_FRAGMENTS, 255 )];
+
+// Device side
+static bool                  ended = false;
+static lbm_upload_progress_t last_progress;
+static uint32_t              progress_events = 0;
+static bool                  verbose         = false;
+
+// Server side
+static lbm_upload_decoder_t server_decoder;
+static uint8_t              upload_port            = LBM_UPLOAD_DEFAULT_PORT;
+static uint32_t             server_frames          = 0;
+static uint32_t             server_complete_frames = 0;  // frames received when the blob was rebuilt
+
+static void print_usage( const char* name )
+{
+    fprintf( stderr,
+             "usage: %s [-b bytes] [-f fragment_size] [-r redundancy_%%] [-i interval_ms] [-u uplink_loss_%%] "
+             "[-t trials] [-s seed] [-v]\n",
+             name );
+}
+
+static bool read_blob( uint32_t offset, uint8_t* buffer, uint16_t size, void* context )
+{
+    ( void ) context;
+    memcpy( buffer, &blob[offset], size );
+    return true;
+}
+
+/**
+ * @brief One round trip, false if the decoder rebuilt a wrong blob
+ *
+ * @param [out] complete Rebuilt from the frames kept
+ * @param [out] needed   Frames pushed until the completion
+ */
+static bool round_trip( uint32_t size, uint8_t fragment_size, uint16_t frames, uint8_t loss_percent, bool* complete,
+                        uint32_t* needed )
+{
+    lbm_upload_decoder_t decoder;
+    lbm_upload_decoder_init( &decoder, decoder_memory, sizeof( decoder_memory ) );
+    *complete = false;
+    *needed   = 0;
+
+    uint8_t frame[LBM_UPLOAD_HEADER_SIZE + 255];
+    for( uint16_t index = 0; ( index < frames ) && ( *complete == false ); index++ )
+    {
+        const uint16_t length = lbm_upload_encode( 0x5A, size, fragment_size, index, read_blob, NULL, frame );
+        if( ( ( uint32_t ) rand( ) % 100 ) < loss_percent )
+        {
+            continue;
+        }
+        ( *needed )++;
+        *complete = ( lbm_upload_decoder_push( &decoder, frame, length ) == LBM_UPLOAD_DECODER_COMPLETE );
+    }
+    if( *complete == false )
+    {
+        return true;
+    }
+    uint32_t       rebuilt_size = 0;
+    const uint8_t* rebuilt      = lbm_upload_decoder_get_data( &decoder, &rebuilt_size );
+    return ( rebuilt_size == size ) && ( memcmp( rebuilt, blob, size ) == 0 );
+}
+
+static void on_upload( lbm_upload_event_t event, const lbm_upload_progress_t* progress, void* context )
+{
+    ( void ) context;
+    last_progress = *progress;
+    if( event == LBM_UPLOAD_EVENT_DONE )
+    {
+        ended = true;
+        return;
+    }
+    progress_events++;
+    if( verbose == true )
+    {
+        printf( "progress           : %u / %u frames, %u ms on air, %u ms, %.1f bps\n", progress->transmitted,
+                progress->fragments + progress->redundancy, progress->airtime_ms, progress->elapsed_ms,
+                ( double ) progress->goodput_bps );
+    }
+}
+
+static void on_uplink( uint8_t fport, const uint8_t* payload, uint8_t size, uint32_t time_on_air_us )
+{
+    ( void ) time_on_air_us;
+    if( fport != upload_port )
+    {
+        return;
+    }
+    server_frames++;
+    if( lbm_upload_decoder_push( &server_decoder, payload, size ) == LBM_UPLOAD_DECODER_COMPLETE )
+    {
+        server_complete_frames = server_frames;
+    }
+}
+
+int main( int argc, char** argv )
+{
+    uint32_t size               = 4096;
+    uint32_t fragment_size      = 0;
+    uint32_t redundancy_percent = LBM_UPLOAD_DEFAULT_REDUNDANCY_PERCENT;
+    uint32_t interval_ms        = 0;
+    uint32_t trials             = 1000;
+    uint32_t seed               = 1;
+
+    sim_network_config_t network_config;
+    sim_network_get_default_config( &network_config );
+
+    int opt;
+    while( ( opt = getopt( argc, argv, "b:f:r:i:u:t:s:v" ) ) != -1 )
+    {
+        switch( opt )
+        {
+        case 'b':
+            size = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'f':
+            fragment_size = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'r':
+            redundancy_percent = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'i':
+            interval_ms = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'u':
+            network_config.uplink_loss_percent = ( uint8_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 't':
+            trials = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 's':
+            seed = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'v':
+            verbose = true;
+            break;
+        default:
+            print_usage( argv[0] );
+            return 1;
+        }
+    }
+    if( ( size == 0 ) || ( size > MAX_BLOB ) || ( fragment_size > 255 - LBM_UPLOAD_HEADER_SIZE ) ||
+        ( redundancy_percent > 255 ) || ( trials == 0 ) )
+    {
+        print_usage( argv[0] );
+        return 1;
+    }
+
+    srand( seed );
+    for( uint32_t i = 0; i < size; i++ )
+    {
+        blob[i] = ( uint8_t ) rand( );
+    }
+
+    // Round trip of the coding alone
+    const uint8_t  trip_fragment_size = ( fragment_size != 0 ) ? ( uint8_t ) fragment_size : ROUND_TRIP_FRAGMENT_SIZE;
+    const uint16_t fragments          = lbm_upload_fragments( size, trip_fragment_size );
+    if( fragments == 0 )
+    {
+        fprintf( stderr, "more than %u fragments\n", LBM_UPLOAD_MAX_FRAGMENTS );
+        return 1;
+    }
+    const uint16_t redundancy = ( uint16_t ) ( ( ( uint32_t ) fragments * redundancy_percent + 99 ) / 100 );
+
+    printf( "\n===== upload benchmark =====\n" );
+    printf( "round trip         : %u bytes, %u fragments of %u bytes + %u coded, %u trials per loss rate\n", size,
+            fragments, trip_fragment_size, redundancy, trials );
+    bool passed = true;
+    for( uint8_t l = 0; l < sizeof( loss_rates ); l++ )
+    {
+        uint32_t decoded = 0;
+        uint32_t wrong   = 0;
+        uint64_t extra   = 0;
+        for( uint32_t t = 0; t < trials; t++ )
+        {
+            bool     complete = false;
+            uint32_t needed   = 0;
+            if( round_trip( size, trip_fragment_size, fragments + redundancy, loss_rates[l], &complete, &needed ) ==
+                false )
+            {
+                wrong++;
+            }
+            if( complete == true )
+            {
+                decoded++;
+                extra += needed - fragments;
+            }
+        }
+        printf( "  %2u %% loss        : %5.1f %% rebuilt, %.2f frames beyond the fragments, %u wrong\n",
+                loss_rates[l], 100.0 * decoded / trials, ( decoded > 0 ) ? ( double ) extra / decoded : 0.0, wrong );
+        passed &= ( wrong == 0 );
+        if( loss_rates[l] == 0 )
+        {
+            passed &= ( decoded == trials );
+        }
+    }
+
+    // One upload over the simulated network
+    network_config.seed = seed;
+    hal_trace_set_quiet( !verbose );
+    sim_clock_reset( );
+    smtc_modem_hal_native_set_seed( seed );
+    sim_network_configure( &network_config );
+    sim_network_set_uplink_handler( on_uplink );
+    lbm_upload_decoder_init( &server_decoder, decoder_memory, sizeof( decoder_memory ) );
+
+    lbm.init( );
+    bench_join_start( lbm, NULL );
+
+    lbm_upload_params_t params;
+    LoRaWANClass::getDefaultUploadParams( &params );
+    params.fragment_size      = ( uint8_t ) fragment_size;
+    params.redundancy_percent = ( uint8_t ) redundancy_percent;
+    params.min_interval_ms    = interval_ms;
+    upload_port               = params.port;
+
+    const uint64_t end_us  = ( uint64_t ) TIMEOUT_S * 1000000ULL;
+    bool           started = false;
+    while( ( ended == false ) && ( sim_clock_now_us( ) < end_us ) )
+    {
+        lbm.runEngineUntilEvent( 1000 );
+        if( ( started == false ) && ( bench_joined( ) == true ) )
+        {
+            started = true;
+            if( lbm.lorawan.upload( blob, size, &params, on_upload, NULL ) != SMTC_MODEM_RC_OK )
+            {
+                fprintf( stderr, "upload refused\n" );
+                return 1;
+            }
+        }
+    }
+    if( ended == false )
+    {
+        lbm.lorawan.getUploadProgress( &last_progress );
+    }
+
+    uint32_t       rebuilt_size = 0;
+    const uint8_t* rebuilt      = lbm_upload_decoder_get_data( &server_decoder, &rebuilt_size );
+    const bool     identical    = ( rebuilt != NULL ) && ( rebuilt_size == size ) && ( memcmp( rebuilt, blob, size ) == 0 );
+    const uint16_t frames       = last_progress.fragments + last_progress.redundancy;
+
+    printf( "upload             : %s, %u fragments of %u bytes + %u coded, %u uplink loss %%\n",
+            status_names[last_progress.status], last_progress.fragments, last_progress.fragment_size,
+            last_progress.redundancy, network_config.uplink_loss_percent );
+    printf( "frames             : %u / %u transmitted, %u queued again, %u progress events\n",
+            last_progress.transmitted, frames, last_progress.requeued, progress_events );
+    printf( "time               : %.1f s, %.1f s on air (%.2f %%)\n", last_progress.elapsed_ms / 1000.0,
+            last_progress.airtime_ms / 1000.0,
+            ( last_progress.elapsed_ms > 0 ) ? 100.0 * last_progress.airtime_ms / last_progress.elapsed_ms : 0.0 );
+    printf( "goodput            : %.1f bps\n", ( double ) last_progress.goodput_bps );
+    if( rebuilt != NULL )
+    {
+        printf( "server             : %u frames received, blob %s after %u\n", server_frames,
+                ( identical == true ) ? "rebuilt" : "WRONG", server_complete_frames );
+    }
+    else
+    {
+        printf( "server             : %u frames received, %u independent, blob not rebuilt\n", server_frames,
+                server_decoder.rank );
+    }
+
+    passed &= ( last_progress.status == LBM_UPLOAD_DONE ) && ( last_progress.transmitted == frames ) &&
+              ( ( rebuilt == NULL ) || ( identical == true ) );
+    if( network_config.uplink_loss_percent == 0 )
+    {
+        passed &= ( identical == true ) && ( server_complete_frames == last_progress.fragments );
+    }
+    printf( "\n%s\n", ( passed == true ) ? "PASS" : "FAIL" );
+    return ( passed == true ) ? 0 : 1;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,246 @@
+/*!
+ * \file      main_native.cpp
+ *
+ * \brief     Entry point of the host-native build: runs the sketch of src/main.cpp against the simulated radio
+ *
+ * The sketch runs unmodified on a virtual clock, so hours of LoRaWAN traffic (join, RX windows, duty-cycle
+ * back-off) play out in a fraction of a second of host time. A summary of the radio, network and flash
+ * activity is printed when the simulated duration has elapsed.
+ *
+ * Usage: program [-d seconds] [-s seed] [-n nvm_file] [-u uplink_loss_%] [-l downlink_loss_%] [-x] [-q] [-L log_file]
+ *   -d  simulated duration in seconds (default 3600)
+ *   -s  seed of the modem random generator and of the network loss pattern (default 1)
+ *   -n  file backing the modem contexts, reused by the next run (default: RAM only); the network server keeps
+ *       its session in <file>.net, so a sketch built with -D USE_WARM_START=1 resumes it in the next run
+ *   -u  percentage of uplinks lost between the device and the gateway
+ *   -l  percentage of downlinks lost between the gateway and the device
+ *   -x  the network never answers the Join-Request
+ *   -q  quiet: only print the summary
+ *   -L  file receiving the binary log records, for tools/lbm_log_decode.py --lp64 (build with -D LBM_LOG_DEFERRED=1)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "lbm_engine.h"
+#include "lbm_sleep.h"
+#include "lbm_event_ring.h"
+#include "lbm_dl_pool.h"
+#include "lbm_aggregator.h"
+#include "lbm_log.h"
+#include "lbm_profile.h"
+#include "lbm_nvm.h"
+#include "lbm_session.h"
+
+extern "C" {
+#include "sim_clock.h"
+#include "sim_radio.h"
+#include "sim_network.h"
+#include "smtc_hal_dbg_trace.h"
+#include "smtc_modem_hal_native.h"
+}
+
+static const char* const radio_mode_names[SIM_RADIO_MODE_NB] = { "sleep", "standby", "fs", "tx", "rx", "cad" };
+
+static void print_usage( const char* name )
+{
+    fprintf( stderr,
+             "usage: %s [-d seconds] [-s seed] [-n nvm_file] [-u uplink_loss_%%] [-l downlink_loss_%%] [-x] [-q] "
+             "[-L log_file]\n",
+             name );
+}
+
+static FILE* log_file = NULL;
+
+static void write_log( const uint8_t* data, uint32_t size )
+{
+    fwrite( data, 1, size, log_file );
+}
+
+static void print_report( void )
+{
+    sim_radio_stats_t   radio;
+    sim_network_stats_t network;
+    lbm_engine_stats_t  engine;
+    lbm_sleep_stats_t   sleep;
+    lbm_event_ring_stats_t events;
+    lbm_dl_pool_stats_t    downlinks;
+    lbm_aggregator_stats_t aggregation;
+    lbm_log_stats_t        log;
+    lbm_profile_stats_t    profile;
+    lbm_nvm_stats_t        nvm;
+    lbm_session_stats_t    session;
+    sim_radio_get_stats( &radio );
+    sim_network_get_stats( &network );
+    lbm_engine_get_stats( &engine );
+    lbm_sleep_get_stats( &sleep );
+    lbm_event_ring_get_stats( &events );
+    lbm_dl_pool_get_stats( &downlinks );
+    lbm_aggregator_get_stats( &aggregation );
+    lbm_log_get_stats( &log );
+    lbm_profile_get_stats( &profile );
+    lbm_nvm_get_stats( &nvm );
+    lbm_session_get_stats( &session );
+
+    uint64_t virtual_us = sim_clock_now_us( );
+    uint64_t host_us    = sim_clock_host_elapsed_us( );
+
+    printf( "\n===== native simulation report =====\n" );
+    printf( "virtual time       : %.3f s\n", ( double ) virtual_us / 1e6 );
+    printf( "host time          : %.3f s (x%.0f)\n", ( double ) host_us / 1e6,
+            ( host_us > 0 ) ? ( double ) virtual_us / ( double ) host_us : 0.0 );
+    printf( "engine wakeups     : %u (%.2f/s, %u on notify, %u on timeout)\n", engine.wakeups,
+            ( double ) engine.wakeups_per_s, engine.wakeups_on_notify, engine.wakeups_on_timeout );
+    printf( "engine idle        : %.1f %%\n", ( double ) engine.idle_percent );
+    printf( "light sleep        : %.1f %% residency (%u sleeps, %u on timer, %u on dio1)\n",
+            ( double ) sleep.residency_percent, sleep.light_sleeps, sleep.wakeups_on_timer, sleep.wakeups_on_dio1 );
+    printf( "event queue        : %u queued, %u read, %u overflows (%u downlinks), high watermark %u\n",
+            events.pushed, events.popped, events.overflows, events.downlink_overflows, events.high_watermark );
+    printf( "downlink pool      : %u read, %u released, %u in use (peak %u/%u), %u exhausted\n", downlinks.acquired,
+            downlinks.released, downlinks.in_use, downlinks.peak_in_use, downlinks.capacity, downlinks.exhausted );
+    printf( "radio tx           : %u\n", radio.tx_count );
+    printf( "radio rx windows   : %u (%u frames, %u timeouts)\n", radio.rx_count, radio.rx_done_count,
+            radio.rx_timeout_count );
+    printf( "radio cad          : %u\n", radio.cad_count );
+    printf( "spi transfers      : %u\n", radio.spi_transfers );
+    for( int mode = 0; mode < SIM_RADIO_MODE_NB; mode++ )
+    {
+        printf( "time in %-10s : %.3f s\n", radio_mode_names[mode], ( double ) radio.time_in_mode_us[mode] / 1e6 );
+    }
+    printf( "join requests      : %u (%u accepted", network.join_requests, network.join_accepts );
+    if( network.join_accepts > 0 )
+    {
+        printf( ", first at %.3f s", ( double ) network.first_join_accept_ms / 1e3 );
+    }
+    printf( ")\n" );
+    static const char* const session_results[] = { "disabled", "none saved", "damaged", "expired",
+                                                    "mismatch", "valid", "resumed" };
+    printf( "boot               : %s start (saved session %s), joined at %.3f s, first uplink at %.3f s\n",
+            ( session.result == LBM_SESSION_RESUMED ) ? "warm" : "cold", session_results[session.result],
+            session.time_to_join_ms / 1e3, session.time_to_first_uplink_ms / 1e3 );
+    printf( "uplinks            : %u (%u confirmed, %u lost, last fcnt %u)\n", network.uplinks,
+            network.confirmed_uplinks, network.uplinks_lost, network.last_fcnt_up );
+    printf( "downlinks          : %u (%u lost)\n", network.downlinks, network.downlinks_lost );
+    printf( "uplink payload     : %u bytes in %.3f s on air (%.1f bytes per airtime second)\n",
+            network.uplink_payload_bytes, ( double ) network.uplink_time_on_air_us / 1e6,
+            ( network.uplink_time_on_air_us > 0 )
+                ? ( double ) network.uplink_payload_bytes * 1e6 / ( double ) network.uplink_time_on_air_us
+                : 0.0 );
+    printf( "aggregated records : %u queued, %u sent in %u frames, %u late\n", aggregation.records_queued,
+            aggregation.records_sent, aggregation.frames_sent, aggregation.records_late );
+    printf( "nvm writes         : %u (%u bytes)\n", smtc_modem_hal_native_get_nvm_write_count( ),
+            smtc_modem_hal_native_get_nvm_write_bytes( ) );
+    printf( "context store      : %u stores (%u unchanged), %u records, %u snapshots\n", nvm.stores,
+            nvm.stores_unchanged, nvm.journal_records, nvm.snapshots );
+    printf( "context flash      : %u programs, %u erases (%.2f per tx), longest write %.3f ms\n", nvm.flash_programs,
+            nvm.flash_erases,
+            ( nvm.transmissions > 0 ) ? ( double ) ( nvm.flash_programs + nvm.flash_erases ) / nvm.transmissions : 0.0,
+            nvm.max_write_us / 1000.0 );
+    printf( "log records        : %u (%u dropped, %u bytes drained, ring high watermark %u/%u)\n", log.records,
+            log.dropped, log.bytes_drained, log.high_watermark, LBM_LOG_BUFFER_SIZE );
+    if( profile.enabled == true )
+    {
+        // Host time, not target cycles: only the relative weight of the stages carries over
+        printf( "profile (us)       : %-13s %8s %9s %9s %9s %10s\n", "stage", "calls", "min", "avg", "max",
+                "total" );
+        for( int stage = 0; stage < LBM_PROFILE_STAGE_COUNT; stage++ )
+        {
+            const lbm_profile_stage_stats_t* s     = &profile.stages[stage];
+            const double                     scale = 1.0 / profile.cycles_per_us;
+            printf( "                     %-13s %8u %9.1f %9.1f %9.1f %10.0f\n",
+                    lbm_profile_stage_name( ( lbm_profile_stage_t ) stage ), s->calls, s->min_cycles * scale,
+                    s->avg_cycles * scale, s->max_cycles * scale, ( double ) s->total_cycles * scale );
+        }
+    }
+}
+
+int main( int argc, char** argv )
+{
+    uint32_t    duration_s = 3600;
+    uint32_t    seed       = 1;
+    const char* nvm_file   = NULL;
+    bool        quiet      = false;
+
+    sim_network_config_t network_config;
+    sim_network_get_default_config( &network_config );
+
+    int opt;
+    while( ( opt = getopt( argc, argv, "d:s:n:u:l:xqL:" ) ) != -1 )
+    {
+        switch( opt )
+        {
+        case 'd':
+            duration_s = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 's':
+            seed = ( uint32_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'n':
+            nvm_file = optarg;
+            break;
+        case 'u':
+            network_config.uplink_loss_percent = ( uint8_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'l':
+            network_config.downlink_loss_percent = ( uint8_t ) strtoul( optarg, NULL, 0 );
+            break;
+        case 'x':
+            network_config.answer_join = false;
+            break;
+        case 'q':
+            quiet = true;
+            break;
+        case 'L':
+            log_file = fopen( optarg, "wb" );
+            if( log_file == NULL )
+            {
+                perror( optarg );
+                return 1;
+            }
+            lbm_log_set_sink( write_log );
+            break;
+        default:
+            print_usage( argv[0] );
+            return 1;
+        }
+    }
+
+    // A device restored from a persistent flash remembers the last JoinNonce it accepted, the server must issue
+    // a larger one on every run
+    if( nvm_file != NULL )
+    {
+        network_config.join_nonce = ( uint32_t ) time( NULL ) & 0x00FFFFFF;
+    }
+    network_config.seed = seed;
+
+    hal_trace_set_quiet( quiet );
+    sim_clock_reset( );
+    smtc_modem_hal_native_set_seed( seed );
+    smtc_modem_hal_native_set_nvm_file( nvm_file );
+    sim_network_configure( &network_config );
+    static char network_file[256];
+    if( nvm_file != NULL )
+    {
+        snprintf( network_file, sizeof( network_file ), "%s.net", nvm_file );
+        sim_network_set_session_file( network_file );
+    }
+
+    setup( );
+    const uint64_t end_us = ( uint64_t ) duration_s * 1000000ULL;
+    while( sim_clock_now_us( ) < end_us )
+    {
+        loop( );
+        // Stands in for the drain task of the target
+        lbm_log_drain( );
+    }
+
+    print_report( );
+    if( log_file != NULL )
+    {
+        fclose( log_file );
+    }
+    return 0;
+}
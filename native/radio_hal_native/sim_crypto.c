@@ -0,0 +1,274 @@
+/*!
+ * \file      sim_crypto.c
+ *
+ * \brief     Network-side LoRaWAN crypto used by the simulated network server
+ *
+ * Straightforward byte-oriented FIPS-197 AES, speed does not matter here.
+ */
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <string.h>
+
+#include "sim_crypto.h"
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE VARIABLES -------------------------------------------------------
+ */
+
+static const uint8_t sbox[256] = {
+    0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76, 0xca, 0x82, 0xc9,
+    0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0, 0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f,
+    0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15, 0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07,
+    0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75, 0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3,
+    0x29, 0xe3, 0x2f, 0x84, 0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58,
+    0xcf, 0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8, 0x51, 0xa3,
+    0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2, 0xcd, 0x0c, 0x13, 0xec, 0x5f,
+    0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73, 0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88,
+    0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb, 0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac,
+    0x62, 0x91, 0x95, 0xe4, 0x79, 0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a,
+    0xae, 0x08, 0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a, 0x70,
+    0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e, 0xe1, 0xf8, 0x98, 0x11,
+    0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf, 0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42,
+    0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16
+};
+
+static uint8_t inv_sbox[256];
+static int     inv_sbox_ready = 0;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DECLARATION -------------------------------------------
+ */
+
+static uint8_t xtime( uint8_t x );
+static uint8_t gmul( uint8_t a, uint8_t b );
+static void    expand_key( const uint8_t key[16], uint8_t round_keys[176] );
+static void    add_round_key( uint8_t state[16], const uint8_t* round_key );
+static void    shift_left_one_bit( const uint8_t in[16], uint8_t out[16] );
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS DEFINITION ---------------------------------------------
+ */
+
+void sim_crypto_aes_encrypt( const uint8_t key[16], const uint8_t in[16], uint8_t out[16] )
+{
+    uint8_t rk[176];
+    uint8_t s[16];
+    expand_key( key, rk );
+    memcpy( s, in, 16 );
+    add_round_key( s, rk );
+
+    for( int round = 1; round <= 10; round++ )
+    {
+        uint8_t t[16];
+        // SubBytes + ShiftRows
+        for( int c = 0; c < 4; c++ )
+        {
+            for( int r = 0; r < 4; r++ )
+            {
+                t[( c * 4 ) + r] = sbox[s[( ( ( c + r ) % 4 ) * 4 ) + r]];
+            }
+        }
+        // MixColumns (skipped on the last round)
+        if( round != 10 )
+        {
+            for( int c = 0; c < 4; c++ )
+            {
+                uint8_t* col = &t[c * 4];
+                uint8_t  a0 = col[0], a1 = col[1], a2 = col[2], a3 = col[3];
+                col[0] = xtime( a0 ) ^ ( xtime( a1 ) ^ a1 ) ^ a2 ^ a3;
+                col[1] = a0 ^ xtime( a1 ) ^ ( xtime( a2 ) ^ a2 ) ^ a3;
+                col[2] = a0 ^ a1 ^ xtime( a2 ) ^ ( xtime( a3 ) ^ a3 );
+                col[3] = ( xtime( a0 ) ^ a0 ) ^ a1 ^ a2 ^ xtime( a3 );
+            }
+        }
+        memcpy( s, t, 16 );
+        add_round_key( s, &rk[round * 16] );
+    }
+    memcpy( out, s, 16 );
+}
+
+void sim_crypto_aes_decrypt( const uint8_t key[16], const uint8_t in[16], uint8_t out[16] )
+{
+    uint8_t rk[176];
+    uint8_t s[16];
+
+    if( inv_sbox_ready == 0 )
+    {
+        for( int i = 0; i < 256; i++ )
+        {
+            inv_sbox[sbox[i]] = ( uint8_t ) i;
+        }
+        inv_sbox_ready = 1;
+    }
+
+    expand_key( key, rk );
+    memcpy( s, in, 16 );
+    add_round_key( s, &rk[160] );
+
+    for( int round = 9; round >= 0; round-- )
+    {
+        uint8_t t[16];
+        // InvShiftRows + InvSubBytes
+        for( int c = 0; c < 4; c++ )
+        {
+            for( int r = 0; r < 4; r++ )
+            {
+                t[( ( ( c + r ) % 4 ) * 4 ) + r] = inv_sbox[s[( c * 4 ) + r]];
+            }
+        }
+        add_round_key( t, &rk[round * 16] );
+        // InvMixColumns (skipped after the last round key)
+        if( round != 0 )
+        {
+            for( int c = 0; c < 4; c++ )
+            {
+                uint8_t* col = &t[c * 4];
+                uint8_t  a0 = col[0], a1 = col[1], a2 = col[2], a3 = col[3];
+                col[0] = gmul( a0, 14 ) ^ gmul( a1, 11 ) ^ gmul( a2, 13 ) ^ gmul( a3, 9 );
+                col[1] = gmul( a0, 9 ) ^ gmul( a1, 14 ) ^ gmul( a2, 11 ) ^ gmul( a3, 13 );
+                col[2] = gmul( a0, 13 ) ^ gmul( a1, 9 ) ^ gmul( a2, 14 ) ^ gmul( a3, 11 );
+                col[3] = gmul( a0, 11 ) ^ gmul( a1, 13 ) ^ gmul( a2, 9 ) ^ gmul( a3, 14 );
+            }
+        }
+        memcpy( s, t, 16 );
+    }
+    memcpy( out, s, 16 );
+}
+
+void sim_crypto_cmac( const uint8_t key[16], const uint8_t* data, size_t size, uint8_t mac[16] )
+{
+    uint8_t zero[16] = { 0 };
+    uint8_t l[16];
+    uint8_t k1[16];
+    uint8_t k2[16];
+
+    // Subkeys generation (RFC 4493 section 2.3)
+    sim_crypto_aes_encrypt( key, zero, l );
+    shift_left_one_bit( l, k1 );
+    if( ( l[0] & 0x80 ) != 0 )
+    {
+        k1[15] ^= 0x87;
+    }
+    shift_left_one_bit( k1, k2 );
+    if( ( k1[0] & 0x80 ) != 0 )
+    {
+        k2[15] ^= 0x87;
+    }
+
+    size_t n        = ( size + 15 ) / 16;
+    int    complete = ( size != 0 ) && ( ( size % 16 ) == 0 );
+    if( n == 0 )
+    {
+        n = 1;
+    }
+
+    uint8_t x[16] = { 0 };
+    uint8_t y[16];
+    for( size_t i = 0; i < ( n - 1 ); i++ )
+    {
+        for( int j = 0; j < 16; j++ )
+        {
+            y[j] = x[j] ^ data[( i * 16 ) + j];
+        }
+        sim_crypto_aes_encrypt( key, y, x );
+    }
+
+    uint8_t last[16] = { 0 };
+    size_t  rem      = size - ( ( n - 1 ) * 16 );
+    memcpy( last, &data[( n - 1 ) * 16], rem );
+    if( complete )
+    {
+        for( int j = 0; j < 16; j++ )
+        {
+            last[j] ^= k1[j];
+        }
+    }
+    else
+    {
+        last[rem] = 0x80;
+        for( int j = 0; j < 16; j++ )
+        {
+            last[j] ^= k2[j];
+        }
+    }
+    for( int j = 0; j < 16; j++ )
+    {
+        y[j] = x[j] ^ last[j];
+    }
+    sim_crypto_aes_encrypt( key, y, mac );
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DEFINITION --------------------------------------------
+ */
+
+static uint8_t xtime( uint8_t x )
+{
+    return ( uint8_t ) ( ( x << 1 ) ^ ( ( ( x >> 7 ) & 1 ) * 0x1b ) );
+}
+
+static uint8_t gmul( uint8_t a, uint8_t b )
+{
+    uint8_t p = 0;
+    while( b != 0 )
+    {
+        if( ( b & 1 ) != 0 )
+        {
+            p ^= a;
+        }
+        a = xtime( a );
+        b >>= 1;
+    }
+    return p;
+}
+
+static void expand_key( const uint8_t key[16], uint8_t rk[176] )
+{
+    uint8_t rcon = 0x01;
+    memcpy( rk, key, 16 );
+    for( int i = 16; i < 176; i += 4 )
+    {
+        uint8_t t[4] = { rk[i - 4], rk[i - 3], rk[i - 2], rk[i - 1] };
+        if( ( i % 16 ) == 0 )
+        {
+            uint8_t tmp = t[0];
+            t[0]        = sbox[t[1]] ^ rcon;
+            t[1]        = sbox[t[2]];
+            t[2]        = sbox[t[3]];
+            t[3]        = sbox[tmp];
+            rcon        = xtime( rcon );
+        }
+        for( int j = 0; j < 4; j++ )
+        {
+            rk[i + j] = rk[i - 16 + j] ^ t[j];
+        }
+    }
+}
+
+static void add_round_key( uint8_t state[16], const uint8_t* round_key )
+{
+    for( int i = 0; i < 16; i++ )
+    {
+        state[i] ^= round_key[i];
+    }
+}
+
+static void shift_left_one_bit( const uint8_t in[16], uint8_t out[16] )
+{
+    uint8_t overflow = 0;
+    for( int i = 15; i >= 0; i-- )
+    {
+        out[i]   = ( uint8_t ) ( ( in[i] << 1 ) | overflow );
+        overflow = ( in[i] & 0x80 ) ? 1 : 0;
+    }
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,48 @@
+/*!
+ * \file      sim_crypto.h
+ *
+ * \brief     Network-side LoRaWAN crypto used by the simulated network server
+ *
+ * Self-contained on purpose: the server needs the AES inverse cipher (Join-Accept is produced with
+ * aes_decrypt) which the device soft secure element does not build, and it must not share state with the
+ * implementation under test.
+ */
+
+#ifndef SIM_CRYPTO_H
+#define SIM_CRYPTO_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS PROTOTYPES --------------------------------------------
+ */
+
+/**
+ * @brief AES-128 single block encryption / decryption
+ */
+void sim_crypto_aes_encrypt( const uint8_t key[16], const uint8_t in[16], uint8_t out[16] );
+void sim_crypto_aes_decrypt( const uint8_t key[16], const uint8_t in[16], uint8_t out[16] );
+
+/**
+ * @brief AES-CMAC (RFC 4493) over a buffer
+ */
+void sim_crypto_cmac( const uint8_t key[16], const uint8_t* data, size_t size, uint8_t mac[16] );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SIM_CRYPTO_H
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,921 @@
+/*!
+ * \file      sim_network.c
+ *
+ * \brief     Minimal LoRaWAN 1.0.x network server answering the simulated device
+ */
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "sim_network.h"
+#include "sim_radio.h"
+#include "sim_crypto.h"
+#include "sim_clock.h"
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE CONSTANTS -------------------------------------------------------
+ */
+
+#define MTYPE_JOIN_REQUEST 0x00
+#define MTYPE_JOIN_ACCEPT 0x01
+#define MTYPE_UNCONFIRMED_UP 0x02
+#define MTYPE_UNCONFIRMED_DOWN 0x03
+#define MTYPE_CONFIRMED_UP 0x04
+#define MTYPE_CONFIRMED_DOWN 0x05
+
+#define JOIN_ACCEPT_DELAY1_US 5000000u
+#define JOIN_REQUEST_LENGTH 23
+#define FCTRL_ACK 0x20
+#define MIC_LENGTH 4
+#define FHDR_LENGTH 7
+#define DIR_UP 0x00
+#define DIR_DOWN 0x01
+#define FOPTS_MAX_LENGTH 15
+
+#define CID_DEVICE_TIME 0x0D
+#define CID_PING_SLOT_INFO 0x10
+
+// LoRaWAN class B timing
+#define BEACON_PERIOD_US 128000000ull
+#define BEACON_DELAY_US 1500u
+#define BEACON_RESERVED_US 2120000u
+#define PING_SLOT_US 30000u
+#define BEACON_LENGTH 17
+#define DEFAULT_PING_PERIODICITY 7
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE TYPES -----------------------------------------------------------
+ */
+
+typedef struct queued_downlink_s
+{
+    bool    used;
+    uint8_t fport;
+    bool    confirmed;
+    uint8_t size;
+    uint8_t payload[242];
+} queued_downlink_t;
+
+typedef struct session_s
+{
+    bool     joined;
+    uint32_t join_nonce;
+    uint8_t  nwk_s_key[16];
+    uint8_t  app_s_key[16];
+    uint32_t fcnt_down;
+    uint32_t fcnt_up;       //!< last uplink counter, 32 bits
+    bool     fcnt_up_seen;  //!< fcnt_up is valid
+} session_t;
+
+typedef struct multicast_group_s
+{
+    bool     set;
+    uint32_t address;  //!< McAddr
+    uint8_t  nwk_s_key[16];
+    uint8_t  app_s_key[16];
+    uint32_t fcnt_down;
+} multicast_group_t;
+
+typedef struct device_s
+{
+    bool      used;
+    uint8_t   dev_eui[8];  //!< device 0 answers any DevEUI not registered
+    uint8_t   nwk_key[16];
+    uint32_t  dev_addr;
+    session_t session;
+    uint8_t   ping_periodicity;  //!< of the last PingSlotInfoReq
+} device_t;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE VARIABLES -------------------------------------------------------
+ */
+
+static sim_network_config_t config;
+static bool                 config_set = false;
+static sim_network_stats_t  stats;
+static device_t             devices[SIM_NETWORK_MAX_DEVICES];  // 0: the one of the configuration
+static queued_downlink_t    queue[SIM_NETWORK_MAX_QUEUED_DOWNLINKS];
+static multicast_group_t    multicast;
+static uint32_t             loss_state;
+static bool                 beacons_on   = false;
+static int                  beacon_event = SIM_CLOCK_INVALID_HANDLE;
+
+static sim_network_uplink_handler_t uplink_handler = NULL;
+static sim_network_air_handler_t    air_handler    = NULL;
+
+static const char* session_file = NULL;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DECLARATION -------------------------------------------
+ */
+
+static void     on_device_tx( const uint8_t* payload, uint8_t size, const sim_radio_params_t* params, uint64_t tx_end_us );
+static int      find_device( const uint8_t* payload, uint8_t size );
+static void     handle_join_request( uint8_t index, const uint8_t* payload, const sim_radio_params_t* params,
+                                     uint64_t tx_end_us );
+static void     handle_data_uplink( uint8_t index, const uint8_t* payload, uint8_t size, bool confirmed,
+                                    const sim_radio_params_t* params, uint64_t tx_end_us );
+static void     send_downlink( uint8_t device, const uint8_t* frame, uint8_t size, const sim_radio_params_t* uplink_params,
+                               uint64_t at_us );
+static uint8_t  append_downlink_mic( const uint8_t key[16], uint32_t dev_addr, uint32_t fcnt, uint8_t* frame,
+                                     uint8_t size );
+static void     derive_session_key( const device_t* device, uint8_t type, uint16_t dev_nonce, uint8_t key[16] );
+static void     encrypt_frm_payload( uint32_t dev_addr, const uint8_t key[16], uint8_t dir, uint32_t fcnt,
+                                     uint8_t* data, uint8_t size );
+static uint8_t  answer_mac_commands( device_t* device, const uint8_t* commands, uint8_t size, uint64_t tx_end_us,
+                                     uint8_t* answers, uint8_t answers_size );
+static void     on_beacon_due( void* context );
+static uint64_t next_ping_slot_us( const device_t* device, uint64_t after_us );
+static uint16_t beacon_crc( const uint8_t* data, uint8_t size );
+static void     deliver_uplink_payload( uint8_t index, const uint8_t* payload, uint8_t size,
+                                        const sim_radio_params_t* params );
+static void     trace_air( uint8_t device, bool downlink, const sim_radio_params_t* params, uint8_t size,
+                           uint64_t start_us );
+static bool     draw_loss( uint8_t percent );
+static void     put_u32_le( uint8_t* buf, uint32_t value );
+static void     session_load( void );
+static void     session_save( void );
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS DEFINITION ---------------------------------------------
+ */
+
+void sim_network_get_default_config( sim_network_config_t* cfg )
+{
+    static const uint8_t default_key[16] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                                             0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01 };
+    memset( cfg, 0, sizeof( *cfg ) );
+    memcpy( cfg->nwk_key, default_key, sizeof( default_key ) );
+    cfg->dev_addr    = 0x260B1234;
+    cfg->net_id      = 0x000013;
+    cfg->join_nonce  = 1;
+    cfg->rx1_delay_s = 1;
+    cfg->answer_join = true;
+    cfg->rssi_dbm    = -80;
+    cfg->snr_db      = 8;
+    cfg->seed        = 1;
+}
+
+void sim_network_configure( const sim_network_config_t* cfg )
+{
+    config     = *cfg;
+    config_set = true;
+    loss_state = ( cfg->seed != 0 ) ? cfg->seed : 1;
+    devices[0].used = true;
+    memcpy( devices[0].nwk_key, cfg->nwk_key, sizeof( devices[0].nwk_key ) );
+    devices[0].dev_addr = cfg->dev_addr;
+}
+
+int sim_network_add_device( const uint8_t dev_eui[8], const uint8_t nwk_key[16], uint32_t dev_addr )
+{
+    for( int i = 1; i < SIM_NETWORK_MAX_DEVICES; i++ )
+    {
+        if( devices[i].used == false )
+        {
+            memset( &devices[i], 0, sizeof( devices[i] ) );
+            devices[i].used = true;
+            memcpy( devices[i].dev_eui, dev_eui, sizeof( devices[i].dev_eui ) );
+            memcpy( devices[i].nwk_key, nwk_key, sizeof( devices[i].nwk_key ) );
+            devices[i].dev_addr           = dev_addr;
+            devices[i].session.join_nonce = config.join_nonce;
+            return i;
+        }
+    }
+    return -1;
+}
+
+void sim_network_init( void )
+{
+    if( config_set == false )
+    {
+        sim_network_config_t cfg;
+        sim_network_get_default_config( &cfg );
+        sim_network_configure( &cfg );
+    }
+    memset( &stats, 0, sizeof( stats ) );
+    memset( queue, 0, sizeof( queue ) );
+    multicast.fcnt_down = 1;
+    beacons_on          = false;
+    beacon_event        = SIM_CLOCK_INVALID_HANDLE;
+    for( int i = 0; i < SIM_NETWORK_MAX_DEVICES; i++ )
+    {
+        memset( &devices[i].session, 0, sizeof( devices[i].session ) );
+        devices[i].session.join_nonce = config.join_nonce;
+        devices[i].ping_periodicity   = DEFAULT_PING_PERIODICITY;
+    }
+    session_load( );
+    sim_radio_set_tx_listener( on_device_tx );
+}
+
+void sim_network_set_session_file( const char* path )
+{
+    session_file = path;
+}
+
+void sim_network_set_multicast_group( uint32_t address, const uint8_t nwk_s_key[16], const uint8_t app_s_key[16] )
+{
+    multicast.set     = true;
+    multicast.address = address;
+    memcpy( multicast.nwk_s_key, nwk_s_key, 16 );
+    memcpy( multicast.app_s_key, app_s_key, 16 );
+    multicast.fcnt_down = 1;
+}
+
+bool sim_network_send_multicast( uint8_t fport, const uint8_t* payload, uint8_t size, uint32_t freq_hz, uint8_t sf,
+                                 uint64_t at_us )
+{
+    if( ( multicast.set == false ) || ( fport == 0 ) || ( size > ( 255 - 1 - FHDR_LENGTH - 1 - MIC_LENGTH ) ) )
+    {
+        return false;
+    }
+
+    // Unconfirmed, no FOpts, no ACK: MHDR | McAddr | FCtrl | FCnt | FPort | FRMPayload | MIC
+    uint8_t frame[256];
+    uint8_t len  = 0;
+    frame[len++] = ( uint8_t ) ( MTYPE_UNCONFIRMED_DOWN << 5 );
+    put_u32_le( &frame[len], multicast.address );
+    len += 4;
+    frame[len++] = 0x00;
+    frame[len++] = ( uint8_t ) multicast.fcnt_down;
+    frame[len++] = ( uint8_t ) ( multicast.fcnt_down >> 8 );
+    frame[len++] = fport;
+    memcpy( &frame[len], payload, size );
+    encrypt_frm_payload( multicast.address, multicast.app_s_key, DIR_DOWN, multicast.fcnt_down, &frame[len], size );
+    len += size;
+    len = append_downlink_mic( multicast.nwk_s_key, multicast.address, multicast.fcnt_down, frame, len );
+    multicast.fcnt_down++;
+
+    // The counter moves on for a lost frame too, as on a real gateway
+    if( draw_loss( config.downlink_loss_percent ) )
+    {
+        stats.multicast_lost++;
+        return true;
+    }
+
+    sim_radio_params_t params = { 0 };
+    params.packet_type        = SIM_RADIO_PACKET_TYPE_LORA;
+    params.freq_hz            = freq_hz;
+    params.sf                 = sf;
+    params.bw_hz              = 125000;
+    params.cr                 = 1;
+    params.preamble_len       = 8;
+    params.implicit_header    = false;
+    params.crc_on             = false;
+    params.iq_inverted        = true;
+    if( sim_radio_push_frame( frame, len, &params, at_us, config.rssi_dbm, config.snr_db ) == false )
+    {
+        return false;
+    }
+    stats.multicast_downlinks++;
+    return true;
+}
+
+void sim_network_start_beacons( void )
+{
+    beacons_on = true;
+    if( beacon_event == SIM_CLOCK_INVALID_HANDLE )
+    {
+        const uint64_t now_us = sim_clock_now_us( );
+        beacon_event = sim_clock_schedule_at_us( ( ( now_us / BEACON_PERIOD_US ) + 1 ) * BEACON_PERIOD_US,
+                                                 on_beacon_due, NULL );
+    }
+}
+
+void sim_network_stop_beacons( void )
+{
+    // The period timer keeps running to count the beacons the device goes without
+    beacons_on = false;
+}
+
+bool sim_network_send_ping_slot( uint8_t fport, const uint8_t* payload, uint8_t size, uint64_t* at_us )
+{
+    device_t*  device  = &devices[0];
+    session_t* session = &device->session;
+
+    if( ( session->joined == false ) || ( fport == 0 ) || ( size > ( 255 - 1 - FHDR_LENGTH - 1 - MIC_LENGTH ) ) )
+    {
+        return false;
+    }
+
+    // MHDR | DevAddr | FCtrl | FCnt | FPort | FRMPayload | MIC
+    uint8_t frame[256];
+    uint8_t len  = 0;
+    frame[len++] = ( uint8_t ) ( MTYPE_UNCONFIRMED_DOWN << 5 );
+    put_u32_le( &frame[len], device->dev_addr );
+    len += 4;
+    frame[len++] = 0x00;
+    frame[len++] = ( uint8_t ) session->fcnt_down;
+    frame[len++] = ( uint8_t ) ( session->fcnt_down >> 8 );
+    frame[len++] = fport;
+    memcpy( &frame[len], payload, size );
+    encrypt_frm_payload( device->dev_addr, session->app_s_key, DIR_DOWN, session->fcnt_down, &frame[len], size );
+    len += size;
+    len = append_downlink_mic( session->nwk_s_key, device->dev_addr, session->fcnt_down, frame, len );
+    session->fcnt_down++;
+    session_save( );
+
+    *at_us = next_ping_slot_us( device, sim_clock_now_us( ) );
+    if( draw_loss( config.downlink_loss_percent ) )
+    {
+        stats.ping_slot_lost++;
+        return true;
+    }
+
+    sim_radio_params_t params = { 0 };
+    params.packet_type        = SIM_RADIO_PACKET_TYPE_LORA;
+    params.freq_hz            = SIM_NETWORK_BEACON_FREQ_HZ;
+    params.sf                 = SIM_NETWORK_BEACON_SF;
+    params.bw_hz              = 125000;
+    params.cr                 = 1;
+    params.preamble_len       = 8;
+    params.implicit_header    = false;
+    params.crc_on             = false;
+    params.iq_inverted        = true;
+    if( sim_radio_push_frame( frame, len, &params, *at_us, config.rssi_dbm, config.snr_db ) == false )
+    {
+        return false;
+    }
+    stats.ping_slot_downlinks++;
+    stats.device_downlinks[0]++;
+    trace_air( 0, true, &params, len, *at_us );
+    return true;
+}
+
+bool sim_network_queue_downlink( uint8_t fport, const uint8_t* payload, uint8_t size, bool confirmed )
+{
+    if( ( fport == 0 ) || ( size > sizeof( queue[0].payload ) ) )
+    {
+        return false;
+    }
+    for( int i = 0; i < SIM_NETWORK_MAX_QUEUED_DOWNLINKS; i++ )
+    {
+        if( queue[i].used == false )
+        {
+            queue[i].used      = true;
+            queue[i].fport     = fport;
+            queue[i].confirmed = confirmed;
+            queue[i].size      = size;
+            memcpy( queue[i].payload, payload, size );
+            return true;
+        }
+    }
+    return false;
+}
+
+void sim_network_set_uplink_handler( sim_network_uplink_handler_t handler )
+{
+    uplink_handler = handler;
+}
+
+void sim_network_set_air_handler( sim_network_air_handler_t handler )
+{
+    air_handler = handler;
+}
+
+void sim_network_get_stats( sim_network_stats_t* out )
+{
+    *out = stats;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DEFINITION --------------------------------------------
+ */
+
+static void on_device_tx( const uint8_t* payload, uint8_t size, const sim_radio_params_t* params, uint64_t tx_end_us )
+{
+    if( ( params->packet_type != SIM_RADIO_PACKET_TYPE_LORA ) || ( params->iq_inverted == true ) || ( size < 1 ) )
+    {
+        return;  // not a LoRaWAN uplink
+    }
+    const int device = find_device( payload, size );
+    if( device >= 0 )
+    {
+        trace_air( ( uint8_t ) device, false, params, size, tx_end_us - sim_radio_get_time_on_air_us( params, size ) );
+    }
+    if( draw_loss( config.uplink_loss_percent ) )
+    {
+        stats.uplinks_lost++;
+        return;
+    }
+
+    switch( payload[0] >> 5 )
+    {
+    case MTYPE_JOIN_REQUEST:
+        if( size == JOIN_REQUEST_LENGTH )
+        {
+            handle_join_request( ( uint8_t ) device, payload, params, tx_end_us );
+        }
+        break;
+    case MTYPE_UNCONFIRMED_UP:
+    case MTYPE_CONFIRMED_UP:
+        if( ( size >= ( 8 + MIC_LENGTH ) ) && ( device >= 0 ) )
+        {
+            handle_data_uplink( ( uint8_t ) device, payload, size, ( payload[0] >> 5 ) == MTYPE_CONFIRMED_UP, params,
+                                tx_end_us );
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static int find_device( const uint8_t* payload, uint8_t size )
+{
+    const uint8_t mtype = payload[0] >> 5;
+    if( ( mtype == MTYPE_JOIN_REQUEST ) && ( size == JOIN_REQUEST_LENGTH ) )
+    {
+        // DevEUI is sent little endian
+        for( int i = 1; i < SIM_NETWORK_MAX_DEVICES; i++ )
+        {
+            bool match = devices[i].used;
+            for( int j = 0; ( j < 8 ) && ( match == true ); j++ )
+            {
+                match = ( payload[9 + j] == devices[i].dev_eui[7 - j] );
+            }
+            if( match == true )
+            {
+                return i;
+            }
+        }
+        return 0;
+    }
+    if( ( ( mtype == MTYPE_UNCONFIRMED_UP ) || ( mtype == MTYPE_CONFIRMED_UP ) ) && ( size >= 5 ) )
+    {
+        const uint32_t dev_addr = ( uint32_t ) payload[1] | ( ( uint32_t ) payload[2] << 8 ) |
+                                  ( ( uint32_t ) payload[3] << 16 ) | ( ( uint32_t ) payload[4] << 24 );
+        for( int i = 0; i < SIM_NETWORK_MAX_DEVICES; i++ )
+        {
+            if( ( devices[i].used == true ) && ( devices[i].session.joined == true ) &&
+                ( devices[i].dev_addr == dev_addr ) )
+            {
+                return i;
+            }
+        }
+    }
+    return -1;
+}
+
+static void handle_join_request( uint8_t index, const uint8_t* payload, const sim_radio_params_t* params,
+                                 uint64_t tx_end_us )
+{
+    device_t*  device  = &devices[index];
+    session_t* session = &device->session;
+
+    stats.join_requests++;
+    if( config.answer_join == false )
+    {
+        return;
+    }
+
+    const uint16_t dev_nonce = ( uint16_t ) payload[17] | ( ( uint16_t ) payload[18] << 8 );
+
+    // MHDR | JoinNonce | NetID | DevAddr | DLSettings | RxDelay | MIC
+    uint8_t frame[17];
+    frame[0] = MTYPE_JOIN_ACCEPT << 5;
+    frame[1] = ( uint8_t ) session->join_nonce;
+    frame[2] = ( uint8_t ) ( session->join_nonce >> 8 );
+    frame[3] = ( uint8_t ) ( session->join_nonce >> 16 );
+    frame[4] = ( uint8_t ) config.net_id;
+    frame[5] = ( uint8_t ) ( config.net_id >> 8 );
+    frame[6] = ( uint8_t ) ( config.net_id >> 16 );
+    put_u32_le( &frame[7], device->dev_addr );
+    frame[11] = 0x00;  // RX1DROffset 0, RX2 DR0
+    frame[12] = config.rx1_delay_s;
+
+    uint8_t mic[16];
+    sim_crypto_cmac( device->nwk_key, frame, 13, mic );
+    memcpy( &frame[13], mic, MIC_LENGTH );
+
+    // The device runs aes_encrypt on the received block: the server has to use the inverse cipher
+    uint8_t block[16];
+    sim_crypto_aes_decrypt( device->nwk_key, &frame[1], block );
+    memcpy( &frame[1], block, 16 );
+
+    derive_session_key( device, 0x01, dev_nonce, session->nwk_s_key );
+    derive_session_key( device, 0x02, dev_nonce, session->app_s_key );
+    session->joined       = true;
+    session->fcnt_down    = 0;
+    session->fcnt_up      = 0;
+    session->fcnt_up_seen = false;
+    session->join_nonce++;
+    session_save( );
+
+    stats.join_accepts++;
+    stats.device_join_accepts[index]++;
+    if( stats.first_join_accept_ms == 0 )
+    {
+        stats.first_join_accept_ms = ( uint32_t ) ( ( tx_end_us + JOIN_ACCEPT_DELAY1_US ) / 1000u );
+    }
+    send_downlink( index, frame, sizeof( frame ), params, tx_end_us + JOIN_ACCEPT_DELAY1_US );
+}
+
+static void handle_data_uplink( uint8_t index, const uint8_t* payload, uint8_t size, bool confirmed,
+                                const sim_radio_params_t* params, uint64_t tx_end_us )
+{
+    device_t*  device  = &devices[index];
+    session_t* session = &device->session;
+
+    stats.uplinks++;
+    stats.device_uplinks[index]++;
+    stats.last_fcnt_up = ( uint32_t ) payload[6] | ( ( uint32_t ) payload[7] << 8 );
+    if( confirmed )
+    {
+        stats.confirmed_uplinks++;
+    }
+    deliver_uplink_payload( index, payload, size, params );
+    session_save( );
+
+    // MAC commands in FOpts, or in the FRMPayload of port 0 (encrypted with the NwkSKey)
+    uint8_t       answers[FOPTS_MAX_LENGTH];
+    uint8_t       answers_len = 0;
+    const uint8_t fopts_len   = payload[5] & 0x0F;
+    const uint8_t port_index  = 1 + FHDR_LENGTH + fopts_len;
+    answers_len = answer_mac_commands( device, &payload[1 + FHDR_LENGTH], fopts_len, tx_end_us, answers,
+                                       sizeof( answers ) );
+    if( ( size > ( port_index + 1 + MIC_LENGTH ) ) && ( payload[port_index] == 0 ) )
+    {
+        uint8_t       commands[256];
+        const uint8_t commands_len = ( uint8_t ) ( size - port_index - 1 - MIC_LENGTH );
+        memcpy( commands, &payload[port_index + 1], commands_len );
+        encrypt_frm_payload( device->dev_addr, session->nwk_s_key, DIR_UP, session->fcnt_up, commands, commands_len );
+        answers_len += answer_mac_commands( device, commands, commands_len, tx_end_us, &answers[answers_len],
+                                            ( uint8_t ) ( sizeof( answers ) - answers_len ) );
+    }
+
+    // Application downlinks are queued for the device of the configuration
+    queued_downlink_t* app = NULL;
+    for( int i = 0; ( i < SIM_NETWORK_MAX_QUEUED_DOWNLINKS ) && ( index == 0 ); i++ )
+    {
+        if( queue[i].used == true )
+        {
+            app = &queue[i];
+            break;
+        }
+    }
+    if( ( confirmed == false ) && ( app == NULL ) && ( answers_len == 0 ) )
+    {
+        return;  // nothing to say in RX1
+    }
+
+    uint8_t frame[256];
+    uint8_t len = 0;
+    frame[len++] =
+        ( uint8_t ) ( ( ( ( app != NULL ) && app->confirmed ) ? MTYPE_CONFIRMED_DOWN : MTYPE_UNCONFIRMED_DOWN ) << 5 );
+    put_u32_le( &frame[len], device->dev_addr );
+    len += 4;
+    frame[len++] = ( uint8_t ) ( ( confirmed ? FCTRL_ACK : 0x00 ) | answers_len );
+    frame[len++] = ( uint8_t ) session->fcnt_down;
+    frame[len++] = ( uint8_t ) ( session->fcnt_down >> 8 );
+    memcpy( &frame[len], answers, answers_len );
+    len += answers_len;
+    if( app != NULL )
+    {
+        frame[len++] = app->fport;
+        memcpy( &frame[len], app->payload, app->size );
+        encrypt_frm_payload( device->dev_addr, session->app_s_key, DIR_DOWN, session->fcnt_down, &frame[len],
+                             app->size );
+        len += app->size;
+        app->used = false;
+    }
+
+    len = append_downlink_mic( session->nwk_s_key, device->dev_addr, session->fcnt_down, frame, len );
+
+    session->fcnt_down++;
+    session_save( );
+    send_downlink( index, frame, len, params, tx_end_us + ( ( uint64_t ) config.rx1_delay_s * 1000000u ) );
+}
+
+static void send_downlink( uint8_t device, const uint8_t* frame, uint8_t size, const sim_radio_params_t* uplink_params,
+                           uint64_t at_us )
+{
+    if( draw_loss( config.downlink_loss_percent ) )
+    {
+        stats.downlinks_lost++;
+        return;
+    }
+
+    // RX1 with RX1DROffset 0: same channel and data rate as the uplink, inverted IQ, no payload CRC
+    sim_radio_params_t params = *uplink_params;
+    params.cr                 = 1;
+    params.preamble_len       = 8;
+    params.implicit_header    = false;
+    params.crc_on             = false;
+    params.iq_inverted        = true;
+
+    if( sim_radio_push_frame( frame, size, &params, at_us, config.rssi_dbm, config.snr_db ) )
+    {
+        stats.downlinks++;
+        stats.device_downlinks[device]++;
+        trace_air( device, true, &params, size, at_us );
+    }
+}
+
+static uint8_t append_downlink_mic( const uint8_t key[16], uint32_t dev_addr, uint32_t fcnt, uint8_t* frame,
+                                    uint8_t size )
+{
+    // B0 | msg
+    uint8_t b0_msg[16 + 256];
+    memset( b0_msg, 0, 16 );
+    b0_msg[0] = 0x49;
+    b0_msg[5] = DIR_DOWN;
+    put_u32_le( &b0_msg[6], dev_addr );
+    put_u32_le( &b0_msg[10], fcnt );
+    b0_msg[15] = size;
+    memcpy( &b0_msg[16], frame, size );
+
+    uint8_t mic[16];
+    sim_crypto_cmac( key, b0_msg, 16u + size, mic );
+    memcpy( &frame[size], mic, MIC_LENGTH );
+    return ( uint8_t ) ( size + MIC_LENGTH );
+}
+
+static uint8_t answer_mac_commands( device_t* device, const uint8_t* commands, uint8_t size, uint64_t tx_end_us,
+                                    uint8_t* answers, uint8_t answers_size )
+{
+    // Payload length of the end-device commands, to skip those the server does not answer
+    static const int8_t request_length[] = {
+        -1, -1, 0, 1, 0, 1, 2, 1, 0, 0, 1, -1, -1, 0, -1, -1, 1, 1, -1, 1,
+    };
+    uint8_t len = 0;
+    uint8_t i   = 0;
+
+    while( i < size )
+    {
+        const uint8_t cid = commands[i++];
+        if( ( cid >= sizeof( request_length ) ) || ( request_length[cid] < 0 ) ||
+            ( ( i + request_length[cid] ) > size ) )
+        {
+            break;  // unknown command: the rest cannot be parsed
+        }
+
+        if( ( cid == CID_DEVICE_TIME ) && ( ( len + 6 ) <= answers_size ) )
+        {
+            // GPS time of the end of the uplink, seconds and 1/256 s
+            const uint64_t gps_us = tx_end_us + ( uint64_t ) SIM_NETWORK_GPS_TIME_AT_START_S * 1000000u;
+            answers[len++]        = CID_DEVICE_TIME;
+            put_u32_le( &answers[len], ( uint32_t ) ( gps_us / 1000000u ) );
+            len += 4;
+            answers[len++] = ( uint8_t ) ( ( ( gps_us % 1000000u ) * 256u ) / 1000000u );
+            stats.device_time_answers++;
+        }
+        else if( ( cid == CID_PING_SLOT_INFO ) && ( ( len + 1 ) <= answers_size ) )
+        {
+            device->ping_periodicity = commands[i] & 0x07;
+            answers[len++]           = CID_PING_SLOT_INFO;
+            stats.ping_slot_info_answers++;
+        }
+        i += ( uint8_t ) request_length[cid];
+    }
+    return len;
+}
+
+static void on_beacon_due( void* context )
+{
+    ( void ) context;
+    const uint64_t now_us = sim_clock_now_us( );
+    beacon_event          = sim_clock_schedule_at_us( now_us + BEACON_PERIOD_US, on_beacon_due, NULL );
+
+    if( ( beacons_on == false ) || draw_loss( config.beacon_loss_percent ) )
+    {
+        stats.beacons_lost++;
+        return;
+    }
+
+    // EU868 beacon: RFU(2) | Time(4) | CRC(2) | InfoDesc(1) | Info(6) | CRC(2), no PHY header nor payload CRC
+    const uint32_t gps_time_s = ( uint32_t ) ( now_us / 1000000u ) + SIM_NETWORK_GPS_TIME_AT_START_S;
+    uint8_t        beacon[BEACON_LENGTH] = { 0 };
+    put_u32_le( &beacon[2], gps_time_s );
+    uint16_t crc = beacon_crc( beacon, 6 );
+    beacon[6]    = ( uint8_t ) crc;
+    beacon[7]    = ( uint8_t ) ( crc >> 8 );
+    crc          = beacon_crc( &beacon[8], 7 );
+    beacon[15]   = ( uint8_t ) crc;
+    beacon[16]   = ( uint8_t ) ( crc >> 8 );
+
+    sim_radio_params_t params = { 0 };
+    params.packet_type        = SIM_RADIO_PACKET_TYPE_LORA;
+    params.freq_hz            = SIM_NETWORK_BEACON_FREQ_HZ;
+    params.sf                 = SIM_NETWORK_BEACON_SF;
+    params.bw_hz              = 125000;
+    params.cr                 = 1;
+    params.preamble_len       = 10;
+    params.implicit_header    = true;
+    params.crc_on             = false;
+    params.iq_inverted        = false;
+    if( sim_radio_push_frame( beacon, sizeof( beacon ), &params, now_us + BEACON_DELAY_US, config.rssi_dbm,
+                              config.snr_db ) )
+    {
+        stats.beacons++;
+    }
+    else
+    {
+        stats.beacons_lost++;
+    }
+}
+
+static uint64_t next_ping_slot_us( const device_t* device, uint64_t after_us )
+{
+    // pingPeriod = 2^12 / pingNb slots of 30 ms, offset drawn per beacon period from the beacon time and DevAddr
+    const uint32_t ping_period = 1u << ( 5 + device->ping_periodicity );
+    uint64_t       period_us   = ( after_us / BEACON_PERIOD_US ) * BEACON_PERIOD_US;
+
+    for( ;; )
+    {
+        const uint32_t beacon_time = ( uint32_t ) ( period_us / 1000000u ) + SIM_NETWORK_GPS_TIME_AT_START_S;
+        uint8_t        key[16]     = { 0 };
+        uint8_t        block[16]   = { 0 };
+        uint8_t        rand[16];
+        put_u32_le( &block[0], beacon_time );
+        put_u32_le( &block[4], device->dev_addr );
+        sim_crypto_aes_encrypt( key, block, rand );
+        const uint32_t ping_offset = ( ( uint32_t ) rand[0] + ( ( uint32_t ) rand[1] << 8 ) ) % ping_period;
+
+        for( uint32_t slot = ping_offset; slot < 4096; slot += ping_period )
+        {
+            const uint64_t slot_us = period_us + BEACON_RESERVED_US + ( uint64_t ) slot * PING_SLOT_US;
+            if( slot_us > after_us )
+            {
+                return slot_us;
+            }
+        }
+        period_us += BEACON_PERIOD_US;
+    }
+}
+
+static uint16_t beacon_crc( const uint8_t* data, uint8_t size )
+{
+    // CRC-16/CCITT, polynomial 0x1021, initial value 0
+    uint16_t crc = 0;
+    for( uint8_t i = 0; i < size; i++ )
+    {
+        crc ^= ( uint16_t ) ( data[i] << 8 );
+        for( uint8_t bit = 0; bit < 8; bit++ )
+        {
+            crc = ( crc & 0x8000 ) ? ( uint16_t ) ( ( crc << 1 ) ^ 0x1021 ) : ( uint16_t ) ( crc << 1 );
+        }
+    }
+    return crc;
+}
+
+static void derive_session_key( const device_t* device, uint8_t type, uint16_t dev_nonce, uint8_t key[16] )
+{
+    // type | JoinNonce | NetID | DevNonce | pad16 (the JoinNonce is the one just sent)
+    uint8_t block[16] = { 0 };
+    block[0]          = type;
+    block[1]          = ( uint8_t ) device->session.join_nonce;
+    block[2]          = ( uint8_t ) ( device->session.join_nonce >> 8 );
+    block[3]          = ( uint8_t ) ( device->session.join_nonce >> 16 );
+    block[4]          = ( uint8_t ) config.net_id;
+    block[5]          = ( uint8_t ) ( config.net_id >> 8 );
+    block[6]          = ( uint8_t ) ( config.net_id >> 16 );
+    block[7]          = ( uint8_t ) dev_nonce;
+    block[8]          = ( uint8_t ) ( dev_nonce >> 8 );
+    sim_crypto_aes_encrypt( device->nwk_key, block, key );
+}
+
+static void deliver_uplink_payload( uint8_t index, const uint8_t* payload, uint8_t size,
+                                    const sim_radio_params_t* params )
+{
+    device_t*  device  = &devices[index];
+    session_t* session = &device->session;
+
+    stats.uplink_time_on_air_us += sim_radio_get_time_on_air_us( params, size );
+
+    // Rebuild the 32-bit counter, a repeated counter is a retransmission of a frame already delivered
+    const uint16_t fcnt16 = ( uint16_t ) ( payload[6] | ( payload[7] << 8 ) );
+    uint32_t       fcnt   = ( session->fcnt_up & 0xFFFF0000u ) | fcnt16;
+    if( session->fcnt_up_seen == true )
+    {
+        if( fcnt == session->fcnt_up )
+        {
+            return;
+        }
+        if( fcnt < session->fcnt_up )
+        {
+            fcnt += 0x10000u;
+        }
+    }
+    session->fcnt_up      = fcnt;
+    session->fcnt_up_seen = true;
+
+    const uint8_t fopts_len  = payload[5] & 0x0F;
+    const uint8_t port_index = 1 + FHDR_LENGTH + fopts_len;
+    if( size <= ( port_index + MIC_LENGTH ) )
+    {
+        return;  // no FPort, no application payload
+    }
+    const uint8_t fport = payload[port_index];
+    uint8_t       data[256];
+    const uint8_t data_size = ( uint8_t ) ( size - port_index - 1 - MIC_LENGTH );
+    memcpy( data, &payload[port_index + 1], data_size );
+    if( fport == 0 )
+    {
+        return;  // MAC commands only
+    }
+    encrypt_frm_payload( device->dev_addr, session->app_s_key, DIR_UP, fcnt, data, data_size );
+
+    stats.uplink_payload_bytes += data_size;
+    if( uplink_handler != NULL )
+    {
+        uplink_handler( fport, data, data_size, sim_radio_get_time_on_air_us( params, size ) );
+    }
+}
+
+static void encrypt_frm_payload( uint32_t dev_addr, const uint8_t key[16], uint8_t dir, uint32_t fcnt, uint8_t* data,
+                                 uint8_t size )
+{
+    uint8_t a[16] = { 0 };
+    uint8_t s[16];
+    a[0]          = 0x01;
+    a[5]          = dir;
+    put_u32_le( &a[6], dev_addr );
+    put_u32_le( &a[10], fcnt );
+
+    for( uint8_t i = 0; i < size; i++ )
+    {
+        if( ( i % 16 ) == 0 )
+        {
+            a[15] = ( uint8_t ) ( ( i / 16 ) + 1 );
+            sim_crypto_aes_encrypt( key, a, s );
+        }
+        data[i] ^= s[i % 16];
+    }
+}
+
+static void trace_air( uint8_t device, bool downlink, const sim_radio_params_t* params, uint8_t size,
+                       uint64_t start_us )
+{
+    if( air_handler != NULL )
+    {
+        air_handler( device, downlink, params, size, start_us, sim_radio_get_time_on_air_us( params, size ) );
+    }
+}
+
+static bool draw_loss( uint8_t percent )
+{
+    if( percent == 0 )
+    {
+        return false;
+    }
+    loss_state ^= loss_state << 13;
+    loss_state ^= loss_state >> 17;
+    loss_state ^= loss_state << 5;
+    return ( loss_state % 100 ) < percent;
+}
+
+static void put_u32_le( uint8_t* buf, uint32_t value )
+{
+    buf[0] = ( uint8_t ) value;
+    buf[1] = ( uint8_t ) ( value >> 8 );
+    buf[2] = ( uint8_t ) ( value >> 16 );
+    buf[3] = ( uint8_t ) ( value >> 24 );
+}
+
+static void session_load( void )
+{
+    if( session_file == NULL )
+    {
+        return;
+    }
+    FILE* f = fopen( session_file, "rb" );
+    if( f == NULL )
+    {
+        return;
+    }
+    session_t saved;
+    if( fread( &saved, 1, sizeof( saved ), f ) == sizeof( saved ) )
+    {
+        // The configured JoinNonce may already be ahead of the saved one
+        const uint32_t join_nonce = ( config.join_nonce > saved.join_nonce ) ? config.join_nonce : saved.join_nonce;
+        devices[0].session            = saved;
+        devices[0].session.join_nonce = join_nonce;
+    }
+    fclose( f );
+}
+
+static void session_save( void )
+{
+    if( session_file == NULL )
+    {
+        return;
+    }
+    FILE* f = fopen( session_file, "wb" );
+    if( f != NULL )
+    {
+        fwrite( &devices[0].session, 1, sizeof( devices[0].session ), f );
+        fclose( f );
+    }
+}
+
+/* --- EOF ------------------------------------------------------------------ */
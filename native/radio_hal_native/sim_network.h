@@ -0,0 +1,239 @@
+/*!
+ * \file      sim_network.h
+ *
+ * \brief     Minimal LoRaWAN 1.0.x network server answering the simulated device
+ *
+ * Listens to every frame leaving the virtual radio. Join-Requests are answered with a valid Join-Accept in
+ * RX1, confirmed uplinks are acknowledged in RX1 and application downlinks queued with
+ * sim_network_queue_downlink() ride on the next RX1 opportunity. Uplink payloads are decrypted and passed to an
+ * optional application handler. Uplink and downlink losses can be injected to
+ * exercise retransmissions and RX2 fallbacks.
+ *
+ * For class B the server answers DeviceTimeReq and PingSlotInfoReq, puts a beacon on the air every 128 s once
+ * sim_network_start_beacons() is called and sends downlinks in the ping slots of the device. The GPS time of the
+ * network is the virtual time plus SIM_NETWORK_GPS_TIME_AT_START_S.
+ *
+ * The device of the configuration answers any DevEUI. More devices, each with its own DevEUI, root key and
+ * DevAddr, can be registered with sim_network_add_device(), e.g. the other stacks of a multi-stack modem.
+ */
+
+#ifndef SIM_NETWORK_H
+#define SIM_NETWORK_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sim_radio.h"
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC CONSTANTS --------------------------------------------------------
+ */
+
+/**
+ * @brief Number of application downlinks that can wait for a device uplink
+ */
+#define SIM_NETWORK_MAX_QUEUED_DOWNLINKS 4
+
+/**
+ * @brief Number of devices served, the one of the configuration included
+ */
+#define SIM_NETWORK_MAX_DEVICES 4
+
+/**
+ * @brief GPS time at virtual time 0, a beacon period boundary
+ */
+#define SIM_NETWORK_GPS_TIME_AT_START_S 1400000000u
+
+/**
+ * @brief Class B beacon and ping slot channel (EU868: 869.525 MHz, DR3)
+ */
+#define SIM_NETWORK_BEACON_FREQ_HZ 869525000u
+#define SIM_NETWORK_BEACON_SF 9
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC TYPES ------------------------------------------------------------
+ */
+
+/**
+ * @brief Network server configuration
+ */
+typedef struct sim_network_config_s
+{
+    uint8_t  nwk_key[16];            //!< root key used by the device for the join (NwkKey / 1.0.x AppKey)
+    uint32_t dev_addr;               //!< DevAddr assigned at join
+    uint32_t net_id;
+    uint32_t join_nonce;             //!< first JoinNonce issued, must exceed the one stored by the device
+    uint8_t  rx1_delay_s;            //!< RxDelay sent in the Join-Accept
+    bool     answer_join;            //!< false simulates a device out of coverage
+    uint8_t  uplink_loss_percent;    //!< probability that an uplink never reaches the gateway
+    uint8_t  downlink_loss_percent;  //!< probability that a downlink never reaches the device
+    uint8_t  beacon_loss_percent;    //!< probability that a beacon never reaches the device
+    int16_t  rssi_dbm;               //!< link budget reported on downlinks
+    int8_t   snr_db;
+    uint32_t seed;                   //!< loss pattern seed
+} sim_network_config_t;
+
+/**
+ * @brief Network server counters
+ */
+typedef struct sim_network_stats_s
+{
+    uint32_t join_requests;
+    uint32_t join_accepts;
+    uint32_t uplinks;           //!< data uplinks received by the gateway
+    uint32_t uplinks_lost;      //!< frames (join or data) dropped by loss injection
+    uint32_t confirmed_uplinks;
+    uint32_t downlinks;         //!< downlinks put on the air
+    uint32_t downlinks_lost;
+    uint32_t last_fcnt_up;
+    uint32_t first_join_accept_ms;  //!< virtual time of the first Join-Accept, 0 if none
+    uint32_t uplink_payload_bytes;  //!< decrypted FRMPayload bytes of data uplinks, retransmissions excluded
+    uint64_t uplink_time_on_air_us; //!< time on air of the data uplinks received, retransmissions included
+    uint32_t device_join_accepts[SIM_NETWORK_MAX_DEVICES];  //!< per device, index of sim_network_add_device()
+    uint32_t device_uplinks[SIM_NETWORK_MAX_DEVICES];
+    uint32_t device_downlinks[SIM_NETWORK_MAX_DEVICES];
+    uint32_t multicast_downlinks;   //!< class C multicast downlinks put on the air
+    uint32_t multicast_lost;        //!< dropped by loss injection
+    uint32_t device_time_answers;   //!< DeviceTimeAns sent
+    uint32_t ping_slot_info_answers;
+    uint32_t beacons;               //!< beacons put on the air
+    uint32_t beacons_lost;          //!< dropped by loss injection or while beacons are stopped
+    uint32_t ping_slot_downlinks;   //!< class B downlinks put on the air
+    uint32_t ping_slot_lost;
+} sim_network_stats_t;
+
+/**
+ * @brief Called with the decrypted application payload of each new data uplink
+ */
+typedef void ( *sim_network_uplink_handler_t )( uint8_t fport, const uint8_t* payload, uint8_t size,
+                                                uint32_t time_on_air_us );
+
+/**
+ * @brief Called for each frame of a known device on the air: uplinks (lost ones included) and downlinks
+ */
+typedef void ( *sim_network_air_handler_t )( uint8_t device, bool downlink, const sim_radio_params_t* params,
+                                             uint8_t size, uint64_t start_us, uint32_t time_on_air_us );
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS PROTOTYPES --------------------------------------------
+ */
+
+/**
+ * @brief Fill a configuration matching the credentials of lbm_config.h
+ */
+void sim_network_get_default_config( sim_network_config_t* config );
+
+/**
+ * @brief Apply a configuration (can be called before or after sim_network_init())
+ */
+void sim_network_configure( const sim_network_config_t* config );
+
+/**
+ * @brief Register another device (before or after sim_network_init(), which keeps the registrations)
+ *
+ * @param [in] dev_eui  DevEUI, most significant byte first as given to the modem
+ * @param [in] nwk_key  Root key used for its join
+ * @param [in] dev_addr DevAddr assigned at join
+ *
+ * @return Device index (1 to SIM_NETWORK_MAX_DEVICES - 1), -1 if no room is left
+ */
+int sim_network_add_device( const uint8_t dev_eui[8], const uint8_t nwk_key[16], uint32_t dev_addr );
+
+/**
+ * @brief Attach the server to the virtual radio and clear its session and counters
+ *
+ * The session is read back from the session file when one is set.
+ */
+void sim_network_init( void );
+
+/**
+ * @brief Keep the session of the server (keys, counters, JoinNonce) in a file, so a device restarted from the
+ *        same nvm file finds its network session in the next run (NULL: RAM only)
+ *
+ * Only the session of the device of the configuration is kept.
+ */
+void sim_network_set_session_file( const char* path );
+
+/**
+ * @brief Queue an application downlink sent in the RX1 window following the next uplink of the device of the
+ *        configuration
+ *
+ * @return false if the queue is full or the payload too long
+ */
+bool sim_network_queue_downlink( uint8_t fport, const uint8_t* payload, uint8_t size, bool confirmed );
+
+/**
+ * @brief Set the multicast group served by sim_network_send_multicast() (McAddr, McNwkSKey, McAppSKey), its
+ *        frame counter starting at 1
+ */
+void sim_network_set_multicast_group( uint32_t address, const uint8_t nwk_s_key[16], const uint8_t app_s_key[16] );
+
+/**
+ * @brief Put an unconfirmed class C downlink of the multicast group on the air, whatever the device does
+ *
+ * The frame is lost with the downlink loss probability of the configuration. It reaches the device only if its
+ * receiver listens on freq_hz / sf (BW125, inverted IQ) when the frame starts.
+ *
+ * @param [in] at_us Start of the frame on the virtual clock
+ *
+ * @return false without group, for a payload too long, or if the air already holds SIM_RADIO_MAX_PENDING_FRAMES
+ *         frames: schedule bursts a few frames ahead
+ */
+bool sim_network_send_multicast( uint8_t fport, const uint8_t* payload, uint8_t size, uint32_t freq_hz, uint8_t sf,
+                                 uint64_t at_us );
+
+/**
+ * @brief Transmit a beacon at the start of every beacon period from the next one on
+ */
+void sim_network_start_beacons( void );
+
+/**
+ * @brief Stop the beacons, each period without one counting as a lost beacon until restarted (gateway outage)
+ */
+void sim_network_stop_beacons( void );
+
+/**
+ * @brief Send an application downlink to the device of the configuration in its next ping slot
+ *
+ * The slot follows the periodicity of its last PingSlotInfoReq (128 s before any) and the pingOffset of the
+ * beacon period (LoRaWAN class B); the frame is lost with the downlink loss probability of the configuration.
+ *
+ * @param [out] at_us Start of the frame on the virtual clock, lost or not
+ *
+ * @return false if the device has not joined, for a payload too long, or if the air is full
+ */
+bool sim_network_send_ping_slot( uint8_t fport, const uint8_t* payload, uint8_t size, uint64_t* at_us );
+
+/**
+ * @brief Register the application server side of the simulation (NULL to remove it)
+ */
+void sim_network_set_uplink_handler( sim_network_uplink_handler_t handler );
+
+/**
+ * @brief Register the observer of the frames on the air (NULL to remove it)
+ */
+void sim_network_set_air_handler( sim_network_air_handler_t handler );
+
+/**
+ * @brief Read the counters
+ */
+void sim_network_get_stats( sim_network_stats_t* stats );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SIM_NETWORK_H
+
+/* --- EOF ------------------------------------------------------------------ */
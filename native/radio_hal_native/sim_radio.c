@@ -0,0 +1,694 @@
+/*!
+ * \file      sim_radio.c
+ *
+ * \brief     Virtual SX126x transceiver driven at the command level by sx126x_hal.c
+ */
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <string.h>
+#include <math.h>
+
+#include "sim_radio.h"
+#include "sim_clock.h"
+#include "smtc_modem_hal.h"
+#include "smtc_modem_hal_native.h"
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE CONSTANTS -------------------------------------------------------
+ */
+
+// SX126x opcodes handled by the model (others are accepted and ignored)
+#define OP_GET_STATUS 0xC0
+#define OP_WRITE_REGISTER 0x0D
+#define OP_READ_REGISTER 0x1D
+#define OP_WRITE_BUFFER 0x0E
+#define OP_READ_BUFFER 0x1E
+#define OP_SET_SLEEP 0x84
+#define OP_SET_STANDBY 0x80
+#define OP_SET_FS 0xC1
+#define OP_SET_TX 0x83
+#define OP_SET_RX 0x82
+#define OP_SET_CAD 0xC5
+#define OP_SET_PACKET_TYPE 0x8A
+#define OP_SET_RF_FREQUENCY 0x86
+#define OP_SET_MODULATION_PARAMS 0x8B
+#define OP_SET_PACKET_PARAMS 0x8C
+#define OP_SET_BUFFER_BASE_ADDRESS 0x8F
+#define OP_SET_LORA_SYMB_NUM_TIMEOUT 0xA0
+#define OP_SET_DIO_IRQ_PARAMS 0x08
+#define OP_GET_IRQ_STATUS 0x12
+#define OP_CLR_IRQ_STATUS 0x02
+#define OP_GET_RX_BUFFER_STATUS 0x13
+#define OP_GET_PACKET_STATUS 0x14
+#define OP_GET_RSSI_INST 0x15
+
+// IRQ flags
+#define IRQ_TX_DONE 0x0001
+#define IRQ_RX_DONE 0x0002
+#define IRQ_PREAMBLE_DETECTED 0x0004
+#define IRQ_HEADER_VALID 0x0010
+#define IRQ_CAD_DONE 0x0080
+#define IRQ_TIMEOUT 0x0200
+
+#define REG_RNG_BASE 0x0819
+#define REGISTER_SPACE 0x1000
+
+#define SET_RX_CONTINUOUS 0xFFFFFF
+#define TIMEOUT_STEP_NS 15625
+
+#define NOISE_FLOOR_DBM ( -120 )
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE TYPES -----------------------------------------------------------
+ */
+
+typedef struct air_frame_s
+{
+    bool               used;
+    uint8_t            payload[256];
+    uint8_t            size;
+    sim_radio_params_t params;
+    uint64_t           arrival_us;
+    int16_t            rssi_dbm;
+    int8_t             snr_db;
+} air_frame_t;
+
+typedef struct sim_radio_s
+{
+    sim_radio_mode_t   mode;
+    uint64_t           mode_enter_us;
+    sim_radio_params_t params;
+    uint8_t            payload_len;  // from packet params
+    uint8_t            buffer[256];
+    uint8_t            tx_base;
+    uint8_t            rx_base;
+    uint8_t            rx_size;
+    uint8_t            registers[REGISTER_SPACE];
+    uint16_t           irq_status;
+    uint16_t           dio1_mask;
+    uint8_t            symb_timeout;
+    int                pending_event;
+    bool               receiving;  // an rx done is scheduled, later frames collide and are lost
+    uint64_t           rx_end_us;  // RX timeout of the open window, UINT64_MAX for continuous RX
+    int16_t            last_rssi_dbm;
+    int8_t             last_snr_db;
+    uint8_t            rx_frame_index;
+} sim_radio_t;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE VARIABLES -------------------------------------------------------
+ */
+
+static sim_radio_t             radio;
+static sim_radio_stats_t       stats;
+static air_frame_t             air[SIM_RADIO_MAX_PENDING_FRAMES];
+static sim_radio_tx_listener_t tx_listener = NULL;
+static sim_radio_tx_listener_t tx_monitor  = NULL;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DECLARATION -------------------------------------------
+ */
+
+static void     set_mode( sim_radio_mode_t mode );
+static void     cancel_pending_event( void );
+static void     schedule_rx_done( int index );
+static void     raise_irq( uint16_t flags );
+static void     start_tx( void );
+static void     start_rx( uint32_t timeout_steps );
+static void     start_cad( void );
+static bool     try_receive( void );
+static bool     frame_matches( const air_frame_t* frame );
+static uint64_t lock_end_us( const air_frame_t* frame );
+static void     drop_missed_frames( void );
+static uint32_t symbol_time_us( const sim_radio_params_t* params );
+static uint32_t decode_bw( uint8_t bw_code );
+static void     on_tx_done( void* context );
+static void     on_rx_done( void* context );
+static void     on_rx_timeout( void* context );
+static void     on_cad_done( void* context );
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS DEFINITION ---------------------------------------------
+ */
+
+void sim_radio_init( void )
+{
+    memset( &radio, 0, sizeof( radio ) );
+    memset( &stats, 0, sizeof( stats ) );
+    memset( air, 0, sizeof( air ) );
+    radio.pending_event       = SIM_CLOCK_INVALID_HANDLE;
+    radio.mode                = SIM_RADIO_MODE_STANDBY;
+    radio.mode_enter_us       = sim_clock_now_us( );
+    radio.params.packet_type  = SIM_RADIO_PACKET_TYPE_LORA;
+    radio.params.preamble_len = 8;
+}
+
+void sim_radio_write( const uint8_t* command, uint16_t command_length, const uint8_t* data, uint16_t data_length )
+{
+    // The driver splits opcode/arguments and bulk data arbitrarily: rebuild the SPI frame
+    uint8_t  frame[300];
+    uint16_t len = 0;
+    for( uint16_t i = 0; ( i < command_length ) && ( len < sizeof( frame ) ); i++ )
+    {
+        frame[len++] = command[i];
+    }
+    for( uint16_t i = 0; ( i < data_length ) && ( len < sizeof( frame ) ); i++ )
+    {
+        frame[len++] = data[i];
+    }
+    if( len == 0 )
+    {
+        return;
+    }
+    stats.spi_transfers++;
+
+    const uint8_t* arg = &frame[1];
+    switch( frame[0] )
+    {
+    case OP_WRITE_REGISTER:
+    {
+        uint16_t addr = ( ( uint16_t ) arg[0] << 8 ) | arg[1];
+        for( uint16_t i = 3; i < len; i++, addr++ )
+        {
+            radio.registers[addr % REGISTER_SPACE] = frame[i];
+        }
+        break;
+    }
+    case OP_WRITE_BUFFER:
+    {
+        uint8_t offset = arg[0];
+        for( uint16_t i = 2; i < len; i++ )
+        {
+            radio.buffer[offset++] = frame[i];
+        }
+        break;
+    }
+    case OP_SET_SLEEP:
+        cancel_pending_event( );
+        set_mode( SIM_RADIO_MODE_SLEEP );
+        break;
+    case OP_SET_STANDBY:
+        cancel_pending_event( );
+        set_mode( SIM_RADIO_MODE_STANDBY );
+        break;
+    case OP_SET_FS:
+        cancel_pending_event( );
+        set_mode( SIM_RADIO_MODE_FS );
+        break;
+    case OP_SET_TX:
+        start_tx( );
+        break;
+    case OP_SET_RX:
+        start_rx( ( ( uint32_t ) arg[0] << 16 ) | ( ( uint32_t ) arg[1] << 8 ) | arg[2] );
+        break;
+    case OP_SET_CAD:
+        start_cad( );
+        break;
+    case OP_SET_PACKET_TYPE:
+        radio.params.packet_type = arg[0];
+        break;
+    case OP_SET_RF_FREQUENCY:
+    {
+        uint32_t rf = ( ( uint32_t ) arg[0] << 24 ) | ( ( uint32_t ) arg[1] << 16 ) | ( ( uint32_t ) arg[2] << 8 ) | arg[3];
+        // Fxtal = 32 MHz, Fstep = Fxtal / 2^25; round to the nearest 100 Hz to absorb the quantization
+        uint64_t hz          = ( ( uint64_t ) rf * 32000000u ) >> 25;
+        radio.params.freq_hz = ( uint32_t ) ( ( ( hz + 50 ) / 100 ) * 100 );
+        break;
+    }
+    case OP_SET_MODULATION_PARAMS:
+        if( radio.params.packet_type == SIM_RADIO_PACKET_TYPE_LORA )
+        {
+            radio.params.sf    = arg[0];
+            radio.params.bw_hz = decode_bw( arg[1] );
+            radio.params.cr    = arg[2];
+        }
+        else if( radio.params.packet_type == SIM_RADIO_PACKET_TYPE_GFSK )
+        {
+            uint32_t br = ( ( uint32_t ) arg[0] << 16 ) | ( ( uint32_t ) arg[1] << 8 ) | arg[2];
+            radio.params.bitrate_bps = ( br != 0 ) ? ( uint32_t ) ( ( 32u * 32000000ull ) / br ) : 0;
+        }
+        break;
+    case OP_SET_PACKET_PARAMS:
+        radio.params.preamble_len = ( ( uint16_t ) arg[0] << 8 ) | arg[1];
+        if( radio.params.packet_type == SIM_RADIO_PACKET_TYPE_LORA )
+        {
+            radio.params.implicit_header = ( arg[2] != 0 );
+            radio.payload_len            = arg[3];
+            radio.params.crc_on          = ( arg[4] != 0 );
+            radio.params.iq_inverted     = ( arg[5] != 0 );
+        }
+        else
+        {
+            radio.payload_len   = arg[6];
+            radio.params.crc_on = ( arg[7] != 0x01 );
+        }
+        break;
+    case OP_SET_BUFFER_BASE_ADDRESS:
+        radio.tx_base = arg[0];
+        radio.rx_base = arg[1];
+        break;
+    case OP_SET_LORA_SYMB_NUM_TIMEOUT:
+        radio.symb_timeout = arg[0];
+        break;
+    case OP_SET_DIO_IRQ_PARAMS:
+        radio.dio1_mask = ( ( uint16_t ) arg[2] << 8 ) | arg[3];
+        break;
+    case OP_CLR_IRQ_STATUS:
+        radio.irq_status &= ~( ( ( uint16_t ) arg[0] << 8 ) | arg[1] );
+        break;
+    default:
+        break;
+    }
+}
+
+void sim_radio_read( const uint8_t* command, uint16_t command_length, uint8_t* data, uint16_t data_length )
+{
+    if( command_length == 0 )
+    {
+        return;
+    }
+    stats.spi_transfers++;
+    memset( data, 0, data_length );
+
+    switch( command[0] )
+    {
+    case OP_GET_STATUS:
+        data[0] = ( uint8_t ) ( ( radio.mode == SIM_RADIO_MODE_RX ) ? 0x50 : 0x20 );
+        break;
+    case OP_READ_REGISTER:
+    {
+        uint16_t addr = ( ( uint16_t ) command[1] << 8 ) | command[2];
+        for( uint16_t i = 0; i < data_length; i++, addr++ )
+        {
+            if( ( addr >= REG_RNG_BASE ) && ( addr < REG_RNG_BASE + 4 ) )
+            {
+                data[i] = ( uint8_t ) smtc_modem_hal_get_random_nb_in_range( 0, 255 );
+            }
+            else
+            {
+                data[i] = radio.registers[addr % REGISTER_SPACE];
+            }
+        }
+        break;
+    }
+    case OP_READ_BUFFER:
+    {
+        uint8_t offset = command[1];
+        for( uint16_t i = 0; i < data_length; i++ )
+        {
+            data[i] = radio.buffer[offset++];
+        }
+        break;
+    }
+    case OP_GET_IRQ_STATUS:
+        if( data_length >= 2 )
+        {
+            data[0] = ( uint8_t ) ( radio.irq_status >> 8 );
+            data[1] = ( uint8_t ) radio.irq_status;
+        }
+        break;
+    case OP_GET_RX_BUFFER_STATUS:
+        if( data_length >= 2 )
+        {
+            data[0] = radio.rx_size;
+            data[1] = radio.rx_base;
+        }
+        break;
+    case OP_GET_PACKET_STATUS:
+        if( data_length >= 3 )
+        {
+            data[0] = ( uint8_t ) ( -radio.last_rssi_dbm * 2 );
+            data[1] = ( uint8_t ) ( radio.last_snr_db * 4 );
+            data[2] = ( uint8_t ) ( -radio.last_rssi_dbm * 2 );
+        }
+        break;
+    case OP_GET_RSSI_INST:
+        data[0] = ( uint8_t ) ( -NOISE_FLOOR_DBM * 2 );
+        break;
+    default:
+        break;
+    }
+}
+
+void sim_radio_reset( void )
+{
+    cancel_pending_event( );
+    radio.irq_status = 0;
+    radio.dio1_mask  = 0;
+    set_mode( SIM_RADIO_MODE_STANDBY );
+}
+
+void sim_radio_wakeup( void )
+{
+    if( radio.mode == SIM_RADIO_MODE_SLEEP )
+    {
+        set_mode( SIM_RADIO_MODE_STANDBY );
+    }
+}
+
+void sim_radio_set_tx_listener( sim_radio_tx_listener_t listener )
+{
+    tx_listener = listener;
+}
+
+void sim_radio_set_tx_monitor( sim_radio_tx_listener_t monitor )
+{
+    tx_monitor = monitor;
+}
+
+bool sim_radio_push_frame( const uint8_t* payload, uint8_t size, const sim_radio_params_t* params, uint64_t arrival_us,
+                           int16_t rssi_dbm, int8_t snr_db )
+{
+    drop_missed_frames( );
+    for( int i = 0; i < SIM_RADIO_MAX_PENDING_FRAMES; i++ )
+    {
+        if( air[i].used == false )
+        {
+            air[i].used = true;
+            memcpy( air[i].payload, payload, size );
+            air[i].size       = size;
+            air[i].params     = *params;
+            air[i].arrival_us = arrival_us;
+            air[i].rssi_dbm   = rssi_dbm;
+            air[i].snr_db     = snr_db;
+
+            // A receiver already listening (continuous RX, long window) picks the frame up directly
+            if( ( radio.mode == SIM_RADIO_MODE_RX ) && ( radio.receiving == false ) && frame_matches( &air[i] ) )
+            {
+                cancel_pending_event( );
+                schedule_rx_done( i );
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+uint32_t sim_radio_get_time_on_air_us( const sim_radio_params_t* params, uint8_t size )
+{
+    if( params->packet_type == SIM_RADIO_PACKET_TYPE_GFSK )
+    {
+        // preamble + 4 bytes sync word + 1 byte length + payload + 2 bytes CRC
+        uint32_t bits = ( uint32_t ) params->preamble_len + ( ( 4u + 1u + size + ( params->crc_on ? 2u : 0u ) ) * 8u );
+        return ( params->bitrate_bps != 0 ) ? ( uint32_t ) ( ( ( uint64_t ) bits * 1000000u ) / params->bitrate_bps ) : 0;
+    }
+
+    const double t_sym  = ( double ) symbol_time_us( params );
+    const int    sf     = params->sf;
+    const int    de     = ( t_sym >= 16000.0 ) ? 1 : 0;  // low data rate optimization
+    const int    ih     = params->implicit_header ? 1 : 0;
+    const int    crc    = params->crc_on ? 1 : 0;
+    const double num    = ( 8.0 * size ) - ( 4.0 * sf ) + 28.0 + ( 16.0 * crc ) - ( 20.0 * ih );
+    const double den    = 4.0 * ( sf - ( 2 * de ) );
+    double       n_payl = ceil( num / den ) * ( params->cr + 4 );
+    if( n_payl < 0 )
+    {
+        n_payl = 0;
+    }
+    n_payl += 8;
+    const double t_preamble = ( params->preamble_len + 4.25 ) * t_sym;
+    return ( uint32_t ) ( t_preamble + ( n_payl * t_sym ) );
+}
+
+sim_radio_mode_t sim_radio_get_mode( void )
+{
+    return radio.mode;
+}
+
+void sim_radio_get_stats( sim_radio_stats_t* out )
+{
+    *out = stats;
+    out->time_in_mode_us[radio.mode] += sim_clock_now_us( ) - radio.mode_enter_us;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DEFINITION --------------------------------------------
+ */
+
+static void set_mode( sim_radio_mode_t mode )
+{
+    const uint64_t now = sim_clock_now_us( );
+    stats.time_in_mode_us[radio.mode] += now - radio.mode_enter_us;
+    radio.mode          = mode;
+    radio.mode_enter_us = now;
+}
+
+static void cancel_pending_event( void )
+{
+    sim_clock_cancel( radio.pending_event );
+    radio.pending_event = SIM_CLOCK_INVALID_HANDLE;
+    radio.receiving     = false;
+}
+
+static void schedule_rx_done( int index )
+{
+    const uint64_t now   = sim_clock_now_us( );
+    const uint64_t start = ( air[index].arrival_us > now ) ? air[index].arrival_us : now;
+
+    radio.rx_frame_index = ( uint8_t ) index;
+    radio.receiving      = true;
+    radio.pending_event  = sim_clock_schedule_at_us(
+        start + sim_radio_get_time_on_air_us( &air[index].params, air[index].size ), on_rx_done, NULL );
+}
+
+static void raise_irq( uint16_t flags )
+{
+    radio.irq_status |= flags;
+    if( ( flags & radio.dio1_mask ) != 0 )
+    {
+        smtc_modem_hal_native_radio_irq( );
+    }
+}
+
+static void start_tx( void )
+{
+    cancel_pending_event( );
+    set_mode( SIM_RADIO_MODE_TX );
+    stats.tx_count++;
+    radio.pending_event = sim_clock_schedule_at_us(
+        sim_clock_now_us( ) + sim_radio_get_time_on_air_us( &radio.params, radio.payload_len ), on_tx_done, NULL );
+}
+
+static void start_rx( uint32_t timeout_steps )
+{
+    cancel_pending_event( );
+    set_mode( SIM_RADIO_MODE_RX );
+    stats.rx_count++;
+
+    uint64_t window_us = UINT64_MAX;
+    if( ( timeout_steps != 0 ) && ( timeout_steps != SET_RX_CONTINUOUS ) )
+    {
+        window_us = ( ( uint64_t ) timeout_steps * TIMEOUT_STEP_NS ) / 1000u;
+    }
+    if( ( radio.params.packet_type == SIM_RADIO_PACKET_TYPE_LORA ) && ( radio.symb_timeout != 0 ) )
+    {
+        uint64_t symb_us = ( uint64_t ) radio.symb_timeout * symbol_time_us( &radio.params );
+        window_us        = ( symb_us < window_us ) ? symb_us : window_us;
+    }
+    radio.rx_end_us = ( window_us != UINT64_MAX ) ? sim_clock_now_us( ) + window_us : UINT64_MAX;
+
+    if( try_receive( ) == true )
+    {
+        return;
+    }
+    if( window_us != UINT64_MAX )
+    {
+        radio.pending_event = sim_clock_schedule_at_us( radio.rx_end_us, on_rx_timeout, NULL );
+    }
+}
+
+static void start_cad( void )
+{
+    cancel_pending_event( );
+    set_mode( SIM_RADIO_MODE_CAD );
+    stats.cad_count++;
+    radio.pending_event =
+        sim_clock_schedule_at_us( sim_clock_now_us( ) + ( 2u * symbol_time_us( &radio.params ) ), on_cad_done, NULL );
+}
+
+static bool try_receive( void )
+{
+    // The first frame on the air wins, whatever its slot in the queue
+    int first = -1;
+    for( int i = 0; i < SIM_RADIO_MAX_PENDING_FRAMES; i++ )
+    {
+        if( ( air[i].used == true ) && frame_matches( &air[i] ) &&
+            ( ( first < 0 ) || ( air[i].arrival_us < air[first].arrival_us ) ) )
+        {
+            first = i;
+        }
+    }
+    if( first < 0 )
+    {
+        return false;
+    }
+    schedule_rx_done( first );
+    return true;
+}
+
+static bool frame_matches( const air_frame_t* frame )
+{
+    const sim_radio_params_t* a = &frame->params;
+    const sim_radio_params_t* b = &radio.params;
+
+    if( ( a->packet_type != b->packet_type ) || ( a->freq_hz != b->freq_hz ) )
+    {
+        return false;
+    }
+    if( ( a->packet_type == SIM_RADIO_PACKET_TYPE_LORA ) &&
+        ( ( a->sf != b->sf ) || ( a->bw_hz != b->bw_hz ) || ( a->iq_inverted != b->iq_inverted ) ) )
+    {
+        return false;
+    }
+
+    // The receiver must be listening before the preamble is over
+    const uint64_t now = sim_clock_now_us( );
+    if( now > lock_end_us( frame ) )
+    {
+        return false;
+    }
+
+    // Frames further away than the window are left in the air for a later window
+    uint64_t window_us = UINT64_MAX;
+    if( ( b->packet_type == SIM_RADIO_PACKET_TYPE_LORA ) && ( radio.symb_timeout != 0 ) )
+    {
+        window_us = ( uint64_t ) radio.symb_timeout * symbol_time_us( b );
+    }
+    if( frame->arrival_us > radio.rx_end_us )
+    {
+        return false;
+    }
+    return ( window_us == UINT64_MAX ) || ( frame->arrival_us <= now + window_us );
+}
+
+static uint64_t lock_end_us( const air_frame_t* frame )
+{
+    const sim_radio_params_t* a = &frame->params;
+    if( a->packet_type == SIM_RADIO_PACKET_TYPE_GFSK )
+    {
+        // The preamble detector needs its last 16 bits
+        const uint64_t bits = ( a->preamble_len > 16 ) ? a->preamble_len - 16u : 0u;
+        return frame->arrival_us + ( ( a->bitrate_bps != 0 ) ? ( bits * 1000000u ) / a->bitrate_bps : 0 );
+    }
+    // Last 4 symbols of the preamble are enough to lock
+    return frame->arrival_us + ( ( uint64_t ) ( a->preamble_len > 4 ? a->preamble_len - 4 : 0 ) * symbol_time_us( a ) );
+}
+
+static void drop_missed_frames( void )
+{
+    // Frames nobody locked on in time are gone, they must not fill the air queue
+    const uint64_t now = sim_clock_now_us( );
+    for( int i = 0; i < SIM_RADIO_MAX_PENDING_FRAMES; i++ )
+    {
+        if( ( air[i].used == false ) || ( ( radio.receiving == true ) && ( radio.rx_frame_index == i ) ) )
+        {
+            continue;
+        }
+        if( now > lock_end_us( &air[i] ) )
+        {
+            air[i].used = false;
+            stats.missed_count++;
+        }
+    }
+}
+
+static uint32_t symbol_time_us( const sim_radio_params_t* params )
+{
+    if( ( params->packet_type != SIM_RADIO_PACKET_TYPE_LORA ) || ( params->bw_hz == 0 ) )
+    {
+        return 0;
+    }
+    return ( uint32_t ) ( ( ( uint64_t ) 1000000u << params->sf ) / params->bw_hz );
+}
+
+static uint32_t decode_bw( uint8_t bw_code )
+{
+    switch( bw_code )
+    {
+    case 0x00:
+        return 7810;
+    case 0x08:
+        return 10420;
+    case 0x01:
+        return 15630;
+    case 0x09:
+        return 20830;
+    case 0x02:
+        return 31250;
+    case 0x0A:
+        return 41670;
+    case 0x03:
+        return 62500;
+    case 0x04:
+        return 125000;
+    case 0x05:
+        return 250000;
+    case 0x06:
+        return 500000;
+    default:
+        return 125000;
+    }
+}
+
+static void on_tx_done( void* context )
+{
+    ( void ) context;
+    radio.pending_event = SIM_CLOCK_INVALID_HANDLE;
+    set_mode( SIM_RADIO_MODE_STANDBY );
+    if( tx_listener != NULL )
+    {
+        tx_listener( &radio.buffer[radio.tx_base], radio.payload_len, &radio.params, sim_clock_now_us( ) );
+    }
+    if( tx_monitor != NULL )
+    {
+        tx_monitor( &radio.buffer[radio.tx_base], radio.payload_len, &radio.params, sim_clock_now_us( ) );
+    }
+    raise_irq( IRQ_TX_DONE );
+}
+
+static void on_rx_done( void* context )
+{
+    ( void ) context;
+    air_frame_t* frame  = &air[radio.rx_frame_index];
+    radio.pending_event = SIM_CLOCK_INVALID_HANDLE;
+    radio.receiving     = false;
+
+    memcpy( &radio.buffer[radio.rx_base], frame->payload, frame->size );
+    radio.rx_size       = frame->size;
+    radio.last_rssi_dbm = frame->rssi_dbm;
+    radio.last_snr_db   = frame->snr_db;
+    frame->used         = false;
+    stats.rx_done_count++;
+
+    set_mode( SIM_RADIO_MODE_STANDBY );
+    raise_irq( IRQ_PREAMBLE_DETECTED | IRQ_HEADER_VALID | IRQ_RX_DONE );
+}
+
+static void on_rx_timeout( void* context )
+{
+    ( void ) context;
+    radio.pending_event = SIM_CLOCK_INVALID_HANDLE;
+    stats.rx_timeout_count++;
+    set_mode( SIM_RADIO_MODE_STANDBY );
+    raise_irq( IRQ_TIMEOUT );
+}
+
+static void on_cad_done( void* context )
+{
+    ( void ) context;
+    radio.pending_event = SIM_CLOCK_INVALID_HANDLE;
+    set_mode( SIM_RADIO_MODE_STANDBY );
+    raise_irq( IRQ_CAD_DONE );
+}
+
+/* --- EOF ------------------------------------------------------------------ */
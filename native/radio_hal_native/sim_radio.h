@@ -0,0 +1,162 @@
+/*!
+ * \file      sim_radio.h
+ *
+ * \brief     Virtual SX126x transceiver driven at the command level by sx126x_hal.c
+ *
+ * The model decodes the SX126x opcodes issued by the real sx126x driver (buffer access, packet and modulation
+ * parameters, TX/RX/CAD/sleep) and schedules the matching DIO1 interrupts on the virtual clock. Frames sent by
+ * the device are handed to a listener (the simulated network server), frames to be received are queued with
+ * an over-the-air arrival time and are only delivered if an RX window overlaps it with matching parameters.
+ */
+
+#ifndef SIM_RADIO_H
+#define SIM_RADIO_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC CONSTANTS --------------------------------------------------------
+ */
+
+/**
+ * @brief Number of frames that can wait in the air for an RX window
+ */
+#define SIM_RADIO_MAX_PENDING_FRAMES 8
+
+#define SIM_RADIO_PACKET_TYPE_GFSK 0x00
+#define SIM_RADIO_PACKET_TYPE_LORA 0x01
+#define SIM_RADIO_PACKET_TYPE_LR_FHSS 0x03
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC TYPES ------------------------------------------------------------
+ */
+
+/**
+ * @brief Operating mode of the virtual transceiver
+ */
+typedef enum sim_radio_mode_e
+{
+    SIM_RADIO_MODE_SLEEP = 0,
+    SIM_RADIO_MODE_STANDBY,
+    SIM_RADIO_MODE_FS,
+    SIM_RADIO_MODE_TX,
+    SIM_RADIO_MODE_RX,
+    SIM_RADIO_MODE_CAD,
+    SIM_RADIO_MODE_NB,
+} sim_radio_mode_t;
+
+/**
+ * @brief Over-the-air parameters of a frame
+ */
+typedef struct sim_radio_params_s
+{
+    uint8_t  packet_type;  //!< SIM_RADIO_PACKET_TYPE_xxx
+    uint32_t freq_hz;
+    uint8_t  sf;           //!< LoRa spreading factor
+    uint32_t bw_hz;        //!< LoRa bandwidth
+    uint8_t  cr;           //!< LoRa coding rate, 1 = 4/5 ... 4 = 4/8
+    uint16_t preamble_len;
+    bool     implicit_header;
+    bool     crc_on;
+    bool     iq_inverted;
+    uint32_t bitrate_bps;  //!< GFSK only
+} sim_radio_params_t;
+
+/**
+ * @brief Counters accumulated by the virtual transceiver since sim_radio_init()
+ */
+typedef struct sim_radio_stats_s
+{
+    uint32_t tx_count;
+    uint32_t rx_count;          //!< RX windows opened
+    uint32_t rx_done_count;     //!< frames received
+    uint32_t rx_timeout_count;  //!< windows closed without frame
+    uint32_t missed_count;      //!< frames that left the air while nobody was listening
+    uint32_t cad_count;
+    uint32_t spi_transfers;
+    uint64_t time_in_mode_us[SIM_RADIO_MODE_NB];
+} sim_radio_stats_t;
+
+/**
+ * @brief Called when a frame has been fully transmitted
+ */
+typedef void ( *sim_radio_tx_listener_t )( const uint8_t* payload, uint8_t size, const sim_radio_params_t* params,
+                                           uint64_t tx_end_us );
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS PROTOTYPES --------------------------------------------
+ */
+
+/**
+ * @brief Power-on reset of the model (registers, buffer, irq and counters)
+ */
+void sim_radio_init( void );
+
+/**
+ * @brief SPI write / read transactions as issued by sx126x_hal.c
+ */
+void sim_radio_write( const uint8_t* command, uint16_t command_length, const uint8_t* data, uint16_t data_length );
+void sim_radio_read( const uint8_t* command, uint16_t command_length, uint8_t* data, uint16_t data_length );
+
+/**
+ * @brief NRESET pulse and wake-up from sleep (NSS toggle)
+ */
+void sim_radio_reset( void );
+void sim_radio_wakeup( void );
+
+/**
+ * @brief Register the function notified at every TX done (typically the simulated network server)
+ */
+void sim_radio_set_tx_listener( sim_radio_tx_listener_t listener );
+
+/**
+ * @brief Register a second function notified at every TX done, after the listener (a simulated P2P peer)
+ */
+void sim_radio_set_tx_monitor( sim_radio_tx_listener_t monitor );
+
+/**
+ * @brief Put a frame on the air
+ *
+ * @param [in] payload    Frame bytes
+ * @param [in] size       Frame length
+ * @param [in] params     Over-the-air parameters, the device only receives it with matching settings
+ * @param [in] arrival_us Virtual time at which the preamble starts
+ * @param [in] rssi_dbm   RSSI reported to the device
+ * @param [in] snr_db     SNR reported to the device
+ *
+ * @return false if the air queue is full
+ */
+bool sim_radio_push_frame( const uint8_t* payload, uint8_t size, const sim_radio_params_t* params, uint64_t arrival_us,
+                           int16_t rssi_dbm, int8_t snr_db );
+
+/**
+ * @brief Time on air of a frame, Semtech SX126x formula
+ */
+uint32_t sim_radio_get_time_on_air_us( const sim_radio_params_t* params, uint8_t size );
+
+/**
+ * @brief Current operating mode and counters
+ */
+sim_radio_mode_t sim_radio_get_mode( void );
+void             sim_radio_get_stats( sim_radio_stats_t* stats );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SIM_RADIO_H
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,67 @@
+/*!
+ * \file      sx126x_hal.c
+ *
+ * \brief     SX126x HAL, host-native implementation: SPI transactions are served by the virtual radio
+ */
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <stdint.h>
+
+#include "sx126x_hal.h"
+#include "sim_radio.h"
+#include "smtc_hal_mcu.h"
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE CONSTANTS -------------------------------------------------------
+ */
+
+/**
+ * @brief Average SPI transaction time at 16 MHz including NSS and BUSY handshake on the RAK3112
+ */
+#define SX126X_HAL_SPI_TRANSFER_US 20
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS DEFINITION ---------------------------------------------
+ */
+
+sx126x_hal_status_t sx126x_hal_write( const void* context, const uint8_t* command, const uint16_t command_length,
+                                      const uint8_t* data, const uint16_t data_length )
+{
+    ( void ) context;
+    sim_radio_write( command, command_length, data, data_length );
+    hal_mcu_wait_us( SX126X_HAL_SPI_TRANSFER_US );
+    return SX126X_HAL_STATUS_OK;
+}
+
+sx126x_hal_status_t sx126x_hal_read( const void* context, const uint8_t* command, const uint16_t command_length,
+                                     uint8_t* data, const uint16_t data_length )
+{
+    ( void ) context;
+    sim_radio_read( command, command_length, data, data_length );
+    hal_mcu_wait_us( SX126X_HAL_SPI_TRANSFER_US );
+    return SX126X_HAL_STATUS_OK;
+}
+
+sx126x_hal_status_t sx126x_hal_reset( const void* context )
+{
+    ( void ) context;
+    sim_radio_reset( );
+    hal_mcu_wait_us( 5000 );
+    return SX126X_HAL_STATUS_OK;
+}
+
+sx126x_hal_status_t sx126x_hal_wakeup( const void* context )
+{
+    ( void ) context;
+    sim_radio_wakeup( );
+    hal_mcu_wait_us( 500 );
+    return SX126X_HAL_STATUS_OK;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,36 @@
+/*!
+ * \file      modem_pinout.h
+ *
+ * \brief     Pin mapping of the simulated board
+ *
+ * Mirrors the RAK3112 SX1262 wiring from rakwireless/variants/rak3112/pins_arduino.h so traces printed by the
+ * host build read the same as on target.
+ */
+
+#ifndef MODEM_PINOUT_H
+#define MODEM_PINOUT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC CONSTANTS --------------------------------------------------------
+ */
+
+#define SMTC_RADIO_SPI_SCLK 5
+#define SMTC_RADIO_SPI_MISO 3
+#define SMTC_RADIO_SPI_MOSI 6
+#define SMTC_RADIO_NSS 7
+#define SMTC_RADIO_NRST 8
+#define SMTC_RADIO_DIOX 47
+#define SMTC_RADIO_BUSY 48
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // MODEM_PINOUT_H
+
+/* --- EOF ------------------------------------------------------------------ */
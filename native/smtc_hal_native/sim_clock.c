@@ -0,0 +1,162 @@
+/*!
+ * \file      sim_clock.c
+ *
+ * \brief     Virtual time base used by the host-native port
+ */
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <time.h>
+
+#include "sim_clock.h"
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE TYPES -----------------------------------------------------------
+ */
+
+typedef struct sim_clock_event_s
+{
+    bool                 used;
+    uint64_t             at_us;
+    uint32_t             sequence;  // keeps FIFO order between events sharing the same deadline
+    sim_clock_callback_t callback;
+    void*                context;
+} sim_clock_event_t;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE VARIABLES -------------------------------------------------------
+ */
+
+static uint64_t          now_us;
+static uint32_t          next_sequence;
+static uint64_t          host_start_us;
+static sim_clock_event_t events[SIM_CLOCK_MAX_EVENTS];
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DECLARATION -------------------------------------------
+ */
+
+static uint64_t host_time_us( void );
+static int      earliest_event( void );
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS DEFINITION ---------------------------------------------
+ */
+
+void sim_clock_reset( void )
+{
+    now_us        = 0;
+    next_sequence = 0;
+    host_start_us = host_time_us( );
+    for( int i = 0; i < SIM_CLOCK_MAX_EVENTS; i++ )
+    {
+        events[i].used = false;
+    }
+}
+
+uint64_t sim_clock_now_us( void )
+{
+    return now_us;
+}
+
+uint32_t sim_clock_now_ms( void )
+{
+    return ( uint32_t ) ( now_us / 1000 );
+}
+
+int sim_clock_schedule_at_us( uint64_t at_us, sim_clock_callback_t callback, void* context )
+{
+    for( int i = 0; i < SIM_CLOCK_MAX_EVENTS; i++ )
+    {
+        if( events[i].used == false )
+        {
+            events[i].used     = true;
+            events[i].at_us    = ( at_us < now_us ) ? now_us : at_us;
+            events[i].sequence = next_sequence++;
+            events[i].callback = callback;
+            events[i].context  = context;
+            return i;
+        }
+    }
+    return SIM_CLOCK_INVALID_HANDLE;
+}
+
+void sim_clock_cancel( int handle )
+{
+    if( ( handle >= 0 ) && ( handle < SIM_CLOCK_MAX_EVENTS ) )
+    {
+        events[handle].used = false;
+    }
+}
+
+uint64_t sim_clock_next_event_us( void )
+{
+    int idx = earliest_event( );
+    return ( idx < 0 ) ? SIM_CLOCK_NO_EVENT : events[idx].at_us;
+}
+
+void sim_clock_advance_us( uint64_t delta_us )
+{
+    const uint64_t target_us = now_us + delta_us;
+
+    for( ;; )
+    {
+        int idx = earliest_event( );
+        if( ( idx < 0 ) || ( events[idx].at_us > target_us ) )
+        {
+            break;
+        }
+
+        // Release the slot before calling back: the callback is allowed to re-schedule itself
+        sim_clock_callback_t callback = events[idx].callback;
+        void*                context  = events[idx].context;
+        now_us                        = events[idx].at_us;
+        events[idx].used              = false;
+        callback( context );
+    }
+    now_us = target_us;
+}
+
+uint64_t sim_clock_host_elapsed_us( void )
+{
+    return host_time_us( ) - host_start_us;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DEFINITION --------------------------------------------
+ */
+
+static uint64_t host_time_us( void )
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ( ( uint64_t ) ts.tv_sec * 1000000u ) + ( ( uint64_t ) ts.tv_nsec / 1000u );
+}
+
+static int earliest_event( void )
+{
+    int best = -1;
+    for( int i = 0; i < SIM_CLOCK_MAX_EVENTS; i++ )
+    {
+        if( events[i].used == false )
+        {
+            continue;
+        }
+        if( ( best < 0 ) || ( events[i].at_us < events[best].at_us ) ||
+            ( ( events[i].at_us == events[best].at_us ) && ( events[i].sequence < events[best].sequence ) ) )
+        {
+            best = i;
+        }
+    }
+    return best;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
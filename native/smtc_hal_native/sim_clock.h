@@ -0,0 +1,115 @@
+/*!
+ * \file      sim_clock.h
+ *
+ * \brief     Virtual time base used by the host-native port
+ *
+ * Time only moves when the firmware sleeps or busy-waits. Every pending timer or radio event that falls
+ * inside the skipped interval is fired in order, so the stack runs as fast as the host can execute it while
+ * seeing exactly the same timeline it would see on the board.
+ */
+
+#ifndef SIM_CLOCK_H
+#define SIM_CLOCK_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC CONSTANTS --------------------------------------------------------
+ */
+
+/**
+ * @brief Maximum number of events that can be scheduled at the same time
+ */
+#define SIM_CLOCK_MAX_EVENTS 16
+
+/**
+ * @brief Handle value returned when an event cannot be scheduled
+ */
+#define SIM_CLOCK_INVALID_HANDLE ( -1 )
+
+/**
+ * @brief Value returned by sim_clock_next_event_us() when nothing is scheduled
+ */
+#define SIM_CLOCK_NO_EVENT UINT64_MAX
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC TYPES ------------------------------------------------------------
+ */
+
+/**
+ * @brief Callback fired when the virtual clock reaches an event deadline
+ */
+typedef void ( *sim_clock_callback_t )( void* context );
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS PROTOTYPES --------------------------------------------
+ */
+
+/**
+ * @brief Reset the virtual clock to 0 and drop every scheduled event
+ */
+void sim_clock_reset( void );
+
+/**
+ * @brief Current virtual time in microseconds
+ */
+uint64_t sim_clock_now_us( void );
+
+/**
+ * @brief Current virtual time in milliseconds
+ */
+uint32_t sim_clock_now_ms( void );
+
+/**
+ * @brief Schedule a callback at an absolute virtual time
+ *
+ * @param [in] at_us    Absolute deadline in microseconds (clamped to now if in the past)
+ * @param [in] callback Function to call
+ * @param [in] context  Opaque argument given back to the callback
+ *
+ * @return Handle of the event, SIM_CLOCK_INVALID_HANDLE if the table is full
+ */
+int sim_clock_schedule_at_us( uint64_t at_us, sim_clock_callback_t callback, void* context );
+
+/**
+ * @brief Cancel a scheduled event (no-op if already fired or invalid)
+ */
+void sim_clock_cancel( int handle );
+
+/**
+ * @brief Deadline of the earliest scheduled event, SIM_CLOCK_NO_EVENT if none
+ */
+uint64_t sim_clock_next_event_us( void );
+
+/**
+ * @brief Move the virtual clock forward, firing every event met on the way
+ *
+ * @param [in] delta_us Amount of virtual time to skip
+ */
+void sim_clock_advance_us( uint64_t delta_us );
+
+/**
+ * @brief Wall-clock time spent since the last reset, in microseconds (used to report the speed-up)
+ */
+uint64_t sim_clock_host_elapsed_us( void );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SIM_CLOCK_H
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,205 @@
+/*!
+ * \file      sim_ota.c
+ *
+ * \brief     Host stand-in for the inactive OTA app partition (esp_ota / esp_partition on the RAK3112)
+ */
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "sim_ota.h"
+#include "smtc_hal_mcu.h"
+#include "smtc_modem_hal_native.h"
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE VARIABLES -------------------------------------------------------
+ */
+
+static uint8_t         partition[SIM_OTA_PARTITION_SIZE];
+static bool            erased_at_boot = false;
+static FILE*           file           = NULL;
+static uint32_t        boot_size      = 0;
+static sim_ota_stats_t stats;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DECLARATION -------------------------------------------
+ */
+
+static void boot( void );
+static bool in_partition( uint32_t offset, uint32_t size );
+static void write_through( uint32_t offset, uint32_t size );
+static void charge( uint32_t us );
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS DEFINITION ---------------------------------------------
+ */
+
+bool sim_ota_set_file( const char* path )
+{
+    boot( );
+    if( file != NULL )
+    {
+        fclose( file );
+        file = NULL;
+    }
+    if( path == NULL )
+    {
+        return true;
+    }
+    file = fopen( path, "r+b" );
+    if( file != NULL )
+    {
+        if( fread( partition, 1, sizeof( partition ), file ) != sizeof( partition ) )
+        {
+            memset( partition, 0xFF, sizeof( partition ) );
+        }
+    }
+    else
+    {
+        file = fopen( path, "w+b" );
+    }
+    if( file == NULL )
+    {
+        return false;
+    }
+    write_through( 0, sizeof( partition ) );
+    return true;
+}
+
+bool sim_ota_read( uint32_t offset, uint8_t* data, uint32_t size )
+{
+    boot( );
+    if( in_partition( offset, size ) == false )
+    {
+        return false;
+    }
+    memcpy( data, &partition[offset], size );
+    stats.reads++;
+    stats.read_bytes += size;
+    return true;
+}
+
+bool sim_ota_program( uint32_t offset, const uint8_t* data, uint32_t size )
+{
+    boot( );
+    if( in_partition( offset, size ) == false )
+    {
+        stats.rejected++;
+        return false;
+    }
+    for( uint32_t i = 0; i < size; i++ )
+    {
+        if( ( data[i] & ~partition[offset + i] ) != 0 )
+        {
+            stats.rejected++;
+            return false;
+        }
+    }
+    for( uint32_t i = 0; i < size; i++ )
+    {
+        partition[offset + i] &= data[i];
+    }
+    stats.programs++;
+    stats.program_bytes += size;
+    charge( SMTC_MODEM_HAL_NATIVE_FLASH_PROGRAM_US +
+            ( uint32_t ) ( ( uint64_t ) size * SMTC_MODEM_HAL_NATIVE_FLASH_PROGRAM_NS_PER_BYTE / 1000 ) );
+    write_through( offset, size );
+    return true;
+}
+
+bool sim_ota_erase_sector( uint32_t offset )
+{
+    boot( );
+    if( ( offset % SIM_OTA_SECTOR_SIZE ) != 0 || ( in_partition( offset, SIM_OTA_SECTOR_SIZE ) == false ) )
+    {
+        stats.rejected++;
+        return false;
+    }
+    memset( &partition[offset], 0xFF, SIM_OTA_SECTOR_SIZE );
+    stats.erases++;
+    charge( SMTC_MODEM_HAL_NATIVE_FLASH_ERASE_US );
+    write_through( offset, SIM_OTA_SECTOR_SIZE );
+    return true;
+}
+
+bool sim_ota_set_boot( uint32_t size )
+{
+    boot( );
+    if( ( size == 0 ) || ( size > sizeof( partition ) ) || ( partition[0] != SIM_OTA_IMAGE_MAGIC ) )
+    {
+        return false;
+    }
+    boot_size = size;
+    return true;
+}
+
+uint32_t sim_ota_get_boot_size( void )
+{
+    return boot_size;
+}
+
+void sim_ota_get_stats( sim_ota_stats_t* stats_out )
+{
+    *stats_out = stats;
+}
+
+void sim_ota_reset_stats( void )
+{
+    memset( &stats, 0, sizeof( stats ) );
+}
+
+void sim_ota_flush( void )
+{
+    if( file != NULL )
+    {
+        fflush( file );
+    }
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DEFINITION --------------------------------------------
+ */
+
+static void boot( void )
+{
+    // Zero-initialized storage: the partition starts erased
+    if( erased_at_boot == false )
+    {
+        memset( partition, 0xFF, sizeof( partition ) );
+        erased_at_boot = true;
+    }
+}
+
+static bool in_partition( uint32_t offset, uint32_t size )
+{
+    return ( offset <= sizeof( partition ) ) && ( size <= ( sizeof( partition ) - offset ) );
+}
+
+static void write_through( uint32_t offset, uint32_t size )
+{
+    if( file == NULL )
+    {
+        return;
+    }
+    if( fseek( file, ( long ) offset, SEEK_SET ) == 0 )
+    {
+        fwrite( &partition[offset], 1, size, file );
+    }
+}
+
+static void charge( uint32_t us )
+{
+    stats.busy_us += us;
+    hal_mcu_wait_us( ( int32_t ) us );
+}
+
+/* --- EOF ------------------------------------------------------------------ */
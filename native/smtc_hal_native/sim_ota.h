@@ -0,0 +1,113 @@
+/*!
+ * \file      sim_ota.h
+ *
+ * \brief     Host stand-in for the inactive OTA app partition (esp_ota / esp_partition on the RAK3112)
+ *
+ * The partition is a simulated SPI NOR flash: erased bytes read 0xFF, programming can only clear bits, erasing
+ * works on 4 KB sectors and each operation charges the busy time of the RAK3112 flash to the virtual clock. It can
+ * be backed by a file so the image written by a test can be inspected afterwards. Selecting the partition for the
+ * next boot checks the first byte of the image like the bootloader checks the magic of an app image.
+ */
+
+#ifndef SIM_OTA_H
+#define SIM_OTA_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC CONSTANTS --------------------------------------------------------
+ */
+
+/**
+ * @brief Size of the partition, the app1 slot of partitions_rak3112.csv
+ */
+#define SIM_OTA_PARTITION_SIZE 0x300000
+#define SIM_OTA_SECTOR_SIZE 4096
+
+/**
+ * @brief First byte of an app image (ESP_IMAGE_HEADER_MAGIC)
+ */
+#define SIM_OTA_IMAGE_MAGIC 0xE9
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC TYPES ------------------------------------------------------------
+ */
+
+typedef struct sim_ota_stats_s
+{
+    uint32_t reads;
+    uint32_t read_bytes;
+    uint32_t programs;
+    uint32_t program_bytes;
+    uint32_t erases;
+    uint32_t rejected;  //!< programs or erases refused: out of the partition or not erased before programming
+    uint64_t busy_us;   //!< charged to the virtual clock
+} sim_ota_stats_t;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS PROTOTYPES --------------------------------------------
+ */
+
+/**
+ * @brief Back the partition with a file, loading its content if it has the size of the partition
+ *
+ * @param [in] path File path, NULL keeps the partition in RAM only
+ *
+ * @return false if the file cannot be created
+ */
+bool sim_ota_set_file( const char* path );
+
+/**
+ * @brief Partition access, offsets relative to its start
+ *
+ * Programming bits back to 1 is refused like esp_partition_write() refuses it with flash encryption off: a
+ * writer that forgets an erase is caught instead of silently leaving corrupted bytes.
+ *
+ * @return false if the range is out of the partition or the program is refused
+ */
+bool sim_ota_read( uint32_t offset, uint8_t* data, uint32_t size );
+bool sim_ota_program( uint32_t offset, const uint8_t* data, uint32_t size );
+bool sim_ota_erase_sector( uint32_t offset );
+
+/**
+ * @brief Select the partition for the next boot
+ *
+ * @param [in] size Size of the image at the start of the partition
+ *
+ * @return false if the image does not start with SIM_OTA_IMAGE_MAGIC or does not fit
+ */
+bool sim_ota_set_boot( uint32_t size );
+
+/**
+ * @brief Size of the image selected for the next boot, 0 if none
+ */
+uint32_t sim_ota_get_boot_size( void );
+
+void sim_ota_get_stats( sim_ota_stats_t* stats );
+void sim_ota_reset_stats( void );
+
+/**
+ * @brief Write the whole partition back to the file now (every operation already writes its range through)
+ */
+void sim_ota_flush( void );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SIM_OTA_H
+
+/* --- EOF ------------------------------------------------------------------ */
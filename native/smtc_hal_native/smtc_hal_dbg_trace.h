@@ -0,0 +1,125 @@
+/*!
+ * \file      smtc_hal_dbg_trace.h
+ *
+ * \brief     Debug trace module, host-native implementation (prints on stdout)
+ */
+
+#ifndef SMTC_HAL_DBG_TRACE_H
+#define SMTC_HAL_DBG_TRACE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC MACROS -----------------------------------------------------------
+ */
+
+#define HAL_FEATURE_OFF 0
+#define HAL_FEATURE_ON !HAL_FEATURE_OFF
+
+#ifndef HAL_DBG_TRACE
+#define HAL_DBG_TRACE HAL_FEATURE_ON
+#endif
+
+#define HAL_DBG_TRACE_COLOR_BLACK "\x1B[0;30m"
+#define HAL_DBG_TRACE_COLOR_RED "\x1B[0;31m"
+#define HAL_DBG_TRACE_COLOR_GREEN "\x1B[0;32m"
+#define HAL_DBG_TRACE_COLOR_YELLOW "\x1B[0;33m"
+#define HAL_DBG_TRACE_COLOR_BLUE "\x1B[0;34m"
+#define HAL_DBG_TRACE_COLOR_MAGENTA "\x1B[0;35m"
+#define HAL_DBG_TRACE_COLOR_CYAN "\x1B[0;36m"
+#define HAL_DBG_TRACE_COLOR_WHITE "\x1B[0;37m"
+#define HAL_DBG_TRACE_COLOR_DEFAULT "\x1B[0m"
+
+#if( HAL_DBG_TRACE == HAL_FEATURE_ON )
+
+#define SMTC_HAL_TRACE_PRINTF( ... ) hal_trace_print( __VA_ARGS__ )
+
+#define SMTC_HAL_TRACE_MSG( msg ) hal_trace_print( "%s", msg )
+
+#define SMTC_HAL_TRACE_MSG_COLOR( msg, color ) \
+    hal_trace_print( "%s%s%s", color, msg, HAL_DBG_TRACE_COLOR_DEFAULT )
+
+#define SMTC_HAL_TRACE_INFO( ... )                                 \
+    do                                                             \
+    {                                                              \
+        hal_trace_print( "%sINFO: ", HAL_DBG_TRACE_COLOR_GREEN );  \
+        hal_trace_print( __VA_ARGS__ );                            \
+        hal_trace_print( "%s", HAL_DBG_TRACE_COLOR_DEFAULT );      \
+    } while( 0 )
+
+#define SMTC_HAL_TRACE_WARNING( ... )                                \
+    do                                                               \
+    {                                                                \
+        hal_trace_print( "%sWARN: ", HAL_DBG_TRACE_COLOR_YELLOW );   \
+        hal_trace_print( __VA_ARGS__ );                              \
+        hal_trace_print( "%s", HAL_DBG_TRACE_COLOR_DEFAULT );        \
+    } while( 0 )
+
+#define SMTC_HAL_TRACE_ERROR( ... )                               \
+    do                                                            \
+    {                                                             \
+        hal_trace_print( "%sERROR: ", HAL_DBG_TRACE_COLOR_RED );  \
+        hal_trace_print( __VA_ARGS__ );                           \
+        hal_trace_print( "%s", HAL_DBG_TRACE_COLOR_DEFAULT );     \
+    } while( 0 )
+
+#define SMTC_HAL_TRACE_ARRAY( msg, array, len )                   \
+    do                                                            \
+    {                                                             \
+        hal_trace_print( "%s - (%u bytes):\n", msg, ( unsigned ) len );  \
+        for( uint32_t i = 0; i < ( uint32_t ) len; i++ )          \
+        {                                                         \
+            if( ( ( i % 16 ) == 0 ) && ( i > 0 ) )                \
+            {                                                     \
+                hal_trace_print( "\n" );                          \
+            }                                                     \
+            hal_trace_print( " %02X", array[i] );                 \
+        }                                                         \
+        hal_trace_print( "\n" );                                  \
+    } while( 0 )
+
+#else
+
+#define SMTC_HAL_TRACE_PRINTF( ... )
+#define SMTC_HAL_TRACE_MSG( msg )
+#define SMTC_HAL_TRACE_MSG_COLOR( msg, color )
+#define SMTC_HAL_TRACE_INFO( ... )
+#define SMTC_HAL_TRACE_WARNING( ... )
+#define SMTC_HAL_TRACE_ERROR( ... )
+#define SMTC_HAL_TRACE_ARRAY( msg, array, len )
+
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS PROTOTYPES --------------------------------------------
+ */
+
+/**
+ * @brief Print a formatted trace on stdout unless the simulator runs in quiet mode
+ */
+void hal_trace_print( const char* fmt, ... );
+
+/**
+ * @brief Silence every trace (keeps benchmark runs clean)
+ */
+void hal_trace_set_quiet( bool quiet );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SMTC_HAL_DBG_TRACE_H
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,58 @@
+/*!
+ * \file      smtc_hal_gpio.h
+ *
+ * \brief     GPIO Hardware Abstraction Layer, host-native implementation
+ *
+ * The simulated board has no real pins: the radio lines (NSS, BUSY, DIO1, NRESET) are modelled inside the
+ * virtual radio. Only the type definitions used by shared code are kept.
+ */
+
+#ifndef SMTC_HAL_GPIO_H
+#define SMTC_HAL_GPIO_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC TYPES ------------------------------------------------------------
+ */
+
+typedef enum hal_gpio_pull_mode_e
+{
+    BSP_GPIO_PULL_MODE_NONE = 0,
+    BSP_GPIO_PULL_MODE_UP   = 1,
+    BSP_GPIO_PULL_MODE_DOWN = 2,
+} hal_gpio_pull_mode_t;
+
+typedef enum hal_gpio_irq_mode_e
+{
+    BSP_GPIO_IRQ_MODE_OFF            = 0,
+    BSP_GPIO_IRQ_MODE_RISING         = 1,
+    BSP_GPIO_IRQ_MODE_FALLING        = 2,
+    BSP_GPIO_IRQ_MODE_RISING_FALLING = 3,
+} hal_gpio_irq_mode_t;
+
+typedef struct hal_gpio_irq_s
+{
+    uint32_t pin;
+    void*    context;
+    void ( *callback )( void* context );
+} hal_gpio_irq_t;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SMTC_HAL_GPIO_H
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,105 @@
+/*!
+ * \file      smtc_hal_mcu.c
+ *
+ * \brief     MCU Hardware Abstraction Layer, host-native implementation
+ */
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+
+#include "smtc_hal_mcu.h"
+#include "smtc_hal_dbg_trace.h"
+#include "smtc_modem_hal_native.h"
+#include "sim_clock.h"
+#include "sim_radio.h"
+#include "sim_network.h"
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE VARIABLES -------------------------------------------------------
+ */
+
+static bool irq_enabled = true;
+static bool trace_quiet = false;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS DEFINITION ---------------------------------------------
+ */
+
+void hal_mcu_init( void )
+{
+    sim_radio_init( );
+    sim_network_init( );
+}
+
+void hal_mcu_disable_irq( void )
+{
+    irq_enabled = false;
+}
+
+void hal_mcu_enable_irq( void )
+{
+    irq_enabled = true;
+    smtc_modem_hal_native_flush_pending_irq( );
+}
+
+bool hal_mcu_irq_is_enabled( void )
+{
+    return irq_enabled;
+}
+
+void hal_mcu_reset( void )
+{
+    hal_trace_print( "MCU reset requested at %u ms (virtual)\n", sim_clock_now_ms( ) );
+    fflush( stdout );
+    exit( 3 );
+}
+
+void hal_mcu_wait_us( const int32_t microseconds )
+{
+    if( microseconds > 0 )
+    {
+        sim_clock_advance_us( ( uint64_t ) microseconds );
+    }
+}
+
+void hal_mcu_set_sleep_for_ms( const int32_t milliseconds )
+{
+    if( milliseconds > 0 )
+    {
+        sim_clock_advance_us( ( uint64_t ) milliseconds * 1000u );
+    }
+}
+
+void hal_mcu_panic_trace( const char* func, uint32_t line )
+{
+    fprintf( stderr, "MCU panic in %s (line %u)\n", func, line );
+    fflush( stdout );
+    abort( );
+}
+
+void hal_trace_print( const char* fmt, ... )
+{
+    if( trace_quiet == true )
+    {
+        return;
+    }
+    va_list args;
+    va_start( args, fmt );
+    vprintf( fmt, args );
+    va_end( args );
+}
+
+void hal_trace_set_quiet( bool quiet )
+{
+    trace_quiet = quiet;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,91 @@
+/*!
+ * \file      smtc_hal_mcu.h
+ *
+ * \brief     MCU Hardware Abstraction Layer, host-native implementation
+ */
+
+#ifndef SMTC_HAL_MCU_H
+#define SMTC_HAL_MCU_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC MACROS -----------------------------------------------------------
+ */
+
+/**
+ * @brief Panic function for mcu issues
+ */
+#define mcu_panic( ... )                            \
+    do                                              \
+    {                                               \
+        hal_mcu_panic_trace( __func__, __LINE__ );  \
+    } while( 0 )
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS PROTOTYPES --------------------------------------------
+ */
+
+/**
+ * @brief Initializes the simulated MCU: virtual clock, radio model and network server
+ */
+void hal_mcu_init( void );
+
+/**
+ * @brief Disable all irq (modem timer and radio DIO1 are held pending)
+ */
+void hal_mcu_disable_irq( void );
+
+/**
+ * @brief Enable all irq and deliver the ones held while disabled
+ */
+void hal_mcu_enable_irq( void );
+
+/**
+ * @brief Tell whether the global irq are currently enabled
+ */
+bool hal_mcu_irq_is_enabled( void );
+
+/**
+ * @brief Reset the MCU (terminates the host process with the reset status)
+ */
+void hal_mcu_reset( void );
+
+/**
+ * @brief Busy wait, advances the virtual clock
+ *
+ * @param [in] microseconds Delay in us
+ */
+void hal_mcu_wait_us( const int32_t microseconds );
+
+/**
+ * @brief Sleep, advances the virtual clock and fires every event met on the way
+ *
+ * @param [in] milliseconds Sleep time in ms
+ */
+void hal_mcu_set_sleep_for_ms( const int32_t milliseconds );
+
+/**
+ * @brief Print the function name and line where a panic happened and abort
+ */
+void hal_mcu_panic_trace( const char* func, uint32_t line );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SMTC_HAL_MCU_H
+
+/* --- EOF ------------------------------------------------------------------ */
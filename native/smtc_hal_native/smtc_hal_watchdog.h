@@ -0,0 +1,35 @@
+/*!
+ * \file      smtc_hal_watchdog.h
+ *
+ * \brief     Watchdog Hardware Abstraction Layer, host-native implementation
+ */
+
+#ifndef SMTC_HAL_WATCHDOG_H
+#define SMTC_HAL_WATCHDOG_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS PROTOTYPES --------------------------------------------
+ */
+
+/**
+ * @brief Initializes the watchdog (no-op on host)
+ */
+static inline void hal_watchdog_init( void ) {}
+
+/**
+ * @brief Reloads the watchdog (no-op on host)
+ */
+static inline void hal_watchdog_reload( void ) {}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SMTC_HAL_WATCHDOG_H
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,530 @@
+/*!
+ * \file      smtc_modem_hal.c
+ *
+ * \brief     Modem Hardware Abstraction Layer, host-native implementation
+ *
+ * Stand-in for smtc_modem_hal_rak3112: time comes from the virtual clock, the radio irq from the virtual
+ * SX126x and the context storage from a RAM (optionally file backed) flash image. A simulated NOR flash with power
+ * loss injection backs the lbm_nvm journal.
+ */
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "smtc_modem_hal.h"
+#include "smtc_modem_hal_native.h"
+#include "smtc_hal_mcu.h"
+#include "smtc_hal_dbg_trace.h"
+#include "sim_clock.h"
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE CONSTANTS -------------------------------------------------------
+ */
+
+#define CRASHLOG_MAX_LENGTH 32
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE TYPES -----------------------------------------------------------
+ */
+
+typedef enum flash_operation_e
+{
+    FLASH_OPERATION_DONE,
+    FLASH_OPERATION_TORN,  // power cut in the middle of it
+    FLASH_OPERATION_LOST,  // power already off
+} flash_operation_t;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE VARIABLES -------------------------------------------------------
+ */
+
+static void ( *timer_callback )( void* context ) = NULL;
+static void* timer_context                       = NULL;
+static int   timer_handle                        = SIM_CLOCK_INVALID_HANDLE;
+static bool  timer_pending                       = false;
+
+static void ( *radio_irq_callback )( void* context ) = NULL;
+static void* radio_irq_context                       = NULL;
+static bool  radio_irq_pending                       = false;
+
+static bool modem_irq_enabled = true;
+
+static uint32_t time_offset_ms = 0;
+static uint32_t random_state   = 0x12345678;
+
+static uint8_t     nvm[SMTC_MODEM_HAL_NATIVE_CONTEXT_NB][SMTC_MODEM_HAL_NATIVE_CONTEXT_SIZE];
+static const char* nvm_file        = NULL;
+static uint32_t    nvm_write_count = 0;
+static uint32_t    nvm_write_bytes = 0;
+
+static uint8_t  flash[SMTC_MODEM_HAL_NATIVE_FLASH_SIZE];
+static uint32_t flash_operations     = 0;
+static uint32_t flash_cut_at         = 0;
+static bool     flash_power_lost     = false;
+static bool     flash_erased_at_boot = false;
+
+static uint8_t crashlog[CRASHLOG_MAX_LENGTH];
+static uint8_t crashlog_length    = 0;
+static bool    crashlog_available = false;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DECLARATION -------------------------------------------
+ */
+
+static bool irq_can_fire( void );
+static void timer_expired( void* context );
+static void nvm_load( void );
+static void nvm_flush( void );
+static void flash_boot( void );
+static flash_operation_t flash_start_operation( void );
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS DEFINITION ---------------------------------------------
+ */
+
+void smtc_modem_hal_reset_mcu( void )
+{
+    hal_mcu_reset( );
+}
+
+void smtc_modem_hal_reload_wdog( void )
+{
+}
+
+uint32_t smtc_modem_hal_get_time_in_s( void )
+{
+    return smtc_modem_hal_get_time_in_ms( ) / 1000;
+}
+
+uint32_t smtc_modem_hal_get_time_in_ms( void )
+{
+    return sim_clock_now_ms( ) + time_offset_ms;
+}
+
+void smtc_modem_hal_set_offset_to_test_wrapping( const uint32_t offset_to_test_wrapping )
+{
+    time_offset_ms = offset_to_test_wrapping;
+}
+
+void smtc_modem_hal_start_timer( const uint32_t milliseconds, void ( *callback )( void* context ), void* context )
+{
+    smtc_modem_hal_stop_timer( );
+    timer_callback = callback;
+    timer_context  = context;
+    timer_handle   = sim_clock_schedule_at_us( sim_clock_now_us( ) + ( ( uint64_t ) milliseconds * 1000u ),
+                                               timer_expired, NULL );
+}
+
+void smtc_modem_hal_stop_timer( void )
+{
+    sim_clock_cancel( timer_handle );
+    timer_handle  = SIM_CLOCK_INVALID_HANDLE;
+    timer_pending = false;
+}
+
+void smtc_modem_hal_disable_modem_irq( void )
+{
+    modem_irq_enabled = false;
+}
+
+void smtc_modem_hal_enable_modem_irq( void )
+{
+    modem_irq_enabled = true;
+    smtc_modem_hal_native_flush_pending_irq( );
+}
+
+void smtc_modem_hal_context_restore( const modem_context_type_t ctx_type, uint32_t offset, uint8_t* buffer,
+                                     const uint32_t size )
+{
+    if( ( ( uint32_t ) ctx_type >= SMTC_MODEM_HAL_NATIVE_CONTEXT_NB ) ||
+        ( ( offset + size ) > SMTC_MODEM_HAL_NATIVE_CONTEXT_SIZE ) )
+    {
+        smtc_modem_hal_on_panic( ( uint8_t* ) __func__, __LINE__, "context restore out of bounds\n" );
+        return;
+    }
+    memcpy( buffer, &nvm[ctx_type][offset], size );
+}
+
+void smtc_modem_hal_context_store( const modem_context_type_t ctx_type, uint32_t offset, const uint8_t* buffer,
+                                   const uint32_t size )
+{
+    if( ( ( uint32_t ) ctx_type >= SMTC_MODEM_HAL_NATIVE_CONTEXT_NB ) ||
+        ( ( offset + size ) > SMTC_MODEM_HAL_NATIVE_CONTEXT_SIZE ) )
+    {
+        smtc_modem_hal_on_panic( ( uint8_t* ) __func__, __LINE__, "context store out of bounds\n" );
+        return;
+    }
+    memcpy( &nvm[ctx_type][offset], buffer, size );
+    nvm_write_count++;
+    nvm_write_bytes += size;
+    nvm_flush( );
+}
+
+void smtc_modem_hal_context_flash_pages_erase( const modem_context_type_t ctx_type, uint32_t offset, uint8_t nb_page )
+{
+    ( void ) nb_page;
+    if( ( ( uint32_t ) ctx_type < SMTC_MODEM_HAL_NATIVE_CONTEXT_NB ) && ( offset < SMTC_MODEM_HAL_NATIVE_CONTEXT_SIZE ) )
+    {
+        memset( &nvm[ctx_type][offset], 0xFF, SMTC_MODEM_HAL_NATIVE_CONTEXT_SIZE - offset );
+        nvm_flush( );
+    }
+}
+
+void smtc_modem_hal_crashlog_store( const uint8_t* crash_string, uint8_t crash_string_length )
+{
+    crashlog_length = ( crash_string_length > CRASHLOG_MAX_LENGTH ) ? CRASHLOG_MAX_LENGTH : crash_string_length;
+    memcpy( crashlog, crash_string, crashlog_length );
+}
+
+void smtc_modem_hal_crashlog_restore( uint8_t* crash_string, uint8_t* crash_string_length )
+{
+    memcpy( crash_string, crashlog, crashlog_length );
+    *crash_string_length = crashlog_length;
+}
+
+void smtc_modem_hal_crashlog_set_status( bool available )
+{
+    crashlog_available = available;
+}
+
+bool smtc_modem_hal_crashlog_get_status( void )
+{
+    return crashlog_available;
+}
+
+void smtc_modem_hal_on_panic( uint8_t* func, uint32_t line, const char* fmt, ... )
+{
+    va_list args;
+    fprintf( stderr, "Modem panic in %s (line %u) at %u ms: ", ( const char* ) func, line, sim_clock_now_ms( ) );
+    va_start( args, fmt );
+    vfprintf( stderr, fmt, args );
+    va_end( args );
+    hal_mcu_reset( );
+}
+
+uint32_t smtc_modem_hal_get_random_nb_in_range( const uint32_t val_1, const uint32_t val_2 )
+{
+    // xorshift32: deterministic for a given seed so simulated runs can be replayed
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+
+    if( val_1 <= val_2 )
+    {
+        return ( random_state % ( val_2 - val_1 + 1 ) ) + val_1;
+    }
+    return ( random_state % ( val_1 - val_2 + 1 ) ) + val_2;
+}
+
+void smtc_modem_hal_irq_config_radio_irq( void ( *callback )( void* context ), void* context )
+{
+    radio_irq_callback = callback;
+    radio_irq_context  = context;
+}
+
+void smtc_modem_hal_radio_irq_clear_pending( void )
+{
+    radio_irq_pending = false;
+}
+
+void smtc_modem_hal_start_radio_tcxo( void )
+{
+}
+
+void smtc_modem_hal_stop_radio_tcxo( void )
+{
+}
+
+uint32_t smtc_modem_hal_get_radio_tcxo_startup_delay_ms( void )
+{
+    return 0;
+}
+
+void smtc_modem_hal_set_ant_switch( bool is_tx_on )
+{
+    ( void ) is_tx_on;
+}
+
+uint8_t smtc_modem_hal_get_battery_level( void )
+{
+    return 254;
+}
+
+int8_t smtc_modem_hal_get_board_delay_ms( void )
+{
+    return 1;
+}
+
+void smtc_modem_hal_print_trace( const char* fmt, ... )
+{
+    char    buf[256];
+    va_list args;
+    va_start( args, fmt );
+    vsnprintf( buf, sizeof( buf ), fmt, args );
+    va_end( args );
+    hal_trace_print( "%s", buf );
+}
+
+int8_t smtc_modem_hal_get_temperature( void )
+{
+    return 25;
+}
+
+uint16_t smtc_modem_hal_get_voltage_mv( void )
+{
+    return 3300;
+}
+
+void smtc_modem_hal_user_lbm_irq( void )
+{
+}
+
+uint32_t smtc_modem_hal_store_and_forward_get_number_of_pages( void )
+{
+    return 0;
+}
+
+uint16_t smtc_modem_hal_flash_get_page_size( void )
+{
+    return SMTC_MODEM_HAL_NATIVE_CONTEXT_SIZE;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- HOST-ONLY FUNCTIONS DEFINITION ------------------------------------------
+ */
+
+void smtc_modem_hal_native_set_nvm_file( const char* path )
+{
+    nvm_file = path;
+    memset( nvm, 0xFF, sizeof( nvm ) );
+    memset( flash, 0xFF, sizeof( flash ) );
+    flash_erased_at_boot = true;
+    nvm_load( );
+}
+
+void smtc_modem_hal_native_set_seed( uint32_t seed )
+{
+    random_state = ( seed != 0 ) ? seed : 0x12345678;
+}
+
+void smtc_modem_hal_native_flush_pending_irq( void )
+{
+    // Radio first: on target DIO1 has a higher priority than the RTC alarm
+    while( irq_can_fire( ) && ( radio_irq_pending || timer_pending ) )
+    {
+        if( radio_irq_pending )
+        {
+            radio_irq_pending = false;
+            if( radio_irq_callback != NULL )
+            {
+                radio_irq_callback( radio_irq_context );
+            }
+        }
+        else
+        {
+            timer_pending = false;
+            if( timer_callback != NULL )
+            {
+                timer_callback( timer_context );
+            }
+        }
+    }
+}
+
+void smtc_modem_hal_native_radio_irq( void )
+{
+    radio_irq_pending = true;
+    smtc_modem_hal_native_flush_pending_irq( );
+}
+
+uint32_t smtc_modem_hal_native_get_nvm_write_count( void )
+{
+    return nvm_write_count;
+}
+
+uint32_t smtc_modem_hal_native_get_nvm_write_bytes( void )
+{
+    return nvm_write_bytes;
+}
+
+bool smtc_modem_hal_native_flash_read( uint32_t address, uint8_t* data, uint32_t size )
+{
+    flash_boot( );
+    if( ( address > SMTC_MODEM_HAL_NATIVE_FLASH_SIZE ) || ( size > ( SMTC_MODEM_HAL_NATIVE_FLASH_SIZE - address ) ) )
+    {
+        return false;
+    }
+    memcpy( data, &flash[address], size );
+    return true;
+}
+
+bool smtc_modem_hal_native_flash_program( uint32_t address, const uint8_t* data, uint32_t size )
+{
+    flash_boot( );
+    if( ( address > SMTC_MODEM_HAL_NATIVE_FLASH_SIZE ) || ( size > ( SMTC_MODEM_HAL_NATIVE_FLASH_SIZE - address ) ) )
+    {
+        return false;
+    }
+    const flash_operation_t operation = flash_start_operation( );
+    if( operation == FLASH_OPERATION_LOST )
+    {
+        return false;
+    }
+    const uint32_t written = ( operation == FLASH_OPERATION_DONE ) ? size : size / 2;
+    for( uint32_t i = 0; i < written; i++ )
+    {
+        flash[address + i] &= data[i];
+    }
+    hal_mcu_wait_us( SMTC_MODEM_HAL_NATIVE_FLASH_PROGRAM_US +
+                     ( int32_t ) ( ( uint64_t ) written * SMTC_MODEM_HAL_NATIVE_FLASH_PROGRAM_NS_PER_BYTE / 1000 ) );
+    nvm_flush( );
+    return operation == FLASH_OPERATION_DONE;
+}
+
+bool smtc_modem_hal_native_flash_erase_sector( uint32_t address )
+{
+    flash_boot( );
+    if( address >= SMTC_MODEM_HAL_NATIVE_FLASH_SIZE )
+    {
+        return false;
+    }
+    const flash_operation_t operation = flash_start_operation( );
+    if( operation == FLASH_OPERATION_LOST )
+    {
+        return false;
+    }
+    const uint32_t sector = address - ( address % SMTC_MODEM_HAL_NATIVE_FLASH_SECTOR_SIZE );
+    memset( &flash[sector], 0xFF,
+            ( operation == FLASH_OPERATION_DONE ) ? SMTC_MODEM_HAL_NATIVE_FLASH_SECTOR_SIZE
+                                                  : SMTC_MODEM_HAL_NATIVE_FLASH_SECTOR_SIZE / 2 );
+    hal_mcu_wait_us( SMTC_MODEM_HAL_NATIVE_FLASH_ERASE_US );
+    nvm_flush( );
+    return operation == FLASH_OPERATION_DONE;
+}
+
+void smtc_modem_hal_native_flash_cut_power_after( uint32_t operations )
+{
+    flash_cut_at = ( operations == 0 ) ? 0 : flash_operations + operations;
+}
+
+bool smtc_modem_hal_native_flash_power_lost( void )
+{
+    return flash_power_lost;
+}
+
+void smtc_modem_hal_native_flash_restore_power( void )
+{
+    flash_power_lost = false;
+    flash_cut_at     = 0;
+}
+
+uint32_t smtc_modem_hal_native_flash_get_operation_count( void )
+{
+    return flash_operations;
+}
+
+void smtc_modem_hal_native_flash_save( uint8_t* image )
+{
+    flash_boot( );
+    memcpy( image, flash, sizeof( flash ) );
+}
+
+void smtc_modem_hal_native_flash_load( const uint8_t* image )
+{
+    flash_boot( );
+    memcpy( flash, image, sizeof( flash ) );
+    nvm_flush( );
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DEFINITION --------------------------------------------
+ */
+
+static bool irq_can_fire( void )
+{
+    return modem_irq_enabled && hal_mcu_irq_is_enabled( );
+}
+
+static void timer_expired( void* context )
+{
+    ( void ) context;
+    timer_handle  = SIM_CLOCK_INVALID_HANDLE;
+    timer_pending = true;
+    smtc_modem_hal_native_flush_pending_irq( );
+}
+
+static void nvm_load( void )
+{
+    if( nvm_file == NULL )
+    {
+        return;
+    }
+    FILE* f = fopen( nvm_file, "rb" );
+    if( f != NULL )
+    {
+        // Context areas, then the flash image
+        if( ( fread( nvm, 1, sizeof( nvm ), f ) != sizeof( nvm ) ) ||
+            ( fread( flash, 1, sizeof( flash ), f ) != sizeof( flash ) ) )
+        {
+            memset( nvm, 0xFF, sizeof( nvm ) );
+            memset( flash, 0xFF, sizeof( flash ) );
+        }
+        fclose( f );
+    }
+}
+
+static void nvm_flush( void )
+{
+    if( nvm_file == NULL )
+    {
+        return;
+    }
+    FILE* f = fopen( nvm_file, "wb" );
+    if( f != NULL )
+    {
+        fwrite( nvm, 1, sizeof( nvm ), f );
+        fwrite( flash, 1, sizeof( flash ), f );
+        fclose( f );
+    }
+}
+
+static void flash_boot( void )
+{
+    // Zero-initialized storage: the flash starts erased
+    if( flash_erased_at_boot == false )
+    {
+        memset( flash, 0xFF, sizeof( flash ) );
+        flash_erased_at_boot = true;
+    }
+}
+
+static flash_operation_t flash_start_operation( void )
+{
+    if( flash_power_lost == true )
+    {
+        return FLASH_OPERATION_LOST;
+    }
+    flash_operations++;
+    if( flash_operations == flash_cut_at )
+    {
+        flash_power_lost = true;
+        return FLASH_OPERATION_TORN;
+    }
+    return FLASH_OPERATION_DONE;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
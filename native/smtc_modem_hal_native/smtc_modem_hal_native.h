@@ -0,0 +1,123 @@
+/*!
+ * \file      smtc_modem_hal_native.h
+ *
+ * \brief     Host-only extensions of the modem HAL (simulation control, not part of smtc_modem_hal.h)
+ */
+
+#ifndef SMTC_MODEM_HAL_NATIVE_H
+#define SMTC_MODEM_HAL_NATIVE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC CONSTANTS --------------------------------------------------------
+ */
+
+/**
+ * @brief Size of the simulated flash area reserved for each context type
+ */
+#define SMTC_MODEM_HAL_NATIVE_CONTEXT_SIZE 4096
+
+/**
+ * @brief Number of context types the simulated flash can hold
+ */
+#define SMTC_MODEM_HAL_NATIVE_CONTEXT_NB 8
+
+/**
+ * @brief Simulated SPI NOR flash holding the lbm_nvm journal (the lbm_nvm partition on target)
+ *
+ * Erased bytes read 0xFF, programming can only clear bits, erasing works on whole sectors.
+ */
+#define SMTC_MODEM_HAL_NATIVE_FLASH_SIZE 65536
+#define SMTC_MODEM_HAL_NATIVE_FLASH_SECTOR_SIZE 4096
+
+/**
+ * @brief Busy time of the simulated flash, charged to the virtual clock (typical values of the RAK3112 flash)
+ */
+#define SMTC_MODEM_HAL_NATIVE_FLASH_ERASE_US 45000
+#define SMTC_MODEM_HAL_NATIVE_FLASH_PROGRAM_US 30
+#define SMTC_MODEM_HAL_NATIVE_FLASH_PROGRAM_NS_PER_BYTE 2500
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS PROTOTYPES --------------------------------------------
+ */
+
+/**
+ * @brief Back the simulated flash with a file so contexts survive between runs
+ *
+ * @param [in] path File path, NULL keeps the contexts in RAM only (every run starts from a blank flash)
+ */
+void smtc_modem_hal_native_set_nvm_file( const char* path );
+
+/**
+ * @brief Seed the pseudo random generator behind smtc_modem_hal_get_random_nb_in_range()
+ */
+void smtc_modem_hal_native_set_seed( uint32_t seed );
+
+/**
+ * @brief Deliver modem timer / radio irq that fired while irq were masked
+ */
+void smtc_modem_hal_native_flush_pending_irq( void );
+
+/**
+ * @brief Raise the radio DIO1 line (called by the virtual radio)
+ */
+void smtc_modem_hal_native_radio_irq( void );
+
+/**
+ * @brief Number of context store calls and bytes written since boot
+ */
+uint32_t smtc_modem_hal_native_get_nvm_write_count( void );
+uint32_t smtc_modem_hal_native_get_nvm_write_bytes( void );
+
+/**
+ * @brief Simulated flash access
+ *
+ * @return false if the range is out of the flash or the power has been cut
+ */
+bool smtc_modem_hal_native_flash_read( uint32_t address, uint8_t* data, uint32_t size );
+bool smtc_modem_hal_native_flash_program( uint32_t address, const uint8_t* data, uint32_t size );
+bool smtc_modem_hal_native_flash_erase_sector( uint32_t address );
+
+/**
+ * @brief Cut the power during a future program or erase
+ *
+ * The operation is left half done: a program writes the first half of its bytes, an erase clears the first half
+ * of the sector. Every later program or erase fails until smtc_modem_hal_native_flash_restore_power().
+ *
+ * @param [in] operations Cut during the n-th program or erase from now, 0 never cuts
+ */
+void smtc_modem_hal_native_flash_cut_power_after( uint32_t operations );
+bool smtc_modem_hal_native_flash_power_lost( void );
+void smtc_modem_hal_native_flash_restore_power( void );
+
+/**
+ * @brief Program and erase operations since boot
+ */
+uint32_t smtc_modem_hal_native_flash_get_operation_count( void );
+
+/**
+ * @brief Copy the whole simulated flash out of / into a buffer of SMTC_MODEM_HAL_NATIVE_FLASH_SIZE bytes
+ */
+void smtc_modem_hal_native_flash_save( uint8_t* image );
+void smtc_modem_hal_native_flash_load( const uint8_t* image );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SMTC_MODEM_HAL_NATIVE_H
+
+/* --- EOF ------------------------------------------------------------------ */
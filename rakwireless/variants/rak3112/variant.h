@@ -1,5 +1,25 @@
 // Just for consistency, for RAK3112 ESP32-S3 all definitions are in the pins_arduino.h
+// The supply currents below feed the energy model of src/lbm_energy.h
 
-#ifndef _VARIANT_RAK3112_
-#define _VARIANT_RAK3113_
-#endif
\ No newline at end of file
+#ifndef _VARIANT_RAK3112_H_
+#define _VARIANT_RAK3112_H_
+
+// SX1262 at 3.3 V with the DC-DC regulator, datasheet typical values in µA
+// TX by decreasing output power: the high power PA with the optimal settings of each power
+#define LBM_ENERGY_TX_TABLE \
+    { { 22, 118000.0f }, { 20, 102000.0f }, { 17, 90000.0f }, { 14, 45000.0f }, { 10, 32000.0f }, { 0, 20000.0f } }
+#define LBM_ENERGY_RX_UA 4600.0f       // boosted gain off
+#define LBM_ENERGY_CAD_UA 4600.0f
+#define LBM_ENERGY_STANDBY_UA 600.0f   // STDBY_RC
+#define LBM_ENERGY_SLEEP_UA 0.6f       // warm start, configuration retained
+
+// ESP32-S3 at 240 MHz, Wi-Fi and Bluetooth off
+#define LBM_ENERGY_MCU_ACTIVE_UA 40000.0f
+#define LBM_ENERGY_MCU_IDLE_UA 28000.0f  // task blocked, clocks running
+#define LBM_ENERGY_MCU_SLEEP_UA 240.0f   // light sleep, RTC timer and GPIO wakeup
+
+// Drawn by the carrier board whatever the state (regulator quiescent current, LEDs off)
+#define LBM_ENERGY_BOARD_UA 0.0f
+#define LBM_ENERGY_SUPPLY_MV 3300
+
+#endif
@@ -0,0 +1,69 @@
+/*!
+ * \file      lbm_aes.h
+ *
+ * \brief     Table-driven AES-128 encryption for MCUs without an AES peripheral
+ *
+ * The aes.c of the soft secure element works on bytes: each round is a byte S-box, a byte ShiftRows and a
+ * MixColumns computed with xtime(). Here each round is 16 lookups in one 1 KB table combining SubBytes and
+ * MixColumns, on 32-bit columns, with the round keys expanded once per key. Only encryption is provided:
+ * LoRaWAN uses AES in the encrypt direction only (CMAC, counter mode, join key derivation).
+ */
+
+#ifndef LBM_AES_H
+#define LBM_AES_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <stdint.h>
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC CONSTANTS --------------------------------------------------------
+ */
+
+#define LBM_AES_BLOCK_SIZE 16
+#define LBM_AES_KEY_SIZE 16
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC TYPES ------------------------------------------------------------
+ */
+
+/**
+ * @brief Expanded AES-128 key: 11 round keys of 4 big-endian columns
+ */
+typedef struct lbm_aes_context_s
+{
+    uint32_t round_keys[44];
+} lbm_aes_context_t;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS PROTOTYPES --------------------------------------------
+ */
+
+/**
+ * @brief Expand an AES-128 key
+ */
+void lbm_aes_set_key( const uint8_t key[LBM_AES_KEY_SIZE], lbm_aes_context_t* context );
+
+/**
+ * @brief Encrypt one block, in and out may overlap
+ */
+void lbm_aes_encrypt( const lbm_aes_context_t* context, const uint8_t in[LBM_AES_BLOCK_SIZE],
+                      uint8_t out[LBM_AES_BLOCK_SIZE] );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // LBM_AES_H
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,414 @@
+/*!
+ * \file      lbm_aggregator.cpp
+ *
+ * \brief     Uplink aggregation: packs small application records into max-size LoRaWAN frames
+ */
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <string.h>
+
+#include "lbm_aggregator.h"
+#include "lbm_core.h"
+#include "lbm_engine.h"
+#include "lbm_uplink.h"
+
+#include "smtc_modem_hal.h"
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE CONSTANTS -------------------------------------------------------
+ */
+
+#if( LBM_AGGREGATOR_MAX_RECORD_SIZE < 1 ) || ( LBM_AGGREGATOR_MAX_RECORD_SIZE > 255 )
+#error "LBM_AGGREGATOR_MAX_RECORD_SIZE must be between 1 and 255"
+#endif
+
+#define COMPACT_MAX_SIZE 16
+#define ESCAPE_TYPE 0x0F
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE TYPES -----------------------------------------------------------
+ */
+
+typedef struct record_s
+{
+    uint32_t deadline_ms;
+    uint8_t  type;
+    uint8_t  size;
+    uint8_t  data[LBM_AGGREGATOR_MAX_RECORD_SIZE];
+} record_t;
+
+typedef enum flush_reason_e
+{
+    FLUSH_FULL,
+    FLUSH_DEADLINE,
+    FLUSH_FORCED,
+} flush_reason_t;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE VARIABLES -------------------------------------------------------
+ */
+
+// FIFO of records waiting for a frame
+static record_t records[LBM_AGGREGATOR_MAX_RECORDS];
+static uint32_t first         = 0;
+static uint32_t count         = 0;
+static uint32_t pending_bytes = 0;  // encoded size of all queued records
+
+// Frame of the oldest records, its records stay queued until its ticket completes
+static lbm_uplink_ticket_t ticket         = LBM_UPLINK_NO_TICKET;
+static uint32_t            sending        = 0;  // records in the frame
+static uint32_t            sending_late   = 0;  // records of the frame sent after their budget
+static uint32_t            sending_data   = 0;  // record data of the frame, headers excluded
+static uint32_t            sending_size   = 0;  // frame payload size
+static flush_reason_t      sending_reason = FLUSH_FULL;
+
+static lbm_aggregator_stats_t stats;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DECLARATION -------------------------------------------
+ */
+
+/**
+ * @brief Encoded size of a record, header included
+ */
+static uint32_t encoded_size( uint8_t type, uint8_t size );
+
+/**
+ * @brief Earliest deadline among the queued records (count > 0)
+ */
+static uint32_t earliest_deadline( void );
+
+/**
+ * @brief Pack the oldest records into one frame and submit it as an uplink ticket
+ */
+static smtc_modem_return_code_t send_frame( uint8_t max_payload, uint32_t now_ms, flush_reason_t reason );
+
+/**
+ * @brief Completion of the ticket of a frame (engine task)
+ */
+static void on_frame( const lbm_uplink_result_t* result, void* context );
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS DEFINITION ---------------------------------------------
+ */
+
+smtc_modem_return_code_t lbm_aggregator_queue( uint8_t type, const uint8_t* data, uint8_t size,
+                                               uint32_t latency_budget_ms )
+{
+    if( ( type > LBM_AGGREGATOR_MAX_TYPE ) || ( data == nullptr ) || ( size == 0 ) ||
+        ( size > LBM_AGGREGATOR_MAX_RECORD_SIZE ) )
+    {
+        return SMTC_MODEM_RC_INVALID;
+    }
+    if( count >= LBM_AGGREGATOR_MAX_RECORDS )
+    {
+        stats.records_dropped++;
+        return SMTC_MODEM_RC_BUSY;
+    }
+
+    record_t* record    = &records[( first + count ) % LBM_AGGREGATOR_MAX_RECORDS];
+    record->deadline_ms = smtc_modem_hal_get_time_in_ms( ) + latency_budget_ms;
+    record->type        = type;
+    record->size        = size;
+    memcpy( record->data, data, size );
+
+    count++;
+    pending_bytes += encoded_size( type, size );
+    stats.records_queued++;
+    return SMTC_MODEM_RC_OK;
+}
+
+uint32_t lbm_aggregator_process( void )
+{
+    if( ( count == 0 ) || ( ticket != LBM_UPLINK_NO_TICKET ) )
+    {
+        // Nothing queued, or the completion of the frame in flight will bring the engine back
+        return LBM_AGGREGATOR_IDLE;
+    }
+
+    // Frame size allowed at the data rate of the next uplink, fails until the device has joined
+    uint8_t max_payload = 0;
+    if( ( smtc_modem_get_next_tx_max_payload( STACK_ID, &max_payload ) != SMTC_MODEM_RC_OK ) || ( max_payload == 0 ) )
+    {
+        // lbm_aggregator_on_event() wakes the engine up on the join
+        return LBM_AGGREGATOR_IDLE;
+    }
+    const uint32_t now_ms = smtc_modem_hal_get_time_in_ms( );
+
+    // A frame queued now would wait in the modem anyway: keep filling it until the band is available
+    int32_t duty_cycle_ms = 0;
+    if( ( smtc_modem_get_duty_cycle_status( STACK_ID, &duty_cycle_ms ) == SMTC_MODEM_RC_OK ) && ( duty_cycle_ms < 0 ) )
+    {
+        stats.duty_cycle_holds++;
+        return ( uint32_t ) ( -duty_cycle_ms );
+    }
+
+    const uint32_t           deadline_ms = earliest_deadline( );
+    smtc_modem_return_code_t ret         = SMTC_MODEM_RC_OK;
+    if( pending_bytes >= max_payload )
+    {
+        ret = send_frame( max_payload, now_ms, FLUSH_FULL );
+    }
+    else if( ( int32_t ) ( deadline_ms - now_ms ) <= 0 )
+    {
+        ret = send_frame( max_payload, now_ms, FLUSH_DEADLINE );
+    }
+    else
+    {
+        return deadline_ms - now_ms;
+    }
+
+    if( ret == SMTC_MODEM_RC_BUSY )
+    {
+        // Every ticket is taken by the application
+        return LBM_UPLINK_RETRY_MS;
+    }
+    // The rest goes out once the ticket of this frame completes
+    return LBM_AGGREGATOR_IDLE;
+}
+
+smtc_modem_return_code_t lbm_aggregator_flush( void )
+{
+    if( count == 0 )
+    {
+        return SMTC_MODEM_RC_NO_EVENT;
+    }
+    if( ticket != LBM_UPLINK_NO_TICKET )
+    {
+        // The oldest records are already in a frame
+        return SMTC_MODEM_RC_BUSY;
+    }
+
+    uint8_t                  max_payload = 0;
+    smtc_modem_return_code_t ret         = smtc_modem_get_next_tx_max_payload( STACK_ID, &max_payload );
+    if( ret != SMTC_MODEM_RC_OK )
+    {
+        return ret;
+    }
+    return send_frame( max_payload, smtc_modem_hal_get_time_in_ms( ), FLUSH_FORCED );
+}
+
+void lbm_aggregator_on_event( const smtc_modem_event_t* event )
+{
+    if( ( event->event_type == SMTC_MODEM_EVENT_JOINED ) && ( event->stack_id == STACK_ID ) && ( count > 0 ) )
+    {
+        // Records queued before the join have a frame size now
+        lbm_engine_notify( );
+    }
+}
+
+void lbm_aggregator_get_stats( lbm_aggregator_stats_t* out )
+{
+    *out         = stats;
+    out->pending = count;
+}
+
+void lbm_aggregator_reset_stats( void )
+{
+    memset( &stats, 0, sizeof( stats ) );
+}
+
+int lbm_aggregator_decode( const uint8_t* frame, uint8_t size, lbm_aggregator_record_cb_t callback, void* context )
+{
+    int      nb_records = 0;
+    uint32_t index      = 0;
+
+    while( index < size )
+    {
+        const uint8_t header      = frame[index++];
+        uint8_t       type        = header >> 4;
+        uint32_t      record_size = ( uint32_t ) ( header & 0x0F ) + 1;
+
+        if( type == ESCAPE_TYPE )
+        {
+            type = header & 0x0F;
+            if( ( type == ESCAPE_TYPE ) || ( index >= size ) )
+            {
+                return -1;
+            }
+            record_size = frame[index++];
+            if( record_size == 0 )
+            {
+                return -1;
+            }
+        }
+        if( ( index + record_size ) > size )
+        {
+            return -1;
+        }
+
+        if( callback != nullptr )
+        {
+            callback( type, &frame[index], ( uint8_t ) record_size, context );
+        }
+        index += record_size;
+        nb_records++;
+    }
+    return nb_records;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DEFINITION --------------------------------------------
+ */
+
+static uint32_t encoded_size( uint8_t type, uint8_t size )
+{
+    return ( ( type < ESCAPE_TYPE ) && ( size <= COMPACT_MAX_SIZE ) ) ? 1u + size : 2u + size;
+}
+
+static uint32_t earliest_deadline( void )
+{
+    const uint32_t now_ms   = smtc_modem_hal_get_time_in_ms( );
+    uint32_t       earliest = records[first].deadline_ms;
+
+    for( uint32_t i = 1; i < count; i++ )
+    {
+        const uint32_t deadline_ms = records[( first + i ) % LBM_AGGREGATOR_MAX_RECORDS].deadline_ms;
+        if( ( int32_t ) ( deadline_ms - now_ms ) < ( int32_t ) ( earliest - now_ms ) )
+        {
+            earliest = deadline_ms;
+        }
+    }
+    return earliest;
+}
+
+static smtc_modem_return_code_t send_frame( uint8_t max_payload, uint32_t now_ms, flush_reason_t reason )
+{
+    uint8_t  frame[SMTC_MODEM_MAX_LORAWAN_PAYLOAD_LENGTH];
+    uint32_t frame_size   = 0;
+    uint32_t nb_records   = 0;
+    uint32_t record_bytes = 0;
+    uint32_t nb_late      = 0;
+
+    if( max_payload > sizeof( frame ) )
+    {
+        max_payload = sizeof( frame );
+    }
+
+    // A record larger than the frame allowed at this data rate would block the queue forever
+    while( ( count > 0 ) && ( encoded_size( records[first].type, records[first].size ) > max_payload ) )
+    {
+        pending_bytes -= encoded_size( records[first].type, records[first].size );
+        first = ( first + 1 ) % LBM_AGGREGATOR_MAX_RECORDS;
+        count--;
+        stats.records_oversized++;
+    }
+
+    // Oldest records first, as many as fit
+    while( nb_records < count )
+    {
+        const record_t* record = &records[( first + nb_records ) % LBM_AGGREGATOR_MAX_RECORDS];
+        const uint32_t  needed = encoded_size( record->type, record->size );
+        if( ( frame_size + needed ) > max_payload )
+        {
+            break;
+        }
+
+        if( needed == ( 1u + record->size ) )
+        {
+            frame[frame_size++] = ( uint8_t ) ( ( record->type << 4 ) | ( record->size - 1 ) );
+        }
+        else
+        {
+            frame[frame_size++] = ( uint8_t ) ( ( ESCAPE_TYPE << 4 ) | record->type );
+            frame[frame_size++] = record->size;
+        }
+        memcpy( &frame[frame_size], record->data, record->size );
+        frame_size += record->size;
+        record_bytes += record->size;
+        if( ( int32_t ) ( now_ms - record->deadline_ms ) > 0 )
+        {
+            nb_late++;
+        }
+        nb_records++;
+    }
+
+    if( nb_records == 0 )
+    {
+        return SMTC_MODEM_RC_NO_EVENT;
+    }
+
+    const smtc_modem_return_code_t ret = lbm_uplink_submit( STACK_ID, LBM_AGGREGATOR_PORT, false, frame,
+                                                            ( uint8_t ) frame_size, on_frame, nullptr, &ticket );
+    if( ret != SMTC_MODEM_RC_OK )
+    {
+        // Records stay queued
+        ticket = LBM_UPLINK_NO_TICKET;
+        return ret;
+    }
+    sending        = nb_records;
+    sending_late   = nb_late;
+    sending_data   = record_bytes;
+    sending_size   = frame_size;
+    sending_reason = reason;
+    return ret;
+}
+
+static void on_frame( const lbm_uplink_result_t* result, void* context )
+{
+    ( void ) context;
+    if( result->ticket != ticket )
+    {
+        return;
+    }
+    ticket = LBM_UPLINK_NO_TICKET;
+
+    switch( result->status )
+    {
+    case LBM_UPLINK_SENT:
+    case LBM_UPLINK_ACKED:
+    case LBM_UPLINK_NACKED:
+        break;
+    case LBM_UPLINK_DROPPED_DUTY_CYCLE:
+    case LBM_UPLINK_NOT_SENT:
+        // Records stay queued, lbm_aggregator_process() holds them until the band is available again
+        stats.frames_requeued++;
+        lbm_engine_notify( );
+        return;
+    default:
+        // Refused or cancelled: records stay queued for the next turn of the engine, the join or a new record
+        stats.frames_requeued++;
+        return;
+    }
+
+    // Records of the frame are still the oldest ones: nothing leaves the queue while a ticket is outstanding
+    first = ( first + sending ) % LBM_AGGREGATOR_MAX_RECORDS;
+    count -= sending;
+    pending_bytes -= sending_size;
+
+    stats.frames_sent++;
+    stats.records_sent += sending;
+    stats.records_late += sending_late;
+    stats.record_bytes_sent += sending_data;
+    stats.frame_bytes_sent += sending_size;
+    switch( sending_reason )
+    {
+    case FLUSH_FULL:
+        stats.full_flushes++;
+        break;
+    case FLUSH_DEADLINE:
+        stats.deadline_flushes++;
+        break;
+    default:
+        stats.forced_flushes++;
+        break;
+    }
+
+    if( count > 0 )
+    {
+        // The next frame waits for no other turn of the engine
+        lbm_engine_notify( );
+    }
+}
+
+/* --- EOF ------------------------------------------------------------------ */
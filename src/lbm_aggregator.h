@@ -0,0 +1,162 @@
+/*!
+ * \file      lbm_aggregator.h
+ *
+ * \brief     Uplink aggregation: packs small application records into max-size LoRaWAN frames
+ *
+ * Records are queued with a latency budget and sent together, on LBM_AGGREGATOR_PORT, when the frame allowed at
+ * the current data rate is full or when the earliest budget expires. While the regional duty cycle blocks the
+ * band, records keep accumulating instead of queuing half-empty frames in the modem. A frame is an lbm_uplink ticket:
+ * its records stay queued until the ticket completes, and go out again in the next frame if it was not sent.
+ *
+ * Frame format, records back to back, in queue order:
+ *   - type 0..14 and size 1..16: one header byte ( type << 4 ) | ( size - 1 ), then the data
+ *   - otherwise (size up to LBM_AGGREGATOR_MAX_RECORD_SIZE): 0xF0 | type, one size byte, then the data
+ * Type 15 is reserved for the escape. lbm_aggregator_decode() and tools/lbm_aggregator_decoder.js read it back.
+ */
+
+#ifndef LBM_AGGREGATOR_H
+#define LBM_AGGREGATOR_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "smtc_modem_api.h"
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC CONSTANTS --------------------------------------------------------
+ */
+
+/**
+ * @brief FPort of aggregated frames
+ */
+#ifndef LBM_AGGREGATOR_PORT
+#define LBM_AGGREGATOR_PORT 10
+#endif
+
+/**
+ * @brief Number of records that can wait for a frame
+ */
+#ifndef LBM_AGGREGATOR_MAX_RECORDS
+#define LBM_AGGREGATOR_MAX_RECORDS 32
+#endif
+
+/**
+ * @brief Largest record, in bytes (at most 255)
+ */
+#ifndef LBM_AGGREGATOR_MAX_RECORD_SIZE
+#define LBM_AGGREGATOR_MAX_RECORD_SIZE 32
+#endif
+
+/**
+ * @brief Highest record type
+ */
+#define LBM_AGGREGATOR_MAX_TYPE 14
+
+/**
+ * @brief Value returned by lbm_aggregator_process() when nothing is queued
+ */
+#define LBM_AGGREGATOR_IDLE 0xFFFFFFFFUL
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC TYPES ------------------------------------------------------------
+ */
+
+/**
+ * @brief Aggregation counters
+ */
+typedef struct lbm_aggregator_stats_s
+{
+    uint32_t records_queued;
+    uint32_t records_sent;
+    uint32_t records_dropped;    //!< refused because the queue was full
+    uint32_t records_oversized;  //!< discarded because they do not fit a frame at the current data rate
+    uint32_t records_late;       //!< sent after their latency budget
+    uint32_t frames_sent;
+    uint32_t full_flushes;       //!< frames sent because no more records would fit
+    uint32_t deadline_flushes;   //!< frames sent because a latency budget expired
+    uint32_t forced_flushes;     //!< frames sent by lbm_aggregator_flush()
+    uint32_t record_bytes_sent;  //!< record data, headers excluded
+    uint32_t frame_bytes_sent;   //!< frame payloads, headers included
+    uint32_t duty_cycle_holds;   //!< flushes postponed because the band was not available
+    uint32_t frames_requeued;    //!< frames not sent, their records queued again
+    uint32_t pending;            //!< records currently queued
+} lbm_aggregator_stats_t;
+
+/**
+ * @brief Called by lbm_aggregator_decode() for each record of a frame
+ */
+typedef void ( *lbm_aggregator_record_cb_t )( uint8_t type, const uint8_t* data, uint8_t size, void* context );
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS PROTOTYPES --------------------------------------------
+ */
+
+/**
+ * @brief Queue a record
+ *
+ * @param [in] type              Application record type, 0..LBM_AGGREGATOR_MAX_TYPE
+ * @param [in] data              Record data
+ * @param [in] size              Record size, 1..LBM_AGGREGATOR_MAX_RECORD_SIZE
+ * @param [in] latency_budget_ms Longest acceptable delay before the record is sent
+ *
+ * @return SMTC_MODEM_RC_INVALID on bad arguments, SMTC_MODEM_RC_BUSY if the queue is full
+ */
+smtc_modem_return_code_t lbm_aggregator_queue( uint8_t type, const uint8_t* data, uint8_t size,
+                                               uint32_t latency_budget_ms );
+
+/**
+ * @brief Send a frame if it is full or a latency budget expired (engine task)
+ *
+ * @return Time in ms before this must be called again, LBM_AGGREGATOR_IDLE if no record is queued, a frame is in
+ *         flight or the device has not joined yet
+ */
+uint32_t lbm_aggregator_process( void );
+
+/**
+ * @brief Send a frame with the oldest records now, whatever their budget
+ *
+ * @return SMTC_MODEM_RC_NO_EVENT if no record is queued, SMTC_MODEM_RC_BUSY if a frame is already in flight, else
+ *         the lbm_uplink_submit() result
+ */
+smtc_modem_return_code_t lbm_aggregator_flush( void );
+
+/**
+ * @brief Modem event hook (engine task): wakes the engine up when records wait for the join
+ */
+void lbm_aggregator_on_event( const smtc_modem_event_t* event );
+
+/**
+ * @brief Read the counters
+ */
+void lbm_aggregator_get_stats( lbm_aggregator_stats_t* stats );
+
+/**
+ * @brief Clear the counters (queued records are kept)
+ */
+void lbm_aggregator_reset_stats( void );
+
+/**
+ * @brief Split an aggregated frame into records (no modem dependency, usable on the server side)
+ *
+ * @return Number of records, -1 if the frame is malformed (records before the error were reported)
+ */
+int lbm_aggregator_decode( const uint8_t* frame, uint8_t size, lbm_aggregator_record_cb_t callback, void* context );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // LBM_AGGREGATOR_H
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,124 @@
+/*!
+ * \file      lbm_airtime.cpp
+ *
+ * \brief     Time-on-air and duty-cycle planner for the regions built in (EU868, AS923)
+ */
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include "lbm_airtime.h"
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE CONSTANTS -------------------------------------------------------
+ */
+
+// Spot checks against the LoRa calculator of the Semtech AN1200.13 formula
+static_assert( lbm_airtime_uplink_us( LBM_AIRTIME_EU868[5], 7 ) == 56576, "SF7/125, 20-byte PHY payload" );
+static_assert( lbm_airtime_uplink_us( LBM_AIRTIME_EU868[0], 51 ) == 2793472, "SF12/125, 64-byte PHY payload" );
+static_assert( lbm_airtime_uplink_us( LBM_AIRTIME_EU868[6], 0 ) == 23168, "SF7/250, 13-byte PHY payload" );
+
+// LR-FHSS, 23-byte PHY payload: 3 headers + 618 coded bits in 13 fragments, 2 headers + 309 bits in 7 fragments
+static_assert( lbm_airtime_uplink_us( LBM_AIRTIME_EU868[8], 10 ) == 986 * LBM_AIRTIME_LR_FHSS_BIT_US, "DR8" );
+static_assert( lbm_airtime_uplink_us( LBM_AIRTIME_EU868[9], 10 ) == 551 * LBM_AIRTIME_LR_FHSS_BIT_US, "DR9" );
+static_assert( lbm_airtime_lr_fhss_hops( LBM_AIRTIME_EU868[8], 23 ) == 16, "DR8 hops" );
+static_assert( lbm_airtime_lr_fhss_hops( LBM_AIRTIME_EU868[11], 23 ) == 9, "DR11 hops" );
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DECLARATION -------------------------------------------
+ */
+
+/**
+ * @brief Data rate entry of the region of the stack, NULL if unsupported or if size does not fit
+ */
+static const lbm_airtime_datarate_t* get_datarate( uint8_t stack_id, uint8_t datarate, uint8_t size );
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS DEFINITION ---------------------------------------------
+ */
+
+const lbm_airtime_datarate_t* lbm_airtime_get_table( smtc_modem_region_t region )
+{
+    switch( region )
+    {
+#if defined( REGION_EU_868 )
+    case SMTC_MODEM_REGION_EU_868:
+        return LBM_AIRTIME_EU868;
+#endif
+#if defined( REGION_AS_923 )
+    case SMTC_MODEM_REGION_AS_923:
+    case SMTC_MODEM_REGION_AS_923_GRP2:
+    case SMTC_MODEM_REGION_AS_923_GRP3:
+    case SMTC_MODEM_REGION_AS_923_GRP4:
+        return LBM_AIRTIME_AS923;
+#endif
+    default:
+        return nullptr;
+    }
+}
+
+smtc_modem_return_code_t lbm_airtime_get( uint8_t stack_id, uint8_t datarate, uint8_t size, uint32_t* time_on_air_us )
+{
+    const lbm_airtime_datarate_t* dr = get_datarate( stack_id, datarate, size );
+    if( dr == nullptr )
+    {
+        return SMTC_MODEM_RC_INVALID;
+    }
+    *time_on_air_us = lbm_airtime_uplink_us( *dr, size );
+    return SMTC_MODEM_RC_OK;
+}
+
+smtc_modem_return_code_t lbm_airtime_earliest_send( uint8_t stack_id, uint8_t datarate, uint8_t size,
+                                                    uint32_t* wait_ms, int32_t* budget_after_ms )
+{
+    const lbm_airtime_datarate_t* dr = get_datarate( stack_id, datarate, size );
+    if( dr == nullptr )
+    {
+        return SMTC_MODEM_RC_INVALID;
+    }
+
+    // Positive: budget left in the band, negative: time until the band is free again
+    int32_t                        status_ms = 0;
+    const smtc_modem_return_code_t ret       = smtc_modem_get_duty_cycle_status( stack_id, &status_ms );
+    if( ret != SMTC_MODEM_RC_OK )
+    {
+        return ret;
+    }
+
+    const int32_t time_on_air_ms = ( int32_t ) ( ( lbm_airtime_uplink_us( *dr, size ) + 999 ) / 1000 );
+    *wait_ms                     = ( status_ms > 0 ) ? 0 : ( uint32_t ) ( -status_ms );
+    if( budget_after_ms != nullptr )
+    {
+        *budget_after_ms = ( ( status_ms > 0 ) ? status_ms : 0 ) - time_on_air_ms;
+    }
+    return SMTC_MODEM_RC_OK;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DEFINITION --------------------------------------------
+ */
+
+static const lbm_airtime_datarate_t* get_datarate( uint8_t stack_id, uint8_t datarate, uint8_t size )
+{
+    smtc_modem_region_t region;
+    if( ( datarate >= LBM_AIRTIME_NB_DATARATES ) ||
+        ( smtc_modem_get_region( stack_id, &region ) != SMTC_MODEM_RC_OK ) )
+    {
+        return nullptr;
+    }
+
+    const lbm_airtime_datarate_t* table = lbm_airtime_get_table( region );
+    if( ( table == nullptr ) || ( table[datarate].max_payload == 0 ) || ( size > table[datarate].max_payload ) )
+    {
+        return nullptr;
+    }
+    return &table[datarate];
+}
+
+/* --- EOF ------------------------------------------------------------------ */
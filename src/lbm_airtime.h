@@ -0,0 +1,275 @@
+/*!
+ * \file      lbm_airtime.h
+ *
+ * \brief     Time-on-air and duty-cycle planner for the regions built in (EU868, AS923)
+ *
+ * The data rate tables and the time-on-air formulas (Semtech AN1200.13 for LoRa, the LR-FHSS frame of the
+ * sx126x driver for EU868 DR8-DR11) are constexpr, so a scheduler can size its uplinks at compile time:
+ *
+ *     static_assert( lbm_airtime_uplink_us( LBM_AIRTIME_EU868[5], 20 ) < 100000, "..." );
+ *
+ * At run time lbm_airtime_get() answers for the region the modem is configured with, in O(1), and
+ * lbm_airtime_earliest_send() combines it with the duty-cycle state of the modem.
+ *
+ * Sizes are application payload sizes: the 13 bytes of MAC header, FPort and MIC are added, FOpts are assumed
+ * empty. Uplinks use an explicit header and CRC, the low data rate optimization follows the symbol time.
+ */
+
+#ifndef LBM_AIRTIME_H
+#define LBM_AIRTIME_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "smtc_modem_api.h"
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC CONSTANTS --------------------------------------------------------
+ */
+
+/**
+ * @brief MHDR (1), DevAddr (4), FCtrl (1), FCnt (2), FPort (1) and MIC (4)
+ */
+#define LBM_AIRTIME_FRAME_OVERHEAD 13
+
+/**
+ * @brief Data rates per region (DR0 to DR11), a region without LR-FHSS leaves DR8-DR11 empty
+ */
+#define LBM_AIRTIME_NB_DATARATES 12
+
+/**
+ * @brief LR-FHSS frame: bits of a header replica, of a payload fragment and its sync, bit time in us (488.28 bps)
+ */
+#define LBM_AIRTIME_LR_FHSS_HEADER_BITS 114
+#define LBM_AIRTIME_LR_FHSS_FRAGMENT_BITS 48
+#define LBM_AIRTIME_LR_FHSS_BLOCK_BITS 50
+#define LBM_AIRTIME_LR_FHSS_BIT_US 2048
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC TYPES ------------------------------------------------------------
+ */
+
+/**
+ * @brief Modulations of the data rates
+ */
+typedef enum lbm_airtime_modulation_e
+{
+    LBM_AIRTIME_LORA = 0,
+    LBM_AIRTIME_FSK,
+    LBM_AIRTIME_LR_FHSS,
+    LBM_AIRTIME_NB_MODULATIONS,
+} lbm_airtime_modulation_t;
+
+/**
+ * @brief Modulation of one data rate
+ */
+typedef struct lbm_airtime_datarate_s
+{
+    lbm_airtime_modulation_t modulation;
+    uint8_t                  sf;           //!< LoRa spreading factor
+    uint16_t                 bw_khz;       //!< LoRa bandwidth, LR-FHSS occupied channel width
+    uint8_t                  cr;           //!< LoRa coding rate 4/(4 + cr), LR-FHSS coding rate cr/3
+    uint8_t                  preamble;     //!< preamble symbols (LoRa) or bytes (FSK), header replicas (LR-FHSS)
+    uint32_t                 fsk_bps;      //!< FSK bit rate
+    uint8_t                  max_payload;  //!< largest application payload without FOpts, 0 if the DR is RFU
+} lbm_airtime_datarate_t;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS PROTOTYPES --------------------------------------------
+ */
+
+/**
+ * @brief Data rate table of a region
+ *
+ * @return NULL if the region is not built in (REGION_EU_868 / REGION_AS_923 in platformio.ini)
+ */
+const lbm_airtime_datarate_t* lbm_airtime_get_table( smtc_modem_region_t region );
+
+/**
+ * @brief Time on air of an uplink carrying size application bytes at a data rate of the region of a stack
+ *
+ * @param [in]  stack_id       Stack whose region applies
+ * @param [in]  datarate       DR0 to DR11
+ * @param [in]  size           Application payload size
+ * @param [out] time_on_air_us Time on air in microseconds
+ *
+ * @return SMTC_MODEM_RC_OK, SMTC_MODEM_RC_INVALID if the region is not supported or the payload does not fit
+ */
+smtc_modem_return_code_t lbm_airtime_get( uint8_t stack_id, uint8_t datarate, uint8_t size, uint32_t* time_on_air_us );
+
+/**
+ * @brief Earliest time the modem will let an uplink of size bytes at a data rate go out
+ *
+ * The modem refuses an uplink while the duty-cycle budget of its bands is exhausted. It accepts it as soon as
+ * some budget is left, whatever the size. budget_after_ms tells how much is left once this uplink has been
+ * sent: a negative value is the extra wait the next uplink will see.
+ *
+ * @param [in]  stack_id        Stack sending the uplink
+ * @param [in]  datarate        DR0 to DR11
+ * @param [in]  size            Application payload size
+ * @param [out] wait_ms         0 if it can be sent now, otherwise the wait in ms
+ * @param [out] budget_after_ms Duty-cycle budget left after this uplink (may be NULL)
+ *
+ * @return SMTC_MODEM_RC_OK, SMTC_MODEM_RC_INVALID if the region is not supported or the payload does not fit
+ */
+smtc_modem_return_code_t lbm_airtime_earliest_send( uint8_t stack_id, uint8_t datarate, uint8_t size,
+                                                    uint32_t* wait_ms, int32_t* budget_after_ms );
+
+#ifdef __cplusplus
+}
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- COMPILE-TIME TABLES AND FORMULA -----------------------------------------
+ */
+
+#ifdef __cplusplus
+
+// RP002-1.0.3, EU863-870: DR0-5 SF12-SF7 / 125 kHz, DR6 SF7 / 250 kHz, DR7 FSK 50 kbps,
+// DR8-11 LR-FHSS CR1/3 and CR2/3 on a 137 kHz then a 336 kHz occupied channel width
+constexpr lbm_airtime_datarate_t LBM_AIRTIME_EU868[LBM_AIRTIME_NB_DATARATES] = {
+    { LBM_AIRTIME_LORA, 12, 125, 1, 8, 0, 51 },     { LBM_AIRTIME_LORA, 11, 125, 1, 8, 0, 51 },
+    { LBM_AIRTIME_LORA, 10, 125, 1, 8, 0, 51 },     { LBM_AIRTIME_LORA, 9, 125, 1, 8, 0, 115 },
+    { LBM_AIRTIME_LORA, 8, 125, 1, 8, 0, 222 },     { LBM_AIRTIME_LORA, 7, 125, 1, 8, 0, 222 },
+    { LBM_AIRTIME_LORA, 7, 250, 1, 8, 0, 222 },     { LBM_AIRTIME_FSK, 0, 0, 0, 5, 50000, 222 },
+    { LBM_AIRTIME_LR_FHSS, 0, 137, 1, 3, 0, 50 },   { LBM_AIRTIME_LR_FHSS, 0, 137, 2, 2, 0, 115 },
+    { LBM_AIRTIME_LR_FHSS, 0, 336, 1, 3, 0, 50 },   { LBM_AIRTIME_LR_FHSS, 0, 336, 2, 2, 0, 115 },
+};
+
+// RP002-1.0.3, AS923 with the uplink dwell time limit off: same modulations, larger frames at DR4-DR7, no LR-FHSS
+constexpr lbm_airtime_datarate_t LBM_AIRTIME_AS923[LBM_AIRTIME_NB_DATARATES] = {
+    { LBM_AIRTIME_LORA, 12, 125, 1, 8, 0, 51 },     { LBM_AIRTIME_LORA, 11, 125, 1, 8, 0, 51 },
+    { LBM_AIRTIME_LORA, 10, 125, 1, 8, 0, 51 },     { LBM_AIRTIME_LORA, 9, 125, 1, 8, 0, 115 },
+    { LBM_AIRTIME_LORA, 8, 125, 1, 8, 0, 242 },     { LBM_AIRTIME_LORA, 7, 125, 1, 8, 0, 242 },
+    { LBM_AIRTIME_LORA, 7, 250, 1, 8, 0, 242 },     { LBM_AIRTIME_FSK, 0, 0, 0, 5, 50000, 242 },
+};
+
+/**
+ * @brief LoRa symbol time in microseconds (exact for SF7-SF12 at 125/250/500 kHz)
+ */
+constexpr uint32_t lbm_airtime_symbol_us( const lbm_airtime_datarate_t& dr )
+{
+    return ( ( uint32_t ) 1000u << dr.sf ) / dr.bw_khz;
+}
+
+/**
+ * @brief Low data rate optimization, mandated when a symbol lasts 16 ms or more
+ */
+constexpr uint32_t lbm_airtime_ldro( const lbm_airtime_datarate_t& dr )
+{
+    return ( lbm_airtime_symbol_us( dr ) >= 16000 ) ? 1 : 0;
+}
+
+/**
+ * @brief Payload symbols after the 8 symbols of the header block, for a PHY payload of phy_size bytes
+ *
+ * ceil( ( 8 PL - 4 SF + 28 + 16 CRC - 20 IH ) / ( 4 ( SF - 2 DE ) ) ) ( CR + 4 )
+ */
+constexpr uint32_t lbm_airtime_payload_symbols( const lbm_airtime_datarate_t& dr, uint32_t phy_size,
+                                                bool implicit_header, bool crc, bool ldro )
+{
+    return ( 8 * phy_size + 28 + ( crc ? 16 : 0 ) <= 4u * dr.sf + ( implicit_header ? 20 : 0 ) )
+               ? 0
+               : ( 8 * phy_size + 28 + ( crc ? 16 : 0 ) - 4 * dr.sf - ( implicit_header ? 20 : 0 ) +
+                   4 * ( dr.sf - ( ldro ? 2 : 0 ) ) - 1 ) /
+                     ( 4 * ( dr.sf - ( ldro ? 2 : 0 ) ) ) * ( dr.cr + 4 );
+}
+
+/**
+ * @brief Time on air of a LoRa frame with a given header mode, CRC and low data rate optimization
+ *        (downlinks carry no CRC, P2P links may use an implicit header or force the optimization)
+ */
+constexpr uint32_t lbm_airtime_lora_frame_us( const lbm_airtime_datarate_t& dr, uint32_t phy_size,
+                                              bool implicit_header, bool crc, bool ldro )
+{
+    // Preamble lasts n + 4.25 symbols
+    return ( 4 * dr.preamble + 17 ) * lbm_airtime_symbol_us( dr ) / 4 +
+           ( 8 + lbm_airtime_payload_symbols( dr, phy_size, implicit_header, crc, ldro ) ) *
+               lbm_airtime_symbol_us( dr );
+}
+
+/**
+ * @brief Time on air of a LoRa uplink with a PHY payload of phy_size bytes
+ */
+constexpr uint32_t lbm_airtime_lora_phy_us( const lbm_airtime_datarate_t& dr, uint32_t phy_size )
+{
+    return lbm_airtime_lora_frame_us( dr, phy_size, false, true, lbm_airtime_ldro( dr ) != 0 );
+}
+
+/**
+ * @brief Time on air of an FSK frame: preamble, 3-byte sync word, length byte, payload, CRC-16
+ */
+constexpr uint32_t lbm_airtime_fsk_phy_us( const lbm_airtime_datarate_t& dr, uint32_t phy_size )
+{
+    return ( uint32_t ) ( ( uint64_t ) ( dr.preamble + 3 + 1 + phy_size + 2 ) * 8 * 1000000u / dr.fsk_bps );
+}
+
+/**
+ * @brief LR-FHSS coded length: PHY payload, CRC-16 and 6 tail bits through the cr/3 convolutional code
+ */
+constexpr uint32_t lbm_airtime_lr_fhss_coded_bits( const lbm_airtime_datarate_t& dr, uint32_t phy_size )
+{
+    return ( 8 * ( phy_size + 2 ) + 6 ) * 3 / dr.cr;
+}
+
+/**
+ * @brief LR-FHSS hops of a frame: one per header replica and one per payload fragment
+ */
+constexpr uint32_t lbm_airtime_lr_fhss_hops( const lbm_airtime_datarate_t& dr, uint32_t phy_size )
+{
+    return dr.preamble +
+           ( lbm_airtime_lr_fhss_coded_bits( dr, phy_size ) + LBM_AIRTIME_LR_FHSS_FRAGMENT_BITS - 1 ) /
+               LBM_AIRTIME_LR_FHSS_FRAGMENT_BITS;
+}
+
+/**
+ * @brief Time on air of an LR-FHSS frame: the header replicas, then the coded payload in 48-bit fragments each
+ *        led by 2 sync bits, the last one possibly shorter
+ */
+constexpr uint32_t lbm_airtime_lr_fhss_phy_us( const lbm_airtime_datarate_t& dr, uint32_t phy_size )
+{
+    return ( dr.preamble * LBM_AIRTIME_LR_FHSS_HEADER_BITS +
+             lbm_airtime_lr_fhss_coded_bits( dr, phy_size ) / LBM_AIRTIME_LR_FHSS_FRAGMENT_BITS *
+                 LBM_AIRTIME_LR_FHSS_BLOCK_BITS +
+             ( ( lbm_airtime_lr_fhss_coded_bits( dr, phy_size ) % LBM_AIRTIME_LR_FHSS_FRAGMENT_BITS != 0 )
+                   ? lbm_airtime_lr_fhss_coded_bits( dr, phy_size ) % LBM_AIRTIME_LR_FHSS_FRAGMENT_BITS +
+                         ( LBM_AIRTIME_LR_FHSS_BLOCK_BITS - LBM_AIRTIME_LR_FHSS_FRAGMENT_BITS )
+                   : 0 ) ) *
+           LBM_AIRTIME_LR_FHSS_BIT_US;
+}
+
+/**
+ * @brief Time on air of a frame with a PHY payload (MHDR to MIC) of phy_size bytes
+ */
+constexpr uint32_t lbm_airtime_phy_us( const lbm_airtime_datarate_t& dr, uint32_t phy_size )
+{
+    return ( dr.modulation == LBM_AIRTIME_LR_FHSS ) ? lbm_airtime_lr_fhss_phy_us( dr, phy_size )
+           : ( dr.modulation == LBM_AIRTIME_FSK )   ? lbm_airtime_fsk_phy_us( dr, phy_size )
+                                                    : lbm_airtime_lora_phy_us( dr, phy_size );
+}
+
+/**
+ * @brief Time on air of an uplink carrying size application bytes
+ */
+constexpr uint32_t lbm_airtime_uplink_us( const lbm_airtime_datarate_t& dr, uint32_t size )
+{
+    return lbm_airtime_phy_us( dr, size + LBM_AIRTIME_FRAME_OVERHEAD );
+}
+
+#endif  // __cplusplus
+
+#endif  // LBM_AIRTIME_H
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -1,6 +1,25 @@
 #include "lbm_api.h"
 #include "lbm_core.h"
+#include "lbm_engine.h"
+#include "lbm_sleep.h"
+#include "lbm_event_ring.h"
+#include "lbm_dl_pool.h"
+#include "lbm_aggregator.h"
+#include "lbm_log.h"
+#include "lbm_profile.h"
+#include "lbm_airtime.h"
+#include "lbm_crypto.h"
+#include "lbm_nvm.h"
+#include "lbm_session.h"
+#include "lbm_stacks.h"
+#include "lbm_lr_fhss.h"
+#include "lbm_uplink.h"
+#include "lbm_upload.h"
+#include "lbm_event_bus.h"
+#include "lbm_p2p.h"
+#include "lbm_p2p_bulk.h"
 #include <Arduino.h>
+#include <string.h>
 
 // Include necessary modem headers
 extern "C" {
@@ -9,13 +28,17 @@ extern "C" {
 #include "smtc_hal_dbg_trace.h"
 }
 
-// Debug print switch
-#define BASIC_MODEM_DEBUG 1
+// Traces of every API call, compiled in at the debug log level only unless set explicitly: with the immediate log
+// backend each one is a blocking Serial.printf() in the caller
+#ifndef BASIC_MODEM_DEBUG
+#define BASIC_MODEM_DEBUG (LBM_LOG_LEVEL >= LBM_LOG_LEVEL_DEBUG)
+#endif
 
+// All call sites pass string literals, so the format strings can be tokenized (see lbm_log.h)
 #if BASIC_MODEM_DEBUG
-#define DEBUG_PRINT(x) Serial.print(x)
-#define DEBUG_PRINTLN(x) Serial.println(x)
-#define DEBUG_PRINTF(fmt, ...) Serial.printf(fmt, ##__VA_ARGS__)
+#define DEBUG_PRINT(x) LBM_LOG_INFO(x)
+#define DEBUG_PRINTLN(x) LBM_LOG_INFO(x "\n")
+#define DEBUG_PRINTF(fmt, ...) LBM_LOG_INFO(fmt, ##__VA_ARGS__)
 #else
 #define DEBUG_PRINT(x)
 #define DEBUG_PRINTLN(x)
@@ -24,12 +47,14 @@ extern "C" {
 
 // Global user event callback
 LBMEventCallback userEventCallback = nullptr;
+LBMDownlinkCallback userDownlinkCallback = nullptr;
 
 // Task handle for LoRaWAN task
 TaskHandle_t loraTaskHandle = NULL;
 
 // LoRaWAN task function
 void loraWANTask(void *parameter) {
+    (void)parameter;
     DEBUG_PRINTLN("LoRaWAN Task Started...");
     
     // Call LoRaWAN main function
@@ -40,17 +65,97 @@ void loraWANTask(void *parameter) {
     vTaskDelete(NULL);
 }
 
-LBMApi::LBMApi() {}
+LBMApi::LBMApi() : lorawan(stacks[STACK_ID]) {
+    for (uint8_t i = 0; i < LBM_NUMBER_OF_STACKS; i++) {
+        stacks[i].stack_id = i;
+    }
+}
 LBMApi::~LBMApi() {}
 
 smtc_modem_return_code_t LBMApi::init() {
+    lbm_log_start();
     DEBUG_PRINTLN("Initializing Basic Modem...");
+    lbm_crypto_init();
+#if BASIC_MODEM_DEBUG
+    const char* crypto_names[] = {"software", "hardware", "table"};
+    DEBUG_PRINTF("Crypto backend: %s AES\n", crypto_names[lbm_crypto_get_backend()]);
+#endif
+    lbm_nvm_init();
+    lbm_session_init();
+    lbm_uplink_init();
     lbm_init();
     return SMTC_MODEM_RC_OK;
 }
 
+// Queued records and uplink tickets, time before they need the CPU again
+static uint32_t processQueues() {
+    // Upload frames become tickets, handed to the modem in the same turn
+    const uint32_t upload_ms = lbm_upload_process();
+    const uint32_t aggregator_ms = lbm_aggregator_process();
+    const uint32_t uplink_ms = lbm_uplink_process();
+    const uint32_t queues_ms = (aggregator_ms < uplink_ms) ? aggregator_ms : uplink_ms;
+    return (upload_ms < queues_ms) ? upload_ms : queues_ms;
+}
+
+static bool readUploadBuffer(uint32_t offset, uint8_t* buffer, uint16_t size, void* context) {
+    memcpy(buffer, (const uint8_t*)context + offset, size);
+    return true;
+}
+
 void LBMApi::runEngine() {
-    smtc_modem_run_engine();
+    processQueues();
+    lbm_engine_run();
+}
+
+uint32_t LBMApi::runEngineUntilEvent(uint32_t max_wait_ms) {
+    // Queued records may need a frame before the modem itself needs the CPU
+    const uint32_t queues_ms = processQueues();
+    return lbm_engine_run_until_event((queues_ms < max_wait_ms) ? queues_ms : max_wait_ms);
+}
+
+void LBMApi::notifyEngine() {
+    lbm_engine_notify();
+}
+
+void LBMApi::getEngineStats(lbm_engine_stats_t* stats) {
+    lbm_engine_get_stats(stats);
+}
+
+void LBMApi::resetEngineStats() {
+    lbm_engine_reset_stats();
+    DEBUG_PRINTLN("Engine stats reset");
+}
+
+uint32_t LBMApi::runEngineLowPower(uint32_t max_wait_ms) {
+    const uint32_t queues_ms = processQueues();
+    return lbm_sleep_run_until_event((queues_ms < max_wait_ms) ? queues_ms : max_wait_ms);
+}
+
+void LBMApi::getSleepStats(lbm_sleep_stats_t* stats) {
+    lbm_sleep_get_stats(stats);
+}
+
+void LBMApi::resetSleepStats() {
+    lbm_sleep_reset_stats();
+    DEBUG_PRINTLN("Sleep stats reset");
+}
+
+void LBMApi::getEnergyStats(lbm_energy_stats_t* stats) {
+    lbm_energy_get_stats(stats);
+}
+
+void LBMApi::resetEnergyStats() {
+    lbm_energy_reset_stats();
+    DEBUG_PRINTLN("Energy stats reset");
+}
+
+void LBMApi::setEnergyProfile(const lbm_energy_profile_t* profile) {
+    lbm_energy_set_profile(profile);
+    DEBUG_PRINTF("Energy profile set: %s\n", profile ? "custom" : "board");
+}
+
+void LBMApi::getEnergyProfile(lbm_energy_profile_t* profile) {
+    lbm_energy_get_profile(profile);
 }
 
 void LBMApi::setEventCallback(LBMEventCallback callback) {
@@ -58,59 +163,342 @@ void LBMApi::setEventCallback(LBMEventCallback callback) {
     DEBUG_PRINTF("User event callback set: %s\n", callback ? "registered" : "cleared");
 }
 
+lbm_event_subscription_t LBMApi::subscribeEvents(uint32_t mask, lbm_event_handler_t handler, void* context, uint8_t priority) {
+    // The subscription tells the failure, LBM_EVENT_BUS_NO_SUBSCRIPTION whatever the reason
+    lbm_event_subscription_t subscription = LBM_EVENT_BUS_NO_SUBSCRIPTION;
+    lbm_event_bus_subscribe(mask, priority, handler, context, &subscription);
+    DEBUG_PRINTF("Subscribe events 0x%08X, priority %d: subscription %u\n",
+                 (unsigned)mask, priority, (unsigned)subscription);
+    return subscription;
+}
+
+smtc_modem_return_code_t LBMApi::unsubscribeEvents(lbm_event_subscription_t subscription) {
+    smtc_modem_return_code_t ret = lbm_event_bus_unsubscribe(subscription);
+    DEBUG_PRINTF("Unsubscribe events %u: %d\n", (unsigned)subscription, ret);
+    return ret;
+}
+
+smtc_modem_return_code_t LBMApi::setEventMask(lbm_event_subscription_t subscription, uint32_t mask) {
+    return lbm_event_bus_set_mask(subscription, mask);
+}
+
+void LBMApi::getEventBusStats(lbm_event_bus_stats_t* stats) {
+    lbm_event_bus_get_stats(stats);
+}
+
+void LBMApi::resetEventBusStats() {
+    lbm_event_bus_reset_stats();
+    DEBUG_PRINTLN("Event bus stats reset");
+}
+
+smtc_modem_return_code_t LBMApi::beginFuota(lbm_fuota_callback_t callback, void* context) {
+    smtc_modem_return_code_t ret = lbm_fuota_begin(callback, context);
+    DEBUG_PRINTF("Begin FUOTA on port %d: %d\n", LBM_FUOTA_PORT, ret);
+    return ret;
+}
+
+void LBMApi::endFuota() {
+    lbm_fuota_end();
+    DEBUG_PRINTLN("FUOTA ended");
+}
+
+void LBMApi::getFuotaProgress(lbm_fuota_progress_t* progress) {
+    lbm_fuota_get_progress(progress);
+}
+
+void LBMApi::setDownlinkCallback(LBMDownlinkCallback callback) {
+    userDownlinkCallback = callback;
+    DEBUG_PRINTF("User downlink callback set: %s\n", callback ? "registered" : "cleared");
+}
+
+void LBMApi::releaseDownlink(lbm_dl_buffer_t* downlink) {
+    lbm_dl_pool_release(downlink);
+}
+
+void LBMApi::getDownlinkPoolStats(lbm_dl_pool_stats_t* stats) {
+    lbm_dl_pool_get_stats(stats);
+}
+
+void LBMApi::resetDownlinkPoolStats() {
+    lbm_dl_pool_reset_stats();
+    DEBUG_PRINTLN("Downlink pool stats reset");
+}
+
+void LBMApi::useEventQueue(bool enable) {
+    lbm_event_ring_enable(enable);
+    DEBUG_PRINTF("Event delivery: %s\n", enable ? "queue" : "callback");
+}
+
+bool LBMApi::pollEvent(lbm_event_record_t* record) {
+    return lbm_event_ring_pop(record);
+}
+
+bool LBMApi::waitEvent(lbm_event_record_t* record, uint32_t timeout_ms) {
+    return lbm_event_ring_wait(record, timeout_ms);
+}
+
+void LBMApi::getEventQueueStats(lbm_event_ring_stats_t* stats) {
+    lbm_event_ring_get_stats(stats);
+}
+
+void LBMApi::resetEventQueueStats() {
+    lbm_event_ring_reset_stats();
+    DEBUG_PRINTLN("Event queue stats reset");
+}
+
+uint16_t LBMApi::peekFrames(const lbm_rx_frame_t** frames) {
+    return lbm_rx_ring_peek(frames);
+}
+
+uint16_t LBMApi::waitFrames(const lbm_rx_frame_t** frames, uint32_t timeout_ms) {
+    return lbm_rx_ring_wait(frames, timeout_ms);
+}
+
+void LBMApi::releaseFrames(uint16_t count) {
+    lbm_rx_ring_release(count);
+}
+
+void LBMApi::getRxRingStats(lbm_rx_ring_stats_t* stats) {
+    lbm_rx_ring_get_stats(stats);
+}
+
+void LBMApi::resetRxRingStats() {
+    lbm_rx_ring_reset_stats();
+    DEBUG_PRINTLN("RX ring stats reset");
+}
+
+void LBMApi::getLogStats(lbm_log_stats_t* stats) {
+    lbm_log_get_stats(stats);
+}
+
+void LBMApi::resetLogStats() {
+    lbm_log_reset_stats();
+}
+
+smtc_modem_return_code_t LBMApi::setCryptoBackend(lbm_crypto_backend_t backend) {
+    smtc_modem_return_code_t ret = lbm_crypto_set_backend(backend);
+    DEBUG_PRINTF("Set crypto backend result: %d\n", ret);
+    return ret;
+}
+
+lbm_crypto_backend_t LBMApi::getCryptoBackend() {
+    return lbm_crypto_get_backend();
+}
+
+smtc_modem_return_code_t LBMApi::syncNvm() {
+    smtc_modem_return_code_t ret = lbm_nvm_sync();
+    DEBUG_PRINTF("Sync NVM result: %d\n", ret);
+    return ret;
+}
+
+void LBMApi::useWarmStart(bool enable, const lbm_session_policy_t* policy) {
+    lbm_session_enable(enable, policy);
+    DEBUG_PRINTF("Warm start: %s\n", enable ? "enabled" : "disabled");
+}
+
+void LBMApi::getSessionStats(lbm_session_stats_t* stats) {
+    lbm_session_get_stats(stats);
+}
+
+void LBMApi::getNvmStats(lbm_nvm_stats_t* stats) {
+    lbm_nvm_get_stats(stats);
+}
+
+void LBMApi::resetNvmStats() {
+    lbm_nvm_reset_stats();
+    DEBUG_PRINTLN("NVM stats reset");
+}
+
+void LBMApi::getStats(lbm_profile_stats_t* stats) {
+    lbm_profile_get_stats(stats);
+}
+
+void LBMApi::resetStats() {
+    lbm_profile_reset_stats();
+    DEBUG_PRINTLN("Profile stats reset");
+}
+
+// Multi-stack implementations
+LoRaWANClass* LBMApi::lorawanStack(uint8_t stack_id) {
+    return (stack_id < LBM_NUMBER_OF_STACKS) ? &stacks[stack_id] : nullptr;
+}
+
+uint8_t LBMApi::getNumberOfStacks() const {
+    return LBM_NUMBER_OF_STACKS;
+}
+
 // LoRaWAN class implementations
 smtc_modem_return_code_t LoRaWANClass::setDevEUI(const uint8_t* dev_eui) {
-    smtc_modem_return_code_t ret = smtc_modem_set_deveui(0, dev_eui);
+    smtc_modem_return_code_t ret = smtc_modem_set_deveui(stack_id, dev_eui);
     DEBUG_PRINTF("Set DevEUI result: %d\n", ret);
     return ret;
 }
 
 smtc_modem_return_code_t LoRaWANClass::setJoinEUI(const uint8_t* join_eui) {
-    smtc_modem_return_code_t ret = smtc_modem_set_joineui(0, join_eui);
+    smtc_modem_return_code_t ret = smtc_modem_set_joineui(stack_id, join_eui);
     DEBUG_PRINTF("Set JoinEUI result: %d\n", ret);
     return ret;
 }
 
 smtc_modem_return_code_t LoRaWANClass::setAppKey(const uint8_t* app_key) {
-    smtc_modem_return_code_t ret = smtc_modem_set_appkey(0, app_key);
+    smtc_modem_return_code_t ret = smtc_modem_set_appkey(stack_id, app_key);
     DEBUG_PRINTF("Set AppKey result: %d\n", ret);
     return ret;
 }
 
 smtc_modem_return_code_t LoRaWANClass::setNwkKey(const uint8_t* nwk_key) {
-    smtc_modem_return_code_t ret = smtc_modem_set_nwkkey(0, nwk_key);
+    smtc_modem_return_code_t ret = smtc_modem_set_nwkkey(stack_id, nwk_key);
     DEBUG_PRINTF("Set NwkKey result: %d\n", ret);
     return ret;
 }
 
 smtc_modem_return_code_t LoRaWANClass::setRegion(smtc_modem_region_t region) {
-    smtc_modem_return_code_t ret = smtc_modem_set_region(0, region);
+    smtc_modem_return_code_t ret = smtc_modem_set_region(stack_id, region);
     DEBUG_PRINTF("Set Region result: %d\n", ret);
     return ret;
 }
 
 smtc_modem_return_code_t LoRaWANClass::setClass(smtc_modem_class_t modem_class) {
-    smtc_modem_return_code_t ret = smtc_modem_set_class(0, modem_class);
+    smtc_modem_return_code_t ret = smtc_modem_set_class(stack_id, modem_class);
+    lbm_engine_notify();
     DEBUG_PRINTF("Set Class result: %d (Class %c)\n", ret, 'A' + modem_class);
     return ret;
 }
 
 smtc_modem_return_code_t LoRaWANClass::join() {
-    smtc_modem_return_code_t ret = smtc_modem_join_network(0);
-    DEBUG_PRINTF("Join network result: %d\n", ret);
+    if ((stack_id == STACK_ID) && lbm_session_resume()) {
+        lbm_engine_notify();
+        DEBUG_PRINTLN("Join network result: session resumed");
+        return SMTC_MODEM_RC_OK;
+    }
+    smtc_modem_return_code_t ret = smtc_modem_join_network(stack_id);
+    lbm_engine_notify();
+    DEBUG_PRINTF("Join network result: %d (stack %d)\n", ret, stack_id);
     return ret;
 }
 
 smtc_modem_return_code_t LoRaWANClass::send(const uint8_t* data, size_t len, uint8_t port, bool confirmed) {
-    smtc_modem_return_code_t ret = smtc_modem_request_uplink(0, port, confirmed, data, len);
+    smtc_modem_return_code_t ret = smtc_modem_request_uplink(stack_id, port, confirmed, data, len);
+    lbm_engine_notify();
     DEBUG_PRINTF("Send uplink: port=%d, len=%d, confirmed=%s, result=%d\n", 
-                 port, len, confirmed ? "true" : "false", ret);
+                 port, (int)len, confirmed ? "true" : "false", ret);
+    return ret;
+}
+
+smtc_modem_return_code_t LoRaWANClass::sendLrFhss(const uint8_t* data, size_t len, uint8_t port, bool confirmed, uint8_t datarate) {
+    if (len > 0xFF) {
+        return SMTC_MODEM_RC_INVALID;
+    }
+    smtc_modem_return_code_t ret = lbm_lr_fhss_send(stack_id, datarate, port, confirmed, data, (uint8_t)len);
+    lbm_engine_notify();
+    DEBUG_PRINTF("Send LR-FHSS uplink: port=%d, len=%d, confirmed=%s, result=%d\n",
+                 port, (int)len, confirmed ? "true" : "false", ret);
+    return ret;
+}
+
+lbm_uplink_ticket_t LoRaWANClass::sendAsync(const uint8_t* data, size_t len, uint8_t port, bool confirmed,
+                                            lbm_uplink_callback_t callback, void* context,
+                                            smtc_modem_return_code_t* result) {
+    lbm_uplink_ticket_t ticket = LBM_UPLINK_NO_TICKET;
+    smtc_modem_return_code_t ret = SMTC_MODEM_RC_INVALID;
+    if (len <= 0xFF) {
+        ret = lbm_uplink_submit(stack_id, port, confirmed, data, (uint8_t)len, callback, context, &ticket);
+    }
+    lbm_engine_notify();
+    DEBUG_PRINTF("Queue uplink ticket %u: port=%d, len=%d, confirmed=%s, result=%d\n",
+                 (unsigned)ticket, port, (int)len, confirmed ? "true" : "false", ret);
+    if (result != nullptr) {
+        *result = ret;
+    }
+    return ticket;
+}
+
+smtc_modem_return_code_t LoRaWANClass::getUplinkResult(lbm_uplink_ticket_t ticket, lbm_uplink_result_t* result) {
+    return lbm_uplink_get(ticket, result);
+}
+
+smtc_modem_return_code_t LoRaWANClass::waitUplink(lbm_uplink_ticket_t ticket, lbm_uplink_result_t* result, uint32_t timeout_ms) {
+    return lbm_uplink_wait(ticket, result, timeout_ms);
+}
+
+smtc_modem_return_code_t LoRaWANClass::cancelUplink(lbm_uplink_ticket_t ticket) {
+    smtc_modem_return_code_t ret = lbm_uplink_cancel(ticket);
+    DEBUG_PRINTF("Cancel uplink ticket %u: %d\n", (unsigned)ticket, ret);
+    return ret;
+}
+
+void LoRaWANClass::getUplinkStats(lbm_uplink_stats_t* stats) {
+    lbm_uplink_get_stats(stats);
+}
+
+void LoRaWANClass::resetUplinkStats() {
+    lbm_uplink_reset_stats();
+    DEBUG_PRINTLN("Uplink ticket stats reset");
+}
+
+void LoRaWANClass::getDefaultUploadParams(lbm_upload_params_t* params) {
+    lbm_upload_get_default_params(params);
+}
+
+smtc_modem_return_code_t LoRaWANClass::upload(const uint8_t* data, size_t len, const lbm_upload_params_t* params,
+                                              lbm_upload_callback_t callback, void* context) {
+    if (data == nullptr) {
+        return SMTC_MODEM_RC_INVALID;
+    }
+    return upload(readUploadBuffer, (void*)data, (uint32_t)len, params, callback, context);
+}
+
+smtc_modem_return_code_t LoRaWANClass::upload(lbm_upload_source_t source, void* source_context, uint32_t size,
+                                              const lbm_upload_params_t* params,
+                                              lbm_upload_callback_t callback, void* context) {
+    smtc_modem_return_code_t ret = lbm_upload_start(stack_id, params, source, source_context, size, callback, context);
+    lbm_engine_notify();
+    DEBUG_PRINTF("Start upload: %u bytes, result=%d\n", (unsigned)size, ret);
+    return ret;
+}
+
+smtc_modem_return_code_t LoRaWANClass::abortUpload() {
+    smtc_modem_return_code_t ret = lbm_upload_abort(stack_id);
+    DEBUG_PRINTF("Abort upload: result=%d\n", ret);
+    return ret;
+}
+
+smtc_modem_return_code_t LoRaWANClass::getUploadProgress(lbm_upload_progress_t* progress) {
+    return lbm_upload_get_progress(stack_id, progress);
+}
+
+smtc_modem_return_code_t LoRaWANClass::queueRecord(uint8_t type, const uint8_t* data, uint8_t len, uint32_t latency_budget_ms) {
+    if (stack_id != STACK_ID) {
+        return SMTC_MODEM_RC_INVALID_STACK_ID;
+    }
+    smtc_modem_return_code_t ret = lbm_aggregator_queue(type, data, len, latency_budget_ms);
+    lbm_engine_notify();
+    DEBUG_PRINTF("Queue record: type=%d, len=%d, budget=%lums, result=%d\n", type, len, (unsigned long)latency_budget_ms, ret);
+    return ret;
+}
+
+smtc_modem_return_code_t LoRaWANClass::flushRecords() {
+    if (stack_id != STACK_ID) {
+        return SMTC_MODEM_RC_INVALID_STACK_ID;
+    }
+    smtc_modem_return_code_t ret = lbm_aggregator_flush();
+    lbm_engine_notify();
+    DEBUG_PRINTF("Flush records result: %d\n", ret);
     return ret;
 }
 
+void LoRaWANClass::getAggregationStats(lbm_aggregator_stats_t* stats) {
+    lbm_aggregator_get_stats(stats);
+}
+
+void LoRaWANClass::resetAggregationStats() {
+    lbm_aggregator_reset_stats();
+    DEBUG_PRINTLN("Aggregation stats reset");
+}
+
 smtc_modem_return_code_t LoRaWANClass::isJoined(bool* joined) const {
     smtc_modem_status_mask_t status_mask;
-    smtc_modem_return_code_t ret = smtc_modem_get_status(0, &status_mask);
+    smtc_modem_return_code_t ret = smtc_modem_get_status(stack_id, &status_mask);
     if (ret == SMTC_MODEM_RC_OK) {
         if (joined != nullptr) {
             *joined = ((status_mask & SMTC_MODEM_STATUS_JOINED) != 0);
@@ -125,13 +513,91 @@ smtc_modem_return_code_t LoRaWANClass::isJoined(bool* joined) const {
 }
 
 smtc_modem_return_code_t LoRaWANClass::getDownlinkData(uint8_t* payload, uint8_t* payload_size, smtc_modem_dl_metadata_t* metadata, uint8_t* remaining) {
+    // Inside the DOWNDATA callback the engine already read this downlink into the pool
+    const lbm_dl_buffer_t* downlink = lbm_take_dispatched_downlink();
+    if (downlink != nullptr) {
+        memcpy(payload, downlink->payload, downlink->size);
+        *payload_size = downlink->size;
+        *metadata = downlink->metadata;
+        *remaining = downlink->remaining;
+        return SMTC_MODEM_RC_OK;
+    }
+
     smtc_modem_return_code_t ret = smtc_modem_get_downlink_data(payload, payload_size, metadata, remaining);
     DEBUG_PRINTF("Get downlink data result: %d\n", ret);
     return ret;
 }
 
+smtc_modem_return_code_t LoRaWANClass::startClassC(lbm_rx_frame_t* storage, uint16_t size) {
+    smtc_modem_return_code_t ret = lbm_rx_ring_start(storage, size);
+    if (ret == SMTC_MODEM_RC_OK) {
+        ret = setClass(SMTC_MODEM_CLASS_C);
+        if (ret != SMTC_MODEM_RC_OK) {
+            lbm_rx_ring_stop();
+        }
+    }
+    DEBUG_PRINTF("Start Class C receive (stack %d): %d\n", stack_id, ret);
+    return ret;
+}
+
+smtc_modem_return_code_t LoRaWANClass::stopClassC() {
+    lbm_rx_ring_stop();
+    return setClass(SMTC_MODEM_CLASS_A);
+}
+
+smtc_modem_return_code_t LoRaWANClass::setMulticastGroup(uint8_t group, uint32_t address, const uint8_t nwk_skey[16],
+                                                         const uint8_t app_skey[16]) {
+    smtc_modem_return_code_t ret = smtc_modem_multicast_set_grp_config(stack_id, group, address, nwk_skey, app_skey);
+    DEBUG_PRINTF("Set multicast group %d (0x%08X): %d\n", group, (unsigned)address, ret);
+    return ret;
+}
+
+smtc_modem_return_code_t LoRaWANClass::startMulticastClassC(uint8_t group, uint32_t frequency_hz, uint8_t datarate) {
+    smtc_modem_return_code_t ret = smtc_modem_multicast_class_c_start_session(stack_id, group, frequency_hz, datarate);
+    lbm_engine_notify();
+    DEBUG_PRINTF("Start multicast group %d in Class C (%u Hz, DR%d): %d\n", group, (unsigned)frequency_hz, datarate,
+                 ret);
+    return ret;
+}
+
+smtc_modem_return_code_t LoRaWANClass::stopMulticastClassC(uint8_t group) {
+    smtc_modem_return_code_t ret = smtc_modem_multicast_class_c_stop_session(stack_id, group);
+    lbm_engine_notify();
+    DEBUG_PRINTF("Stop multicast group %d: %d\n", group, ret);
+    return ret;
+}
+
+smtc_modem_return_code_t LoRaWANClass::startClassB(smtc_modem_class_b_ping_slot_periodicity_t periodicity) {
+    smtc_modem_return_code_t ret = lbm_class_b_start(stack_id, periodicity);
+    lbm_engine_notify();
+    DEBUG_PRINTF("Start Class B (stack %d, ping slot every %d s): %d\n", stack_id, 1 << periodicity, ret);
+    return ret;
+}
+
+smtc_modem_return_code_t LoRaWANClass::stopClassB() {
+    smtc_modem_return_code_t ret = lbm_class_b_stop();
+    lbm_engine_notify();
+    DEBUG_PRINTF("Stop Class B: %d\n", ret);
+    return ret;
+}
+
+smtc_modem_return_code_t LoRaWANClass::setPingSlotPeriodicity(smtc_modem_class_b_ping_slot_periodicity_t periodicity) {
+    smtc_modem_return_code_t ret = lbm_class_b_set_periodicity(periodicity);
+    lbm_engine_notify();
+    DEBUG_PRINTF("Set ping slot every %d s: %d\n", 1 << periodicity, ret);
+    return ret;
+}
+
+void LoRaWANClass::getClassBStats(lbm_class_b_stats_t* stats) {
+    lbm_class_b_get_stats(stats);
+}
+
+void LoRaWANClass::resetClassBStats() {
+    lbm_class_b_reset_stats();
+}
+
 smtc_modem_return_code_t LoRaWANClass::setJoinDataRateDistribution(const uint8_t dr_distribution[SMTC_MODEM_CUSTOM_ADR_DATA_LENGTH]) {
-    smtc_modem_return_code_t ret = smtc_modem_adr_set_join_distribution(0, dr_distribution);
+    smtc_modem_return_code_t ret = smtc_modem_adr_set_join_distribution(stack_id, dr_distribution);
     DEBUG_PRINTF("Set Join DR distribution result: %d\n", ret);
 #if BASIC_MODEM_DEBUG
     // Print distribution for debugging
@@ -148,30 +614,46 @@ smtc_modem_return_code_t LoRaWANClass::setJoinDataRateDistribution(const uint8_t
 }
 
 smtc_modem_return_code_t LoRaWANClass::setADRProfile(smtc_modem_adr_profile_t adr_profile, const uint8_t dr_distribution[SMTC_MODEM_CUSTOM_ADR_DATA_LENGTH]) {
-    smtc_modem_return_code_t ret = smtc_modem_adr_set_profile(0, adr_profile, dr_distribution);
+    smtc_modem_return_code_t ret = lbm_lr_fhss_set_adr_profile(stack_id, adr_profile, dr_distribution);
+#if BASIC_MODEM_DEBUG
     const char* profile_names[] = {"NETWORK_CONTROLLED", "MOBILE_LONG_RANGE", "MOBILE_LOW_POWER", "CUSTOM"};
     DEBUG_PRINTF("Set ADR profile: %s, result: %d\n", 
                  (adr_profile <= SMTC_MODEM_ADR_PROFILE_CUSTOM) ? profile_names[adr_profile] : "UNKNOWN", 
                  ret);
+#endif
+    return ret;
+}
+
+smtc_modem_return_code_t LoRaWANClass::setLrFhssDistribution(uint8_t lr_fhss_percent, const uint8_t dr_distribution[SMTC_MODEM_CUSTOM_ADR_DATA_LENGTH]) {
+    smtc_modem_return_code_t ret = lbm_lr_fhss_set_distribution(stack_id, lr_fhss_percent, dr_distribution);
+    DEBUG_PRINTF("Set LR-FHSS share: %d%%, result: %d\n", lr_fhss_percent, ret);
+    return ret;
+}
+
+smtc_modem_return_code_t LoRaWANClass::getLrFhssDatarates(uint16_t* datarates_mask) {
+    smtc_modem_return_code_t ret = lbm_lr_fhss_get_datarates(stack_id, datarates_mask);
+    if (ret == SMTC_MODEM_RC_OK) {
+        DEBUG_PRINTF("Get LR-FHSS datarates: 0x%04X\n", *datarates_mask);
+    }
     return ret;
 }
 
 smtc_modem_return_code_t LoRaWANClass::setNbTrans(uint8_t nb_trans) {
-    smtc_modem_return_code_t ret = smtc_modem_set_nb_trans(0, nb_trans);
+    smtc_modem_return_code_t ret = smtc_modem_set_nb_trans(stack_id, nb_trans);
     DEBUG_PRINTF("Set NbTrans: %d, result: %d\n", nb_trans, ret);
     return ret;
 }
 
 // LBT (Listen Before Talk) implementations
 smtc_modem_return_code_t LoRaWANClass::setLBTParameters(uint32_t listening_duration_ms, int16_t threshold_dbm, uint32_t bw_hz) {
-    smtc_modem_return_code_t ret = smtc_modem_lbt_set_parameters(0, listening_duration_ms, threshold_dbm, bw_hz);
+    smtc_modem_return_code_t ret = smtc_modem_lbt_set_parameters(stack_id, listening_duration_ms, threshold_dbm, bw_hz);
     DEBUG_PRINTF("Set LBT parameters: duration=%dms, threshold=%ddBm, bw=%dHz, result: %d\n", 
                  listening_duration_ms, threshold_dbm, bw_hz, ret);
     return ret;
 }
 
 smtc_modem_return_code_t LoRaWANClass::getLBTParameters(uint32_t* listening_duration_ms, int16_t* threshold_dbm, uint32_t* bw_hz) {
-    smtc_modem_return_code_t ret = smtc_modem_lbt_get_parameters(0, listening_duration_ms, threshold_dbm, bw_hz);
+    smtc_modem_return_code_t ret = smtc_modem_lbt_get_parameters(stack_id, listening_duration_ms, threshold_dbm, bw_hz);
     if (ret == SMTC_MODEM_RC_OK) {
         DEBUG_PRINTF("Get LBT parameters: duration=%dms, threshold=%ddBm, bw=%dHz\n", 
                      *listening_duration_ms, *threshold_dbm, *bw_hz);
@@ -182,13 +664,13 @@ smtc_modem_return_code_t LoRaWANClass::getLBTParameters(uint32_t* listening_dura
 }
 
 smtc_modem_return_code_t LoRaWANClass::setLBTState(bool enable) {
-    smtc_modem_return_code_t ret = smtc_modem_lbt_set_state(0, enable);
+    smtc_modem_return_code_t ret = smtc_modem_lbt_set_state(stack_id, enable);
     DEBUG_PRINTF("Set LBT state: %s, result: %d\n", enable ? "enabled" : "disabled", ret);
     return ret;
 }
 
 smtc_modem_return_code_t LoRaWANClass::getLBTState(bool* enabled) {
-    smtc_modem_return_code_t ret = smtc_modem_lbt_get_state(0, enabled);
+    smtc_modem_return_code_t ret = smtc_modem_lbt_get_state(stack_id, enabled);
     if (ret == SMTC_MODEM_RC_OK) {
         DEBUG_PRINTF("Get LBT state: %s\n", *enabled ? "enabled" : "disabled");
     } else {
@@ -199,13 +681,13 @@ smtc_modem_return_code_t LoRaWANClass::getLBTState(bool* enabled) {
 
 // CSMA (Carrier Sense Multiple Access) implementations
 smtc_modem_return_code_t LoRaWANClass::setCSMAState(bool enable) {
-    smtc_modem_return_code_t ret = smtc_modem_csma_set_state(0, enable);
+    smtc_modem_return_code_t ret = smtc_modem_csma_set_state(stack_id, enable);
     DEBUG_PRINTF("Set CSMA state: %s, result: %d\n", enable ? "enabled" : "disabled", ret);
     return ret;
 }
 
 smtc_modem_return_code_t LoRaWANClass::getCSMAState(bool* enabled) {
-    smtc_modem_return_code_t ret = smtc_modem_csma_get_state(0, enabled);
+    smtc_modem_return_code_t ret = smtc_modem_csma_get_state(stack_id, enabled);
     if (ret == SMTC_MODEM_RC_OK) {
         DEBUG_PRINTF("Get CSMA state: %s\n", *enabled ? "enabled" : "disabled");
     } else {
@@ -215,14 +697,14 @@ smtc_modem_return_code_t LoRaWANClass::getCSMAState(bool* enabled) {
 }
 
 smtc_modem_return_code_t LoRaWANClass::setCSMAParameters(uint8_t max_ch_change, bool bo_enabled, uint8_t nb_bo_max) {
-    smtc_modem_return_code_t ret = smtc_modem_csma_set_parameters(0, max_ch_change, bo_enabled, nb_bo_max);
+    smtc_modem_return_code_t ret = smtc_modem_csma_set_parameters(stack_id, max_ch_change, bo_enabled, nb_bo_max);
     DEBUG_PRINTF("Set CSMA parameters: max_ch_change=%d, back-off=%s, nb_bo_max=%d, result: %d\n", 
                  max_ch_change, bo_enabled ? "enabled" : "disabled", nb_bo_max, ret);
     return ret;
 }
 
 smtc_modem_return_code_t LoRaWANClass::getCSMAParameters(uint8_t* max_ch_change, bool* bo_enabled, uint8_t* nb_bo_max) {
-    smtc_modem_return_code_t ret = smtc_modem_csma_get_parameters(0, max_ch_change, bo_enabled, nb_bo_max);
+    smtc_modem_return_code_t ret = smtc_modem_csma_get_parameters(stack_id, max_ch_change, bo_enabled, nb_bo_max);
     if (ret == SMTC_MODEM_RC_OK) {
         DEBUG_PRINTF("Get CSMA parameters: max_ch_change=%d, back-off=%s, nb_bo_max=%d\n", 
                      *max_ch_change, *bo_enabled ? "enabled" : "disabled", *nb_bo_max);
@@ -234,7 +716,7 @@ smtc_modem_return_code_t LoRaWANClass::getCSMAParameters(uint8_t* max_ch_change,
 
 // Network utility implementations
 smtc_modem_return_code_t LoRaWANClass::getNextTxMaxPayload(uint8_t* tx_max_payload_size) {
-    smtc_modem_return_code_t ret = smtc_modem_get_next_tx_max_payload(0, tx_max_payload_size);
+    smtc_modem_return_code_t ret = smtc_modem_get_next_tx_max_payload(stack_id, tx_max_payload_size);
     if (ret == SMTC_MODEM_RC_OK) {
         DEBUG_PRINTF("Get next TX max payload: %d bytes\n", *tx_max_payload_size);
     } else {
@@ -244,7 +726,7 @@ smtc_modem_return_code_t LoRaWANClass::getNextTxMaxPayload(uint8_t* tx_max_paylo
 }
 
 smtc_modem_return_code_t LoRaWANClass::getDutyCycleStatus(int32_t* duty_cycle_status_ms) {
-    smtc_modem_return_code_t ret = smtc_modem_get_duty_cycle_status(0, duty_cycle_status_ms);
+    smtc_modem_return_code_t ret = smtc_modem_get_duty_cycle_status(stack_id, duty_cycle_status_ms);
     if (ret == SMTC_MODEM_RC_OK) {
         if (*duty_cycle_status_ms >= 0) {
             DEBUG_PRINTF("Duty cycle status: %dms available\n", *duty_cycle_status_ms);
@@ -257,8 +739,26 @@ smtc_modem_return_code_t LoRaWANClass::getDutyCycleStatus(int32_t* duty_cycle_st
     return ret;
 }
 
+smtc_modem_return_code_t LoRaWANClass::getTimeOnAir(uint8_t datarate, uint8_t len, uint32_t* time_on_air_ms) {
+    uint32_t time_on_air_us = 0;
+    smtc_modem_return_code_t ret = lbm_airtime_get(stack_id, datarate, len, &time_on_air_us);
+    if (ret == SMTC_MODEM_RC_OK) {
+        *time_on_air_ms = (time_on_air_us + 999) / 1000;
+    }
+    return ret;
+}
+
+smtc_modem_return_code_t LoRaWANClass::getEarliestSendTime(uint8_t datarate, uint8_t len, uint32_t* wait_ms, int32_t* budget_after_ms) {
+    smtc_modem_return_code_t ret = lbm_airtime_earliest_send(stack_id, datarate, len, wait_ms, budget_after_ms);
+    if (ret == SMTC_MODEM_RC_OK) {
+        DEBUG_PRINTF("Earliest send of %u bytes at DR%u: in %ums\n", len, datarate, *wait_ms);
+    }
+    return ret;
+}
+
 smtc_modem_return_code_t LoRaWANClass::sendEmptyUplink(bool send_fport, uint8_t fport, bool confirmed) {
-    smtc_modem_return_code_t ret = smtc_modem_request_empty_uplink(0, send_fport, fport, confirmed);
+    smtc_modem_return_code_t ret = smtc_modem_request_empty_uplink(stack_id, send_fport, fport, confirmed);
+    lbm_engine_notify();
     DEBUG_PRINTF("Send empty uplink: fport=%s%d, confirmed=%s, result=%d\n",
                  send_fport ? "" : "none(", send_fport ? fport : 0, 
                  confirmed ? "true" : "false", ret);
@@ -266,13 +766,18 @@ smtc_modem_return_code_t LoRaWANClass::sendEmptyUplink(bool send_fport, uint8_t
 }
 
 smtc_modem_return_code_t LoRaWANClass::leaveNetwork() {
-    smtc_modem_return_code_t ret = smtc_modem_leave_network(0);
+    smtc_modem_return_code_t ret = smtc_modem_leave_network(stack_id);
+    if (stack_id == STACK_ID) {
+        lbm_session_forget();
+    }
+    lbm_lr_fhss_on_leave(stack_id);
+    lbm_engine_notify();
     DEBUG_PRINTF("Leave network: result=%d\n", ret);
     return ret;
 }
 
 smtc_modem_return_code_t LoRaWANClass::getNetworkType(bool* network_type) {
-    smtc_modem_return_code_t ret = smtc_modem_get_network_type(0, network_type);
+    smtc_modem_return_code_t ret = smtc_modem_get_network_type(stack_id, network_type);
     if (ret == SMTC_MODEM_RC_OK) {
         DEBUG_PRINTF("Get network type: %s\n", *network_type ? "public" : "private");
     } else {
@@ -282,14 +787,14 @@ smtc_modem_return_code_t LoRaWANClass::getNetworkType(bool* network_type) {
 }
 
 smtc_modem_return_code_t LoRaWANClass::setNetworkType(bool network_type) {
-    smtc_modem_return_code_t ret = smtc_modem_set_network_type(0, network_type);
+    smtc_modem_return_code_t ret = smtc_modem_set_network_type(stack_id, network_type);
     DEBUG_PRINTF("Set network type: %s, result=%d\n", 
                  network_type ? "public" : "private", ret);
     return ret;
 }
 
 smtc_modem_return_code_t LoRaWANClass::getEnabledDatarates(uint16_t* enabled_datarates_mask) {
-    smtc_modem_return_code_t ret = smtc_modem_get_enabled_datarates(0, enabled_datarates_mask);
+    smtc_modem_return_code_t ret = smtc_modem_get_enabled_datarates(stack_id, enabled_datarates_mask);
     if (ret == SMTC_MODEM_RC_OK) {
         DEBUG_PRINTF("Get enabled datarates: 0x%04X\n", *enabled_datarates_mask);
     } else {
@@ -299,14 +804,14 @@ smtc_modem_return_code_t LoRaWANClass::getEnabledDatarates(uint16_t* enabled_dat
 }
 
 smtc_modem_return_code_t LoRaWANClass::setADRAckLimitDelay(uint8_t adr_ack_limit, uint8_t adr_ack_delay) {
-    smtc_modem_return_code_t ret = smtc_modem_set_adr_ack_limit_delay(0, adr_ack_limit, adr_ack_delay);
+    smtc_modem_return_code_t ret = smtc_modem_set_adr_ack_limit_delay(stack_id, adr_ack_limit, adr_ack_delay);
     DEBUG_PRINTF("Set ADR ACK limit/delay: %d/%d, result=%d\n", 
                  adr_ack_limit, adr_ack_delay, ret);
     return ret;
 }
 
 smtc_modem_return_code_t LoRaWANClass::getADRAckLimitDelay(uint8_t* adr_ack_limit, uint8_t* adr_ack_delay) {
-    smtc_modem_return_code_t ret = smtc_modem_get_adr_ack_limit_delay(0, adr_ack_limit, adr_ack_delay);
+    smtc_modem_return_code_t ret = smtc_modem_get_adr_ack_limit_delay(stack_id, adr_ack_limit, adr_ack_delay);
     if (ret == SMTC_MODEM_RC_OK) {
         DEBUG_PRINTF("Get ADR ACK limit/delay: %d/%d\n", *adr_ack_limit, *adr_ack_delay);
     } else {
@@ -317,13 +822,14 @@ smtc_modem_return_code_t LoRaWANClass::getADRAckLimitDelay(uint8_t* adr_ack_limi
 
 smtc_modem_return_code_t LoRaWANClass::suspendRadio(bool suspend) {
     smtc_modem_return_code_t ret = smtc_modem_suspend_radio_communications(suspend);
+    lbm_engine_notify();
     DEBUG_PRINTF("Radio communications: %s, result=%d\n", 
                  suspend ? "suspended" : "resumed", ret);
     return ret;
 }
 
 smtc_modem_return_code_t LoRaWANClass::getRadioSuspendStatus(bool* suspended) {
-    smtc_modem_return_code_t ret = smtc_modem_get_suspend_radio_communications(0, suspended);
+    smtc_modem_return_code_t ret = smtc_modem_get_suspend_radio_communications(stack_id, suspended);
     if (ret == SMTC_MODEM_RC_OK) {
         DEBUG_PRINTF("Radio suspend status: %s\n", *suspended ? "suspended" : "active");
     } else {
@@ -333,7 +839,7 @@ smtc_modem_return_code_t LoRaWANClass::getRadioSuspendStatus(bool* suspended) {
 }
 
 smtc_modem_return_code_t LoRaWANClass::getJoinDutyCycleBackoffBypass(bool* enabled) {
-    smtc_modem_return_code_t ret = smtc_modem_get_join_duty_cycle_backoff_bypass(0, enabled);
+    smtc_modem_return_code_t ret = smtc_modem_get_join_duty_cycle_backoff_bypass(stack_id, enabled);
     if (ret == SMTC_MODEM_RC_OK) {
         DEBUG_PRINTF("Join duty cycle backoff bypass: %s\n", *enabled ? "enabled" : "disabled");
     } else {
@@ -343,7 +849,7 @@ smtc_modem_return_code_t LoRaWANClass::getJoinDutyCycleBackoffBypass(bool* enabl
 }
 
 smtc_modem_return_code_t LoRaWANClass::setJoinDutyCycleBackoffBypass(bool enable) {
-    smtc_modem_return_code_t ret = smtc_modem_set_join_duty_cycle_backoff_bypass(0, enable);
+    smtc_modem_return_code_t ret = smtc_modem_set_join_duty_cycle_backoff_bypass(stack_id, enable);
     DEBUG_PRINTF("Set join duty cycle backoff bypass: %s, result=%d\n", 
                  enable ? "enabled" : "disabled", ret);
     return ret;
@@ -369,12 +875,14 @@ smtc_modem_return_code_t LoRaWANClass::getCrystalError(uint32_t* crystal_error_p
 // Alarm timer implementations
 smtc_modem_return_code_t LoRaWANClass::startAlarmTimer(uint32_t alarm_timer_in_s) {
     smtc_modem_return_code_t ret = smtc_modem_alarm_start_timer(alarm_timer_in_s);
+    lbm_engine_notify();
     DEBUG_PRINTF("Start alarm timer: %ds, result=%d\n", alarm_timer_in_s, ret);
     return ret;
 }
 
 smtc_modem_return_code_t LoRaWANClass::clearAlarmTimer() {
     smtc_modem_return_code_t ret = smtc_modem_alarm_clear_timer();
+    lbm_engine_notify();
     DEBUG_PRINTF("Clear alarm timer: result=%d\n", ret);
     return ret;
 }
@@ -389,5 +897,116 @@ smtc_modem_return_code_t LoRaWANClass::getAlarmRemainingTime(uint32_t* remaining
     return ret;
 }
 
+// Per-stack implementations
+uint8_t LoRaWANClass::getStackId() const {
+    return stack_id;
+}
+
+void LoRaWANClass::setEventCallback(LBMEventCallback callback) {
+    lbm_stacks_set_event_callback(stack_id, callback);
+}
+
+void LoRaWANClass::getStackStats(lbm_stack_stats_t* stats) {
+    lbm_stacks_get_stats(stack_id, stats);
+}
+
+void LoRaWANClass::resetStackStats() {
+    lbm_stacks_reset_stats(stack_id);
+    DEBUG_PRINTF("Stack %d stats reset\n", stack_id);
+}
+
+// P2P class implementations
+
+void P2PClass::getDefaultParams(lbm_p2p_params_t* params) {
+    lbm_p2p_get_default_params(params);
+}
+
+smtc_modem_return_code_t P2PClass::begin(const lbm_p2p_params_t* params) {
+    smtc_modem_return_code_t ret = lbm_p2p_begin(params);
+    DEBUG_PRINTF("P2P begin: %d\n", ret);
+    return ret;
+}
+
+void P2PClass::end() {
+    lbm_p2p_end();
+    DEBUG_PRINTLN("P2P ended");
+}
+
+smtc_modem_return_code_t P2PClass::setParams(const lbm_p2p_params_t* params) {
+    smtc_modem_return_code_t ret = lbm_p2p_set_params(params);
+    DEBUG_PRINTF("P2P set params: %d\n", ret);
+    return ret;
+}
+
+smtc_modem_return_code_t P2PClass::send(const uint8_t* data, uint8_t len, const lbm_p2p_params_t* params) {
+    smtc_modem_return_code_t ret = lbm_p2p_send(data, len, params);
+    DEBUG_PRINTF("P2P send %d bytes: %d\n", len, ret);
+    return ret;
+}
+
+smtc_modem_return_code_t P2PClass::startReceive() {
+    smtc_modem_return_code_t ret = lbm_p2p_start_rx();
+    DEBUG_PRINTF("P2P start receive: %d\n", ret);
+    return ret;
+}
+
+smtc_modem_return_code_t P2PClass::stopReceive() {
+    smtc_modem_return_code_t ret = lbm_p2p_stop_rx();
+    DEBUG_PRINTF("P2P stop receive: %d\n", ret);
+    return ret;
+}
+
+uint32_t P2PClass::available() {
+    return lbm_p2p_available();
+}
+
+bool P2PClass::read(lbm_p2p_frame_t* frame) {
+    return lbm_p2p_read(frame);
+}
+
+bool P2PClass::receive(lbm_p2p_frame_t* frame, uint32_t timeout_ms) {
+    return lbm_p2p_wait(frame, timeout_ms);
+}
+
+void P2PClass::getStats(lbm_p2p_stats_t* stats) {
+    lbm_p2p_get_stats(stats);
+}
+
+void P2PClass::resetStats() {
+    lbm_p2p_reset_stats();
+    DEBUG_PRINTLN("P2P stats reset");
+}
+
+void P2PClass::getDefaultBulkParams(lbm_p2p_bulk_params_t* params) {
+    lbm_p2p_bulk_get_default_params(params);
+}
+
+smtc_modem_return_code_t P2PClass::sendBulk(lbm_p2p_bulk_source_t source, void* context,
+                                            const lbm_p2p_bulk_params_t* params) {
+    smtc_modem_return_code_t ret = lbm_p2p_bulk_send(params, source, context);
+    DEBUG_PRINTF("P2P bulk send: %d\n", ret);
+    return ret;
+}
+
+smtc_modem_return_code_t P2PClass::receiveBulk(lbm_p2p_bulk_sink_t sink, void* context, uint32_t timeout_ms,
+                                               const lbm_p2p_bulk_params_t* params) {
+    smtc_modem_return_code_t ret = lbm_p2p_bulk_receive(params, sink, context, timeout_ms);
+    DEBUG_PRINTF("P2P bulk receive: %d\n", ret);
+    return ret;
+}
+
+void P2PClass::abortBulk() {
+    lbm_p2p_bulk_abort();
+    DEBUG_PRINTLN("P2P bulk abort requested");
+}
+
+lbm_p2p_bulk_status_t P2PClass::getBulkStatus() {
+    return lbm_p2p_bulk_get_status();
+}
+
+void P2PClass::getBulkStats(lbm_p2p_bulk_stats_t* stats) {
+    lbm_p2p_bulk_get_stats(stats);
+}
+
 // Global instance
 LBMApi lbm;
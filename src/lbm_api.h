@@ -3,6 +3,28 @@
 #include <stdint.h>
 #include <stddef.h>
 #include "lbm_core.h"
+#include "lbm_engine.h"
+#include "lbm_sleep.h"
+#include "lbm_energy.h"
+#include "lbm_event_ring.h"
+#include "lbm_rx_ring.h"
+#include "lbm_class_b.h"
+#include "lbm_dl_pool.h"
+#include "lbm_aggregator.h"
+#include "lbm_log.h"
+#include "lbm_profile.h"
+#include "lbm_airtime.h"
+#include "lbm_crypto.h"
+#include "lbm_nvm.h"
+#include "lbm_session.h"
+#include "lbm_stacks.h"
+#include "lbm_lr_fhss.h"
+#include "lbm_uplink.h"
+#include "lbm_upload.h"
+#include "lbm_fuota.h"
+#include "lbm_event_bus.h"
+#include "lbm_p2p.h"
+#include "lbm_p2p_bulk.h"
 
 extern "C" {
 #include "smtc_modem_api.h"
@@ -27,8 +49,10 @@ class LBMApi;
 
 // Global user event callback variable declaration
 extern LBMEventCallback userEventCallback;
+extern LBMDownlinkCallback userDownlinkCallback;
 
-// LoRaWAN network management class
+// LoRaWAN network management class, one instance per stack: lbm.lorawan (stack 0) and lbm.lorawanStack(id)
+// Radio suspension, crystal error and the alarm timer are modem-wide, whichever instance sets them
 class LoRaWANClass {
     friend class LBMApi;
 public:
@@ -87,6 +111,7 @@ public:
      * @return SMTC_MODEM_RC_OK on success
      * @note Generates SMTC_MODEM_EVENT_JOINED on success or SMTC_MODEM_EVENT_JOINFAIL on failure
      * @note Must call setDevEUI, setJoinEUI, setAppKey, setNwkKey, and setRegion first
+     * @note With lbm.useWarmStart(true), lbm.lorawan resumes the saved session instead when it is still valid
      */
     smtc_modem_return_code_t join();
     
@@ -110,6 +135,164 @@ public:
      * @note Generates SMTC_MODEM_EVENT_TXDONE event after transmission
      */
     smtc_modem_return_code_t send(const uint8_t* data, size_t len, uint8_t port = 2, bool confirmed = false);
+
+    /**
+     * @brief Send one uplink with an LR-FHSS data rate (EU868 DR8-DR11), whatever the ADR profile
+     * @param data Pointer to payload data buffer
+     * @param len Length of payload (at most 50 bytes at DR8/DR10, 115 at DR9/DR11)
+     * @param port LoRaWAN FPort (1-223, default: 2)
+     * @param confirmed true for confirmed uplink, false for unconfirmed (default: false)
+     * @param datarate LR-FHSS data rate, LBM_LR_FHSS_ANY_DATARATE for the first one enabled that fits len
+     * @return SMTC_MODEM_RC_OK on success, SMTC_MODEM_RC_INVALID if the data rate is not enabled on the channels
+     *         (see getLrFhssDatarates()) or len does not fit, SMTC_MODEM_RC_BUSY if every uplink ticket is in use
+     * @note Queued as an uplink ticket: the ADR profile set with setADRProfile() applies again once this uplink
+     *       completes, whatever other TXDONE comes before
+     * @note Call it from the task that runs the engine
+     */
+    smtc_modem_return_code_t sendLrFhss(const uint8_t* data, size_t len, uint8_t port = 2, bool confirmed = false,
+                                        uint8_t datarate = LBM_LR_FHSS_ANY_DATARATE);
+
+    // Uplink tickets
+    /**
+     * @brief Queue an uplink and return at once with a ticket tracking it until its TXDONE
+     * @param data Pointer to payload data buffer, copied
+     * @param len Length of payload (at most LBM_UPLINK_MAX_PAYLOAD, and what the data rate allows when sent)
+     * @param port LoRaWAN FPort (1-223, default: 2)
+     * @param confirmed true for confirmed uplink, false for unconfirmed (default: false)
+     * @param callback Called by the engine task when the uplink completes, nullptr to poll or wait instead
+     * @param context Passed to callback
+     * @param result If not nullptr, receives the lbm_uplink_submit() result: SMTC_MODEM_RC_INVALID if len is too long,
+     *        SMTC_MODEM_RC_BUSY if every ticket is in use
+     * @return Ticket, LBM_UPLINK_NO_TICKET if len is too long or every ticket is in use
+     * @note Tickets of a stack reach the modem one at a time in the order of the calls, the next one at the
+     *       TXDONE of the previous one: several can be queued without waiting for the radio
+     * @note A ticket waits while getDutyCycleStatus() reports the band busy, and completes with
+     *       LBM_UPLINK_DROPPED_DUTY_CYCLE if it is still busy LBM_UPLINK_DUTY_CYCLE_WAIT_MS after the call
+     * @note SMTC_MODEM_EVENT_TXDONE still reaches the event callbacks
+     */
+    lbm_uplink_ticket_t sendAsync(const uint8_t* data, size_t len, uint8_t port = 2, bool confirmed = false,
+                                  lbm_uplink_callback_t callback = nullptr, void* context = nullptr,
+                                  smtc_modem_return_code_t* result = nullptr);
+
+    /**
+     * @brief Read the state of a ticket (status, data rate, time on air, request / TX / completion times)
+     * @param ticket Ticket returned by sendAsync()
+     * @param result Output: state, status LBM_UPLINK_QUEUED or LBM_UPLINK_IN_FLIGHT until completed
+     * @return SMTC_MODEM_RC_OK on success, SMTC_MODEM_RC_INVALID if the ticket is unknown or was already read
+     * @note Reading a completed ticket releases it; a ticket with a callback is released after the callback
+     */
+    smtc_modem_return_code_t getUplinkResult(lbm_uplink_ticket_t ticket, lbm_uplink_result_t* result);
+
+    /**
+     * @brief Block until a ticket completes, then read it like getUplinkResult()
+     * @param ticket Ticket returned by sendAsync()
+     * @param result Output: state
+     * @param timeout_ms Longest wait (default: LBM_ENGINE_WAIT_FOREVER)
+     * @return SMTC_MODEM_RC_OK once completed, SMTC_MODEM_RC_BUSY on timeout, SMTC_MODEM_RC_INVALID if unknown
+     * @note Call it from another task than the one running the engine
+     */
+    smtc_modem_return_code_t waitUplink(lbm_uplink_ticket_t ticket, lbm_uplink_result_t* result,
+                                        uint32_t timeout_ms = LBM_ENGINE_WAIT_FOREVER);
+
+    /**
+     * @brief Cancel a ticket the modem has not taken yet
+     * @return SMTC_MODEM_RC_OK on success, SMTC_MODEM_RC_BUSY once taken by the modem,
+     *         SMTC_MODEM_RC_INVALID if unknown or completed
+     */
+    smtc_modem_return_code_t cancelUplink(lbm_uplink_ticket_t ticket);
+
+    /**
+     * @brief Get ticket counters and request to TX / request to completion latency histograms (all stacks)
+     * @param stats Output: counters since boot or since the last resetUplinkStats()
+     * @note lbm_uplink_latency_percentile() turns a histogram into a percentile
+     */
+    void getUplinkStats(lbm_uplink_stats_t* stats);
+
+    /**
+     * @brief Clear ticket counters and histograms
+     */
+    void resetUplinkStats();
+
+    // Large payload uplinks
+    /**
+     * @brief Get the default upload settings: port LBM_UPLOAD_DEFAULT_PORT, fragments as long as the data rate
+     *        allows, LBM_UPLOAD_DEFAULT_REDUNDANCY_PERCENT coded fragments, no interval
+     * @param params Output: settings, to be changed and passed to upload()
+     */
+    static void getDefaultUploadParams(lbm_upload_params_t* params);
+
+    /**
+     * @brief Start sending a blob larger than one frame, fragmented over unconfirmed uplinks with coded fragments
+     * @param data Blob, read as the fragments go: it must stay unchanged until the end of the upload
+     * @param len Blob size (at most LBM_UPLOAD_MAX_FRAGMENTS fragments)
+     * @param params Upload settings, nullptr for the defaults
+     * @param callback Called by the engine task after each frame transmitted and at the end, nullptr to poll
+     *        getUploadProgress() instead
+     * @param context Passed to callback
+     * @return SMTC_MODEM_RC_OK on success, SMTC_MODEM_RC_BUSY if an upload runs on this stack,
+     *         SMTC_MODEM_RC_INVALID if len is 0 or too large, or the fragment size above what the data rate allows
+     * @note The receiver rebuilds the blob with lbm_upload_decoder_push() from any fragments numerous enough,
+     *       usually a few more than the fragments of the blob, whichever were lost
+     * @note Frames are uplink tickets: they wait for the duty cycle and let send() through in between
+     */
+    smtc_modem_return_code_t upload(const uint8_t* data, size_t len, const lbm_upload_params_t* params = nullptr,
+                                    lbm_upload_callback_t callback = nullptr, void* context = nullptr);
+
+    /**
+     * @brief Start sending a blob read from a source callback, e.g. a file or a flash partition
+     * @param source Called from the engine task with an offset and a size, possibly several times for a fragment
+     * @param source_context Passed to source
+     * @param size Blob size
+     * @return As upload() above
+     */
+    smtc_modem_return_code_t upload(lbm_upload_source_t source, void* source_context, uint32_t size,
+                                    const lbm_upload_params_t* params = nullptr,
+                                    lbm_upload_callback_t callback = nullptr, void* context = nullptr);
+
+    /**
+     * @brief Stop the upload of this stack, its callback gets LBM_UPLOAD_EVENT_DONE with LBM_UPLOAD_ABORTED
+     * @return SMTC_MODEM_RC_OK on success, SMTC_MODEM_RC_INVALID if no upload runs
+     */
+    smtc_modem_return_code_t abortUpload();
+
+    /**
+     * @brief Get the progress of the running or last upload of this stack: frames transmitted, time on air,
+     *        elapsed time and goodput
+     * @param progress Output: progress, status LBM_UPLOAD_NOT_STARTED before the first upload
+     */
+    smtc_modem_return_code_t getUploadProgress(lbm_upload_progress_t* progress);
+
+    // Uplink aggregation
+    /**
+     * @brief Queue a small record to be sent packed with others in one frame on LBM_AGGREGATOR_PORT
+     * @param type Application record type (0-14), returned by the decoder
+     * @param data Record data
+     * @param len Record length (1 to LBM_AGGREGATOR_MAX_RECORD_SIZE bytes)
+     * @param latency_budget_ms Longest acceptable delay before the record leaves the device
+     * @return SMTC_MODEM_RC_OK on success, SMTC_MODEM_RC_BUSY if the queue is full,
+     *         SMTC_MODEM_RC_INVALID_STACK_ID on any stack but lbm.lorawan
+     * @note A frame is sent when no more records fit at the current data rate (getNextTxMaxPayload()) or
+     *       when the earliest budget expires, and is held while getDutyCycleStatus() reports the band busy
+     * @note The runEngine*() calls drive the queue: call this from the task that runs the engine
+     */
+    smtc_modem_return_code_t queueRecord(uint8_t type, const uint8_t* data, uint8_t len, uint32_t latency_budget_ms);
+
+    /**
+     * @brief Send the oldest queued records now, whatever their latency budget
+     * @return SMTC_MODEM_RC_OK on success, SMTC_MODEM_RC_NO_EVENT if nothing is queued
+     */
+    smtc_modem_return_code_t flushRecords();
+
+    /**
+     * @brief Get aggregation counters (records and frames sent, flush reasons, late records)
+     * @param stats Output: counters since boot or since the last resetAggregationStats()
+     */
+    void getAggregationStats(lbm_aggregator_stats_t* stats);
+
+    /**
+     * @brief Clear aggregation counters
+     */
+    void resetAggregationStats();
     
     // Data reception
     /**
@@ -121,9 +304,91 @@ public:
      * @return SMTC_MODEM_RC_OK on success
      * @note Call this after receiving SMTC_MODEM_EVENT_DOWNDATA event
      * @note If remaining > 0, call again to retrieve next downlink
+     * @note The engine reads each downlink into the LBMApi pool first: inside the event callback this copies
+     *       it from there. Prefer setDownlinkCallback(), which lends the pool buffer without a copy
      */
     smtc_modem_return_code_t getDownlinkData(uint8_t* payload, uint8_t* payload_size, smtc_modem_dl_metadata_t* metadata, uint8_t* remaining);
 
+    // Class C receive mode
+    /**
+     * @brief Switch this stack to Class C and queue every downlink frame in the RX ring (lbm.peekFrames())
+     * @param storage Frames of the ring, e.g. in PSRAM, kept until stopClassC(); nullptr for the static ring of
+     *                LBM_RX_RING_SIZE frames
+     * @param size Frames in storage, a power of 2 up to LBM_RX_RING_MAX_SIZE
+     * @return SMTC_MODEM_RC_OK on success, SMTC_MODEM_RC_INVALID for a bad size, SMTC_MODEM_RC_BUSY if the ring
+     *         is already started, or the setClass() error
+     * @note The ring takes the downlinks of every stack: the downlink callback, getDownlinkData() and the DOWNDATA
+     *       records of the event queue no longer carry them. Event subscribers still get each one, ring full or not
+     */
+    smtc_modem_return_code_t startClassC(lbm_rx_frame_t* storage = nullptr, uint16_t size = 0);
+
+    /**
+     * @brief Stop the RX ring, dropping the frames still queued, and switch this stack back to Class A
+     * @return The setClass() result
+     */
+    smtc_modem_return_code_t stopClassC();
+
+    /**
+     * @brief Set the address and session keys of a multicast group
+     * @param group Group (0-3)
+     * @param address McAddr
+     * @param nwk_skey McNwkSKey
+     * @param app_skey McAppSKey
+     * @return SMTC_MODEM_RC_OK on success, SMTC_MODEM_RC_BUSY while a session of the group runs
+     */
+    smtc_modem_return_code_t setMulticastGroup(uint8_t group, uint32_t address, const uint8_t nwk_skey[16],
+                                               const uint8_t app_skey[16]);
+
+    /**
+     * @brief Start receiving a multicast group in Class C on its own frequency and data rate
+     * @param group Group set with setMulticastGroup()
+     * @param frequency_hz Frequency of the session
+     * @param datarate Data rate of the session
+     * @return SMTC_MODEM_RC_OK on success, SMTC_MODEM_RC_BUSY if the stack is not in Class C
+     */
+    smtc_modem_return_code_t startMulticastClassC(uint8_t group, uint32_t frequency_hz, uint8_t datarate);
+
+    /**
+     * @brief Stop the Class C session of a multicast group
+     */
+    smtc_modem_return_code_t stopMulticastClassC(uint8_t group);
+
+    // Class B
+    /**
+     * @brief Switch this stack to Class B, asking the network time and announcing the ping-slot periodicity
+     * @param periodicity A ping slot every 2^periodicity s, SMTC_MODEM_CLASS_B_PINGSLOT_1_S to _128_S
+     * @return SMTC_MODEM_RC_OK on success, SMTC_MODEM_RC_BUSY if another stack runs Class B, or the modem error
+     * @note Call once joined. The requests go with the next uplink; the stack is ready for ping-slot downlinks
+     *       when getClassBStats() reports LBM_CLASS_B_STATE_READY (CLASS_B_STATUS event)
+     * @note Missed beacons and a lost beacon lock are recovered by asking the network time again (lbm_class_b.h)
+     */
+    smtc_modem_return_code_t startClassB(smtc_modem_class_b_ping_slot_periodicity_t periodicity);
+
+    /**
+     * @brief Switch the Class B stack back to Class A
+     */
+    smtc_modem_return_code_t stopClassB();
+
+    /**
+     * @brief Change the ping-slot periodicity while Class B runs, announced again with PingSlotInfoReq
+     * @return SMTC_MODEM_RC_OK on success, SMTC_MODEM_RC_BUSY if Class B is not started
+     */
+    smtc_modem_return_code_t setPingSlotPeriodicity(smtc_modem_class_b_ping_slot_periodicity_t periodicity);
+
+    /**
+     * @brief Get the beacon acquisition state, missed beacons and recoveries, and the radio-on time of the beacon
+     *        windows and ping slots
+     * @param stats Output: counters since startClassB() or the last resetClassBStats()
+     * @note rx_us_per_beacon_period and rx_us_per_ping_slot, against the 2^periodicity s worst wait for a ping
+     *       slot, give the energy / latency trade-off of the periodicity in use
+     */
+    void getClassBStats(lbm_class_b_stats_t* stats);
+
+    /**
+     * @brief Clear the Class B counters (state and periodicity are kept)
+     */
+    void resetClassBStats();
+
     // ADR (Adaptive Data Rate) configuration
     /**
      * @brief Set custom DataRate distribution for Join procedure
@@ -141,6 +406,23 @@ public:
      * @return SMTC_MODEM_RC_OK on success
      */
     smtc_modem_return_code_t setADRProfile(smtc_modem_adr_profile_t adr_profile, const uint8_t dr_distribution[SMTC_MODEM_CUSTOM_ADR_DATA_LENGTH] = nullptr);
+
+    /**
+     * @brief Set a CUSTOM ADR profile sending a share of the uplinks with the LR-FHSS data rates
+     * @param lr_fhss_percent Share of LR-FHSS uplinks (0-100), split evenly between the LR-FHSS data rates enabled
+     * @param dr_distribution Weights of the LoRa/FSK data rates, scaled to the rest; nullptr for those of the last
+     *        CUSTOM profile, or the data rate the network assigned
+     * @return SMTC_MODEM_RC_OK on success, SMTC_MODEM_RC_INVALID if no LR-FHSS data rate is enabled
+     * @note Network-controlled ADR stops, as with any CUSTOM profile
+     */
+    smtc_modem_return_code_t setLrFhssDistribution(uint8_t lr_fhss_percent, const uint8_t dr_distribution[SMTC_MODEM_CUSTOM_ADR_DATA_LENGTH] = nullptr);
+
+    /**
+     * @brief Get the LR-FHSS data rates of the region that are enabled on the channels
+     * @param datarates_mask Output: bit n set for DRn (EU868: DR8-DR11, once the network has enabled them)
+     * @return SMTC_MODEM_RC_OK on success
+     */
+    smtc_modem_return_code_t getLrFhssDatarates(uint16_t* datarates_mask);
     
     /**
      * @brief Set number of transmissions for unconfirmed uplink
@@ -236,6 +518,29 @@ public:
      * @note Positive value = time still available, Negative value = time to wait until band available
      */
     smtc_modem_return_code_t getDutyCycleStatus(int32_t* duty_cycle_status_ms);
+
+    // Airtime planning
+    /**
+     * @brief Get the time on air of an uplink in the current region, without sending it
+     * @param datarate Data rate (DR0-DR7, DR8-DR11 LR-FHSS in EU868)
+     * @param len Application payload length (FOpts assumed empty)
+     * @param time_on_air_ms Output: time on air in ms, rounded up
+     * @return SMTC_MODEM_RC_OK on success, SMTC_MODEM_RC_INVALID if the region is not EU868/AS923 or len does not
+     *         fit at this data rate
+     * @note The same figures are available at compile time: lbm_airtime_uplink_us(LBM_AIRTIME_EU868[dr], len)
+     */
+    smtc_modem_return_code_t getTimeOnAir(uint8_t datarate, uint8_t len, uint32_t* time_on_air_ms);
+
+    /**
+     * @brief Get the earliest time an uplink can be sent given the current duty-cycle state
+     * @param datarate Data rate (DR0-DR11)
+     * @param len Application payload length
+     * @param wait_ms Output: 0 if the modem accepts it now, otherwise the wait in ms
+     * @param budget_after_ms Optional output: duty-cycle budget left once it is sent, negative if the next
+     *        uplink will have to wait that long
+     * @return SMTC_MODEM_RC_OK on success, SMTC_MODEM_RC_INVALID as for getTimeOnAir()
+     */
+    smtc_modem_return_code_t getEarliestSendTime(uint8_t datarate, uint8_t len, uint32_t* wait_ms, int32_t* budget_after_ms = nullptr);
     
     /**
      * @brief Request empty uplink (no payload, optional FPort)
@@ -250,6 +555,7 @@ public:
     /**
      * @brief Leave network or cancel ongoing join
      * @return SMTC_MODEM_RC_OK on success
+     * @note Also drops the session saved for warm start
      */
     smtc_modem_return_code_t leaveNetwork();
     
@@ -359,16 +665,172 @@ public:
      */
     smtc_modem_return_code_t getAlarmRemainingTime(uint32_t* remaining_time_in_s);
 
+    // Multi-stack
+    /**
+     * @brief Get the modem stack this instance drives
+     * @return Stack id (0 for lbm.lorawan)
+     */
+    uint8_t getStackId() const;
+
+    /**
+     * @brief Receive the events of this stack on a callback of its own
+     * @param callback Called instead of the lbm.setEventCallback() one for events of this stack, nullptr to clear
+     * @note Modem-wide events (RESET, ALARM, ...) still go to the lbm.setEventCallback() one, unless their stack_id
+     *       is that of a stack with its own callback. In queued mode, read event.stack_id of each record instead
+     */
+    void setEventCallback(LBMEventCallback callback);
+
+    /**
+     * @brief Get the counters of this stack: events, uplinks sent and not sent, downlinks, radio planner aborts,
+     *        and per modulation (LoRa, FSK, LR-FHSS) the uplinks, their time on air and acknowledged share
+     * @param stats Output: counters since boot or since the last resetStackStats()
+     * @note planner_aborts counts the radio tasks (TX, RX windows) of this stack dropped because another task
+     *       held the radio, e.g. an RX window of the other stack
+     */
+    void getStackStats(lbm_stack_stats_t* stats);
+
+    /**
+     * @brief Clear the counters of this stack
+     */
+    void resetStackStats();
+
 private:
-    LoRaWANClass() {} // Only LBMApi can create
+    LoRaWANClass() : stack_id(STACK_ID) {} // Only LBMApi can create
+    uint8_t stack_id;
 };
 
-// P2P class (reserved for future)
+// P2P class: raw LoRa frames between devices, scheduled by the radio planner next to LoRaWAN (see lbm_p2p.h)
 class P2PClass {
     friend class LBMApi;
 public:
-    // P2P methods will be added here in future
-    
+    /**
+     * @brief Get the default link settings: 869.525 MHz, SF7, 125 kHz, 4/5, 14 dBm, private sync word
+     * @param params Output: settings, to be changed and passed to begin()
+     */
+    static void getDefaultParams(lbm_p2p_params_t* params);
+
+    /**
+     * @brief Start P2P on its radio planner hook (after lbm.init())
+     * @param params Settings of receive and default ones of send(), nullptr for the defaults
+     * @return SMTC_MODEM_RC_OK on success, SMTC_MODEM_RC_INVALID for bad settings,
+     *         SMTC_MODEM_RC_BUSY if the hook is taken, SMTC_MODEM_RC_FAIL if the modem is not initialized
+     * @note LoRaWAN keeps the priority: its TX and RX windows abort a P2P task that is in the way
+     */
+    smtc_modem_return_code_t begin(const lbm_p2p_params_t* params = nullptr);
+
+    /**
+     * @brief Stop P2P: abort the running task, drop the frames not sent yet, release the hook
+     */
+    void end();
+
+    /**
+     * @brief Change the settings of receive and the default ones of send()
+     * @param params New settings, taken by the next receive window
+     * @return SMTC_MODEM_RC_OK on success, SMTC_MODEM_RC_INVALID for bad settings
+     */
+    smtc_modem_return_code_t setParams(const lbm_p2p_params_t* params);
+
+    /**
+     * @brief Queue a frame
+     * @param data Payload
+     * @param len Payload length (1 to LBM_P2P_MAX_PAYLOAD)
+     * @param params Settings of this frame only (frequency, SF, BW, power...), nullptr for the current ones
+     * @return SMTC_MODEM_RC_OK on success, SMTC_MODEM_RC_BUSY if the TX queue is full
+     * @note A running receive window is cut short so the frame goes out first
+     */
+    smtc_modem_return_code_t send(const uint8_t* data, uint8_t len, const lbm_p2p_params_t* params = nullptr);
+
+    /**
+     * @brief Start continuous receive: the radio listens whenever LoRaWAN and P2P transmissions leave it free
+     * @return SMTC_MODEM_RC_OK on success, SMTC_MODEM_RC_FAIL if begin() was not called
+     */
+    smtc_modem_return_code_t startReceive();
+
+    /**
+     * @brief Stop continuous receive, frames already received stay readable
+     * @return SMTC_MODEM_RC_OK on success, SMTC_MODEM_RC_FAIL if begin() was not called
+     */
+    smtc_modem_return_code_t stopReceive();
+
+    /**
+     * @brief Get the number of received frames waiting to be read
+     */
+    uint32_t available();
+
+    /**
+     * @brief Read the oldest received frame without waiting
+     * @param frame Output: payload, RSSI, SNR and time of reception
+     * @return true if a frame was read
+     */
+    bool read(lbm_p2p_frame_t* frame);
+
+    /**
+     * @brief Wait for a received frame
+     * @param frame Output: payload, RSSI, SNR and time of reception
+     * @param timeout_ms Longest wait in ms
+     * @return true if a frame was read, false on timeout
+     * @note Call it from another task than the one running the engine
+     */
+    bool receive(lbm_p2p_frame_t* frame, uint32_t timeout_ms);
+
+    /**
+     * @brief Get the P2P counters: frames sent and received per second, RX to application latency,
+     *        planner aborts, ring overflows
+     * @param stats Output: counters since begin() or the last resetStats()
+     */
+    void getStats(lbm_p2p_stats_t* stats);
+
+    /**
+     * @brief Clear the P2P counters
+     */
+    void resetStats();
+
+    /**
+     * @brief Get the default bulk transfer settings: 869.525 MHz, GFSK 100 kbps, 240-byte frames, window of 8
+     * @param params Output: settings, to be changed and passed to sendBulk() / receiveBulk()
+     */
+    static void getDefaultBulkParams(lbm_p2p_bulk_params_t* params);
+
+    /**
+     * @brief Start sending data to a device running receiveBulk(), over GFSK with selective ACKs
+     * @param source Called from the engine task for the next bytes, returns 0 at the end of the data
+     * @param context Passed to source
+     * @param params Transfer settings, nullptr for the defaults
+     * @return SMTC_MODEM_RC_OK on success, SMTC_MODEM_RC_BUSY if a transfer runs,
+     *         SMTC_MODEM_RC_FAIL if begin() was not called
+     * @note The transfer holds the P2P hook until it ends: receive and queued frames resume afterwards
+     */
+    smtc_modem_return_code_t sendBulk(lbm_p2p_bulk_source_t source, void* context,
+                                      const lbm_p2p_bulk_params_t* params = nullptr);
+
+    /**
+     * @brief Start waiting for a bulk transfer, its data is handed to sink in order
+     * @param sink Called from the engine task with each piece of data, returns false to abort
+     * @param context Passed to sink
+     * @param timeout_ms Longest wait for the sender to start
+     * @param params Transfer settings, nullptr for the defaults (same frequency and bitrate as the sender)
+     * @return SMTC_MODEM_RC_OK on success, SMTC_MODEM_RC_BUSY if a transfer runs,
+     *         SMTC_MODEM_RC_FAIL if begin() was not called
+     */
+    smtc_modem_return_code_t receiveBulk(lbm_p2p_bulk_sink_t sink, void* context, uint32_t timeout_ms,
+                                         const lbm_p2p_bulk_params_t* params = nullptr);
+
+    /**
+     * @brief Stop the running bulk transfer
+     */
+    void abortBulk();
+
+    /**
+     * @brief Get the state of the last bulk transfer (running, done, failed, aborted)
+     */
+    lbm_p2p_bulk_status_t getBulkStatus();
+
+    /**
+     * @brief Get the counters of the last bulk transfer: sustained throughput, retransmissions, ACK timeouts
+     * @param stats Output: counters
+     */
+    void getBulkStats(lbm_p2p_bulk_stats_t* stats);
+
 private:
     P2PClass() {} // Only LBMApi can create
 };
@@ -383,13 +845,344 @@ public:
     
     // Core modem engine function - must be called regularly
     void runEngine();
+
+    // Event-driven engine runner
+    /**
+     * @brief Run the modem engine, then block the calling task until the modem needs the CPU again
+     * @param max_wait_ms Upper bound of the wait in ms (default: no bound)
+     * @return Time in ms the task was blocked
+     * @note Replaces the runEngine()/delay() polling loop. The wait ends on a radio IRQ, on an API call that
+     *       queues modem work (join, send, ...) or on the deadline returned by the engine, whichever comes first
+     */
+    uint32_t runEngineUntilEvent(uint32_t max_wait_ms = LBM_ENGINE_WAIT_FOREVER);
+
+    /**
+     * @brief Wake up the task blocked in runEngineUntilEvent()
+     * @note Safe to call from an interrupt handler
+     */
+    void notifyEngine();
+
+    /**
+     * @brief Get engine runner counters (wakeups/sec, idle time)
+     * @param stats Output: counters since boot or since the last resetEngineStats()
+     */
+    void getEngineStats(lbm_engine_stats_t* stats);
+
+    /**
+     * @brief Clear engine runner counters
+     */
+    void resetEngineStats();
+
+    // Low-power run mode
+    /**
+     * @brief Run the modem engine, then light-sleep the MCU until the modem needs it again
+     * @param max_wait_ms Upper bound of the sleep in ms (default: no bound)
+     * @return Time in ms spent sleeping or waiting
+     * @note Wakes up on the engine deadline (timer) or on the SX1262 DIO1 line (GPIO). Waits shorter than
+     *       LBM_SLEEP_MIN_MS block on a task notification like runEngineUntilEvent()
+     */
+    uint32_t runEngineLowPower(uint32_t max_wait_ms = LBM_ENGINE_WAIT_FOREVER);
+
+    /**
+     * @brief Get low-power run mode counters (sleep residency, wakeup causes, time compensation)
+     * @param stats Output: counters since boot or since the last resetSleepStats()
+     */
+    void getSleepStats(lbm_sleep_stats_t* stats);
+
+    /**
+     * @brief Clear low-power run mode counters
+     */
+    void resetSleepStats();
+
+    // Energy model
+    /**
+     * @brief Get time and charge per radio and MCU state, per output power, per uplink and per day
+     * @param stats Output: counters since boot or since the last resetEnergyStats()
+     * @note Charges use the supply currents of the board (LBM_ENERGY_* in the variant header) or those of
+     *       setEnergyProfile(), applied to the whole period when read
+     */
+    void getEnergyStats(lbm_energy_stats_t* stats);
+
+    /**
+     * @brief Clear energy counters, e.g. before comparing data rates or NbTrans settings
+     */
+    void resetEnergyStats();
+
+    /**
+     * @brief Replace the supply currents of the energy model (measured board, other PA or supply)
+     * @param profile Currents in uA, TX points by decreasing power; nullptr for the board defaults
+     */
+    void setEnergyProfile(const lbm_energy_profile_t* profile = nullptr);
+
+    /**
+     * @brief Get the supply currents in use
+     * @param profile Output
+     */
+    void getEnergyProfile(lbm_energy_profile_t* profile);
     
-    // Event callback registration
+    // Event callback registration (events of every stack, but those with their own LoRaWANClass callback)
     void setEventCallback(LBMEventCallback callback);
 
+    // Event subscribers
+    /**
+     * @brief Subscribe a handler to some event types, next to the event callback
+     * @param mask LBM_EVENT_MASK(SMTC_MODEM_EVENT_xxx) of each event type, or LBM_EVENT_MASK_ALL
+     * @param handler Called from the engine context with the event, the downlink for DOWNDATA and context
+     * @param context Passed back to handler
+     * @param priority Higher first, equal priorities in subscription order (default: 0)
+     * @return Subscription, LBM_EVENT_BUS_NO_SUBSCRIPTION if handler or mask is missing or
+     *         LBM_EVENT_BUS_MAX_SUBSCRIBERS are already subscribed
+     * @note Subscribers run before the event callback, also when useEventQueue() is on
+     */
+    lbm_event_subscription_t subscribeEvents(uint32_t mask, lbm_event_handler_t handler, void* context = nullptr,
+                                             uint8_t priority = 0);
+
+    /**
+     * @brief Remove a subscriber (also from inside its handler)
+     * @return SMTC_MODEM_RC_OK on success, SMTC_MODEM_RC_INVALID if unknown
+     */
+    smtc_modem_return_code_t unsubscribeEvents(lbm_event_subscription_t subscription);
+
+    /**
+     * @brief Change the event types of a subscriber
+     * @return SMTC_MODEM_RC_OK on success, SMTC_MODEM_RC_INVALID if unknown or mask is 0
+     */
+    smtc_modem_return_code_t setEventMask(lbm_event_subscription_t subscription, uint32_t mask);
+
+    /**
+     * @brief Get subscriber counters: calls and handler time (average, maximum, calls over LBM_EVENT_BUS_SLOW_US)
+     * @param stats Output: counters since boot or since the last resetEventBusStats(), subscribers in call order
+     */
+    void getEventBusStats(lbm_event_bus_stats_t* stats);
+
+    /**
+     * @brief Clear subscriber counters
+     */
+    void resetEventBusStats();
+
+    // Firmware update over the air
+    /**
+     * @brief Answer the fragmentation package (TS004, port 201) and write the image into the inactive OTA partition
+     * @param callback Called from the engine context at the setup, for each data fragment and at the end
+     *                 (nullptr for none)
+     * @param context Passed back to callback
+     * @return SMTC_MODEM_RC_OK on success, SMTC_MODEM_RC_FAIL without OTA partition to write (app1 of
+     *         partitions_rak3112.csv), SMTC_MODEM_RC_BUSY if already begun or the event bus is full
+     * @note Once LBM_FUOTA_DONE the image is selected for the next boot: restart when it suits the application
+     */
+    smtc_modem_return_code_t beginFuota(lbm_fuota_callback_t callback = nullptr, void* context = nullptr);
+
+    /**
+     * @brief Stop answering the fragmentation package, dropping the session in progress
+     */
+    void endFuota();
+
+    /**
+     * @brief Get the session: fragments received and in place, missing ones solved, flash operations, peak RAM
+     */
+    void getFuotaProgress(lbm_fuota_progress_t* progress);
+
+    // Pooled downlink delivery
+    /**
+     * @brief Register the callback that receives each downlink as a buffer borrowed from the pool
+     * @param callback Called from the engine context after the event callback, nullptr to clear
+     * @note The buffer (payload pointer, size, metadata) stays valid until releaseDownlink(), which may be
+     *       called later and from another task. LBM_DL_POOL_SIZE buffers exist: a downlink arriving while
+     *       all are borrowed stays in the modem (see getDownlinkPoolStats())
+     * @note Not called in queued mode: the buffer comes with the DOWNDATA record instead
+     */
+    void setDownlinkCallback(LBMDownlinkCallback callback);
+
+    /**
+     * @brief Give a downlink buffer back to the pool
+     * @param downlink Buffer received by the downlink callback or in an event record (nullptr is ignored)
+     */
+    void releaseDownlink(lbm_dl_buffer_t* downlink);
+
+    /**
+     * @brief Get downlink pool counters (buffers in use, peak, exhaustion)
+     * @param stats Output: counters since boot or since the last resetDownlinkPoolStats()
+     */
+    void getDownlinkPoolStats(lbm_dl_pool_stats_t* stats);
+
+    /**
+     * @brief Clear downlink pool counters
+     */
+    void resetDownlinkPoolStats();
+
+    // Queued event delivery
+    /**
+     * @brief Deliver modem events through a lock-free queue instead of the callback
+     * @param enable true: events (and downlink buffers) are queued for pollEvent()/waitEvent() and the
+     *               callback is no longer called; false: synchronous callback from the engine context (default)
+     * @note Keeps slow application code out of the engine context, where it can delay RX windows
+     */
+    void useEventQueue(bool enable);
+
+    /**
+     * @brief Get the oldest queued event without blocking
+     * @param record Output: event, timestamp and, for DOWNDATA, the borrowed downlink buffer
+     * @return true if an event was returned
+     * @note Release record->downlink with releaseDownlink() once handled
+     */
+    bool pollEvent(lbm_event_record_t* record);
+
+    /**
+     * @brief Get the oldest queued event, waiting up to timeout_ms for one
+     * @param record Output: event, timestamp and, for DOWNDATA, the borrowed downlink buffer
+     * @param timeout_ms Maximum wait in ms (LBM_ENGINE_WAIT_FOREVER: no limit)
+     * @return true if an event was returned, false on timeout
+     * @note For an application task other than the one running the engine, use pollEvent() in the engine loop
+     */
+    bool waitEvent(lbm_event_record_t* record, uint32_t timeout_ms);
+
+    /**
+     * @brief Get event queue counters (queued, read, overflows, depth)
+     * @param stats Output: counters since boot or since the last resetEventQueueStats()
+     */
+    void getEventQueueStats(lbm_event_ring_stats_t* stats);
+
+    /**
+     * @brief Clear event queue counters
+     */
+    void resetEventQueueStats();
+
+    // Class C receive ring
+    /**
+     * @brief Get the oldest frames queued by lbm.lorawan.startClassC() without blocking
+     * @param frames Output: first frame, the others follow it (frames[0] to frames[count - 1])
+     * @return Frames returned, 0 if none. Frames that wrapped around the end of the ring come with the next call
+     * @note The frames are read in place: hand them back with releaseFrames() once handled
+     */
+    uint16_t peekFrames(const lbm_rx_frame_t** frames);
+
+    /**
+     * @brief Same as peekFrames(), waiting up to timeout_ms for a frame
+     * @param frames Output: first frame
+     * @param timeout_ms Maximum wait in ms (LBM_ENGINE_WAIT_FOREVER: no limit)
+     * @return Frames returned, 0 on timeout
+     * @note For an application task other than the one running the engine, use peekFrames() in the engine loop
+     */
+    uint16_t waitFrames(const lbm_rx_frame_t** frames, uint32_t timeout_ms);
+
+    /**
+     * @brief Hand the oldest frames back to the ring
+     * @param count Frames handled, at most those of the last peekFrames() / waitFrames()
+     */
+    void releaseFrames(uint16_t count);
+
+    /**
+     * @brief Get RX ring counters: frames received and dropped with the ring full, downlinks per second,
+     *        RX done to queued and RX done to application latency histograms
+     * @param stats Output: counters since startClassC() or the last resetRxRingStats()
+     */
+    void getRxRingStats(lbm_rx_ring_stats_t* stats);
+
+    /**
+     * @brief Clear RX ring counters and restart the throughput window
+     */
+    void resetRxRingStats();
+
+    // Logging
+    /**
+     * @brief Get deferred log counters (records, drops, ring depth and high watermark)
+     * @param stats Output: counters since boot or since the last resetLogStats()
+     * @note Only the LBM_LOG_DEFERRED=1 backend counts, the immediate backend leaves them at 0
+     */
+    void getLogStats(lbm_log_stats_t* stats);
+
+    /**
+     * @brief Clear deferred log counters
+     */
+    void resetLogStats();
+
+    // Crypto
+    /**
+     * @brief Select the AES implementation used by the secure element
+     * @param backend LBM_CRYPTO_BACKEND_HARDWARE (ESP32-S3 AES peripheral, default on target),
+     *        LBM_CRYPTO_BACKEND_TABLE (32-bit table AES, default on the host) or
+     *        LBM_CRYPTO_BACKEND_SOFT (SWL2001 byte-wise AES)
+     * @return SMTC_MODEM_RC_OK on success, SMTC_MODEM_RC_INVALID if the backend is unavailable or failed its
+     *         known-answer tests
+     * @note init() already selects the default backend when its self test passes
+     */
+    smtc_modem_return_code_t setCryptoBackend(lbm_crypto_backend_t backend);
+
+    /**
+     * @brief Get the AES implementation in use
+     */
+    lbm_crypto_backend_t getCryptoBackend();
+
+    // Context storage
+    /**
+     * @brief Resume the joined session at boot instead of joining again (call before init())
+     * @param enable true: the session is saved before each uplink, and lorawan.join() resumes it when DevEUI,
+     *        JoinEUI and region match and the policy allows; SMTC_MODEM_EVENT_JOINED follows without a Join-Request
+     * @param policy Session age limits (running time, uplink counter, warm boots), nullptr for the defaults
+     * @note Needs the lbm_nvm partition, otherwise every boot joins
+     */
+    void useWarmStart(bool enable, const lbm_session_policy_t* policy = nullptr);
+
+    /**
+     * @brief Get the warm start outcome of this boot and the time to join and to the first uplink
+     * @param stats Output: result, resumed DevAddr and counter, times since init() in ms
+     */
+    void getSessionStats(lbm_session_stats_t* stats);
+
+    /**
+     * @brief Write a full snapshot of the modem contexts to flash, e.g. before cutting the power
+     * @return SMTC_MODEM_RC_OK on success, SMTC_MODEM_RC_FAIL if the flash could not be written
+     * @note Pending changes are written anyway before each transmission and when the engine goes idle
+     */
+    smtc_modem_return_code_t syncNvm();
+
+    /**
+     * @brief Get context store counters (stores, journal records, flash programs and erases, longest write)
+     * @param stats Output: counters since boot or since the last resetNvmStats()
+     * @note stats->enabled is false without the lbm_nvm partition: the HAL then writes every store itself
+     */
+    void getNvmStats(lbm_nvm_stats_t* stats);
+
+    /**
+     * @brief Clear context store counters
+     */
+    void resetNvmStats();
+
+    // Profiling
+    /**
+     * @brief Get per-stage cycle counts of the modem engine (calls, min/avg/max/total per stage)
+     * @param stats Output: counters since boot or since the last resetStats()
+     * @note Needs the [profile] flags of platformio.ini, otherwise stats->enabled is false and all counters are 0
+     */
+    void getStats(lbm_profile_stats_t* stats);
+
+    /**
+     * @brief Clear the per-stage cycle counts
+     */
+    void resetStats();
+
+    // Multi-stack
+    /**
+     * @brief Get the LoRaWAN instance of a modem stack
+     * @param stack_id 0 to getNumberOfStacks() - 1
+     * @return The instance, nullptr if the modem has no such stack
+     * @note Each stack has its own credentials, region, class and session, and joins on its own. They share
+     *       the radio: the radio planner interleaves their TX and RX windows and aborts a task that cannot wait
+     * @note Build with -D NUMBER_OF_STACKS=2 or more in place of the [basic_modem] value (see lbm_stacks.h)
+     */
+    LoRaWANClass* lorawanStack(uint8_t stack_id);
+
+    /**
+     * @brief Get the number of LoRaWAN stacks of the modem (NUMBER_OF_STACKS of the build)
+     */
+    uint8_t getNumberOfStacks() const;
+
     // Sub-modules
-    LoRaWANClass lorawan;
+    LoRaWANClass& lorawan; // stack 0, same instance as lorawanStack(0)
     P2PClass p2p;
+
+private:
+    LoRaWANClass stacks[LBM_NUMBER_OF_STACKS];
 };
 
 extern LBMApi lbm;
@@ -0,0 +1,463 @@
+/*!
+ * \file      lbm_class_b.cpp
+ *
+ * \brief     Class B: beacon acquisition, ping-slot periodicity, missed-beacon recovery and radio-on time
+ */
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <string.h>
+
+#include "lbm_class_b.h"
+#include "lbm_core.h"
+#include "lbm_log.h"
+
+extern "C" {
+#include "smtc_modem_hal.h"
+}
+
+#if !defined( LBM_NATIVE )
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+#else
+extern "C" {
+#include "sim_clock.h"
+}
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE MACROS ----------------------------------------------------------
+ */
+
+// The engine task drives the radio and the events while the application starts, stops and reads the counters
+static lbm_critical_t class_b_lock = LBM_CRITICAL_INITIALIZER;
+#define CLASS_B_LOCK( ) LBM_CRITICAL_ENTER( &class_b_lock )
+#define CLASS_B_UNLOCK( ) LBM_CRITICAL_EXIT( &class_b_lock )
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE TYPES -----------------------------------------------------------
+ */
+
+typedef enum window_kind_e
+{
+    WINDOW_NONE,
+    WINDOW_BEACON,
+    WINDOW_PING_SLOT,
+    WINDOW_CLASS_A,
+} window_kind_t;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE VARIABLES -------------------------------------------------------
+ */
+
+static lbm_class_b_stats_t stats;
+static uint32_t            acquisition_start_ms = 0;
+static uint32_t            missed_in_row        = 0;
+static bool                recovering           = false;  // beacons missed or lost since the last one received
+
+// Set in the radio hooks, the request itself is made by lbm_class_b_process()
+static volatile bool time_request_pending = false;
+
+// Radio as last configured by the stack
+static bool     iq_inverted = false;
+static bool     tx_seen     = false;
+static uint32_t last_tx_ms  = 0;
+
+// RX window open, and the last one opened for the frame read out of the radio after it ends
+static window_kind_t window          = WINDOW_NONE;
+static uint64_t      window_start_us = 0;
+static window_kind_t last_window     = WINDOW_NONE;
+static bool          last_window_rx  = false;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DECLARATION -------------------------------------------
+ */
+
+static void     open_window( void );
+static void     close_window( void );
+static void     settle_last_window( void );
+static void     request_time( void );
+static uint64_t now_us( void );
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS DEFINITION ---------------------------------------------
+ */
+
+smtc_modem_return_code_t lbm_class_b_start( uint8_t stack_id, smtc_modem_class_b_ping_slot_periodicity_t periodicity )
+{
+    if( ( stats.state != LBM_CLASS_B_STATE_OFF ) && ( stats.stack_id != stack_id ) )
+    {
+        return SMTC_MODEM_RC_BUSY;
+    }
+
+    smtc_modem_return_code_t rc = smtc_modem_class_b_set_ping_slot_periodicity( stack_id, periodicity );
+    if( rc != SMTC_MODEM_RC_OK )
+    {
+        return rc;
+    }
+
+    // Tracking starts before the class switch: the stack may report on it straight away
+    CLASS_B_LOCK( );
+    stats.state                   = LBM_CLASS_B_STATE_TIME_SYNC;
+    stats.stack_id                = stack_id;
+    stats.periodicity             = ( uint8_t ) periodicity;
+    stats.ping_slot_info_answered = false;
+    acquisition_start_ms          = smtc_modem_hal_get_time_in_ms( );
+    missed_in_row                 = 0;
+    recovering                    = false;
+    CLASS_B_UNLOCK( );
+
+    rc = smtc_modem_set_class( stack_id, SMTC_MODEM_CLASS_B );
+    if( rc != SMTC_MODEM_RC_OK )
+    {
+        CLASS_B_LOCK( );
+        stats.state = LBM_CLASS_B_STATE_OFF;
+        CLASS_B_UNLOCK( );
+        return rc;
+    }
+
+    // Both go in the next uplink
+    rc = smtc_modem_trigger_lorawan_mac_request(
+        stack_id, ( smtc_modem_lorawan_mac_request_t )( SMTC_MODEM_LORAWAN_MAC_REQ_DEVICE_TIME |
+                                                        SMTC_MODEM_LORAWAN_MAC_REQ_PING_SLOT_INFO ) );
+    if( rc == SMTC_MODEM_RC_OK )
+    {
+        CLASS_B_LOCK( );
+        stats.time_requests++;
+        CLASS_B_UNLOCK( );
+    }
+    LBM_LOG_INFO( "Class B started on stack %u, ping slot every %u s\n", stack_id, 1u << periodicity );
+    return rc;
+}
+
+smtc_modem_return_code_t lbm_class_b_stop( void )
+{
+    if( stats.state == LBM_CLASS_B_STATE_OFF )
+    {
+        return SMTC_MODEM_RC_OK;
+    }
+
+    const smtc_modem_return_code_t rc = smtc_modem_set_class( stats.stack_id, SMTC_MODEM_CLASS_A );
+
+    CLASS_B_LOCK( );
+    close_window( );
+    settle_last_window( );
+    stats.state          = LBM_CLASS_B_STATE_OFF;
+    time_request_pending = false;
+    CLASS_B_UNLOCK( );
+    return rc;
+}
+
+smtc_modem_return_code_t lbm_class_b_set_periodicity( smtc_modem_class_b_ping_slot_periodicity_t periodicity )
+{
+    if( stats.state == LBM_CLASS_B_STATE_OFF )
+    {
+        return SMTC_MODEM_RC_BUSY;
+    }
+
+    smtc_modem_return_code_t rc = smtc_modem_class_b_set_ping_slot_periodicity( stats.stack_id, periodicity );
+    if( rc != SMTC_MODEM_RC_OK )
+    {
+        return rc;
+    }
+    CLASS_B_LOCK( );
+    stats.periodicity             = ( uint8_t ) periodicity;
+    stats.ping_slot_info_answered = false;
+    CLASS_B_UNLOCK( );
+    return smtc_modem_trigger_lorawan_mac_request( stats.stack_id, SMTC_MODEM_LORAWAN_MAC_REQ_PING_SLOT_INFO );
+}
+
+void lbm_class_b_on_event( const smtc_modem_event_t* event )
+{
+    if( stats.state == LBM_CLASS_B_STATE_OFF )
+    {
+        return;
+    }
+    if( event->event_type == SMTC_MODEM_EVENT_RESET )
+    {
+        // The class is not kept across a modem reset
+        CLASS_B_LOCK( );
+        window      = WINDOW_NONE;
+        stats.state = LBM_CLASS_B_STATE_OFF;
+        CLASS_B_UNLOCK( );
+        return;
+    }
+    if( event->stack_id != stats.stack_id )
+    {
+        return;
+    }
+
+    switch( event->event_type )
+    {
+    case SMTC_MODEM_EVENT_LORAWAN_MAC_TIME:
+        if( event->event_data.lorawan_mac_time.status == SMTC_MODEM_EVENT_MAC_TIME_NOT_VALID )
+        {
+            request_time( );
+        }
+        else if( stats.state == LBM_CLASS_B_STATE_TIME_SYNC )
+        {
+            CLASS_B_LOCK( );
+            stats.state = LBM_CLASS_B_STATE_ACQUISITION;
+            CLASS_B_UNLOCK( );
+        }
+        break;
+
+    case SMTC_MODEM_EVENT_CLASS_B_PING_SLOT_INFO:
+        if( event->event_data.class_b_ping_slot_info.status == SMTC_MODEM_EVENT_CLASS_B_PING_SLOT_ANSWERED )
+        {
+            stats.ping_slot_info_answered = true;
+        }
+        else
+        {
+            ( void ) smtc_modem_trigger_lorawan_mac_request( stats.stack_id,
+                                                             SMTC_MODEM_LORAWAN_MAC_REQ_PING_SLOT_INFO );
+        }
+        break;
+
+    case SMTC_MODEM_EVENT_CLASS_B_STATUS:
+        if( event->event_data.class_b_status.status == SMTC_MODEM_EVENT_CLASS_B_READY )
+        {
+            if( stats.state != LBM_CLASS_B_STATE_READY )
+            {
+                CLASS_B_LOCK( );
+                stats.acquisition_ms = smtc_modem_hal_get_time_in_ms( ) - acquisition_start_ms;
+                stats.state          = LBM_CLASS_B_STATE_READY;
+                if( recovering == true )
+                {
+                    // Locked again after a loss
+                    stats.recoveries++;
+                    recovering = false;
+                }
+                missed_in_row = 0;
+                CLASS_B_UNLOCK( );
+                LBM_LOG_INFO( "Class B beacon locked in %u ms\n", stats.acquisition_ms );
+            }
+        }
+        else if( stats.state == LBM_CLASS_B_STATE_READY )
+        {
+            CLASS_B_LOCK( );
+            stats.losses++;
+            stats.state          = LBM_CLASS_B_STATE_ACQUISITION;
+            acquisition_start_ms = smtc_modem_hal_get_time_in_ms( );
+            recovering           = true;
+            CLASS_B_UNLOCK( );
+            LBM_LOG_WARN( "Class B beacon lost after %u missed\n", missed_in_row );
+            request_time( );
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+void lbm_class_b_on_tx( void )
+{
+    CLASS_B_LOCK( );
+    close_window( );
+    tx_seen    = true;
+    last_tx_ms = smtc_modem_hal_get_time_in_ms( );
+    CLASS_B_UNLOCK( );
+}
+
+void lbm_class_b_on_rx( void )
+{
+    CLASS_B_LOCK( );
+    open_window( );
+    CLASS_B_UNLOCK( );
+}
+
+void lbm_class_b_on_radio_idle( void )
+{
+    CLASS_B_LOCK( );
+    close_window( );
+    CLASS_B_UNLOCK( );
+}
+
+void lbm_class_b_on_lora_pkt_params( bool invert_iq )
+{
+    // Beacons are the only LoRa downlinks sent without IQ inversion
+    iq_inverted = invert_iq;
+}
+
+void lbm_class_b_on_rx_done( void )
+{
+    // Only asked for once a frame was received, during or right after its window
+    CLASS_B_LOCK( );
+    if( ( last_window != WINDOW_NONE ) && ( last_window_rx == false ) )
+    {
+        last_window_rx = true;
+        if( last_window == WINDOW_BEACON )
+        {
+            stats.beacons_received++;
+            if( ( recovering == true ) && ( stats.state == LBM_CLASS_B_STATE_READY ) )
+            {
+                stats.recoveries++;
+                recovering = false;
+            }
+            missed_in_row = 0;
+        }
+        else if( last_window == WINDOW_PING_SLOT )
+        {
+            stats.ping_slot_frames++;
+        }
+    }
+    CLASS_B_UNLOCK( );
+}
+
+void lbm_class_b_process( void )
+{
+    if( ( time_request_pending == true ) && ( stats.state != LBM_CLASS_B_STATE_OFF ) )
+    {
+        time_request_pending = false;
+        LBM_LOG_WARN( "Class B: %u beacons missed in a row, network time requested\n", missed_in_row );
+        request_time( );
+    }
+}
+
+void lbm_class_b_get_stats( lbm_class_b_stats_t* out )
+{
+    CLASS_B_LOCK( );
+    *out = stats;
+    CLASS_B_UNLOCK( );
+
+    out->rx_us_per_beacon =
+        ( out->beacon_windows > 0 ) ? ( float ) out->beacon_rx_us / ( float ) out->beacon_windows : 0.0f;
+    out->rx_us_per_ping_slot =
+        ( out->ping_slots > 0 ) ? ( float ) out->ping_slot_rx_us / ( float ) out->ping_slots : 0.0f;
+    out->rx_us_per_beacon_period = ( out->beacon_windows > 0 ) ? ( float ) ( out->beacon_rx_us + out->ping_slot_rx_us ) /
+                                                                     ( float ) out->beacon_windows
+                                                               : 0.0f;
+}
+
+void lbm_class_b_reset_stats( void )
+{
+    CLASS_B_LOCK( );
+    lbm_class_b_stats_t kept = stats;
+    memset( &stats, 0, sizeof( stats ) );
+    stats.state                   = kept.state;
+    stats.stack_id                = kept.stack_id;
+    stats.periodicity             = kept.periodicity;
+    stats.ping_slot_info_answered = kept.ping_slot_info_answered;
+    stats.acquisition_ms          = kept.acquisition_ms;
+    // A window still open is counted from now on
+    window_start_us = now_us( );
+    CLASS_B_UNLOCK( );
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DEFINITION --------------------------------------------
+ */
+
+static void open_window( void )
+{
+    close_window( );
+    settle_last_window( );
+    if( stats.state == LBM_CLASS_B_STATE_OFF )
+    {
+        return;
+    }
+
+    if( iq_inverted == false )
+    {
+        window = WINDOW_BEACON;
+        stats.beacon_windows++;
+    }
+    else if( ( tx_seen == true ) &&
+             ( ( smtc_modem_hal_get_time_in_ms( ) - last_tx_ms ) < LBM_CLASS_B_CLASS_A_GUARD_MS ) )
+    {
+        window = WINDOW_CLASS_A;
+        stats.class_a_windows++;
+    }
+    else
+    {
+        window = WINDOW_PING_SLOT;
+        stats.ping_slots++;
+    }
+    window_start_us = now_us( );
+    last_window     = window;
+    last_window_rx  = false;
+}
+
+static void close_window( void )
+{
+    if( window == WINDOW_NONE )
+    {
+        return;
+    }
+
+    const uint64_t duration_us = now_us( ) - window_start_us;
+    switch( window )
+    {
+    case WINDOW_BEACON:
+        stats.beacon_rx_us += duration_us;
+        break;
+    case WINDOW_PING_SLOT:
+        stats.ping_slot_rx_us += duration_us;
+        break;
+    default:
+        stats.class_a_rx_us += duration_us;
+        break;
+    }
+    window = WINDOW_NONE;
+}
+
+static void settle_last_window( void )
+{
+    // A beacon window is missed once the next window opens without a frame read out of it. Windows of the
+    // acquisition search are not expected to hold a beacon
+    if( ( last_window == WINDOW_BEACON ) && ( last_window_rx == false ) && ( stats.state == LBM_CLASS_B_STATE_READY ) )
+    {
+        stats.beacons_missed++;
+        missed_in_row++;
+        recovering = true;
+        if( missed_in_row > stats.max_missed_in_row )
+        {
+            stats.max_missed_in_row = missed_in_row;
+        }
+        if( missed_in_row == LBM_CLASS_B_RESYNC_MISSED )
+        {
+            time_request_pending = true;
+        }
+    }
+    last_window = WINDOW_NONE;
+}
+
+static void request_time( void )
+{
+    if( smtc_modem_trigger_lorawan_mac_request( stats.stack_id, SMTC_MODEM_LORAWAN_MAC_REQ_DEVICE_TIME ) ==
+        SMTC_MODEM_RC_OK )
+    {
+        CLASS_B_LOCK( );
+        stats.time_requests++;
+        CLASS_B_UNLOCK( );
+    }
+}
+
+#if !defined( LBM_NATIVE )
+
+static uint64_t now_us( void )
+{
+    return ( uint64_t ) esp_timer_get_time( );
+}
+
+#else
+
+static uint64_t now_us( void )
+{
+    // Windows are timed on the virtual clock the simulated radio runs on
+    return sim_clock_now_us( );
+}
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
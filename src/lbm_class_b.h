@@ -0,0 +1,186 @@
+/*!
+ * \file      lbm_class_b.h
+ *
+ * \brief     Class B: beacon acquisition, ping-slot periodicity, missed-beacon recovery and radio-on time
+ *
+ * lbm_class_b_start() sets the ping-slot periodicity, switches the stack to class B and asks the network for its
+ * time (DeviceTimeReq) and the periodicity it must use (PingSlotInfoReq). The stack then searches the beacon;
+ * CLASS_B_STATUS and the MAC time events move the tracker through time sync, acquisition and ready, a refused or
+ * unanswered request being sent again.
+ *
+ * Every RX window the radio opens while class B runs is timed in µs, from the RX command to the standby or sleep
+ * that ends it, and filed as:
+ *
+ * - a beacon window: LoRa without IQ inversion;
+ * - a class A window: inverted IQ, opened less than LBM_CLASS_B_CLASS_A_GUARD_MS after a transmission started;
+ * - a ping slot: any other inverted IQ window.
+ *
+ * A beacon window that ends without a frame read out of the radio is a missed beacon. After
+ * LBM_CLASS_B_RESYNC_MISSED of them in a row, or when the stack reports the beacon lost, the tracker asks the
+ * network time again so the next search windows are centered on a fresh clock; the stack keeps searching on its
+ * own. Radio-on time per beacon period and per ping slot, for the periodicity in use, is what a class B device
+ * pays on top of class A: compare it with the wait for a ping slot (2^periodicity s at worst) to choose the
+ * periodicity.
+ *
+ * The radio is observed through the lbm_class_b_on_*() hooks, called by the sx126x driver wraps of
+ * lbm_radio_hooks.cpp; one stack at a time runs class B.
+ */
+
+#ifndef LBM_CLASS_B_H
+#define LBM_CLASS_B_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "smtc_modem_api.h"
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC CONSTANTS --------------------------------------------------------
+ */
+
+/**
+ * @brief Beacon period of LoRaWAN class B
+ */
+#define LBM_CLASS_B_BEACON_PERIOD_S 128
+
+/**
+ * @brief Missed beacons in a row after which the network time is requested again
+ */
+#ifndef LBM_CLASS_B_RESYNC_MISSED
+#define LBM_CLASS_B_RESYNC_MISSED 4
+#endif
+
+/**
+ * @brief RX windows opened within this delay after the start of a transmission are class A ones (RX1 / RX2 after
+ *        the longest uplink)
+ */
+#ifndef LBM_CLASS_B_CLASS_A_GUARD_MS
+#define LBM_CLASS_B_CLASS_A_GUARD_MS 6000
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC TYPES ------------------------------------------------------------
+ */
+
+/**
+ * @brief Where class B stands
+ */
+typedef enum lbm_class_b_state_e
+{
+    LBM_CLASS_B_STATE_OFF,          //!< not started
+    LBM_CLASS_B_STATE_TIME_SYNC,    //!< waiting for the network time
+    LBM_CLASS_B_STATE_ACQUISITION,  //!< time known, searching the beacon
+    LBM_CLASS_B_STATE_READY,        //!< beacon locked, ping slots open
+} lbm_class_b_state_t;
+
+/**
+ * @brief Class B counters and radio-on time
+ */
+typedef struct lbm_class_b_stats_s
+{
+    lbm_class_b_state_t state;
+    uint8_t             stack_id;
+    uint8_t             periodicity;              //!< a ping slot every 2^periodicity s
+    bool                ping_slot_info_answered;  //!< network acknowledged the periodicity
+    uint32_t            acquisition_ms;           //!< start or beacon loss to the last lock, 0 before a lock
+    uint32_t            time_requests;            //!< DeviceTimeReq asked for
+    uint32_t            beacon_windows;           //!< beacon periods observed
+    uint32_t            beacons_received;
+    uint32_t            beacons_missed;           //!< while locked
+    uint32_t            max_missed_in_row;
+    uint32_t            losses;                   //!< beacon lock lost (CLASS_B_STATUS not ready)
+    uint32_t            recoveries;               //!< beacons received again after misses or a loss
+    uint32_t            ping_slots;               //!< ping slot windows opened
+    uint32_t            ping_slot_frames;         //!< frames received in a ping slot
+    uint32_t            class_a_windows;
+    uint64_t            beacon_rx_us;             //!< radio time in beacon windows
+    uint64_t            ping_slot_rx_us;
+    uint64_t            class_a_rx_us;
+    float               rx_us_per_beacon;         //!< beacon window on average
+    float               rx_us_per_ping_slot;      //!< ping slot window on average
+    float               rx_us_per_beacon_period;  //!< beacon and ping slots of one beacon period
+} lbm_class_b_stats_t;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS PROTOTYPES --------------------------------------------
+ */
+
+/**
+ * @brief Switch a joined stack to class B
+ *
+ * @param [in] stack_id    Stack
+ * @param [in] periodicity Ping slot every 2^periodicity s (SMTC_MODEM_CLASS_B_PINGSLOT_1_S to _128_S)
+ *
+ * @return SMTC_MODEM_RC_OK, SMTC_MODEM_RC_BUSY if another stack runs class B, or the modem error
+ */
+smtc_modem_return_code_t lbm_class_b_start( uint8_t stack_id, smtc_modem_class_b_ping_slot_periodicity_t periodicity );
+
+/**
+ * @brief Switch the class B stack back to class A (counters are kept)
+ */
+smtc_modem_return_code_t lbm_class_b_stop( void );
+
+/**
+ * @brief Change the ping-slot periodicity, announced again to the network
+ */
+smtc_modem_return_code_t lbm_class_b_set_periodicity( smtc_modem_class_b_ping_slot_periodicity_t periodicity );
+
+/**
+ * @brief Follow the class B and MAC time events (engine context)
+ */
+void lbm_class_b_on_event( const smtc_modem_event_t* event );
+
+/**
+ * @brief A transmission starts (engine context): the RX windows following it are class A ones
+ */
+void lbm_class_b_on_tx( void );
+
+/**
+ * @brief The radio starts a receive window (sx126x_set_rx*)
+ */
+void lbm_class_b_on_rx( void );
+
+/**
+ * @brief The radio goes to standby or sleep, ending the window in progress
+ */
+void lbm_class_b_on_radio_idle( void );
+
+/**
+ * @brief LoRa packet parameters of the next window: beacons are received without IQ inversion
+ */
+void lbm_class_b_on_lora_pkt_params( bool invert_iq );
+
+/**
+ * @brief A received frame is read out of the radio (sx126x_get_rx_buffer_status)
+ */
+void lbm_class_b_on_rx_done( void );
+
+/**
+ * @brief Make the requests decided while the radio was driven (engine context, before the modem engine runs)
+ */
+void lbm_class_b_process( void );
+
+/**
+ * @brief Read / clear the counters (state and periodicity are kept)
+ */
+void lbm_class_b_get_stats( lbm_class_b_stats_t* stats );
+void lbm_class_b_reset_stats( void );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // LBM_CLASS_B_H
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -41,6 +41,18 @@
 
 #include "main.h"
 #include "lbm_core.h"
+#include "lbm_event_ring.h"
+#include "lbm_rx_ring.h"
+#include "lbm_log.h"
+#include "lbm_session.h"
+#include "lbm_stacks.h"
+#include "lbm_lr_fhss.h"
+#include "lbm_uplink.h"
+#include "lbm_aggregator.h"
+#include "lbm_event_bus.h"
+#include "lbm_class_b.h"
+#include "lbm_energy.h"
+#include "lbm_engine.h"
 
 #include "smtc_modem_test_api.h"
 #include "smtc_modem_api.h"
@@ -140,7 +152,7 @@
  */
 
 /**
- * Stack id value (multistacks modem is not yet available)
+ * Stack id value of the example code, see lbm_core.h
  */
 #define STACK_ID 0
 
@@ -175,10 +187,7 @@ static const uint8_t user_app_key[16]     = USER_LORAWAN_APP_KEY;
  * -----------------------------------------------------------------------------
  * --- PRIVATE VARIABLES -------------------------------------------------------
  */
-static uint8_t                  rx_payload[SMTC_MODEM_MAX_LORAWAN_PAYLOAD_LENGTH] = { 0 };  // Buffer for rx payload
-static uint8_t                  rx_payload_size = 0;      // Size of the payload in the rx_payload buffer
-static smtc_modem_dl_metadata_t rx_metadata     = { 0 };  // Metadata of downlink
-static uint8_t                  rx_remaining    = 0;      // Remaining downlink payload in modem
+static lbm_dl_buffer_t* dispatched_downlink = nullptr;  // Downlink of the DOWNDATA event in the user callback
 
 static volatile bool user_button_is_press = false;  // Flag for button status
 static uint32_t      uplink_counter       = 0;      // uplink raising counter
@@ -240,8 +249,9 @@ void main_periodical_uplink( void )
 
     while( 1 )
     {
-        smtc_modem_run_engine( );
-        hal_mcu_set_sleep_for_ms( 10 );
+        // Sleep until the modem deadline, unless its irq or the application needs the engine earlier
+        sleep_time_ms = lbm_engine_run( );
+        lbm_engine_wait( sleep_time_ms );
     }
 }
 
@@ -263,6 +273,13 @@ void lbm_init(void)
     hal_mcu_set_sleep_for_ms(100);
 }
 
+const lbm_dl_buffer_t* lbm_take_dispatched_downlink( void )
+{
+    const lbm_dl_buffer_t* downlink = dispatched_downlink;
+    dispatched_downlink             = nullptr;
+    return downlink;
+}
+
 
 
 
@@ -273,13 +290,16 @@ void lbm_init(void)
 
 static void modem_event_callback( void )
 {
-    extern LBMEventCallback userEventCallback;
+    extern LBMEventCallback    userEventCallback;
+    extern LBMDownlinkCallback userDownlinkCallback;
     
-    SMTC_HAL_TRACE_MSG_COLOR( "Modem event callback\n", HAL_DBG_TRACE_COLOR_BLUE );
+    LBM_LOG_DEBUG( "Modem event callback\n" );
 
     smtc_modem_event_t current_event;
     uint8_t            event_pending_count;
-    uint8_t            stack_id = STACK_ID;
+#if defined( USE_LR11XX_CREDENTIALS )
+    uint8_t stack_id = STACK_ID;
+#endif
 
     // Continue to read modem event until all event has been processed
     do
@@ -287,16 +307,51 @@ static void modem_event_callback( void )
         // Read modem event
         ASSERT_SMTC_MODEM_RC( smtc_modem_get_event( &current_event, &event_pending_count ) );
 
-        // Call user callback first if registered
-        if (userEventCallback != nullptr) {
-            userEventCallback(&current_event);
+        // Single copy of the downlink out of the modem, into a pool buffer lent to the application or, in class C
+        // receive mode, into the RX ring the application drains (the frame is not handed to the pool paths)
+        lbm_dl_buffer_t*       downlink = nullptr;
+        const lbm_dl_buffer_t* received = nullptr;
+        if( current_event.event_type == SMTC_MODEM_EVENT_DOWNDATA )
+        {
+            if( lbm_rx_ring_is_started( ) == true )
+            {
+                received = lbm_rx_ring_read_downlink( );
+            }
+            else
+            {
+                downlink = lbm_dl_pool_read_downlink( );
+                received = downlink;
+            }
+        }
+
+        lbm_stacks_on_event( &current_event );
+        lbm_lr_fhss_on_event( &current_event );
+        lbm_uplink_on_event( &current_event );
+        lbm_aggregator_on_event( &current_event );
+        lbm_class_b_on_event( &current_event );
+        lbm_energy_on_event( &current_event );
+
+        // Subscribers of the event type, in the engine context whatever the delivery mode of the callback
+        lbm_event_bus_dispatch( &current_event, received );
+
+        // Call user callback first if registered (synchronous mode), the one of the stack if it has one
+        LBMEventCallback callback = lbm_stacks_get_event_callback( current_event.stack_id );
+        if( callback == nullptr )
+        {
+            callback = userEventCallback;
+        }
+        if( ( lbm_event_ring_is_enabled( ) == false ) && ( callback != nullptr ) )
+        {
+            dispatched_downlink = downlink;
+            callback( &current_event );
+            dispatched_downlink = nullptr;
         }
 
         // Then continue with original internal processing
         switch( current_event.event_type )
         {
         case SMTC_MODEM_EVENT_RESET:
-            SMTC_HAL_TRACE_INFO( "Event received: RESET\n" );
+            LBM_LOG_INFO( "Event received: RESET\n" );
 
 #if !defined( USE_LR11XX_CREDENTIALS )
             // Set user credentials
@@ -307,9 +362,9 @@ static void modem_event_callback( void )
 #else
             // Get internal credentials
             ASSERT_SMTC_MODEM_RC( smtc_modem_get_chip_eui( stack_id, chip_eui ) );
-            SMTC_HAL_TRACE_ARRAY( "CHIP_EUI", chip_eui, SMTC_MODEM_EUI_LENGTH );
+            LBM_LOG_INFO_ARRAY( "CHIP_EUI", chip_eui, SMTC_MODEM_EUI_LENGTH );
             ASSERT_SMTC_MODEM_RC( smtc_modem_get_pin( stack_id, chip_pin ) );
-            SMTC_HAL_TRACE_ARRAY( "CHIP_PIN", chip_pin, SMTC_MODEM_PIN_LENGTH );
+            LBM_LOG_INFO_ARRAY( "CHIP_PIN", chip_pin, SMTC_MODEM_PIN_LENGTH );
 #endif
             // Set user region
             // ASSERT_SMTC_MODEM_RC( smtc_modem_set_region( stack_id, MODEM_EXAMPLE_REGION ) );
@@ -350,7 +405,7 @@ static void modem_event_callback( void )
             break;
 
         case SMTC_MODEM_EVENT_ALARM:
-            SMTC_HAL_TRACE_INFO( "Event received: ALARM\n" );
+            LBM_LOG_INFO( "Event received: ALARM\n" );
             // Send periodical uplink on port 101
             // send_uplink_counter_on_port( 101 );
             // // Restart periodical uplink alarm
@@ -358,8 +413,12 @@ static void modem_event_callback( void )
             break;
 
         case SMTC_MODEM_EVENT_JOINED:
-            SMTC_HAL_TRACE_INFO( "Event received: JOINED\n" );
-            SMTC_HAL_TRACE_INFO( "Modem is now joined \n" );
+            LBM_LOG_INFO( "Event received: JOINED (stack %u)\n", current_event.stack_id );
+            LBM_LOG_INFO( "Modem is now joined \n" );
+            if( current_event.stack_id == STACK_ID )
+            {
+                lbm_session_on_joined( );
+            }
 
             // Send first periodical uplink on port 101
             // send_uplink_counter_on_port( 101 );
@@ -368,41 +427,45 @@ static void modem_event_callback( void )
             break;
 
         case SMTC_MODEM_EVENT_TXDONE:
-            SMTC_HAL_TRACE_INFO( "Event received: TXDONE\n" );
-            SMTC_HAL_TRACE_INFO( "Transmission done \n" );
+            LBM_LOG_INFO( "Event received: TXDONE\n" );
+            LBM_LOG_INFO( "Transmission done \n" );
             break;
 
         case SMTC_MODEM_EVENT_DOWNDATA:
-            SMTC_HAL_TRACE_INFO( "Event received: DOWNDATA\n" );
-            // Get downlink data
-            ASSERT_SMTC_MODEM_RC(
-                smtc_modem_get_downlink_data( rx_payload, &rx_payload_size, &rx_metadata, &rx_remaining ) );
-            SMTC_HAL_TRACE_PRINTF( "Data received on port %u\n", rx_metadata.fport );
-            SMTC_HAL_TRACE_ARRAY( "Received payload", rx_payload, rx_payload_size );
+            LBM_LOG_INFO( "Event received: DOWNDATA\n" );
+            if( received != nullptr )
+            {
+                LBM_LOG_INFO( "Data received on port %u\n", received->metadata.fport );
+                LBM_LOG_INFO_ARRAY( "Received payload", received->payload, received->size );
+            }
+            else
+            {
+                LBM_LOG_WARN( "No free downlink buffer, downlink dropped\n" );
+            }
             break;
 
         case SMTC_MODEM_EVENT_JOINFAIL:
-            SMTC_HAL_TRACE_INFO( "Event received: JOINFAIL\n" );
+            LBM_LOG_INFO( "Event received: JOINFAIL\n" );
             break;
 
         case SMTC_MODEM_EVENT_ALCSYNC_TIME:
-            SMTC_HAL_TRACE_INFO( "Event received: ALCSync service TIME\n" );
+            LBM_LOG_INFO( "Event received: ALCSync service TIME\n" );
             break;
 
         case SMTC_MODEM_EVENT_LINK_CHECK:
-            SMTC_HAL_TRACE_INFO( "Event received: LINK_CHECK\n" );
+            LBM_LOG_INFO( "Event received: LINK_CHECK\n" );
             break;
 
         case SMTC_MODEM_EVENT_CLASS_B_PING_SLOT_INFO:
-            SMTC_HAL_TRACE_INFO( "Event received: CLASS_B_PING_SLOT_INFO\n" );
+            LBM_LOG_INFO( "Event received: CLASS_B_PING_SLOT_INFO\n" );
             break;
 
         case SMTC_MODEM_EVENT_CLASS_B_STATUS:
-            SMTC_HAL_TRACE_INFO( "Event received: CLASS_B_STATUS\n" );
+            LBM_LOG_INFO( "Event received: CLASS_B_STATUS\n" );
             break;
 
         case SMTC_MODEM_EVENT_LORAWAN_MAC_TIME:
-            SMTC_HAL_TRACE_WARNING( "Event received: LORAWAN MAC TIME\n" );
+            LBM_LOG_WARN( "Event received: LORAWAN MAC TIME\n" );
             break;
 
         case SMTC_MODEM_EVENT_LORAWAN_FUOTA_DONE:
@@ -410,33 +473,33 @@ static void modem_event_callback( void )
             bool status = current_event.event_data.fuota_status.successful;
             if( status == true )
             {
-                SMTC_HAL_TRACE_INFO( "Event received: FUOTA SUCCESSFUL\n" );
+                LBM_LOG_INFO( "Event received: FUOTA SUCCESSFUL\n" );
             }
             else
             {
-                SMTC_HAL_TRACE_WARNING( "Event received: FUOTA FAIL\n" );
+                LBM_LOG_WARN( "Event received: FUOTA FAIL\n" );
             }
             break;
         }
 
         case SMTC_MODEM_EVENT_NO_MORE_MULTICAST_SESSION_CLASS_C:
-            SMTC_HAL_TRACE_INFO( "Event received: MULTICAST CLASS_C STOP\n" );
+            LBM_LOG_INFO( "Event received: MULTICAST CLASS_C STOP\n" );
             break;
 
         case SMTC_MODEM_EVENT_NO_MORE_MULTICAST_SESSION_CLASS_B:
-            SMTC_HAL_TRACE_INFO( "Event received: MULTICAST CLASS_B STOP\n" );
+            LBM_LOG_INFO( "Event received: MULTICAST CLASS_B STOP\n" );
             break;
 
         case SMTC_MODEM_EVENT_NEW_MULTICAST_SESSION_CLASS_C:
-            SMTC_HAL_TRACE_INFO( "Event received: New MULTICAST CLASS_C \n" );
+            LBM_LOG_INFO( "Event received: New MULTICAST CLASS_C \n" );
             break;
 
         case SMTC_MODEM_EVENT_NEW_MULTICAST_SESSION_CLASS_B:
-            SMTC_HAL_TRACE_INFO( "Event received: New MULTICAST CLASS_B\n" );
+            LBM_LOG_INFO( "Event received: New MULTICAST CLASS_B\n" );
             break;
 
         case SMTC_MODEM_EVENT_FIRMWARE_MANAGEMENT:
-            SMTC_HAL_TRACE_INFO( "Event received: FIRMWARE_MANAGEMENT\n" );
+            LBM_LOG_INFO( "Event received: FIRMWARE_MANAGEMENT\n" );
             if( current_event.event_data.fmp.status == SMTC_MODEM_EVENT_FMP_REBOOT_IMMEDIATELY )
             {
                 smtc_modem_hal_reset_mcu( );
@@ -444,31 +507,31 @@ static void modem_event_callback( void )
             break;
 
         case SMTC_MODEM_EVENT_STREAM_DONE:
-            SMTC_HAL_TRACE_INFO( "Event received: STREAM_DONE\n" );
+            LBM_LOG_INFO( "Event received: STREAM_DONE\n" );
             break;
 
         case SMTC_MODEM_EVENT_UPLOAD_DONE:
-            SMTC_HAL_TRACE_INFO( "Event received: UPLOAD_DONE\n" );
+            LBM_LOG_INFO( "Event received: UPLOAD_DONE\n" );
             break;
 
         case SMTC_MODEM_EVENT_DM_SET_CONF:
-            SMTC_HAL_TRACE_INFO( "Event received: DM_SET_CONF\n" );
+            LBM_LOG_INFO( "Event received: DM_SET_CONF\n" );
             break;
 
         case SMTC_MODEM_EVENT_MUTE:
-            SMTC_HAL_TRACE_INFO( "Event received: MUTE\n" );
+            LBM_LOG_INFO( "Event received: MUTE\n" );
             break;
         case SMTC_MODEM_EVENT_RELAY_TX_DYNAMIC:  //!< Relay TX dynamic mode has enable or disable the WOR protocol
-            SMTC_HAL_TRACE_INFO( "Event received: RELAY_TX_DYNAMIC\n" );
+            LBM_LOG_INFO( "Event received: RELAY_TX_DYNAMIC\n" );
             break;
         case SMTC_MODEM_EVENT_RELAY_TX_MODE:  //!< Relay TX activation has been updated
-            SMTC_HAL_TRACE_INFO( "Event received: RELAY_TX_MODE\n" );
+            LBM_LOG_INFO( "Event received: RELAY_TX_MODE\n" );
             break;
         case SMTC_MODEM_EVENT_RELAY_TX_SYNC:  //!< Relay TX synchronisation has changed
-            SMTC_HAL_TRACE_INFO( "Event received: RELAY_TX_SYNC\n" );
+            LBM_LOG_INFO( "Event received: RELAY_TX_SYNC\n" );
             break;
         case SMTC_MODEM_EVENT_RELAY_RX_RUNNING:
-            SMTC_HAL_TRACE_INFO( "Event received: RELAY_RX_RUNNING\n" );
+            LBM_LOG_INFO( "Event received: RELAY_RX_RUNNING\n" );
 #if defined( ADD_CSMA )
             bool csma_state = false;
             ASSERT_SMTC_MODEM_RC( smtc_modem_csma_get_state( STACK_ID, &csma_state ) );
@@ -487,33 +550,52 @@ static void modem_event_callback( void )
 
             break;
         case SMTC_MODEM_EVENT_REGIONAL_DUTY_CYCLE:
-            SMTC_HAL_TRACE_INFO( "Event received: DUTY_CYCLE\n" );
+            LBM_LOG_INFO( "Event received: DUTY_CYCLE\n" );
             break;
         case SMTC_MODEM_EVENT_TEST_MODE:
         {
             uint8_t status_test_mode = current_event.event_data.test_mode_status.status;
-#if MODEM_HAL_DBG_TRACE == MODEM_HAL_FEATURE_ON
+#if LBM_LOG_LEVEL >= LBM_LOG_LEVEL_INFO
             const char* status_name[] = { "SMTC_MODEM_EVENT_TEST_MODE_ENDED", "SMTC_MODEM_EVENT_TEST_MODE_TX_COMPLETED",
                                     "SMTC_MODEM_EVENT_TEST_MODE_TX_DONE", "SMTC_MODEM_EVENT_TEST_MODE_RX_DONE" };
-            SMTC_HAL_TRACE_INFO( "Event received: TEST_MODE :  %s\n", status_name[status_test_mode] );
+            LBM_LOG_INFO( "Event received: TEST_MODE :  %s\n", status_name[status_test_mode] );
 #endif
             if( status_test_mode == SMTC_MODEM_EVENT_TEST_MODE_RX_DONE )
             {
                 int16_t rssi;
                 int16_t snr;
+                uint8_t rx_payload[SMTC_MODEM_MAX_LORAWAN_PAYLOAD_LENGTH];
                 uint8_t rx_payload_length;
                 smtc_modem_test_get_last_rx_packets( &rssi, &snr, rx_payload, &rx_payload_length );
-                SMTC_HAL_TRACE_ARRAY( "rx_payload", rx_payload, rx_payload_length );
-                SMTC_HAL_TRACE_PRINTF( "rssi: %d, snr: %d\n", rssi, snr );
+                LBM_LOG_INFO_ARRAY( "rx_payload", rx_payload, rx_payload_length );
+                LBM_LOG_INFO( "rssi: %d, snr: %d\n", rssi, snr );
             }
 
             break;
         }
 
         default:
-            SMTC_HAL_TRACE_ERROR( "Unknown event %u\n", current_event.event_type );
+            LBM_LOG_ERROR( "Unknown event %u\n", current_event.event_type );
             break;
         }
+
+        if( lbm_event_ring_is_enabled( ) == true )
+        {
+            // Queued mode: the record takes the downlink buffer over, the application releases it
+            lbm_event_ring_push( &current_event, downlink );
+        }
+        else if( downlink != nullptr )
+        {
+            // Synchronous mode: lend the buffer to the downlink callback, or give it straight back
+            if( userDownlinkCallback != nullptr )
+            {
+                userDownlinkCallback( downlink );
+            }
+            else
+            {
+                lbm_dl_pool_release( downlink );
+            }
+        }
     } while( event_pending_count > 0 );
 }
 
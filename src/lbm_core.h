@@ -47,6 +47,11 @@ extern "C" {
 #include <stdint.h>
 #include <stdbool.h>
 #include "smtc_modem_api.h"
+#include "lbm_dl_pool.h"
+
+#if !defined( LBM_NATIVE )
+#include "freertos/FreeRTOS.h"
+#endif
 
 /*
  * -----------------------------------------------------------------------------
@@ -56,6 +61,9 @@ extern "C" {
 // User event callback function type
 typedef void (*LBMEventCallback)(smtc_modem_event_t* event);
 
+// Downlink callback function type, the buffer is borrowed until lbm_dl_pool_release()
+typedef void (*LBMDownlinkCallback)(lbm_dl_buffer_t* downlink);
+
 /*
  * -----------------------------------------------------------------------------
  * --- PUBLIC MACROS -----------------------------------------------------------
@@ -75,6 +83,24 @@ typedef void (*LBMEventCallback)(smtc_modem_event_t* event);
 #define DELAY_FIRST_MSG_AFTER_JOIN 60
 #endif
 
+/**
+ * @brief Critical section of a module shared by the engine task, the application tasks and ISRs
+ *
+ * static lbm_critical_t lock = LBM_CRITICAL_INITIALIZER; then LBM_CRITICAL_ENTER( &lock ) / LBM_CRITICAL_EXIT( &lock ).
+ * The host build runs a single task: the lock is a placeholder and the section is not guarded.
+ */
+#if !defined( LBM_NATIVE )
+typedef portMUX_TYPE lbm_critical_t;
+#define LBM_CRITICAL_INITIALIZER portMUX_INITIALIZER_UNLOCKED
+#define LBM_CRITICAL_ENTER( lock ) portENTER_CRITICAL_SAFE( lock )
+#define LBM_CRITICAL_EXIT( lock ) portEXIT_CRITICAL_SAFE( lock )
+#else
+typedef uint8_t lbm_critical_t;
+#define LBM_CRITICAL_INITIALIZER 0
+#define LBM_CRITICAL_ENTER( lock ) ( ( void ) ( lock ) )
+#define LBM_CRITICAL_EXIT( lock ) ( ( void ) ( lock ) )
+#endif
+
 
 /*
  * -----------------------------------------------------------------------------
@@ -82,10 +108,19 @@ typedef void (*LBMEventCallback)(smtc_modem_event_t* event);
  */
 
 /**
- * @brief Stack id value (multistacks modem is not yet available)
+ * @brief Stack id of lbm.lorawan, and of the features bound to one stack (warm start, aggregation, example code)
  */
 #define STACK_ID 0
 
+/**
+ * @brief LoRaWAN stacks run by the modem on the one radio, see lbm_stacks.h (NUMBER_OF_STACKS of the build)
+ */
+#if defined( NUMBER_OF_STACKS )
+#define LBM_NUMBER_OF_STACKS NUMBER_OF_STACKS
+#else
+#define LBM_NUMBER_OF_STACKS 1
+#endif
+
 /*
  * -----------------------------------------------------------------------------
  * --- PUBLIC TYPES ------------------------------------------------------------
@@ -105,6 +140,15 @@ typedef void (*LBMEventCallback)(smtc_modem_event_t* event);
 void main_periodical_uplink(void);
 void lbm_init(void);
 
+/**
+ * @brief Take the downlink of the DOWNDATA event being passed to the synchronous event callback
+ *
+ * Lets LoRaWANClass::getDownlinkData() return the payload the engine already read into the pool.
+ *
+ * @return The buffer (still owned by the engine), NULL outside a DOWNDATA callback or if already taken
+ */
+const lbm_dl_buffer_t* lbm_take_dispatched_downlink(void);
+
 
 #ifdef __cplusplus
 }
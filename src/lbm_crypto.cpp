@@ -0,0 +1,383 @@
+/*!
+ * \file      lbm_crypto.cpp
+ *
+ * \brief     AES block backend of the soft secure element, and a streaming AES-CMAC
+ */
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <string.h>
+
+#include "lbm_crypto.h"
+#include "lbm_log.h"
+
+extern "C" {
+#include "aes.h"
+#include "cmac.h"
+}
+
+#if defined( ESP32 ) && !defined( LBM_NATIVE )
+#include "aes/esp_aes.h"
+#define HARDWARE_AVAILABLE true
+#else
+#define HARDWARE_AVAILABLE false
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE CONSTANTS -------------------------------------------------------
+ */
+
+// aes_set_key() stores ( keylen / 4 ) + 6 rounds: 10 for the AES-128 keys of LoRaWAN
+#define AES128_ROUNDS 10
+
+// MIC and payload encryption alternate between two session keys
+#define TABLE_KEY_SLOTS 2
+
+// One-block CMAC subkey generation constant (RFC 4493 section 2.3)
+#define CMAC_RB 0x87
+
+typedef struct aes_vector_s
+{
+    uint8_t key[16];
+    uint8_t plaintext[16];
+    uint8_t ciphertext[16];
+} aes_vector_t;
+
+typedef struct cmac_vector_s
+{
+    uint8_t size;
+    uint8_t mac[16];
+} cmac_vector_t;
+
+// FIPS-197 appendix C.1 and SP 800-38A F.1.1
+static const aes_vector_t aes_vectors[] = {
+    { { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f },
+      { 0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff },
+      { 0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30, 0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a } },
+    { { 0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c },
+      { 0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96, 0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a },
+      { 0x3a, 0xd7, 0x7b, 0xb4, 0x0d, 0x7a, 0x36, 0x60, 0xa8, 0x9e, 0xca, 0xf3, 0x24, 0x66, 0xef, 0x97 } },
+};
+
+// RFC 4493 section 4: prefixes of one message under one key
+static const uint8_t cmac_key[16] = { 0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+                                      0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c };
+
+static const uint8_t cmac_message[64] = {
+    0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96, 0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a,
+    0xae, 0x2d, 0x8a, 0x57, 0x1e, 0x03, 0xac, 0x9c, 0x9e, 0xb7, 0x6f, 0xac, 0x45, 0xaf, 0x8e, 0x51,
+    0x30, 0xc8, 0x1c, 0x46, 0xa3, 0x5c, 0xe4, 0x11, 0xe5, 0xfb, 0xc1, 0x19, 0x1a, 0x0a, 0x52, 0xef,
+    0xf6, 0x9f, 0x24, 0x45, 0xdf, 0x4f, 0x9b, 0x17, 0xad, 0x2b, 0x41, 0x7b, 0xe6, 0x6c, 0x37, 0x10,
+};
+
+static const cmac_vector_t cmac_vectors[] = {
+    { 0, { 0xbb, 0x1d, 0x69, 0x29, 0xe9, 0x59, 0x37, 0x28, 0x7f, 0xa3, 0x7d, 0x12, 0x9b, 0x75, 0x67, 0x46 } },
+    { 16, { 0x07, 0x0a, 0x16, 0xb4, 0x6b, 0x4d, 0x41, 0x44, 0xf7, 0x9b, 0xdd, 0x9d, 0xd0, 0x4a, 0x28, 0x7c } },
+    { 40, { 0xdf, 0xa6, 0x67, 0x47, 0xde, 0x9a, 0xe6, 0x30, 0x30, 0xca, 0x32, 0x61, 0x14, 0x97, 0xc8, 0x27 } },
+    { 64, { 0x51, 0xf0, 0xbe, 0xbf, 0x7e, 0x3b, 0x9d, 0x92, 0xfc, 0x49, 0x74, 0x17, 0x79, 0x36, 0x3c, 0xfe } },
+};
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE VARIABLES -------------------------------------------------------
+ */
+
+static lbm_crypto_backend_t backend = LBM_CRYPTO_BACKEND_SOFT;
+static bool                 verified[LBM_CRYPTO_BACKEND_COUNT];
+
+// Expanded keys of the table backend, replaced in turn
+static struct
+{
+    uint8_t           key[LBM_AES_KEY_SIZE];
+    lbm_aes_context_t context;
+    bool              loaded;
+} table_keys[TABLE_KEY_SLOTS];
+static uint8_t table_next_slot = 0;
+
+#if HARDWARE_AVAILABLE
+// The peripheral context keeps the last key, LoRaWAN uses the same key for many blocks in a row
+static esp_aes_context hardware_context;
+static uint8_t         hardware_key[16];
+static bool            hardware_key_loaded = false;
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DECLARATION -------------------------------------------
+ */
+
+/**
+ * @brief Encrypt one block on the AES peripheral
+ *
+ * @return false if the peripheral refused it, the caller then uses the soft backend
+ */
+static bool hardware_encrypt( const uint8_t key[16], const uint8_t in[16], uint8_t out[16] );
+
+/**
+ * @brief Encrypt one block on the table AES, expanding the key unless it is one of the last two used
+ */
+static void table_encrypt( const uint8_t key[16], const uint8_t in[16], uint8_t out[16] );
+
+/**
+ * @brief Encrypt one CMAC block in place
+ */
+static void cmac_encrypt( const lbm_crypto_cmac_t* context, uint8_t block[LBM_AES_BLOCK_SIZE] );
+
+/**
+ * @brief Multiply a CMAC subkey by x in GF(2^128)
+ */
+static void cmac_double( uint8_t block[LBM_AES_BLOCK_SIZE] );
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS DEFINITION ---------------------------------------------
+ */
+
+void lbm_crypto_init( void )
+{
+#if HARDWARE_AVAILABLE
+    esp_aes_init( &hardware_context );
+#endif
+    if( ( LBM_CRYPTO_BACKEND != LBM_CRYPTO_BACKEND_SOFT ) &&
+        ( lbm_crypto_set_backend( LBM_CRYPTO_BACKEND ) != SMTC_MODEM_RC_OK ) )
+    {
+        LBM_LOG_ERROR( "AES backend %d failed its self test, using software AES\n", LBM_CRYPTO_BACKEND );
+    }
+}
+
+smtc_modem_return_code_t lbm_crypto_set_backend( lbm_crypto_backend_t new_backend )
+{
+    if( ( new_backend < LBM_CRYPTO_BACKEND_SOFT ) || ( new_backend >= LBM_CRYPTO_BACKEND_COUNT ) )
+    {
+        return SMTC_MODEM_RC_INVALID;
+    }
+    if( ( new_backend != LBM_CRYPTO_BACKEND_SOFT ) && ( verified[new_backend] == false ) )
+    {
+        verified[new_backend] = ( lbm_crypto_self_test( new_backend ) == 0 );
+        if( verified[new_backend] == false )
+        {
+            return SMTC_MODEM_RC_INVALID;
+        }
+    }
+    backend = new_backend;
+    return SMTC_MODEM_RC_OK;
+}
+
+lbm_crypto_backend_t lbm_crypto_get_backend( void )
+{
+    return backend;
+}
+
+int lbm_crypto_self_test( lbm_crypto_backend_t tested )
+{
+    if( ( tested == LBM_CRYPTO_BACKEND_HARDWARE ) && ( HARDWARE_AVAILABLE == false ) )
+    {
+        return -1;
+    }
+
+    // aes_encrypt() below goes through the wrapper, like the calls of the secure element
+    const lbm_crypto_backend_t previous = backend;
+    backend                             = tested;
+    int failures                        = 0;
+
+    for( const aes_vector_t& vector : aes_vectors )
+    {
+        aes_context context;
+        uint8_t     out[16];
+        aes_set_key( vector.key, sizeof( vector.key ), &context );
+        aes_encrypt( vector.plaintext, out, &context );
+        if( memcmp( out, vector.ciphertext, sizeof( out ) ) != 0 )
+        {
+            failures++;
+        }
+    }
+
+    for( const cmac_vector_t& vector : cmac_vectors )
+    {
+        AES_CMAC_CTX context;
+        uint8_t      mac[16];
+        AES_CMAC_Init( &context );
+        AES_CMAC_SetKey( &context, cmac_key );
+        AES_CMAC_Update( &context, cmac_message, vector.size );
+        AES_CMAC_Final( mac, &context );
+        if( memcmp( mac, vector.mac, sizeof( mac ) ) != 0 )
+        {
+            failures++;
+        }
+
+        // Same message fed in uneven pieces
+        lbm_crypto_cmac_t stream;
+        lbm_crypto_cmac_init( &stream, cmac_key );
+        for( uint32_t offset = 0, piece = 1; offset < vector.size; offset += piece, piece += 7 )
+        {
+            lbm_crypto_cmac_update( &stream, cmac_message + offset,
+                                    ( piece < ( uint32_t ) ( vector.size - offset ) ) ? piece : vector.size - offset );
+        }
+        lbm_crypto_cmac_final( &stream, mac );
+        if( memcmp( mac, vector.mac, sizeof( mac ) ) != 0 )
+        {
+            failures++;
+        }
+    }
+
+    backend = previous;
+    return failures;
+}
+
+void lbm_crypto_cmac_init( lbm_crypto_cmac_t* context, const uint8_t key[LBM_AES_KEY_SIZE] )
+{
+    memcpy( context->key, key, LBM_AES_KEY_SIZE );
+    lbm_aes_set_key( key, &context->table_key );
+    memset( context->mac, 0, sizeof( context->mac ) );
+    context->last_size = 0;
+}
+
+void lbm_crypto_cmac_update( lbm_crypto_cmac_t* context, const uint8_t* data, uint32_t size )
+{
+    while( size > 0 )
+    {
+        if( context->last_size == LBM_AES_BLOCK_SIZE )
+        {
+            // More data follows: the kept block was not the final one
+            for( int i = 0; i < LBM_AES_BLOCK_SIZE; i++ )
+            {
+                context->mac[i] ^= context->last[i];
+            }
+            cmac_encrypt( context, context->mac );
+            context->last_size = 0;
+        }
+
+        // Whole blocks straight from the piece, keeping back the one that may be the final block
+        while( ( context->last_size == 0 ) && ( size > LBM_AES_BLOCK_SIZE ) )
+        {
+            for( int i = 0; i < LBM_AES_BLOCK_SIZE; i++ )
+            {
+                context->mac[i] ^= data[i];
+            }
+            cmac_encrypt( context, context->mac );
+            data += LBM_AES_BLOCK_SIZE;
+            size -= LBM_AES_BLOCK_SIZE;
+        }
+
+        const uint32_t free_size = LBM_AES_BLOCK_SIZE - context->last_size;
+        const uint32_t copied    = ( size < free_size ) ? size : free_size;
+        memcpy( context->last + context->last_size, data, copied );
+        context->last_size += copied;
+        data += copied;
+        size -= copied;
+    }
+}
+
+void lbm_crypto_cmac_final( lbm_crypto_cmac_t* context, uint8_t mac[LBM_AES_BLOCK_SIZE] )
+{
+    // K1 for a complete final block, K2 for a padded one
+    uint8_t subkey[LBM_AES_BLOCK_SIZE] = { 0 };
+    cmac_encrypt( context, subkey );
+    cmac_double( subkey );
+    if( context->last_size < LBM_AES_BLOCK_SIZE )
+    {
+        cmac_double( subkey );
+        context->last[context->last_size] = 0x80;
+        memset( context->last + context->last_size + 1, 0, LBM_AES_BLOCK_SIZE - context->last_size - 1 );
+    }
+
+    for( int i = 0; i < LBM_AES_BLOCK_SIZE; i++ )
+    {
+        context->mac[i] ^= context->last[i] ^ subkey[i];
+    }
+    cmac_encrypt( context, context->mac );
+    memcpy( mac, context->mac, LBM_AES_BLOCK_SIZE );
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DEFINITION --------------------------------------------
+ */
+
+static bool hardware_encrypt( const uint8_t key[16], const uint8_t in[16], uint8_t out[16] )
+{
+#if HARDWARE_AVAILABLE
+    if( ( hardware_key_loaded == false ) || ( memcmp( key, hardware_key, sizeof( hardware_key ) ) != 0 ) )
+    {
+        if( esp_aes_setkey( &hardware_context, key, 128 ) != 0 )
+        {
+            hardware_key_loaded = false;
+            return false;
+        }
+        memcpy( hardware_key, key, sizeof( hardware_key ) );
+        hardware_key_loaded = true;
+    }
+    return esp_aes_crypt_ecb( &hardware_context, ESP_AES_ENCRYPT, in, out ) == 0;
+#else
+    ( void ) key;
+    ( void ) in;
+    ( void ) out;
+    return false;
+#endif
+}
+
+static void table_encrypt( const uint8_t key[16], const uint8_t in[16], uint8_t out[16] )
+{
+    for( int slot = 0; slot < TABLE_KEY_SLOTS; slot++ )
+    {
+        if( ( table_keys[slot].loaded == true ) && ( memcmp( key, table_keys[slot].key, LBM_AES_KEY_SIZE ) == 0 ) )
+        {
+            lbm_aes_encrypt( &table_keys[slot].context, in, out );
+            return;
+        }
+    }
+
+    const uint8_t slot = table_next_slot;
+    table_next_slot    = ( uint8_t ) ( ( slot + 1 ) % TABLE_KEY_SLOTS );
+    memcpy( table_keys[slot].key, key, LBM_AES_KEY_SIZE );
+    lbm_aes_set_key( key, &table_keys[slot].context );
+    table_keys[slot].loaded = true;
+    lbm_aes_encrypt( &table_keys[slot].context, in, out );
+}
+
+static void cmac_encrypt( const lbm_crypto_cmac_t* context, uint8_t block[LBM_AES_BLOCK_SIZE] )
+{
+    if( ( backend != LBM_CRYPTO_BACKEND_HARDWARE ) || ( hardware_encrypt( context->key, block, block ) == false ) )
+    {
+        lbm_aes_encrypt( &context->table_key, block, block );
+    }
+}
+
+static void cmac_double( uint8_t block[LBM_AES_BLOCK_SIZE] )
+{
+    const uint8_t carry = block[0] >> 7;
+    for( int i = 0; i < LBM_AES_BLOCK_SIZE - 1; i++ )
+    {
+        block[i] = ( uint8_t ) ( ( block[i] << 1 ) | ( block[i + 1] >> 7 ) );
+    }
+    block[LBM_AES_BLOCK_SIZE - 1] = ( uint8_t ) ( ( block[LBM_AES_BLOCK_SIZE - 1] << 1 ) ^ ( carry ? CMAC_RB : 0 ) );
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- LINKER WRAPPED FUNCTIONS ------------------------------------------------
+ */
+
+extern "C" return_type __real_aes_encrypt( const uint8_t in[N_BLOCK], uint8_t out[N_BLOCK], const aes_context ctx[1] );
+
+extern "C" return_type __wrap_aes_encrypt( const uint8_t in[N_BLOCK], uint8_t out[N_BLOCK], const aes_context ctx[1] )
+{
+    // An AES key schedule starts with the key itself
+    if( ( backend == LBM_CRYPTO_BACKEND_HARDWARE ) && ( ctx->rnd == AES128_ROUNDS ) &&
+        ( hardware_encrypt( ctx->ksch, in, out ) == true ) )
+    {
+        return 0;
+    }
+    if( ( backend == LBM_CRYPTO_BACKEND_TABLE ) && ( ctx->rnd == AES128_ROUNDS ) )
+    {
+        table_encrypt( ctx->ksch, in, out );
+        return 0;
+    }
+    return __real_aes_encrypt( in, out, ctx );
+}
+
+/* --- EOF ------------------------------------------------------------------ */
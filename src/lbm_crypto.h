@@ -0,0 +1,138 @@
+/*!
+ * \file      lbm_crypto.h
+ *
+ * \brief     AES block backend of the soft secure element, and a streaming AES-CMAC
+ *
+ * Every operation of soft_se.c (join, MIC, payload encryption) ends up in aes_encrypt(), directly or through the
+ * CMAC of cmac.c. The call is intercepted at link time (-Wl,--wrap=aes_encrypt, see [basic_modem] in
+ * platformio.ini) and handed to the selected backend:
+ * - soft: the original byte-wise aes.c
+ * - hardware: the ESP32 AES peripheral
+ * - table: the 32-bit table AES of lbm_aes.cpp, for the boards without an AES peripheral (nRF52, RP2040, host)
+ * The hardware and table backends take the key from the start of the aes.c key schedule.
+ *
+ * lbm_crypto_init() checks the selected backend against FIPS-197 and RFC 4493 known answers before using it,
+ * and keeps the soft backend if one of them fails.
+ *
+ * lbm_crypto_cmac_*() compute an AES-CMAC over any number of pieces, e.g. the MIC of a LoRaWAN frame from the
+ * B0 block, the header and the payload where they are, without assembling them in one buffer first.
+ */
+
+#ifndef LBM_CRYPTO_H
+#define LBM_CRYPTO_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "smtc_modem_api.h"
+#include "lbm_aes.h"
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC TYPES ------------------------------------------------------------
+ */
+
+/**
+ * @brief AES block implementations
+ */
+typedef enum lbm_crypto_backend_e
+{
+    LBM_CRYPTO_BACKEND_SOFT,      //!< SWL2001 aes.c
+    LBM_CRYPTO_BACKEND_HARDWARE,  //!< ESP32 AES peripheral (ESP32 targets only)
+    LBM_CRYPTO_BACKEND_TABLE,     //!< 32-bit table AES of lbm_aes.cpp
+    LBM_CRYPTO_BACKEND_COUNT
+} lbm_crypto_backend_t;
+
+/**
+ * @brief Streaming AES-CMAC (RFC 4493)
+ */
+typedef struct lbm_crypto_cmac_s
+{
+    uint8_t           key[LBM_AES_KEY_SIZE];
+    lbm_aes_context_t table_key;                 //!< round keys, when the blocks run on the table AES
+    uint8_t           mac[LBM_AES_BLOCK_SIZE];   //!< CBC-MAC of the blocks processed so far
+    uint8_t           last[LBM_AES_BLOCK_SIZE];  //!< last block, kept until it is known to be the final one
+    uint8_t           last_size;
+} lbm_crypto_cmac_t;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC CONSTANTS --------------------------------------------------------
+ */
+
+/**
+ * @brief Backend selected by lbm_crypto_init()
+ */
+#ifndef LBM_CRYPTO_BACKEND
+#if defined( ESP32 ) && !defined( LBM_NATIVE )
+#define LBM_CRYPTO_BACKEND LBM_CRYPTO_BACKEND_HARDWARE
+#else
+#define LBM_CRYPTO_BACKEND LBM_CRYPTO_BACKEND_TABLE
+#endif
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS PROTOTYPES --------------------------------------------
+ */
+
+/**
+ * @brief Select LBM_CRYPTO_BACKEND once its known-answer tests pass, the soft backend otherwise
+ *
+ * Call before the modem is initialized.
+ */
+void lbm_crypto_init( void );
+
+/**
+ * @brief Switch backend
+ *
+ * @return SMTC_MODEM_RC_OK, SMTC_MODEM_RC_INVALID if the backend is not available or failed its self test
+ */
+smtc_modem_return_code_t lbm_crypto_set_backend( lbm_crypto_backend_t backend );
+
+/**
+ * @brief Backend in use
+ */
+lbm_crypto_backend_t lbm_crypto_get_backend( void );
+
+/**
+ * @brief Run the known-answer tests (FIPS-197 AES-128, RFC 4493 AES-CMAC) on a backend
+ *
+ * @return Number of failed vectors, -1 if the backend is not available
+ */
+int lbm_crypto_self_test( lbm_crypto_backend_t backend );
+
+/**
+ * @brief Start an AES-CMAC
+ *
+ * The blocks run on the hardware backend when it is selected, on the table AES otherwise.
+ */
+void lbm_crypto_cmac_init( lbm_crypto_cmac_t* context, const uint8_t key[LBM_AES_KEY_SIZE] );
+
+/**
+ * @brief Add a piece of the message, of any size
+ */
+void lbm_crypto_cmac_update( lbm_crypto_cmac_t* context, const uint8_t* data, uint32_t size );
+
+/**
+ * @brief Finish the AES-CMAC
+ *
+ * @param [out] mac 16-byte CMAC, a LoRaWAN MIC is its first 4 bytes (little endian)
+ */
+void lbm_crypto_cmac_final( lbm_crypto_cmac_t* context, uint8_t mac[LBM_AES_BLOCK_SIZE] );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // LBM_CRYPTO_H
+
+/* --- EOF ------------------------------------------------------------------ */
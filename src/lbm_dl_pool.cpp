@@ -0,0 +1,154 @@
+/*!
+ * \file      lbm_dl_pool.cpp
+ *
+ * \brief     Fixed pool of downlink buffers lent to the application
+ */
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <atomic>
+
+#include "lbm_dl_pool.h"
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE CONSTANTS -------------------------------------------------------
+ */
+
+#if( LBM_DL_POOL_SIZE < 1 ) || ( LBM_DL_POOL_SIZE > 32 )
+#error "LBM_DL_POOL_SIZE must be between 1 and 32"
+#endif
+
+#define ALL_FREE ( ( LBM_DL_POOL_SIZE == 32 ) ? 0xFFFFFFFFUL : ( ( 1UL << LBM_DL_POOL_SIZE ) - 1 ) )
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE VARIABLES -------------------------------------------------------
+ */
+
+static lbm_dl_buffer_t pool[LBM_DL_POOL_SIZE];
+
+// Engine context only: where a downlink is read and dropped when no buffer is free
+static lbm_dl_buffer_t scratch;
+
+// Bit n set: pool[n] is free
+static std::atomic<uint32_t> free_mask( ALL_FREE );
+
+static uint32_t              peak_in_use     = 0;
+static uint32_t              acquired        = 0;
+static uint32_t              exhausted       = 0;
+static std::atomic<uint32_t> released( 0 );
+static std::atomic<uint32_t> invalid_release( 0 );
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DECLARATION -------------------------------------------
+ */
+
+static uint32_t count_in_use( uint32_t mask );
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS DEFINITION ---------------------------------------------
+ */
+
+lbm_dl_buffer_t* lbm_dl_pool_read_downlink( void )
+{
+    // Claim the lowest free buffer
+    uint32_t mask = free_mask.load( std::memory_order_acquire );
+    uint32_t bit;
+    do
+    {
+        if( mask == 0 )
+        {
+            // Left in the modem, the frame would reach the application after later ones, or not at all
+            if( smtc_modem_get_downlink_data( scratch.data, &scratch.size, &scratch.metadata, &scratch.remaining ) ==
+                SMTC_MODEM_RC_OK )
+            {
+                exhausted++;
+            }
+            return nullptr;
+        }
+        bit = mask & ( ~mask + 1 );
+    } while( free_mask.compare_exchange_weak( mask, mask & ~bit, std::memory_order_acq_rel,
+                                              std::memory_order_acquire ) == false );
+
+    lbm_dl_buffer_t* buffer = &pool[__builtin_ctz( bit )];
+
+    if( smtc_modem_get_downlink_data( buffer->data, &buffer->size, &buffer->metadata, &buffer->remaining ) !=
+        SMTC_MODEM_RC_OK )
+    {
+        free_mask.fetch_or( bit, std::memory_order_release );
+        return nullptr;
+    }
+    buffer->payload = buffer->data;
+
+    acquired++;
+    const uint32_t in_use = count_in_use( mask & ~bit );
+    if( in_use > peak_in_use )
+    {
+        peak_in_use = in_use;
+    }
+    return buffer;
+}
+
+void lbm_dl_pool_release( lbm_dl_buffer_t* buffer )
+{
+    if( buffer == nullptr )
+    {
+        return;
+    }
+
+    const uintptr_t offset = ( uintptr_t ) buffer - ( uintptr_t ) &pool[0];
+    const uint32_t  index  = ( uint32_t ) ( offset / sizeof( lbm_dl_buffer_t ) );
+    if( ( ( uintptr_t ) buffer < ( uintptr_t ) &pool[0] ) || ( index >= LBM_DL_POOL_SIZE ) ||
+        ( &pool[index] != buffer ) )
+    {
+        invalid_release++;
+        return;
+    }
+
+    const uint32_t bit = 1UL << index;
+    if( ( free_mask.fetch_or( bit, std::memory_order_release ) & bit ) != 0 )
+    {
+        // Double release
+        invalid_release++;
+        return;
+    }
+    released++;
+}
+
+void lbm_dl_pool_get_stats( lbm_dl_pool_stats_t* stats )
+{
+    stats->capacity        = LBM_DL_POOL_SIZE;
+    stats->in_use          = count_in_use( free_mask.load( std::memory_order_acquire ) );
+    stats->peak_in_use     = peak_in_use;
+    stats->acquired        = acquired;
+    stats->released        = released.load( );
+    stats->exhausted       = exhausted;
+    stats->invalid_release = invalid_release.load( );
+}
+
+void lbm_dl_pool_reset_stats( void )
+{
+    peak_in_use = count_in_use( free_mask.load( std::memory_order_acquire ) );
+    acquired    = 0;
+    exhausted   = 0;
+    released.store( 0 );
+    invalid_release.store( 0 );
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DEFINITION --------------------------------------------
+ */
+
+static uint32_t count_in_use( uint32_t mask )
+{
+    return LBM_DL_POOL_SIZE - ( uint32_t ) __builtin_popcount( mask );
+}
+
+/* --- EOF ------------------------------------------------------------------ */
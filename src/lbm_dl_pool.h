@@ -0,0 +1,107 @@
+/*!
+ * \file      lbm_dl_pool.h
+ *
+ * \brief     Fixed pool of downlink buffers lent to the application
+ *
+ * The engine reads each downlink once, straight from the modem into a free pool buffer, and the application
+ * borrows that buffer (payload pointer, size, metadata) until it releases it. RAM use is fixed at build time,
+ * which bounds what a burst of Class C / multicast downlinks can take: with every buffer lent, the next downlink
+ * is still read out of the modem, then dropped and counted.
+ *
+ * Acquire is done by the engine, release by any task: the free list is a lock-free bitmask.
+ */
+
+#ifndef LBM_DL_POOL_H
+#define LBM_DL_POOL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "smtc_modem_api.h"
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC CONSTANTS --------------------------------------------------------
+ */
+
+/**
+ * @brief Number of downlink buffers (at most 32)
+ */
+#ifndef LBM_DL_POOL_SIZE
+#define LBM_DL_POOL_SIZE 4
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC TYPES ------------------------------------------------------------
+ */
+
+/**
+ * @brief Borrowed downlink, valid until lbm_dl_pool_release()
+ */
+typedef struct lbm_dl_buffer_s
+{
+    const uint8_t*           payload;    //!< points to data[]
+    uint8_t                  size;       //!< payload size in bytes
+    uint8_t                  remaining;  //!< downlinks still waiting in the modem when this one was read
+    smtc_modem_dl_metadata_t metadata;
+    uint8_t                  data[SMTC_MODEM_MAX_LORAWAN_PAYLOAD_LENGTH];
+} lbm_dl_buffer_t;
+
+/**
+ * @brief Pool counters
+ */
+typedef struct lbm_dl_pool_stats_s
+{
+    uint32_t capacity;         //!< LBM_DL_POOL_SIZE
+    uint32_t in_use;           //!< buffers currently lent
+    uint32_t peak_in_use;      //!< highest in_use seen
+    uint32_t acquired;         //!< downlinks read into the pool
+    uint32_t released;
+    uint32_t exhausted;        //!< downlinks dropped because no buffer was free
+    uint32_t invalid_release;  //!< release of a pointer not lent by the pool (ignored)
+} lbm_dl_pool_stats_t;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS PROTOTYPES --------------------------------------------
+ */
+
+/**
+ * @brief Read the next downlink from the modem into a free buffer (engine context)
+ *
+ * @return The filled buffer, NULL if the modem had no downlink, or if the pool is exhausted (the downlink is
+ *         dropped)
+ */
+lbm_dl_buffer_t* lbm_dl_pool_read_downlink( void );
+
+/**
+ * @brief Give a buffer back to the pool (any task, NULL is ignored)
+ */
+void lbm_dl_pool_release( lbm_dl_buffer_t* buffer );
+
+/**
+ * @brief Read the counters
+ */
+void lbm_dl_pool_get_stats( lbm_dl_pool_stats_t* stats );
+
+/**
+ * @brief Clear the counters (buffers in use stay lent)
+ */
+void lbm_dl_pool_reset_stats( void );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // LBM_DL_POOL_H
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,411 @@
+/*!
+ * \file      lbm_energy.cpp
+ *
+ * \brief     Charge and energy model: time and µAh per radio and MCU state, per uplink and per day
+ */
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <string.h>
+
+#include "lbm_energy.h"
+#include "lbm_core.h"
+#include "variant.h"
+
+extern "C" {
+#include "smtc_modem_hal.h"
+}
+
+#if !defined( LBM_NATIVE )
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+#else
+extern "C" {
+#include "sim_clock.h"
+}
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE CONSTANTS -------------------------------------------------------
+ */
+
+// Boards without a table in their variant header: SX1262 datasheet values, MCU not modelled
+#ifndef LBM_ENERGY_TX_TABLE
+#define LBM_ENERGY_TX_TABLE { { 22, 118000.0f }, { 14, 45000.0f }, { 0, 20000.0f } }
+#endif
+#ifndef LBM_ENERGY_RX_UA
+#define LBM_ENERGY_RX_UA 4600.0f
+#endif
+#ifndef LBM_ENERGY_CAD_UA
+#define LBM_ENERGY_CAD_UA LBM_ENERGY_RX_UA
+#endif
+#ifndef LBM_ENERGY_STANDBY_UA
+#define LBM_ENERGY_STANDBY_UA 600.0f
+#endif
+#ifndef LBM_ENERGY_SLEEP_UA
+#define LBM_ENERGY_SLEEP_UA 0.6f
+#endif
+#ifndef LBM_ENERGY_MCU_ACTIVE_UA
+#define LBM_ENERGY_MCU_ACTIVE_UA 0.0f
+#endif
+#ifndef LBM_ENERGY_MCU_IDLE_UA
+#define LBM_ENERGY_MCU_IDLE_UA 0.0f
+#endif
+#ifndef LBM_ENERGY_MCU_SLEEP_UA
+#define LBM_ENERGY_MCU_SLEEP_UA 0.0f
+#endif
+#ifndef LBM_ENERGY_BOARD_UA
+#define LBM_ENERGY_BOARD_UA 0.0f
+#endif
+#ifndef LBM_ENERGY_SUPPLY_MV
+#define LBM_ENERGY_SUPPLY_MV 3300
+#endif
+
+#define US_PER_HOUR 3600000000.0
+#define US_PER_DAY 86400000000.0
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE MACROS ----------------------------------------------------------
+ */
+
+// The engine task drives the radio and waits while the application reads the counters
+static lbm_critical_t energy_lock = LBM_CRITICAL_INITIALIZER;
+#define ENERGY_LOCK( ) LBM_CRITICAL_ENTER( &energy_lock )
+#define ENERGY_UNLOCK( ) LBM_CRITICAL_EXIT( &energy_lock )
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE VARIABLES -------------------------------------------------------
+ */
+
+static const lbm_energy_tx_point_t board_tx[] = LBM_ENERGY_TX_TABLE;
+
+static const lbm_energy_profile_t board_profile = {
+    LBM_ENERGY_TX_TABLE,
+    ( uint8_t ) ( sizeof( board_tx ) / sizeof( board_tx[0] ) ),
+    LBM_ENERGY_RX_UA,
+    LBM_ENERGY_CAD_UA,
+    LBM_ENERGY_STANDBY_UA,
+    LBM_ENERGY_SLEEP_UA,
+    LBM_ENERGY_MCU_ACTIVE_UA,
+    LBM_ENERGY_MCU_IDLE_UA,
+    LBM_ENERGY_MCU_SLEEP_UA,
+    LBM_ENERGY_BOARD_UA,
+    LBM_ENERGY_SUPPLY_MV,
+};
+
+static lbm_energy_profile_t profile = board_profile;
+
+// The chip starts in STDBY_RC, the MCU runs
+static lbm_energy_radio_t radio_state     = LBM_ENERGY_RADIO_STANDBY;
+static lbm_energy_mcu_t   mcu_state       = LBM_ENERGY_MCU_ACTIVE;
+static uint64_t           radio_since_us  = 0;
+static uint64_t           mcu_since_us    = 0;
+static uint64_t           stats_start_us  = 0;
+static int8_t             tx_power_dbm    = 14;  // last output power configured
+static int                tx_level        = -1;  // level of the transmission in progress
+
+static uint64_t              radio_us[LBM_ENERGY_RADIO_CAD + 1];
+static uint64_t              mcu_us[LBM_ENERGY_MCU_SLEEP + 1];
+static lbm_energy_tx_level_t tx_levels[LBM_ENERGY_TX_LEVELS];
+static uint8_t               tx_level_count = 0;
+static uint32_t              transmissions  = 0;
+static uint32_t              rx_windows     = 0;
+static uint32_t              cads           = 0;
+
+// Uplinks, radio charge at the end of the previous one
+static uint32_t uplinks          = 0;
+static double   uplink_mark_uah  = 0.0;
+static double   last_uplink_uah  = 0.0;
+static double   max_uplink_uah   = 0.0;
+static double   total_uplink_uah = 0.0;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DECLARATION -------------------------------------------
+ */
+
+static uint64_t now_us( void );
+
+/**
+ * @brief Add the time spent in the current states up to now
+ */
+static void settle( uint64_t now );
+
+/**
+ * @brief Counters of an output power, the last one once the table is full
+ */
+static int level_of( int8_t power_dbm );
+
+static double charge_uah( uint64_t time_us, float current_ua );
+
+/**
+ * @brief Charge of the radio TX, RX and CAD time so far
+ */
+static double radio_active_uah( void );
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS DEFINITION ---------------------------------------------
+ */
+
+void lbm_energy_set_profile( const lbm_energy_profile_t* new_profile )
+{
+    ENERGY_LOCK( );
+    profile = ( new_profile != NULL ) ? *new_profile : board_profile;
+    if( profile.tx_points > LBM_ENERGY_TX_POINTS )
+    {
+        profile.tx_points = LBM_ENERGY_TX_POINTS;
+    }
+    ENERGY_UNLOCK( );
+}
+
+void lbm_energy_get_profile( lbm_energy_profile_t* out )
+{
+    ENERGY_LOCK( );
+    *out = profile;
+    ENERGY_UNLOCK( );
+}
+
+float lbm_energy_tx_current_ua( const lbm_energy_profile_t* p, int8_t power_dbm )
+{
+    if( p->tx_points == 0 )
+    {
+        return 0.0f;
+    }
+    if( power_dbm >= p->tx[0].power_dbm )
+    {
+        return p->tx[0].current_ua;
+    }
+    for( uint8_t i = 1; i < p->tx_points; i++ )
+    {
+        const lbm_energy_tx_point_t* high = &p->tx[i - 1];
+        const lbm_energy_tx_point_t* low  = &p->tx[i];
+        if( power_dbm >= low->power_dbm )
+        {
+            const float span = ( float ) ( high->power_dbm - low->power_dbm );
+            return low->current_ua + ( ( high->current_ua - low->current_ua ) * ( float ) ( power_dbm - low->power_dbm ) /
+                                       ( ( span > 0.0f ) ? span : 1.0f ) );
+        }
+    }
+    return p->tx[p->tx_points - 1].current_ua;
+}
+
+void lbm_energy_on_tx_power( int8_t power_dbm )
+{
+    // The output power asked for: the PA settings behind it are the driver's business
+    tx_power_dbm = power_dbm;
+}
+
+void lbm_energy_on_radio( lbm_energy_radio_t state )
+{
+    ENERGY_LOCK( );
+    settle( now_us( ) );
+    tx_level = -1;
+    switch( state )
+    {
+    case LBM_ENERGY_RADIO_TX:
+        transmissions++;
+        tx_level = level_of( tx_power_dbm );
+        tx_levels[tx_level].transmissions++;
+        break;
+    case LBM_ENERGY_RADIO_RX:
+        rx_windows++;
+        break;
+    case LBM_ENERGY_RADIO_CAD:
+        cads++;
+        break;
+    default:
+        break;
+    }
+    radio_state = state;
+    ENERGY_UNLOCK( );
+}
+
+void lbm_energy_on_mcu( lbm_energy_mcu_t state )
+{
+    ENERGY_LOCK( );
+    settle( now_us( ) );
+    mcu_state = state;
+    ENERGY_UNLOCK( );
+}
+
+void lbm_energy_on_event( const smtc_modem_event_t* event )
+{
+    if( ( event->event_type != SMTC_MODEM_EVENT_TXDONE ) && ( event->event_type != SMTC_MODEM_EVENT_JOINED ) &&
+        ( event->event_type != SMTC_MODEM_EVENT_JOINFAIL ) )
+    {
+        return;
+    }
+
+    ENERGY_LOCK( );
+    settle( now_us( ) );
+    const double radio_uah = radio_active_uah( );
+    if( event->event_type == SMTC_MODEM_EVENT_TXDONE )
+    {
+        last_uplink_uah = radio_uah - uplink_mark_uah;
+        total_uplink_uah += last_uplink_uah;
+        if( last_uplink_uah > max_uplink_uah )
+        {
+            max_uplink_uah = last_uplink_uah;
+        }
+        uplinks++;
+    }
+    // Joining is not billed to the first uplink
+    uplink_mark_uah = radio_uah;
+    ENERGY_UNLOCK( );
+}
+
+void lbm_energy_get_stats( lbm_energy_stats_t* stats )
+{
+    lbm_energy_profile_t p;
+
+    memset( stats, 0, sizeof( *stats ) );
+    ENERGY_LOCK( );
+    const uint64_t now = now_us( );
+    settle( now );
+    p                     = profile;
+    stats->elapsed_us     = now - stats_start_us;
+    stats->transmissions  = transmissions;
+    stats->rx_windows     = rx_windows;
+    stats->cads           = cads;
+    stats->tx_level_count = tx_level_count;
+    memcpy( stats->radio_us, radio_us, sizeof( radio_us ) );
+    memcpy( stats->mcu_us, mcu_us, sizeof( mcu_us ) );
+    memcpy( stats->tx_levels, tx_levels, sizeof( tx_levels ) );
+    stats->uplinks         = uplinks;
+    stats->last_uplink_uah = ( float ) last_uplink_uah;
+    stats->max_uplink_uah  = ( float ) max_uplink_uah;
+    stats->avg_uplink_uah  = ( uplinks > 0 ) ? ( float ) ( total_uplink_uah / uplinks ) : 0.0f;
+    ENERGY_UNLOCK( );
+
+    double tx_uah = 0.0;
+    for( uint8_t i = 0; i < stats->tx_level_count; i++ )
+    {
+        lbm_energy_tx_level_t* level = &stats->tx_levels[i];
+        const double           uah = charge_uah( level->time_us, lbm_energy_tx_current_ua( &p, level->power_dbm ) );
+        level->charge_uah          = ( float ) uah;
+        tx_uah += uah;
+    }
+    const float radio_ua[] = { p.sleep_ua, p.standby_ua, 0.0f, p.rx_ua, p.cad_ua };
+    const float mcu_ua[]   = { p.mcu_active_ua, p.mcu_idle_ua, p.mcu_sleep_ua };
+
+    double total = 0.0;
+    for( int i = 0; i <= LBM_ENERGY_RADIO_CAD; i++ )
+    {
+        const double uah     = ( i == LBM_ENERGY_RADIO_TX ) ? tx_uah : charge_uah( stats->radio_us[i], radio_ua[i] );
+        stats->radio_uah[i] = ( float ) uah;
+        total += uah;
+    }
+    for( int i = 0; i <= LBM_ENERGY_MCU_SLEEP; i++ )
+    {
+        const double uah  = charge_uah( stats->mcu_us[i], mcu_ua[i] );
+        stats->mcu_uah[i] = ( float ) uah;
+        total += uah;
+    }
+    const double board = charge_uah( stats->elapsed_us, p.board_ua );
+    stats->board_uah   = ( float ) board;
+    total += board;
+
+    stats->total_uah = ( float ) total;
+    stats->total_mwh = ( float ) ( total * p.supply_mv / 1e6 );
+    if( stats->elapsed_us > 0 )
+    {
+        stats->average_ua  = ( float ) ( total * US_PER_HOUR / ( double ) stats->elapsed_us );
+        stats->uah_per_day = ( float ) ( total * US_PER_DAY / ( double ) stats->elapsed_us );
+    }
+    stats->uah_per_uplink = ( stats->uplinks > 0 ) ? ( float ) ( total / stats->uplinks ) : 0.0f;
+}
+
+void lbm_energy_reset_stats( void )
+{
+    ENERGY_LOCK( );
+    const uint64_t now = now_us( );
+    settle( now );
+    memset( radio_us, 0, sizeof( radio_us ) );
+    memset( mcu_us, 0, sizeof( mcu_us ) );
+    memset( tx_levels, 0, sizeof( tx_levels ) );
+    tx_level_count   = 0;
+    transmissions    = 0;
+    rx_windows       = 0;
+    cads             = 0;
+    uplinks          = 0;
+    uplink_mark_uah  = 0.0;
+    last_uplink_uah  = 0.0;
+    max_uplink_uah   = 0.0;
+    total_uplink_uah = 0.0;
+    stats_start_us   = now;
+    if( radio_state == LBM_ENERGY_RADIO_TX )
+    {
+        tx_level = level_of( tx_power_dbm );
+    }
+    ENERGY_UNLOCK( );
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DEFINITION --------------------------------------------
+ */
+
+static uint64_t now_us( void )
+{
+#if !defined( LBM_NATIVE )
+    return ( uint64_t ) esp_timer_get_time( );
+#else
+    return sim_clock_now_us( );
+#endif
+}
+
+static void settle( uint64_t now )
+{
+    const uint64_t radio_time = now - radio_since_us;
+    radio_us[radio_state] += radio_time;
+    if( tx_level >= 0 )
+    {
+        tx_levels[tx_level].time_us += radio_time;
+    }
+    radio_since_us = now;
+
+    mcu_us[mcu_state] += now - mcu_since_us;
+    mcu_since_us = now;
+}
+
+static int level_of( int8_t power_dbm )
+{
+    for( uint8_t i = 0; i < tx_level_count; i++ )
+    {
+        if( tx_levels[i].power_dbm == power_dbm )
+        {
+            return i;
+        }
+    }
+    if( tx_level_count == LBM_ENERGY_TX_LEVELS )
+    {
+        return LBM_ENERGY_TX_LEVELS - 1;
+    }
+    tx_levels[tx_level_count].power_dbm = power_dbm;
+    return tx_level_count++;
+}
+
+static double charge_uah( uint64_t time_us, float current_ua )
+{
+    return ( double ) time_us * ( double ) current_ua / US_PER_HOUR;
+}
+
+static double radio_active_uah( void )
+{
+    double uah = charge_uah( radio_us[LBM_ENERGY_RADIO_RX], profile.rx_ua ) +
+                 charge_uah( radio_us[LBM_ENERGY_RADIO_CAD], profile.cad_ua );
+    for( uint8_t i = 0; i < tx_level_count; i++ )
+    {
+        uah += charge_uah( tx_levels[i].time_us, lbm_energy_tx_current_ua( &profile, tx_levels[i].power_dbm ) );
+    }
+    return uah;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,194 @@
+/*!
+ * \file      lbm_energy.h
+ *
+ * \brief     Charge and energy model: time and µAh per radio and MCU state, per uplink and per day
+ *
+ * The time spent in each state is counted in µs and turned into charge with the supply currents of the board
+ * (lbm_energy_profile_t, filled from the LBM_ENERGY_* table of the variant header):
+ *
+ * - radio: TX at each output power, RX (receive windows and LBT listening), CAD, standby and sleep. A state runs
+ *   from the command that enters it to the next one, so the end of a TX or an RX window is the standby or sleep
+ *   command that follows its interrupt;
+ * - MCU: idle while the engine waits for its next deadline, light sleep in the low-power run mode, active the
+ *   rest of the time (modem engine and application).
+ *
+ * Each SMTC_MODEM_EVENT_TXDONE closes an uplink: its cost is the radio charge since the previous one (every
+ * transmission of it and its RX windows). The total charge divided by the uplinks, sleep included, is the cost of
+ * a message; scaled to 24 h it is the daily budget. Both compare data rates, NbTrans or classes directly.
+ *
+ * Charges are computed when read, with the profile in use then. The radio is observed through the sx126x and ral
+ * driver wraps of lbm_radio_hooks.cpp.
+ */
+
+#ifndef LBM_ENERGY_H
+#define LBM_ENERGY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "smtc_modem_api.h"
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC CONSTANTS --------------------------------------------------------
+ */
+
+/**
+ * @brief Points of the TX current table, interpolated between them
+ */
+#define LBM_ENERGY_TX_POINTS 8
+
+/**
+ * @brief Output powers counted apart, the next ones go with the last
+ */
+#define LBM_ENERGY_TX_LEVELS 8
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC TYPES ------------------------------------------------------------
+ */
+
+/**
+ * @brief Radio states
+ */
+typedef enum lbm_energy_radio_e
+{
+    LBM_ENERGY_RADIO_SLEEP,
+    LBM_ENERGY_RADIO_STANDBY,
+    LBM_ENERGY_RADIO_TX,
+    LBM_ENERGY_RADIO_RX,
+    LBM_ENERGY_RADIO_CAD,
+} lbm_energy_radio_t;
+
+/**
+ * @brief MCU states
+ */
+typedef enum lbm_energy_mcu_e
+{
+    LBM_ENERGY_MCU_ACTIVE,
+    LBM_ENERGY_MCU_IDLE,   //!< engine blocked on its notification, clocks running
+    LBM_ENERGY_MCU_SLEEP,  //!< light sleep
+} lbm_energy_mcu_t;
+
+/**
+ * @brief Supply current at one output power
+ */
+typedef struct lbm_energy_tx_point_s
+{
+    int8_t power_dbm;
+    float  current_ua;
+} lbm_energy_tx_point_t;
+
+/**
+ * @brief Supply currents of the board
+ */
+typedef struct lbm_energy_profile_s
+{
+    lbm_energy_tx_point_t tx[LBM_ENERGY_TX_POINTS];  //!< by decreasing power
+    uint8_t               tx_points;
+    float                 rx_ua;
+    float                 cad_ua;
+    float                 standby_ua;
+    float                 sleep_ua;          //!< radio sleep, warm start
+    float                 mcu_active_ua;
+    float                 mcu_idle_ua;
+    float                 mcu_sleep_ua;
+    float                 board_ua;          //!< always drawn (regulator, sensors)
+    uint16_t              supply_mv;         //!< to turn charge into energy
+} lbm_energy_profile_t;
+
+/**
+ * @brief Time and charge at one output power
+ */
+typedef struct lbm_energy_tx_level_s
+{
+    int8_t   power_dbm;
+    uint32_t transmissions;
+    uint64_t time_us;
+    float    charge_uah;
+} lbm_energy_tx_level_t;
+
+/**
+ * @brief Energy counters
+ */
+typedef struct lbm_energy_stats_s
+{
+    uint64_t              elapsed_us;
+    uint32_t              transmissions;
+    uint32_t              rx_windows;
+    uint32_t              cads;
+    uint64_t              radio_us[LBM_ENERGY_RADIO_CAD + 1];   //!< per lbm_energy_radio_t
+    float                 radio_uah[LBM_ENERGY_RADIO_CAD + 1];
+    uint64_t              mcu_us[LBM_ENERGY_MCU_SLEEP + 1];     //!< per lbm_energy_mcu_t
+    float                 mcu_uah[LBM_ENERGY_MCU_SLEEP + 1];
+    lbm_energy_tx_level_t tx_levels[LBM_ENERGY_TX_LEVELS];
+    uint8_t               tx_level_count;
+    float                 board_uah;
+    float                 total_uah;
+    float                 total_mwh;
+    float                 average_ua;
+    uint32_t              uplinks;             //!< TXDONE events
+    float                 last_uplink_uah;     //!< radio charge of the last uplink, its repetitions and RX windows
+    float                 max_uplink_uah;
+    float                 avg_uplink_uah;
+    float                 uah_per_uplink;      //!< total charge / uplinks: sleep between them included
+    float                 uah_per_day;         //!< total charge scaled to 24 h
+} lbm_energy_stats_t;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS PROTOTYPES --------------------------------------------
+ */
+
+/**
+ * @brief Replace the supply currents, NULL for those of the board
+ */
+void lbm_energy_set_profile( const lbm_energy_profile_t* profile );
+void lbm_energy_get_profile( lbm_energy_profile_t* profile );
+
+/**
+ * @brief Supply current at an output power, interpolated in the TX table
+ */
+float lbm_energy_tx_current_ua( const lbm_energy_profile_t* profile, int8_t power_dbm );
+
+/**
+ * @brief Output power of the next transmissions (ral_sx126x_set_tx_cfg)
+ */
+void lbm_energy_on_tx_power( int8_t power_dbm );
+
+/**
+ * @brief The radio enters a state (sx126x driver wraps)
+ */
+void lbm_energy_on_radio( lbm_energy_radio_t state );
+
+/**
+ * @brief The MCU enters a state (engine wait and light sleep)
+ */
+void lbm_energy_on_mcu( lbm_energy_mcu_t state );
+
+/**
+ * @brief Close an uplink on SMTC_MODEM_EVENT_TXDONE (engine context)
+ */
+void lbm_energy_on_event( const smtc_modem_event_t* event );
+
+/**
+ * @brief Read / clear the counters (the current states are kept)
+ */
+void lbm_energy_get_stats( lbm_energy_stats_t* stats );
+void lbm_energy_reset_stats( void );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // LBM_ENERGY_H
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,172 @@
+/*!
+ * \file      lbm_engine.cpp
+ *
+ * \brief     Event-driven runner for smtc_modem_run_engine()
+ */
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include "lbm_engine.h"
+#include "lbm_class_b.h"
+#include "lbm_energy.h"
+#include "lbm_nvm.h"
+#include "lbm_p2p.h"
+#include "lbm_profile.h"
+
+#include "smtc_modem_api.h"
+#include "smtc_modem_hal.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE VARIABLES -------------------------------------------------------
+ */
+
+static TaskHandle_t volatile engine_task = nullptr;  // Task blocked in lbm_engine_run_until_event()
+
+static uint32_t stats_start_ms     = 0;
+static uint32_t wakeups            = 0;
+static uint32_t wakeups_on_notify  = 0;
+static uint32_t wakeups_on_timeout = 0;
+static uint32_t idle_time_ms       = 0;
+static uint32_t last_sleep_time_ms = 0;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS DEFINITION ---------------------------------------------
+ */
+
+uint32_t lbm_engine_run( void )
+{
+    // P2P frames queued and receive requested by the application become planner tasks
+    lbm_p2p_process( );
+    // Time requests decided by the class B tracker while the radio was driven
+    lbm_class_b_process( );
+    LBM_PROFILE_BEGIN( );
+    last_sleep_time_ms = smtc_modem_run_engine( );
+    LBM_PROFILE_END( LBM_PROFILE_ENGINE );
+    wakeups++;
+    if( last_sleep_time_ms >= LBM_NVM_IDLE_MS )
+    {
+        // Nothing due for a while: flash writes will not delay the radio
+        lbm_nvm_idle( );
+    }
+    return last_sleep_time_ms;
+}
+
+uint32_t lbm_engine_run_until_event( uint32_t max_wait_ms )
+{
+    uint32_t wait_ms = lbm_engine_run( );
+    if( wait_ms > max_wait_ms )
+    {
+        wait_ms = max_wait_ms;
+    }
+    return lbm_engine_wait( wait_ms );
+}
+
+uint32_t lbm_engine_wait( uint32_t wait_ms )
+{
+    engine_task = xTaskGetCurrentTaskHandle( );
+
+    if( wait_ms == 0 )
+    {
+        return 0;
+    }
+
+    const TickType_t ticks    = ( wait_ms == LBM_ENGINE_WAIT_FOREVER ) ? portMAX_DELAY : pdMS_TO_TICKS( wait_ms );
+    const uint32_t   start_ms = smtc_modem_hal_get_time_in_ms( );
+
+    lbm_energy_on_mcu( LBM_ENERGY_MCU_IDLE );
+    if( ulTaskNotifyTake( pdTRUE, ticks ) != 0 )
+    {
+        wakeups_on_notify++;
+    }
+    else
+    {
+        wakeups_on_timeout++;
+    }
+    lbm_energy_on_mcu( LBM_ENERGY_MCU_ACTIVE );
+
+    const uint32_t slept_ms = smtc_modem_hal_get_time_in_ms( ) - start_ms;
+    idle_time_ms += slept_ms;
+    return slept_ms;
+}
+
+bool lbm_engine_take_notification( void )
+{
+    engine_task = xTaskGetCurrentTaskHandle( );
+    return ulTaskNotifyTake( pdTRUE, 0 ) != 0;
+}
+
+void lbm_engine_notify( void )
+{
+    TaskHandle_t task = engine_task;
+    if( task == nullptr )
+    {
+        // Polling mode, nobody to wake up
+        return;
+    }
+
+    if( xPortInIsrContext( ) )
+    {
+        BaseType_t higher_priority_task_woken = pdFALSE;
+        vTaskNotifyGiveFromISR( task, &higher_priority_task_woken );
+        portYIELD_FROM_ISR( higher_priority_task_woken );
+    }
+    else
+    {
+        xTaskNotifyGive( task );
+    }
+}
+
+void lbm_engine_get_stats( lbm_engine_stats_t* stats )
+{
+    stats->wakeups            = wakeups;
+    stats->wakeups_on_notify  = wakeups_on_notify;
+    stats->wakeups_on_timeout = wakeups_on_timeout;
+    stats->idle_time_ms       = idle_time_ms;
+    stats->elapsed_ms         = smtc_modem_hal_get_time_in_ms( ) - stats_start_ms;
+    stats->last_sleep_time_ms = last_sleep_time_ms;
+
+    if( stats->elapsed_ms > 0 )
+    {
+        stats->wakeups_per_s = ( float ) wakeups * 1000.0f / ( float ) stats->elapsed_ms;
+        stats->idle_percent  = ( float ) idle_time_ms * 100.0f / ( float ) stats->elapsed_ms;
+    }
+    else
+    {
+        stats->wakeups_per_s = 0.0f;
+        stats->idle_percent  = 0.0f;
+    }
+}
+
+void lbm_engine_reset_stats( void )
+{
+    stats_start_ms     = smtc_modem_hal_get_time_in_ms( );
+    wakeups            = 0;
+    wakeups_on_notify  = 0;
+    wakeups_on_timeout = 0;
+    idle_time_ms       = 0;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- LINKER WRAPPED FUNCTIONS ------------------------------------------------
+ */
+
+// The modem calls smtc_modem_hal_user_lbm_irq() from its radio and timer irq handlers. The board HAL already
+// provides it, so the call is intercepted with -Wl,--wrap (see [basic_modem] in platformio.ini).
+extern "C" void __real_smtc_modem_hal_user_lbm_irq( void );
+
+extern "C" void __wrap_smtc_modem_hal_user_lbm_irq( void )
+{
+    __real_smtc_modem_hal_user_lbm_irq( );
+    lbm_engine_notify( );
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,118 @@
+/*!
+ * \file      lbm_engine.h
+ *
+ * \brief     Event-driven runner for smtc_modem_run_engine()
+ *
+ * Instead of polling the modem every few milliseconds, the runner blocks the calling FreeRTOS task on a task
+ * notification. The notification is given by the radio / timer irq (through smtc_modem_hal_user_lbm_irq) and by
+ * the API calls that queue work for the modem; otherwise the task sleeps until the deadline returned by
+ * smtc_modem_run_engine().
+ */
+
+#ifndef LBM_ENGINE_H
+#define LBM_ENGINE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC CONSTANTS --------------------------------------------------------
+ */
+
+/**
+ * @brief Maximum wait value: only the modem deadline or a notification ends the wait
+ */
+#define LBM_ENGINE_WAIT_FOREVER 0xFFFFFFFFUL
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC TYPES ------------------------------------------------------------
+ */
+
+/**
+ * @brief Engine runner counters
+ */
+typedef struct lbm_engine_stats_s
+{
+    uint32_t wakeups;             //!< smtc_modem_run_engine() calls
+    uint32_t wakeups_on_notify;   //!< waits ended by an irq or an API call
+    uint32_t wakeups_on_timeout;  //!< waits ended by the modem deadline or the caller's max wait
+    uint32_t idle_time_ms;        //!< time spent blocked in lbm_engine_run_until_event()
+    uint32_t elapsed_ms;          //!< time covered by the counters
+    uint32_t last_sleep_time_ms;  //!< last value returned by smtc_modem_run_engine()
+    float    wakeups_per_s;       //!< wakeups / elapsed time
+    float    idle_percent;        //!< idle_time_ms / elapsed_ms
+} lbm_engine_stats_t;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS PROTOTYPES --------------------------------------------
+ */
+
+/**
+ * @brief Run the modem engine once (polling mode)
+ *
+ * @return Time in ms before the modem needs to run again
+ */
+uint32_t lbm_engine_run( void );
+
+/**
+ * @brief Run the modem engine, then block the calling task until there is work for it
+ *
+ * The wait ends on the first notification, on the modem deadline or after max_wait_ms, whichever comes first.
+ * Notifications given while the engine was running are not lost: the next wait returns immediately.
+ *
+ * @param [in] max_wait_ms Upper bound of the wait, LBM_ENGINE_WAIT_FOREVER for none
+ *
+ * @return Time in ms spent blocked
+ */
+uint32_t lbm_engine_run_until_event( uint32_t max_wait_ms );
+
+/**
+ * @brief Block the calling task until a notification or for wait_ms, whichever comes first
+ *
+ * @param [in] wait_ms Wait duration, LBM_ENGINE_WAIT_FOREVER for none
+ *
+ * @return Time in ms spent blocked
+ */
+uint32_t lbm_engine_wait( uint32_t wait_ms );
+
+/**
+ * @brief Consume the notifications given to the calling task without blocking
+ *
+ * @return true if the modem got work since the last wait
+ */
+bool lbm_engine_take_notification( void );
+
+/**
+ * @brief Wake up the task blocked in lbm_engine_run_until_event() (task or isr context)
+ */
+void lbm_engine_notify( void );
+
+/**
+ * @brief Read the counters
+ */
+void lbm_engine_get_stats( lbm_engine_stats_t* stats );
+
+/**
+ * @brief Clear the counters and restart the elapsed time
+ */
+void lbm_engine_reset_stats( void );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // LBM_ENGINE_H
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,293 @@
+/*!
+ * \file      lbm_event_bus.cpp
+ *
+ * \brief     Modem event subscribers: per-type masks, context pointers, priorities and dispatch time
+ */
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <string.h>
+
+#include "lbm_event_bus.h"
+#include "lbm_core.h"
+#include "lbm_log.h"
+
+#if defined( LBM_NATIVE )
+#include <time.h>
+#else
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE MACROS ----------------------------------------------------------
+ */
+
+// Applications subscribe from their own tasks while the engine dispatches
+static lbm_critical_t bus_lock = LBM_CRITICAL_INITIALIZER;
+#define BUS_LOCK( ) LBM_CRITICAL_ENTER( &bus_lock )
+#define BUS_UNLOCK( ) LBM_CRITICAL_EXIT( &bus_lock )
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE TYPES -----------------------------------------------------------
+ */
+
+typedef struct subscriber_s
+{
+    lbm_event_subscription_t     subscription;  //!< LBM_EVENT_BUS_NO_SUBSCRIPTION: free
+    lbm_event_handler_t          handler;
+    void*                        context;
+    uint32_t                     mask;
+    uint8_t                      priority;
+    lbm_event_subscriber_stats_t stats;
+} subscriber_t;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE VARIABLES -------------------------------------------------------
+ */
+
+// Subscribers stay in their slot; order[] lists the slots in use in dispatch order
+static subscriber_t             subscribers[LBM_EVENT_BUS_MAX_SUBSCRIBERS];
+static uint8_t                  order[LBM_EVENT_BUS_MAX_SUBSCRIBERS];
+static uint8_t                  count             = 0;
+static lbm_event_subscription_t last_subscription = LBM_EVENT_BUS_NO_SUBSCRIPTION;
+
+static uint32_t events     = 0;
+static uint32_t deliveries = 0;
+static uint32_t unmatched  = 0;
+static uint32_t table_full = 0;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DECLARATION -------------------------------------------
+ */
+
+/**
+ * @brief Position of a subscription in order[], count if unknown (lock held)
+ */
+static uint8_t find( lbm_event_subscription_t subscription );
+
+static uint64_t now_us( void );
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS DEFINITION ---------------------------------------------
+ */
+
+smtc_modem_return_code_t lbm_event_bus_subscribe( uint32_t mask, uint8_t priority, lbm_event_handler_t handler,
+                                                  void* context, lbm_event_subscription_t* subscription )
+{
+    *subscription = LBM_EVENT_BUS_NO_SUBSCRIPTION;
+    if( ( handler == nullptr ) || ( mask == 0 ) )
+    {
+        return SMTC_MODEM_RC_INVALID;
+    }
+
+    BUS_LOCK( );
+    uint8_t slot = 0;
+    while( ( slot < LBM_EVENT_BUS_MAX_SUBSCRIBERS ) &&
+           ( subscribers[slot].subscription != LBM_EVENT_BUS_NO_SUBSCRIPTION ) )
+    {
+        slot++;
+    }
+    if( slot == LBM_EVENT_BUS_MAX_SUBSCRIBERS )
+    {
+        table_full++;
+        BUS_UNLOCK( );
+        return SMTC_MODEM_RC_BUSY;
+    }
+    if( ++last_subscription == LBM_EVENT_BUS_NO_SUBSCRIPTION )
+    {
+        last_subscription++;
+    }
+
+    subscriber_t* s = &subscribers[slot];
+    memset( s, 0, sizeof( *s ) );
+    s->subscription = last_subscription;
+    s->handler      = handler;
+    s->context      = context;
+    s->mask         = mask;
+    s->priority     = priority;
+
+    // After the subscribers of the same or a higher priority
+    uint8_t position = count;
+    while( ( position > 0 ) && ( subscribers[order[position - 1]].priority < priority ) )
+    {
+        order[position] = order[position - 1];
+        position--;
+    }
+    order[position] = slot;
+    count++;
+    *subscription = last_subscription;
+    BUS_UNLOCK( );
+    return SMTC_MODEM_RC_OK;
+}
+
+smtc_modem_return_code_t lbm_event_bus_unsubscribe( lbm_event_subscription_t subscription )
+{
+    BUS_LOCK( );
+    const uint8_t position = find( subscription );
+    if( position == count )
+    {
+        BUS_UNLOCK( );
+        return SMTC_MODEM_RC_INVALID;
+    }
+    subscribers[order[position]].subscription = LBM_EVENT_BUS_NO_SUBSCRIPTION;
+    memmove( &order[position], &order[position + 1], count - position - 1 );
+    count--;
+    BUS_UNLOCK( );
+    return SMTC_MODEM_RC_OK;
+}
+
+smtc_modem_return_code_t lbm_event_bus_set_mask( lbm_event_subscription_t subscription, uint32_t mask )
+{
+    BUS_LOCK( );
+    const uint8_t position = find( subscription );
+    if( ( position == count ) || ( mask == 0 ) )
+    {
+        BUS_UNLOCK( );
+        return SMTC_MODEM_RC_INVALID;
+    }
+    subscribers[order[position]].mask = mask;
+    BUS_UNLOCK( );
+    return SMTC_MODEM_RC_OK;
+}
+
+void lbm_event_bus_dispatch( const smtc_modem_event_t* event, const lbm_dl_buffer_t* downlink )
+{
+    const uint32_t bit = ( event->event_type < 32 ) ? ( uint32_t ) LBM_EVENT_MASK( event->event_type ) : 0;
+
+    // Handlers may subscribe or unsubscribe: walk a copy of the order taken before the first call
+    uint8_t snapshot[LBM_EVENT_BUS_MAX_SUBSCRIBERS];
+    BUS_LOCK( );
+    const uint8_t nb = count;
+    memcpy( snapshot, order, nb );
+    events++;
+    BUS_UNLOCK( );
+
+    bool matched = false;
+    for( uint8_t i = 0; i < nb; i++ )
+    {
+        subscriber_t* s = &subscribers[snapshot[i]];
+        BUS_LOCK( );
+        const lbm_event_subscription_t subscription = s->subscription;
+        const lbm_event_handler_t      handler      = s->handler;
+        void* const                    context      = s->context;
+        const bool wanted = ( subscription != LBM_EVENT_BUS_NO_SUBSCRIPTION ) && ( ( s->mask & bit ) != 0 );
+        BUS_UNLOCK( );
+        if( wanted == false )
+        {
+            continue;
+        }
+
+        matched                 = true;
+        const uint64_t start_us = now_us( );
+        handler( event, downlink, context );
+        const uint32_t elapsed_us = ( uint32_t ) ( now_us( ) - start_us );
+
+        BUS_LOCK( );
+        deliveries++;
+        bool longest = false;
+        if( s->subscription == subscription )
+        {
+            lbm_event_subscriber_stats_t* st = &s->stats;
+            st->calls++;
+            st->total_us += elapsed_us;
+            if( elapsed_us > LBM_EVENT_BUS_SLOW_US )
+            {
+                st->slow_calls++;
+            }
+            if( elapsed_us > st->max_us )
+            {
+                st->max_us        = elapsed_us;
+                st->slowest_event = event->event_type;
+                longest           = true;
+            }
+        }
+        BUS_UNLOCK( );
+        if( ( longest == true ) && ( elapsed_us > LBM_EVENT_BUS_SLOW_US ) )
+        {
+            LBM_LOG_WARN( "Event bus: subscriber %u took %u us on event %u\n", subscription, elapsed_us,
+                          event->event_type );
+        }
+    }
+
+    if( matched == false )
+    {
+        BUS_LOCK( );
+        unmatched++;
+        BUS_UNLOCK( );
+    }
+}
+
+void lbm_event_bus_get_stats( lbm_event_bus_stats_t* stats )
+{
+    memset( stats, 0, sizeof( *stats ) );
+    BUS_LOCK( );
+    stats->events      = events;
+    stats->deliveries  = deliveries;
+    stats->unmatched   = unmatched;
+    stats->table_full  = table_full;
+    stats->subscribers = count;
+    for( uint8_t i = 0; i < count; i++ )
+    {
+        const subscriber_t*           s  = &subscribers[order[i]];
+        lbm_event_subscriber_stats_t* st = &stats->subscriber[i];
+        *st                              = s->stats;
+        st->subscription                 = s->subscription;
+        st->mask                         = s->mask;
+        st->priority                     = s->priority;
+        st->avg_us                       = ( st->calls > 0 ) ? ( uint32_t ) ( st->total_us / st->calls ) : 0;
+    }
+    BUS_UNLOCK( );
+}
+
+void lbm_event_bus_reset_stats( void )
+{
+    BUS_LOCK( );
+    events     = 0;
+    deliveries = 0;
+    unmatched  = 0;
+    table_full = 0;
+    for( uint8_t i = 0; i < LBM_EVENT_BUS_MAX_SUBSCRIBERS; i++ )
+    {
+        memset( &subscribers[i].stats, 0, sizeof( subscribers[i].stats ) );
+    }
+    BUS_UNLOCK( );
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DEFINITION --------------------------------------------
+ */
+
+static uint8_t find( lbm_event_subscription_t subscription )
+{
+    uint8_t position = 0;
+    while( ( position < count ) && ( ( subscription == LBM_EVENT_BUS_NO_SUBSCRIPTION ) ||
+                                     ( subscribers[order[position]].subscription != subscription ) ) )
+    {
+        position++;
+    }
+    return position;
+}
+
+static uint64_t now_us( void )
+{
+#if defined( LBM_NATIVE )
+    // Handlers run on the host CPU: wall time, the virtual clock only moves when the modem waits
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return ( uint64_t ) now.tv_sec * 1000000ULL + ( uint64_t ) now.tv_nsec / 1000;
+#else
+    return ( uint64_t ) esp_timer_get_time( );
+#endif
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,166 @@
+/*!
+ * \file      lbm_event_bus.h
+ *
+ * \brief     Modem event subscribers: per-type masks, context pointers, priorities and dispatch time
+ *
+ * The event callback of LBMApi is one function for the whole firmware. Here each component subscribes on its
+ * own with the event types it handles (a bitmask of SMTC_MODEM_EVENT_xxx), a context pointer handed back at
+ * each call and a priority. The table is sized at build time (LBM_EVENT_BUS_MAX_SUBSCRIBERS) and nothing is
+ * allocated. For each event, the dispatcher walks the subscribers by decreasing priority, subscription order
+ * among equals, and calls those whose mask holds the event type: one AND per subscriber.
+ *
+ * Subscribers run in the engine context, before the callbacks of LBMApi / LoRaWANClass and whether the event
+ * queue (useEventQueue()) is on or not. Every call is timed, so that a handler slow enough to delay the stack
+ * shows up in lbm_event_bus_get_stats() and, beyond LBM_EVENT_BUS_SLOW_US, in the log.
+ */
+
+#ifndef LBM_EVENT_BUS_H
+#define LBM_EVENT_BUS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "smtc_modem_api.h"
+#include "lbm_dl_pool.h"
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC CONSTANTS --------------------------------------------------------
+ */
+
+/**
+ * @brief Number of subscribers
+ */
+#ifndef LBM_EVENT_BUS_MAX_SUBSCRIBERS
+#define LBM_EVENT_BUS_MAX_SUBSCRIBERS 8
+#endif
+
+/**
+ * @brief Handler duration above which a call is counted as slow and logged when it is the longest so far
+ */
+#ifndef LBM_EVENT_BUS_SLOW_US
+#define LBM_EVENT_BUS_SLOW_US 1000
+#endif
+
+/**
+ * @brief Mask bit of one event type, e.g. LBM_EVENT_MASK( SMTC_MODEM_EVENT_TXDONE )
+ */
+#define LBM_EVENT_MASK( type ) ( 1UL << ( type ) )
+
+/**
+ * @brief Mask of every event type
+ */
+#define LBM_EVENT_MASK_ALL 0xFFFFFFFFUL
+
+/**
+ * @brief No subscription: lbm_event_bus_subscribe() failed
+ */
+#define LBM_EVENT_BUS_NO_SUBSCRIPTION 0
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC TYPES ------------------------------------------------------------
+ */
+
+/**
+ * @brief Subscription handle, never reused before the counter wraps
+ */
+typedef uint32_t lbm_event_subscription_t;
+
+/**
+ * @brief Event handler
+ *
+ * @param [in] event    Event read from the modem
+ * @param [in] downlink DOWNDATA: the downlink, read once by the engine, valid during the call only; NULL for
+ *                      other events, or if the downlink pool was exhausted (downlink dropped)
+ * @param [in] context  Pointer given at subscription
+ */
+typedef void ( *lbm_event_handler_t )( const smtc_modem_event_t* event, const lbm_dl_buffer_t* downlink,
+                                       void* context );
+
+/**
+ * @brief Counters of one subscriber
+ */
+typedef struct lbm_event_subscriber_stats_s
+{
+    lbm_event_subscription_t subscription;
+    uint32_t                 mask;
+    uint8_t                  priority;
+    uint32_t                 calls;
+    uint32_t                 slow_calls;     //!< longer than LBM_EVENT_BUS_SLOW_US
+    uint32_t                 max_us;
+    uint32_t                 avg_us;
+    uint64_t                 total_us;
+    uint8_t                  slowest_event;  //!< event type of the max_us call
+} lbm_event_subscriber_stats_t;
+
+/**
+ * @brief Bus counters, subscribers in dispatch order
+ */
+typedef struct lbm_event_bus_stats_s
+{
+    uint32_t                     events;       //!< events dispatched
+    uint32_t                     deliveries;   //!< handler calls
+    uint32_t                     unmatched;    //!< events no subscriber asked for
+    uint32_t                     table_full;   //!< subscriptions refused
+    uint8_t                      subscribers;  //!< entries of subscriber[] in use
+    lbm_event_subscriber_stats_t subscriber[LBM_EVENT_BUS_MAX_SUBSCRIBERS];
+} lbm_event_bus_stats_t;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS PROTOTYPES --------------------------------------------
+ */
+
+/**
+ * @brief Subscribe a handler to some event types
+ *
+ * @param [in]  mask         LBM_EVENT_MASK() of each event type, or LBM_EVENT_MASK_ALL
+ * @param [in]  priority     Higher first; equal priorities in subscription order
+ * @param [out] subscription Handle, LBM_EVENT_BUS_NO_SUBSCRIPTION on error
+ *
+ * @return SMTC_MODEM_RC_OK, SMTC_MODEM_RC_INVALID without handler or mask, SMTC_MODEM_RC_BUSY if the table is full
+ */
+smtc_modem_return_code_t lbm_event_bus_subscribe( uint32_t mask, uint8_t priority, lbm_event_handler_t handler,
+                                                  void* context, lbm_event_subscription_t* subscription );
+
+/**
+ * @brief Remove a subscriber, possibly from its own handler
+ *
+ * @return SMTC_MODEM_RC_OK, SMTC_MODEM_RC_INVALID if unknown
+ */
+smtc_modem_return_code_t lbm_event_bus_unsubscribe( lbm_event_subscription_t subscription );
+
+/**
+ * @brief Change the event types of a subscriber
+ *
+ * @return SMTC_MODEM_RC_OK, SMTC_MODEM_RC_INVALID if unknown or mask is 0
+ */
+smtc_modem_return_code_t lbm_event_bus_set_mask( lbm_event_subscription_t subscription, uint32_t mask );
+
+/**
+ * @brief Call the subscribers of an event (called by the event dispatcher)
+ */
+void lbm_event_bus_dispatch( const smtc_modem_event_t* event, const lbm_dl_buffer_t* downlink );
+
+/**
+ * @brief Read / clear the counters (subscriptions are kept)
+ */
+void lbm_event_bus_get_stats( lbm_event_bus_stats_t* stats );
+void lbm_event_bus_reset_stats( void );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // LBM_EVENT_BUS_H
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,182 @@
+/*!
+ * \file      lbm_event_ring.cpp
+ *
+ * \brief     Bounded lock-free single-producer / single-consumer ring of modem events
+ */
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <atomic>
+
+#include "lbm_event_ring.h"
+#include "lbm_engine.h"
+
+#include "smtc_modem_hal.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE CONSTANTS -------------------------------------------------------
+ */
+
+#if( LBM_EVENT_RING_SIZE & ( LBM_EVENT_RING_SIZE - 1 ) ) != 0
+#error "LBM_EVENT_RING_SIZE must be a power of 2"
+#endif
+
+#define RING_MASK ( LBM_EVENT_RING_SIZE - 1 )
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE VARIABLES -------------------------------------------------------
+ */
+
+static lbm_event_record_t ring[LBM_EVENT_RING_SIZE];
+
+// Free-running indexes: head is only written by the producer, tail only by the consumer
+static std::atomic<uint32_t> head( 0 );
+static std::atomic<uint32_t> tail( 0 );
+
+static std::atomic<bool> enabled( false );
+
+// Wakes up lbm_event_ring_wait(), may be given while nobody waits
+static SemaphoreHandle_t data_available = nullptr;
+
+// Producer side counters
+static uint32_t pushed             = 0;
+static uint32_t overflows          = 0;
+static uint32_t downlink_overflows = 0;
+static uint32_t high_watermark     = 0;
+
+// Consumer side counter
+static uint32_t popped = 0;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS DEFINITION ---------------------------------------------
+ */
+
+void lbm_event_ring_enable( bool enable )
+{
+    if( ( enable == true ) && ( data_available == nullptr ) )
+    {
+        data_available = xSemaphoreCreateBinary( );
+    }
+    enabled.store( enable, std::memory_order_release );
+}
+
+bool lbm_event_ring_is_enabled( void )
+{
+    return enabled.load( std::memory_order_acquire );
+}
+
+bool lbm_event_ring_push( const smtc_modem_event_t* event, lbm_dl_buffer_t* downlink )
+{
+    const uint32_t h = head.load( std::memory_order_relaxed );
+    const uint32_t t = tail.load( std::memory_order_acquire );
+
+    if( ( h - t ) >= LBM_EVENT_RING_SIZE )
+    {
+        overflows++;
+        if( event->event_type == SMTC_MODEM_EVENT_DOWNDATA )
+        {
+            downlink_overflows++;
+        }
+        lbm_dl_pool_release( downlink );
+        return false;
+    }
+
+    lbm_event_record_t* record = &ring[h & RING_MASK];
+    record->event              = *event;
+    record->timestamp_ms       = smtc_modem_hal_get_time_in_ms( );
+    record->downlink           = downlink;
+
+    // Publish the record
+    head.store( h + 1, std::memory_order_release );
+
+    pushed++;
+    if( ( h + 1 - t ) > high_watermark )
+    {
+        high_watermark = h + 1 - t;
+    }
+
+    xSemaphoreGive( data_available );
+    // The consumer may be the task that runs the engine: make sure it does not go back to sleep
+    lbm_engine_notify( );
+    return true;
+}
+
+bool lbm_event_ring_pop( lbm_event_record_t* record )
+{
+    const uint32_t t = tail.load( std::memory_order_relaxed );
+    const uint32_t h = head.load( std::memory_order_acquire );
+
+    if( t == h )
+    {
+        return false;
+    }
+
+    *record = ring[t & RING_MASK];
+
+    // Hand the slot back to the producer
+    tail.store( t + 1, std::memory_order_release );
+    popped++;
+    return true;
+}
+
+bool lbm_event_ring_wait( lbm_event_record_t* record, uint32_t timeout_ms )
+{
+    const uint32_t start_ms = smtc_modem_hal_get_time_in_ms( );
+
+    for( ;; )
+    {
+        if( lbm_event_ring_pop( record ) == true )
+        {
+            return true;
+        }
+        if( data_available == nullptr )
+        {
+            return false;
+        }
+
+        const uint32_t waited_ms = smtc_modem_hal_get_time_in_ms( ) - start_ms;
+        if( waited_ms >= timeout_ms )
+        {
+            return false;
+        }
+
+        const uint32_t   remaining_ms = timeout_ms - waited_ms;
+        const TickType_t ticks =
+            ( timeout_ms == LBM_ENGINE_WAIT_FOREVER ) ? portMAX_DELAY : pdMS_TO_TICKS( remaining_ms );
+        if( xSemaphoreTake( data_available, ticks ) != pdPASS )
+        {
+            // Timed out, last chance for an event published just before the deadline
+            return lbm_event_ring_pop( record );
+        }
+    }
+}
+
+void lbm_event_ring_get_stats( lbm_event_ring_stats_t* stats )
+{
+    stats->pushed             = pushed;
+    stats->popped             = popped;
+    stats->overflows          = overflows;
+    stats->downlink_overflows = downlink_overflows;
+    stats->depth              = head.load( std::memory_order_acquire ) - tail.load( std::memory_order_acquire );
+    stats->high_watermark     = high_watermark;
+}
+
+void lbm_event_ring_reset_stats( void )
+{
+    pushed             = 0;
+    popped             = 0;
+    overflows          = 0;
+    downlink_overflows = 0;
+    high_watermark     = 0;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,127 @@
+/*!
+ * \file      lbm_event_ring.h
+ *
+ * \brief     Bounded lock-free single-producer / single-consumer ring of modem events
+ *
+ * When enabled, modem_event_callback() no longer calls the user callback inside the engine context. It pushes
+ * each event, together with the pooled downlink buffer for DOWNDATA, into this ring, and the application drains
+ * it from its own task. The engine is the only producer and a single application task the only consumer,
+ * so head and tail need no lock, only acquire / release ordering.
+ */
+
+#ifndef LBM_EVENT_RING_H
+#define LBM_EVENT_RING_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "smtc_modem_api.h"
+#include "lbm_dl_pool.h"
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC CONSTANTS --------------------------------------------------------
+ */
+
+/**
+ * @brief Number of records in the ring (power of 2)
+ */
+#ifndef LBM_EVENT_RING_SIZE
+#define LBM_EVENT_RING_SIZE 8
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC TYPES ------------------------------------------------------------
+ */
+
+/**
+ * @brief Event as queued for the application
+ */
+typedef struct lbm_event_record_s
+{
+    smtc_modem_event_t event;
+    uint32_t           timestamp_ms;  //!< modem time when the engine produced the event
+    lbm_dl_buffer_t*   downlink;      //!< DOWNDATA only, owned by the reader until lbm_dl_pool_release(); NULL if
+                                      //!< the pool was exhausted (downlink dropped)
+} lbm_event_record_t;
+
+/**
+ * @brief Ring counters
+ */
+typedef struct lbm_event_ring_stats_s
+{
+    uint32_t pushed;              //!< events queued by the engine
+    uint32_t popped;              //!< events read by the application
+    uint32_t overflows;           //!< events dropped because the ring was full
+    uint32_t downlink_overflows;  //!< of which DOWNDATA events (buffer released, payload lost)
+    uint32_t depth;               //!< events currently queued
+    uint32_t high_watermark;      //!< highest depth seen
+} lbm_event_ring_stats_t;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS PROTOTYPES --------------------------------------------
+ */
+
+/**
+ * @brief Route modem events to the ring (true) or to the synchronous user callback (false, default)
+ */
+void lbm_event_ring_enable( bool enable );
+
+/**
+ * @brief Tell whether events are routed to the ring
+ */
+bool lbm_event_ring_is_enabled( void );
+
+/**
+ * @brief Queue an event (producer side, engine context)
+ *
+ * @param [in] event    Modem event
+ * @param [in] downlink Downlink buffer handed over to the ring, NULL if none
+ *
+ * @return false if the ring is full (the event is dropped and counted, the downlink buffer released)
+ */
+bool lbm_event_ring_push( const smtc_modem_event_t* event, lbm_dl_buffer_t* downlink );
+
+/**
+ * @brief Dequeue the oldest event without blocking (consumer side)
+ *
+ * @return false if the ring is empty
+ */
+bool lbm_event_ring_pop( lbm_event_record_t* record );
+
+/**
+ * @brief Dequeue the oldest event, blocking the calling task up to timeout_ms for one to arrive
+ *
+ * @remark Must not be called from the task that runs the engine: nothing would fill the ring meanwhile
+ *
+ * @return false on timeout
+ */
+bool lbm_event_ring_wait( lbm_event_record_t* record, uint32_t timeout_ms );
+
+/**
+ * @brief Read the counters
+ */
+void lbm_event_ring_get_stats( lbm_event_ring_stats_t* stats );
+
+/**
+ * @brief Clear the counters (queued events are kept)
+ */
+void lbm_event_ring_reset_stats( void );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // LBM_EVENT_RING_H
+
+/* --- EOF ------------------------------------------------------------------ */
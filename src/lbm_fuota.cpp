@@ -0,0 +1,815 @@
+/*!
+ * \file      lbm_fuota.cpp
+ *
+ * \brief     Firmware update over the air: fragmentation session written straight into the inactive OTA partition
+ */
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <string.h>
+
+#include "lbm_fuota.h"
+#include "lbm_core.h"
+#include "lbm_dl_pool.h"
+#include "lbm_event_bus.h"
+#include "lbm_log.h"
+#include "lbm_upload.h"
+#include "lbm_uplink.h"
+
+extern "C" {
+#include "smtc_modem_hal.h"
+}
+
+#if !defined( LBM_NATIVE )
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#else
+#include "sim_ota.h"
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE MACROS ----------------------------------------------------------
+ */
+
+// The engine task writes the progress while the application reads it
+static lbm_critical_t fuota_lock = LBM_CRITICAL_INITIALIZER;
+#define FUOTA_LOCK( ) LBM_CRITICAL_ENTER( &fuota_lock )
+#define FUOTA_UNLOCK( ) LBM_CRITICAL_EXIT( &fuota_lock )
+
+#define SLOT_ROW_BYTES LBM_UPLOAD_ROW_BYTES( LBM_FUOTA_MAX_MISSING )
+#define MAX_SECTORS ( LBM_FUOTA_MAX_AREA_SIZE / LBM_FUOTA_SECTOR_SIZE )
+
+#define NO_SLOT 0xFFFF
+
+// Fragmentation package (TS004 v1.0.0)
+#define PACKAGE_IDENTIFIER 3
+#define PACKAGE_VERSION 1
+
+#define CID_PACKAGE_VERSION 0x00
+#define CID_FRAG_SESSION_STATUS 0x01
+#define CID_FRAG_SESSION_SETUP 0x02
+#define CID_FRAG_SESSION_DELETE 0x03
+#define CID_DATA_FRAGMENT 0x08
+
+#define SETUP_ENCODING_UNSUPPORTED 0x01
+#define SETUP_NOT_ENOUGH_MEMORY 0x02
+#define SETUP_INDEX_NOT_SUPPORTED 0x04
+#define DELETE_SESSION_DOES_NOT_EXIST 0x04
+#define STATUS_NOT_ENOUGH_MATRIX_MEMORY 0x01
+
+#define MAX_ANSWER_SIZE 32
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE TYPES -----------------------------------------------------------
+ */
+
+typedef struct session_s
+{
+    lbm_fuota_progress_t     progress;        //!< engine task copy, published to shared_progress
+    lbm_fuota_callback_t     callback;
+    void*                    context;
+    lbm_event_subscription_t subscription;
+    uint32_t                 area_size;       //!< of the partition, at most LBM_FUOTA_MAX_AREA_SIZE
+    uint32_t                 scratch_offset;  //!< first sector behind the image
+    uint32_t                 start_ms;
+    uint32_t                 end_ms;
+} session_t;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE VARIABLES -------------------------------------------------------
+ */
+
+static session_t            session;
+static lbm_fuota_progress_t shared_progress;
+
+static uint8_t  in_place[LBM_UPLOAD_ROW_BYTES( LBM_FUOTA_MAX_FRAGMENTS )];  //!< fragments written to their place
+static uint8_t  parity[LBM_UPLOAD_ROW_BYTES( LBM_FUOTA_MAX_FRAGMENTS )];    //!< coded fragment being taken
+static uint8_t  erased[LBM_UPLOAD_ROW_BYTES( MAX_SECTORS )];                //!< sectors erased in this session
+static uint16_t slot_fragment[LBM_FUOTA_MAX_MISSING];                       //!< fragment of each slot
+static uint8_t  rows[LBM_FUOTA_MAX_MISSING][SLOT_ROW_BYTES];                //!< row of slot c: lowest bit c, or empty
+static uint8_t  row[SLOT_ROW_BYTES];
+static uint8_t  data[LBM_FUOTA_MAX_FRAGMENT_SIZE];
+static uint8_t  buffer[LBM_FUOTA_MAX_FRAGMENT_SIZE];
+
+#if !defined( LBM_NATIVE )
+static const esp_partition_t* partition = nullptr;
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DECLARATION -------------------------------------------
+ */
+
+static void on_event( const smtc_modem_event_t* event, const lbm_dl_buffer_t* downlink, void* context );
+
+/**
+ * @brief Handle a FragSessionSetupReq
+ *
+ * @return Status byte of the answer
+ */
+static uint8_t setup( uint8_t stack_id, const uint8_t* request );
+
+/**
+ * @brief Take a data fragment, N 1 to M: fragment N, beyond: coded fragment N - M
+ */
+static void take_fragment( uint16_t n, const uint8_t* payload );
+
+/**
+ * @brief Reduce row / data against the solved slots and keep it as the row of a slot if something is left
+ *
+ * @param [in] coded data is a coded fragment, parity its matrix row: the fragments in place are taken out first
+ *
+ * @return false if the row brought nothing (no flash access then)
+ */
+static bool solve( bool coded );
+
+/**
+ * @brief Rebuild the missing fragments once every slot is solved, then select the partition for the next boot
+ */
+static void complete( void );
+
+static uint16_t find_slot( uint16_t fragment );
+static bool     read_fragment( uint16_t fragment, uint8_t* out );
+static bool     write_area( uint32_t offset, const uint8_t* in, uint32_t size );
+static void     fail( const char* what );
+static void     update_ram( void );
+static void     publish( lbm_fuota_event_t event );
+static void     xor_into( uint8_t* out, const uint8_t* in, uint32_t size );
+
+static bool flash_open( uint32_t* size );
+static bool flash_read( uint32_t offset, uint8_t* out, uint32_t size );
+static bool flash_program( uint32_t offset, const uint8_t* in, uint32_t size );
+static bool flash_erase( uint32_t offset );
+static bool flash_select_boot( uint32_t size );
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS DEFINITION ---------------------------------------------
+ */
+
+smtc_modem_return_code_t lbm_fuota_begin( lbm_fuota_callback_t callback, void* context )
+{
+    if( session.progress.status != LBM_FUOTA_STOPPED )
+    {
+        return SMTC_MODEM_RC_BUSY;
+    }
+    uint32_t size = 0;
+    if( flash_open( &size ) == false )
+    {
+        LBM_LOG_WARN( "FUOTA: no OTA partition to write\n" );
+        return SMTC_MODEM_RC_FAIL;
+    }
+
+    lbm_event_subscription_t       subscription = LBM_EVENT_BUS_NO_SUBSCRIPTION;
+    const smtc_modem_return_code_t ret =
+        lbm_event_bus_subscribe( LBM_EVENT_MASK( SMTC_MODEM_EVENT_DOWNDATA ), 0, on_event, nullptr, &subscription );
+    if( ret != SMTC_MODEM_RC_OK )
+    {
+        return SMTC_MODEM_RC_BUSY;
+    }
+
+    memset( &session, 0, sizeof( session ) );
+    session.callback           = callback;
+    session.context            = context;
+    session.subscription       = subscription;
+    session.area_size          = ( size > LBM_FUOTA_MAX_AREA_SIZE ) ? LBM_FUOTA_MAX_AREA_SIZE : size;
+    session.progress.status    = LBM_FUOTA_IDLE;
+    session.progress.ram_bytes = sizeof( session ) + sizeof( in_place ) + sizeof( parity ) + sizeof( erased ) +
+                                 sizeof( slot_fragment ) + sizeof( rows ) + sizeof( row ) + sizeof( data ) +
+                                 sizeof( buffer );
+    publish( LBM_FUOTA_EVENT_PROGRESS );
+    LBM_LOG_INFO( "FUOTA: %u bytes of OTA partition, %u bytes of RAM\n", session.area_size,
+                  session.progress.ram_bytes );
+    return SMTC_MODEM_RC_OK;
+}
+
+void lbm_fuota_end( void )
+{
+    if( session.progress.status == LBM_FUOTA_STOPPED )
+    {
+        return;
+    }
+    lbm_event_bus_unsubscribe( session.subscription );
+    session.subscription    = LBM_EVENT_BUS_NO_SUBSCRIPTION;
+    session.callback        = nullptr;
+    session.progress.status = LBM_FUOTA_STOPPED;
+    FUOTA_LOCK( );
+    shared_progress = session.progress;
+    FUOTA_UNLOCK( );
+}
+
+smtc_modem_return_code_t lbm_fuota_handle_message( uint8_t stack_id, const uint8_t* payload, uint8_t size )
+{
+    if( session.progress.status == LBM_FUOTA_STOPPED )
+    {
+        return SMTC_MODEM_RC_FAIL;
+    }
+
+    // Commands follow each other in one downlink, the answers in one uplink
+    uint8_t                  answer[MAX_ANSWER_SIZE];
+    uint8_t                  answer_size = 0;
+    smtc_modem_return_code_t ret         = SMTC_MODEM_RC_OK;
+    uint8_t                  i           = 0;
+    while( ( i < size ) && ( ret == SMTC_MODEM_RC_OK ) )
+    {
+        const uint8_t* command   = &payload[i];
+        const uint8_t  remaining = size - i;
+        switch( command[0] )
+        {
+        case CID_PACKAGE_VERSION:
+            if( answer_size + 3 <= MAX_ANSWER_SIZE )
+            {
+                answer[answer_size++] = CID_PACKAGE_VERSION;
+                answer[answer_size++] = PACKAGE_IDENTIFIER;
+                answer[answer_size++] = PACKAGE_VERSION;
+            }
+            i += 1;
+            break;
+
+        case CID_FRAG_SESSION_STATUS:
+        {
+            if( remaining < 2 )
+            {
+                ret = SMTC_MODEM_RC_INVALID;
+                break;
+            }
+            const bool                  participants = ( command[1] & 0x01 ) != 0;
+            const uint8_t               index        = ( command[1] >> 1 ) & 0x03;
+            const lbm_fuota_progress_t* p            = &session.progress;
+            const bool                  exists       = ( ( p->status == LBM_FUOTA_RECEIVING ) ||
+                                                         ( p->status == LBM_FUOTA_DONE ) ||
+                                                         ( p->status == LBM_FUOTA_FAILED ) ) &&
+                                                       ( p->frag_index == index );
+            const uint32_t              needed       = ( p->status == LBM_FUOTA_RECEIVING )
+                                                           ? ( uint32_t ) p->fragments - p->written - p->solved
+                                                           : 0;
+            // Without participants only the devices still missing fragments answer
+            if( exists && ( participants || ( needed > 0 ) ) && ( answer_size + 5 <= MAX_ANSWER_SIZE ) )
+            {
+                const uint16_t received_and_index =
+                    ( uint16_t ) ( ( index << 14 ) | ( ( p->received > 0x3FFF ) ? 0x3FFF : p->received ) );
+                answer[answer_size++] = CID_FRAG_SESSION_STATUS;
+                answer[answer_size++] = ( uint8_t ) received_and_index;
+                answer[answer_size++] = ( uint8_t ) ( received_and_index >> 8 );
+                answer[answer_size++] = ( uint8_t ) ( ( needed > 255 ) ? 255 : needed );
+                answer[answer_size++] = ( p->dropped > 0 ) ? STATUS_NOT_ENOUGH_MATRIX_MEMORY : 0;
+            }
+            i += 2;
+            break;
+        }
+
+        case CID_FRAG_SESSION_SETUP:
+        {
+            if( remaining < 11 )
+            {
+                ret = SMTC_MODEM_RC_INVALID;
+                break;
+            }
+            const uint8_t status = setup( stack_id, &command[1] );
+            if( answer_size + 2 <= MAX_ANSWER_SIZE )
+            {
+                answer[answer_size++] = CID_FRAG_SESSION_SETUP;
+                answer[answer_size++] = status;
+            }
+            i += 11;
+            break;
+        }
+
+        case CID_FRAG_SESSION_DELETE:
+        {
+            if( remaining < 2 )
+            {
+                ret = SMTC_MODEM_RC_INVALID;
+                break;
+            }
+            const uint8_t index  = command[1] & 0x03;
+            uint8_t       status = index;
+            if( ( session.progress.status == LBM_FUOTA_RECEIVING ) && ( session.progress.frag_index == index ) )
+            {
+                session.progress.status = LBM_FUOTA_IDLE;
+                publish( LBM_FUOTA_EVENT_PROGRESS );
+                LBM_LOG_INFO( "FUOTA: session %u deleted\n", index );
+            }
+            else
+            {
+                status |= DELETE_SESSION_DOES_NOT_EXIST;
+            }
+            if( answer_size + 2 <= MAX_ANSWER_SIZE )
+            {
+                answer[answer_size++] = CID_FRAG_SESSION_DELETE;
+                answer[answer_size++] = status;
+            }
+            i += 2;
+            break;
+        }
+
+        case CID_DATA_FRAGMENT:
+        {
+            // The fragment takes the rest of the downlink
+            const lbm_fuota_progress_t* p = &session.progress;
+            if( remaining < 3 )
+            {
+                ret = SMTC_MODEM_RC_INVALID;
+                break;
+            }
+            const uint16_t index_and_n = ( uint16_t ) ( command[1] | ( command[2] << 8 ) );
+            const uint16_t n           = index_and_n & 0x3FFF;
+            if( ( p->status == LBM_FUOTA_RECEIVING ) && ( p->frag_index == ( index_and_n >> 14 ) ) )
+            {
+                if( ( remaining - 3 != p->fragment_size ) || ( n == 0 ) )
+                {
+                    ret = SMTC_MODEM_RC_INVALID;
+                    break;
+                }
+                take_fragment( n, &command[3] );
+            }
+            i = size;
+            break;
+        }
+
+        default:
+            ret = SMTC_MODEM_RC_INVALID;
+            break;
+        }
+    }
+
+    if( answer_size > 0 )
+    {
+        lbm_uplink_ticket_t ticket = LBM_UPLINK_NO_TICKET;
+        if( lbm_uplink_submit( stack_id, LBM_FUOTA_PORT, false, answer, answer_size, nullptr, nullptr, &ticket ) !=
+            SMTC_MODEM_RC_OK )
+        {
+            LBM_LOG_WARN( "FUOTA: answer of %u bytes not queued\n", answer_size );
+        }
+    }
+    return ret;
+}
+
+void lbm_fuota_get_progress( lbm_fuota_progress_t* progress )
+{
+    FUOTA_LOCK( );
+    *progress = shared_progress;
+    FUOTA_UNLOCK( );
+    if( progress->status == LBM_FUOTA_RECEIVING )
+    {
+        progress->elapsed_ms = smtc_modem_hal_get_time_in_ms( ) - session.start_ms;
+    }
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DEFINITION --------------------------------------------
+ */
+
+static void on_event( const smtc_modem_event_t* event, const lbm_dl_buffer_t* downlink, void* context )
+{
+    ( void ) context;
+    if( ( downlink != nullptr ) && ( downlink->metadata.fport == LBM_FUOTA_PORT ) )
+    {
+        lbm_fuota_handle_message( event->stack_id, downlink->payload, downlink->size );
+    }
+}
+
+static uint8_t setup( uint8_t stack_id, const uint8_t* request )
+{
+    const uint8_t  index         = ( request[0] >> 4 ) & 0x03;
+    const uint16_t fragments     = ( uint16_t ) ( request[1] | ( request[2] << 8 ) );
+    const uint8_t  fragment_size = request[3];
+    const uint8_t  algorithm     = ( request[4] >> 3 ) & 0x07;
+    const uint8_t  padding       = request[5];
+    const uint32_t descriptor    = ( uint32_t ) request[6] | ( ( uint32_t ) request[7] << 8 ) |
+                                ( ( uint32_t ) request[8] << 16 ) | ( ( uint32_t ) request[9] << 24 );
+    lbm_fuota_progress_t* p = &session.progress;
+
+    uint8_t status = ( uint8_t ) ( index << 6 );
+    if( algorithm != 0 )
+    {
+        status |= SETUP_ENCODING_UNSUPPORTED;
+    }
+    // Image then scratch area, each starting on a sector
+    const uint32_t image_area = ( uint32_t ) fragments * fragment_size;
+    const uint32_t scratch =
+        ( image_area + LBM_FUOTA_SECTOR_SIZE - 1 ) / LBM_FUOTA_SECTOR_SIZE * LBM_FUOTA_SECTOR_SIZE;
+    if( ( fragments == 0 ) || ( fragments > LBM_FUOTA_MAX_FRAGMENTS ) || ( fragment_size == 0 ) ||
+        ( fragment_size > LBM_FUOTA_MAX_FRAGMENT_SIZE ) || ( padding >= image_area ) ||
+        ( scratch + ( uint32_t ) LBM_FUOTA_MAX_MISSING * fragment_size > session.area_size ) )
+    {
+        status |= SETUP_NOT_ENOUGH_MEMORY;
+    }
+    // One session at a time; a finished image stays untouched until lbm_fuota_end()
+    if( ( ( p->status == LBM_FUOTA_RECEIVING ) && ( p->frag_index != index ) ) || ( p->status == LBM_FUOTA_DONE ) )
+    {
+        status |= SETUP_INDEX_NOT_SUPPORTED;
+    }
+    if( ( status & 0x3F ) != 0 )
+    {
+        LBM_LOG_WARN( "FUOTA: session %u of %u x %u bytes refused, status 0x%02X\n", index, fragments, fragment_size,
+                      status );
+        return status;
+    }
+
+    const uint32_t ram_bytes = p->ram_bytes;
+    memset( p, 0, sizeof( *p ) );
+    memset( in_place, 0, sizeof( in_place ) );
+    memset( erased, 0, sizeof( erased ) );
+    memset( rows, 0, sizeof( rows ) );
+    p->status              = LBM_FUOTA_RECEIVING;
+    p->stack_id            = stack_id;
+    p->frag_index          = index;
+    p->fragments           = fragments;
+    p->fragment_size       = fragment_size;
+    p->size                = image_area - padding;
+    p->descriptor          = descriptor;
+    p->ram_bytes           = ram_bytes;
+    session.scratch_offset = scratch;
+    session.start_ms       = smtc_modem_hal_get_time_in_ms( );
+    update_ram( );
+    LBM_LOG_INFO( "FUOTA: session %u, %u bytes in %u fragments of %u bytes, descriptor 0x%08X\n", index, p->size,
+                  fragments, fragment_size, descriptor );
+    publish( LBM_FUOTA_EVENT_SESSION );
+    return status;
+}
+
+static void take_fragment( uint16_t n, const uint8_t* payload )
+{
+    lbm_fuota_progress_t* p  = &session.progress;
+    const uint16_t        m  = p->fragments;
+    const uint8_t         fs = p->fragment_size;
+    p->received++;
+
+    if( n <= m )
+    {
+        const uint16_t fragment = n - 1;
+        const uint16_t slot     = find_slot( fragment );
+        if( LBM_UPLOAD_GET_BIT( in_place, fragment ) != 0 )
+        {
+            p->redundant++;
+        }
+        else if( slot == NO_SLOT )
+        {
+            if( write_area( ( uint32_t ) fragment * fs, payload, fs ) == false )
+            {
+                return;
+            }
+            LBM_UPLOAD_SET_BIT( in_place, fragment );
+            p->written++;
+        }
+        else
+        {
+            // Covered by coded fragments already: one more equation on its slot
+            memset( row, 0, sizeof( row ) );
+            LBM_UPLOAD_SET_BIT( row, slot );
+            memcpy( data, payload, fs );
+            if( solve( false ) == false )
+            {
+                p->redundant++;
+            }
+        }
+    }
+    else if( m == 1 )
+    {
+        // The TS004 row of a single fragment is empty
+        p->coded++;
+        p->redundant++;
+    }
+    else
+    {
+        p->coded++;
+        lbm_upload_parity_row( n - m, m, parity );
+
+        // Slots the fragments not in place would need, before touching anything
+        uint16_t new_slots = 0;
+        uint16_t unknown   = 0;
+        for( uint16_t i = 0; i < m; i++ )
+        {
+            if( ( LBM_UPLOAD_GET_BIT( parity, i ) != 0 ) && ( LBM_UPLOAD_GET_BIT( in_place, i ) == 0 ) )
+            {
+                unknown++;
+                new_slots += ( find_slot( i ) == NO_SLOT ) ? 1 : 0;
+            }
+        }
+        if( unknown == 0 )
+        {
+            p->redundant++;
+        }
+        else if( p->missing + new_slots > LBM_FUOTA_MAX_MISSING )
+        {
+            p->dropped++;
+        }
+        else
+        {
+            memset( row, 0, sizeof( row ) );
+            for( uint16_t i = 0; i < m; i++ )
+            {
+                if( ( LBM_UPLOAD_GET_BIT( parity, i ) != 0 ) && ( LBM_UPLOAD_GET_BIT( in_place, i ) == 0 ) )
+                {
+                    uint16_t slot = find_slot( i );
+                    if( slot == NO_SLOT )
+                    {
+                        slot                = p->missing++;
+                        slot_fragment[slot] = i;
+                    }
+                    LBM_UPLOAD_SET_BIT( row, slot );
+                }
+            }
+            update_ram( );
+            memcpy( data, payload, fs );
+            if( solve( true ) == false )
+            {
+                p->redundant++;
+            }
+        }
+    }
+
+    if( ( p->status == LBM_FUOTA_RECEIVING ) && ( p->written + p->missing == m ) && ( p->solved == p->missing ) )
+    {
+        complete( );
+    }
+    if( p->status == LBM_FUOTA_RECEIVING )
+    {
+        publish( LBM_FUOTA_EVENT_PROGRESS );
+    }
+}
+
+static bool solve( bool coded )
+{
+    lbm_fuota_progress_t* p  = &session.progress;
+    const uint8_t         fs = p->fragment_size;
+
+    // On the bits first: a row the solved slots already give costs no flash read
+    uint8_t reduced[SLOT_ROW_BYTES];
+    memcpy( reduced, row, sizeof( reduced ) );
+    uint16_t pivot = NO_SLOT;
+    for( uint16_t c = 0; c < p->missing; c++ )
+    {
+        if( LBM_UPLOAD_GET_BIT( reduced, c ) != 0 )
+        {
+            if( LBM_UPLOAD_GET_BIT( rows[c], c ) == 0 )
+            {
+                pivot = c;
+                break;
+            }
+            xor_into( reduced, rows[c], sizeof( reduced ) );
+        }
+    }
+    if( pivot == NO_SLOT )
+    {
+        return false;
+    }
+
+    // A coded fragment covers fragments in place too: take them out
+    if( coded )
+    {
+        for( uint16_t i = 0; i < p->fragments; i++ )
+        {
+            if( ( LBM_UPLOAD_GET_BIT( parity, i ) != 0 ) && ( LBM_UPLOAD_GET_BIT( in_place, i ) != 0 ) )
+            {
+                if( read_fragment( i, buffer ) == false )
+                {
+                    return true;
+                }
+                xor_into( data, buffer, fs );
+            }
+        }
+    }
+    // Then the same eliminations as on the bits, with the data of the solved slots
+    for( uint16_t c = 0; c < pivot; c++ )
+    {
+        if( LBM_UPLOAD_GET_BIT( row, c ) != 0 )
+        {
+            xor_into( row, rows[c], sizeof( row ) );
+            if( flash_read( session.scratch_offset + ( uint32_t ) c * fs, buffer, fs ) == false )
+            {
+                fail( "scratch read" );
+                return true;
+            }
+            xor_into( data, buffer, fs );
+        }
+    }
+    if( write_area( session.scratch_offset + ( uint32_t ) pivot * fs, data, fs ) == false )
+    {
+        return true;
+    }
+    memcpy( rows[pivot], row, sizeof( row ) );
+    p->solved++;
+    return true;
+}
+
+static void complete( void )
+{
+    lbm_fuota_progress_t* p  = &session.progress;
+    const uint8_t         fs = p->fragment_size;
+
+    // Slot c only depends on the slots above it
+    for( int32_t c = ( int32_t ) p->missing - 1; c >= 0; c-- )
+    {
+        if( flash_read( session.scratch_offset + ( uint32_t ) c * fs, data, fs ) == false )
+        {
+            fail( "scratch read" );
+            return;
+        }
+        for( uint16_t k = ( uint16_t ) c + 1; k < p->missing; k++ )
+        {
+            if( LBM_UPLOAD_GET_BIT( rows[c], k ) != 0 )
+            {
+                if( read_fragment( slot_fragment[k], buffer ) == false )
+                {
+                    return;
+                }
+                xor_into( data, buffer, fs );
+            }
+        }
+        if( write_area( ( uint32_t ) slot_fragment[c] * fs, data, fs ) == false )
+        {
+            return;
+        }
+        LBM_UPLOAD_SET_BIT( in_place, slot_fragment[c] );
+        p->written++;
+    }
+
+    session.end_ms = smtc_modem_hal_get_time_in_ms( );
+    p->elapsed_ms  = session.end_ms - session.start_ms;
+    if( flash_select_boot( p->size ) == false )
+    {
+        fail( "image check" );
+        return;
+    }
+    p->status = LBM_FUOTA_DONE;
+    LBM_LOG_INFO( "FUOTA: session %u done, %u bytes from %u fragments (%u coded, %u rebuilt) in %u ms\n",
+                  p->frag_index, p->size, p->received, p->coded, p->missing, p->elapsed_ms );
+    publish( LBM_FUOTA_EVENT_DONE );
+}
+
+static uint16_t find_slot( uint16_t fragment )
+{
+    for( uint16_t c = 0; c < session.progress.missing; c++ )
+    {
+        if( slot_fragment[c] == fragment )
+        {
+            return c;
+        }
+    }
+    return NO_SLOT;
+}
+
+static bool read_fragment( uint16_t fragment, uint8_t* out )
+{
+    const uint8_t fs = session.progress.fragment_size;
+    if( flash_read( ( uint32_t ) fragment * fs, out, fs ) == false )
+    {
+        fail( "fragment read" );
+        return false;
+    }
+    return true;
+}
+
+static bool write_area( uint32_t offset, const uint8_t* in, uint32_t size )
+{
+    // Sectors are erased the first time the session writes into them, whatever the previous image left
+    for( uint32_t sector = offset / LBM_FUOTA_SECTOR_SIZE; sector <= ( offset + size - 1 ) / LBM_FUOTA_SECTOR_SIZE;
+         sector++ )
+    {
+        if( LBM_UPLOAD_GET_BIT( erased, sector ) == 0 )
+        {
+            if( flash_erase( sector * LBM_FUOTA_SECTOR_SIZE ) == false )
+            {
+                fail( "erase" );
+                return false;
+            }
+            LBM_UPLOAD_SET_BIT( erased, sector );
+        }
+    }
+    if( flash_program( offset, in, size ) == false )
+    {
+        fail( "program" );
+        return false;
+    }
+    return true;
+}
+
+static void fail( const char* what )
+{
+    ( void ) what;  // logged only
+    lbm_fuota_progress_t* p = &session.progress;
+    session.end_ms          = smtc_modem_hal_get_time_in_ms( );
+    p->elapsed_ms           = session.end_ms - session.start_ms;
+    p->status               = LBM_FUOTA_FAILED;
+    LBM_LOG_WARN( "FUOTA: session %u failed (%s)\n", p->frag_index, what );
+    publish( LBM_FUOTA_EVENT_DONE );
+}
+
+static void update_ram( void )
+{
+    lbm_fuota_progress_t* p = &session.progress;
+    // Bitmaps of the fragments and of the sectors, matrix row, slots in use and the two fragment buffers
+    const uint32_t in_use = ( uint32_t ) ( sizeof( session ) + 2 * LBM_UPLOAD_ROW_BYTES( p->fragments ) +
+                                           LBM_UPLOAD_ROW_BYTES( session.area_size / LBM_FUOTA_SECTOR_SIZE ) +
+                                           p->missing * ( sizeof( slot_fragment[0] ) + SLOT_ROW_BYTES ) +
+                                           SLOT_ROW_BYTES + 2u * p->fragment_size );
+    if( in_use > p->peak_ram_bytes )
+    {
+        p->peak_ram_bytes = in_use;
+    }
+}
+
+static void publish( lbm_fuota_event_t event )
+{
+    FUOTA_LOCK( );
+    shared_progress = session.progress;
+    FUOTA_UNLOCK( );
+    if( session.callback != nullptr )
+    {
+        lbm_fuota_progress_t progress;
+        lbm_fuota_get_progress( &progress );
+        session.callback( event, &progress, session.context );
+    }
+}
+
+static void xor_into( uint8_t* out, const uint8_t* in, uint32_t size )
+{
+    for( uint32_t i = 0; i < size; i++ )
+    {
+        out[i] ^= in[i];
+    }
+}
+
+#if !defined( LBM_NATIVE )
+
+static bool flash_open( uint32_t* size )
+{
+    partition = esp_ota_get_next_update_partition( nullptr );
+    if( partition == nullptr )
+    {
+        return false;
+    }
+    *size = partition->size;
+    return true;
+}
+
+static bool flash_read( uint32_t offset, uint8_t* out, uint32_t size )
+{
+    session.progress.flash_reads++;
+    return esp_partition_read( partition, offset, out, size ) == ESP_OK;
+}
+
+static bool flash_program( uint32_t offset, const uint8_t* in, uint32_t size )
+{
+    session.progress.flash_programs++;
+    session.progress.flash_bytes += size;
+    return esp_partition_write( partition, offset, in, size ) == ESP_OK;
+}
+
+static bool flash_erase( uint32_t offset )
+{
+    session.progress.flash_erases++;
+    return esp_partition_erase_range( partition, offset, LBM_FUOTA_SECTOR_SIZE ) == ESP_OK;
+}
+
+static bool flash_select_boot( uint32_t size )
+{
+    // Checks the image (header, segments, checksum and SHA-256) before writing otadata
+    ( void ) size;
+    return esp_ota_set_boot_partition( partition ) == ESP_OK;
+}
+
+#else
+
+static bool flash_open( uint32_t* size )
+{
+    *size = SIM_OTA_PARTITION_SIZE;
+    return true;
+}
+
+static bool flash_read( uint32_t offset, uint8_t* out, uint32_t size )
+{
+    session.progress.flash_reads++;
+    return sim_ota_read( offset, out, size );
+}
+
+static bool flash_program( uint32_t offset, const uint8_t* in, uint32_t size )
+{
+    session.progress.flash_programs++;
+    session.progress.flash_bytes += size;
+    return sim_ota_program( offset, in, size );
+}
+
+static bool flash_erase( uint32_t offset )
+{
+    session.progress.flash_erases++;
+    return sim_ota_erase_sector( offset );
+}
+
+static bool flash_select_boot( uint32_t size )
+{
+    return sim_ota_set_boot( size );
+}
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
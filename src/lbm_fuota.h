@@ -0,0 +1,174 @@
+/*!
+ * \file      lbm_fuota.h
+ *
+ * \brief     Firmware update over the air: fragmentation session written straight into the inactive OTA partition
+ *
+ * Answers the Fragmented Data Block Transport package (TS004 v1.0.0, port 201) and rebuilds the data block into
+ * the OTA partition the next boot would not use (app1 of partitions_rak3112.csv while running from app0, and the
+ * other way round). The image is never held in RAM or PSRAM:
+ *
+ * - a fragment that arrives goes straight to its place in the partition, sectors being erased the first time
+ *   anything is written into them;
+ * - a coded fragment is reduced against the fragments already in flash and what is left only covers fragments
+ *   still missing. Those get a slot (LBM_FUOTA_MAX_MISSING of them), a bit row over the slots stays in RAM and
+ *   the reduced data is written once into a scratch area behind the image;
+ * - when every missing fragment is solved, they are rebuilt from the scratch area in reverse slot order and
+ *   written to their place, then the partition is selected for the next boot (esp_ota_set_boot_partition(), which
+ *   checks the image). Restarting into it is up to the application.
+ *
+ * RAM in use grows with the fragments lost, not with the image: a bitmap of the fragments in flash, a matrix row,
+ * the slots and two fragment buffers. It is reported as the session goes (lbm_fuota_progress_t) with the flash
+ * operations. Nothing survives a reset: the fragmentation server starts a new session.
+ *
+ * Only the fragmentation package is implemented, not the multicast setup (TS005) or the clock synchronization
+ * (TS003) packages: the fragments come on whatever the stack receives on port 201, class A downlinks or a
+ * multicast group set up by the application. Flash operations run in the engine task with the downlink, a sector
+ * erase holding it for about 45 ms.
+ */
+
+#ifndef LBM_FUOTA_H
+#define LBM_FUOTA_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "smtc_modem_api.h"
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC CONSTANTS --------------------------------------------------------
+ */
+
+/**
+ * @brief LoRaWAN port of the fragmentation package
+ */
+#define LBM_FUOTA_PORT 201
+
+/**
+ * @brief Largest number of fragments of a session (the 14 bit fragment number of TS004)
+ */
+#define LBM_FUOTA_MAX_FRAGMENTS 16383
+
+/**
+ * @brief Largest fragment
+ */
+#define LBM_FUOTA_MAX_FRAGMENT_SIZE 242
+
+/**
+ * @brief Fragments that can be missing at the same time while coded fragments arrive
+ *
+ * A coded fragment that would need more is dropped (lbm_fuota_progress_t::dropped) and reported as a lack of
+ * matrix memory in the FragSessionStatusAns. RAM: LBM_FUOTA_MAX_MISSING * ( LBM_FUOTA_MAX_MISSING / 8 + 2 ) bytes.
+ */
+#ifndef LBM_FUOTA_MAX_MISSING
+#define LBM_FUOTA_MAX_MISSING 256
+#endif
+
+/**
+ * @brief Flash sector, erased as a whole
+ */
+#define LBM_FUOTA_SECTOR_SIZE 4096
+
+/**
+ * @brief Largest area of the partition in use, image and scratch area
+ */
+#define LBM_FUOTA_MAX_AREA_SIZE 0x400000
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC TYPES ------------------------------------------------------------
+ */
+
+typedef enum lbm_fuota_status_e
+{
+    LBM_FUOTA_STOPPED = 0,  //!< lbm_fuota_begin() not called
+    LBM_FUOTA_IDLE,         //!< waiting for a FragSessionSetupReq
+    LBM_FUOTA_RECEIVING,
+    LBM_FUOTA_DONE,         //!< image written and selected for the next boot
+    LBM_FUOTA_FAILED,       //!< flash error or image refused by the boot partition check
+} lbm_fuota_status_t;
+
+typedef enum lbm_fuota_event_e
+{
+    LBM_FUOTA_EVENT_SESSION = 0,  //!< session set up
+    LBM_FUOTA_EVENT_PROGRESS,     //!< data fragment taken
+    LBM_FUOTA_EVENT_DONE,         //!< LBM_FUOTA_DONE or LBM_FUOTA_FAILED
+} lbm_fuota_event_t;
+
+typedef struct lbm_fuota_progress_s
+{
+    lbm_fuota_status_t status;
+    uint8_t            stack_id;       //!< of the last setup
+    uint8_t            frag_index;     //!< TS004 session index, 0 to 3
+    uint16_t           fragments;      //!< M
+    uint8_t            fragment_size;
+    uint32_t           size;           //!< image size, M * fragment_size - padding
+    uint32_t           descriptor;     //!< of the FragSessionSetupReq, for the application
+    uint32_t           received;       //!< data fragments of the session, duplicates included
+    uint32_t           coded;          //!< of which coded
+    uint32_t           redundant;      //!< duplicates and coded fragments that brought nothing
+    uint32_t           dropped;        //!< coded fragments beyond LBM_FUOTA_MAX_MISSING missing fragments
+    uint16_t           written;        //!< fragments in place in the partition
+    uint16_t           missing;        //!< fragments covered by coded fragments and not in place, in a slot
+    uint16_t           solved;         //!< of the missing ones, rows of the matrix
+    uint32_t           flash_erases;
+    uint32_t           flash_programs;
+    uint32_t           flash_bytes;    //!< programmed
+    uint32_t           flash_reads;
+    uint32_t           ram_bytes;      //!< reserved by the module (static)
+    uint32_t           peak_ram_bytes; //!< in use at most during the session
+    uint32_t           elapsed_ms;     //!< setup to the end, or to now
+} lbm_fuota_progress_t;
+
+/**
+ * @brief Session callback (engine task)
+ */
+typedef void ( *lbm_fuota_callback_t )( lbm_fuota_event_t event, const lbm_fuota_progress_t* progress,
+                                        void* context );
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS PROTOTYPES --------------------------------------------
+ */
+
+/**
+ * @brief Open the inactive OTA partition and answer the fragmentation package on port 201
+ *
+ * @param [in] callback May be NULL
+ *
+ * @return SMTC_MODEM_RC_OK, SMTC_MODEM_RC_FAIL without OTA partition to write, SMTC_MODEM_RC_BUSY if already begun
+ *         or the event bus is full
+ */
+smtc_modem_return_code_t lbm_fuota_begin( lbm_fuota_callback_t callback, void* context );
+
+/**
+ * @brief Stop answering, dropping the session in progress (a finished image stays selected)
+ */
+void lbm_fuota_end( void );
+
+/**
+ * @brief Handle one message of the fragmentation package, answers queued as uplink tickets on port 201
+ *
+ * Called by the event bus for each downlink on LBM_FUOTA_PORT once begun; it can also be fed directly.
+ *
+ * @return SMTC_MODEM_RC_OK, SMTC_MODEM_RC_FAIL if not begun, SMTC_MODEM_RC_INVALID for a malformed message
+ */
+smtc_modem_return_code_t lbm_fuota_handle_message( uint8_t stack_id, const uint8_t* payload, uint8_t size );
+
+void lbm_fuota_get_progress( lbm_fuota_progress_t* progress );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // LBM_FUOTA_H
+
+/* --- EOF ------------------------------------------------------------------ */
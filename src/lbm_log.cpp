@@ -0,0 +1,332 @@
+/*!
+ * \file      lbm_log.cpp
+ *
+ * \brief     Compile-time filtered logging, with an optional tokenized deferred backend
+ */
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <Arduino.h>
+#include <atomic>
+#include <string.h>
+
+#include "lbm_log.h"
+#include "lbm_core.h"
+
+#include "smtc_modem_hal.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE CONSTANTS -------------------------------------------------------
+ */
+
+#if( LBM_LOG_BUFFER_SIZE & ( LBM_LOG_BUFFER_SIZE - 1 ) ) != 0
+#error "LBM_LOG_BUFFER_SIZE must be a power of 2"
+#endif
+
+#if LBM_LOG_MAX_RECORD_SIZE > 255
+#error "LBM_LOG_MAX_RECORD_SIZE must not exceed 255"
+#endif
+
+#define BUFFER_MASK ( LBM_LOG_BUFFER_SIZE - 1 )
+
+// sync, length, level, id, timestamp
+#define RECORD_HEADER_SIZE 11
+
+// Serial writes are split so that the drain task gives the CPU back in between
+#define DRAIN_CHUNK_SIZE 64
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE VARIABLES -------------------------------------------------------
+ */
+
+static uint8_t ring[LBM_LOG_BUFFER_SIZE];
+
+// Free-running byte indexes: writers share head under the lock, only the drain moves tail
+static std::atomic<uint32_t> head( 0 );
+static std::atomic<uint32_t> tail( 0 );
+
+static lbm_critical_t writer_lock = LBM_CRITICAL_INITIALIZER;
+#define WRITER_LOCK( ) LBM_CRITICAL_ENTER( &writer_lock )
+#define WRITER_UNLOCK( ) LBM_CRITICAL_EXIT( &writer_lock )
+
+static uint32_t records        = 0;
+static uint32_t dropped        = 0;
+static uint32_t dropped_report = 0;  // dropped records not reported in the output yet
+static uint32_t bytes_drained  = 0;
+static uint32_t high_watermark = 0;
+
+static void default_sink( const uint8_t* data, uint32_t size );
+
+static lbm_log_sink_t sink = default_sink;
+
+#if LBM_LOG_DEFERRED && !defined( LBM_NATIVE )
+static TaskHandle_t drain_task = nullptr;
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DECLARATION -------------------------------------------
+ */
+
+/**
+ * @brief Copy a record into the ring if it fits, writer lock held
+ */
+static bool ring_put( const uint8_t* record, uint32_t size );
+
+#if LBM_LOG_DEFERRED && !defined( LBM_NATIVE )
+static void drain_task_function( void* parameter );
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS DEFINITION ---------------------------------------------
+ */
+
+void lbm_log_start( void )
+{
+#if LBM_LOG_DEFERRED && !defined( LBM_NATIVE )
+    if( drain_task == nullptr )
+    {
+        xTaskCreate( drain_task_function, "lbm_log", 2048, nullptr, LBM_LOG_TASK_PRIORITY, &drain_task );
+    }
+#endif
+}
+
+uint32_t lbm_log_drain( void )
+{
+    uint32_t drained = 0;
+
+    for( ;; )
+    {
+        const uint32_t t = tail.load( std::memory_order_relaxed );
+        const uint32_t h = head.load( std::memory_order_acquire );
+        if( t == h )
+        {
+            break;
+        }
+
+        // Contiguous part only, the wrapped part goes in the next chunk
+        uint32_t size = h - t;
+        if( size > ( LBM_LOG_BUFFER_SIZE - ( t & BUFFER_MASK ) ) )
+        {
+            size = LBM_LOG_BUFFER_SIZE - ( t & BUFFER_MASK );
+        }
+        if( size > DRAIN_CHUNK_SIZE )
+        {
+            size = DRAIN_CHUNK_SIZE;
+        }
+
+        if( sink != nullptr )
+        {
+            sink( &ring[t & BUFFER_MASK], size );
+        }
+        tail.store( t + size, std::memory_order_release );
+        drained += size;
+    }
+
+    bytes_drained += drained;
+    return drained;
+}
+
+void lbm_log_set_sink( lbm_log_sink_t new_sink )
+{
+    sink = new_sink;
+}
+
+void lbm_log_get_stats( lbm_log_stats_t* stats )
+{
+    stats->records        = records;
+    stats->dropped        = dropped;
+    stats->bytes_drained  = bytes_drained;
+    stats->depth          = head.load( std::memory_order_acquire ) - tail.load( std::memory_order_acquire );
+    stats->high_watermark = high_watermark;
+}
+
+void lbm_log_reset_stats( void )
+{
+    records        = 0;
+    dropped        = 0;
+    bytes_drained  = 0;
+    high_watermark = 0;
+}
+
+void lbm_log_commit( const uint8_t* record, uint32_t size )
+{
+    WRITER_LOCK( );
+    if( dropped_report > 0 )
+    {
+        // Tell the reader about the gap before the next record that makes it
+        uint8_t report[RECORD_HEADER_SIZE + 4];
+        memcpy( report, record, RECORD_HEADER_SIZE );
+        report[1] = sizeof( report ) - 2;
+        report[2] = LBM_LOG_LEVEL_WARN;
+        memset( &report[3], 0, 4 );  // id 0
+        memcpy( &report[RECORD_HEADER_SIZE], &dropped_report, 4 );  // the targets are little-endian
+        if( ring_put( report, sizeof( report ) ) == true )
+        {
+            dropped_report = 0;
+        }
+    }
+    if( ( dropped_report == 0 ) && ( ring_put( record, size ) == true ) )
+    {
+        records++;
+    }
+    else
+    {
+        dropped++;
+        dropped_report++;
+    }
+    WRITER_UNLOCK( );
+}
+
+#if LBM_LOG_DEFERRED
+
+LBMLogRecord::LBMLogRecord( uint8_t level, uint32_t id ) : size( RECORD_HEADER_SIZE )
+{
+    const uint32_t timestamp_ms = smtc_modem_hal_get_time_in_ms( );
+
+    buffer[0] = LBM_LOG_SYNC;
+    buffer[2] = level;
+    memcpy( &buffer[3], &id, 4 );
+    memcpy( &buffer[7], &timestamp_ms, 4 );
+}
+
+void LBMLogRecord::putWord( uint32_t word )
+{
+    if( ( size + 4u ) <= sizeof( buffer ) )
+    {
+        memcpy( &buffer[size], &word, 4 );
+        size += 4;
+    }
+}
+
+void LBMLogRecord::putDoubleWord( uint64_t word )
+{
+    if( ( size + 8u ) <= sizeof( buffer ) )
+    {
+        memcpy( &buffer[size], &word, 8 );
+        size += 8;
+    }
+}
+
+void LBMLogRecord::put( float value )
+{
+    uint32_t word;
+    memcpy( &word, &value, 4 );
+    putWord( word );
+}
+
+void LBMLogRecord::put( const char* s )
+{
+    uint32_t length = ( s != nullptr ) ? strnlen( s, LBM_LOG_MAX_STRING ) : 0;
+    if( ( size + 1u + length ) > sizeof( buffer ) )
+    {
+        length = ( size < sizeof( buffer ) ) ? sizeof( buffer ) - size - 1u : 0;
+        if( size >= sizeof( buffer ) )
+        {
+            return;
+        }
+    }
+    buffer[size++] = ( uint8_t ) length;
+    memcpy( &buffer[size], s, length );
+    size += length;
+}
+
+void LBMLogRecord::putArray( const uint8_t* data, uint32_t length )
+{
+    if( ( size + 1u + length ) > sizeof( buffer ) )
+    {
+        length = sizeof( buffer ) - size - 1u;
+    }
+    buffer[size++] = ( uint8_t ) length;
+    memcpy( &buffer[size], data, length );
+    size += length;
+}
+
+void LBMLogRecord::commit( )
+{
+    buffer[1] = size - 2;
+    lbm_log_commit( buffer, size );
+}
+
+#else
+
+void lbm_log_print_array( const char* label, const uint8_t* data, uint32_t size )
+{
+    Serial.printf( "%s - (%lu bytes):\n", label, ( unsigned long ) size );
+    for( uint32_t i = 0; i < size; i++ )
+    {
+        Serial.printf( " %02X", data[i] );
+    }
+    Serial.printf( "\n" );
+}
+
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DEFINITION --------------------------------------------
+ */
+
+static bool ring_put( const uint8_t* record, uint32_t size )
+{
+    const uint32_t h = head.load( std::memory_order_relaxed );
+    const uint32_t t = tail.load( std::memory_order_acquire );
+
+    if( ( LBM_LOG_BUFFER_SIZE - ( h - t ) ) < size )
+    {
+        return false;
+    }
+
+    const uint32_t offset = h & BUFFER_MASK;
+    const uint32_t first  = ( size < ( LBM_LOG_BUFFER_SIZE - offset ) ) ? size : LBM_LOG_BUFFER_SIZE - offset;
+    memcpy( &ring[offset], record, first );
+    memcpy( &ring[0], &record[first], size - first );
+
+    head.store( h + size, std::memory_order_release );
+    if( ( h + size - t ) > high_watermark )
+    {
+        high_watermark = h + size - t;
+    }
+    return true;
+}
+
+#if !defined( LBM_NATIVE )
+
+static void default_sink( const uint8_t* data, uint32_t size )
+{
+    Serial.write( data, size );
+}
+
+#if LBM_LOG_DEFERRED
+static void drain_task_function( void* parameter )
+{
+    ( void ) parameter;
+    for( ;; )
+    {
+        vTaskDelay( pdMS_TO_TICKS( LBM_LOG_DRAIN_PERIOD_MS ) );
+        lbm_log_drain( );
+    }
+}
+#endif
+
+#else
+
+static void default_sink( const uint8_t* data, uint32_t size )
+{
+    // The host console shows the modem traces, binary records only go to a file set with lbm_log_set_sink()
+    ( void ) data;
+    ( void ) size;
+}
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
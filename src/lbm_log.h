@@ -0,0 +1,299 @@
+/*!
+ * \file      lbm_log.h
+ *
+ * \brief     Compile-time filtered logging, with an optional tokenized deferred backend
+ *
+ * LBM_LOG_ERROR / WARN / INFO / DEBUG take a printf format string literal. Levels above LBM_LOG_LEVEL expand to
+ * nothing, arguments included.
+ *
+ * With LBM_LOG_DEFERRED=0 (default) a log is printed at once with Serial.printf(). With LBM_LOG_DEFERRED=1 the
+ * format string never reaches the binary: it is replaced by its 32-bit FNV-1a hash computed by the compiler, and
+ * the caller only appends a small binary record (id, timestamp, raw arguments) to a RAM ring. A low-priority task
+ * writes the ring to the serial port, and tools/lbm_log_decode.py turns the records back into text by hashing
+ * the format strings found in the sources.
+ *
+ * Record: 0xA5, length of the rest (u8), level (u8, bit 7 set for LBM_LOG_*_ARRAY), id (u32 LE),
+ * timestamp ms (u32 LE), then per conversion: %s as length (u8) and up to LBM_LOG_MAX_STRING characters,
+ * %f / %e / %g as a float (u32 LE), 8-byte integers as a u64 LE, %p as the low 32 bits of the address, anything
+ * else as a u32 LE. 8-byte integers are %lld / %llu / %jd, and %ld / %zu on a 64-bit host (decode with --lp64).
+ * An array record carries length (u8) and bytes.
+ * Id 0 reports records dropped because the ring was full (u32 count).
+ */
+
+#ifndef LBM_LOG_H
+#define LBM_LOG_H
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC CONSTANTS --------------------------------------------------------
+ */
+
+#define LBM_LOG_LEVEL_NONE 0
+#define LBM_LOG_LEVEL_ERROR 1
+#define LBM_LOG_LEVEL_WARN 2
+#define LBM_LOG_LEVEL_INFO 3
+#define LBM_LOG_LEVEL_DEBUG 4
+
+/**
+ * @brief Most verbose level compiled in
+ */
+#ifndef LBM_LOG_LEVEL
+#define LBM_LOG_LEVEL LBM_LOG_LEVEL_INFO
+#endif
+
+/**
+ * @brief 1: tokenized records drained by a task, 0: immediate Serial.printf()
+ */
+#ifndef LBM_LOG_DEFERRED
+#define LBM_LOG_DEFERRED 0
+#endif
+
+/**
+ * @brief Size of the record ring in bytes (power of 2)
+ */
+#ifndef LBM_LOG_BUFFER_SIZE
+#define LBM_LOG_BUFFER_SIZE 2048
+#endif
+
+/**
+ * @brief Longest string argument kept in a record
+ */
+#ifndef LBM_LOG_MAX_STRING
+#define LBM_LOG_MAX_STRING 24
+#endif
+
+/**
+ * @brief Longest record, header included (at most 255)
+ */
+#ifndef LBM_LOG_MAX_RECORD_SIZE
+#define LBM_LOG_MAX_RECORD_SIZE 96
+#endif
+
+/**
+ * @brief Period of the drain task
+ */
+#ifndef LBM_LOG_DRAIN_PERIOD_MS
+#define LBM_LOG_DRAIN_PERIOD_MS 50
+#endif
+
+/**
+ * @brief Priority of the drain task, keep it below the task running the modem engine when possible
+ */
+#ifndef LBM_LOG_TASK_PRIORITY
+#define LBM_LOG_TASK_PRIORITY 1
+#endif
+
+#define LBM_LOG_SYNC 0xA5
+#define LBM_LOG_ARRAY_FLAG 0x80
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC TYPES ------------------------------------------------------------
+ */
+
+/**
+ * @brief Deferred backend counters
+ */
+typedef struct lbm_log_stats_s
+{
+    uint32_t records;         //!< records written to the ring
+    uint32_t dropped;         //!< records lost because the ring was full
+    uint32_t bytes_drained;   //!< bytes handed to the output
+    uint32_t depth;           //!< bytes currently in the ring
+    uint32_t high_watermark;  //!< highest depth seen
+} lbm_log_stats_t;
+
+/**
+ * @brief Output of the drained bytes
+ */
+typedef void ( *lbm_log_sink_t )( const uint8_t* data, uint32_t size );
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS PROTOTYPES --------------------------------------------
+ */
+
+/**
+ * @brief Start the drain task (deferred backend on target, no-op otherwise)
+ */
+void lbm_log_start( void );
+
+/**
+ * @brief Write the pending records to the sink
+ *
+ * @return Number of bytes drained
+ */
+uint32_t lbm_log_drain( void );
+
+/**
+ * @brief Replace the output (default: Serial on target, discarded on the host), NULL discards
+ */
+void lbm_log_set_sink( lbm_log_sink_t sink );
+
+/**
+ * @brief Read the counters
+ */
+void lbm_log_get_stats( lbm_log_stats_t* stats );
+
+/**
+ * @brief Clear the counters (pending records are kept)
+ */
+void lbm_log_reset_stats( void );
+
+/**
+ * @brief Append an encoded record to the ring (any task)
+ */
+void lbm_log_commit( const uint8_t* record, uint32_t size );
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- RECORD ENCODING ---------------------------------------------------------
+ */
+
+#if LBM_LOG_DEFERRED
+
+#include <type_traits>
+
+/**
+ * @brief FNV-1a hash of a format string, evaluated by the compiler
+ */
+constexpr uint32_t lbm_log_hash( const char* s, uint32_t h = 2166136261u )
+{
+    return ( *s == 0 ) ? h : lbm_log_hash( s + 1, ( h ^ ( uint8_t ) *s ) * 16777619u );
+}
+
+#define LBM_LOG_ID( fmt ) ( std::integral_constant< uint32_t, lbm_log_hash( fmt ) >::value )
+
+class LBMLogRecord
+{
+public:
+    LBMLogRecord( uint8_t level, uint32_t id );
+
+    void put( const char* s );
+    void put( char* s ) { put( ( const char* ) s ); }
+    void put( float value );
+    void put( double value ) { put( ( float ) value ); }
+    void putArray( const uint8_t* data, uint32_t size );
+    template< typename T >
+    void put( T value )
+    {
+        static_assert( std::is_integral< T >::value || std::is_enum< T >::value || std::is_pointer< T >::value,
+                       "unsupported log argument" );
+        putInteger( value, std::integral_constant< bool, ( sizeof( T ) > 4 ) && !std::is_pointer< T >::value >( ) );
+    }
+
+    void pack( ) {}
+    template< typename T, typename... Rest >
+    void pack( T value, Rest... rest )
+    {
+        put( value );
+        pack( rest... );
+    }
+
+    void commit( );
+
+private:
+    template< typename T >
+    void putInteger( T value, std::false_type )
+    {
+        putWord( ( uint32_t ) ( uintptr_t ) value );
+    }
+    template< typename T >
+    void putInteger( T value, std::true_type )
+    {
+        putDoubleWord( ( uint64_t ) value );
+    }
+    void putWord( uint32_t word );
+    void putDoubleWord( uint64_t word );
+
+    uint8_t buffer[LBM_LOG_MAX_RECORD_SIZE];
+    uint8_t size;
+};
+
+template< typename... Args >
+inline void lbm_log_write( uint8_t level, uint32_t id, Args... args )
+{
+    LBMLogRecord record( level, id );
+    record.pack( args... );
+    record.commit( );
+}
+
+inline void lbm_log_write_array( uint8_t level, uint32_t id, const uint8_t* data, uint32_t size )
+{
+    LBMLogRecord record( level | LBM_LOG_ARRAY_FLAG, id );
+    record.putArray( data, size );
+    record.commit( );
+}
+
+#define LBM_LOG_WRITE( level, fmt, ... ) lbm_log_write( level, LBM_LOG_ID( fmt ), ##__VA_ARGS__ )
+#define LBM_LOG_WRITE_ARRAY( level, label, data, size ) \
+    lbm_log_write_array( level, LBM_LOG_ID( label ), ( const uint8_t* ) ( data ), size )
+
+#else
+
+#include <Arduino.h>
+
+/**
+ * @brief Print "label: XX XX ..." immediately
+ */
+void lbm_log_print_array( const char* label, const uint8_t* data, uint32_t size );
+
+#define LBM_LOG_WRITE( level, fmt, ... ) Serial.printf( fmt, ##__VA_ARGS__ )
+#define LBM_LOG_WRITE_ARRAY( level, label, data, size ) \
+    lbm_log_print_array( label, ( const uint8_t* ) ( data ), size )
+
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC MACROS -----------------------------------------------------------
+ */
+
+#define LBM_LOG_DISCARD( ) \
+    do                     \
+    {                      \
+    } while( 0 )
+
+#if LBM_LOG_LEVEL >= LBM_LOG_LEVEL_ERROR
+#define LBM_LOG_ERROR( fmt, ... ) LBM_LOG_WRITE( LBM_LOG_LEVEL_ERROR, fmt, ##__VA_ARGS__ )
+#define LBM_LOG_ERROR_ARRAY( label, data, size ) LBM_LOG_WRITE_ARRAY( LBM_LOG_LEVEL_ERROR, label, data, size )
+#else
+#define LBM_LOG_ERROR( fmt, ... ) LBM_LOG_DISCARD( )
+#define LBM_LOG_ERROR_ARRAY( label, data, size ) LBM_LOG_DISCARD( )
+#endif
+
+#if LBM_LOG_LEVEL >= LBM_LOG_LEVEL_WARN
+#define LBM_LOG_WARN( fmt, ... ) LBM_LOG_WRITE( LBM_LOG_LEVEL_WARN, fmt, ##__VA_ARGS__ )
+#define LBM_LOG_WARN_ARRAY( label, data, size ) LBM_LOG_WRITE_ARRAY( LBM_LOG_LEVEL_WARN, label, data, size )
+#else
+#define LBM_LOG_WARN( fmt, ... ) LBM_LOG_DISCARD( )
+#define LBM_LOG_WARN_ARRAY( label, data, size ) LBM_LOG_DISCARD( )
+#endif
+
+#if LBM_LOG_LEVEL >= LBM_LOG_LEVEL_INFO
+#define LBM_LOG_INFO( fmt, ... ) LBM_LOG_WRITE( LBM_LOG_LEVEL_INFO, fmt, ##__VA_ARGS__ )
+#define LBM_LOG_INFO_ARRAY( label, data, size ) LBM_LOG_WRITE_ARRAY( LBM_LOG_LEVEL_INFO, label, data, size )
+#else
+#define LBM_LOG_INFO( fmt, ... ) LBM_LOG_DISCARD( )
+#define LBM_LOG_INFO_ARRAY( label, data, size ) LBM_LOG_DISCARD( )
+#endif
+
+#if LBM_LOG_LEVEL >= LBM_LOG_LEVEL_DEBUG
+#define LBM_LOG_DEBUG( fmt, ... ) LBM_LOG_WRITE( LBM_LOG_LEVEL_DEBUG, fmt, ##__VA_ARGS__ )
+#define LBM_LOG_DEBUG_ARRAY( label, data, size ) LBM_LOG_WRITE_ARRAY( LBM_LOG_LEVEL_DEBUG, label, data, size )
+#else
+#define LBM_LOG_DEBUG( fmt, ... ) LBM_LOG_DISCARD( )
+#define LBM_LOG_DEBUG_ARRAY( label, data, size ) LBM_LOG_DISCARD( )
+#endif
+
+#endif  // LBM_LOG_H
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,334 @@
+/*!
+ * \file      lbm_lr_fhss.cpp
+ *
+ * \brief     LR-FHSS uplinks: data rates of the region, ADR distributions mixing them in, one-off LR-FHSS uplinks
+ */
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <string.h>
+
+#include "lbm_lr_fhss.h"
+#include "lbm_airtime.h"
+#include "lbm_core.h"
+#include "lbm_log.h"
+#include "lbm_uplink.h"
+
+extern "C" {
+#include "lorawan_api.h"
+#include "lr1_stack_mac_layer.h"
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE TYPES -----------------------------------------------------------
+ */
+
+typedef struct adr_state_s
+{
+    smtc_modem_adr_profile_t profile;  //!< last one set by the application
+    uint8_t                  distribution[SMTC_MODEM_CUSTOM_ADR_DATA_LENGTH];  //!< of a custom profile
+    bool                     borrowed;  //!< an lbm_lr_fhss_send() uplink runs on a profile of its own
+    lbm_uplink_ticket_t      ticket;    //!< that uplink, whose completion puts the profile back
+} adr_state_t;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE VARIABLES -------------------------------------------------------
+ */
+
+// The modem starts network controlled
+static adr_state_t states[LBM_NUMBER_OF_STACKS];
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DECLARATION -------------------------------------------
+ */
+
+/**
+ * @brief Data rate table of the region of a stack, NULL if lbm_airtime does not know it
+ */
+static const lbm_airtime_datarate_t* get_table( uint8_t stack_id );
+
+/**
+ * @brief Apply the profile the application set
+ */
+static smtc_modem_return_code_t restore_profile( uint8_t stack_id );
+
+/**
+ * @brief Hand-over of an lbm_lr_fhss_send() ticket: custom profile holding its data rate (context) alone
+ */
+static smtc_modem_return_code_t borrow_profile( const lbm_uplink_result_t* result, bool undo, void* context );
+
+/**
+ * @brief Completion of an lbm_lr_fhss_send() ticket: profile of the application back
+ */
+static void on_uplink_done( const lbm_uplink_result_t* result, void* context );
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS DEFINITION ---------------------------------------------
+ */
+
+smtc_modem_return_code_t lbm_lr_fhss_get_datarates( uint8_t stack_id, uint16_t* datarates )
+{
+    uint16_t                       enabled = 0;
+    const smtc_modem_return_code_t ret     = smtc_modem_get_enabled_datarates( stack_id, &enabled );
+    if( ret != SMTC_MODEM_RC_OK )
+    {
+        return ret;
+    }
+
+    *datarates                          = 0;
+    const lbm_airtime_datarate_t* table = get_table( stack_id );
+    for( uint8_t dr = 0; ( table != nullptr ) && ( dr < LBM_AIRTIME_NB_DATARATES ); dr++ )
+    {
+        if( ( table[dr].modulation == LBM_AIRTIME_LR_FHSS ) && ( table[dr].max_payload != 0 ) &&
+            ( ( enabled & ( 1u << dr ) ) != 0 ) )
+        {
+            *datarates |= ( uint16_t ) ( 1u << dr );
+        }
+    }
+    return SMTC_MODEM_RC_OK;
+}
+
+smtc_modem_return_code_t lbm_lr_fhss_set_adr_profile( uint8_t stack_id, smtc_modem_adr_profile_t profile,
+                                                      const uint8_t distribution[SMTC_MODEM_CUSTOM_ADR_DATA_LENGTH] )
+{
+    if( stack_id >= LBM_NUMBER_OF_STACKS )
+    {
+        return SMTC_MODEM_RC_INVALID_STACK_ID;
+    }
+    adr_state_t* state = &states[stack_id];
+
+    if( state->borrowed == false )
+    {
+        const smtc_modem_return_code_t ret = smtc_modem_adr_set_profile( stack_id, profile, distribution );
+        if( ret != SMTC_MODEM_RC_OK )
+        {
+            return ret;
+        }
+    }
+    state->profile = profile;
+    if( ( profile == SMTC_MODEM_ADR_PROFILE_CUSTOM ) && ( distribution != nullptr ) )
+    {
+        memcpy( state->distribution, distribution, sizeof( state->distribution ) );
+    }
+    return SMTC_MODEM_RC_OK;
+}
+
+smtc_modem_return_code_t lbm_lr_fhss_set_distribution( uint8_t stack_id, uint8_t lr_fhss_percent,
+                                                       const uint8_t distribution[SMTC_MODEM_CUSTOM_ADR_DATA_LENGTH] )
+{
+    if( stack_id >= LBM_NUMBER_OF_STACKS )
+    {
+        return SMTC_MODEM_RC_INVALID_STACK_ID;
+    }
+    uint16_t                 lr_fhss = 0;
+    smtc_modem_return_code_t ret     = lbm_lr_fhss_get_datarates( stack_id, &lr_fhss );
+    if( ret != SMTC_MODEM_RC_OK )
+    {
+        return ret;
+    }
+    if( ( lr_fhss_percent > 100 ) || ( ( lr_fhss_percent > 0 ) && ( lr_fhss == 0 ) ) )
+    {
+        return SMTC_MODEM_RC_INVALID;
+    }
+
+    // Weights of the other data rates: given, of the last custom profile, or all on the network data rate
+    uint8_t base[SMTC_MODEM_CUSTOM_ADR_DATA_LENGTH] = { 0 };
+    if( distribution != nullptr )
+    {
+        memcpy( base, distribution, sizeof( base ) );
+    }
+    else if( states[stack_id].profile == SMTC_MODEM_ADR_PROFILE_CUSTOM )
+    {
+        memcpy( base, states[stack_id].distribution, sizeof( base ) );
+    }
+    else
+    {
+        const lr1_stack_mac_t* mac = lorawan_api_stack_mac_get( stack_id );
+        if( ( mac == nullptr ) || ( mac->tx_data_rate_adr >= SMTC_MODEM_CUSTOM_ADR_DATA_LENGTH ) )
+        {
+            return SMTC_MODEM_RC_FAIL;
+        }
+        base[mac->tx_data_rate_adr] = 1;
+    }
+
+    const lbm_airtime_datarate_t* table = get_table( stack_id );
+    uint32_t                      sum   = 0;
+    for( uint8_t dr = 0; dr < SMTC_MODEM_CUSTOM_ADR_DATA_LENGTH; dr++ )
+    {
+        const bool is_lr_fhss =
+            ( table != nullptr ) && ( dr < LBM_AIRTIME_NB_DATARATES ) && ( table[dr].modulation == LBM_AIRTIME_LR_FHSS );
+        if( is_lr_fhss == true )
+        {
+            base[dr] = 0;
+        }
+        sum += base[dr];
+    }
+    if( ( sum == 0 ) && ( lr_fhss_percent < 100 ) )
+    {
+        return SMTC_MODEM_RC_INVALID;
+    }
+
+    // Scale to 100 - lr_fhss_percent, the rounding loss going to the heaviest data rate
+    uint8_t mixed[SMTC_MODEM_CUSTOM_ADR_DATA_LENGTH] = { 0 };
+    uint8_t heaviest                                 = 0;
+    uint8_t total                                    = 0;
+    for( uint8_t dr = 0; ( sum != 0 ) && ( dr < SMTC_MODEM_CUSTOM_ADR_DATA_LENGTH ); dr++ )
+    {
+        mixed[dr] = ( uint8_t ) ( base[dr] * ( 100u - lr_fhss_percent ) / sum );
+        total += mixed[dr];
+        if( base[dr] > base[heaviest] )
+        {
+            heaviest = dr;
+        }
+    }
+    if( sum != 0 )
+    {
+        mixed[heaviest] += ( uint8_t ) ( 100u - lr_fhss_percent - total );
+    }
+
+    // LR-FHSS share split evenly, the remainder to the first one
+    const uint8_t count = ( uint8_t ) __builtin_popcount( lr_fhss );
+    bool          first = true;
+    for( uint8_t dr = 0; ( lr_fhss_percent > 0 ) && ( dr < SMTC_MODEM_CUSTOM_ADR_DATA_LENGTH ); dr++ )
+    {
+        if( ( lr_fhss & ( 1u << dr ) ) != 0 )
+        {
+            mixed[dr] = ( uint8_t ) ( lr_fhss_percent / count + ( ( first == true ) ? lr_fhss_percent % count : 0 ) );
+            first     = false;
+        }
+    }
+
+    ret = lbm_lr_fhss_set_adr_profile( stack_id, SMTC_MODEM_ADR_PROFILE_CUSTOM, mixed );
+    LBM_LOG_INFO( "LR-FHSS: %u %% of the uplinks on DR mask 0x%04X, result %d\n", lr_fhss_percent, lr_fhss, ret );
+    return ret;
+}
+
+smtc_modem_return_code_t lbm_lr_fhss_send( uint8_t stack_id, uint8_t datarate, uint8_t port, bool confirmed,
+                                           const uint8_t* payload, uint8_t size )
+{
+    if( stack_id >= LBM_NUMBER_OF_STACKS )
+    {
+        return SMTC_MODEM_RC_INVALID_STACK_ID;
+    }
+    uint16_t                 lr_fhss = 0;
+    smtc_modem_return_code_t ret     = lbm_lr_fhss_get_datarates( stack_id, &lr_fhss );
+    if( ret != SMTC_MODEM_RC_OK )
+    {
+        return ret;
+    }
+    const lbm_airtime_datarate_t* table = get_table( stack_id );
+    if( datarate == LBM_LR_FHSS_ANY_DATARATE )
+    {
+        for( uint8_t dr = 0; dr < LBM_AIRTIME_NB_DATARATES; dr++ )
+        {
+            if( ( ( lr_fhss & ( 1u << dr ) ) != 0 ) && ( size <= table[dr].max_payload ) )
+            {
+                datarate = dr;
+                break;
+            }
+        }
+    }
+    if( ( datarate >= LBM_AIRTIME_NB_DATARATES ) || ( ( lr_fhss & ( 1u << datarate ) ) == 0 ) ||
+        ( size > table[datarate].max_payload ) )
+    {
+        return SMTC_MODEM_RC_INVALID;
+    }
+
+    // The profile is borrowed from the hand-over of the ticket to its completion: the data rate is drawn from
+    // the distribution when the frame is built, and no other uplink is taken by the modem meanwhile
+    lbm_uplink_ticket_t ticket;
+    ret = lbm_uplink_submit_prepared( stack_id, port, confirmed, payload, size, borrow_profile, on_uplink_done,
+                                      ( void* ) ( uintptr_t ) datarate, &ticket );
+    if( ret == SMTC_MODEM_RC_OK )
+    {
+        LBM_LOG_INFO( "LR-FHSS: %u bytes on port %u at DR%u, ticket %u\n", size, port, datarate, ticket );
+    }
+    return ret;
+}
+
+void lbm_lr_fhss_on_event( const smtc_modem_event_t* event )
+{
+    // A new session or a modem reset starts on the profile of the modem, no uplink of ours is pending any more
+    if( ( ( event->event_type == SMTC_MODEM_EVENT_JOINED ) || ( event->event_type == SMTC_MODEM_EVENT_RESET ) ) &&
+        ( event->stack_id < LBM_NUMBER_OF_STACKS ) )
+    {
+        lbm_lr_fhss_on_leave( event->stack_id );
+    }
+}
+
+void lbm_lr_fhss_on_leave( uint8_t stack_id )
+{
+    if( stack_id < LBM_NUMBER_OF_STACKS )
+    {
+        states[stack_id].borrowed = false;
+        states[stack_id].ticket   = LBM_UPLINK_NO_TICKET;
+    }
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DEFINITION --------------------------------------------
+ */
+
+static const lbm_airtime_datarate_t* get_table( uint8_t stack_id )
+{
+    smtc_modem_region_t region;
+    if( smtc_modem_get_region( stack_id, &region ) != SMTC_MODEM_RC_OK )
+    {
+        return nullptr;
+    }
+    return lbm_airtime_get_table( region );
+}
+
+static smtc_modem_return_code_t restore_profile( uint8_t stack_id )
+{
+    adr_state_t* state = &states[stack_id];
+    state->borrowed    = false;
+    state->ticket      = LBM_UPLINK_NO_TICKET;
+
+    const smtc_modem_return_code_t ret = smtc_modem_adr_set_profile(
+        stack_id, state->profile, ( state->profile == SMTC_MODEM_ADR_PROFILE_CUSTOM ) ? state->distribution : nullptr );
+    if( ret != SMTC_MODEM_RC_OK )
+    {
+        LBM_LOG_WARN( "LR-FHSS: ADR profile %u not restored, result %d\n", state->profile, ret );
+    }
+    return ret;
+}
+
+static smtc_modem_return_code_t borrow_profile( const lbm_uplink_result_t* result, bool undo, void* context )
+{
+    if( undo == true )
+    {
+        return restore_profile( result->stack_id );
+    }
+
+    uint8_t only[SMTC_MODEM_CUSTOM_ADR_DATA_LENGTH] = { 0 };
+    only[( uintptr_t ) context]                     = 100;
+    const smtc_modem_return_code_t ret =
+        smtc_modem_adr_set_profile( result->stack_id, SMTC_MODEM_ADR_PROFILE_CUSTOM, only );
+    if( ret == SMTC_MODEM_RC_OK )
+    {
+        states[result->stack_id].borrowed = true;
+        states[result->stack_id].ticket   = result->ticket;
+    }
+    return ret;
+}
+
+static void on_uplink_done( const lbm_uplink_result_t* result, void* context )
+{
+    ( void ) context;
+    const adr_state_t* state = &states[result->stack_id];
+    if( ( state->borrowed == true ) && ( state->ticket == result->ticket ) )
+    {
+        restore_profile( result->stack_id );
+    }
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,110 @@
+/*!
+ * \file      lbm_lr_fhss.h
+ *
+ * \brief     LR-FHSS uplinks: data rates of the region, ADR distributions mixing them in, one-off LR-FHSS uplinks
+ *
+ * LR-FHSS (EU868 DR8-DR11) hops each frame over tens of narrow channels of a 137 or 336 kHz occupied channel
+ * width and repeats its header, so far more devices share a gateway than with LoRa, at the cost of a longer
+ * time on air for the same payload. The modem sends them like any other data rate once the network has
+ * enabled them on a channel (NewChannelReq / LinkADRReq); getEnabledDatarates() tells which ones are.
+ *
+ * The modem API has no per-uplink data rate, only the ADR profile. This module remembers the profile the
+ * application set (LoRaWANClass::setADRProfile() goes through it), so that lbm_lr_fhss_send() can switch to a
+ * custom distribution holding the LR-FHSS data rate alone for one uplink and put the profile back once it
+ * completes. The uplink is an lbm_uplink ticket: the profile is switched when the ticket is handed to the
+ * modem and put back by the completion of that ticket, not by whichever TXDONE comes next. With the
+ * network-controlled profile, the data rate the network assigned is kept meanwhile.
+ */
+
+#ifndef LBM_LR_FHSS_H
+#define LBM_LR_FHSS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "smtc_modem_api.h"
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC CONSTANTS --------------------------------------------------------
+ */
+
+/**
+ * @brief Data rate argument of lbm_lr_fhss_send(): the first LR-FHSS data rate enabled that fits the payload
+ */
+#define LBM_LR_FHSS_ANY_DATARATE 0xFF
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS PROTOTYPES --------------------------------------------
+ */
+
+/**
+ * @brief LR-FHSS data rates of the region of a stack that are enabled on its channels
+ *
+ * @param [out] datarates Bit n set for DRn
+ *
+ * @return SMTC_MODEM_RC_OK, or the error of smtc_modem_get_enabled_datarates()
+ */
+smtc_modem_return_code_t lbm_lr_fhss_get_datarates( uint8_t stack_id, uint16_t* datarates );
+
+/**
+ * @brief smtc_modem_adr_set_profile(), remembered to be put back after an LR-FHSS uplink
+ *
+ * While an lbm_lr_fhss_send() uplink is in flight, the profile is only remembered and applies once it completes.
+ */
+smtc_modem_return_code_t lbm_lr_fhss_set_adr_profile( uint8_t stack_id, smtc_modem_adr_profile_t profile,
+                                                      const uint8_t distribution[SMTC_MODEM_CUSTOM_ADR_DATA_LENGTH] );
+
+/**
+ * @brief Custom ADR profile sending lr_fhss_percent of the uplinks with LR-FHSS
+ *
+ * The LR-FHSS data rates enabled share lr_fhss_percent evenly. The weights of distribution (LoRa / FSK data
+ * rates, NULL: those of the last custom profile, or the data rate the network assigned) are scaled to the
+ * rest.
+ *
+ * @return SMTC_MODEM_RC_OK, SMTC_MODEM_RC_INVALID if lr_fhss_percent exceeds 100, if no LR-FHSS data rate is
+ *         enabled or if distribution is empty, or the error of smtc_modem_adr_set_profile()
+ */
+smtc_modem_return_code_t lbm_lr_fhss_set_distribution( uint8_t stack_id, uint8_t lr_fhss_percent,
+                                                       const uint8_t distribution[SMTC_MODEM_CUSTOM_ADR_DATA_LENGTH] );
+
+/**
+ * @brief Send one uplink with an LR-FHSS data rate, whatever the ADR profile
+ *
+ * @param [in] datarate LR-FHSS data rate enabled, or LBM_LR_FHSS_ANY_DATARATE
+ *
+ * Queued as an lbm_uplink ticket behind the other tickets of the stack. The modem refusing the uplink at the
+ * hand-over completes the ticket as LBM_UPLINK_REFUSED (see lbm_uplink_get_stats()).
+ *
+ * @return SMTC_MODEM_RC_OK, SMTC_MODEM_RC_INVALID if the data rate is not an LR-FHSS one enabled or the
+ *         payload does not fit, or the error of lbm_uplink_submit() (SMTC_MODEM_RC_BUSY: every ticket in use)
+ */
+smtc_modem_return_code_t lbm_lr_fhss_send( uint8_t stack_id, uint8_t datarate, uint8_t port, bool confirmed,
+                                           const uint8_t* payload, uint8_t size );
+
+/**
+ * @brief Forget the LR-FHSS uplink in flight on JOINED and RESET (called by the event dispatcher)
+ */
+void lbm_lr_fhss_on_event( const smtc_modem_event_t* event );
+
+/**
+ * @brief Forget the LR-FHSS uplink in flight when the stack leaves the network
+ */
+void lbm_lr_fhss_on_leave( uint8_t stack_id );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // LBM_LR_FHSS_H
+
+/* --- EOF ------------------------------------------------------------------ */
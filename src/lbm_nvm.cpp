@@ -0,0 +1,788 @@
+/*!
+ * \file      lbm_nvm.cpp
+ *
+ * \brief     Write-behind cache in front of the modem context store, with a journal in flash
+ *
+ * Journal layout, in each LBM_NVM_SECTOR_SIZE sector:
+ * - sector header: magic, sequence number and its complement
+ * - base: one SNAPSHOT record per cached context, then a SNAPSHOT_END record
+ * - CHANGE records, appended in place until the sector is full
+ * Records are a kind, the context type, an offset, a size and a CRC-16 of all that and the data. The sector with
+ * the highest sequence number and a complete base is the current one; the others are older versions, reused in
+ * turn.
+ */
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <string.h>
+
+#include "lbm_nvm.h"
+#include "lbm_log.h"
+
+extern "C" {
+#include "smtc_modem_hal.h"
+}
+
+#if !defined( LBM_NATIVE )
+#include "esp_partition.h"
+#include "esp_timer.h"
+#else
+extern "C" {
+#include "sim_clock.h"
+#include "smtc_modem_hal_native.h"
+}
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE CONSTANTS -------------------------------------------------------
+ */
+
+#define LBM_NVM_SECTOR_SIZE 4096
+#define LBM_NVM_PARTITION_LABEL "lbm_nvm"
+
+#define SECTOR_MAGIC 0x4E4D424Cu  // "LBMN"
+#define SECTOR_HEADER_SIZE 16
+#define RECORD_HEADER_SIZE 8
+#define RECORD_ALIGN 4
+
+// Free space under which lbm_nvm_idle() moves to a new sector, so transmissions find room to append
+#define IDLE_SNAPSHOT_THRESHOLD ( LBM_NVM_SECTOR_SIZE / 4 )
+
+#define RECORD_SNAPSHOT 0x01
+#define RECORD_SNAPSHOT_END 0x02
+#define RECORD_CHANGE 0x03
+
+#define NO_SECTOR 0xFF
+
+// The small contexts, rewritten on every change; FUOTA and store-and-forward data go to the HAL
+static const modem_context_type_t cached_types[] = {
+    CONTEXT_MODEM,
+    CONTEXT_KEY_MODEM,
+    CONTEXT_LORAWAN_STACK,
+    CONTEXT_SECURE_ELEMENT,
+    ( modem_context_type_t ) LBM_NVM_CONTEXT_SESSION,
+};
+#define NB_CACHED_CONTEXTS ( sizeof( cached_types ) / sizeof( cached_types[0] ) )
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE TYPES -----------------------------------------------------------
+ */
+
+typedef struct sector_header_s
+{
+    uint32_t magic;
+    uint32_t sequence;
+    uint32_t sequence_check;  // ~sequence
+    uint32_t rfu;
+} sector_header_t;
+
+typedef struct record_header_s
+{
+    uint8_t  kind;
+    uint8_t  context;
+    uint16_t offset;
+    uint16_t size;
+    uint16_t crc;
+} record_header_t;
+
+static_assert( sizeof( sector_header_t ) == SECTOR_HEADER_SIZE, "sector header layout" );
+static_assert( sizeof( record_header_t ) == RECORD_HEADER_SIZE, "record header layout" );
+static_assert( NB_CACHED_CONTEXTS * ( RECORD_HEADER_SIZE + LBM_NVM_CONTEXT_SIZE ) + SECTOR_HEADER_SIZE +
+                       RECORD_HEADER_SIZE <
+                   LBM_NVM_SECTOR_SIZE - IDLE_SNAPSHOT_THRESHOLD,
+               "a snapshot must leave room for changes" );
+
+typedef struct context_cache_s
+{
+    uint8_t  current[LBM_NVM_CONTEXT_SIZE];  // as seen by the modem
+    uint8_t  flushed[LBM_NVM_CONTEXT_SIZE];  // as in the journal
+    uint16_t size;                           // bytes of current known, from the modem, the journal or the HAL
+    uint16_t flushed_size;
+    uint8_t  deferred;    // stores since the journal was written
+    bool     in_journal;  // the base of the current sector holds it
+    bool     bypass;      // too large to cache, the HAL stores it
+} context_cache_t;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE VARIABLES -------------------------------------------------------
+ */
+
+static context_cache_t contexts[NB_CACHED_CONTEXTS];
+
+static bool     mounted        = false;
+static bool     enabled        = false;
+static uint8_t  active_sector  = NO_SECTOR;
+static uint32_t active_seq     = 0;
+static uint32_t write_offset   = 0;
+static bool     active_damaged = false;  // incomplete record at the end: no more appends in this sector
+
+static lbm_nvm_stats_t stats;
+
+static uint8_t record_buffer[RECORD_HEADER_SIZE + LBM_NVM_CONTEXT_SIZE + RECORD_ALIGN];
+
+#if !defined( LBM_NATIVE )
+static const esp_partition_t* partition = nullptr;
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DECLARATION -------------------------------------------
+ */
+
+// HAL functions behind the wrappers at the end of this file
+extern "C" void __real_smtc_modem_hal_context_restore( const modem_context_type_t ctx_type, uint32_t offset,
+                                                       uint8_t* buffer, const uint32_t size );
+extern "C" void __real_smtc_modem_hal_context_store( const modem_context_type_t ctx_type, uint32_t offset,
+                                                     const uint8_t* buffer, const uint32_t size );
+extern "C" void __real_smtc_modem_hal_context_flash_pages_erase( const modem_context_type_t ctx_type, uint32_t offset,
+                                                                 uint8_t nb_page );
+
+static bool     flash_open( void );
+static bool     flash_read( uint32_t address, void* data, uint32_t size );
+static bool     flash_program( uint32_t address, const void* data, uint32_t size );
+static bool     flash_erase( uint32_t address );
+static uint64_t now_us( void );
+
+static context_cache_t* get_cache( modem_context_type_t type );
+static uint16_t         crc16( uint16_t crc, const uint8_t* data, uint32_t size );
+static uint32_t         record_length( uint32_t data_size );
+
+/**
+ * @brief Replay a sector into the cache
+ *
+ * @return false if its base is incomplete, the cache is then left empty
+ */
+static bool replay_sector( uint8_t sector );
+
+/**
+ * @brief Fill current[] from the HAL up to end, for contexts not (fully) in the journal
+ */
+static void import_from_hal( modem_context_type_t type, context_cache_t* cache, uint32_t end );
+
+/**
+ * @brief Stop caching a context that turned out too large, after handing the cached bytes to the HAL
+ */
+static void bypass_cache( modem_context_type_t type, context_cache_t* cache );
+
+static bool is_dirty( const context_cache_t* cache );
+static bool append_record( uint8_t sector, uint32_t* offset, uint8_t kind, uint8_t context, uint16_t data_offset,
+                           const uint8_t* data, uint16_t size );
+static smtc_modem_return_code_t write_changes( void );
+static smtc_modem_return_code_t write_snapshot( void );
+
+/**
+ * @brief Account for the time a caller spent blocked in flash operations
+ */
+static void record_write_time( uint64_t start_us );
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS DEFINITION ---------------------------------------------
+ */
+
+void lbm_nvm_init( void )
+{
+    memset( contexts, 0, sizeof( contexts ) );
+    mounted        = true;
+    active_sector  = NO_SECTOR;
+    active_seq     = 0;
+    write_offset   = 0;
+    active_damaged = false;
+    enabled        = flash_open( );
+    stats.enabled  = enabled;
+    if( enabled == false )
+    {
+        LBM_LOG_WARN( "No %s partition, contexts are written through\n", LBM_NVM_PARTITION_LABEL );
+        return;
+    }
+
+    // Newest sector first, falling back to older ones while their base is incomplete
+    uint32_t tried_below = UINT32_MAX;
+    uint32_t highest_seq = 0;
+    for( ;; )
+    {
+        uint8_t  best     = NO_SECTOR;
+        uint32_t best_seq = 0;
+        for( uint8_t sector = 0; sector < LBM_NVM_SECTOR_COUNT; sector++ )
+        {
+            sector_header_t header;
+            if( ( flash_read( sector * LBM_NVM_SECTOR_SIZE, &header, sizeof( header ) ) == false ) ||
+                ( header.magic != SECTOR_MAGIC ) || ( header.sequence_check != ~header.sequence ) )
+            {
+                continue;
+            }
+            highest_seq = ( header.sequence > highest_seq ) ? header.sequence : highest_seq;
+            if( ( header.sequence < tried_below ) && ( ( best == NO_SECTOR ) || ( header.sequence > best_seq ) ) )
+            {
+                best     = sector;
+                best_seq = header.sequence;
+            }
+        }
+        if( best == NO_SECTOR )
+        {
+            break;
+        }
+        active_seq = best_seq;
+        if( replay_sector( best ) == true )
+        {
+            active_sector = best;
+            break;
+        }
+        tried_below = best_seq;
+    }
+
+    // The next snapshot must outrank every sector header found, complete or not
+    active_seq = highest_seq;
+    LBM_LOG_INFO( "NVM journal: sector %d, %u records replayed, %u discarded\n",
+                  ( active_sector == NO_SECTOR ) ? -1 : active_sector, stats.replayed_records,
+                  stats.discarded_records );
+}
+
+smtc_modem_return_code_t lbm_nvm_flush( void )
+{
+    if( ( mounted == false ) || ( enabled == false ) )
+    {
+        return SMTC_MODEM_RC_OK;
+    }
+    const uint64_t                 start_us = now_us( );
+    const smtc_modem_return_code_t ret      = write_changes( );
+    record_write_time( start_us );
+    return ret;
+}
+
+void lbm_nvm_on_tx( void )
+{
+    // What the frame depends on (frame counter, DevNonce) must survive a reset once it is on air
+    stats.transmissions++;
+    lbm_nvm_flush( );
+}
+
+smtc_modem_return_code_t lbm_nvm_idle( void )
+{
+    if( ( mounted == false ) || ( enabled == false ) )
+    {
+        return SMTC_MODEM_RC_OK;
+    }
+    const uint64_t           start_us = now_us( );
+    smtc_modem_return_code_t ret      = write_changes( );
+    if( ( ret == SMTC_MODEM_RC_OK ) && ( active_sector != NO_SECTOR ) &&
+        ( ( LBM_NVM_SECTOR_SIZE - write_offset ) < IDLE_SNAPSHOT_THRESHOLD ) )
+    {
+        ret = write_snapshot( );
+    }
+    record_write_time( start_us );
+    return ret;
+}
+
+smtc_modem_return_code_t lbm_nvm_sync( void )
+{
+    if( ( mounted == false ) || ( enabled == false ) )
+    {
+        return SMTC_MODEM_RC_OK;
+    }
+    const uint64_t                 start_us = now_us( );
+    const smtc_modem_return_code_t ret      = write_snapshot( );
+    record_write_time( start_us );
+    return ret;
+}
+
+smtc_modem_return_code_t lbm_nvm_store_context( lbm_nvm_context_t context, const uint8_t* data, uint16_t size )
+{
+    if( size > LBM_NVM_CONTEXT_SIZE )
+    {
+        return SMTC_MODEM_RC_INVALID;
+    }
+    context_cache_t* cache = get_cache( ( modem_context_type_t ) context );
+    if( cache == nullptr )
+    {
+        return SMTC_MODEM_RC_FAIL;
+    }
+    stats.stores++;
+    if( ( size == cache->size ) && ( memcmp( cache->current, data, size ) == 0 ) )
+    {
+        stats.stores_unchanged++;
+        return SMTC_MODEM_RC_OK;
+    }
+    memcpy( cache->current, data, size );
+    cache->size = ( size > cache->size ) ? size : cache->size;
+    cache->deferred++;
+    if( cache->deferred >= LBM_NVM_MAX_DEFERRED )
+    {
+        return lbm_nvm_flush( );
+    }
+    return SMTC_MODEM_RC_OK;
+}
+
+uint16_t lbm_nvm_restore_context( lbm_nvm_context_t context, uint8_t* data, uint16_t size )
+{
+    const context_cache_t* cache = get_cache( ( modem_context_type_t ) context );
+    if( cache == nullptr )
+    {
+        return 0;
+    }
+    const uint16_t known = ( cache->size < size ) ? cache->size : size;
+    memcpy( data, cache->current, known );
+    return known;
+}
+
+void lbm_nvm_get_stats( lbm_nvm_stats_t* stats_out )
+{
+    *stats_out = stats;
+}
+
+void lbm_nvm_reset_stats( void )
+{
+    const bool was_enabled = stats.enabled;
+    memset( &stats, 0, sizeof( stats ) );
+    stats.enabled = was_enabled;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DEFINITION --------------------------------------------
+ */
+
+#if !defined( LBM_NATIVE )
+
+static bool flash_open( void )
+{
+    partition = esp_partition_find_first( ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, LBM_NVM_PARTITION_LABEL );
+    return ( partition != nullptr ) && ( partition->size >= ( uint32_t ) LBM_NVM_SECTOR_COUNT * LBM_NVM_SECTOR_SIZE );
+}
+
+static bool flash_read( uint32_t address, void* data, uint32_t size )
+{
+    return esp_partition_read( partition, address, data, size ) == ESP_OK;
+}
+
+static bool flash_program( uint32_t address, const void* data, uint32_t size )
+{
+    stats.flash_programs++;
+    stats.flash_bytes += size;
+    return esp_partition_write( partition, address, data, size ) == ESP_OK;
+}
+
+static bool flash_erase( uint32_t address )
+{
+    stats.flash_erases++;
+    return esp_partition_erase_range( partition, address, LBM_NVM_SECTOR_SIZE ) == ESP_OK;
+}
+
+static uint64_t now_us( void )
+{
+    return ( uint64_t ) esp_timer_get_time( );
+}
+
+#else
+
+static bool flash_open( void )
+{
+    return ( uint32_t ) LBM_NVM_SECTOR_COUNT * LBM_NVM_SECTOR_SIZE <= SMTC_MODEM_HAL_NATIVE_FLASH_SIZE;
+}
+
+static bool flash_read( uint32_t address, void* data, uint32_t size )
+{
+    return smtc_modem_hal_native_flash_read( address, ( uint8_t* ) data, size );
+}
+
+static bool flash_program( uint32_t address, const void* data, uint32_t size )
+{
+    stats.flash_programs++;
+    stats.flash_bytes += size;
+    return smtc_modem_hal_native_flash_program( address, ( const uint8_t* ) data, size );
+}
+
+static bool flash_erase( uint32_t address )
+{
+    stats.flash_erases++;
+    return smtc_modem_hal_native_flash_erase_sector( address );
+}
+
+static uint64_t now_us( void )
+{
+    // The simulated flash charges its busy time to the virtual clock
+    return sim_clock_now_us( );
+}
+
+#endif
+
+static context_cache_t* get_cache( modem_context_type_t type )
+{
+    if( mounted == false )
+    {
+        lbm_nvm_init( );
+    }
+    if( enabled == false )
+    {
+        return nullptr;
+    }
+    for( uint32_t i = 0; i < NB_CACHED_CONTEXTS; i++ )
+    {
+        if( cached_types[i] == type )
+        {
+            return ( contexts[i].bypass == true ) ? nullptr : &contexts[i];
+        }
+    }
+    return nullptr;
+}
+
+static uint16_t crc16( uint16_t crc, const uint8_t* data, uint32_t size )
+{
+    // CRC-16/CCITT, bitwise: records are short and written rarely
+    for( uint32_t i = 0; i < size; i++ )
+    {
+        crc ^= ( uint16_t ) data[i] << 8;
+        for( int bit = 0; bit < 8; bit++ )
+        {
+            crc = ( crc & 0x8000 ) ? ( uint16_t ) ( ( crc << 1 ) ^ 0x1021 ) : ( uint16_t ) ( crc << 1 );
+        }
+    }
+    return crc;
+}
+
+static uint32_t record_length( uint32_t data_size )
+{
+    return RECORD_HEADER_SIZE + ( ( data_size + RECORD_ALIGN - 1 ) & ~( uint32_t ) ( RECORD_ALIGN - 1 ) );
+}
+
+static bool replay_sector( uint8_t sector )
+{
+    const uint32_t base_address = sector * LBM_NVM_SECTOR_SIZE;
+    uint32_t       offset       = SECTOR_HEADER_SIZE;
+    bool           base_done    = false;
+    uint32_t       records      = 0;
+
+    while( offset + RECORD_HEADER_SIZE <= LBM_NVM_SECTOR_SIZE )
+    {
+        record_header_t header;
+        if( flash_read( base_address + offset, &header, sizeof( header ) ) == false )
+        {
+            break;
+        }
+        const uint8_t erased[RECORD_HEADER_SIZE] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+        if( memcmp( &header, erased, sizeof( header ) ) == 0 )
+        {
+            // End of the journal
+            write_offset = offset;
+            break;
+        }
+
+        // Anything that does not check out is a record cut by a power loss: it is the last one
+        context_cache_t* cache = nullptr;
+        for( uint32_t i = 0; i < NB_CACHED_CONTEXTS; i++ )
+        {
+            cache = ( cached_types[i] == header.context ) ? &contexts[i] : cache;
+        }
+        bool valid = ( header.size <= LBM_NVM_CONTEXT_SIZE ) && ( header.offset + header.size <= LBM_NVM_CONTEXT_SIZE ) &&
+                     ( offset + record_length( header.size ) <= LBM_NVM_SECTOR_SIZE ) &&
+                     flash_read( base_address + offset + RECORD_HEADER_SIZE, record_buffer, header.size );
+        if( valid == true )
+        {
+            const uint16_t crc = crc16( crc16( 0xFFFF, ( const uint8_t* ) &header, 6 ), record_buffer, header.size );
+            valid              = ( crc == header.crc );
+        }
+        if( valid == true )
+        {
+            switch( header.kind )
+            {
+            case RECORD_SNAPSHOT:
+                valid = ( base_done == false ) && ( cache != nullptr ) && ( header.offset == 0 );
+                break;
+            case RECORD_SNAPSHOT_END:
+                valid = ( base_done == false );
+                break;
+            case RECORD_CHANGE:
+                valid = ( base_done == true ) && ( cache != nullptr ) && ( cache->in_journal == true );
+                break;
+            default:
+                valid = false;
+                break;
+            }
+        }
+        if( valid == false )
+        {
+            stats.discarded_records++;
+            active_damaged = true;
+            break;
+        }
+
+        if( header.kind == RECORD_SNAPSHOT_END )
+        {
+            base_done = true;
+        }
+        else
+        {
+            memcpy( &cache->current[header.offset], record_buffer, header.size );
+            if( header.offset + header.size > cache->size )
+            {
+                cache->size = header.offset + header.size;
+            }
+            cache->in_journal = true;
+        }
+        records++;
+        offset += record_length( header.size );
+        write_offset = offset;
+    }
+
+    if( base_done == false )
+    {
+        memset( contexts, 0, sizeof( contexts ) );
+        active_damaged = false;
+        return false;
+    }
+    for( uint32_t i = 0; i < NB_CACHED_CONTEXTS; i++ )
+    {
+        memcpy( contexts[i].flushed, contexts[i].current, contexts[i].size );
+        contexts[i].flushed_size = contexts[i].size;
+    }
+    stats.replayed_records += records;
+    return true;
+}
+
+static void import_from_hal( modem_context_type_t type, context_cache_t* cache, uint32_t end )
+{
+    if( end > cache->size )
+    {
+        __real_smtc_modem_hal_context_restore( type, cache->size, &cache->current[cache->size], end - cache->size );
+        cache->size = ( uint16_t ) end;
+    }
+}
+
+static void bypass_cache( modem_context_type_t type, context_cache_t* cache )
+{
+    if( cache->size > 0 )
+    {
+        __real_smtc_modem_hal_context_store( type, 0, cache->current, cache->size );
+    }
+    cache->bypass = true;
+    LBM_LOG_WARN( "Context %d larger than %d bytes, written through\n", type, LBM_NVM_CONTEXT_SIZE );
+
+    // Drop it from the journal, or the next boot would restore the cached copy
+    const uint64_t start_us = now_us( );
+    write_snapshot( );
+    record_write_time( start_us );
+}
+
+static bool is_dirty( const context_cache_t* cache )
+{
+    return ( cache->bypass == false ) &&
+           ( ( cache->size != cache->flushed_size ) || ( memcmp( cache->current, cache->flushed, cache->size ) != 0 ) );
+}
+
+static bool append_record( uint8_t sector, uint32_t* offset, uint8_t kind, uint8_t context, uint16_t data_offset,
+                           const uint8_t* data, uint16_t size )
+{
+    record_header_t header = { kind, context, data_offset, size, 0 };
+    header.crc             = crc16( crc16( 0xFFFF, ( const uint8_t* ) &header, 6 ), data, size );
+
+    // One program per record, padding left erased
+    const uint32_t length = record_length( size );
+    memcpy( record_buffer, &header, sizeof( header ) );
+    if( size > 0 )
+    {
+        memcpy( &record_buffer[RECORD_HEADER_SIZE], data, size );
+    }
+    memset( &record_buffer[RECORD_HEADER_SIZE + size], 0xFF, length - RECORD_HEADER_SIZE - size );
+    if( flash_program( sector * LBM_NVM_SECTOR_SIZE + *offset, record_buffer, length ) == false )
+    {
+        return false;
+    }
+    *offset += length;
+    return true;
+}
+
+static smtc_modem_return_code_t write_changes( void )
+{
+    uint32_t needed = 0;
+    bool     dirty  = false;
+    for( uint32_t i = 0; i < NB_CACHED_CONTEXTS; i++ )
+    {
+        context_cache_t* cache = &contexts[i];
+        if( is_dirty( cache ) == false )
+        {
+            continue;
+        }
+        dirty = true;
+        if( cache->in_journal == false )
+        {
+            // Changes need a base to apply to
+            return write_snapshot( );
+        }
+        needed += record_length( cache->size );
+    }
+    if( dirty == false )
+    {
+        return SMTC_MODEM_RC_OK;
+    }
+    if( ( active_sector == NO_SECTOR ) || ( active_damaged == true ) || ( write_offset + needed > LBM_NVM_SECTOR_SIZE ) )
+    {
+        return write_snapshot( );
+    }
+
+    for( uint32_t i = 0; i < NB_CACHED_CONTEXTS; i++ )
+    {
+        context_cache_t* cache = &contexts[i];
+        if( is_dirty( cache ) == false )
+        {
+            continue;
+        }
+
+        // Changed range, bytes the journal does not have yet included
+        uint32_t first = 0;
+        uint32_t last  = cache->size;
+        while( ( first < cache->flushed_size ) && ( cache->current[first] == cache->flushed[first] ) )
+        {
+            first++;
+        }
+        if( cache->size <= cache->flushed_size )
+        {
+            while( ( last > first ) && ( cache->current[last - 1] == cache->flushed[last - 1] ) )
+            {
+                last--;
+            }
+        }
+
+        if( append_record( active_sector, &write_offset, RECORD_CHANGE, ( uint8_t ) cached_types[i], ( uint16_t ) first,
+                           &cache->current[first], ( uint16_t ) ( last - first ) ) == false )
+        {
+            active_damaged = true;
+            return SMTC_MODEM_RC_FAIL;
+        }
+        memcpy( &cache->flushed[first], &cache->current[first], last - first );
+        cache->flushed_size = cache->size;
+        cache->deferred     = 0;
+        stats.journal_records++;
+    }
+    return SMTC_MODEM_RC_OK;
+}
+
+static smtc_modem_return_code_t write_snapshot( void )
+{
+    // The current sector stays valid until the new one has a complete base
+    const uint8_t  sector = ( active_sector == NO_SECTOR ) ? 0 : ( uint8_t ) ( ( active_sector + 1 ) % LBM_NVM_SECTOR_COUNT );
+    const uint32_t seq    = active_seq + 1;
+
+    const sector_header_t header = { SECTOR_MAGIC, seq, ~seq, 0xFFFFFFFF };
+    uint32_t              offset = SECTOR_HEADER_SIZE;
+    bool                  ok     = flash_erase( sector * LBM_NVM_SECTOR_SIZE ) &&
+                flash_program( sector * LBM_NVM_SECTOR_SIZE, &header, sizeof( header ) );
+    for( uint32_t i = 0; ( ok == true ) && ( i < NB_CACHED_CONTEXTS ); i++ )
+    {
+        if( ( contexts[i].bypass == false ) && ( contexts[i].size > 0 ) )
+        {
+            ok = append_record( sector, &offset, RECORD_SNAPSHOT, ( uint8_t ) cached_types[i], 0, contexts[i].current,
+                                contexts[i].size );
+        }
+    }
+    ok = ok && append_record( sector, &offset, RECORD_SNAPSHOT_END, 0, 0, nullptr, 0 );
+
+    // A sequence number is never reused, even by a failed attempt
+    active_seq = seq;
+    if( ok == false )
+    {
+        return SMTC_MODEM_RC_FAIL;
+    }
+
+    active_sector  = sector;
+    write_offset   = offset;
+    active_damaged = false;
+    for( uint32_t i = 0; i < NB_CACHED_CONTEXTS; i++ )
+    {
+        context_cache_t* cache = &contexts[i];
+        memcpy( cache->flushed, cache->current, cache->size );
+        cache->flushed_size = cache->size;
+        cache->deferred     = 0;
+        cache->in_journal   = ( cache->bypass == false ) && ( cache->size > 0 );
+    }
+    stats.snapshots++;
+    return SMTC_MODEM_RC_OK;
+}
+
+static void record_write_time( uint64_t start_us )
+{
+    const uint64_t elapsed_us = now_us( ) - start_us;
+    if( elapsed_us > stats.max_write_us )
+    {
+        stats.max_write_us = ( uint32_t ) elapsed_us;
+    }
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- LINKER WRAPPED FUNCTIONS ------------------------------------------------
+ */
+
+extern "C" void __wrap_smtc_modem_hal_context_restore( const modem_context_type_t ctx_type, uint32_t offset,
+                                                       uint8_t* buffer, const uint32_t size )
+{
+    context_cache_t* cache = get_cache( ctx_type );
+    if( ( cache != nullptr ) && ( offset + size > LBM_NVM_CONTEXT_SIZE ) )
+    {
+        bypass_cache( ctx_type, cache );
+        cache = nullptr;
+    }
+    if( cache == nullptr )
+    {
+        __real_smtc_modem_hal_context_restore( ctx_type, offset, buffer, size );
+        return;
+    }
+    import_from_hal( ctx_type, cache, offset + size );
+    memcpy( buffer, &cache->current[offset], size );
+}
+
+extern "C" void __wrap_smtc_modem_hal_context_store( const modem_context_type_t ctx_type, uint32_t offset,
+                                                     const uint8_t* buffer, const uint32_t size )
+{
+    context_cache_t* cache = get_cache( ctx_type );
+    if( ( cache != nullptr ) && ( offset + size > LBM_NVM_CONTEXT_SIZE ) )
+    {
+        bypass_cache( ctx_type, cache );
+        cache = nullptr;
+    }
+    if( cache == nullptr )
+    {
+        __real_smtc_modem_hal_context_store( ctx_type, offset, buffer, size );
+        return;
+    }
+
+    stats.stores++;
+    import_from_hal( ctx_type, cache, offset );
+    if( ( offset + size <= cache->size ) && ( memcmp( &cache->current[offset], buffer, size ) == 0 ) )
+    {
+        stats.stores_unchanged++;
+        return;
+    }
+    memcpy( &cache->current[offset], buffer, size );
+    if( offset + size > cache->size )
+    {
+        cache->size = ( uint16_t ) ( offset + size );
+    }
+
+    // Keys are not worth the risk of losing them, and the number of lost stores stays bounded
+    cache->deferred++;
+    if( ( ctx_type == CONTEXT_KEY_MODEM ) || ( ctx_type == CONTEXT_SECURE_ELEMENT ) ||
+        ( cache->deferred >= LBM_NVM_MAX_DEFERRED ) )
+    {
+        lbm_nvm_flush( );
+    }
+}
+
+extern "C" void __wrap_smtc_modem_hal_context_flash_pages_erase( const modem_context_type_t ctx_type, uint32_t offset,
+                                                                 uint8_t nb_page )
+{
+    context_cache_t* cache = get_cache( ctx_type );
+    if( ( cache != nullptr ) && ( offset < cache->size ) )
+    {
+        memset( &cache->current[offset], 0xFF, cache->size - offset );
+        cache->deferred++;
+    }
+    __real_smtc_modem_hal_context_flash_pages_erase( ctx_type, offset, nb_page );
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,173 @@
+/*!
+ * \file      lbm_nvm.h
+ *
+ * \brief     Write-behind cache in front of the modem context store, with a journal in flash
+ *
+ * The modem saves a context (DevNonce, session keys, modem settings) through smtc_modem_hal_context_store() each
+ * time it changes, and the HAL rewrites it in flash: a sector erase and a program every time. The calls are
+ * intercepted at link time (-Wl,--wrap, see [basic_modem] in platformio.ini) for the small contexts (modem,
+ * key, LoRaWAN stack, secure element), which are kept in RAM instead:
+ * - a store only updates RAM; stores that do not change anything are dropped
+ * - changes are appended to a journal in the lbm_nvm flash partition as records holding the changed bytes only,
+ *   without erasing: before every transmission (so a counter sent on air is never rolled back), when the engine
+ *   goes idle, and after LBM_NVM_MAX_DEFERRED stores in a row; key changes are appended at once
+ * - when the journal sector fills up, a snapshot of every context starts the next sector, on idle if possible
+ *
+ * Records carry a CRC: at boot the journal is replayed up to the last complete record, so a power loss at any
+ * point restores the contexts as they were at some earlier store, never older than the last transmission and
+ * at most LBM_NVM_MAX_DEFERRED stores behind.
+ *
+ * Without the lbm_nvm partition (see partitions_rak3112.csv) every call goes to the HAL unchanged. Contexts
+ * missing from the journal are read from the HAL once, so a device keeps its session across the update.
+ *
+ * The journal also keeps contexts of this library (lbm_nvm_context_t), which the HAL has no room for.
+ */
+
+#ifndef LBM_NVM_H
+#define LBM_NVM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "smtc_modem_api.h"
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC CONSTANTS --------------------------------------------------------
+ */
+
+/**
+ * @brief Largest cached context, larger ones go to the HAL
+ */
+#ifndef LBM_NVM_CONTEXT_SIZE
+#define LBM_NVM_CONTEXT_SIZE 512
+#endif
+
+/**
+ * @brief Flash sectors used by the journal, in turn (4 KB each)
+ */
+#ifndef LBM_NVM_SECTOR_COUNT
+#define LBM_NVM_SECTOR_COUNT 16
+#endif
+
+/**
+ * @brief Stores kept in RAM only before the journal is written anyway
+ */
+#ifndef LBM_NVM_MAX_DEFERRED
+#define LBM_NVM_MAX_DEFERRED 8
+#endif
+
+/**
+ * @brief Engine sleep from which lbm_nvm_idle() runs
+ */
+#ifndef LBM_NVM_IDLE_MS
+#define LBM_NVM_IDLE_MS 1000
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC TYPES ------------------------------------------------------------
+ */
+
+/**
+ * @brief Contexts of this library, numbered after the modem_context_type_t of the HAL
+ */
+typedef enum lbm_nvm_context_e
+{
+    LBM_NVM_CONTEXT_SESSION = 0x40,  //!< joined session, see lbm_session.h
+} lbm_nvm_context_t;
+
+/**
+ * @brief Cache and flash counters
+ */
+typedef struct lbm_nvm_stats_s
+{
+    bool     enabled;            //!< false: no lbm_nvm partition, the HAL stores every context
+    uint32_t stores;             //!< context stores from the modem
+    uint32_t stores_unchanged;   //!< stores that did not change the cached context
+    uint32_t journal_records;    //!< change records appended
+    uint32_t snapshots;          //!< journal sectors started with a full snapshot
+    uint32_t transmissions;      //!< radio transmissions (journal written before each)
+    uint32_t flash_programs;     //!< program operations
+    uint32_t flash_erases;       //!< sector erases
+    uint32_t flash_bytes;        //!< bytes programmed
+    uint32_t max_write_us;       //!< longest time a caller was blocked by flash operations
+    uint32_t replayed_records;   //!< records replayed at boot
+    uint32_t discarded_records;  //!< incomplete records found at boot (power loss while writing)
+} lbm_nvm_stats_t;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS PROTOTYPES --------------------------------------------
+ */
+
+/**
+ * @brief Mount the journal and rebuild the cached contexts, before the modem is initialized
+ */
+void lbm_nvm_init( void );
+
+/**
+ * @brief Append the pending changes to the journal
+ *
+ * Called before every transmission.
+ */
+smtc_modem_return_code_t lbm_nvm_flush( void );
+
+/**
+ * @brief A transmission starts: flush, so the frame counter sent on air is never rolled back
+ */
+void lbm_nvm_on_tx( void );
+
+/**
+ * @brief Append the pending changes, and start a new sector with a snapshot if the current one is nearly full
+ *
+ * Called by the engine runner when the modem sleeps for LBM_NVM_IDLE_MS or more.
+ */
+smtc_modem_return_code_t lbm_nvm_idle( void );
+
+/**
+ * @brief Write a full snapshot of the contexts now, e.g. before the power is switched off
+ *
+ * @return SMTC_MODEM_RC_OK, SMTC_MODEM_RC_FAIL if the flash could not be written
+ */
+smtc_modem_return_code_t lbm_nvm_sync( void );
+
+/**
+ * @brief Update a context of this library, written to the journal like the modem contexts (before the next
+ *        transmission at the latest)
+ *
+ * @return SMTC_MODEM_RC_OK, SMTC_MODEM_RC_FAIL without the lbm_nvm partition, SMTC_MODEM_RC_INVALID if larger than
+ *         LBM_NVM_CONTEXT_SIZE
+ */
+smtc_modem_return_code_t lbm_nvm_store_context( lbm_nvm_context_t context, const uint8_t* data, uint16_t size );
+
+/**
+ * @brief Read a context of this library back
+ *
+ * A context never shrinks: after a smaller store, the bytes past its end are those of the larger one.
+ *
+ * @return Bytes known (from the journal or the last store), 0 if it was never stored
+ */
+uint16_t lbm_nvm_restore_context( lbm_nvm_context_t context, uint8_t* data, uint16_t size );
+
+/**
+ * @brief Get / reset the counters
+ */
+void lbm_nvm_get_stats( lbm_nvm_stats_t* stats );
+void lbm_nvm_reset_stats( void );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // LBM_NVM_H
+
+/* --- EOF ------------------------------------------------------------------ */
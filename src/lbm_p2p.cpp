@@ -0,0 +1,750 @@
+/*!
+ * \file      lbm_p2p.cpp
+ *
+ * \brief     Raw LoRa point-to-point links scheduled by the radio planner, next to LoRaWAN
+ */
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <atomic>
+#include <string.h>
+
+#include "lbm_p2p.h"
+#include "lbm_p2p_bulk.h"
+#include "lbm_core.h"
+#include "lbm_engine.h"
+#include "lbm_log.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+extern "C" {
+#include "smtc_modem_hal.h"
+#include "lorawan_api.h"
+#include "lr1_stack_mac_layer.h"
+#include "radio_planner.h"
+#include "radio_planner_stats.h"
+#include "ralf.h"
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE CONSTANTS -------------------------------------------------------
+ */
+
+#if( LBM_P2P_RX_RING_SIZE & ( LBM_P2P_RX_RING_SIZE - 1 ) ) != 0
+#error "LBM_P2P_RX_RING_SIZE must be a power of 2"
+#endif
+
+#if( LBM_P2P_TX_QUEUE_SIZE & ( LBM_P2P_TX_QUEUE_SIZE - 1 ) ) != 0
+#error "LBM_P2P_TX_QUEUE_SIZE must be a power of 2"
+#endif
+
+// Sizes are uint8_t: every one of them fits the buffers, lbm_p2p_send() does not check the upper bound
+static_assert( LBM_P2P_MAX_PAYLOAD == 255, "LBM_P2P_MAX_PAYLOAD must cover every uint8_t size" );
+
+#define RX_RING_MASK ( LBM_P2P_RX_RING_SIZE - 1 )
+#define TX_QUEUE_MASK ( LBM_P2P_TX_QUEUE_SIZE - 1 )
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE TYPES -----------------------------------------------------------
+ */
+
+typedef enum p2p_task_e
+{
+    P2P_TASK_NONE = 0,
+    P2P_TASK_TX,
+    P2P_TASK_RX,
+    P2P_TASK_BULK,  // task of lbm_p2p_bulk, which handles its end
+} p2p_task_t;
+
+typedef struct tx_entry_s
+{
+    lbm_p2p_params_t params;
+    uint8_t          payload[LBM_P2P_MAX_PAYLOAD];
+    uint8_t          size;
+} tx_entry_t;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE VARIABLES -------------------------------------------------------
+ */
+
+static radio_planner_t* rp = nullptr;  // set while the hook is taken
+
+// Settings written by the application, applied by the engine (seqlock: odd while being written)
+static lbm_p2p_params_t      requested_params;
+static std::atomic<uint32_t> requested_version( 0 );
+static uint32_t              applied_version = 0;
+static lbm_p2p_params_t      params;  // engine copy
+
+static std::atomic<bool> rx_enabled( false );
+
+// Frames to send: the application is the producer, the engine the consumer
+static tx_entry_t            tx_queue[LBM_P2P_TX_QUEUE_SIZE];
+static std::atomic<uint32_t> tx_head( 0 );
+static std::atomic<uint32_t> tx_tail( 0 );
+
+// Received frames: the engine is the producer, the application the consumer
+static lbm_p2p_frame_t       rx_ring[LBM_P2P_RX_RING_SIZE];
+static std::atomic<uint32_t> rx_head( 0 );
+static std::atomic<uint32_t> rx_tail( 0 );
+
+// Wakes up lbm_p2p_wait(), may be given while nobody waits
+static SemaphoreHandle_t data_available = nullptr;
+
+// Task handed to the planner, and the buffers it works on until its hook callback
+static p2p_task_t         current_task = P2P_TASK_NONE;
+static bool               aborting     = false;
+static ralf_params_lora_t task_params;
+static uint8_t            task_payload[LBM_P2P_MAX_PAYLOAD];
+static uint8_t            task_size = 0;
+
+// Engine side counters
+static uint32_t stats_start_ms     = 0;
+static uint32_t tx_done            = 0;
+static uint32_t tx_aborted         = 0;
+static uint32_t rx_windows         = 0;
+static uint32_t rx_windows_aborted = 0;
+static uint32_t rx_frames          = 0;
+static uint32_t rx_crc_errors      = 0;
+static uint32_t rx_overflows       = 0;
+static uint32_t rx_high_watermark  = 0;
+
+// Application side counters
+static uint32_t tx_queued        = 0;
+static uint32_t tx_overflows     = 0;
+static uint32_t rx_read          = 0;
+static uint32_t latency_min_ms   = 0;
+static uint32_t latency_max_ms   = 0;
+static uint64_t latency_total_ms = 0;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DECLARATION -------------------------------------------
+ */
+
+/**
+ * @brief Check settings against what the SX1262 and the planner support
+ */
+static bool params_are_valid( const lbm_p2p_params_t* p );
+
+/**
+ * @brief Convert settings to ralf ones for a frame of size bytes (TX) or any frame (RX)
+ */
+static void to_ralf( const lbm_p2p_params_t* p, bool tx, uint8_t size, ralf_params_lora_t* lora );
+
+/**
+ * @brief Take the settings last given by the application, if they were not being written
+ */
+static void apply_requested_params( void );
+
+/**
+ * @brief Hand the next queued frame, else a receive window, to the planner (hook idle)
+ */
+static void schedule_next( void );
+static bool enqueue_tx( void );
+static bool enqueue_rx( void );
+
+/**
+ * @brief Planner callbacks: task launch (radio setup) and end of task
+ */
+static void launch_tx( void* context );
+static void launch_rx( void* context );
+static void on_planner_event( void* context );
+
+/**
+ * @brief Queue a frame read from the radio (producer side)
+ */
+static void push_frame( uint8_t size, int16_t rssi_dbm, int8_t snr_db, uint32_t timestamp_ms );
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS DEFINITION ---------------------------------------------
+ */
+
+void lbm_p2p_get_default_params( lbm_p2p_params_t* p )
+{
+    p->frequency_hz = 869525000;
+    p->sf           = 7;
+    p->bw_khz       = 125;
+    p->cr           = 1;
+    p->tx_power_dbm = 14;
+    p->preamble_len = 8;
+    p->sync_word    = 0x12;
+    p->crc_on       = true;
+    p->iq_inverted  = false;
+}
+
+smtc_modem_return_code_t lbm_p2p_begin( const lbm_p2p_params_t* new_params )
+{
+    lbm_p2p_params_t p;
+    if( new_params != nullptr )
+    {
+        p = *new_params;
+    }
+    else
+    {
+        lbm_p2p_get_default_params( &p );
+    }
+    if( params_are_valid( &p ) == false )
+    {
+        return SMTC_MODEM_RC_INVALID;
+    }
+    if( rp != nullptr )
+    {
+        return SMTC_MODEM_RC_BUSY;
+    }
+
+    // Every stack shares the planner of the modem
+    const lr1_stack_mac_t* mac = lorawan_api_stack_mac_get( STACK_ID );
+    if( ( mac == nullptr ) || ( mac->rp == nullptr ) )
+    {
+        return SMTC_MODEM_RC_FAIL;
+    }
+    if( rp_hook_init( mac->rp, LBM_P2P_HOOK_ID, on_planner_event, mac->rp ) != RP_HOOK_STATUS_OK )
+    {
+        LBM_LOG_WARN( "P2P: planner hook %u already in use\n", LBM_P2P_HOOK_ID );
+        return SMTC_MODEM_RC_BUSY;
+    }
+
+    if( data_available == nullptr )
+    {
+        data_available = xSemaphoreCreateBinary( );
+    }
+    params           = p;
+    requested_params = p;
+    applied_version  = requested_version.load( std::memory_order_relaxed );
+    current_task     = P2P_TASK_NONE;
+    aborting         = false;
+    rp               = mac->rp;
+    lbm_p2p_reset_stats( );
+    LBM_LOG_INFO( "P2P: %u Hz SF%u %u kHz\n", p.frequency_hz, p.sf, p.bw_khz );
+    return SMTC_MODEM_RC_OK;
+}
+
+void lbm_p2p_end( void )
+{
+    if( rp == nullptr )
+    {
+        return;
+    }
+    rx_enabled.store( false, std::memory_order_release );
+    if( current_task != P2P_TASK_NONE )
+    {
+        aborting = true;
+        rp_task_abort( rp, LBM_P2P_HOOK_ID );
+        aborting     = false;
+        current_task = P2P_TASK_NONE;
+    }
+    lbm_p2p_bulk_end( );
+    rp_release_hook( rp, LBM_P2P_HOOK_ID );
+    rp = nullptr;
+
+    // Frames not sent yet are dropped, frames received stay readable
+    tx_tail.store( tx_head.load( std::memory_order_acquire ), std::memory_order_release );
+}
+
+bool lbm_p2p_is_started( void )
+{
+    return rp != nullptr;
+}
+
+smtc_modem_return_code_t lbm_p2p_set_params( const lbm_p2p_params_t* new_params )
+{
+    if( params_are_valid( new_params ) == false )
+    {
+        return SMTC_MODEM_RC_INVALID;
+    }
+    const uint32_t v = requested_version.load( std::memory_order_relaxed );
+    requested_version.store( v + 1, std::memory_order_relaxed );
+    std::atomic_thread_fence( std::memory_order_release );
+    requested_params = *new_params;
+    requested_version.store( v + 2, std::memory_order_release );
+    lbm_engine_notify( );
+    return SMTC_MODEM_RC_OK;
+}
+
+smtc_modem_return_code_t lbm_p2p_send( const uint8_t* payload, uint8_t size, const lbm_p2p_params_t* frame_params )
+{
+    if( rp == nullptr )
+    {
+        return SMTC_MODEM_RC_FAIL;
+    }
+    if( ( payload == nullptr ) || ( size == 0 ) ||
+        ( ( frame_params != nullptr ) && ( params_are_valid( frame_params ) == false ) ) )
+    {
+        return SMTC_MODEM_RC_INVALID;
+    }
+
+    const uint32_t h = tx_head.load( std::memory_order_relaxed );
+    const uint32_t t = tx_tail.load( std::memory_order_acquire );
+    if( ( h - t ) >= LBM_P2P_TX_QUEUE_SIZE )
+    {
+        tx_overflows++;
+        return SMTC_MODEM_RC_BUSY;
+    }
+
+    tx_entry_t* entry = &tx_queue[h & TX_QUEUE_MASK];
+    if( frame_params != nullptr )
+    {
+        entry->params = *frame_params;
+    }
+    else
+    {
+        // Latest settings, even if the engine has not taken them yet
+        uint32_t v;
+        do
+        {
+            v             = requested_version.load( std::memory_order_acquire );
+            entry->params = requested_params;
+            std::atomic_thread_fence( std::memory_order_acquire );
+        } while( ( ( v & 1 ) != 0 ) || ( v != requested_version.load( std::memory_order_relaxed ) ) );
+    }
+    memcpy( entry->payload, payload, size );
+    entry->size = size;
+
+    // Publish the frame
+    tx_head.store( h + 1, std::memory_order_release );
+    tx_queued++;
+    lbm_engine_notify( );
+    return SMTC_MODEM_RC_OK;
+}
+
+smtc_modem_return_code_t lbm_p2p_start_rx( void )
+{
+    if( rp == nullptr )
+    {
+        return SMTC_MODEM_RC_FAIL;
+    }
+    rx_enabled.store( true, std::memory_order_release );
+    lbm_engine_notify( );
+    return SMTC_MODEM_RC_OK;
+}
+
+smtc_modem_return_code_t lbm_p2p_stop_rx( void )
+{
+    if( rp == nullptr )
+    {
+        return SMTC_MODEM_RC_FAIL;
+    }
+    rx_enabled.store( false, std::memory_order_release );
+    lbm_engine_notify( );
+    return SMTC_MODEM_RC_OK;
+}
+
+void lbm_p2p_process( void )
+{
+    if( rp == nullptr )
+    {
+        return;
+    }
+    apply_requested_params( );
+
+    // A receive window gives way to a queued frame or a bulk transfer, or ends when receive is stopped
+    const bool tx_pending = tx_head.load( std::memory_order_acquire ) != tx_tail.load( std::memory_order_relaxed );
+    if( ( current_task == P2P_TASK_RX ) &&
+        ( ( tx_pending == true ) || ( rx_enabled.load( std::memory_order_acquire ) == false ) ||
+          ( lbm_p2p_bulk_is_running( ) == true ) ) )
+    {
+        aborting = true;
+        rp_task_abort( rp, LBM_P2P_HOOK_ID );
+        aborting     = false;
+        current_task = P2P_TASK_NONE;
+    }
+    schedule_next( );
+}
+
+uint32_t lbm_p2p_available( void )
+{
+    return rx_head.load( std::memory_order_acquire ) - rx_tail.load( std::memory_order_relaxed );
+}
+
+bool lbm_p2p_read( lbm_p2p_frame_t* frame )
+{
+    const uint32_t t = rx_tail.load( std::memory_order_relaxed );
+    const uint32_t h = rx_head.load( std::memory_order_acquire );
+
+    if( t == h )
+    {
+        return false;
+    }
+
+    *frame = rx_ring[t & RX_RING_MASK];
+
+    // Hand the slot back to the producer
+    rx_tail.store( t + 1, std::memory_order_release );
+
+    const uint32_t latency_ms = smtc_modem_hal_get_time_in_ms( ) - frame->timestamp_ms;
+    if( ( rx_read == 0 ) || ( latency_ms < latency_min_ms ) )
+    {
+        latency_min_ms = latency_ms;
+    }
+    if( latency_ms > latency_max_ms )
+    {
+        latency_max_ms = latency_ms;
+    }
+    latency_total_ms += latency_ms;
+    rx_read++;
+    return true;
+}
+
+bool lbm_p2p_wait( lbm_p2p_frame_t* frame, uint32_t timeout_ms )
+{
+    const uint32_t start_ms = smtc_modem_hal_get_time_in_ms( );
+
+    for( ;; )
+    {
+        if( lbm_p2p_read( frame ) == true )
+        {
+            return true;
+        }
+        if( data_available == nullptr )
+        {
+            return false;
+        }
+
+        const uint32_t waited_ms = smtc_modem_hal_get_time_in_ms( ) - start_ms;
+        if( waited_ms >= timeout_ms )
+        {
+            return false;
+        }
+
+        const TickType_t ticks =
+            ( timeout_ms == LBM_ENGINE_WAIT_FOREVER ) ? portMAX_DELAY : pdMS_TO_TICKS( timeout_ms - waited_ms );
+        if( xSemaphoreTake( data_available, ticks ) != pdPASS )
+        {
+            // Timed out, last chance for a frame published just before the deadline
+            return lbm_p2p_read( frame );
+        }
+    }
+}
+
+void lbm_p2p_get_stats( lbm_p2p_stats_t* stats )
+{
+    stats->tx_queued          = tx_queued;
+    stats->tx_overflows       = tx_overflows;
+    stats->tx_done            = tx_done;
+    stats->tx_aborted         = tx_aborted;
+    stats->rx_windows         = rx_windows;
+    stats->rx_windows_aborted = rx_windows_aborted;
+    stats->rx_frames          = rx_frames;
+    stats->rx_crc_errors      = rx_crc_errors;
+    stats->rx_overflows       = rx_overflows;
+    stats->rx_read            = rx_read;
+    stats->rx_depth           = rx_head.load( std::memory_order_acquire ) - rx_tail.load( std::memory_order_acquire );
+    stats->rx_high_watermark  = rx_high_watermark;
+    stats->latency_min_ms     = latency_min_ms;
+    stats->latency_avg_ms     = ( rx_read > 0 ) ? ( uint32_t ) ( latency_total_ms / rx_read ) : 0;
+    stats->latency_max_ms     = latency_max_ms;
+    stats->elapsed_ms         = smtc_modem_hal_get_time_in_ms( ) - stats_start_ms;
+    if( stats->elapsed_ms > 0 )
+    {
+        stats->tx_packets_per_s = ( float ) tx_done * 1000.0f / ( float ) stats->elapsed_ms;
+        stats->rx_packets_per_s = ( float ) rx_frames * 1000.0f / ( float ) stats->elapsed_ms;
+    }
+    else
+    {
+        stats->tx_packets_per_s = 0.0f;
+        stats->rx_packets_per_s = 0.0f;
+    }
+}
+
+void lbm_p2p_reset_stats( void )
+{
+    stats_start_ms     = smtc_modem_hal_get_time_in_ms( );
+    tx_done            = 0;
+    tx_aborted         = 0;
+    rx_windows         = 0;
+    rx_windows_aborted = 0;
+    rx_frames          = 0;
+    rx_crc_errors      = 0;
+    rx_overflows       = 0;
+    rx_high_watermark  = 0;
+    tx_queued          = 0;
+    tx_overflows       = 0;
+    rx_read            = 0;
+    latency_min_ms     = 0;
+    latency_max_ms     = 0;
+    latency_total_ms   = 0;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DEFINITION --------------------------------------------
+ */
+
+static bool params_are_valid( const lbm_p2p_params_t* p )
+{
+    if( ( p->sf < 5 ) || ( p->sf > 12 ) || ( p->cr < 1 ) || ( p->cr > 4 ) || ( p->preamble_len == 0 ) )
+    {
+        return false;
+    }
+    return ( p->bw_khz == 62 ) || ( p->bw_khz == 125 ) || ( p->bw_khz == 250 ) || ( p->bw_khz == 500 );
+}
+
+static void to_ralf( const lbm_p2p_params_t* p, bool tx, uint8_t size, ralf_params_lora_t* lora )
+{
+    memset( lora, 0, sizeof( *lora ) );
+    lora->rf_freq_in_hz     = p->frequency_hz;
+    lora->output_pwr_in_dbm = p->tx_power_dbm;
+    lora->sync_word         = p->sync_word;
+    lora->symb_nb_timeout   = 0;  // windows are closed by the RX timeout, not by a symbol count
+
+    lora->mod_params.sf = ( ral_lora_sf_t ) p->sf;
+    switch( p->bw_khz )
+    {
+    case 62:
+        lora->mod_params.bw = RAL_LORA_BW_062_KHZ;
+        break;
+    case 250:
+        lora->mod_params.bw = RAL_LORA_BW_250_KHZ;
+        break;
+    case 500:
+        lora->mod_params.bw = RAL_LORA_BW_500_KHZ;
+        break;
+    default:
+        lora->mod_params.bw = RAL_LORA_BW_125_KHZ;
+        break;
+    }
+    const ral_lora_cr_t coding_rates[] = { RAL_LORA_CR_4_5, RAL_LORA_CR_4_6, RAL_LORA_CR_4_7, RAL_LORA_CR_4_8 };
+    lora->mod_params.cr                = coding_rates[p->cr - 1];
+    lora->mod_params.ldro              = ral_compute_lora_ldro( lora->mod_params.sf, lora->mod_params.bw );
+
+    lora->pkt_params.preamble_len_in_symb = p->preamble_len;
+    lora->pkt_params.header_type          = RAL_LORA_PKT_EXPLICIT;
+    lora->pkt_params.pld_len_in_bytes     = tx ? size : LBM_P2P_MAX_PAYLOAD;
+    lora->pkt_params.crc_is_on            = p->crc_on;
+    lora->pkt_params.invert_iq_is_on      = p->iq_inverted;
+}
+
+static void apply_requested_params( void )
+{
+    const uint32_t v = requested_version.load( std::memory_order_acquire );
+    if( ( v == applied_version ) || ( ( v & 1 ) != 0 ) )
+    {
+        return;
+    }
+    const lbm_p2p_params_t copy = requested_params;
+    std::atomic_thread_fence( std::memory_order_acquire );
+    if( requested_version.load( std::memory_order_relaxed ) == v )
+    {
+        params          = copy;
+        applied_version = v;
+    }
+}
+
+static void schedule_next( void )
+{
+    if( current_task != P2P_TASK_NONE )
+    {
+        return;
+    }
+    // A bulk transfer has the hook to itself until it is over
+    if( ( lbm_p2p_bulk_is_running( ) == true ) && ( lbm_p2p_bulk_schedule( rp ) == true ) )
+    {
+        current_task = P2P_TASK_BULK;
+        return;
+    }
+    // Frames the planner refuses are dropped, the next one gets its chance
+    while( tx_head.load( std::memory_order_acquire ) != tx_tail.load( std::memory_order_relaxed ) )
+    {
+        if( enqueue_tx( ) == true )
+        {
+            return;
+        }
+    }
+    if( rx_enabled.load( std::memory_order_acquire ) == true )
+    {
+        enqueue_rx( );
+    }
+}
+
+static bool enqueue_tx( void )
+{
+    const uint32_t    t     = tx_tail.load( std::memory_order_relaxed );
+    const tx_entry_t* entry = &tx_queue[t & TX_QUEUE_MASK];
+
+    to_ralf( &entry->params, true, entry->size, &task_params );
+    memcpy( task_payload, entry->payload, entry->size );
+    task_size = entry->size;
+
+    // The planner works on task_payload from now on
+    tx_tail.store( t + 1, std::memory_order_release );
+
+    rp_radio_params_t radio_params;
+    memset( &radio_params, 0, sizeof( radio_params ) );
+    radio_params.pkt_type = RAL_PKT_TYPE_LORA;
+    radio_params.tx.lora  = task_params;
+
+    rp_task_t task;
+    memset( &task, 0, sizeof( task ) );
+    task.hook_id                    = LBM_P2P_HOOK_ID;
+    task.type                       = RP_TASK_TYPE_TX_LORA;
+    task.state                      = RP_TASK_STATE_ASAP;
+    task.start_time_ms              = smtc_modem_hal_get_time_in_ms( );
+    task.duration_time_ms           = ral_get_lora_time_on_air_in_ms( &rp->radio->ral, &task_params.pkt_params,
+                                                                      &task_params.mod_params );
+    task.schedule_task_low_priority = false;
+    task.launch_task_callbacks      = launch_tx;
+
+    if( rp_task_enqueue( rp, &task, task_payload, task_size, &radio_params ) != RP_HOOK_STATUS_OK )
+    {
+        tx_aborted++;
+        return false;
+    }
+    current_task = P2P_TASK_TX;
+    return true;
+}
+
+static bool enqueue_rx( void )
+{
+    to_ralf( &params, false, 0, &task_params );
+
+    rp_radio_params_t radio_params;
+    memset( &radio_params, 0, sizeof( radio_params ) );
+    radio_params.pkt_type         = RAL_PKT_TYPE_LORA;
+    radio_params.rx.lora          = task_params;
+    radio_params.rx.timeout_in_ms = LBM_P2P_RX_WINDOW_MS;
+
+    // Low priority: a LoRaWAN task aborts the window even while it runs
+    rp_task_t task;
+    memset( &task, 0, sizeof( task ) );
+    task.hook_id                    = LBM_P2P_HOOK_ID;
+    task.type                       = RP_TASK_TYPE_RX_LORA;
+    task.state                      = RP_TASK_STATE_ASAP;
+    task.start_time_ms              = smtc_modem_hal_get_time_in_ms( );
+    task.duration_time_ms           = LBM_P2P_RX_WINDOW_MS;
+    task.schedule_task_low_priority = true;
+    task.launch_task_callbacks      = launch_rx;
+
+    if( rp_task_enqueue( rp, &task, task_payload, LBM_P2P_MAX_PAYLOAD, &radio_params ) != RP_HOOK_STATUS_OK )
+    {
+        return false;
+    }
+    rx_windows++;
+    current_task = P2P_TASK_RX;
+    return true;
+}
+
+static void launch_tx( void* context )
+{
+    radio_planner_t* planner = ( radio_planner_t* ) context;
+
+    smtc_modem_hal_start_radio_tcxo( );
+    smtc_modem_hal_set_ant_switch( true );
+    if( ( ralf_setup_lora( planner->radio, &task_params ) != RAL_STATUS_OK ) ||
+        ( ral_set_dio_irq_params( &planner->radio->ral, RAL_IRQ_TX_DONE ) != RAL_STATUS_OK ) ||
+        ( ral_set_pkt_payload( &planner->radio->ral, task_payload, task_size ) != RAL_STATUS_OK ) ||
+        ( ral_set_tx( &planner->radio->ral ) != RAL_STATUS_OK ) )
+    {
+        SMTC_MODEM_HAL_PANIC( );
+    }
+    rp_stats_set_tx_timestamp( &planner->stats, smtc_modem_hal_get_time_in_ms( ) );
+}
+
+static void launch_rx( void* context )
+{
+    radio_planner_t* planner = ( radio_planner_t* ) context;
+
+    smtc_modem_hal_start_radio_tcxo( );
+    smtc_modem_hal_set_ant_switch( false );
+    if( ( ralf_setup_lora( planner->radio, &task_params ) != RAL_STATUS_OK ) ||
+        ( ral_set_dio_irq_params( &planner->radio->ral, RAL_IRQ_RX_DONE | RAL_IRQ_RX_TIMEOUT | RAL_IRQ_RX_HDR_ERROR |
+                                                            RAL_IRQ_RX_CRC_ERROR ) != RAL_STATUS_OK ) ||
+        ( ral_set_rx( &planner->radio->ral, LBM_P2P_RX_WINDOW_MS ) != RAL_STATUS_OK ) )
+    {
+        SMTC_MODEM_HAL_PANIC( );
+    }
+    rp_stats_set_rx_timestamp( &planner->stats, smtc_modem_hal_get_time_in_ms( ) );
+}
+
+static void on_planner_event( void* context )
+{
+    radio_planner_t* planner = ( radio_planner_t* ) context;
+    if( aborting == true )
+    {
+        return;  // lbm_p2p_process() or lbm_p2p_end() takes care of the aborted task
+    }
+
+    uint32_t    irq_ms;
+    rp_status_t status;
+    rp_get_status( planner, LBM_P2P_HOOK_ID, &irq_ms, &status );
+
+    const p2p_task_t task = current_task;
+    current_task          = P2P_TASK_NONE;
+    if( task == P2P_TASK_BULK )
+    {
+        lbm_p2p_bulk_on_planner_event( planner, ( uint8_t ) status, irq_ms );
+        schedule_next( );
+        return;
+    }
+    switch( status )
+    {
+    case RP_STATUS_TX_DONE:
+        tx_done++;
+        break;
+    case RP_STATUS_RX_PACKET:
+    {
+        const ral_lora_rx_pkt_status_t* pkt = &planner->radio_params[LBM_P2P_HOOK_ID].rx.lora_pkt_status;
+        push_frame( ( uint8_t ) planner->rx_payload_size[LBM_P2P_HOOK_ID], pkt->rssi_pkt_in_dbm, pkt->snr_pkt_in_db,
+                    irq_ms );
+        break;
+    }
+    case RP_STATUS_RX_CRC_ERROR:
+        rx_crc_errors++;
+        break;
+    case RP_STATUS_TASK_ABORTED:
+        if( task == P2P_TASK_TX )
+        {
+            tx_aborted++;
+        }
+        else
+        {
+            rx_windows_aborted++;
+        }
+        break;
+    default:
+        break;
+    }
+
+    // Next frame, or back to listening
+    schedule_next( );
+}
+
+static void push_frame( uint8_t size, int16_t rssi_dbm, int8_t snr_db, uint32_t timestamp_ms )
+{
+    const uint32_t h = rx_head.load( std::memory_order_relaxed );
+    const uint32_t t = rx_tail.load( std::memory_order_acquire );
+
+    rx_frames++;
+    if( ( h - t ) >= LBM_P2P_RX_RING_SIZE )
+    {
+        rx_overflows++;
+        return;
+    }
+
+    lbm_p2p_frame_t* frame = &rx_ring[h & RX_RING_MASK];
+    memcpy( frame->payload, task_payload, size );
+    frame->size         = size;
+    frame->rssi_dbm     = rssi_dbm;
+    frame->snr_db       = snr_db;
+    frame->timestamp_ms = timestamp_ms;
+
+    // Publish the frame
+    rx_head.store( h + 1, std::memory_order_release );
+    if( ( h + 1 - t ) > rx_high_watermark )
+    {
+        rx_high_watermark = h + 1 - t;
+    }
+
+    xSemaphoreGive( data_available );
+    // The consumer may be the task that runs the engine: make sure it does not go back to sleep
+    lbm_engine_notify( );
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,237 @@
+/*!
+ * \file      lbm_p2p.h
+ *
+ * \brief     Raw LoRa point-to-point links scheduled by the radio planner, next to LoRaWAN
+ *
+ * P2P frames do not drive the SX1262 directly: every transmission and every receive window is a task of the
+ * LBM radio planner on a hook of its own (LBM_P2P_HOOK_ID), so the planner arbitrates them against the
+ * LoRaWAN stacks like any other task. The hook id sets the priority: the lr1mac hooks have lower ids and win
+ * every conflict, and receive windows are low priority tasks that a LoRaWAN TX or RX window aborts while
+ * they run.
+ *
+ * Continuous receive is a chain of LBM_P2P_RX_WINDOW_MS windows, a new one enqueued as soon as the previous
+ * one ends (frame, timeout or abort), so the radio listens whenever LoRaWAN and queued P2P transmissions
+ * leave it free. Received frames go with RSSI, SNR and the time of the RX done interrupt into a bounded
+ * single-producer / single-consumer ring: the engine is the producer, one application task the consumer.
+ * Frames to send wait in a second ring of the same kind, filled by the application and emptied by the
+ * engine, each one with its own radio parameters.
+ *
+ * A bulk transfer (lbm_p2p_bulk.h) takes the hook over while it runs: the receive window in progress is
+ * aborted, queued frames and continuous receive resume when the transfer ends.
+ */
+
+#ifndef LBM_P2P_H
+#define LBM_P2P_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "smtc_modem_api.h"
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC CONSTANTS --------------------------------------------------------
+ */
+
+/**
+ * @brief Largest P2P payload, the largest uint8_t size
+ */
+#ifndef LBM_P2P_MAX_PAYLOAD
+#define LBM_P2P_MAX_PAYLOAD 255
+#endif
+
+/**
+ * @brief Number of received frames the ring holds (power of 2)
+ */
+#ifndef LBM_P2P_RX_RING_SIZE
+#define LBM_P2P_RX_RING_SIZE 8
+#endif
+
+/**
+ * @brief Number of frames waiting to be sent (power of 2)
+ */
+#ifndef LBM_P2P_TX_QUEUE_SIZE
+#define LBM_P2P_TX_QUEUE_SIZE 4
+#endif
+
+/**
+ * @brief Length of one receive window of continuous receive
+ *
+ * Longer windows mean fewer planner tasks, shorter ones let a queued transmission start sooner.
+ */
+#ifndef LBM_P2P_RX_WINDOW_MS
+#define LBM_P2P_RX_WINDOW_MS 2000
+#endif
+
+/**
+ * @brief Radio planner hook of the P2P tasks
+ */
+#ifndef LBM_P2P_HOOK_ID
+#define LBM_P2P_HOOK_ID RP_HOOK_ID_DIRECT_RP_ACCESS
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC TYPES ------------------------------------------------------------
+ */
+
+/**
+ * @brief LoRa settings of a P2P link, both ends must use the same ones
+ */
+typedef struct lbm_p2p_params_s
+{
+    uint32_t frequency_hz;
+    uint8_t  sf;            //!< spreading factor, 5 to 12
+    uint16_t bw_khz;        //!< bandwidth, 62, 125, 250 or 500
+    uint8_t  cr;            //!< coding rate, 1 = 4/5 ... 4 = 4/8
+    int8_t   tx_power_dbm;  //!< TX only
+    uint16_t preamble_len;  //!< in symbols
+    uint8_t  sync_word;     //!< 0x12 private (default), 0x34 public LoRaWAN
+    bool     crc_on;
+    bool     iq_inverted;
+} lbm_p2p_params_t;
+
+/**
+ * @brief Received frame as queued for the application
+ */
+typedef struct lbm_p2p_frame_s
+{
+    uint8_t  payload[LBM_P2P_MAX_PAYLOAD];
+    uint8_t  size;
+    int16_t  rssi_dbm;
+    int8_t   snr_db;
+    uint32_t timestamp_ms;  //!< modem time of the RX done interrupt
+} lbm_p2p_frame_t;
+
+/**
+ * @brief P2P counters
+ */
+typedef struct lbm_p2p_stats_s
+{
+    uint32_t tx_queued;           //!< frames accepted by lbm_p2p_send()
+    uint32_t tx_overflows;        //!< frames refused because the TX queue was full
+    uint32_t tx_done;             //!< frames sent
+    uint32_t tx_aborted;          //!< frames dropped by the planner (conflict with a LoRaWAN task)
+    uint32_t rx_windows;          //!< receive windows handed to the planner
+    uint32_t rx_windows_aborted;  //!< of which aborted by a higher priority task
+    uint32_t rx_frames;           //!< frames received with a valid CRC
+    uint32_t rx_crc_errors;       //!< frames received with a bad CRC (dropped)
+    uint32_t rx_overflows;        //!< frames dropped because the ring was full
+    uint32_t rx_read;             //!< frames read by the application
+    uint32_t rx_depth;            //!< frames currently in the ring
+    uint32_t rx_high_watermark;   //!< highest depth seen
+    uint32_t latency_min_ms;      //!< RX done interrupt to lbm_p2p_read(), 0 when rx_read is 0
+    uint32_t latency_avg_ms;
+    uint32_t latency_max_ms;
+    uint32_t elapsed_ms;          //!< time covered by the counters
+    float    tx_packets_per_s;    //!< tx_done / elapsed time
+    float    rx_packets_per_s;    //!< rx_frames / elapsed time
+} lbm_p2p_stats_t;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS PROTOTYPES --------------------------------------------
+ */
+
+/**
+ * @brief Default settings: 869.525 MHz, SF7, 125 kHz, 4/5, 14 dBm, 8 symbols, private sync word, CRC on
+ */
+void lbm_p2p_get_default_params( lbm_p2p_params_t* params );
+
+/**
+ * @brief Take the planner hook of P2P (after lbm_init())
+ *
+ * @param [in] params Settings of continuous receive and default ones of lbm_p2p_send(), NULL for the defaults
+ *
+ * @return SMTC_MODEM_RC_OK, SMTC_MODEM_RC_INVALID (bad settings), SMTC_MODEM_RC_BUSY (hook already taken),
+ *         SMTC_MODEM_RC_FAIL (modem not initialized)
+ */
+smtc_modem_return_code_t lbm_p2p_begin( const lbm_p2p_params_t* params );
+
+/**
+ * @brief Abort the running task and bulk transfer, drop the queued frames and release the hook
+ */
+void lbm_p2p_end( void );
+
+/**
+ * @brief true between lbm_p2p_begin() and lbm_p2p_end()
+ */
+bool lbm_p2p_is_started( void );
+
+/**
+ * @brief Change the settings of continuous receive and the default ones of lbm_p2p_send()
+ *
+ * The running receive window keeps the previous settings, the next one uses the new settings.
+ *
+ * @return SMTC_MODEM_RC_OK, SMTC_MODEM_RC_INVALID
+ */
+smtc_modem_return_code_t lbm_p2p_set_params( const lbm_p2p_params_t* params );
+
+/**
+ * @brief Queue a frame (any task)
+ *
+ * @param [in] params Settings of this frame only, NULL for those of lbm_p2p_begin() / lbm_p2p_set_params()
+ *
+ * @return SMTC_MODEM_RC_OK, SMTC_MODEM_RC_INVALID, SMTC_MODEM_RC_BUSY (queue full), SMTC_MODEM_RC_FAIL (not begun)
+ */
+smtc_modem_return_code_t lbm_p2p_send( const uint8_t* payload, uint8_t size, const lbm_p2p_params_t* params );
+
+/**
+ * @brief Start / stop continuous receive
+ *
+ * @return SMTC_MODEM_RC_OK, SMTC_MODEM_RC_FAIL (not begun)
+ */
+smtc_modem_return_code_t lbm_p2p_start_rx( void );
+smtc_modem_return_code_t lbm_p2p_stop_rx( void );
+
+/**
+ * @brief Hand the next transmission or receive window to the planner if the hook is idle (engine task)
+ */
+void lbm_p2p_process( void );
+
+/**
+ * @brief Number of received frames waiting in the ring
+ */
+uint32_t lbm_p2p_available( void );
+
+/**
+ * @brief Dequeue the oldest received frame without blocking (consumer side)
+ *
+ * @return false if the ring is empty
+ */
+bool lbm_p2p_read( lbm_p2p_frame_t* frame );
+
+/**
+ * @brief Dequeue the oldest received frame, blocking the calling task up to timeout_ms for one to arrive
+ *
+ * @remark Must not be called from the task that runs the engine: nothing would fill the ring meanwhile
+ *
+ * @return false on timeout
+ */
+bool lbm_p2p_wait( lbm_p2p_frame_t* frame, uint32_t timeout_ms );
+
+/**
+ * @brief Read the counters
+ */
+void lbm_p2p_get_stats( lbm_p2p_stats_t* stats );
+
+/**
+ * @brief Clear the counters and restart the elapsed time (queued frames are kept)
+ */
+void lbm_p2p_reset_stats( void );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // LBM_P2P_H
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,853 @@
+/*!
+ * \file      lbm_p2p_bulk.cpp
+ *
+ * \brief     P2P bulk transfer over GFSK with windowed selective acknowledgements
+ */
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <atomic>
+#include <string.h>
+
+#include "lbm_p2p_bulk.h"
+#include "lbm_p2p.h"
+#include "lbm_engine.h"
+#include "lbm_log.h"
+
+extern "C" {
+#include "smtc_modem_hal.h"
+#include "radio_planner.h"
+#include "radio_planner_stats.h"
+#include "ralf.h"
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE CONSTANTS -------------------------------------------------------
+ */
+
+#if( LBM_P2P_BULK_MAX_WINDOW & ( LBM_P2P_BULK_MAX_WINDOW - 1 ) ) != 0
+#error "LBM_P2P_BULK_MAX_WINDOW must be a power of 2"
+#endif
+
+#if LBM_P2P_BULK_MAX_WINDOW > 32
+#error "LBM_P2P_BULK_MAX_WINDOW must fit the 32-bit ACK bitmap"
+#endif
+
+#if LBM_P2P_BULK_MAX_FRAME > 255
+#error "LBM_P2P_BULK_MAX_CHUNK too large for the radio buffer"
+#endif
+
+#define SLOT_MASK ( LBM_P2P_BULK_MAX_WINDOW - 1 )
+
+#define FRAME_TYPE_DATA 0xB1
+#define FRAME_TYPE_ACK 0xB2
+
+#define DATA_FLAG_LAST 0x01
+#define DATA_FLAG_ACK_REQ 0x02
+
+#define ACK_FLAG_COMPLETE 0x01
+#define ACK_FLAG_ABORT 0x02
+
+// GFSK framing of the lr1mac FSK data rates, with a sync word of its own so LoRaWAN FSK frames are ignored
+#define GFSK_PREAMBLE_BITS 40
+#define GFSK_SYNC_WORD_BITS 24
+#define GFSK_WHITENING_SEED 0x01FF
+#define GFSK_CRC_SEED 0x1D0F
+#define GFSK_CRC_POLYNOMIAL 0x1021
+
+// Quiet time, in ACK timeouts, after which a receiver that got everything stops answering the sender
+#define RX_LINGER_ACK_TIMEOUTS 2
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE VARIABLES -------------------------------------------------------
+ */
+
+static const uint8_t gfsk_sync_word[3] = { 0x4C, 0x42, 0x4D };
+
+// Written by the application task before running is set, then owned by the engine until it is cleared
+static std::atomic<bool>    running( false );
+static std::atomic<bool>    abort_requested( false );
+static std::atomic<uint8_t> bulk_status( LBM_P2P_BULK_IDLE );
+static lbm_p2p_bulk_params_t params;
+static bool                  sender = false;
+static uint32_t              first_frame_timeout_ms = 0;
+static union
+{
+    lbm_p2p_bulk_tx_t tx;
+    lbm_p2p_bulk_rx_t rx;
+} ends;
+
+// Task handed to the planner, and the buffers it works on until its hook callback
+static ralf_params_gfsk_t task_params;
+static const uint8_t*     task_payload = nullptr;
+static uint8_t            task_size    = 0;
+static uint32_t           task_window_ms = 0;
+static bool               task_is_tx     = false;
+static uint8_t            frame_buffer[LBM_P2P_BULK_MAX_FRAME];  // data frames and received frames
+static uint8_t            ack_buffer[LBM_P2P_BULK_ACK_SIZE];
+static bool               ack_pending   = false;
+static uint32_t           not_before_ms = 0;  // earliest start of the next transmission
+
+// Engine side counters
+static uint32_t start_ms       = 0;
+static uint32_t end_ms         = 0;
+static uint32_t last_frame_ms  = 0;
+static uint32_t planner_aborts = 0;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DECLARATION -------------------------------------------
+ */
+
+/**
+ * @brief Check settings against what the SX1262 GFSK modem and the frame format support
+ */
+static bool params_are_valid( const lbm_p2p_bulk_params_t* p );
+
+/**
+ * @brief Hand a transfer prepared by the application task over to the engine
+ */
+static void start( lbm_p2p_bulk_status_t status );
+
+/**
+ * @brief End the transfer and give the hook back to plain P2P (engine task)
+ */
+static void finish( lbm_p2p_bulk_status_t status );
+
+/**
+ * @brief Convert the settings to ralf ones for a frame of size bytes (TX) or any frame (RX)
+ */
+static void to_ralf( bool tx, uint8_t size, ralf_params_gfsk_t* gfsk );
+
+/**
+ * @brief Hand a transmission / a receive window to the planner
+ */
+static bool enqueue_tx( radio_planner_t* rp, const uint8_t* payload, uint8_t size );
+static bool enqueue_rx( radio_planner_t* rp, uint32_t window_ms );
+
+/**
+ * @brief Planner callbacks: task launch (radio setup)
+ */
+static void launch_tx( void* context );
+static void launch_rx( void* context );
+
+/**
+ * @brief Read the next chunk of the source into the slot of seq
+ *
+ * @return false if the source failed
+ */
+static bool tx_fill_slot( lbm_p2p_bulk_tx_t* tx, uint16_t seq );
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS DEFINITION ---------------------------------------------
+ */
+
+void lbm_p2p_bulk_get_default_params( lbm_p2p_bulk_params_t* p )
+{
+    p->frequency_hz   = 869525000;
+    p->bitrate_bps    = 100000;
+    p->fdev_hz        = 25000;
+    p->tx_power_dbm   = 14;
+    p->chunk_size     = LBM_P2P_BULK_MAX_CHUNK;
+    p->window         = ( LBM_P2P_BULK_MAX_WINDOW < 8 ) ? LBM_P2P_BULK_MAX_WINDOW : 8;
+    p->max_retries    = 8;
+    p->ack_timeout_ms = 100;
+}
+
+smtc_modem_return_code_t lbm_p2p_bulk_send( const lbm_p2p_bulk_params_t* new_params, lbm_p2p_bulk_source_t source,
+                                            void* context )
+{
+    lbm_p2p_bulk_params_t p;
+    if( new_params != nullptr )
+    {
+        p = *new_params;
+    }
+    else
+    {
+        lbm_p2p_bulk_get_default_params( &p );
+    }
+    if( ( source == nullptr ) || ( params_are_valid( &p ) == false ) )
+    {
+        return SMTC_MODEM_RC_INVALID;
+    }
+    if( lbm_p2p_is_started( ) == false )
+    {
+        return SMTC_MODEM_RC_FAIL;
+    }
+    if( running.load( std::memory_order_acquire ) == true )
+    {
+        return SMTC_MODEM_RC_BUSY;
+    }
+
+    params = p;
+    sender = true;
+    lbm_p2p_bulk_tx_init( &ends.tx, &p, ( uint8_t ) smtc_modem_hal_get_random_nb_in_range( 1, 255 ), source,
+                          context );
+    start( LBM_P2P_BULK_SENDING );
+    LBM_LOG_INFO( "P2P bulk: sending, session %u, %u bps\n", ends.tx.session, p.bitrate_bps );
+    return SMTC_MODEM_RC_OK;
+}
+
+smtc_modem_return_code_t lbm_p2p_bulk_receive( const lbm_p2p_bulk_params_t* new_params, lbm_p2p_bulk_sink_t sink,
+                                               void* context, uint32_t timeout_ms )
+{
+    lbm_p2p_bulk_params_t p;
+    if( new_params != nullptr )
+    {
+        p = *new_params;
+    }
+    else
+    {
+        lbm_p2p_bulk_get_default_params( &p );
+    }
+    if( ( sink == nullptr ) || ( params_are_valid( &p ) == false ) )
+    {
+        return SMTC_MODEM_RC_INVALID;
+    }
+    if( lbm_p2p_is_started( ) == false )
+    {
+        return SMTC_MODEM_RC_FAIL;
+    }
+    if( running.load( std::memory_order_acquire ) == true )
+    {
+        return SMTC_MODEM_RC_BUSY;
+    }
+
+    params                 = p;
+    sender                 = false;
+    first_frame_timeout_ms = timeout_ms;
+    lbm_p2p_bulk_rx_init( &ends.rx, &p, sink, context );
+    start( LBM_P2P_BULK_RECEIVING );
+    LBM_LOG_INFO( "P2P bulk: receiving, %u bps\n", p.bitrate_bps );
+    return SMTC_MODEM_RC_OK;
+}
+
+void lbm_p2p_bulk_abort( void )
+{
+    if( running.load( std::memory_order_acquire ) == true )
+    {
+        abort_requested.store( true, std::memory_order_release );
+        lbm_engine_notify( );
+    }
+}
+
+lbm_p2p_bulk_status_t lbm_p2p_bulk_get_status( void )
+{
+    return ( lbm_p2p_bulk_status_t ) bulk_status.load( std::memory_order_acquire );
+}
+
+void lbm_p2p_bulk_get_stats( lbm_p2p_bulk_stats_t* stats )
+{
+    memset( stats, 0, sizeof( *stats ) );
+    if( lbm_p2p_bulk_get_status( ) == LBM_P2P_BULK_IDLE )
+    {
+        return;
+    }
+
+    if( sender == true )
+    {
+        stats->bytes                = ends.tx.bytes_acked;
+        stats->frames_sent          = ends.tx.frames_sent;
+        stats->frames_retransmitted = ends.tx.frames_retransmitted;
+        stats->frames_received      = ends.tx.acks_received;
+        stats->ack_timeouts         = ends.tx.ack_timeouts;
+    }
+    else
+    {
+        stats->bytes           = ends.rx.offset;
+        stats->frames_sent     = ends.rx.acks_sent;
+        stats->frames_received = ends.rx.frames_received;
+        stats->duplicates      = ends.rx.duplicates;
+    }
+    stats->planner_aborts = planner_aborts;
+
+    const uint32_t until_ms = ( running.load( std::memory_order_acquire ) == true ) ? smtc_modem_hal_get_time_in_ms( )
+                                                                                    : end_ms;
+    stats->elapsed_ms = until_ms - start_ms;
+    if( stats->elapsed_ms > 0 )
+    {
+        stats->throughput_bps = ( float ) stats->bytes * 8000.0f / ( float ) stats->elapsed_ms;
+    }
+    if( stats->frames_sent > 0 )
+    {
+        stats->retransmission_percent = ( float ) stats->frames_retransmitted * 100.0f / ( float ) stats->frames_sent;
+    }
+}
+
+bool lbm_p2p_bulk_is_running( void )
+{
+    return running.load( std::memory_order_acquire );
+}
+
+bool lbm_p2p_bulk_schedule( void* planner )
+{
+    radio_planner_t* rp = ( radio_planner_t* ) planner;
+
+    if( abort_requested.load( std::memory_order_acquire ) == true )
+    {
+        finish( LBM_P2P_BULK_ABORTED );
+        return false;
+    }
+
+    if( sender == true )
+    {
+        const uint8_t size = lbm_p2p_bulk_tx_next_frame( &ends.tx, frame_buffer );
+        if( size > 0 )
+        {
+            return enqueue_tx( rp, frame_buffer, size );
+        }
+        if( ends.tx.waiting_ack == true )
+        {
+            return enqueue_rx( rp, params.ack_timeout_ms );
+        }
+        finish( ( ends.tx.done == true ) ? LBM_P2P_BULK_DONE : LBM_P2P_BULK_FAILED );
+        return false;
+    }
+
+    // The ACK that tells the sender why the transfer stops still goes out
+    if( ack_pending == true )
+    {
+        return enqueue_tx( rp, ack_buffer, LBM_P2P_BULK_ACK_SIZE );
+    }
+
+    const uint32_t now_ms  = smtc_modem_hal_get_time_in_ms( );
+    const uint32_t idle_ms = now_ms - last_frame_ms;
+    if( ends.rx.failed == true )
+    {
+        finish( LBM_P2P_BULK_FAILED );
+        return false;
+    }
+    if( ends.rx.complete == true )
+    {
+        // Keep answering until the sender has stopped asking
+        if( idle_ms >= ( uint32_t ) params.ack_timeout_ms * RX_LINGER_ACK_TIMEOUTS )
+        {
+            finish( LBM_P2P_BULK_DONE );
+            return false;
+        }
+    }
+    else if( ( ( ends.rx.started == false ) && ( idle_ms >= first_frame_timeout_ms ) ) ||
+             ( ( ends.rx.started == true ) &&
+               ( idle_ms >= ( uint32_t ) params.ack_timeout_ms * ( params.max_retries + 2u ) ) ) )
+    {
+        LBM_LOG_WARN( "P2P bulk: nothing received for %u ms\n", idle_ms );
+        finish( LBM_P2P_BULK_FAILED );
+        return false;
+    }
+    return enqueue_rx( rp, params.ack_timeout_ms );
+}
+
+void lbm_p2p_bulk_on_planner_event( void* planner, uint8_t status, uint32_t irq_ms )
+{
+    radio_planner_t* rp = ( radio_planner_t* ) planner;
+
+    switch( ( rp_status_t ) status )
+    {
+    case RP_STATUS_TX_DONE:
+        not_before_ms = irq_ms + LBM_P2P_BULK_TURNAROUND_MS;
+        if( sender == false )
+        {
+            ack_pending = false;
+        }
+        break;
+    case RP_STATUS_RX_PACKET:
+    {
+        const uint8_t size = ( uint8_t ) rp->rx_payload_size[LBM_P2P_HOOK_ID];
+        not_before_ms      = irq_ms + LBM_P2P_BULK_TURNAROUND_MS;
+        if( sender == true )
+        {
+            // Anything but our ACK leaves the sender waiting, the next window gets another chance
+            lbm_p2p_bulk_tx_on_ack( &ends.tx, frame_buffer, size );
+        }
+        else
+        {
+            const uint32_t received = ends.rx.frames_received;
+            if( lbm_p2p_bulk_rx_on_frame( &ends.rx, frame_buffer, size, ack_buffer ) > 0 )
+            {
+                ack_pending = true;
+            }
+            if( ends.rx.frames_received != received )
+            {
+                last_frame_ms = irq_ms;
+            }
+        }
+        break;
+    }
+    case RP_STATUS_TASK_ABORTED:
+        planner_aborts++;
+        if( ( sender == true ) && ( task_is_tx == false ) )
+        {
+            lbm_p2p_bulk_tx_on_timeout( &ends.tx );
+        }
+        break;
+    default:
+        // RX timeout or CRC error
+        if( sender == true )
+        {
+            lbm_p2p_bulk_tx_on_timeout( &ends.tx );
+        }
+        break;
+    }
+}
+
+void lbm_p2p_bulk_end( void )
+{
+    if( running.load( std::memory_order_acquire ) == true )
+    {
+        finish( LBM_P2P_BULK_ABORTED );
+    }
+}
+
+void lbm_p2p_bulk_tx_init( lbm_p2p_bulk_tx_t* tx, const lbm_p2p_bulk_params_t* p, uint8_t session,
+                           lbm_p2p_bulk_source_t source, void* context )
+{
+    memset( tx, 0, sizeof( *tx ) );
+    tx->source      = source;
+    tx->context     = context;
+    tx->session     = session;
+    tx->window      = p->window;
+    tx->chunk_size  = p->chunk_size;
+    tx->max_retries = p->max_retries;
+}
+
+uint8_t lbm_p2p_bulk_tx_next_frame( lbm_p2p_bulk_tx_t* tx, uint8_t* frame )
+{
+    if( ( tx->done == true ) || ( tx->failed == true ) || ( tx->waiting_ack == true ) )
+    {
+        return 0;
+    }
+
+    // Top the window up from the source
+    while( ( tx->source_ended == false ) && ( ( uint16_t ) ( tx->next_seq - tx->base ) < tx->window ) )
+    {
+        if( tx_fill_slot( tx, tx->next_seq ) == false )
+        {
+            tx->failed = true;
+            return 0;
+        }
+        tx->next_seq++;
+    }
+
+    // Oldest frame not acknowledged and not sent since the last ACK
+    uint16_t seq = tx->base;
+    while( ( seq != tx->next_seq ) && ( ( tx->slots[seq & SLOT_MASK].acked == true ) ||
+                                        ( tx->slots[seq & SLOT_MASK].sent == true ) ) )
+    {
+        seq++;
+    }
+    if( seq == tx->next_seq )
+    {
+        // Only reached with an empty window: everything was acknowledged
+        tx->done = tx->source_ended;
+        return 0;
+    }
+
+    // The last frame of the burst asks for the ACK
+    bool more = false;
+    for( uint16_t s = seq + 1; s != tx->next_seq; s++ )
+    {
+        if( ( tx->slots[s & SLOT_MASK].acked == false ) && ( tx->slots[s & SLOT_MASK].sent == false ) )
+        {
+            more = true;
+            break;
+        }
+    }
+
+    auto* slot = &tx->slots[seq & SLOT_MASK];
+    frame[0]   = FRAME_TYPE_DATA;
+    frame[1]   = tx->session;
+    frame[2]   = ( uint8_t ) seq;
+    frame[3]   = ( uint8_t ) ( seq >> 8 );
+    frame[4]   = ( slot->last ? DATA_FLAG_LAST : 0 ) | ( more ? 0 : DATA_FLAG_ACK_REQ );
+    memcpy( &frame[LBM_P2P_BULK_HEADER_SIZE], slot->data, slot->size );
+
+    tx->frames_sent++;
+    if( slot->sent_once == true )
+    {
+        tx->frames_retransmitted++;
+    }
+    slot->sent      = true;
+    slot->sent_once = true;
+    if( more == false )
+    {
+        tx->waiting_ack = true;
+        tx->probe_seq   = seq;
+    }
+    return ( uint8_t ) ( LBM_P2P_BULK_HEADER_SIZE + slot->size );
+}
+
+void lbm_p2p_bulk_tx_on_ack( lbm_p2p_bulk_tx_t* tx, const uint8_t* ack, uint8_t size )
+{
+    if( ( size != LBM_P2P_BULK_ACK_SIZE ) || ( ack[0] != FRAME_TYPE_ACK ) || ( ack[1] != tx->session ) ||
+        ( tx->done == true ) || ( tx->failed == true ) )
+    {
+        return;
+    }
+    tx->acks_received++;
+    if( ( ack[8] & ACK_FLAG_ABORT ) != 0 )
+    {
+        tx->failed = true;
+        return;
+    }
+
+    const uint16_t expected = ( uint16_t ) ( ack[2] | ( ack[3] << 8 ) );
+    const uint32_t bitmap =
+        ( uint32_t ) ack[4] | ( ( uint32_t ) ack[5] << 8 ) | ( ( uint32_t ) ack[6] << 16 ) | ( ( uint32_t ) ack[7] << 24 );
+    const uint16_t in_order = expected - tx->base;
+    if( in_order > ( uint16_t ) ( tx->next_seq - tx->base ) )
+    {
+        return;  // refers to frames never sent
+    }
+
+    // Frames the receiver holds are done with, the others go again in the next burst
+    for( uint16_t s = tx->base; s != tx->next_seq; s++ )
+    {
+        auto*          slot  = &tx->slots[s & SLOT_MASK];
+        const uint16_t after = s - expected;
+        const bool     held  = ( ( uint16_t ) ( s - tx->base ) < in_order ) ||
+                          ( ( after >= 1 ) && ( after <= 32 ) && ( ( bitmap & ( 1UL << ( after - 1 ) ) ) != 0 ) );
+        if( slot->acked == true )
+        {
+            continue;
+        }
+        if( held == true )
+        {
+            slot->acked = true;
+            tx->bytes_acked += slot->size;
+        }
+        else
+        {
+            slot->sent = false;
+        }
+    }
+    while( ( tx->base != tx->next_seq ) && ( tx->slots[tx->base & SLOT_MASK].acked == true ) )
+    {
+        if( tx->slots[tx->base & SLOT_MASK].last == true )
+        {
+            tx->done = true;
+        }
+        tx->base++;
+    }
+    tx->waiting_ack = false;
+    tx->retries     = 0;
+}
+
+void lbm_p2p_bulk_tx_on_timeout( lbm_p2p_bulk_tx_t* tx )
+{
+    if( ( tx->done == true ) || ( tx->failed == true ) || ( tx->waiting_ack == false ) )
+    {
+        return;
+    }
+    tx->ack_timeouts++;
+    if( ++tx->retries > tx->max_retries )
+    {
+        tx->failed = true;
+        return;
+    }
+
+    // Ask again with the frame that asked last time
+    tx->slots[tx->probe_seq & SLOT_MASK].sent = false;
+    tx->waiting_ack                           = false;
+}
+
+void lbm_p2p_bulk_rx_init( lbm_p2p_bulk_rx_t* rx, const lbm_p2p_bulk_params_t* p, lbm_p2p_bulk_sink_t sink,
+                           void* context )
+{
+    memset( rx, 0, sizeof( *rx ) );
+    rx->sink    = sink;
+    rx->context = context;
+    rx->window  = p->window;
+}
+
+uint8_t lbm_p2p_bulk_rx_on_frame( lbm_p2p_bulk_rx_t* rx, const uint8_t* frame, uint8_t size, uint8_t* ack )
+{
+    if( ( size < LBM_P2P_BULK_HEADER_SIZE ) || ( size > LBM_P2P_BULK_MAX_FRAME ) || ( frame[0] != FRAME_TYPE_DATA ) )
+    {
+        return 0;
+    }
+    // The first frame opens the session, frames of other sessions are ignored
+    if( rx->started == false )
+    {
+        rx->started = true;
+        rx->session = frame[1];
+    }
+    else if( frame[1] != rx->session )
+    {
+        return 0;
+    }
+    rx->frames_received++;
+
+    const uint16_t seq   = ( uint16_t ) ( frame[2] | ( frame[3] << 8 ) );
+    const uint8_t  flags = frame[4];
+    const uint16_t ahead = seq - rx->expected;
+    if( ( rx->complete == true ) || ( ahead >= 0x8000 ) )
+    {
+        rx->duplicates++;  // already handed to the sink
+    }
+    else if( ahead < rx->window )
+    {
+        auto* slot = &rx->slots[seq & SLOT_MASK];
+        if( slot->stored == true )
+        {
+            rx->duplicates++;
+        }
+        else
+        {
+            slot->stored = true;
+            slot->last   = ( flags & DATA_FLAG_LAST ) != 0;
+            slot->size   = size - LBM_P2P_BULK_HEADER_SIZE;
+            memcpy( slot->data, &frame[LBM_P2P_BULK_HEADER_SIZE], slot->size );
+        }
+    }
+
+    // Hand over what is now in order
+    while( ( rx->complete == false ) && ( rx->failed == false ) && ( rx->slots[rx->expected & SLOT_MASK].stored == true ) )
+    {
+        auto* slot = &rx->slots[rx->expected & SLOT_MASK];
+        if( ( slot->size > 0 ) && ( rx->sink( rx->offset, slot->data, slot->size, rx->context ) == false ) )
+        {
+            rx->failed = true;
+            break;
+        }
+        rx->offset += slot->size;
+        rx->complete = slot->last;
+        slot->stored = false;
+        rx->expected++;
+    }
+
+    if( ( flags & DATA_FLAG_ACK_REQ ) == 0 )
+    {
+        return 0;
+    }
+
+    uint32_t bitmap = 0;
+    for( uint8_t i = 0; ( i + 1 ) < rx->window; i++ )
+    {
+        if( rx->slots[( uint16_t ) ( rx->expected + 1 + i ) & SLOT_MASK].stored == true )
+        {
+            bitmap |= 1UL << i;
+        }
+    }
+    ack[0] = FRAME_TYPE_ACK;
+    ack[1] = rx->session;
+    ack[2] = ( uint8_t ) rx->expected;
+    ack[3] = ( uint8_t ) ( rx->expected >> 8 );
+    ack[4] = ( uint8_t ) bitmap;
+    ack[5] = ( uint8_t ) ( bitmap >> 8 );
+    ack[6] = ( uint8_t ) ( bitmap >> 16 );
+    ack[7] = ( uint8_t ) ( bitmap >> 24 );
+    ack[8] = ( rx->complete ? ACK_FLAG_COMPLETE : 0 ) | ( rx->failed ? ACK_FLAG_ABORT : 0 );
+    rx->acks_sent++;
+    return LBM_P2P_BULK_ACK_SIZE;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DEFINITION --------------------------------------------
+ */
+
+static bool params_are_valid( const lbm_p2p_bulk_params_t* p )
+{
+    if( ( p->bitrate_bps < 600 ) || ( p->bitrate_bps > 300000 ) || ( p->fdev_hz == 0 ) || ( p->fdev_hz > 200000 ) )
+    {
+        return false;
+    }
+    return ( p->chunk_size > 0 ) && ( p->chunk_size <= LBM_P2P_BULK_MAX_CHUNK ) && ( p->window > 0 ) &&
+           ( p->window <= LBM_P2P_BULK_MAX_WINDOW ) && ( p->ack_timeout_ms > 0 );
+}
+
+static void start( lbm_p2p_bulk_status_t status )
+{
+    const uint32_t now_ms = smtc_modem_hal_get_time_in_ms( );
+
+    ack_pending    = false;
+    planner_aborts = 0;
+    start_ms       = now_ms;
+    end_ms         = now_ms;
+    last_frame_ms  = now_ms;
+    not_before_ms  = now_ms;
+    abort_requested.store( false, std::memory_order_relaxed );
+    bulk_status.store( status, std::memory_order_relaxed );
+
+    // The engine owns the transfer from now on
+    running.store( true, std::memory_order_release );
+    lbm_engine_notify( );
+}
+
+static void finish( lbm_p2p_bulk_status_t status )
+{
+    end_ms = smtc_modem_hal_get_time_in_ms( );
+    bulk_status.store( status, std::memory_order_relaxed );
+    running.store( false, std::memory_order_release );
+    LBM_LOG_INFO( "P2P bulk: %s after %u ms, %u bytes\n",
+                  ( status == LBM_P2P_BULK_DONE ) ? "done" : ( status == LBM_P2P_BULK_ABORTED ) ? "aborted" : "failed",
+                  end_ms - start_ms, sender ? ends.tx.bytes_acked : ends.rx.offset );
+}
+
+static void to_ralf( bool tx, uint8_t size, ralf_params_gfsk_t* gfsk )
+{
+    memset( gfsk, 0, sizeof( *gfsk ) );
+    gfsk->rf_freq_in_hz     = params.frequency_hz;
+    gfsk->output_pwr_in_dbm = params.tx_power_dbm;
+    gfsk->sync_word         = gfsk_sync_word;
+    gfsk->whitening_seed    = GFSK_WHITENING_SEED;
+    gfsk->crc_seed          = GFSK_CRC_SEED;
+    gfsk->crc_polynomial    = GFSK_CRC_POLYNOMIAL;
+
+    gfsk->mod_params.br_in_bps   = params.bitrate_bps;
+    gfsk->mod_params.fdev_in_hz  = params.fdev_hz;
+    gfsk->mod_params.pulse_shape = RAL_GFSK_PULSE_SHAPE_BT_1;
+    // Carson bandwidth, the driver rounds it up to the next receiver bandwidth
+    gfsk->mod_params.bw_dsb_in_hz = 2 * ( params.fdev_hz + params.bitrate_bps / 2 );
+
+    gfsk->pkt_params.preamble_len_in_bits  = GFSK_PREAMBLE_BITS;
+    gfsk->pkt_params.preamble_detector     = RAL_GFSK_PREAMBLE_DETECTOR_MIN_16BITS;
+    gfsk->pkt_params.sync_word_len_in_bits = GFSK_SYNC_WORD_BITS;
+    gfsk->pkt_params.address_filtering     = RAL_GFSK_ADDRESS_FILTERING_DISABLE;
+    gfsk->pkt_params.header_type           = RAL_GFSK_PKT_VAR_LEN;
+    gfsk->pkt_params.pld_len_in_bytes      = tx ? size : LBM_P2P_BULK_MAX_FRAME;
+    gfsk->pkt_params.crc_type              = RAL_GFSK_CRC_2_BYTES_INV;
+    gfsk->pkt_params.dc_free               = RAL_GFSK_DC_FREE_WHITENING;
+}
+
+static bool enqueue_tx( radio_planner_t* rp, const uint8_t* payload, uint8_t size )
+{
+    to_ralf( true, size, &task_params );
+    task_payload = payload;
+    task_size    = size;
+
+    rp_radio_params_t radio_params;
+    memset( &radio_params, 0, sizeof( radio_params ) );
+    radio_params.pkt_type = RAL_PKT_TYPE_GFSK;
+    radio_params.tx.gfsk  = task_params;
+
+    rp_task_t task;
+    memset( &task, 0, sizeof( task ) );
+    task.hook_id          = LBM_P2P_HOOK_ID;
+    task.type             = RP_TASK_TYPE_TX_FSK;
+    task.state            = RP_TASK_STATE_ASAP;
+    task.start_time_ms    = smtc_modem_hal_get_time_in_ms( );
+    task.duration_time_ms = ral_get_gfsk_time_on_air_in_ms( &rp->radio->ral, &task_params.pkt_params,
+                                                            &task_params.mod_params );
+    task.schedule_task_low_priority = false;
+    task.launch_task_callbacks      = launch_tx;
+
+    // Leave the other end the time to get back to receive
+    if( ( int32_t ) ( not_before_ms - task.start_time_ms ) > 0 )
+    {
+        task.state         = RP_TASK_STATE_SCHEDULE;
+        task.start_time_ms = not_before_ms;
+    }
+
+    if( rp_task_enqueue( rp, &task, ( uint8_t* ) payload, size, &radio_params ) != RP_HOOK_STATUS_OK )
+    {
+        LBM_LOG_WARN( "P2P bulk: transmission refused by the planner\n" );
+        finish( LBM_P2P_BULK_FAILED );
+        return false;
+    }
+    task_is_tx = true;
+    return true;
+}
+
+static bool enqueue_rx( radio_planner_t* rp, uint32_t window_ms )
+{
+    to_ralf( false, 0, &task_params );
+    task_window_ms = window_ms;
+
+    rp_radio_params_t radio_params;
+    memset( &radio_params, 0, sizeof( radio_params ) );
+    radio_params.pkt_type         = RAL_PKT_TYPE_GFSK;
+    radio_params.rx.gfsk          = task_params;
+    radio_params.rx.timeout_in_ms = window_ms;
+
+    // Low priority, as plain P2P windows: a LoRaWAN task aborts it even while it runs
+    rp_task_t task;
+    memset( &task, 0, sizeof( task ) );
+    task.hook_id                    = LBM_P2P_HOOK_ID;
+    task.type                       = RP_TASK_TYPE_RX_FSK;
+    task.state                      = RP_TASK_STATE_ASAP;
+    task.start_time_ms              = smtc_modem_hal_get_time_in_ms( );
+    task.duration_time_ms           = window_ms;
+    task.schedule_task_low_priority = true;
+    task.launch_task_callbacks      = launch_rx;
+
+    if( rp_task_enqueue( rp, &task, frame_buffer, LBM_P2P_BULK_MAX_FRAME, &radio_params ) != RP_HOOK_STATUS_OK )
+    {
+        LBM_LOG_WARN( "P2P bulk: receive window refused by the planner\n" );
+        finish( LBM_P2P_BULK_FAILED );
+        return false;
+    }
+    task_is_tx = false;
+    return true;
+}
+
+static void launch_tx( void* context )
+{
+    radio_planner_t* planner = ( radio_planner_t* ) context;
+
+    smtc_modem_hal_start_radio_tcxo( );
+    smtc_modem_hal_set_ant_switch( true );
+    if( ( ralf_setup_gfsk( planner->radio, &task_params ) != RAL_STATUS_OK ) ||
+        ( ral_set_dio_irq_params( &planner->radio->ral, RAL_IRQ_TX_DONE ) != RAL_STATUS_OK ) ||
+        ( ral_set_pkt_payload( &planner->radio->ral, task_payload, task_size ) != RAL_STATUS_OK ) ||
+        ( ral_set_tx( &planner->radio->ral ) != RAL_STATUS_OK ) )
+    {
+        SMTC_MODEM_HAL_PANIC( );
+    }
+    rp_stats_set_tx_timestamp( &planner->stats, smtc_modem_hal_get_time_in_ms( ) );
+}
+
+static void launch_rx( void* context )
+{
+    radio_planner_t* planner = ( radio_planner_t* ) context;
+
+    smtc_modem_hal_start_radio_tcxo( );
+    smtc_modem_hal_set_ant_switch( false );
+    if( ( ralf_setup_gfsk( planner->radio, &task_params ) != RAL_STATUS_OK ) ||
+        ( ral_set_dio_irq_params( &planner->radio->ral, RAL_IRQ_RX_DONE | RAL_IRQ_RX_TIMEOUT |
+                                                            RAL_IRQ_RX_CRC_ERROR ) != RAL_STATUS_OK ) ||
+        ( ral_set_rx( &planner->radio->ral, task_window_ms ) != RAL_STATUS_OK ) )
+    {
+        SMTC_MODEM_HAL_PANIC( );
+    }
+    rp_stats_set_rx_timestamp( &planner->stats, smtc_modem_hal_get_time_in_ms( ) );
+}
+
+static bool tx_fill_slot( lbm_p2p_bulk_tx_t* tx, uint16_t seq )
+{
+    auto* slot      = &tx->slots[seq & SLOT_MASK];
+    slot->size      = 0;
+    slot->last      = false;
+    slot->acked     = false;
+    slot->sent      = false;
+    slot->sent_once = false;
+
+    // Streaming sources may hand fewer bytes than asked, a full chunk is assembled from several reads
+    while( slot->size < tx->chunk_size )
+    {
+        const uint16_t room = tx->chunk_size - slot->size;
+        const int32_t  read = tx->source( &slot->data[slot->size], room, tx->context );
+        if( ( read < 0 ) || ( read > room ) )
+        {
+            LBM_LOG_WARN( "P2P bulk: source failed (%d)\n", ( int ) read );
+            return false;
+        }
+        if( read == 0 )
+        {
+            // A source ending on a chunk boundary costs an empty last frame
+            tx->source_ended = true;
+            slot->last       = true;
+            break;
+        }
+        slot->size += ( uint8_t ) read;
+    }
+    return true;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
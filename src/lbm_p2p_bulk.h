@@ -0,0 +1,286 @@
+/*!
+ * \file      lbm_p2p_bulk.h
+ *
+ * \brief     P2P bulk transfer over GFSK with windowed selective acknowledgements
+ *
+ * Offloads tens of kilobytes (logs, files) between two devices in seconds instead of the hours LoRa SF7 would
+ * take. Frames use the SX126x GFSK modem (100 kbps by default) and go through the radio planner on the P2P
+ * hook, which the transfer holds until it ends: LoRaWAN keeps the priority, plain P2P frames wait.
+ *
+ * The sender reads the data from a source callback as it goes and keeps a window of up to
+ * LBM_P2P_BULK_MAX_WINDOW frames in RAM. It sends the frames of the window not acknowledged yet back to back,
+ * the last one asking for an ACK. The ACK carries the next frame the receiver expects and a bitmap of the
+ * frames it holds after that one, so only the missing frames are sent again. Without an ACK in time, the
+ * sender asks again with the last frame, up to max_retries times in a row. The receiver hands the data to a
+ * sink callback in order.
+ *
+ * Frames (little endian):
+ *   DATA  type 0xB1, session, sequence (2), flags (LAST, ACK_REQ), 0 to chunk_size bytes
+ *   ACK   type 0xB2, session, next expected sequence (2), bitmap of the following 32 frames (4), flags
+ *         (COMPLETE, ABORT)
+ *
+ * The protocol itself (lbm_p2p_bulk_tx_xxx / lbm_p2p_bulk_rx_xxx) does not touch the radio, so a simulated
+ * peer can run the other end of a transfer.
+ */
+
+#ifndef LBM_P2P_BULK_H
+#define LBM_P2P_BULK_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "smtc_modem_api.h"
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC CONSTANTS --------------------------------------------------------
+ */
+
+/**
+ * @brief Largest window, frames held in RAM by each end (power of 2, at most 32: the ACK bitmap size)
+ */
+#ifndef LBM_P2P_BULK_MAX_WINDOW
+#define LBM_P2P_BULK_MAX_WINDOW 16
+#endif
+
+/**
+ * @brief Largest data bytes per frame
+ */
+#ifndef LBM_P2P_BULK_MAX_CHUNK
+#define LBM_P2P_BULK_MAX_CHUNK 240
+#endif
+
+#define LBM_P2P_BULK_HEADER_SIZE 5
+#define LBM_P2P_BULK_ACK_SIZE 9
+#define LBM_P2P_BULK_MAX_FRAME ( LBM_P2P_BULK_HEADER_SIZE + LBM_P2P_BULK_MAX_CHUNK )
+
+/**
+ * @brief Gap before a transmission after the last frame sent or received
+ *
+ * The other end needs it to get its next receive window through the planner and to set the radio up.
+ */
+#ifndef LBM_P2P_BULK_TURNAROUND_MS
+#define LBM_P2P_BULK_TURNAROUND_MS 10
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC TYPES ------------------------------------------------------------
+ */
+
+/**
+ * @brief Source of the data to send (engine task)
+ *
+ * @param [out] buffer  Where to copy the next bytes
+ * @param [in]  size    Room in buffer
+ * @param [in]  context As given to lbm_p2p_bulk_send()
+ *
+ * @return Bytes copied, 0 at the end of the data, negative to abort the transfer
+ */
+typedef int32_t ( *lbm_p2p_bulk_source_t )( uint8_t* buffer, uint16_t size, void* context );
+
+/**
+ * @brief Destination of the data received, called in order (engine task)
+ *
+ * @param [in] offset  Position of data in the transfer
+ *
+ * @return false to abort the transfer
+ */
+typedef bool ( *lbm_p2p_bulk_sink_t )( uint32_t offset, const uint8_t* data, uint16_t size, void* context );
+
+/**
+ * @brief Settings of a transfer, both ends must use the same frequency, bitrate and deviation
+ */
+typedef struct lbm_p2p_bulk_params_s
+{
+    uint32_t frequency_hz;
+    uint32_t bitrate_bps;     //!< 600 to 300000
+    uint32_t fdev_hz;         //!< frequency deviation
+    int8_t   tx_power_dbm;
+    uint8_t  chunk_size;      //!< data bytes per frame, up to LBM_P2P_BULK_MAX_CHUNK
+    uint8_t  window;          //!< frames sent before an ACK, up to LBM_P2P_BULK_MAX_WINDOW
+    uint8_t  max_retries;     //!< ACKs missed in a row before the sender gives up
+    uint16_t ack_timeout_ms;  //!< wait for an ACK; the receiver gives up after (max_retries + 2) times this
+} lbm_p2p_bulk_params_t;
+
+/**
+ * @brief State of the transfer of this device
+ */
+typedef enum lbm_p2p_bulk_status_e
+{
+    LBM_P2P_BULK_IDLE = 0,   //!< no transfer started yet
+    LBM_P2P_BULK_SENDING,
+    LBM_P2P_BULK_RECEIVING,
+    LBM_P2P_BULK_DONE,       //!< every byte acknowledged (send) / delivered to the sink (receive)
+    LBM_P2P_BULK_FAILED,     //!< retries exhausted, receive timeout, or aborted by the source, sink or other end
+    LBM_P2P_BULK_ABORTED,    //!< lbm_p2p_bulk_abort()
+} lbm_p2p_bulk_status_t;
+
+/**
+ * @brief Counters of the last transfer
+ */
+typedef struct lbm_p2p_bulk_stats_s
+{
+    uint32_t bytes;                   //!< acknowledged (send) / delivered to the sink (receive)
+    uint32_t frames_sent;             //!< data frames (send) / ACKs (receive) put on the air
+    uint32_t frames_retransmitted;    //!< data frames sent more than once (send)
+    uint32_t frames_received;         //!< ACKs (send) / data frames (receive) received
+    uint32_t duplicates;              //!< data frames received again (receive)
+    uint32_t ack_timeouts;            //!< ACKs not received in time (send)
+    uint32_t planner_aborts;          //!< radio tasks aborted by a LoRaWAN task
+    uint32_t elapsed_ms;              //!< from the start to the end of the transfer, or to now while it runs
+    float    throughput_bps;          //!< sustained goodput: bytes * 8 / elapsed time
+    float    retransmission_percent;  //!< frames_retransmitted / frames_sent
+} lbm_p2p_bulk_stats_t;
+
+/**
+ * @brief Sender end of the protocol
+ */
+typedef struct lbm_p2p_bulk_tx_s
+{
+    lbm_p2p_bulk_source_t source;
+    void*                 context;
+    uint8_t               session;
+    uint8_t               window;
+    uint8_t               chunk_size;
+    uint8_t               max_retries;
+    uint16_t              base;      //!< oldest frame not acknowledged
+    uint16_t              next_seq;  //!< next frame to read from the source
+    uint16_t              probe_seq; //!< frame that asked for the pending ACK
+    uint8_t               retries;
+    bool                  source_ended;
+    bool                  waiting_ack;
+    bool                  done;
+    bool                  failed;
+    struct
+    {
+        uint8_t data[LBM_P2P_BULK_MAX_CHUNK];
+        uint8_t size;
+        bool    last;
+        bool    acked;
+        bool    sent;      //!< sent since the last ACK
+        bool    sent_once;
+    } slots[LBM_P2P_BULK_MAX_WINDOW];
+    uint32_t bytes_acked;
+    uint32_t frames_sent;
+    uint32_t frames_retransmitted;
+    uint32_t acks_received;
+    uint32_t ack_timeouts;
+} lbm_p2p_bulk_tx_t;
+
+/**
+ * @brief Receiver end of the protocol
+ */
+typedef struct lbm_p2p_bulk_rx_s
+{
+    lbm_p2p_bulk_sink_t sink;
+    void*               context;
+    uint8_t             window;
+    uint8_t             session;
+    bool                started;
+    bool                complete;
+    bool                failed;
+    uint16_t            expected;  //!< next frame to hand to the sink
+    uint32_t            offset;    //!< bytes handed to the sink
+    struct
+    {
+        uint8_t data[LBM_P2P_BULK_MAX_CHUNK];
+        uint8_t size;
+        bool    last;
+        bool    stored;
+    } slots[LBM_P2P_BULK_MAX_WINDOW];
+    uint32_t frames_received;
+    uint32_t duplicates;
+    uint32_t acks_sent;
+} lbm_p2p_bulk_rx_t;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS PROTOTYPES --------------------------------------------
+ */
+
+/**
+ * @brief Default settings: 869.525 MHz, 100 kbps, 25 kHz deviation, 14 dBm, 240-byte chunks, window of 8,
+ *        100 ms ACK timeout, 8 retries
+ */
+void lbm_p2p_bulk_get_default_params( lbm_p2p_bulk_params_t* params );
+
+/**
+ * @brief Send the data read from source to the device running lbm_p2p_bulk_receive() (after lbm_p2p_begin())
+ *
+ * @param [in] params NULL for the defaults
+ *
+ * @return SMTC_MODEM_RC_OK, SMTC_MODEM_RC_INVALID, SMTC_MODEM_RC_BUSY (a transfer runs), SMTC_MODEM_RC_FAIL
+ *         (P2P not begun)
+ */
+smtc_modem_return_code_t lbm_p2p_bulk_send( const lbm_p2p_bulk_params_t* params, lbm_p2p_bulk_source_t source,
+                                            void* context );
+
+/**
+ * @brief Listen for a transfer and hand its data to sink (after lbm_p2p_begin())
+ *
+ * @param [in] timeout_ms Longest wait for the first frame
+ *
+ * @return As lbm_p2p_bulk_send()
+ */
+smtc_modem_return_code_t lbm_p2p_bulk_receive( const lbm_p2p_bulk_params_t* params, lbm_p2p_bulk_sink_t sink,
+                                               void* context, uint32_t timeout_ms );
+
+/**
+ * @brief Stop the running transfer at its next radio event
+ */
+void lbm_p2p_bulk_abort( void );
+
+/**
+ * @brief State of the transfer, and its counters
+ */
+lbm_p2p_bulk_status_t lbm_p2p_bulk_get_status( void );
+void                  lbm_p2p_bulk_get_stats( lbm_p2p_bulk_stats_t* stats );
+
+/**
+ * @brief Planner side, called by lbm_p2p while a transfer holds the hook (engine task)
+ *
+ * lbm_p2p_bulk_schedule() hands the next task to the planner and returns false once the transfer is over.
+ * lbm_p2p_bulk_on_planner_event() takes the end of that task (rp_status_t). lbm_p2p_bulk_end() aborts the
+ * transfer when P2P ends.
+ */
+bool lbm_p2p_bulk_is_running( void );
+bool lbm_p2p_bulk_schedule( void* planner );
+void lbm_p2p_bulk_on_planner_event( void* planner, uint8_t status, uint32_t irq_ms );
+void lbm_p2p_bulk_end( void );
+
+/**
+ * @brief Sender end: start, next frame to put on the air, ACK received, no ACK in time
+ *
+ * lbm_p2p_bulk_tx_next_frame() returns 0 when the sender waits for an ACK or is over (done or failed).
+ */
+void    lbm_p2p_bulk_tx_init( lbm_p2p_bulk_tx_t* tx, const lbm_p2p_bulk_params_t* params, uint8_t session,
+                              lbm_p2p_bulk_source_t source, void* context );
+uint8_t lbm_p2p_bulk_tx_next_frame( lbm_p2p_bulk_tx_t* tx, uint8_t* frame );
+void    lbm_p2p_bulk_tx_on_ack( lbm_p2p_bulk_tx_t* tx, const uint8_t* ack, uint8_t size );
+void    lbm_p2p_bulk_tx_on_timeout( lbm_p2p_bulk_tx_t* tx );
+
+/**
+ * @brief Receiver end: start, frame received
+ *
+ * @return Size of the ACK written to ack (LBM_P2P_BULK_ACK_SIZE) when the frame asked for one, else 0
+ */
+void    lbm_p2p_bulk_rx_init( lbm_p2p_bulk_rx_t* rx, const lbm_p2p_bulk_params_t* params, lbm_p2p_bulk_sink_t sink,
+                              void* context );
+uint8_t lbm_p2p_bulk_rx_on_frame( lbm_p2p_bulk_rx_t* rx, const uint8_t* frame, uint8_t size, uint8_t* ack );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // LBM_P2P_BULK_H
+
+/* --- EOF ------------------------------------------------------------------ */
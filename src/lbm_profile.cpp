@@ -0,0 +1,232 @@
+/*!
+ * \file      lbm_profile.cpp
+ *
+ * \brief     Per-stage cycle counters of the modem engine
+ */
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <string.h>
+
+#include "lbm_profile.h"
+
+#if LBM_PROFILE
+
+#if defined( LBM_NATIVE )
+#include <time.h>
+#else
+#include <Arduino.h>
+#endif
+
+extern "C" {
+#include "radio_planner.h"
+#include "lr1_stack_mac_layer.h"
+#include "smtc_secure_element.h"
+#include "sx126x_hal.h"
+}
+
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE VARIABLES -------------------------------------------------------
+ */
+
+static const char* const stage_names[LBM_PROFILE_STAGE_COUNT] = {
+    "engine", "radio planner", "lr1mac build", "lr1mac parse", "crypto", "hal spi",
+};
+
+#if LBM_PROFILE
+// Only the task running the engine updates the counters
+static lbm_profile_stage_stats_t stages[LBM_PROFILE_STAGE_COUNT];
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS DEFINITION ---------------------------------------------
+ */
+
+void lbm_profile_get_stats( lbm_profile_stats_t* stats )
+{
+    memset( stats, 0, sizeof( *stats ) );
+#if LBM_PROFILE
+    stats->enabled = true;
+#if defined( LBM_NATIVE )
+    stats->cycles_per_us = 1000;
+#else
+    stats->cycles_per_us = getCpuFrequencyMhz( );
+#endif
+    for( int stage = 0; stage < LBM_PROFILE_STAGE_COUNT; stage++ )
+    {
+        stats->stages[stage] = stages[stage];
+        if( stages[stage].calls > 0 )
+        {
+            stats->stages[stage].avg_cycles = ( uint32_t ) ( stages[stage].total_cycles / stages[stage].calls );
+        }
+    }
+#endif
+}
+
+void lbm_profile_reset_stats( void )
+{
+#if LBM_PROFILE
+    memset( stages, 0, sizeof( stages ) );
+#endif
+}
+
+const char* lbm_profile_stage_name( lbm_profile_stage_t stage )
+{
+    return ( stage < LBM_PROFILE_STAGE_COUNT ) ? stage_names[stage] : "unknown";
+}
+
+#if LBM_PROFILE
+
+uint32_t lbm_profile_now( void )
+{
+#if defined( LBM_NATIVE )
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return ( uint32_t ) ( ( uint64_t ) now.tv_sec * 1000000000ULL + ( uint64_t ) now.tv_nsec );
+#else
+    return ESP.getCycleCount( );
+#endif
+}
+
+void lbm_profile_record( lbm_profile_stage_t stage, uint32_t start )
+{
+    // Unsigned difference: correct across one wrap of the 32-bit counter
+    const uint32_t             cycles = lbm_profile_now( ) - start;
+    lbm_profile_stage_stats_t* s      = &stages[stage];
+
+    if( ( s->calls == 0 ) || ( cycles < s->min_cycles ) )
+    {
+        s->min_cycles = cycles;
+    }
+    if( cycles > s->max_cycles )
+    {
+        s->max_cycles = cycles;
+    }
+    s->total_cycles += cycles;
+    s->calls++;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- LINKER WRAPPED FUNCTIONS ------------------------------------------------
+ */
+
+extern "C" rp_hook_status_t __real_rp_task_enqueue( radio_planner_t* rp, const rp_task_t* task, uint8_t* payload,
+                                                    uint16_t payload_size, const rp_radio_params_t* radio_params );
+extern "C" void             __real_rp_callback( radio_planner_t* rp );
+extern "C" void             __real_lr1_stack_mac_tx_frame_build( lr1_stack_mac_t* lr1_mac );
+extern "C" int              __real_lr1_stack_mac_rx_frame_decode( lr1_stack_mac_t* lr1_mac );
+extern "C" smtc_se_return_code_t __real_smtc_secure_element_aes_encrypt( const uint8_t* buffer, uint16_t size,
+                                                                         smtc_se_key_identifier_t key_id,
+                                                                         uint8_t* enc_buffer, uint8_t stack_id );
+extern "C" smtc_se_return_code_t __real_smtc_secure_element_compute_aes_cmac( uint8_t* mic_bx_buffer,
+                                                                              const uint8_t* buffer, uint16_t size,
+                                                                              smtc_se_key_identifier_t key_id,
+                                                                              uint32_t* cmac, uint8_t stack_id );
+extern "C" smtc_se_return_code_t __real_smtc_secure_element_verify_aes_cmac( uint8_t* buffer, uint16_t size,
+                                                                             uint32_t                 expected_cmac,
+                                                                             smtc_se_key_identifier_t key_id,
+                                                                             uint8_t                  stack_id );
+extern "C" sx126x_hal_status_t __real_sx126x_hal_write( const void* context, const uint8_t* command,
+                                                        const uint16_t command_length, const uint8_t* data,
+                                                        const uint16_t data_length );
+extern "C" sx126x_hal_status_t __real_sx126x_hal_read( const void* context, const uint8_t* command,
+                                                       const uint16_t command_length, uint8_t* data,
+                                                       const uint16_t data_length );
+
+extern "C" rp_hook_status_t __wrap_rp_task_enqueue( radio_planner_t* rp, const rp_task_t* task, uint8_t* payload,
+                                                    uint16_t payload_size, const rp_radio_params_t* radio_params )
+{
+    LBM_PROFILE_BEGIN( );
+    const rp_hook_status_t status = __real_rp_task_enqueue( rp, task, payload, payload_size, radio_params );
+    LBM_PROFILE_END( LBM_PROFILE_RADIO_PLANNER );
+    return status;
+}
+
+extern "C" void __wrap_rp_callback( radio_planner_t* rp )
+{
+    LBM_PROFILE_BEGIN( );
+    __real_rp_callback( rp );
+    LBM_PROFILE_END( LBM_PROFILE_RADIO_PLANNER );
+}
+
+extern "C" void __wrap_lr1_stack_mac_tx_frame_build( lr1_stack_mac_t* lr1_mac )
+{
+    LBM_PROFILE_BEGIN( );
+    __real_lr1_stack_mac_tx_frame_build( lr1_mac );
+    LBM_PROFILE_END( LBM_PROFILE_LR1MAC_BUILD );
+}
+
+extern "C" int __wrap_lr1_stack_mac_rx_frame_decode( lr1_stack_mac_t* lr1_mac )
+{
+    LBM_PROFILE_BEGIN( );
+    const int status = __real_lr1_stack_mac_rx_frame_decode( lr1_mac );
+    LBM_PROFILE_END( LBM_PROFILE_LR1MAC_PARSE );
+    return status;
+}
+
+extern "C" smtc_se_return_code_t __wrap_smtc_secure_element_aes_encrypt( const uint8_t* buffer, uint16_t size,
+                                                                         smtc_se_key_identifier_t key_id,
+                                                                         uint8_t* enc_buffer, uint8_t stack_id )
+{
+    LBM_PROFILE_BEGIN( );
+    const smtc_se_return_code_t status =
+        __real_smtc_secure_element_aes_encrypt( buffer, size, key_id, enc_buffer, stack_id );
+    LBM_PROFILE_END( LBM_PROFILE_CRYPTO );
+    return status;
+}
+
+extern "C" smtc_se_return_code_t __wrap_smtc_secure_element_compute_aes_cmac( uint8_t* mic_bx_buffer,
+                                                                              const uint8_t* buffer, uint16_t size,
+                                                                              smtc_se_key_identifier_t key_id,
+                                                                              uint32_t* cmac, uint8_t stack_id )
+{
+    LBM_PROFILE_BEGIN( );
+    const smtc_se_return_code_t status =
+        __real_smtc_secure_element_compute_aes_cmac( mic_bx_buffer, buffer, size, key_id, cmac, stack_id );
+    LBM_PROFILE_END( LBM_PROFILE_CRYPTO );
+    return status;
+}
+
+extern "C" smtc_se_return_code_t __wrap_smtc_secure_element_verify_aes_cmac( uint8_t* buffer, uint16_t size,
+                                                                             uint32_t                 expected_cmac,
+                                                                             smtc_se_key_identifier_t key_id,
+                                                                             uint8_t                  stack_id )
+{
+    LBM_PROFILE_BEGIN( );
+    const smtc_se_return_code_t status =
+        __real_smtc_secure_element_verify_aes_cmac( buffer, size, expected_cmac, key_id, stack_id );
+    LBM_PROFILE_END( LBM_PROFILE_CRYPTO );
+    return status;
+}
+
+extern "C" sx126x_hal_status_t __wrap_sx126x_hal_write( const void* context, const uint8_t* command,
+                                                        const uint16_t command_length, const uint8_t* data,
+                                                        const uint16_t data_length )
+{
+    LBM_PROFILE_BEGIN( );
+    const sx126x_hal_status_t status = __real_sx126x_hal_write( context, command, command_length, data, data_length );
+    LBM_PROFILE_END( LBM_PROFILE_HAL_SPI );
+    return status;
+}
+
+extern "C" sx126x_hal_status_t __wrap_sx126x_hal_read( const void* context, const uint8_t* command,
+                                                       const uint16_t command_length, uint8_t* data,
+                                                       const uint16_t data_length )
+{
+    LBM_PROFILE_BEGIN( );
+    const sx126x_hal_status_t status = __real_sx126x_hal_read( context, command, command_length, data, data_length );
+    LBM_PROFILE_END( LBM_PROFILE_HAL_SPI );
+    return status;
+}
+
+#endif  // LBM_PROFILE
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,138 @@
+/*!
+ * \file      lbm_profile.h
+ *
+ * \brief     Per-stage cycle counters of the modem engine
+ *
+ * Each stage records its call count and the min / max / total duration of a call, in CPU cycles on the target
+ * (CCOUNT register) and in nanoseconds on the host (CLOCK_MONOTONIC). Durations are inclusive: the SPI transfers
+ * issued by the radio planner are also counted in the radio planner stage.
+ *
+ * The stages inside the modem library are measured by intercepting their entry points at link time. The
+ * -Wl,--wrap flags and LBM_PROFILE=1 come together in the [profile] section of platformio.ini. Without them
+ * nothing is compiled: the macros are empty and the wrappers do not exist. Calls made from inside the same
+ * translation unit as the wrapped function are not seen.
+ */
+
+#ifndef LBM_PROFILE_H
+#define LBM_PROFILE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC CONSTANTS --------------------------------------------------------
+ */
+
+/**
+ * @brief 1: build the instrumentation (needs the link flags of [profile] in platformio.ini)
+ */
+#ifndef LBM_PROFILE
+#define LBM_PROFILE 0
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC TYPES ------------------------------------------------------------
+ */
+
+/**
+ * @brief Instrumented stages
+ */
+typedef enum lbm_profile_stage_e
+{
+    LBM_PROFILE_ENGINE,         //!< smtc_modem_run_engine(), everything below included
+    LBM_PROFILE_RADIO_PLANNER,  //!< rp_task_enqueue() and rp_callback(): task arbitration and radio setup
+    LBM_PROFILE_LR1MAC_BUILD,   //!< lr1_stack_mac_tx_frame_build()
+    LBM_PROFILE_LR1MAC_PARSE,   //!< lr1_stack_mac_rx_frame_decode()
+    LBM_PROFILE_CRYPTO,         //!< AES and CMAC of the secure element, behind smtc_modem_crypto.c
+    LBM_PROFILE_HAL_SPI,        //!< sx126x_hal_read() and sx126x_hal_write()
+    LBM_PROFILE_STAGE_COUNT
+} lbm_profile_stage_t;
+
+/**
+ * @brief Counters of one stage
+ */
+typedef struct lbm_profile_stage_stats_s
+{
+    uint32_t calls;
+    uint32_t min_cycles;    //!< 0 when calls is 0
+    uint32_t max_cycles;
+    uint32_t avg_cycles;    //!< total_cycles / calls
+    uint64_t total_cycles;
+} lbm_profile_stage_stats_t;
+
+/**
+ * @brief Snapshot of all stages
+ */
+typedef struct lbm_profile_stats_s
+{
+    bool                      enabled;         //!< false: built without LBM_PROFILE, all counters are 0
+    uint32_t                  cycles_per_us;   //!< counter frequency (1000 on the host: nanoseconds)
+    lbm_profile_stage_stats_t stages[LBM_PROFILE_STAGE_COUNT];
+} lbm_profile_stats_t;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS PROTOTYPES --------------------------------------------
+ */
+
+/**
+ * @brief Copy the counters
+ */
+void lbm_profile_get_stats( lbm_profile_stats_t* stats );
+
+/**
+ * @brief Clear the counters
+ */
+void lbm_profile_reset_stats( void );
+
+/**
+ * @brief Printable name of a stage
+ */
+const char* lbm_profile_stage_name( lbm_profile_stage_t stage );
+
+#if LBM_PROFILE
+
+/**
+ * @brief Current value of the cycle counter
+ */
+uint32_t lbm_profile_now( void );
+
+/**
+ * @brief Account one call of a stage that started at start (value of lbm_profile_now())
+ */
+void lbm_profile_record( lbm_profile_stage_t stage, uint32_t start );
+
+#define LBM_PROFILE_BEGIN( ) const uint32_t lbm_profile_start = lbm_profile_now( )
+#define LBM_PROFILE_END( stage ) lbm_profile_record( stage, lbm_profile_start )
+
+#else
+
+#define LBM_PROFILE_BEGIN( ) \
+    do                       \
+    {                        \
+    } while( 0 )
+#define LBM_PROFILE_END( stage ) \
+    do                           \
+    {                            \
+    } while( 0 )
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // LBM_PROFILE_H
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,120 @@
+/*!
+ * \file      lbm_radio_hooks.cpp
+ *
+ * \brief     Radio driver hooks: the linker-wrapped sx126x and ral calls, fanned out to the modules observing them
+ *
+ * Every sx126x / ral driver call wrapped at link time (see [basic_modem] in platformio.ini) is defined here and
+ * only here, so the order in which the modules see a radio command is written down once:
+ *
+ * - set_tx: session (save), class B (class A windows follow), NVM (flush before the frame is on air), energy;
+ * - set_rx / set_rx_with_timeout_in_rtc_step: energy, then class B opens its window;
+ * - set_standby / set_sleep: class B closes its window, then energy;
+ * - set_cad, ral_sx126x_set_tx_cfg: energy;
+ * - set_lora_pkt_params, get_rx_buffer_status: class B.
+ *
+ * A module observing the radio adds a lbm_<module>_on_*() hook and calls it from here; adding a wrap means adding
+ * its -Wl,--wrap flag too. The bus transfers (sx126x_hal_read / _write) are timed by lbm_profile.cpp, under the
+ * optional [profile] flags.
+ */
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include "lbm_nvm.h"
+#include "lbm_session.h"
+#include "lbm_class_b.h"
+#include "lbm_energy.h"
+
+extern "C" {
+#include "sx126x.h"
+#include "ral_sx126x.h"
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- LINKER WRAPPED FUNCTIONS ------------------------------------------------
+ */
+
+extern "C" sx126x_status_t __real_sx126x_set_tx( const void* context, const uint32_t timeout_in_ms );
+extern "C" sx126x_status_t __real_sx126x_set_rx( const void* context, const uint32_t timeout_in_ms );
+extern "C" sx126x_status_t __real_sx126x_set_rx_with_timeout_in_rtc_step( const void*    context,
+                                                                          const uint32_t timeout_in_rtc_step );
+extern "C" sx126x_status_t __real_sx126x_set_standby( const void* context, const sx126x_standby_cfg_t cfg );
+extern "C" sx126x_status_t __real_sx126x_set_sleep( const void* context, const sx126x_sleep_cfgs_t cfg );
+extern "C" sx126x_status_t __real_sx126x_set_cad( const void* context );
+extern "C" sx126x_status_t __real_sx126x_set_lora_pkt_params( const void* context, const sx126x_pkt_params_lora_t* params );
+extern "C" sx126x_status_t __real_sx126x_get_rx_buffer_status( const void*                context,
+                                                               sx126x_rx_buffer_status_t* rx_buffer_status );
+extern "C" ral_status_t    __real_ral_sx126x_set_tx_cfg( const void* context, const int8_t output_pwr_in_dbm,
+                                                         const uint32_t rf_freq_in_hz );
+
+extern "C" sx126x_status_t __wrap_sx126x_set_tx( const void* context, const uint32_t timeout_in_ms )
+{
+    // What the frame depends on (frame counter, DevNonce) must survive a reset once it is on air
+    lbm_session_on_tx( );
+    lbm_class_b_on_tx( );
+    lbm_nvm_on_tx( );
+    lbm_energy_on_radio( LBM_ENERGY_RADIO_TX );
+    return __real_sx126x_set_tx( context, timeout_in_ms );
+}
+
+extern "C" sx126x_status_t __wrap_sx126x_set_rx( const void* context, const uint32_t timeout_in_ms )
+{
+    const sx126x_status_t status = __real_sx126x_set_rx( context, timeout_in_ms );
+    lbm_energy_on_radio( LBM_ENERGY_RADIO_RX );
+    lbm_class_b_on_rx( );
+    return status;
+}
+
+extern "C" sx126x_status_t __wrap_sx126x_set_rx_with_timeout_in_rtc_step( const void*    context,
+                                                                          const uint32_t timeout_in_rtc_step )
+{
+    const sx126x_status_t status = __real_sx126x_set_rx_with_timeout_in_rtc_step( context, timeout_in_rtc_step );
+    lbm_energy_on_radio( LBM_ENERGY_RADIO_RX );
+    lbm_class_b_on_rx( );
+    return status;
+}
+
+extern "C" sx126x_status_t __wrap_sx126x_set_standby( const void* context, const sx126x_standby_cfg_t cfg )
+{
+    lbm_class_b_on_radio_idle( );
+    lbm_energy_on_radio( LBM_ENERGY_RADIO_STANDBY );
+    return __real_sx126x_set_standby( context, cfg );
+}
+
+extern "C" sx126x_status_t __wrap_sx126x_set_sleep( const void* context, const sx126x_sleep_cfgs_t cfg )
+{
+    lbm_class_b_on_radio_idle( );
+    lbm_energy_on_radio( LBM_ENERGY_RADIO_SLEEP );
+    return __real_sx126x_set_sleep( context, cfg );
+}
+
+extern "C" sx126x_status_t __wrap_sx126x_set_cad( const void* context )
+{
+    lbm_energy_on_radio( LBM_ENERGY_RADIO_CAD );
+    return __real_sx126x_set_cad( context );
+}
+
+extern "C" sx126x_status_t __wrap_sx126x_set_lora_pkt_params( const void* context, const sx126x_pkt_params_lora_t* params )
+{
+    lbm_class_b_on_lora_pkt_params( params->invert_iq_is_on );
+    return __real_sx126x_set_lora_pkt_params( context, params );
+}
+
+extern "C" sx126x_status_t __wrap_sx126x_get_rx_buffer_status( const void*                context,
+                                                               sx126x_rx_buffer_status_t* rx_buffer_status )
+{
+    lbm_class_b_on_rx_done( );
+    return __real_sx126x_get_rx_buffer_status( context, rx_buffer_status );
+}
+
+extern "C" ral_status_t __wrap_ral_sx126x_set_tx_cfg( const void* context, const int8_t output_pwr_in_dbm,
+                                                      const uint32_t rf_freq_in_hz )
+{
+    lbm_energy_on_tx_power( output_pwr_in_dbm );
+    return __real_ral_sx126x_set_tx_cfg( context, output_pwr_in_dbm, rf_freq_in_hz );
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,336 @@
+/*!
+ * \file      lbm_rx_ring.cpp
+ *
+ * \brief     Class C receive ring: every downlink frame with its metadata, drained by the application in batches
+ */
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <atomic>
+#include <string.h>
+
+#include "lbm_rx_ring.h"
+#include "lbm_engine.h"
+#include "lbm_log.h"
+
+#include "smtc_modem_hal.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE CONSTANTS -------------------------------------------------------
+ */
+
+#if( LBM_RX_RING_SIZE & ( LBM_RX_RING_SIZE - 1 ) ) != 0
+#error "LBM_RX_RING_SIZE must be a power of 2"
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE VARIABLES -------------------------------------------------------
+ */
+
+static lbm_rx_frame_t default_ring[LBM_RX_RING_SIZE];
+
+// Frame read while the ring is full or stopping: the event bus still gets it
+static lbm_rx_frame_t scratch;
+
+static lbm_rx_frame_t* ring     = default_ring;
+static uint32_t        capacity = LBM_RX_RING_SIZE;
+
+// Free-running indexes: head is only written by the producer, tail only by the consumer
+static std::atomic<uint32_t> head( 0 );
+static std::atomic<uint32_t> tail( 0 );
+
+static std::atomic<bool> started( false );
+// Set while the engine writes a slot, lbm_rx_ring_stop() waits for it before the storage goes back
+static std::atomic<bool> producing( false );
+
+// Wakes up lbm_rx_ring_wait(), may be given while nobody waits
+static SemaphoreHandle_t data_available = nullptr;
+
+// Producer side counters
+static uint32_t             received        = 0;
+static uint32_t             dropped         = 0;
+static uint32_t             high_watermark  = 0;
+static uint32_t             window_start_ms = 0;
+static uint32_t             second_start_ms = 0;
+static uint32_t             second_count    = 0;
+static uint32_t             peak_per_s      = 0;
+static lbm_uplink_latency_t rx_to_queue;
+static uint64_t             rx_to_queue_total_ms = 0;
+
+// Consumer side counters
+static uint32_t             seen      = 0;  // index up to which frames were delivered
+static uint32_t             delivered = 0;
+static uint32_t             released  = 0;
+static lbm_uplink_latency_t rx_to_app;
+static uint64_t             rx_to_app_total_ms = 0;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DECLARATION -------------------------------------------
+ */
+
+static void     count_rate( uint32_t now_ms );
+static uint32_t elapsed_ms( uint32_t since_ms, uint32_t now_ms );
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS DEFINITION ---------------------------------------------
+ */
+
+smtc_modem_return_code_t lbm_rx_ring_start( lbm_rx_frame_t* storage, uint16_t size )
+{
+    if( ( storage != nullptr ) &&
+        ( ( size == 0 ) || ( size > LBM_RX_RING_MAX_SIZE ) || ( ( size & ( size - 1 ) ) != 0 ) ) )
+    {
+        return SMTC_MODEM_RC_INVALID;
+    }
+    if( started.load( std::memory_order_acquire ) == true )
+    {
+        return SMTC_MODEM_RC_BUSY;
+    }
+    if( data_available == nullptr )
+    {
+        data_available = xSemaphoreCreateBinary( );
+    }
+
+    ring     = ( storage != nullptr ) ? storage : default_ring;
+    capacity = ( storage != nullptr ) ? size : LBM_RX_RING_SIZE;
+    head.store( 0, std::memory_order_relaxed );
+    tail.store( 0, std::memory_order_relaxed );
+    seen = 0;
+    lbm_rx_ring_reset_stats( );
+
+    started.store( true, std::memory_order_seq_cst );
+    LBM_LOG_INFO( "RX ring started: %u frames\n", capacity );
+    return SMTC_MODEM_RC_OK;
+}
+
+void lbm_rx_ring_stop( void )
+{
+    started.store( false, std::memory_order_seq_cst );
+    while( producing.load( std::memory_order_seq_cst ) == true )
+    {
+        vTaskDelay( 1 );
+    }
+    tail.store( head.load( std::memory_order_acquire ), std::memory_order_release );
+    seen = tail.load( std::memory_order_relaxed );
+}
+
+bool lbm_rx_ring_is_started( void )
+{
+    return started.load( std::memory_order_acquire );
+}
+
+const lbm_dl_buffer_t* lbm_rx_ring_read_downlink( void )
+{
+    producing.store( true, std::memory_order_seq_cst );
+
+    const uint32_t  h     = head.load( std::memory_order_relaxed );
+    const uint32_t  t     = tail.load( std::memory_order_acquire );
+    const bool      open  = started.load( std::memory_order_seq_cst );
+    const bool      full  = ( h - t ) >= capacity;
+    lbm_rx_frame_t* frame = ( ( open == true ) && ( full == false ) ) ? &ring[h & ( capacity - 1 )] : &scratch;
+
+    lbm_dl_buffer_t* downlink = &frame->downlink;
+    if( smtc_modem_get_downlink_data( downlink->data, &downlink->size, &downlink->metadata, &downlink->remaining ) !=
+        SMTC_MODEM_RC_OK )
+    {
+        producing.store( false, std::memory_order_release );
+        return nullptr;
+    }
+    downlink->payload = downlink->data;
+
+    const uint32_t now_ms = smtc_modem_hal_get_time_in_ms( );
+    frame->sequence       = received;
+    frame->rx_done_ms     = downlink->metadata.timestamp;
+    frame->queued_ms      = now_ms;
+
+    if( open == false )
+    {
+        producing.store( false, std::memory_order_release );
+        return downlink;
+    }
+
+    received++;
+    count_rate( now_ms );
+    if( full == true )
+    {
+        dropped++;
+        LBM_LOG_WARN( "RX ring full, frame %u dropped\n", frame->sequence );
+        producing.store( false, std::memory_order_release );
+        return downlink;
+    }
+
+    lbm_uplink_latency_add( &rx_to_queue, &rx_to_queue_total_ms, elapsed_ms( frame->rx_done_ms, now_ms ) );
+
+    // Publish the frame
+    head.store( h + 1, std::memory_order_release );
+    producing.store( false, std::memory_order_release );
+
+    if( ( h + 1 - t ) > high_watermark )
+    {
+        high_watermark = h + 1 - t;
+    }
+
+    xSemaphoreGive( data_available );
+    // The consumer may be the task that runs the engine: make sure it does not go back to sleep
+    lbm_engine_notify( );
+    return downlink;
+}
+
+uint16_t lbm_rx_ring_peek( const lbm_rx_frame_t** frames )
+{
+    const uint32_t t = tail.load( std::memory_order_relaxed );
+    const uint32_t h = head.load( std::memory_order_acquire );
+
+    if( ( started.load( std::memory_order_acquire ) == false ) || ( t == h ) )
+    {
+        return 0;
+    }
+
+    // Contiguous run of slots, the frames that wrapped around come with the next call
+    const uint32_t first = t & ( capacity - 1 );
+    uint32_t       count = h - t;
+    if( count > ( capacity - first ) )
+    {
+        count = capacity - first;
+    }
+
+    const uint32_t now_ms = smtc_modem_hal_get_time_in_ms( );
+    for( uint32_t i = ( ( int32_t ) ( seen - t ) > 0 ) ? seen : t; ( int32_t ) ( t + count - i ) > 0; i++ )
+    {
+        const lbm_rx_frame_t* frame = &ring[i & ( capacity - 1 )];
+        lbm_uplink_latency_add( &rx_to_app, &rx_to_app_total_ms, elapsed_ms( frame->rx_done_ms, now_ms ) );
+        delivered++;
+        seen = i + 1;
+    }
+
+    *frames = &ring[first];
+    return ( uint16_t ) count;
+}
+
+uint16_t lbm_rx_ring_wait( const lbm_rx_frame_t** frames, uint32_t timeout_ms )
+{
+    const uint32_t start_ms = smtc_modem_hal_get_time_in_ms( );
+
+    for( ;; )
+    {
+        const uint16_t count = lbm_rx_ring_peek( frames );
+        if( count > 0 )
+        {
+            return count;
+        }
+        if( data_available == nullptr )
+        {
+            return 0;
+        }
+
+        const uint32_t waited_ms = smtc_modem_hal_get_time_in_ms( ) - start_ms;
+        if( waited_ms >= timeout_ms )
+        {
+            return 0;
+        }
+
+        const uint32_t   remaining_ms = timeout_ms - waited_ms;
+        const TickType_t ticks =
+            ( timeout_ms == LBM_ENGINE_WAIT_FOREVER ) ? portMAX_DELAY : pdMS_TO_TICKS( remaining_ms );
+        if( xSemaphoreTake( data_available, ticks ) != pdPASS )
+        {
+            // Timed out, last chance for a frame published just before the deadline
+            return lbm_rx_ring_peek( frames );
+        }
+    }
+}
+
+void lbm_rx_ring_release( uint16_t count )
+{
+    const uint32_t t = tail.load( std::memory_order_relaxed );
+    const uint32_t h = head.load( std::memory_order_acquire );
+
+    if( count > ( h - t ) )
+    {
+        count = ( uint16_t ) ( h - t );
+    }
+
+    // Hand the slots back to the producer
+    tail.store( t + count, std::memory_order_release );
+    released += count;
+}
+
+void lbm_rx_ring_get_stats( lbm_rx_ring_stats_t* stats )
+{
+    const uint32_t now_ms = smtc_modem_hal_get_time_in_ms( );
+
+    memset( stats, 0, sizeof( *stats ) );
+    stats->capacity        = ( started.load( std::memory_order_acquire ) == true ) ? capacity : 0;
+    stats->received        = received;
+    stats->dropped         = dropped;
+    stats->delivered       = delivered;
+    stats->released        = released;
+    stats->depth           = head.load( std::memory_order_acquire ) - tail.load( std::memory_order_acquire );
+    stats->high_watermark  = high_watermark;
+    stats->window_ms       = elapsed_ms( window_start_ms, now_ms );
+    stats->downlinks_per_s = ( stats->window_ms > 0 ) ? ( float ) received * 1000.0f / stats->window_ms : 0.0f;
+    stats->peak_per_s      = ( second_count > peak_per_s ) ? second_count : peak_per_s;
+
+    stats->rx_to_queue = rx_to_queue;
+    stats->rx_to_queue.average_ms =
+        ( rx_to_queue.count > 0 ) ? ( float ) rx_to_queue_total_ms / rx_to_queue.count : 0.0f;
+    stats->rx_to_app            = rx_to_app;
+    stats->rx_to_app.average_ms = ( rx_to_app.count > 0 ) ? ( float ) rx_to_app_total_ms / rx_to_app.count : 0.0f;
+}
+
+void lbm_rx_ring_reset_stats( void )
+{
+    received             = 0;
+    dropped              = 0;
+    high_watermark       = 0;
+    window_start_ms      = smtc_modem_hal_get_time_in_ms( );
+    second_start_ms      = window_start_ms;
+    second_count         = 0;
+    peak_per_s           = 0;
+    rx_to_queue_total_ms = 0;
+    memset( &rx_to_queue, 0, sizeof( rx_to_queue ) );
+
+    delivered          = 0;
+    released           = 0;
+    rx_to_app_total_ms = 0;
+    memset( &rx_to_app, 0, sizeof( rx_to_app ) );
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DEFINITION --------------------------------------------
+ */
+
+static void count_rate( uint32_t now_ms )
+{
+    // One second buckets from the start of the window
+    if( elapsed_ms( second_start_ms, now_ms ) >= 1000 )
+    {
+        if( second_count > peak_per_s )
+        {
+            peak_per_s = second_count;
+        }
+        second_start_ms += ( elapsed_ms( second_start_ms, now_ms ) / 1000 ) * 1000;
+        second_count = 0;
+    }
+    second_count++;
+}
+
+static uint32_t elapsed_ms( uint32_t since_ms, uint32_t now_ms )
+{
+    // A timestamp taken after now (not set by the stack) counts as no delay
+    return ( ( int32_t ) ( now_ms - since_ms ) > 0 ) ? now_ms - since_ms : 0;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,161 @@
+/*!
+ * \file      lbm_rx_ring.h
+ *
+ * \brief     Class C receive ring: every downlink frame with its metadata, drained by the application in batches
+ *
+ * Once started, modem_event_callback() reads each DOWNDATA straight into the next slot of this ring instead of a
+ * pool buffer (lbm_dl_pool.h), so a burst of class C or multicast downlinks is taken out of the modem as fast as
+ * the engine gets the events, whatever the application is doing. The application drains the ring from its own
+ * task: lbm_rx_ring_peek() returns the frames queued as one contiguous run of slots, read in place, and
+ * lbm_rx_ring_release() hands them back at once.
+ *
+ * The storage and its size are chosen by the application (a power of 2 of lbm_rx_frame_t, e.g. in PSRAM), or a
+ * static ring of LBM_RX_RING_SIZE frames. A frame arriving while the ring is full is still read out of the modem
+ * and seen by the event bus subscribers, then dropped and counted. The engine is the only producer and a single
+ * application task the only consumer, as for lbm_event_ring.h.
+ *
+ * Counters cover the throughput (frames per second over the window, busiest second) and two delay histograms:
+ * RX done to queued (engine) and RX done to the first lbm_rx_ring_peek() that returned the frame (application).
+ */
+
+#ifndef LBM_RX_RING_H
+#define LBM_RX_RING_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "smtc_modem_api.h"
+#include "lbm_dl_pool.h"
+#include "lbm_uplink.h"
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC CONSTANTS --------------------------------------------------------
+ */
+
+/**
+ * @brief Frames of the static ring used when the application gives no storage (power of 2)
+ */
+#ifndef LBM_RX_RING_SIZE
+#define LBM_RX_RING_SIZE 16
+#endif
+
+/**
+ * @brief Largest ring (power of 2)
+ */
+#define LBM_RX_RING_MAX_SIZE 1024
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC TYPES ------------------------------------------------------------
+ */
+
+/**
+ * @brief Frame as queued for the application
+ */
+typedef struct lbm_rx_frame_s
+{
+    lbm_dl_buffer_t downlink;   //!< payload, size and metadata (window, fport, RSSI, SNR, stack)
+    uint32_t        sequence;   //!< frames received since lbm_rx_ring_start(), dropped ones included
+    uint32_t        rx_done_ms; //!< modem time of the end of the reception (metadata timestamp)
+    uint32_t        queued_ms;  //!< modem time the engine queued it
+} lbm_rx_frame_t;
+
+/**
+ * @brief Ring counters
+ */
+typedef struct lbm_rx_ring_stats_s
+{
+    uint32_t             capacity;        //!< frames, 0 when stopped
+    uint32_t             received;        //!< frames read out of the modem while started
+    uint32_t             dropped;         //!< of which lost because the ring was full
+    uint32_t             delivered;       //!< frames returned by lbm_rx_ring_peek() / lbm_rx_ring_wait()
+    uint32_t             released;
+    uint32_t             depth;           //!< frames currently queued
+    uint32_t             high_watermark;  //!< highest depth seen
+    uint32_t             window_ms;       //!< since the start or the last reset
+    float                downlinks_per_s; //!< received over the window
+    uint32_t             peak_per_s;      //!< most frames received within one second of the window
+    lbm_uplink_latency_t rx_to_queue;     //!< RX done to queued, frames queued
+    lbm_uplink_latency_t rx_to_app;       //!< RX done to the application, frames delivered
+} lbm_rx_ring_stats_t;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS PROTOTYPES --------------------------------------------
+ */
+
+/**
+ * @brief Route the downlinks of every stack to the ring
+ *
+ * @param [in] storage Frames of the ring, owned by the module until lbm_rx_ring_stop(); NULL for the static ring
+ * @param [in] size    Frames in storage, a power of 2 up to LBM_RX_RING_MAX_SIZE (ignored without storage)
+ *
+ * @return SMTC_MODEM_RC_OK, SMTC_MODEM_RC_INVALID for a bad size, SMTC_MODEM_RC_BUSY if already started
+ */
+smtc_modem_return_code_t lbm_rx_ring_start( lbm_rx_frame_t* storage, uint16_t size );
+
+/**
+ * @brief Give downlinks back to the pool delivery, dropping the frames still queued
+ *
+ * @remark No frame returned by lbm_rx_ring_peek() may be used afterwards
+ */
+void lbm_rx_ring_stop( void );
+
+bool lbm_rx_ring_is_started( void );
+
+/**
+ * @brief Read the pending downlink out of the modem into the ring (producer side, engine context)
+ *
+ * @return The downlink read, in the ring or in a scratch frame if the ring was full, valid until the next call;
+ *         NULL if the modem had none
+ */
+const lbm_dl_buffer_t* lbm_rx_ring_read_downlink( void );
+
+/**
+ * @brief Get the oldest queued frames without blocking (consumer side)
+ *
+ * @param [out] frames First frame, the others follow it in memory
+ *
+ * @return Frames available from *frames on, up to the end of the storage: after releasing them, the next call
+ *         returns those that wrapped around. 0 if the ring is empty
+ */
+uint16_t lbm_rx_ring_peek( const lbm_rx_frame_t** frames );
+
+/**
+ * @brief Same as lbm_rx_ring_peek(), blocking the calling task up to timeout_ms for a frame to arrive
+ *
+ * @remark Must not be called from the task that runs the engine: nothing would fill the ring meanwhile
+ *
+ * @return 0 on timeout
+ */
+uint16_t lbm_rx_ring_wait( const lbm_rx_frame_t** frames, uint32_t timeout_ms );
+
+/**
+ * @brief Hand the oldest frames back to the producer
+ *
+ * @param [in] count Frames, at most those returned by the last lbm_rx_ring_peek() / lbm_rx_ring_wait()
+ */
+void lbm_rx_ring_release( uint16_t count );
+
+/**
+ * @brief Read / clear the counters and histograms (queued frames are kept)
+ */
+void lbm_rx_ring_get_stats( lbm_rx_ring_stats_t* stats );
+void lbm_rx_ring_reset_stats( void );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // LBM_RX_RING_H
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,302 @@
+/*!
+ * \file      lbm_session.cpp
+ *
+ * \brief     Warm start: saved LoRaWAN session, resumed in place of a join
+ */
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <string.h>
+
+#include "lbm_session.h"
+#include "lbm_core.h"
+#include "lbm_nvm.h"
+#include "lbm_log.h"
+
+extern "C" {
+#include "smtc_modem_hal.h"
+#include "lorawan_api.h"
+#include "lr1_stack_mac_layer.h"
+#include "modem_event_utilities.h"
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE CONSTANTS -------------------------------------------------------
+ */
+
+#define SESSION_MAGIC 0x534D424Cu  // "LBMS"
+#define SESSION_VERSION 2
+
+// Regional state of lr1mac: channels of the CFList and NewChannelReq, channel mask of LinkADRReq, DlChannelReq
+// frequencies. The union holds the context of each region built in, plain arrays without pointers.
+#define SESSION_REGION( mac ) ( ( mac )->real->region )
+#define SESSION_REGION_SIZE sizeof( SESSION_REGION( ( lr1_stack_mac_t* ) nullptr ) )
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE TYPES -----------------------------------------------------------
+ */
+
+typedef struct session_record_s
+{
+    uint32_t magic;
+    uint8_t  version;
+    uint8_t  saved;  // 0 once the session was left
+    uint8_t  region;
+    uint8_t  rfu;
+    uint8_t  dev_eui[SMTC_MODEM_EUI_LENGTH];
+    uint8_t  join_eui[SMTC_MODEM_EUI_LENGTH];
+    uint32_t dev_addr;
+    uint32_t fcnt_up;  // counter of the last frame sent
+    uint32_t fcnt_down;
+    uint32_t rx2_frequency;
+    uint32_t age_s;
+    uint16_t warm_boots;
+    uint8_t  tx_data_rate;
+    uint8_t  rx1_dr_offset;
+    uint8_t  rx2_data_rate;
+    uint8_t  rx1_delay_s;
+    uint8_t  nb_trans;
+    int8_t   tx_power;
+    uint8_t  region_context[SESSION_REGION_SIZE];
+} session_record_t;
+
+static_assert( sizeof( session_record_t ) <= LBM_NVM_CONTEXT_SIZE,
+               "the regions built in need a larger LBM_NVM_CONTEXT_SIZE for the saved session" );
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE VARIABLES -------------------------------------------------------
+ */
+
+static bool                 enabled = false;
+static lbm_session_policy_t policy  = { LBM_SESSION_MAX_AGE_S, LBM_SESSION_MAX_FCNT_UP, LBM_SESSION_MAX_WARM_BOOTS };
+
+static session_record_t    record;           // saved session, then the one in use
+static bool                active   = false;  // record follows the session in use
+static bool                resuming = false;  // the next JOINED event is the one of lbm_session_resume()
+static bool                uplink_seen  = false;  // a LoRaWAN uplink of the stack went on air since the boot
+static uint32_t            uplink_fcnt  = 0;      // its frame counter
+static uint32_t            boot_ms      = 0;
+static uint32_t            start_ms     = 0;  // when the running time of the session was last taken
+static lbm_session_stats_t stats;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DECLARATION -------------------------------------------
+ */
+
+/**
+ * @brief Copy the state of lr1mac into the record and hand it to the journal
+ */
+static void save( void );
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS DEFINITION ---------------------------------------------
+ */
+
+void lbm_session_enable( bool enable, const lbm_session_policy_t* new_policy )
+{
+    enabled = enable;
+    if( new_policy != nullptr )
+    {
+        policy = *new_policy;
+    }
+}
+
+void lbm_session_init( void )
+{
+    memset( &stats, 0, sizeof( stats ) );
+    memset( &record, 0, sizeof( record ) );
+    active      = false;
+    resuming    = false;
+    uplink_seen = false;
+    boot_ms     = smtc_modem_hal_get_time_in_ms( );
+    if( enabled == false )
+    {
+        stats.result = LBM_SESSION_DISABLED;
+        return;
+    }
+
+    const uint16_t size = lbm_nvm_restore_context( LBM_NVM_CONTEXT_SESSION, ( uint8_t* ) &record, sizeof( record ) );
+    if( ( size == 0 ) || ( record.magic == 0xFFFFFFFF ) || ( ( record.magic == SESSION_MAGIC ) && ( record.saved == 0 ) ) )
+    {
+        stats.result = LBM_SESSION_NONE;
+    }
+    else if( ( size != sizeof( record ) ) || ( record.magic != SESSION_MAGIC ) || ( record.version != SESSION_VERSION ) )
+    {
+        stats.result = LBM_SESSION_DAMAGED;
+    }
+    else if( ( ( policy.max_age_s != 0 ) && ( record.age_s >= policy.max_age_s ) ) ||
+             ( ( policy.max_fcnt_up != 0 ) && ( record.fcnt_up >= policy.max_fcnt_up ) ) ||
+             ( ( policy.max_warm_boots != 0 ) && ( record.warm_boots >= policy.max_warm_boots ) ) )
+    {
+        stats.result = LBM_SESSION_EXPIRED;
+    }
+    else
+    {
+        stats.result = LBM_SESSION_VALID;
+    }
+    stats.dev_addr   = record.dev_addr;
+    stats.age_s      = record.age_s;
+    stats.warm_boots = record.warm_boots;
+    LBM_LOG_INFO( "Saved session %08X: result %d, fcnt %u, %u s, %u warm boots\n", record.dev_addr, stats.result,
+                  record.fcnt_up, record.age_s, record.warm_boots );
+}
+
+bool lbm_session_resume( void )
+{
+    if( stats.result != LBM_SESSION_VALID )
+    {
+        return false;
+    }
+
+    uint8_t             dev_eui[SMTC_MODEM_EUI_LENGTH];
+    uint8_t             join_eui[SMTC_MODEM_EUI_LENGTH];
+    smtc_modem_region_t region;
+    if( ( smtc_modem_get_deveui( STACK_ID, dev_eui ) != SMTC_MODEM_RC_OK ) ||
+        ( smtc_modem_get_joineui( STACK_ID, join_eui ) != SMTC_MODEM_RC_OK ) ||
+        ( smtc_modem_get_region( STACK_ID, &region ) != SMTC_MODEM_RC_OK ) ||
+        ( memcmp( dev_eui, record.dev_eui, sizeof( dev_eui ) ) != 0 ) ||
+        ( memcmp( join_eui, record.join_eui, sizeof( join_eui ) ) != 0 ) || ( region != record.region ) )
+    {
+        stats.result = LBM_SESSION_MISMATCH;
+        LBM_LOG_INFO( "Saved session is for other credentials, joining\n" );
+        return false;
+    }
+
+    // The session keys are already back in the secure element, from its own context
+    lr1_stack_mac_t* mac = lorawan_api_stack_mac_get( STACK_ID );
+    mac->dev_addr        = record.dev_addr;
+    mac->fcnt_up         = record.fcnt_up + 1;
+    mac->fcnt_dwn        = record.fcnt_down;
+    mac->tx_data_rate    = record.tx_data_rate;
+    mac->rx1_dr_offset   = record.rx1_dr_offset;
+    mac->rx2_data_rate   = record.rx2_data_rate;
+    mac->rx2_frequency   = record.rx2_frequency;
+    mac->rx1_delay_s     = record.rx1_delay_s;
+    mac->nb_trans        = record.nb_trans;
+    mac->tx_power        = record.tx_power;
+    mac->adr_ack_cnt     = 0;
+    memcpy( &SESSION_REGION( mac ), record.region_context, sizeof( record.region_context ) );
+    mac->join_status     = JOINED;
+
+    // Count the boot now: a device resetting before its first uplink still runs out of warm boots
+    record.warm_boots++;
+    record.fcnt_up = mac->fcnt_up;
+    active         = true;
+    resuming       = true;
+    start_ms       = boot_ms;
+    lbm_nvm_store_context( LBM_NVM_CONTEXT_SESSION, ( const uint8_t* ) &record, sizeof( record ) );
+    lbm_nvm_flush( );
+
+    stats.result          = LBM_SESSION_RESUMED;
+    stats.fcnt_up         = mac->fcnt_up;
+    stats.warm_boots      = record.warm_boots;
+    stats.time_to_join_ms = smtc_modem_hal_get_time_in_ms( ) - boot_ms;
+    increment_asynchronous_msgnumber( SMTC_MODEM_EVENT_JOINED, 0, STACK_ID );
+    LBM_LOG_INFO( "Session %08X resumed at fcnt %u\n", record.dev_addr, mac->fcnt_up );
+    return true;
+}
+
+void lbm_session_on_joined( void )
+{
+    if( resuming == true )
+    {
+        resuming = false;
+        return;
+    }
+    stats.time_to_join_ms = smtc_modem_hal_get_time_in_ms( ) - boot_ms;
+    if( enabled == false )
+    {
+        return;
+    }
+
+    // A new session: its running time and warm boots start over
+    memset( &record, 0, sizeof( record ) );
+    record.magic   = SESSION_MAGIC;
+    record.version = SESSION_VERSION;
+    record.saved   = 1;
+    smtc_modem_region_t region;
+    if( ( smtc_modem_get_deveui( STACK_ID, record.dev_eui ) != SMTC_MODEM_RC_OK ) ||
+        ( smtc_modem_get_joineui( STACK_ID, record.join_eui ) != SMTC_MODEM_RC_OK ) ||
+        ( smtc_modem_get_region( STACK_ID, &region ) != SMTC_MODEM_RC_OK ) )
+    {
+        return;
+    }
+    record.region = ( uint8_t ) region;
+    active        = true;
+    start_ms      = smtc_modem_hal_get_time_in_ms( );
+    save( );
+}
+
+void lbm_session_on_tx( void )
+{
+    // Every transmission comes here, P2P and the other stacks too: only a new frame counter of this stack is a
+    // new uplink, retransmissions of a frame reuse it
+    const lr1_stack_mac_t* mac = lorawan_api_stack_mac_get( STACK_ID );
+    if( ( mac->join_status != JOINED ) || ( ( uplink_seen == true ) && ( mac->fcnt_up == uplink_fcnt ) ) )
+    {
+        return;
+    }
+    uplink_seen = true;
+    uplink_fcnt = mac->fcnt_up;
+    if( stats.time_to_first_uplink_ms == 0 )
+    {
+        stats.time_to_first_uplink_ms = smtc_modem_hal_get_time_in_ms( ) - boot_ms;
+    }
+    if( ( active == true ) && ( mac->fcnt_up != record.fcnt_up ) )
+    {
+        save( );
+    }
+}
+
+void lbm_session_forget( void )
+{
+    active   = false;
+    resuming = false;
+    if( ( enabled == true ) && ( record.magic == SESSION_MAGIC ) )
+    {
+        record.saved = 0;
+        lbm_nvm_store_context( LBM_NVM_CONTEXT_SESSION, ( const uint8_t* ) &record, sizeof( record ) );
+        lbm_nvm_flush( );
+    }
+}
+
+void lbm_session_get_stats( lbm_session_stats_t* stats_out )
+{
+    *stats_out = stats;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DEFINITION --------------------------------------------
+ */
+
+static void save( void )
+{
+    const lr1_stack_mac_t* mac = lorawan_api_stack_mac_get( STACK_ID );
+    const uint32_t         now = smtc_modem_hal_get_time_in_ms( );
+
+    record.age_s += ( now - start_ms ) / 1000;
+    start_ms      = now - ( now - start_ms ) % 1000;
+    record.dev_addr      = mac->dev_addr;
+    record.fcnt_up       = mac->fcnt_up;
+    record.fcnt_down     = mac->fcnt_dwn;
+    record.tx_data_rate  = mac->tx_data_rate;
+    record.rx1_dr_offset = mac->rx1_dr_offset;
+    record.rx2_data_rate = mac->rx2_data_rate;
+    record.rx2_frequency = mac->rx2_frequency;
+    record.rx1_delay_s   = mac->rx1_delay_s;
+    record.nb_trans      = mac->nb_trans;
+    record.tx_power      = mac->tx_power;
+    memcpy( record.region_context, &SESSION_REGION( mac ), sizeof( record.region_context ) );
+    lbm_nvm_store_context( LBM_NVM_CONTEXT_SESSION, ( const uint8_t* ) &record, sizeof( record ) );
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,160 @@
+/*!
+ * \file      lbm_session.h
+ *
+ * \brief     Warm start: resume the joined LoRaWAN session after a reset instead of joining again
+ *
+ * Without it, every boot runs an OTAA join: a Join-Request, the RX windows of the Join-Accept and the join
+ * duty-cycle back-off on a failure, all before the first uplink can go. When enabled, the session of the stack
+ * (DevAddr, frame counters, data rate, TX power, RX window settings and the regional channel state) is saved in
+ * the lbm_nvm journal before each new uplink, next to the secure element context that holds the session keys. At
+ * the next boot, join() puts the saved session back into lr1mac and raises SMTC_MODEM_EVENT_JOINED at once.
+ *
+ * The uplink counter resumes one past the last frame sent, so no counter is used twice. The session is dropped,
+ * and join() runs a normal OTAA join, when:
+ * - DevEUI, JoinEUI or region differ from the saved session
+ * - the session is older than the policy allows: running time, uplink counter or warm boots in a row
+ * - the record is missing or damaged, or the lbm_nvm partition is missing, or it was saved by a build with
+ *   other regions
+ *
+ * The regional channel state is the lr1mac context of the region: the channels of the CFList and NewChannelReq,
+ * the channel mask of the last LinkADRReq and the DlChannelReq frequencies come back as the network left them.
+ */
+
+#ifndef LBM_SESSION_H
+#define LBM_SESSION_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "smtc_modem_api.h"
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC CONSTANTS --------------------------------------------------------
+ */
+
+/**
+ * @brief Default policy: running time of a session before a fresh join (30 days)
+ */
+#ifndef LBM_SESSION_MAX_AGE_S
+#define LBM_SESSION_MAX_AGE_S ( 30u * 24u * 3600u )
+#endif
+
+/**
+ * @brief Default policy: uplink counter from which a fresh join is preferred to a resumed session
+ */
+#ifndef LBM_SESSION_MAX_FCNT_UP
+#define LBM_SESSION_MAX_FCNT_UP 0xFFFF0000u
+#endif
+
+/**
+ * @brief Default policy: warm boots in a row before a fresh join
+ */
+#ifndef LBM_SESSION_MAX_WARM_BOOTS
+#define LBM_SESSION_MAX_WARM_BOOTS 32
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC TYPES ------------------------------------------------------------
+ */
+
+/**
+ * @brief When a saved session is too old to resume (0: no limit)
+ */
+typedef struct lbm_session_policy_s
+{
+    uint32_t max_age_s;       //!< running time since the join, summed over the boots
+    uint32_t max_fcnt_up;     //!< uplink counter
+    uint16_t max_warm_boots;  //!< warm boots in a row
+} lbm_session_policy_t;
+
+/**
+ * @brief What happened to the saved session at this boot
+ */
+typedef enum lbm_session_result_e
+{
+    LBM_SESSION_DISABLED = 0,  //!< warm start not enabled
+    LBM_SESSION_NONE,          //!< no saved session (never joined, left, or no lbm_nvm partition)
+    LBM_SESSION_DAMAGED,       //!< saved session unreadable
+    LBM_SESSION_EXPIRED,       //!< saved session past the policy limits
+    LBM_SESSION_MISMATCH,      //!< saved for other credentials or another region
+    LBM_SESSION_VALID,         //!< saved session can be resumed by join()
+    LBM_SESSION_RESUMED,       //!< join() resumed it, no Join-Request sent
+} lbm_session_result_t;
+
+/**
+ * @brief Boot counters
+ */
+typedef struct lbm_session_stats_s
+{
+    lbm_session_result_t result;
+    uint32_t             dev_addr;                 //!< of the saved or resumed session
+    uint32_t             fcnt_up;                  //!< next uplink counter of the resumed session
+    uint32_t             age_s;                    //!< running time of the saved session at boot
+    uint16_t             warm_boots;               //!< warm boots in a row of the session
+    uint32_t             time_to_join_ms;          //!< from init() to joined (resumed or OTAA), 0 if not yet
+    uint32_t             time_to_first_uplink_ms;  //!< from init() to the first uplink on air, 0 if not yet
+} lbm_session_stats_t;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS PROTOTYPES --------------------------------------------
+ */
+
+/**
+ * @brief Enable warm start and set its policy, before lbm_session_init()
+ *
+ * @param [in] policy Limits, NULL for the LBM_SESSION_MAX_* defaults
+ */
+void lbm_session_enable( bool enable, const lbm_session_policy_t* policy );
+
+/**
+ * @brief Start the boot timers and load the saved session, after lbm_nvm_init()
+ */
+void lbm_session_init( void );
+
+/**
+ * @brief Resume the saved session in place of a join, once credentials and region are set
+ *
+ * @return true if resumed: SMTC_MODEM_EVENT_JOINED follows, no Join-Request is sent
+ */
+bool lbm_session_resume( void );
+
+/**
+ * @brief Save the session of a fresh OTAA join (called on SMTC_MODEM_EVENT_JOINED)
+ */
+void lbm_session_on_joined( void );
+
+/**
+ * @brief Save the session before a new uplink of the stack goes on air (called before each transmission)
+ *
+ * P2P frames, the other stacks and the retransmissions of a frame leave the saved session as it is.
+ */
+void lbm_session_on_tx( void );
+
+/**
+ * @brief Drop the saved session, e.g. when leaving the network
+ */
+void lbm_session_forget( void );
+
+/**
+ * @brief Get the boot counters
+ */
+void lbm_session_get_stats( lbm_session_stats_t* stats );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // LBM_SESSION_H
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,339 @@
+/*!
+ * \file      lbm_sleep.cpp
+ *
+ * \brief     Tickless light-sleep run mode driven by the modem's next deadline
+ */
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <Arduino.h>
+
+#include "lbm_sleep.h"
+#include "lbm_engine.h"
+#include "lbm_energy.h"
+
+#include "smtc_modem_hal.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#if !defined( LBM_NATIVE )
+#include "esp_sleep.h"
+#include "esp_timer.h"
+#include "driver/gpio.h"
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE CONSTANTS -------------------------------------------------------
+ */
+
+/**
+ * @brief GPIO connected to the SX126x DIO1 line
+ */
+#ifndef LBM_SLEEP_DIO1_PIN
+#define LBM_SLEEP_DIO1_PIN LORA_SX126X_DIO1
+#endif
+
+/**
+ * @brief Drift below which the HAL clock is considered running during sleep (its resolution is 1 ms)
+ */
+#define TIME_COMPENSATION_THRESHOLD_US 2000
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE TYPES -----------------------------------------------------------
+ */
+
+typedef enum wakeup_cause_e
+{
+    WAKEUP_CAUSE_TIMER,
+    WAKEUP_CAUSE_DIO1,
+} wakeup_cause_t;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE VARIABLES -------------------------------------------------------
+ */
+
+static volatile int64_t time_offset_us = 0;  // Added to the modem HAL time base
+
+static void ( *radio_irq_callback )( void* context ) = nullptr;  // Callback registered by the modem
+static void*             radio_irq_context               = nullptr;
+static volatile uint32_t radio_irq_count                 = 0;
+
+static uint32_t stats_start_ms      = 0;
+static uint32_t light_sleeps        = 0;
+static uint32_t wakeups_on_timer    = 0;
+static uint32_t wakeups_on_dio1     = 0;
+static uint32_t dio1_replays        = 0;
+static uint32_t skipped_pending     = 0;
+static uint32_t light_sleep_time_ms = 0;
+static uint32_t wait_time_ms        = 0;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DECLARATION -------------------------------------------
+ */
+
+extern "C" uint32_t __real_smtc_modem_hal_get_time_in_ms( void );
+extern "C" uint32_t __real_smtc_modem_hal_get_time_in_s( void );
+extern "C" void     __real_smtc_modem_hal_irq_config_radio_irq( void ( *callback )( void* context ), void* context );
+
+/**
+ * @brief Clock that keeps running in light sleep, in µs
+ */
+static uint64_t reference_time_us( void );
+
+/**
+ * @brief Enter light sleep, platform part
+ */
+static wakeup_cause_t enter_light_sleep( uint32_t duration_ms );
+
+/**
+ * @brief Light sleep with HAL time compensation and counters
+ *
+ * @return Time slept in ms
+ */
+static uint32_t light_sleep( uint32_t duration_ms );
+
+/**
+ * @brief Installed as the modem radio irq callback to know whether the radio irq was delivered
+ */
+static void radio_irq_trampoline( void* context );
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS DEFINITION ---------------------------------------------
+ */
+
+lbm_sleep_plan_t lbm_sleep_plan( uint32_t engine_sleep_ms, uint32_t max_wait_ms, bool notification_pending )
+{
+    lbm_sleep_plan_t plan = { LBM_SLEEP_MODE_NONE, 0 };
+
+    if( notification_pending == true )
+    {
+        return plan;
+    }
+
+    const bool     engine_bound = ( engine_sleep_ms <= max_wait_ms );
+    const uint32_t wait_ms      = ( engine_bound == true ) ? engine_sleep_ms : max_wait_ms;
+    const uint32_t guard_ms     = ( engine_bound == true ) ? LBM_SLEEP_WAKEUP_GUARD_MS : 0;
+
+    if( wait_ms == 0 )
+    {
+        return plan;
+    }
+
+    if( wait_ms < ( LBM_SLEEP_MIN_MS + guard_ms ) )
+    {
+        plan.mode        = LBM_SLEEP_MODE_WAIT;
+        plan.duration_ms = wait_ms;
+    }
+    else
+    {
+        plan.mode        = LBM_SLEEP_MODE_LIGHT;
+        plan.duration_ms = wait_ms - guard_ms;
+    }
+    return plan;
+}
+
+uint32_t lbm_sleep_run_until_event( uint32_t max_wait_ms )
+{
+    const uint32_t         engine_sleep_ms = lbm_engine_run( );
+    const bool             pending         = lbm_engine_take_notification( );
+    const lbm_sleep_plan_t plan            = lbm_sleep_plan( engine_sleep_ms, max_wait_ms, pending );
+
+    switch( plan.mode )
+    {
+    case LBM_SLEEP_MODE_WAIT:
+    {
+        const uint32_t waited_ms = lbm_engine_wait( plan.duration_ms );
+        wait_time_ms += waited_ms;
+        return waited_ms;
+    }
+    case LBM_SLEEP_MODE_LIGHT:
+        return light_sleep( plan.duration_ms );
+    default:
+        if( pending == true )
+        {
+            skipped_pending++;
+        }
+        return 0;
+    }
+}
+
+void lbm_sleep_get_stats( lbm_sleep_stats_t* stats )
+{
+    stats->light_sleeps         = light_sleeps;
+    stats->wakeups_on_timer     = wakeups_on_timer;
+    stats->wakeups_on_dio1      = wakeups_on_dio1;
+    stats->dio1_replays         = dio1_replays;
+    stats->skipped_pending      = skipped_pending;
+    stats->light_sleep_time_ms  = light_sleep_time_ms;
+    stats->wait_time_ms         = wait_time_ms;
+    stats->elapsed_ms           = smtc_modem_hal_get_time_in_ms( ) - stats_start_ms;
+    stats->time_compensation_ms = ( int32_t ) ( time_offset_us / 1000 );
+    stats->residency_percent =
+        ( stats->elapsed_ms > 0 ) ? ( float ) light_sleep_time_ms * 100.0f / ( float ) stats->elapsed_ms : 0.0f;
+}
+
+void lbm_sleep_reset_stats( void )
+{
+    stats_start_ms      = smtc_modem_hal_get_time_in_ms( );
+    light_sleeps        = 0;
+    wakeups_on_timer    = 0;
+    wakeups_on_dio1     = 0;
+    dio1_replays        = 0;
+    skipped_pending     = 0;
+    light_sleep_time_ms = 0;
+    wait_time_ms        = 0;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DEFINITION --------------------------------------------
+ */
+
+#if !defined( LBM_NATIVE )
+
+static uint64_t reference_time_us( void )
+{
+    // esp_timer is kept in step with the RTC timer across light sleep
+    return ( uint64_t ) esp_timer_get_time( );
+}
+
+static wakeup_cause_t enter_light_sleep( uint32_t duration_ms )
+{
+    const gpio_num_t dio1 = ( gpio_num_t ) LBM_SLEEP_DIO1_PIN;
+
+    // The UART clock stops in light sleep, drain pending traces first
+    Serial.flush( );
+
+    // gpio_wakeup_enable() turns the pin interrupt into a level one: keep it masked until the edge type is back
+    gpio_intr_disable( dio1 );
+    gpio_wakeup_enable( dio1, GPIO_INTR_HIGH_LEVEL );
+    esp_sleep_enable_gpio_wakeup( );
+    esp_sleep_enable_timer_wakeup( ( uint64_t ) duration_ms * 1000u );
+
+    esp_light_sleep_start( );
+
+    const esp_sleep_wakeup_cause_t cause = esp_sleep_get_wakeup_cause( );
+    esp_sleep_disable_wakeup_source( ESP_SLEEP_WAKEUP_ALL );
+    gpio_wakeup_disable( dio1 );
+    gpio_set_intr_type( dio1, GPIO_INTR_POSEDGE );
+    gpio_intr_enable( dio1 );
+
+    if( cause != ESP_SLEEP_WAKEUP_GPIO )
+    {
+        return WAKEUP_CAUSE_TIMER;
+    }
+    return ( gpio_get_level( dio1 ) != 0 ) ? WAKEUP_CAUSE_DIO1 : WAKEUP_CAUSE_TIMER;
+}
+
+#else
+
+static uint64_t reference_time_us( void )
+{
+    // The simulated HAL time base never stops, no compensation is expected on the host
+    return ( uint64_t ) __real_smtc_modem_hal_get_time_in_ms( ) * 1000u;
+}
+
+static wakeup_cause_t enter_light_sleep( uint32_t duration_ms )
+{
+    // The simulated DIO1 irq reaches the modem through radio_irq_trampoline() as soon as the virtual clock gets to
+    // it. Other notifications (lbm_engine_notify() from the API) would not end a light sleep on target: sleep on.
+    const uint32_t irq_count_before = radio_irq_count;
+    const uint32_t start_ms         = __real_smtc_modem_hal_get_time_in_ms( );
+    uint32_t       slept_ms         = 0;
+
+    while( slept_ms < duration_ms )
+    {
+        ( void ) ulTaskNotifyTake( pdTRUE, pdMS_TO_TICKS( duration_ms - slept_ms ) );
+        if( radio_irq_count != irq_count_before )
+        {
+            return WAKEUP_CAUSE_DIO1;
+        }
+        slept_ms = __real_smtc_modem_hal_get_time_in_ms( ) - start_ms;
+    }
+    return WAKEUP_CAUSE_TIMER;
+}
+
+#endif
+
+static uint32_t light_sleep( uint32_t duration_ms )
+{
+    const uint32_t irq_count_before = radio_irq_count;
+    const uint64_t ref_start_us     = reference_time_us( );
+    const uint32_t hal_start_ms     = __real_smtc_modem_hal_get_time_in_ms( );
+
+    lbm_energy_on_mcu( LBM_ENERGY_MCU_SLEEP );
+    const wakeup_cause_t cause = enter_light_sleep( duration_ms );
+    lbm_energy_on_mcu( LBM_ENERGY_MCU_ACTIVE );
+
+    const uint64_t ref_slept_us = reference_time_us( ) - ref_start_us;
+    const uint32_t hal_slept_ms = __real_smtc_modem_hal_get_time_in_ms( ) - hal_start_ms;
+
+    // If the HAL clock (partly) stopped during sleep, move its time base forward by what it missed
+    const int64_t drift_us = ( int64_t ) ref_slept_us - ( ( int64_t ) hal_slept_ms * 1000 );
+    if( drift_us > TIME_COMPENSATION_THRESHOLD_US )
+    {
+        time_offset_us += drift_us;
+    }
+
+    light_sleeps++;
+    light_sleep_time_ms += ( uint32_t ) ( ref_slept_us / 1000u );
+
+    if( cause == WAKEUP_CAUSE_DIO1 )
+    {
+        wakeups_on_dio1++;
+        // The DIO1 edge may have happened while the pin interrupt was masked, deliver it to the modem if so
+        if( ( radio_irq_count == irq_count_before ) && ( radio_irq_callback != nullptr ) )
+        {
+            dio1_replays++;
+            radio_irq_trampoline( radio_irq_context );
+        }
+    }
+    else
+    {
+        wakeups_on_timer++;
+    }
+
+    // The engine runs next anyway, a notification given by the wakeup irq is not extra work
+    ( void ) lbm_engine_take_notification( );
+
+    return ( uint32_t ) ( ref_slept_us / 1000u );
+}
+
+static void radio_irq_trampoline( void* context )
+{
+    radio_irq_count++;
+    radio_irq_callback( context );
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- LINKER WRAPPED FUNCTIONS ------------------------------------------------
+ */
+
+extern "C" uint32_t __wrap_smtc_modem_hal_get_time_in_ms( void )
+{
+    return __real_smtc_modem_hal_get_time_in_ms( ) + ( uint32_t ) ( time_offset_us / 1000 );
+}
+
+extern "C" uint32_t __wrap_smtc_modem_hal_get_time_in_s( void )
+{
+    return __real_smtc_modem_hal_get_time_in_s( ) + ( uint32_t ) ( time_offset_us / 1000000 );
+}
+
+extern "C" void __wrap_smtc_modem_hal_irq_config_radio_irq( void ( *callback )( void* context ), void* context )
+{
+    radio_irq_callback = callback;
+    radio_irq_context  = context;
+    __real_smtc_modem_hal_irq_config_radio_irq( radio_irq_trampoline, context );
+}
+
+/* --- EOF ------------------------------------------------------------------ */
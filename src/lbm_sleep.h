@@ -0,0 +1,129 @@
+/*!
+ * \file      lbm_sleep.h
+ *
+ * \brief     Tickless light-sleep run mode driven by the modem's next deadline
+ *
+ * After each engine run the MCU enters ESP-IDF light sleep until the deadline returned by
+ * smtc_modem_run_engine(), with a GPIO wakeup on the SX126x DIO1 line so radio interrupts are served on time.
+ * Waits too short to pay for the light-sleep entry / exit fall back to the task notification wait of
+ * lbm_engine.h. The modem HAL time base is corrected after each sleep in case its clock does not run in
+ * light sleep.
+ */
+
+#ifndef LBM_SLEEP_H
+#define LBM_SLEEP_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC CONSTANTS --------------------------------------------------------
+ */
+
+/**
+ * @brief Shortest wait worth a light sleep, below it the task waits on a notification
+ */
+#ifndef LBM_SLEEP_MIN_MS
+#define LBM_SLEEP_MIN_MS 5
+#endif
+
+/**
+ * @brief Margin between the end of a light sleep and the modem deadline (wakeup latency, clock restart)
+ */
+#ifndef LBM_SLEEP_WAKEUP_GUARD_MS
+#define LBM_SLEEP_WAKEUP_GUARD_MS 2
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC TYPES ------------------------------------------------------------
+ */
+
+/**
+ * @brief What to do until the next engine run
+ */
+typedef enum lbm_sleep_mode_e
+{
+    LBM_SLEEP_MODE_NONE,   //!< run the engine again immediately
+    LBM_SLEEP_MODE_WAIT,   //!< block on a task notification (CPU idle, clocks running)
+    LBM_SLEEP_MODE_LIGHT,  //!< light sleep with timer + DIO1 wakeup
+} lbm_sleep_mode_t;
+
+/**
+ * @brief Wakeup decision for one engine cycle
+ */
+typedef struct lbm_sleep_plan_s
+{
+    lbm_sleep_mode_t mode;
+    uint32_t         duration_ms;
+} lbm_sleep_plan_t;
+
+/**
+ * @brief Low-power run mode counters
+ */
+typedef struct lbm_sleep_stats_s
+{
+    uint32_t light_sleeps;           //!< light sleeps entered
+    uint32_t wakeups_on_timer;       //!< light sleeps ended by the timer
+    uint32_t wakeups_on_dio1;        //!< light sleeps ended by the radio
+    uint32_t dio1_replays;           //!< radio irq delivered by the run mode because the edge was lost in sleep
+    uint32_t skipped_pending;        //!< sleeps skipped because the modem already had work
+    uint32_t light_sleep_time_ms;    //!< time spent in light sleep
+    uint32_t wait_time_ms;           //!< time spent in notification waits
+    uint32_t elapsed_ms;             //!< time covered by the counters
+    int32_t  time_compensation_ms;   //!< total correction applied to the modem HAL time base
+    float    residency_percent;      //!< light_sleep_time_ms / elapsed_ms
+} lbm_sleep_stats_t;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS PROTOTYPES --------------------------------------------
+ */
+
+/**
+ * @brief Decide how to wait until the next engine run (pure function, no side effect)
+ *
+ * @param [in] engine_sleep_ms      Value returned by smtc_modem_run_engine()
+ * @param [in] max_wait_ms          Caller's own bound (LBM_ENGINE_WAIT_FOREVER for none)
+ * @param [in] notification_pending The modem got work while the engine was running
+ *
+ * @return Wait mode and duration. The guard is only taken from sleeps bounded by the modem deadline.
+ */
+lbm_sleep_plan_t lbm_sleep_plan( uint32_t engine_sleep_ms, uint32_t max_wait_ms, bool notification_pending );
+
+/**
+ * @brief Run the modem engine, then sleep until it needs the CPU again or max_wait_ms elapsed
+ *
+ * @param [in] max_wait_ms Upper bound of the sleep, LBM_ENGINE_WAIT_FOREVER for none
+ *
+ * @return Time in ms spent sleeping or waiting
+ */
+uint32_t lbm_sleep_run_until_event( uint32_t max_wait_ms );
+
+/**
+ * @brief Read the counters
+ */
+void lbm_sleep_get_stats( lbm_sleep_stats_t* stats );
+
+/**
+ * @brief Clear the counters and restart the elapsed time (the time compensation is kept)
+ */
+void lbm_sleep_reset_stats( void );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // LBM_SLEEP_H
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,177 @@
+/*!
+ * \file      lbm_stacks.cpp
+ *
+ * \brief     Several LoRaWAN stacks on one radio: per-stack event routing and counters
+ */
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <string.h>
+
+#include "lbm_stacks.h"
+
+extern "C" {
+#include "lorawan_api.h"
+#include "lr1_stack_mac_layer.h"
+#include "radio_planner.h"
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE VARIABLES -------------------------------------------------------
+ */
+
+static LBMEventCallback callbacks[LBM_NUMBER_OF_STACKS];
+
+// Only the task running the engine updates the counters
+static lbm_stack_stats_t stacks[LBM_NUMBER_OF_STACKS];
+
+// Planner counts at the last reset, the planner keeps its own since boot
+static uint32_t planner_aborts_base[LBM_NUMBER_OF_STACKS];
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DECLARATION -------------------------------------------
+ */
+
+/**
+ * @brief Tasks of the planner hook of a stack aborted since boot
+ */
+static uint32_t get_planner_aborts( uint8_t stack_id );
+
+/**
+ * @brief Count the uplink a TXDONE event ends under the modulation of its data rate
+ */
+static void count_uplink( lbm_stack_stats_t* s, const smtc_modem_event_t* event );
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS DEFINITION ---------------------------------------------
+ */
+
+smtc_modem_return_code_t lbm_stacks_set_event_callback( uint8_t stack_id, LBMEventCallback callback )
+{
+    if( stack_id >= LBM_NUMBER_OF_STACKS )
+    {
+        return SMTC_MODEM_RC_INVALID_STACK_ID;
+    }
+    callbacks[stack_id] = callback;
+    return SMTC_MODEM_RC_OK;
+}
+
+LBMEventCallback lbm_stacks_get_event_callback( uint8_t stack_id )
+{
+    return ( stack_id < LBM_NUMBER_OF_STACKS ) ? callbacks[stack_id] : nullptr;
+}
+
+void lbm_stacks_on_event( const smtc_modem_event_t* event )
+{
+    if( event->stack_id >= LBM_NUMBER_OF_STACKS )
+    {
+        return;
+    }
+    lbm_stack_stats_t* s = &stacks[event->stack_id];
+    s->events++;
+    switch( event->event_type )
+    {
+    case SMTC_MODEM_EVENT_JOINED:
+        s->joined++;
+        break;
+    case SMTC_MODEM_EVENT_JOINFAIL:
+        s->join_fails++;
+        break;
+    case SMTC_MODEM_EVENT_TXDONE:
+        if( event->event_data.txdone.status == SMTC_MODEM_EVENT_TXDONE_NOT_SENT )
+        {
+            s->tx_not_sent++;
+        }
+        else
+        {
+            s->tx_done++;
+            count_uplink( s, event );
+        }
+        break;
+    case SMTC_MODEM_EVENT_DOWNDATA:
+        s->downlinks++;
+        break;
+    default:
+        break;
+    }
+}
+
+smtc_modem_return_code_t lbm_stacks_get_stats( uint8_t stack_id, lbm_stack_stats_t* stats )
+{
+    if( stack_id >= LBM_NUMBER_OF_STACKS )
+    {
+        return SMTC_MODEM_RC_INVALID_STACK_ID;
+    }
+    *stats                = stacks[stack_id];
+    stats->planner_aborts = get_planner_aborts( stack_id ) - planner_aborts_base[stack_id];
+    for( uint8_t i = 0; i < LBM_AIRTIME_NB_MODULATIONS; i++ )
+    {
+        lbm_modulation_stats_t* m = &stats->modulations[i];
+        m->success_percent        = ( m->confirmed > 0 ) ? 100.0f * m->acknowledged / m->confirmed : 0.0f;
+    }
+    return SMTC_MODEM_RC_OK;
+}
+
+smtc_modem_return_code_t lbm_stacks_reset_stats( uint8_t stack_id )
+{
+    if( stack_id >= LBM_NUMBER_OF_STACKS )
+    {
+        return SMTC_MODEM_RC_INVALID_STACK_ID;
+    }
+    memset( &stacks[stack_id], 0, sizeof( stacks[stack_id] ) );
+    planner_aborts_base[stack_id] = get_planner_aborts( stack_id );
+    return SMTC_MODEM_RC_OK;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DEFINITION --------------------------------------------
+ */
+
+static uint32_t get_planner_aborts( uint8_t stack_id )
+{
+    const lr1_stack_mac_t* mac = lorawan_api_stack_mac_get( stack_id );
+    if( ( mac == nullptr ) || ( mac->rp == nullptr ) )
+    {
+        return 0;  // modem not initialized yet
+    }
+    return mac->rp->stats.task_hook_aborted_nb[mac->stack_id4rp];
+}
+
+static void count_uplink( lbm_stack_stats_t* s, const smtc_modem_event_t* event )
+{
+    // The MAC keeps the data rate and the PHY size (FOpts included) of the last uplink until the next one
+    const lr1_stack_mac_t* mac = lorawan_api_stack_mac_get( event->stack_id );
+    smtc_modem_region_t    region;
+    if( ( mac == nullptr ) || ( mac->tx_data_rate >= LBM_AIRTIME_NB_DATARATES ) ||
+        ( smtc_modem_get_region( event->stack_id, &region ) != SMTC_MODEM_RC_OK ) )
+    {
+        return;
+    }
+    const lbm_airtime_datarate_t* table = lbm_airtime_get_table( region );
+    if( ( table == nullptr ) || ( table[mac->tx_data_rate].max_payload == 0 ) )
+    {
+        return;
+    }
+
+    const lbm_airtime_datarate_t& dr = table[mac->tx_data_rate];
+    lbm_modulation_stats_t*       m  = &s->modulations[dr.modulation];
+    m->uplinks++;
+    m->airtime_ms += ( lbm_airtime_phy_us( dr, mac->tx_payload_size ) + 500 ) / 1000;
+    if( mac->tx_mtype == CONF_DATA_UP )
+    {
+        m->confirmed++;
+        if( event->event_data.txdone.status == SMTC_MODEM_EVENT_TXDONE_CONFIRMED )
+        {
+            m->acknowledged++;
+        }
+    }
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,106 @@
+/*!
+ * \file      lbm_stacks.h
+ *
+ * \brief     Several LoRaWAN stacks on one radio: per-stack event routing and counters
+ *
+ * Built with NUMBER_OF_STACKS greater than 1, the modem runs one lr1mac per stack, each with its own
+ * credentials, region, class and session, e.g. a private network next to a public one. They share the SX1262
+ * through the radio planner: each stack owns a planner hook, and a task of one stack (TX, RX1, RX2, CAD) that
+ * overlaps a task of another one is moved when it can start later, aborted otherwise. A stack whose uplink was
+ * aborted reports SMTC_MODEM_EVENT_TXDONE with SMTC_MODEM_EVENT_TXDONE_NOT_SENT; an aborted RX window simply
+ * receives nothing.
+ *
+ * Every event carries the stack_id of the stack that raised it. This module routes it to the callback of that
+ * stack (LoRaWANClass::setEventCallback()) when one is set, otherwise to the callback of LBMApi, and keeps per
+ * stack counters, planner aborts included, so the cost of sharing the radio can be measured. The uplinks sent
+ * are also counted per modulation (LoRa, FSK, LR-FHSS) with their time on air and the share of confirmed ones
+ * the network acknowledged, to compare LR-FHSS data rates with LoRa ones on a site.
+ */
+
+#ifndef LBM_STACKS_H
+#define LBM_STACKS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "smtc_modem_api.h"
+#include "lbm_core.h"
+#include "lbm_airtime.h"
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC TYPES ------------------------------------------------------------
+ */
+
+/**
+ * @brief Uplinks of one stack sent with one modulation
+ */
+typedef struct lbm_modulation_stats_s
+{
+    uint32_t uplinks;          //!< uplinks sent (TXDONE sent or confirmed)
+    uint32_t confirmed;        //!< of which confirmed uplinks
+    uint32_t acknowledged;     //!< confirmed uplinks acknowledged by the network
+    uint32_t airtime_ms;       //!< time on air, one transmission per uplink
+    float    success_percent;  //!< acknowledged / confirmed
+} lbm_modulation_stats_t;
+
+/**
+ * @brief Counters of one stack
+ */
+typedef struct lbm_stack_stats_s
+{
+    uint32_t events;          //!< events raised by the stack
+    uint32_t joined;          //!< SMTC_MODEM_EVENT_JOINED
+    uint32_t join_fails;      //!< SMTC_MODEM_EVENT_JOINFAIL
+    uint32_t tx_done;         //!< uplinks sent (TXDONE sent or confirmed)
+    uint32_t tx_not_sent;     //!< uplinks given up without a transmission (TXDONE not sent)
+    uint32_t downlinks;       //!< SMTC_MODEM_EVENT_DOWNDATA
+    uint32_t planner_aborts;  //!< radio planner tasks of the stack aborted by a conflicting task
+    lbm_modulation_stats_t modulations[LBM_AIRTIME_NB_MODULATIONS];  //!< per lbm_airtime_modulation_t (EU868, AS923)
+} lbm_stack_stats_t;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS PROTOTYPES --------------------------------------------
+ */
+
+/**
+ * @brief Route the events of a stack to a callback of its own (NULL: back to the callback of LBMApi)
+ *
+ * @return SMTC_MODEM_RC_OK, SMTC_MODEM_RC_INVALID_STACK_ID
+ */
+smtc_modem_return_code_t lbm_stacks_set_event_callback( uint8_t stack_id, LBMEventCallback callback );
+
+/**
+ * @brief Callback of the stack that raised an event, NULL if it has none (or for an unknown stack id)
+ */
+LBMEventCallback lbm_stacks_get_event_callback( uint8_t stack_id );
+
+/**
+ * @brief Count an event read from the modem (called by the event dispatcher)
+ */
+void lbm_stacks_on_event( const smtc_modem_event_t* event );
+
+/**
+ * @brief Get / reset the counters of a stack
+ *
+ * @return SMTC_MODEM_RC_OK, SMTC_MODEM_RC_INVALID_STACK_ID
+ */
+smtc_modem_return_code_t lbm_stacks_get_stats( uint8_t stack_id, lbm_stack_stats_t* stats );
+smtc_modem_return_code_t lbm_stacks_reset_stats( uint8_t stack_id );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // LBM_STACKS_H
+
+/* --- EOF ------------------------------------------------------------------ */
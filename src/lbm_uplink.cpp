@@ -0,0 +1,664 @@
+/*!
+ * \file      lbm_uplink.cpp
+ *
+ * \brief     Uplink tickets: queued uplinks completing one by one with their status, time on air and latencies
+ */
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <string.h>
+
+#include "lbm_uplink.h"
+#include "lbm_airtime.h"
+#include "lbm_core.h"
+#include "lbm_engine.h"
+#include "lbm_log.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+extern "C" {
+#include "smtc_modem_hal.h"
+#include "lorawan_api.h"
+#include "lr1_stack_mac_layer.h"
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE MACROS ----------------------------------------------------------
+ */
+
+// The engine task completes tickets while the application submits and reads them
+static lbm_critical_t tickets_lock = LBM_CRITICAL_INITIALIZER;
+#define TICKETS_LOCK( ) LBM_CRITICAL_ENTER( &tickets_lock )
+#define TICKETS_UNLOCK( ) LBM_CRITICAL_EXIT( &tickets_lock )
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE TYPES -----------------------------------------------------------
+ */
+
+typedef struct slot_s
+{
+    lbm_uplink_result_t   result;  //!< result.ticket LBM_UPLINK_NO_TICKET: free
+    lbm_uplink_prepare_t  prepare;
+    lbm_uplink_callback_t callback;
+    void*                 context;
+    uint8_t               payload[LBM_UPLINK_MAX_PAYLOAD];
+} slot_t;
+
+/**
+ * @brief What a completion hands to the application once the lock is released
+ */
+typedef struct completion_s
+{
+    lbm_uplink_result_t   result;
+    lbm_uplink_callback_t callback;
+    void*                 context;
+    SemaphoreHandle_t     signal;  //!< completion signal of the slot
+} completion_t;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE VARIABLES -------------------------------------------------------
+ */
+
+static slot_t              slots[LBM_UPLINK_MAX_TICKETS];
+static lbm_uplink_ticket_t last_ticket = LBM_UPLINK_NO_TICKET;
+
+// Ticket taken by the modem on each stack, completed by its next TXDONE
+static slot_t* in_flight[LBM_NUMBER_OF_STACKS];
+
+// Hand-over postponed while the modem holds an uplink requested outside the tickets
+static uint32_t retry_at_ms[LBM_NUMBER_OF_STACKS];
+static bool     retry_armed[LBM_NUMBER_OF_STACKS];
+
+static lbm_uplink_stats_t stats;
+static uint64_t           to_tx_total_ms   = 0;
+static uint64_t           to_done_total_ms = 0;
+
+// One per slot, created by lbm_uplink_init() and given when its ticket completes: lbm_uplink_wait() only wakes up
+// for the ticket it waits for
+static SemaphoreHandle_t completed[LBM_UPLINK_MAX_TICKETS];
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DECLARATION -------------------------------------------
+ */
+
+static bool is_completed( const slot_t* slot );
+
+/**
+ * @brief Slot of a ticket, NULL if unknown (lock held)
+ */
+static slot_t* find( lbm_uplink_ticket_t ticket );
+
+/**
+ * @brief Slot for a new ticket: a free one, else the oldest completed one (lock held)
+ */
+static slot_t* allocate( void );
+
+/**
+ * @brief Oldest queued ticket of a stack (lock held)
+ */
+static slot_t* oldest_queued( uint8_t stack_id );
+
+/**
+ * @brief Copy the state of a ticket, releasing it once completed
+ *
+ * @return SMTC_MODEM_RC_OK if completed, SMTC_MODEM_RC_BUSY if not yet, SMTC_MODEM_RC_INVALID if unknown
+ */
+static smtc_modem_return_code_t read_ticket( lbm_uplink_ticket_t ticket, lbm_uplink_result_t* result );
+
+/**
+ * @brief Completion signal of the slot holding a ticket, NULL if unknown
+ */
+static SemaphoreHandle_t completion_signal( lbm_uplink_ticket_t ticket );
+
+/**
+ * @brief Hand the oldest queued ticket of a stack to the modem
+ *
+ * @return Time in ms before trying again, LBM_UPLINK_IDLE if nothing is to be done before an event
+ */
+static uint32_t process_stack( uint8_t stack_id, uint32_t now_ms );
+
+/**
+ * @brief Data rate, PHY size, time on air and transmission times of the uplink the MAC just sent
+ */
+static void read_transmission( lbm_uplink_result_t* result );
+
+/**
+ * @brief Give a ticket its final status and count it, releasing it if it has a callback (lock held)
+ */
+static void finish( slot_t* slot, lbm_uplink_status_t status, completion_t* completion );
+
+/**
+ * @brief Wake up the lbm_uplink_wait() of a completed ticket and call its callback
+ */
+static void notify( const completion_t* completion );
+
+/**
+ * @brief finish() then notify()
+ */
+static void complete( slot_t* slot, lbm_uplink_status_t status );
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS DEFINITION ---------------------------------------------
+ */
+
+void lbm_uplink_init( void )
+{
+    for( uint8_t i = 0; i < LBM_UPLINK_MAX_TICKETS; i++ )
+    {
+        if( completed[i] == nullptr )
+        {
+            completed[i] = xSemaphoreCreateBinary( );
+        }
+    }
+}
+
+smtc_modem_return_code_t lbm_uplink_submit( uint8_t stack_id, uint8_t port, bool confirmed, const uint8_t* payload,
+                                            uint8_t size, lbm_uplink_callback_t callback, void* context,
+                                            lbm_uplink_ticket_t* ticket )
+{
+    return lbm_uplink_submit_prepared( stack_id, port, confirmed, payload, size, nullptr, callback, context, ticket );
+}
+
+smtc_modem_return_code_t lbm_uplink_submit_prepared( uint8_t stack_id, uint8_t port, bool confirmed,
+                                                     const uint8_t* payload, uint8_t size,
+                                                     lbm_uplink_prepare_t prepare, lbm_uplink_callback_t callback,
+                                                     void* context, lbm_uplink_ticket_t* ticket )
+{
+    *ticket = LBM_UPLINK_NO_TICKET;
+    if( stack_id >= LBM_NUMBER_OF_STACKS )
+    {
+        return SMTC_MODEM_RC_INVALID_STACK_ID;
+    }
+    if( ( size > LBM_UPLINK_MAX_PAYLOAD ) || ( ( payload == nullptr ) && ( size > 0 ) ) )
+    {
+        return SMTC_MODEM_RC_INVALID;
+    }
+    TICKETS_LOCK( );
+    slot_t* slot = allocate( );
+    if( slot == nullptr )
+    {
+        stats.table_full++;
+        TICKETS_UNLOCK( );
+        return SMTC_MODEM_RC_BUSY;
+    }
+    if( ++last_ticket == LBM_UPLINK_NO_TICKET )
+    {
+        last_ticket++;
+    }
+
+    memset( &slot->result, 0, sizeof( slot->result ) );
+    slot->result.ticket       = last_ticket;
+    slot->result.stack_id     = stack_id;
+    slot->result.port         = port;
+    slot->result.confirmed    = confirmed;
+    slot->result.size         = size;
+    slot->result.status       = LBM_UPLINK_QUEUED;
+    slot->result.requested_ms = smtc_modem_hal_get_time_in_ms( );
+    slot->prepare             = prepare;
+    slot->callback            = callback;
+    slot->context             = context;
+    if( size > 0 )
+    {
+        memcpy( slot->payload, payload, size );
+    }
+    stats.submitted++;
+    *ticket = last_ticket;
+    TICKETS_UNLOCK( );
+    return SMTC_MODEM_RC_OK;
+}
+
+smtc_modem_return_code_t lbm_uplink_get( lbm_uplink_ticket_t ticket, lbm_uplink_result_t* result )
+{
+    const smtc_modem_return_code_t ret = read_ticket( ticket, result );
+    return ( ret == SMTC_MODEM_RC_BUSY ) ? SMTC_MODEM_RC_OK : ret;
+}
+
+smtc_modem_return_code_t lbm_uplink_wait( lbm_uplink_ticket_t ticket, lbm_uplink_result_t* result,
+                                          uint32_t timeout_ms )
+{
+    const uint32_t start_ms = smtc_modem_hal_get_time_in_ms( );
+
+    for( ;; )
+    {
+        const smtc_modem_return_code_t ret = read_ticket( ticket, result );
+        if( ret != SMTC_MODEM_RC_BUSY )
+        {
+            return ret;
+        }
+        // A give left by an earlier ticket of the slot only costs one more turn
+        const SemaphoreHandle_t signal = completion_signal( ticket );
+        if( signal == nullptr )
+        {
+            return read_ticket( ticket, result );
+        }
+
+        const uint32_t waited_ms = smtc_modem_hal_get_time_in_ms( ) - start_ms;
+        if( waited_ms >= timeout_ms )
+        {
+            return SMTC_MODEM_RC_BUSY;
+        }
+
+        const TickType_t ticks =
+            ( timeout_ms == LBM_ENGINE_WAIT_FOREVER ) ? portMAX_DELAY : pdMS_TO_TICKS( timeout_ms - waited_ms );
+        if( xSemaphoreTake( signal, ticks ) != pdPASS )
+        {
+            // Timed out, last chance for a completion just before the deadline
+            return read_ticket( ticket, result );
+        }
+    }
+}
+
+smtc_modem_return_code_t lbm_uplink_cancel( lbm_uplink_ticket_t ticket )
+{
+    TICKETS_LOCK( );
+    slot_t* slot = find( ticket );
+    if( ( slot == nullptr ) || ( is_completed( slot ) == true ) )
+    {
+        TICKETS_UNLOCK( );
+        return SMTC_MODEM_RC_INVALID;
+    }
+    if( slot->result.status == LBM_UPLINK_IN_FLIGHT )
+    {
+        TICKETS_UNLOCK( );
+        return SMTC_MODEM_RC_BUSY;
+    }
+    completion_t completion;
+    finish( slot, LBM_UPLINK_CANCELLED, &completion );
+    TICKETS_UNLOCK( );
+
+    notify( &completion );
+    return SMTC_MODEM_RC_OK;
+}
+
+uint32_t lbm_uplink_process( void )
+{
+    const uint32_t now_ms  = smtc_modem_hal_get_time_in_ms( );
+    uint32_t       next_ms = LBM_UPLINK_IDLE;
+    for( uint8_t stack_id = 0; stack_id < LBM_NUMBER_OF_STACKS; stack_id++ )
+    {
+        const uint32_t stack_ms = process_stack( stack_id, now_ms );
+        next_ms                 = ( stack_ms < next_ms ) ? stack_ms : next_ms;
+    }
+    return next_ms;
+}
+
+void lbm_uplink_on_event( const smtc_modem_event_t* event )
+{
+    if( event->event_type == SMTC_MODEM_EVENT_RESET )
+    {
+        // Uplinks held by the modem before the reset are lost
+        for( uint8_t stack_id = 0; stack_id < LBM_NUMBER_OF_STACKS; stack_id++ )
+        {
+            if( in_flight[stack_id] != nullptr )
+            {
+                complete( in_flight[stack_id], LBM_UPLINK_NOT_SENT );
+            }
+        }
+        return;
+    }
+    if( ( event->event_type != SMTC_MODEM_EVENT_TXDONE ) || ( event->stack_id >= LBM_NUMBER_OF_STACKS ) ||
+        ( in_flight[event->stack_id] == nullptr ) )
+    {
+        return;
+    }
+
+    slot_t* slot = in_flight[event->stack_id];
+    switch( event->event_data.txdone.status )
+    {
+    case SMTC_MODEM_EVENT_TXDONE_NOT_SENT:
+        complete( slot, LBM_UPLINK_NOT_SENT );
+        break;
+    case SMTC_MODEM_EVENT_TXDONE_CONFIRMED:
+        read_transmission( &slot->result );
+        complete( slot, LBM_UPLINK_ACKED );
+        break;
+    default:
+        read_transmission( &slot->result );
+        complete( slot, ( slot->result.confirmed == true ) ? LBM_UPLINK_NACKED : LBM_UPLINK_SENT );
+        break;
+    }
+}
+
+void lbm_uplink_get_stats( lbm_uplink_stats_t* out )
+{
+    TICKETS_LOCK( );
+    *out          = stats;
+    out->pending  = 0;
+    for( uint8_t i = 0; i < LBM_UPLINK_MAX_TICKETS; i++ )
+    {
+        if( ( slots[i].result.ticket != LBM_UPLINK_NO_TICKET ) && ( is_completed( &slots[i] ) == false ) )
+        {
+            out->pending++;
+        }
+    }
+    TICKETS_UNLOCK( );
+    out->to_tx.average_ms   = ( out->to_tx.count > 0 ) ? ( float ) to_tx_total_ms / out->to_tx.count : 0.0f;
+    out->to_done.average_ms = ( out->to_done.count > 0 ) ? ( float ) to_done_total_ms / out->to_done.count : 0.0f;
+}
+
+void lbm_uplink_reset_stats( void )
+{
+    TICKETS_LOCK( );
+    memset( &stats, 0, sizeof( stats ) );
+    to_tx_total_ms   = 0;
+    to_done_total_ms = 0;
+    TICKETS_UNLOCK( );
+}
+
+void lbm_uplink_latency_add( lbm_uplink_latency_t* latency, uint64_t* total_ms, uint32_t ms )
+{
+    uint8_t bucket = 0;
+    while( ( bucket < ( LBM_UPLINK_LATENCY_BUCKETS - 1 ) ) && ( ms >= ( 1u << bucket ) ) )
+    {
+        bucket++;
+    }
+    latency->buckets[bucket]++;
+    latency->min_ms = ( ( latency->count == 0 ) || ( ms < latency->min_ms ) ) ? ms : latency->min_ms;
+    latency->max_ms = ( ms > latency->max_ms ) ? ms : latency->max_ms;
+    latency->count++;
+    *total_ms += ms;
+}
+
+uint32_t lbm_uplink_latency_percentile( const lbm_uplink_latency_t* latency, uint8_t percent )
+{
+    if( latency->count == 0 )
+    {
+        return 0;
+    }
+    const uint64_t rank  = ( ( uint64_t ) latency->count * percent + 99 ) / 100;
+    uint64_t       below = 0;
+    for( uint8_t n = 0; n < ( LBM_UPLINK_LATENCY_BUCKETS - 1 ); n++ )
+    {
+        below += latency->buckets[n];
+        if( below >= rank )
+        {
+            return ( 1u << n ) - 1;
+        }
+    }
+    return UINT32_MAX;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DEFINITION --------------------------------------------
+ */
+
+static bool is_completed( const slot_t* slot )
+{
+    return slot->result.status >= LBM_UPLINK_SENT;
+}
+
+static slot_t* find( lbm_uplink_ticket_t ticket )
+{
+    for( uint8_t i = 0; ( ticket != LBM_UPLINK_NO_TICKET ) && ( i < LBM_UPLINK_MAX_TICKETS ); i++ )
+    {
+        if( slots[i].result.ticket == ticket )
+        {
+            return &slots[i];
+        }
+    }
+    return nullptr;
+}
+
+static slot_t* allocate( void )
+{
+    slot_t* oldest = nullptr;
+    for( uint8_t i = 0; i < LBM_UPLINK_MAX_TICKETS; i++ )
+    {
+        slot_t* slot = &slots[i];
+        if( slot->result.ticket == LBM_UPLINK_NO_TICKET )
+        {
+            return slot;
+        }
+        if( ( is_completed( slot ) == true ) &&
+            ( ( oldest == nullptr ) || ( ( int32_t ) ( slot->result.ticket - oldest->result.ticket ) < 0 ) ) )
+        {
+            oldest = slot;
+        }
+    }
+    if( oldest != nullptr )
+    {
+        stats.unread_recycled++;
+    }
+    return oldest;
+}
+
+static slot_t* oldest_queued( uint8_t stack_id )
+{
+    slot_t* oldest = nullptr;
+    for( uint8_t i = 0; i < LBM_UPLINK_MAX_TICKETS; i++ )
+    {
+        slot_t* slot = &slots[i];
+        if( ( slot->result.ticket != LBM_UPLINK_NO_TICKET ) && ( slot->result.status == LBM_UPLINK_QUEUED ) &&
+            ( slot->result.stack_id == stack_id ) &&
+            ( ( oldest == nullptr ) || ( ( int32_t ) ( slot->result.ticket - oldest->result.ticket ) < 0 ) ) )
+        {
+            oldest = slot;
+        }
+    }
+    return oldest;
+}
+
+static smtc_modem_return_code_t read_ticket( lbm_uplink_ticket_t ticket, lbm_uplink_result_t* result )
+{
+    TICKETS_LOCK( );
+    slot_t* slot = find( ticket );
+    if( slot == nullptr )
+    {
+        TICKETS_UNLOCK( );
+        return SMTC_MODEM_RC_INVALID;
+    }
+    *result         = slot->result;
+    const bool done = is_completed( slot );
+    if( done == true )
+    {
+        slot->result.ticket = LBM_UPLINK_NO_TICKET;
+    }
+    TICKETS_UNLOCK( );
+    return ( done == true ) ? SMTC_MODEM_RC_OK : SMTC_MODEM_RC_BUSY;
+}
+
+static SemaphoreHandle_t completion_signal( lbm_uplink_ticket_t ticket )
+{
+    TICKETS_LOCK( );
+    const slot_t* slot = find( ticket );
+    TICKETS_UNLOCK( );
+    return ( slot != nullptr ) ? completed[slot - slots] : nullptr;
+}
+
+static uint32_t process_stack( uint8_t stack_id, uint32_t now_ms )
+{
+    TICKETS_LOCK( );
+    slot_t* slot = ( in_flight[stack_id] == nullptr ) ? oldest_queued( stack_id ) : nullptr;
+    if( slot == nullptr )
+    {
+        // Nothing queued, or the TXDONE of the ticket in flight will bring the engine back
+        TICKETS_UNLOCK( );
+        return LBM_UPLINK_IDLE;
+    }
+    TICKETS_UNLOCK( );
+
+    if( retry_armed[stack_id] == true )
+    {
+        if( ( int32_t ) ( retry_at_ms[stack_id] - now_ms ) > 0 )
+        {
+            return retry_at_ms[stack_id] - now_ms;
+        }
+        retry_armed[stack_id] = false;
+    }
+
+    // The modem would take the uplink and hold it until the band opens: keep it here, within its wait budget
+    int32_t duty_cycle_ms = 0;
+    if( ( smtc_modem_get_duty_cycle_status( stack_id, &duty_cycle_ms ) == SMTC_MODEM_RC_OK ) && ( duty_cycle_ms < 0 ) )
+    {
+        const uint32_t waited_ms = now_ms - slot->result.requested_ms;
+        if( ( waited_ms + ( uint32_t ) ( -duty_cycle_ms ) ) > LBM_UPLINK_DUTY_CYCLE_WAIT_MS )
+        {
+            complete( slot, LBM_UPLINK_DROPPED_DUTY_CYCLE );
+            return 0;  // the next ticket may fit its own budget
+        }
+        stats.duty_cycle_holds++;
+        return ( uint32_t ) ( -duty_cycle_ms );
+    }
+
+    // In flight before the request, so that lbm_uplink_cancel() leaves it alone meanwhile
+    TICKETS_LOCK( );
+    if( slot->result.status != LBM_UPLINK_QUEUED )
+    {
+        TICKETS_UNLOCK( );
+        return 0;  // cancelled by another task since
+    }
+    slot->result.status = LBM_UPLINK_IN_FLIGHT;
+    in_flight[stack_id] = slot;
+    TICKETS_UNLOCK( );
+
+    smtc_modem_return_code_t ret =
+        ( slot->prepare != nullptr ) ? slot->prepare( &slot->result, false, slot->context ) : SMTC_MODEM_RC_OK;
+    const bool prepared = ( ret == SMTC_MODEM_RC_OK );
+    if( prepared == true )
+    {
+        ret = smtc_modem_request_uplink( stack_id, slot->result.port, slot->result.confirmed, slot->payload,
+                                         slot->result.size );
+    }
+    if( ret == SMTC_MODEM_RC_OK )
+    {
+        slot->result.submitted_ms = now_ms;
+        LBM_LOG_INFO( "Uplink ticket %u: %u bytes on port %u, stack %u\n", slot->result.ticket, slot->result.size,
+                      slot->result.port, stack_id );
+        return LBM_UPLINK_IDLE;
+    }
+
+    TICKETS_LOCK( );
+    slot->result.status = LBM_UPLINK_QUEUED;
+    in_flight[stack_id] = nullptr;
+    TICKETS_UNLOCK( );
+    if( ( ret == SMTC_MODEM_RC_BUSY ) && ( prepared == true ) )
+    {
+        // An uplink of send() or of the modem itself is pending: it must not run with the settings of this ticket
+        if( slot->prepare != nullptr )
+        {
+            slot->prepare( &slot->result, true, slot->context );
+        }
+        stats.modem_busy++;
+        retry_at_ms[stack_id] = now_ms + LBM_UPLINK_RETRY_MS;
+        retry_armed[stack_id] = true;
+        return LBM_UPLINK_RETRY_MS;
+    }
+    slot->result.refusal = ret;
+    complete( slot, LBM_UPLINK_REFUSED );
+    return 0;
+}
+
+static void read_transmission( lbm_uplink_result_t* result )
+{
+    // Kept by the MAC until the next uplink, like lbm_stacks does for its counters
+    const lr1_stack_mac_t* mac = lorawan_api_stack_mac_get( result->stack_id );
+    if( mac == nullptr )
+    {
+        return;
+    }
+    result->datarate  = mac->tx_data_rate;
+    result->phy_size  = mac->tx_payload_size;
+    result->tx_end_ms = mac->isr_tx_done_radio_timestamp;
+
+    smtc_modem_region_t region;
+    if( ( mac->tx_data_rate < LBM_AIRTIME_NB_DATARATES ) &&
+        ( smtc_modem_get_region( result->stack_id, &region ) == SMTC_MODEM_RC_OK ) )
+    {
+        const lbm_airtime_datarate_t* table = lbm_airtime_get_table( region );
+        if( ( table != nullptr ) && ( table[mac->tx_data_rate].max_payload != 0 ) )
+        {
+            result->airtime_ms = ( lbm_airtime_phy_us( table[mac->tx_data_rate], mac->tx_payload_size ) + 500 ) / 1000;
+        }
+    }
+    result->tx_start_ms = result->tx_end_ms - result->airtime_ms;
+}
+
+static void finish( slot_t* slot, lbm_uplink_status_t status, completion_t* completion )
+{
+    lbm_uplink_result_t* result = &slot->result;
+    result->status              = status;
+    result->done_ms             = smtc_modem_hal_get_time_in_ms( );
+    if( in_flight[result->stack_id] == slot )
+    {
+        in_flight[result->stack_id] = nullptr;
+    }
+
+    switch( status )
+    {
+    case LBM_UPLINK_SENT:
+        stats.sent++;
+        break;
+    case LBM_UPLINK_ACKED:
+        stats.acked++;
+        break;
+    case LBM_UPLINK_NACKED:
+        stats.nacked++;
+        break;
+    case LBM_UPLINK_DROPPED_DUTY_CYCLE:
+        stats.dropped_duty_cycle++;
+        break;
+    case LBM_UPLINK_NOT_SENT:
+        stats.not_sent++;
+        break;
+    case LBM_UPLINK_REFUSED:
+        stats.refused++;
+        break;
+    default:
+        stats.cancelled++;
+        break;
+    }
+    if( status != LBM_UPLINK_CANCELLED )
+    {
+        lbm_uplink_latency_add( &stats.to_done, &to_done_total_ms, result->done_ms - result->requested_ms );
+    }
+    if( result->tx_end_ms != 0 )
+    {
+        lbm_uplink_latency_add( &stats.to_tx, &to_tx_total_ms, result->tx_start_ms - result->requested_ms );
+    }
+
+    completion->result   = *result;
+    completion->callback = slot->callback;
+    completion->context  = slot->context;
+    completion->signal   = completed[slot - slots];
+    if( slot->callback != nullptr )
+    {
+        result->ticket = LBM_UPLINK_NO_TICKET;
+    }
+}
+
+static void notify( const completion_t* completion )
+{
+    const lbm_uplink_result_t* result = &completion->result;
+    LBM_LOG_INFO( "Uplink ticket %u: status %u after %u ms\n", result->ticket, result->status,
+                  result->done_ms - result->requested_ms );
+    if( completion->signal != nullptr )
+    {
+        xSemaphoreGive( completion->signal );
+    }
+    if( completion->callback != nullptr )
+    {
+        completion->callback( result, completion->context );
+    }
+}
+
+static void complete( slot_t* slot, lbm_uplink_status_t status )
+{
+    completion_t completion;
+    TICKETS_LOCK( );
+    finish( slot, status, &completion );
+    TICKETS_UNLOCK( );
+    notify( &completion );
+}
+
+
+/* --- EOF ------------------------------------------------------------------ */
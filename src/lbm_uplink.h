@@ -0,0 +1,289 @@
+/*!
+ * \file      lbm_uplink.h
+ *
+ * \brief     Uplink tickets: queued uplinks completing one by one with their status, time on air and latencies
+ *
+ * smtc_modem_request_uplink() takes one uplink per stack at a time and its outcome only shows up later as a
+ * TXDONE event, so an application sending several has to retry on SMTC_MODEM_RC_BUSY and pair the events with
+ * its requests by hand. lbm_uplink_submit() copies the payload into a ticket and returns at once. Tickets of a
+ * stack are handed to the modem in submission order, the next one at the TXDONE of the previous one, and this
+ * TXDONE completes the ticket that was handed over: the modem refuses any other uplink while it is pending.
+ *
+ * A completed ticket tells how the uplink ended (sent, acknowledged or not, dropped because the band stayed
+ * closed, aborted, refused by the modem), its data rate and time on air, and when it was requested, handed to
+ * the modem, transmitted and completed. The application polls it (lbm_uplink_get()), blocks on it from another
+ * task than the engine (lbm_uplink_wait()), or passes a callback called by the engine when it completes.
+ * Request to transmission and request to completion delays of all tickets feed log2 histograms.
+ *
+ * Tickets are driven by lbm_uplink_process(), called by the LBMApi runEngine*() functions like the aggregator.
+ */
+
+#ifndef LBM_UPLINK_H
+#define LBM_UPLINK_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "smtc_modem_api.h"
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC CONSTANTS --------------------------------------------------------
+ */
+
+/**
+ * @brief Number of tickets, queued, in flight or completed and not read yet
+ */
+#ifndef LBM_UPLINK_MAX_TICKETS
+#define LBM_UPLINK_MAX_TICKETS 8
+#endif
+
+/**
+ * @brief Largest payload of a ticket, in bytes
+ */
+#ifndef LBM_UPLINK_MAX_PAYLOAD
+#define LBM_UPLINK_MAX_PAYLOAD 242
+#endif
+
+/**
+ * @brief Longest time a ticket waits for the band after its request, before it is dropped for duty cycle
+ */
+#ifndef LBM_UPLINK_DUTY_CYCLE_WAIT_MS
+#define LBM_UPLINK_DUTY_CYCLE_WAIT_MS 60000
+#endif
+
+/**
+ * @brief Delay before handing a ticket to the modem again when it is busy with an uplink of its own
+ */
+#ifndef LBM_UPLINK_RETRY_MS
+#define LBM_UPLINK_RETRY_MS 1000
+#endif
+
+/**
+ * @brief Number of latency histogram buckets
+ */
+#define LBM_UPLINK_LATENCY_BUCKETS 20
+
+/**
+ * @brief No ticket: lbm_uplink_submit() failed
+ */
+#define LBM_UPLINK_NO_TICKET 0
+
+/**
+ * @brief Value returned by lbm_uplink_process() when no ticket waits for the modem
+ */
+#define LBM_UPLINK_IDLE 0xFFFFFFFFUL
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC TYPES ------------------------------------------------------------
+ */
+
+/**
+ * @brief Ticket handle, never reused before the counter wraps
+ */
+typedef uint32_t lbm_uplink_ticket_t;
+
+/**
+ * @brief Progress of a ticket, completed from LBM_UPLINK_SENT on
+ */
+typedef enum lbm_uplink_status_e
+{
+    LBM_UPLINK_QUEUED = 0,          //!< waiting for the modem or for the band
+    LBM_UPLINK_IN_FLIGHT,           //!< taken by the modem, waiting for its TXDONE
+    LBM_UPLINK_SENT,                //!< unconfirmed uplink transmitted
+    LBM_UPLINK_ACKED,               //!< confirmed uplink acknowledged by the network
+    LBM_UPLINK_NACKED,              //!< confirmed uplink transmitted, no acknowledgement after all transmissions
+    LBM_UPLINK_DROPPED_DUTY_CYCLE,  //!< band still closed LBM_UPLINK_DUTY_CYCLE_WAIT_MS after the request
+    LBM_UPLINK_NOT_SENT,            //!< taken by the modem but never transmitted (TXDONE not sent)
+    LBM_UPLINK_REFUSED,             //!< refused by the modem (not joined, payload too long at this data rate...)
+    LBM_UPLINK_CANCELLED,           //!< cancelled while queued
+} lbm_uplink_status_t;
+
+/**
+ * @brief State of a ticket
+ *
+ * Times are modem times in ms (smtc_modem_hal_get_time_in_ms()), 0 until reached. With several transmissions
+ * (NbTrans, confirmed retries), tx_start_ms / tx_end_ms are those of the last one and airtime_ms the time on
+ * air of one.
+ */
+typedef struct lbm_uplink_result_s
+{
+    lbm_uplink_ticket_t      ticket;
+    uint8_t                  stack_id;
+    uint8_t                  port;
+    bool                     confirmed;
+    uint8_t                  size;          //!< application payload
+    lbm_uplink_status_t      status;
+    smtc_modem_return_code_t refusal;       //!< LBM_UPLINK_REFUSED: result of smtc_modem_request_uplink()
+    uint8_t                  datarate;      //!< transmitted uplinks only
+    uint8_t                  phy_size;      //!< PHY payload, FOpts included
+    uint32_t                 airtime_ms;    //!< 0 if the region has no lbm_airtime table
+    uint32_t                 requested_ms;  //!< lbm_uplink_submit()
+    uint32_t                 submitted_ms;  //!< accepted by smtc_modem_request_uplink()
+    uint32_t                 tx_start_ms;
+    uint32_t                 tx_end_ms;
+    uint32_t                 done_ms;       //!< completion
+} lbm_uplink_result_t;
+
+/**
+ * @brief Called by the engine task when a ticket completes (by the caller of lbm_uplink_cancel() for a
+ *        cancelled one), the ticket being already released
+ */
+typedef void ( *lbm_uplink_callback_t )( const lbm_uplink_result_t* result, void* context );
+
+/**
+ * @brief Called by the engine task just before a ticket is handed to the modem, with the context of its callback
+ *
+ * Whatever it changes in the modem applies to this uplink only. If the modem is busy and the ticket stays queued,
+ * it is called again with undo true, then once more at the next hand-over.
+ *
+ * @return SMTC_MODEM_RC_OK to hand the ticket over, any other result refuses it (LBM_UPLINK_REFUSED)
+ */
+typedef smtc_modem_return_code_t ( *lbm_uplink_prepare_t )( const lbm_uplink_result_t* result, bool undo,
+                                                             void* context );
+
+/**
+ * @brief Delay histogram, bucket 0 below 1 ms, bucket n from 2^(n-1) to 2^n - 1 ms, the last one open
+ */
+typedef struct lbm_uplink_latency_s
+{
+    uint32_t count;
+    uint32_t min_ms;
+    uint32_t max_ms;
+    float    average_ms;
+    uint32_t buckets[LBM_UPLINK_LATENCY_BUCKETS];
+} lbm_uplink_latency_t;
+
+/**
+ * @brief Ticket counters
+ */
+typedef struct lbm_uplink_stats_s
+{
+    uint32_t submitted;
+    uint32_t table_full;          //!< lbm_uplink_submit() refused, every ticket in use
+    uint32_t sent;                //!< completions, by status
+    uint32_t acked;
+    uint32_t nacked;
+    uint32_t dropped_duty_cycle;
+    uint32_t not_sent;
+    uint32_t refused;
+    uint32_t cancelled;
+    uint32_t unread_recycled;     //!< completed tickets nobody read, reused by lbm_uplink_submit()
+    uint32_t modem_busy;          //!< hand-overs postponed by an uplink the modem already held
+    uint32_t duty_cycle_holds;    //!< hand-overs postponed because the band was closed
+    uint32_t pending;             //!< tickets queued or in flight
+    lbm_uplink_latency_t to_tx;   //!< request to start of the (last) transmission, transmitted uplinks
+    lbm_uplink_latency_t to_done; //!< request to completion, every completed ticket but cancelled ones
+} lbm_uplink_stats_t;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS PROTOTYPES --------------------------------------------
+ */
+
+/**
+ * @brief Create the completion signals of the tickets, once, before the first lbm_uplink_submit()
+ */
+void lbm_uplink_init( void );
+
+/**
+ * @brief Queue an uplink
+ *
+ * @param [in]  callback Called on completion (NULL: read the result with lbm_uplink_get() / lbm_uplink_wait())
+ * @param [out] ticket   Handle, LBM_UPLINK_NO_TICKET on error
+ *
+ * @return SMTC_MODEM_RC_OK, SMTC_MODEM_RC_INVALID_STACK_ID, SMTC_MODEM_RC_INVALID if size exceeds
+ *         LBM_UPLINK_MAX_PAYLOAD, SMTC_MODEM_RC_BUSY if every ticket is queued or in flight
+ */
+smtc_modem_return_code_t lbm_uplink_submit( uint8_t stack_id, uint8_t port, bool confirmed, const uint8_t* payload,
+                                            uint8_t size, lbm_uplink_callback_t callback, void* context,
+                                            lbm_uplink_ticket_t* ticket );
+
+/**
+ * @brief lbm_uplink_submit() with a function preparing the modem when the ticket is handed over
+ *
+ * For settings the modem only has for all uplinks (ADR profile): prepare sets them for this ticket, the
+ * callback puts them back once it completes, whatever the outcome.
+ */
+smtc_modem_return_code_t lbm_uplink_submit_prepared( uint8_t stack_id, uint8_t port, bool confirmed,
+                                                     const uint8_t* payload, uint8_t size,
+                                                     lbm_uplink_prepare_t prepare, lbm_uplink_callback_t callback,
+                                                     void* context, lbm_uplink_ticket_t* ticket );
+
+/**
+ * @brief Read the state of a ticket
+ *
+ * Reading a completed ticket releases it: it cannot be read again. A completed ticket nobody reads stays
+ * readable until lbm_uplink_submit() needs its slot. A ticket with a callback can be polled until it completes.
+ *
+ * @return SMTC_MODEM_RC_OK, SMTC_MODEM_RC_INVALID if the ticket is unknown, already read or recycled
+ */
+smtc_modem_return_code_t lbm_uplink_get( lbm_uplink_ticket_t ticket, lbm_uplink_result_t* result );
+
+/**
+ * @brief Block until a ticket completes, then read it like lbm_uplink_get()
+ *
+ * Call it from another task than the one running the engine. Tasks waiting for different tickets do not wake
+ * each other up; only one of the tasks waiting for the same ticket can read it.
+ *
+ * @param [in] timeout_ms LBM_ENGINE_WAIT_FOREVER to wait without limit
+ *
+ * @return SMTC_MODEM_RC_OK once completed, SMTC_MODEM_RC_BUSY on timeout (result holds the current state),
+ *         SMTC_MODEM_RC_INVALID if the ticket is unknown
+ */
+smtc_modem_return_code_t lbm_uplink_wait( lbm_uplink_ticket_t ticket, lbm_uplink_result_t* result,
+                                          uint32_t timeout_ms );
+
+/**
+ * @brief Cancel a queued ticket (its callback is called with LBM_UPLINK_CANCELLED)
+ *
+ * @return SMTC_MODEM_RC_OK, SMTC_MODEM_RC_BUSY once in flight, SMTC_MODEM_RC_INVALID if unknown or completed
+ */
+smtc_modem_return_code_t lbm_uplink_cancel( lbm_uplink_ticket_t ticket );
+
+/**
+ * @brief Hand the oldest queued ticket of each stack to the modem when it can take it (engine task)
+ *
+ * @return Time in ms before this must be called again, LBM_UPLINK_IDLE if no ticket is queued
+ */
+uint32_t lbm_uplink_process( void );
+
+/**
+ * @brief Complete the ticket in flight on the stack of a TXDONE (called by the event dispatcher)
+ */
+void lbm_uplink_on_event( const smtc_modem_event_t* event );
+
+/**
+ * @brief Read / clear the counters and histograms (tickets are kept)
+ */
+void lbm_uplink_get_stats( lbm_uplink_stats_t* stats );
+void lbm_uplink_reset_stats( void );
+
+/**
+ * @brief Count one delay in a histogram, total_ms accumulating the sum the average is computed from
+ */
+void lbm_uplink_latency_add( lbm_uplink_latency_t* latency, uint64_t* total_ms, uint32_t ms );
+
+/**
+ * @brief Upper bound of the bucket holding a percentile of a histogram
+ *
+ * @return ms, UINT32_MAX if it falls in the last bucket, 0 if the histogram is empty
+ */
+uint32_t lbm_uplink_latency_percentile( const lbm_uplink_latency_t* latency, uint8_t percent );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // LBM_UPLINK_H
+
+/* --- EOF ------------------------------------------------------------------ */
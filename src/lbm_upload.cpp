@@ -0,0 +1,654 @@
+/*!
+ * \file      lbm_upload.cpp
+ *
+ * \brief     Large payload uplinks: a blob fragmented across uplink tickets, with redundancy fragments
+ */
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <string.h>
+
+#include "lbm_upload.h"
+#include "lbm_core.h"
+#include "lbm_log.h"
+#include "lbm_uplink.h"
+
+extern "C" {
+#include "smtc_modem_hal.h"
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE MACROS ----------------------------------------------------------
+ */
+
+// The engine task moves the uploads on while the application starts, aborts and reads them
+static lbm_critical_t upload_lock = LBM_CRITICAL_INITIALIZER;
+#define UPLOAD_LOCK( ) LBM_CRITICAL_ENTER( &upload_lock )
+#define UPLOAD_UNLOCK( ) LBM_CRITICAL_EXIT( &upload_lock )
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE TYPES -----------------------------------------------------------
+ */
+
+typedef struct upload_s
+{
+    lbm_upload_progress_t progress;
+    lbm_upload_source_t   source;
+    void*                 source_context;
+    lbm_upload_callback_t callback;
+    void*                 context;
+    uint8_t               port;
+    uint32_t              min_interval_ms;
+    uint32_t              start_ms;
+    uint32_t              end_ms;
+    uint32_t              next_at_ms;  //!< earliest request of the next frame
+    uint16_t              next;        //!< frame to queue next, 0 to M + R - 1
+    uint8_t               requeues;    //!< of the next frame, in a row
+    lbm_uplink_ticket_t   ticket;      //!< frame queued or in flight, LBM_UPLINK_NO_TICKET if none
+} upload_t;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE VARIABLES -------------------------------------------------------
+ */
+
+static upload_t uploads[LBM_NUMBER_OF_STACKS];
+static uint8_t  last_session[LBM_NUMBER_OF_STACKS];
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DECLARATION -------------------------------------------
+ */
+
+static uint32_t prbs23( uint32_t x );
+
+/**
+ * @brief Read fragment i of a blob, the end of the last one zeroed
+ */
+static bool read_fragment( uint32_t size, uint8_t fragment_size, uint16_t i, lbm_upload_source_t source,
+                           void* source_context, uint8_t* data );
+
+/**
+ * @brief Queue the next frame of an upload, or end it
+ *
+ * @return Time in ms before trying again, LBM_UPLOAD_IDLE once queued or ended
+ */
+static uint32_t queue_frame( upload_t* upload, uint32_t now_ms );
+
+/**
+ * @brief Completion of the ticket of a frame (engine task)
+ */
+static void on_frame( const lbm_uplink_result_t* result, void* context );
+
+/**
+ * @brief Give an upload its final status (lock held)
+ */
+static void end( upload_t* upload, lbm_upload_status_t status, uint32_t now_ms );
+
+/**
+ * @brief Copy the progress of an upload with its time and goodput (lock held)
+ */
+static void read_progress( const upload_t* upload, uint32_t now_ms, lbm_upload_progress_t* progress );
+
+static void report( const upload_t* upload, lbm_upload_event_t event, const lbm_upload_progress_t* progress );
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS DEFINITION ---------------------------------------------
+ */
+
+void lbm_upload_get_default_params( lbm_upload_params_t* params )
+{
+    params->port               = LBM_UPLOAD_DEFAULT_PORT;
+    params->fragment_size      = 0;
+    params->redundancy_percent = LBM_UPLOAD_DEFAULT_REDUNDANCY_PERCENT;
+    params->min_interval_ms    = 0;
+}
+
+smtc_modem_return_code_t lbm_upload_start( uint8_t stack_id, const lbm_upload_params_t* params,
+                                           lbm_upload_source_t source, void* source_context, uint32_t size,
+                                           lbm_upload_callback_t callback, void* context )
+{
+    if( stack_id >= LBM_NUMBER_OF_STACKS )
+    {
+        return SMTC_MODEM_RC_INVALID_STACK_ID;
+    }
+    lbm_upload_params_t p;
+    if( params == nullptr )
+    {
+        lbm_upload_get_default_params( &p );
+    }
+    else
+    {
+        p = *params;
+    }
+    if( ( source == nullptr ) || ( size == 0 ) || ( p.port == 0 ) || ( p.port > 223 ) )
+    {
+        return SMTC_MODEM_RC_INVALID;
+    }
+
+    // Every frame has to fit the data rate of the start, the ticket of a longer one would be refused
+    uint8_t                        max_payload = 0;
+    const smtc_modem_return_code_t ret         = smtc_modem_get_next_tx_max_payload( stack_id, &max_payload );
+    if( ret != SMTC_MODEM_RC_OK )
+    {
+        return ret;
+    }
+    max_payload = ( max_payload > LBM_UPLINK_MAX_PAYLOAD ) ? LBM_UPLINK_MAX_PAYLOAD : max_payload;
+    if( max_payload <= LBM_UPLOAD_HEADER_SIZE )
+    {
+        return SMTC_MODEM_RC_INVALID;
+    }
+    const uint8_t largest = max_payload - LBM_UPLOAD_HEADER_SIZE;
+    if( p.fragment_size == 0 )
+    {
+        p.fragment_size = largest;
+    }
+    const uint16_t fragments = lbm_upload_fragments( size, p.fragment_size );
+    if( ( p.fragment_size > largest ) || ( fragments == 0 ) )
+    {
+        return SMTC_MODEM_RC_INVALID;
+    }
+
+    upload_t* upload = &uploads[stack_id];
+    UPLOAD_LOCK( );
+    if( upload->progress.status == LBM_UPLOAD_SENDING )
+    {
+        UPLOAD_UNLOCK( );
+        return SMTC_MODEM_RC_BUSY;
+    }
+    if( last_session[stack_id] == 0 )
+    {
+        last_session[stack_id] = ( uint8_t ) smtc_modem_hal_get_random_nb_in_range( 1, 255 );
+    }
+    else if( ++last_session[stack_id] == 0 )
+    {
+        last_session[stack_id]++;
+    }
+
+    memset( upload, 0, sizeof( *upload ) );
+    upload->progress.stack_id      = stack_id;
+    upload->progress.session       = last_session[stack_id];
+    upload->progress.status        = LBM_UPLOAD_SENDING;
+    upload->progress.size          = size;
+    upload->progress.fragment_size = p.fragment_size;
+    upload->progress.fragments     = fragments;
+    upload->progress.redundancy    = ( uint16_t ) ( ( ( uint32_t ) fragments * p.redundancy_percent + 99 ) / 100 );
+    upload->source                 = source;
+    upload->source_context         = source_context;
+    upload->callback               = callback;
+    upload->context                = context;
+    upload->port                   = p.port;
+    upload->min_interval_ms        = p.min_interval_ms;
+    upload->start_ms               = smtc_modem_hal_get_time_in_ms( );
+    upload->next_at_ms             = upload->start_ms;
+    upload->ticket                 = LBM_UPLINK_NO_TICKET;
+    UPLOAD_UNLOCK( );
+
+    LBM_LOG_INFO( "Upload %u: %u bytes in %u fragments of %u bytes + %u coded, port %u, stack %u\n",
+                  upload->progress.session, size, fragments, p.fragment_size, upload->progress.redundancy, p.port,
+                  stack_id );
+    // The first frame is queued by the next lbm_upload_process(), in the engine task like the next ones
+    return SMTC_MODEM_RC_OK;
+}
+
+smtc_modem_return_code_t lbm_upload_abort( uint8_t stack_id )
+{
+    if( stack_id >= LBM_NUMBER_OF_STACKS )
+    {
+        return SMTC_MODEM_RC_INVALID_STACK_ID;
+    }
+    upload_t*      upload = &uploads[stack_id];
+    const uint32_t now_ms = smtc_modem_hal_get_time_in_ms( );
+
+    UPLOAD_LOCK( );
+    if( upload->progress.status != LBM_UPLOAD_SENDING )
+    {
+        UPLOAD_UNLOCK( );
+        return SMTC_MODEM_RC_INVALID;
+    }
+    end( upload, LBM_UPLOAD_ABORTED, now_ms );
+    const lbm_uplink_ticket_t ticket = upload->ticket;
+    upload->ticket                   = LBM_UPLINK_NO_TICKET;
+    lbm_upload_progress_t progress;
+    read_progress( upload, now_ms, &progress );
+    UPLOAD_UNLOCK( );
+
+    // A frame the modem already holds goes out, its completion finds the upload ended
+    if( ticket != LBM_UPLINK_NO_TICKET )
+    {
+        lbm_uplink_cancel( ticket );
+    }
+    report( upload, LBM_UPLOAD_EVENT_DONE, &progress );
+    return SMTC_MODEM_RC_OK;
+}
+
+smtc_modem_return_code_t lbm_upload_get_progress( uint8_t stack_id, lbm_upload_progress_t* progress )
+{
+    if( stack_id >= LBM_NUMBER_OF_STACKS )
+    {
+        return SMTC_MODEM_RC_INVALID_STACK_ID;
+    }
+    const uint32_t now_ms = smtc_modem_hal_get_time_in_ms( );
+    UPLOAD_LOCK( );
+    read_progress( &uploads[stack_id], now_ms, progress );
+    progress->stack_id = stack_id;
+    UPLOAD_UNLOCK( );
+    return SMTC_MODEM_RC_OK;
+}
+
+uint32_t lbm_upload_process( void )
+{
+    const uint32_t now_ms  = smtc_modem_hal_get_time_in_ms( );
+    uint32_t       next_ms = LBM_UPLOAD_IDLE;
+    for( uint8_t stack_id = 0; stack_id < LBM_NUMBER_OF_STACKS; stack_id++ )
+    {
+        upload_t* upload = &uploads[stack_id];
+        if( ( upload->progress.status != LBM_UPLOAD_SENDING ) || ( upload->ticket != LBM_UPLINK_NO_TICKET ) )
+        {
+            continue;
+        }
+        const uint32_t stack_ms = queue_frame( upload, now_ms );
+        next_ms                 = ( stack_ms < next_ms ) ? stack_ms : next_ms;
+    }
+    return next_ms;
+}
+
+uint16_t lbm_upload_fragments( uint32_t size, uint8_t fragment_size )
+{
+    if( fragment_size == 0 )
+    {
+        return 0;
+    }
+    const uint32_t fragments = ( size + fragment_size - 1 ) / fragment_size;
+    return ( fragments <= LBM_UPLOAD_MAX_FRAGMENTS ) ? ( uint16_t ) fragments : 0;
+}
+
+uint16_t lbm_upload_encode( uint8_t session, uint32_t size, uint8_t fragment_size, uint16_t index,
+                            lbm_upload_source_t source, void* source_context, uint8_t* frame )
+{
+    const uint16_t m = lbm_upload_fragments( size, fragment_size );
+    if( ( m == 0 ) || ( index == 0xFFFF ) )
+    {
+        return 0;
+    }
+
+    const uint16_t number = index + 1;
+    frame[0]              = session;
+    frame[1]              = ( uint8_t ) number;
+    frame[2]              = ( uint8_t ) ( number >> 8 );
+    frame[3]              = ( uint8_t ) m;
+    frame[4]              = ( uint8_t ) ( m >> 8 );
+    frame[5]              = ( uint8_t ) ( ( uint32_t ) m * fragment_size - size );
+    uint8_t* data         = &frame[LBM_UPLOAD_HEADER_SIZE];
+
+    if( index < m )
+    {
+        return ( read_fragment( size, fragment_size, index, source, source_context, data ) == true )
+                   ? LBM_UPLOAD_HEADER_SIZE + fragment_size
+                   : 0;
+    }
+
+    uint8_t row[LBM_UPLOAD_ROW_BYTES( LBM_UPLOAD_MAX_FRAGMENTS )];
+    uint8_t fragment[255];
+    lbm_upload_parity_row( index - m + 1, m, row );
+    memset( data, 0, fragment_size );
+    for( uint16_t i = 0; i < m; i++ )
+    {
+        if( LBM_UPLOAD_GET_BIT( row, i ) == 0 )
+        {
+            continue;
+        }
+        if( read_fragment( size, fragment_size, i, source, source_context, fragment ) == false )
+        {
+            return 0;
+        }
+        for( uint8_t b = 0; b < fragment_size; b++ )
+        {
+            data[b] ^= fragment[b];
+        }
+    }
+    return LBM_UPLOAD_HEADER_SIZE + fragment_size;
+}
+
+void lbm_upload_parity_row( uint16_t n, uint16_t m, uint8_t* row )
+{
+    memset( row, 0, LBM_UPLOAD_ROW_BYTES( m ) );
+    if( m == 1 )
+    {
+        // TS004 leaves the row empty: a copy of the only fragment is of more use
+        LBM_UPLOAD_SET_BIT( row, 0 );
+        return;
+    }
+
+    // As the reference decoder: a power of 2 draws from m + 1 values, the draw of m being thrown away
+    const uint32_t modulo = ( ( m & ( m - 1 ) ) == 0 ) ? m + 1u : m;
+    uint32_t       x      = 1 + 1001u * n;
+    for( uint16_t coefficients = 0; coefficients < ( m >> 1 ); coefficients++ )
+    {
+        uint32_t r = 1u << 16;
+        while( r >= m )
+        {
+            x = prbs23( x );
+            r = x % modulo;
+        }
+        LBM_UPLOAD_SET_BIT( row, r );
+    }
+}
+
+void lbm_upload_decoder_init( lbm_upload_decoder_t* decoder, uint8_t* memory, size_t memory_size )
+{
+    memset( decoder, 0, sizeof( *decoder ) );
+    decoder->memory      = memory;
+    decoder->memory_size = memory_size;
+}
+
+lbm_upload_decoder_status_t lbm_upload_decoder_push( lbm_upload_decoder_t* decoder, const uint8_t* frame,
+                                                     uint16_t size )
+{
+    if( size <= LBM_UPLOAD_HEADER_SIZE )
+    {
+        return LBM_UPLOAD_DECODER_IGNORED;
+    }
+    const uint8_t  session       = frame[0];
+    const uint16_t number        = ( uint16_t ) ( frame[1] | ( frame[2] << 8 ) );
+    const uint16_t m             = ( uint16_t ) ( frame[3] | ( frame[4] << 8 ) );
+    const uint8_t  padding       = frame[5];
+    const uint16_t fragment_size = size - LBM_UPLOAD_HEADER_SIZE;
+    if( ( number == 0 ) || ( m == 0 ) || ( fragment_size > 255 ) || ( padding >= fragment_size ) )
+    {
+        return LBM_UPLOAD_DECODER_IGNORED;
+    }
+
+    if( decoder->started == false )
+    {
+        const size_t needed = LBM_UPLOAD_DECODER_MEMORY( m, fragment_size );
+        if( ( decoder->memory == nullptr ) || ( decoder->memory_size < needed ) )
+        {
+            return LBM_UPLOAD_DECODER_NO_MEMORY;
+        }
+        memset( decoder->memory, 0, needed );
+        decoder->started       = true;
+        decoder->session       = session;
+        decoder->fragments     = m;
+        decoder->fragment_size = ( uint8_t ) fragment_size;
+        decoder->padding       = padding;
+    }
+    else if( ( decoder->complete == true ) || ( session != decoder->session ) || ( m != decoder->fragments ) ||
+             ( fragment_size != decoder->fragment_size ) || ( padding != decoder->padding ) )
+    {
+        return LBM_UPLOAD_DECODER_IGNORED;
+    }
+    decoder->frames++;
+
+    // Fragment data first, so that the blob is in one piece once solved
+    const size_t row_bytes    = LBM_UPLOAD_ROW_BYTES( m );
+    uint8_t*     data         = decoder->memory;
+    uint8_t*     scratch_data = data + ( size_t ) m * fragment_size;
+    uint8_t*     rows         = scratch_data + fragment_size;
+    uint8_t*     used         = rows + ( size_t ) m * row_bytes;
+    uint8_t*     scratch_row  = used + row_bytes;
+
+    if( number <= m )
+    {
+        memset( scratch_row, 0, row_bytes );
+        LBM_UPLOAD_SET_BIT( scratch_row, number - 1 );
+    }
+    else
+    {
+        lbm_upload_parity_row( number - m, m, scratch_row );
+    }
+    memcpy( scratch_data, &frame[LBM_UPLOAD_HEADER_SIZE], fragment_size );
+
+    // Each row kept has its lowest bit at its own index: eliminating in increasing order never sets a bit behind
+    uint16_t pivot = m;
+    for( uint16_t c = 0; c < m; c++ )
+    {
+        if( LBM_UPLOAD_GET_BIT( scratch_row, c ) == 0 )
+        {
+            continue;
+        }
+        if( LBM_UPLOAD_GET_BIT( used, c ) == 0 )
+        {
+            pivot = c;
+            break;
+        }
+        const uint8_t* row = rows + ( size_t ) c * row_bytes;
+        for( size_t b = c / 8; b < row_bytes; b++ )
+        {
+            scratch_row[b] ^= row[b];
+        }
+        const uint8_t* known = data + ( size_t ) c * fragment_size;
+        for( uint16_t b = 0; b < fragment_size; b++ )
+        {
+            scratch_data[b] ^= known[b];
+        }
+    }
+    if( pivot == m )
+    {
+        return LBM_UPLOAD_DECODER_REDUNDANT;
+    }
+    memcpy( rows + ( size_t ) pivot * row_bytes, scratch_row, row_bytes );
+    memcpy( data + ( size_t ) pivot * fragment_size, scratch_data, fragment_size );
+    LBM_UPLOAD_SET_BIT( used, pivot );
+    if( ++decoder->rank < m )
+    {
+        return LBM_UPLOAD_DECODER_NEED_MORE;
+    }
+
+    // Triangular with a full diagonal: solve from the last fragment back
+    for( int32_t c = m - 2; c >= 0; c-- )
+    {
+        const uint8_t* row   = rows + ( size_t ) c * row_bytes;
+        uint8_t*       solve = data + ( size_t ) c * fragment_size;
+        for( uint16_t j = ( uint16_t ) c + 1; j < m; j++ )
+        {
+            if( LBM_UPLOAD_GET_BIT( row, j ) == 0 )
+            {
+                continue;
+            }
+            const uint8_t* known = data + ( size_t ) j * fragment_size;
+            for( uint16_t b = 0; b < fragment_size; b++ )
+            {
+                solve[b] ^= known[b];
+            }
+        }
+    }
+    decoder->complete = true;
+    return LBM_UPLOAD_DECODER_COMPLETE;
+}
+
+const uint8_t* lbm_upload_decoder_get_data( const lbm_upload_decoder_t* decoder, uint32_t* size )
+{
+    if( decoder->complete == false )
+    {
+        *size = 0;
+        return nullptr;
+    }
+    *size = ( uint32_t ) decoder->fragments * decoder->fragment_size - decoder->padding;
+    return decoder->memory;
+}
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PRIVATE FUNCTIONS DEFINITION --------------------------------------------
+ */
+
+static uint32_t prbs23( uint32_t x )
+{
+    const uint32_t b0 = x & 1;
+    const uint32_t b1 = ( x & 0x20 ) >> 5;
+    return ( x >> 1 ) + ( ( b0 ^ b1 ) << 22 );
+}
+
+static bool read_fragment( uint32_t size, uint8_t fragment_size, uint16_t i, lbm_upload_source_t source,
+                           void* source_context, uint8_t* data )
+{
+    const uint32_t offset = ( uint32_t ) i * fragment_size;
+    const uint32_t left   = size - offset;
+    const uint16_t length = ( left < fragment_size ) ? ( uint16_t ) left : fragment_size;
+    if( length < fragment_size )
+    {
+        memset( &data[length], 0, fragment_size - length );
+    }
+    return source( offset, data, length, source_context );
+}
+
+static uint32_t queue_frame( upload_t* upload, uint32_t now_ms )
+{
+    if( ( int32_t ) ( upload->next_at_ms - now_ms ) > 0 )
+    {
+        return upload->next_at_ms - now_ms;
+    }
+
+    const lbm_upload_progress_t* p = &upload->progress;
+    uint8_t                      frame[LBM_UPLOAD_HEADER_SIZE + 255];
+    const uint16_t               length =
+        lbm_upload_encode( p->session, p->size, p->fragment_size, upload->next, upload->source,
+                           upload->source_context, frame );
+
+    lbm_uplink_ticket_t      ticket = LBM_UPLINK_NO_TICKET;
+    smtc_modem_return_code_t ret    = SMTC_MODEM_RC_FAIL;
+    if( length > 0 )
+    {
+        ret = lbm_uplink_submit( p->stack_id, upload->port, false, frame, ( uint8_t ) length, on_frame, upload,
+                                 &ticket );
+        if( ret == SMTC_MODEM_RC_BUSY )
+        {
+            // Every ticket is taken by the application
+            return LBM_UPLINK_RETRY_MS;
+        }
+    }
+
+    lbm_upload_progress_t progress;
+    UPLOAD_LOCK( );
+    if( upload->progress.status != LBM_UPLOAD_SENDING )
+    {
+        // Aborted by another task meanwhile
+        UPLOAD_UNLOCK( );
+        if( ticket != LBM_UPLINK_NO_TICKET )
+        {
+            lbm_uplink_cancel( ticket );
+        }
+        return LBM_UPLOAD_IDLE;
+    }
+    if( ret == SMTC_MODEM_RC_OK )
+    {
+        upload->ticket = ticket;
+        UPLOAD_UNLOCK( );
+        return LBM_UPLOAD_IDLE;
+    }
+    upload->progress.refusal = ret;
+    end( upload, LBM_UPLOAD_FAILED, now_ms );
+    read_progress( upload, now_ms, &progress );
+    UPLOAD_UNLOCK( );
+    report( upload, LBM_UPLOAD_EVENT_DONE, &progress );
+    return LBM_UPLOAD_IDLE;
+}
+
+static void on_frame( const lbm_uplink_result_t* result, void* context )
+{
+    upload_t*      upload = ( upload_t* ) context;
+    const uint32_t now_ms = smtc_modem_hal_get_time_in_ms( );
+
+    UPLOAD_LOCK( );
+    if( ( upload->progress.status != LBM_UPLOAD_SENDING ) || ( result->ticket != upload->ticket ) )
+    {
+        // Frame of an aborted upload
+        UPLOAD_UNLOCK( );
+        return;
+    }
+    upload->ticket = LBM_UPLINK_NO_TICKET;
+
+    lbm_upload_event_t event = LBM_UPLOAD_EVENT_PROGRESS;
+    switch( result->status )
+    {
+    case LBM_UPLINK_SENT:
+    case LBM_UPLINK_ACKED:
+    case LBM_UPLINK_NACKED:
+        upload->progress.transmitted++;
+        upload->progress.airtime_ms += result->airtime_ms;
+        upload->next++;
+        upload->requeues   = 0;
+        upload->next_at_ms = now_ms + upload->min_interval_ms;
+        if( upload->next == ( upload->progress.fragments + upload->progress.redundancy ) )
+        {
+            end( upload, LBM_UPLOAD_DONE, now_ms );
+            event = LBM_UPLOAD_EVENT_DONE;
+        }
+        break;
+    case LBM_UPLINK_DROPPED_DUTY_CYCLE:
+    case LBM_UPLINK_NOT_SENT:
+        upload->progress.requeued++;
+        if( ++upload->requeues > LBM_UPLOAD_MAX_REQUEUES )
+        {
+            end( upload, LBM_UPLOAD_FAILED, now_ms );
+            event = LBM_UPLOAD_EVENT_DONE;
+        }
+        else
+        {
+            // Same frame again, the band decides when
+            upload->next_at_ms = now_ms;
+            UPLOAD_UNLOCK( );
+            return;
+        }
+        break;
+    default:
+        upload->progress.refusal = result->refusal;
+        end( upload, LBM_UPLOAD_FAILED, now_ms );
+        event = LBM_UPLOAD_EVENT_DONE;
+        break;
+    }
+    lbm_upload_progress_t progress;
+    read_progress( upload, now_ms, &progress );
+    UPLOAD_UNLOCK( );
+
+    report( upload, event, &progress );
+    if( event == LBM_UPLOAD_EVENT_PROGRESS )
+    {
+        // Without interval, the next frame waits for no other turn of the engine
+        queue_frame( upload, now_ms );
+    }
+}
+
+static void end( upload_t* upload, lbm_upload_status_t status, uint32_t now_ms )
+{
+    upload->progress.status = status;
+    upload->end_ms          = now_ms;
+}
+
+static void read_progress( const upload_t* upload, uint32_t now_ms, lbm_upload_progress_t* progress )
+{
+    *progress                   = upload->progress;
+    const bool sending          = ( upload->progress.status == LBM_UPLOAD_SENDING );
+    progress->elapsed_ms        = ( sending == true ) ? now_ms - upload->start_ms : upload->end_ms - upload->start_ms;
+    uint32_t bytes              = upload->progress.size;
+    if( upload->progress.status != LBM_UPLOAD_DONE )
+    {
+        const uint32_t covered = ( upload->next < upload->progress.fragments ) ? upload->next
+                                                                                : upload->progress.fragments;
+        bytes = ( covered * upload->progress.fragment_size < bytes ) ? covered * upload->progress.fragment_size : bytes;
+    }
+    progress->goodput_bps = ( progress->elapsed_ms > 0 ) ? ( float ) bytes * 8000.0f / progress->elapsed_ms : 0.0f;
+}
+
+static void report( const upload_t* upload, lbm_upload_event_t event, const lbm_upload_progress_t* progress )
+{
+    if( event == LBM_UPLOAD_EVENT_DONE )
+    {
+        LBM_LOG_INFO( "Upload %u: status %u, %u frames in %u ms (%u ms on air), %.0f bps\n", progress->session,
+                      progress->status, progress->transmitted, progress->elapsed_ms, progress->airtime_ms,
+                      ( double ) progress->goodput_bps );
+    }
+    if( upload->callback != nullptr )
+    {
+        upload->callback( event, progress, upload->context );
+    }
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,295 @@
+/*!
+ * \file      lbm_upload.h
+ *
+ * \brief     Large payload uplinks: a blob fragmented across uplink tickets, with redundancy fragments
+ *
+ * Sends blobs of a few kilobytes (configuration dumps, waveform snapshots) as a train of unconfirmed uplinks on
+ * one port. The blob is cut in M fragments of the same size, the last one padded, followed by R coded fragments
+ * which are each the XOR of about M/2 of them. The receiver rebuilds the blob from any M fragments that are
+ * linearly independent, a few more than M in practice, whichever are lost on the way: no retries, no downlink.
+ *
+ * The coded fragments follow the parity matrix of the LoRaWAN Fragmented Data Block Transport specification
+ * (TS004): coded fragment n (1 to R) covers the fragments picked by a PRBS23 seeded with 1 + 1001 * n, so the
+ * receiver needs nothing but the frame header to know which fragments each one covers.
+ *
+ * Frames (little endian):
+ *   session (1), index (2, 1 to M: fragment, M + 1 to M + R: coded fragment), M (2), padding of the last
+ *   fragment (1), fragment_size bytes
+ *
+ * Fragments go through the uplink tickets (lbm_uplink.h) one at a time, so they wait for the band like any
+ * ticket and let send() and the aggregator through in between. A fragment the band keeps out longer than
+ * LBM_UPLINK_DUTY_CYCLE_WAIT_MS, or that the modem takes without sending, is queued again.
+ *
+ * The blob is read from a source callback by offset, as the fragments go: a coded fragment reads again the
+ * fragments it covers, so the blob does not have to stay in RAM. The decoder (lbm_upload_decoder_xxx) does
+ * not touch the modem: it runs on the application server side, or on the host to check a round trip.
+ */
+
+#ifndef LBM_UPLOAD_H
+#define LBM_UPLOAD_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- DEPENDENCIES ------------------------------------------------------------
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "smtc_modem_api.h"
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC CONSTANTS --------------------------------------------------------
+ */
+
+/**
+ * @brief Largest number of fragments M of a blob, redundancy fragments excluded
+ */
+#ifndef LBM_UPLOAD_MAX_FRAGMENTS
+#define LBM_UPLOAD_MAX_FRAGMENTS 512
+#endif
+
+/**
+ * @brief Times in a row a fragment can be queued again (duty cycle drop, not sent) before the upload fails
+ */
+#ifndef LBM_UPLOAD_MAX_REQUEUES
+#define LBM_UPLOAD_MAX_REQUEUES 8
+#endif
+
+#define LBM_UPLOAD_HEADER_SIZE 6
+#define LBM_UPLOAD_DEFAULT_PORT 200
+#define LBM_UPLOAD_DEFAULT_REDUNDANCY_PERCENT 25
+
+/**
+ * @brief Value returned by lbm_upload_process() when no fragment has to be queued before a ticket completes
+ */
+#define LBM_UPLOAD_IDLE 0xFFFFFFFF
+
+/**
+ * @brief Rows of fragments, one bit each, as filled by lbm_upload_parity_row(): size of a row of m fragments, then
+ *        bit n of a row
+ */
+#define LBM_UPLOAD_ROW_BYTES( m ) ( ( ( size_t ) ( m ) + 7 ) / 8 )
+#define LBM_UPLOAD_GET_BIT( row, n ) ( ( ( row )[( n ) / 8] >> ( ( n ) % 8 ) ) & 1 )
+#define LBM_UPLOAD_SET_BIT( row, n ) ( ( row )[( n ) / 8] |= ( uint8_t ) ( 1 << ( ( n ) % 8 ) ) )
+
+/**
+ * @brief Memory needed by a decoder for a blob of nb_fragments fragments of fragment_size bytes
+ *
+ * Fragment data, then one row of nb_fragments bits per fragment, a bitmap of the rows in use and a scratch row.
+ * About 5.3 KB for 4 KB sent in fragments of 45 bytes (DR0 in EU868).
+ */
+#define LBM_UPLOAD_DECODER_MEMORY( nb_fragments, fragment_size )              \
+    ( ( ( size_t ) ( nb_fragments ) + 1 ) * ( ( size_t ) ( fragment_size ) ) + \
+      ( ( size_t ) ( nb_fragments ) + 2 ) * LBM_UPLOAD_ROW_BYTES( nb_fragments ) )
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC TYPES ------------------------------------------------------------
+ */
+
+/**
+ * @brief Source of the blob (engine task)
+ *
+ * Called for each fragment with the part of the blob it holds, and again for those a coded fragment covers.
+ *
+ * @param [in]  offset  Position in the blob
+ * @param [out] buffer  Where to copy size bytes
+ * @param [in]  context As given to lbm_upload_start()
+ *
+ * @return false to abort the upload
+ */
+typedef bool ( *lbm_upload_source_t )( uint32_t offset, uint8_t* buffer, uint16_t size, void* context );
+
+/**
+ * @brief Settings of an upload
+ */
+typedef struct lbm_upload_params_s
+{
+    uint8_t  port;                //!< FPort (1-223) of every frame of the upload
+    uint8_t  fragment_size;       //!< blob bytes per frame; 0: what the data rate allows at the start, less
+                                  //!< the header (choose the size of the lowest data rate in use with ADR)
+    uint8_t  redundancy_percent;  //!< coded fragments, in percent of M, rounded up
+    uint32_t min_interval_ms;     //!< least time between the end of a frame and the request of the next one
+} lbm_upload_params_t;
+
+/**
+ * @brief State of the upload of a stack
+ */
+typedef enum lbm_upload_status_e
+{
+    LBM_UPLOAD_NOT_STARTED = 0,  //!< no upload started yet
+    LBM_UPLOAD_SENDING,
+    LBM_UPLOAD_DONE,             //!< every fragment and coded fragment transmitted
+    LBM_UPLOAD_FAILED,           //!< refused by the modem, requeued too often, or aborted by the source
+    LBM_UPLOAD_ABORTED,          //!< lbm_upload_abort()
+} lbm_upload_status_t;
+
+/**
+ * @brief What the callback reports
+ */
+typedef enum lbm_upload_event_e
+{
+    LBM_UPLOAD_EVENT_PROGRESS = 0,  //!< a frame was transmitted, more are to come
+    LBM_UPLOAD_EVENT_DONE,          //!< the upload ended, see status
+} lbm_upload_event_t;
+
+/**
+ * @brief Progress of an upload
+ *
+ * The goodput counts the blob bytes only: while sending, those of the fragments transmitted so far; once done,
+ * the whole blob, over the time from lbm_upload_start() to the last TXDONE.
+ */
+typedef struct lbm_upload_progress_s
+{
+    uint8_t                  stack_id;
+    uint8_t                  session;         //!< first byte of every frame of the upload
+    lbm_upload_status_t      status;
+    smtc_modem_return_code_t refusal;         //!< LBM_UPLOAD_FAILED by the modem: its answer to the fragment
+    uint32_t                 size;            //!< blob bytes
+    uint8_t                  fragment_size;
+    uint16_t                 fragments;       //!< M
+    uint16_t                 redundancy;      //!< R
+    uint16_t                 transmitted;     //!< frames transmitted, out of M + R
+    uint16_t                 requeued;        //!< frames queued again after a duty cycle drop or not sent
+    uint32_t                 airtime_ms;      //!< time on air of the frames transmitted
+    uint32_t                 elapsed_ms;      //!< since lbm_upload_start(), until the end once ended
+    float                    goodput_bps;
+} lbm_upload_progress_t;
+
+/**
+ * @brief Called by the engine task after each frame transmitted and at the end of an upload
+ */
+typedef void ( *lbm_upload_callback_t )( lbm_upload_event_t event, const lbm_upload_progress_t* progress,
+                                         void* context );
+
+/**
+ * @brief Result of lbm_upload_decoder_push()
+ */
+typedef enum lbm_upload_decoder_status_e
+{
+    LBM_UPLOAD_DECODER_NEED_MORE = 0,  //!< frame taken, the blob is not complete yet
+    LBM_UPLOAD_DECODER_COMPLETE,       //!< the blob is rebuilt, read it with lbm_upload_decoder_get_data()
+    LBM_UPLOAD_DECODER_REDUNDANT,      //!< frame already known, or combination of frames already known
+    LBM_UPLOAD_DECODER_IGNORED,        //!< other session, malformed, or after the completion
+    LBM_UPLOAD_DECODER_NO_MEMORY,      //!< the memory given to lbm_upload_decoder_init() is too small for it
+} lbm_upload_decoder_status_t;
+
+/**
+ * @brief Receiver end, solving the frames received by Gaussian elimination over GF(2) as they arrive
+ */
+typedef struct lbm_upload_decoder_s
+{
+    uint8_t* memory;
+    size_t   memory_size;
+    bool     started;        //!< first frame received: the fields below are known
+    bool     complete;
+    uint8_t  session;
+    uint16_t fragments;      //!< M
+    uint8_t  fragment_size;
+    uint8_t  padding;
+    uint16_t rank;           //!< independent frames received
+    uint32_t frames;         //!< frames pushed, redundant ones included
+} lbm_upload_decoder_t;
+
+/*
+ * -----------------------------------------------------------------------------
+ * --- PUBLIC FUNCTIONS PROTOTYPES --------------------------------------------
+ */
+
+/**
+ * @brief Default settings: LBM_UPLOAD_DEFAULT_PORT, fragments as long as the data rate allows,
+ *        LBM_UPLOAD_DEFAULT_REDUNDANCY_PERCENT, no interval
+ */
+void lbm_upload_get_default_params( lbm_upload_params_t* params );
+
+/**
+ * @brief Start the upload of a blob on a stack
+ *
+ * @param [in] params   NULL for the defaults
+ * @param [in] size     Blob bytes, at most LBM_UPLOAD_MAX_FRAGMENTS fragments
+ * @param [in] callback Progress and end of the upload, NULL to poll lbm_upload_get_progress()
+ *
+ * @return SMTC_MODEM_RC_OK, SMTC_MODEM_RC_INVALID_STACK_ID, SMTC_MODEM_RC_INVALID (no source, empty or too
+ *         large blob, port out of range, fragment size above what the data rate allows), SMTC_MODEM_RC_BUSY
+ *         (an upload runs on the stack)
+ */
+smtc_modem_return_code_t lbm_upload_start( uint8_t stack_id, const lbm_upload_params_t* params,
+                                           lbm_upload_source_t source, void* source_context, uint32_t size,
+                                           lbm_upload_callback_t callback, void* context );
+
+/**
+ * @brief Stop the upload of a stack, the frame held by the modem, if any, is still transmitted
+ *
+ * @return SMTC_MODEM_RC_OK, SMTC_MODEM_RC_INVALID_STACK_ID, SMTC_MODEM_RC_INVALID if no upload runs
+ */
+smtc_modem_return_code_t lbm_upload_abort( uint8_t stack_id );
+
+/**
+ * @brief Progress of the running or last upload of a stack
+ *
+ * @return SMTC_MODEM_RC_OK, SMTC_MODEM_RC_INVALID_STACK_ID
+ */
+smtc_modem_return_code_t lbm_upload_get_progress( uint8_t stack_id, lbm_upload_progress_t* progress );
+
+/**
+ * @brief Queue the frames waiting for their interval or for a free ticket (engine task, before the tickets)
+ *
+ * @return Time in ms before the next call is needed, LBM_UPLOAD_IDLE if none
+ */
+uint32_t lbm_upload_process( void );
+
+/**
+ * @brief Build frame number index (0 to M + R - 1) of a blob, as lbm_upload_start() does
+ *
+ * @param [out] frame Room for LBM_UPLOAD_HEADER_SIZE + fragment_size bytes
+ *
+ * @return Frame size, 0 if the source failed or the arguments are out of range
+ */
+uint16_t lbm_upload_encode( uint8_t session, uint32_t size, uint8_t fragment_size, uint16_t index,
+                            lbm_upload_source_t source, void* source_context, uint8_t* frame );
+
+/**
+ * @brief Number of fragments M of a blob
+ */
+uint16_t lbm_upload_fragments( uint32_t size, uint8_t fragment_size );
+
+/**
+ * @brief Fragments covered by coded fragment n (1 to R) of a blob of m fragments, one bit each
+ *
+ * Line n of the TS004 parity matrix, except for m = 1 where TS004 covers nothing and this covers the fragment.
+ *
+ * @param [out] row Room for LBM_UPLOAD_ROW_BYTES( m ) bytes, LBM_UPLOAD_GET_BIT( row, i ) set for fragment i
+ */
+void lbm_upload_parity_row( uint16_t n, uint16_t m, uint8_t* row );
+
+/**
+ * @brief Start receiving a blob, the first frame pushed gives its session, size and fragment size
+ */
+void lbm_upload_decoder_init( lbm_upload_decoder_t* decoder, uint8_t* memory, size_t memory_size );
+
+/**
+ * @brief Take a frame in
+ */
+lbm_upload_decoder_status_t lbm_upload_decoder_push( lbm_upload_decoder_t* decoder, const uint8_t* frame,
+                                                     uint16_t size );
+
+/**
+ * @brief Rebuilt blob, NULL until LBM_UPLOAD_DECODER_COMPLETE
+ *
+ * @param [out] size Blob bytes
+ */
+const uint8_t* lbm_upload_decoder_get_data( const lbm_upload_decoder_t* decoder, uint32_t* size );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // LBM_UPLOAD_H
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -15,6 +15,25 @@ const unsigned long sendInterval = 10000; // 10 seconds in milliseconds
 bool networkJoined = false;
 uint32_t packetCounter = 0;
 
+// Engine modes
+#define ENGINE_MODE_POLLING     0  // runEngine() every 10 ms
+#define ENGINE_MODE_EVENT       1  // the loop blocks until the modem needs the CPU
+#define ENGINE_MODE_LIGHT_SLEEP 2  // same, with the MCU in light sleep (the USB serial console drops while asleep)
+
+#ifndef ENGINE_MODE
+#define ENGINE_MODE ENGINE_MODE_EVENT
+#endif
+
+// Event delivery: 1 = queued and handled in loop(), 0 = callback from inside the modem engine
+#ifndef USE_EVENT_QUEUE
+#define USE_EVENT_QUEUE 1
+#endif
+
+// Boot: 1 = resume the joined session saved in flash instead of joining again, 0 = join at every boot
+#ifndef USE_WARM_START
+#define USE_WARM_START 0
+#endif
+
 // User event callback function
 void myEventCallback(smtc_modem_event_t* event) {
     Serial.printf("User callback - Event type: %d\n", event->event_type);
@@ -33,28 +52,7 @@ void myEventCallback(smtc_modem_event_t* event) {
             break;
         case SMTC_MODEM_EVENT_DOWNDATA:
             Serial.println("Event: DOWNDATA - Downlink data received");
-            
-            // Get downlink data details using API
-            {
-                uint8_t rx_payload[255] = {0};
-                uint8_t rx_payload_size = 0;
-                smtc_modem_dl_metadata_t rx_metadata = {0};
-                uint8_t rx_remaining = 0;
-                
-                // Get the downlink data using new API
-                if (lbm.lorawan.getDownlinkData(rx_payload, &rx_payload_size, &rx_metadata, &rx_remaining)) {
-                    Serial.printf("RSSI: %d dBm, SNR: %d dB\n", rx_metadata.rssi, rx_metadata.snr);
-                    
-                    // Print payload in hex format
-                    Serial.print("HEX: ");
-                    for (int i = 0; i < rx_payload_size; i++) {
-                        Serial.printf("%02X ", rx_payload[i]);
-                    }
-                    Serial.println();
-                } else {
-                    Serial.println("Failed to get downlink data");
-                }
-            }
+            // The payload itself is handed to onDownlink()
             break;
         case SMTC_MODEM_EVENT_JOINFAIL:
             Serial.println("Event: JOINFAIL - Join failed");
@@ -66,6 +64,28 @@ void myEventCallback(smtc_modem_event_t* event) {
     }
 }
 
+// Downlink handler: the buffer is borrowed from the LBMApi pool, give it back once done
+void onDownlink(lbm_dl_buffer_t* downlink) {
+    Serial.printf("Port: %d, RSSI: %d dBm, SNR: %d dB\n", downlink->metadata.fport, downlink->metadata.rssi, downlink->metadata.snr);
+    Serial.print("HEX: ");
+    for (int i = 0; i < downlink->size; i++) {
+        Serial.printf("%02X ", downlink->payload[i]);
+    }
+    Serial.println();
+
+    lbm.releaseDownlink(downlink);
+}
+
+// Queued event handler, runs in loop() outside the modem engine
+void handleQueuedEvent(lbm_event_record_t* record) {
+    myEventCallback(&record->event);
+
+    // The engine already read the downlink into the pool, it comes with the event
+    if (record->downlink != nullptr) {
+        onDownlink(record->downlink);
+    }
+}
+
 // Function to send periodic data
 void sendPeriodicData() {
     if (!networkJoined) {
@@ -103,6 +123,13 @@ void setup() {
 
     // Register user event callback
     lbm.setEventCallback(myEventCallback);
+    lbm.setDownlinkCallback(onDownlink);
+#if USE_EVENT_QUEUE
+    lbm.useEventQueue(true);
+#endif
+#if USE_WARM_START
+    lbm.useWarmStart(true);
+#endif
     
     lbm.init();
     lbm.lorawan.setRegion(REGION_EU868); // Set to EU868 region
@@ -117,8 +144,30 @@ void setup() {
 }
 
 void loop() {
+#if ENGINE_MODE != ENGINE_MODE_POLLING
+    // Run the LoRaWAN modem engine, then sleep until it needs the CPU or the next send is due
+    unsigned long maxWait = sendInterval;
+    if (networkJoined) {
+        unsigned long sinceLastSend = millis() - lastSendTime;
+        maxWait = (sinceLastSend < sendInterval) ? sendInterval - sinceLastSend : 0;
+    }
+#if ENGINE_MODE == ENGINE_MODE_LIGHT_SLEEP
+    lbm.runEngineLowPower(maxWait);
+#else
+    lbm.runEngineUntilEvent(maxWait);
+#endif
+#else
     // Run the LoRaWAN modem engine - this must be called regularly
     lbm.runEngine();
+#endif
+
+#if USE_EVENT_QUEUE
+    // Handle modem events outside the engine context
+    lbm_event_record_t record;
+    while (lbm.pollEvent(&record)) {
+        handleQueuedEvent(&record);
+    }
+#endif
     
     // Check if it's time to send data (10 second timer)
     if (networkJoined && (millis() - lastSendTime >= sendInterval)) {
@@ -126,6 +175,8 @@ void loop() {
         lastSendTime = millis(); // Reset timer
     }
 
+#if ENGINE_MODE == ENGINE_MODE_POLLING
     // Small delay to prevent overwhelming the system
     delay(10);
+#endif
 }
\ No newline at end of file
@@ -0,0 +1,53 @@
+/**
+ * Network server payload decoder for frames built by LoRaWANClass::queueRecord() (src/lbm_aggregator.h).
+ *
+ * Install it as the uplink payload formatter of the device (The Things Stack: "Custom Javascript formatter",
+ * ChirpStack v4: device profile codec). Frames on any other FPort are returned as raw bytes.
+ *
+ * Records are back to back:
+ *   - type 0..14, size 1..16: one header byte (type << 4) | (size - 1), then the data
+ *   - otherwise: 0xF0 | type, one size byte, then the data
+ */
+
+var AGGREGATOR_PORT = 10; // LBM_AGGREGATOR_PORT
+
+function decodeRecords(bytes) {
+  var records = [];
+  var i = 0;
+  while (i < bytes.length) {
+    var header = bytes[i++];
+    var type = header >> 4;
+    var size = (header & 0x0f) + 1;
+    if (type === 0x0f) {
+      type = header & 0x0f;
+      if (type === 0x0f || i >= bytes.length) {
+        throw new Error("bad record header at byte " + (i - 1));
+      }
+      size = bytes[i++];
+      if (size === 0) {
+        throw new Error("empty record at byte " + (i - 2));
+      }
+    }
+    if (i + size > bytes.length) {
+      throw new Error("truncated record at byte " + i);
+    }
+    records.push({ type: type, bytes: bytes.slice(i, i + size) });
+    i += size;
+  }
+  return records;
+}
+
+function decodeUplink(input) {
+  if (input.fPort !== AGGREGATOR_PORT) {
+    return { data: { bytes: input.bytes } };
+  }
+  try {
+    return { data: { records: decodeRecords(input.bytes) } };
+  } catch (e) {
+    return { errors: [e.message] };
+  }
+}
+
+if (typeof module !== "undefined") {
+  module.exports = { decodeUplink: decodeUplink, decodeRecords: decodeRecords };
+}
@@ -0,0 +1,265 @@
+#!/usr/bin/env python3
+"""Decoder of the tokenized log records written with LBM_LOG_DEFERRED=1 (src/lbm_log.h).
+
+The firmware only sends the 32-bit FNV-1a hash of each format string. The dictionary is rebuilt here by scanning
+the sources for the logging macros and hashing their string literals, so it must see the sources the firmware
+was built from. Bytes that are not log records (boot messages, Semtech traces) are passed through unchanged.
+
+usage: lbm_log_decode.py [-s SRC_DIR ...] [--lp64] [capture_file | --port /dev/ttyACM0 [--baud 115200]]
+"""
+
+import argparse
+import os
+import re
+import struct
+import sys
+
+SYNC = 0xA5
+ARRAY_FLAG = 0x80
+HEADER_SIZE = 9  # level, id, timestamp (after sync and length)
+LEVEL_NAMES = {1: "E", 2: "W", 3: "I", 4: "D"}
+
+# Macro name -> suffix appended to the format (must match the DEBUG_PRINT* mapping in src/lbm_api.cpp)
+MACROS = {
+    "LBM_LOG_ERROR": "",
+    "LBM_LOG_WARN": "",
+    "LBM_LOG_INFO": "",
+    "LBM_LOG_DEBUG": "",
+    "LBM_LOG_ERROR_ARRAY": "",
+    "LBM_LOG_WARN_ARRAY": "",
+    "LBM_LOG_INFO_ARRAY": "",
+    "LBM_LOG_DEBUG_ARRAY": "",
+    "DEBUG_PRINTF": "",
+    "DEBUG_PRINT": "",
+    "DEBUG_PRINTLN": "\n",
+}
+
+CALL_RE = re.compile(r"\b(" + "|".join(sorted(MACROS, key=len, reverse=True)) + r")\s*\(\s*((?:\"(?:[^\"\\]|\\.)*\"\s*)+)")
+LITERAL_RE = re.compile(r"\"((?:[^\"\\]|\\.)*)\"")
+SPEC_RE = re.compile(r"%([-+ #0]*)(\*|\d+)?(?:\.(\*|\d+))?(hh|h|ll|l|j|z|t|L)?([diouxXcsfFeEgGaAp%])")
+SOURCE_EXTENSIONS = (".c", ".cpp", ".h", ".hpp", ".ino")
+
+ESCAPES = {"n": "\n", "t": "\t", "r": "\r", "\\": "\\", '"': '"', "'": "'", "0": "\0"}
+
+
+def fnv1a(text):
+    h = 2166136261
+    for byte in text.encode("latin-1"):
+        h = ((h ^ byte) * 16777619) & 0xFFFFFFFF
+    return h
+
+
+def unescape(literal):
+    out = []
+    i = 0
+    while i < len(literal):
+        c = literal[i]
+        if c == "\\" and i + 1 < len(literal):
+            nxt = literal[i + 1]
+            if nxt == "x":
+                m = re.match(r"[0-9a-fA-F]+", literal[i + 2:])
+                out.append(chr(int(m.group(0), 16) & 0xFF))
+                i += 2 + len(m.group(0))
+                continue
+            out.append(ESCAPES.get(nxt, nxt))
+            i += 2
+            continue
+        out.append(c)
+        i += 1
+    return "".join(out)
+
+
+def build_dictionary(source_dirs):
+    dictionary = {}
+    for source_dir in source_dirs:
+        for root, _, files in os.walk(source_dir):
+            for name in files:
+                if not name.endswith(SOURCE_EXTENSIONS):
+                    continue
+                with open(os.path.join(root, name), encoding="utf-8", errors="replace") as f:
+                    text = f.read()
+                for call in CALL_RE.finditer(text):
+                    fmt = "".join(unescape(s) for s in LITERAL_RE.findall(call.group(2))) + MACROS[call.group(1)]
+                    dictionary[fnv1a(fmt)] = fmt
+    return dictionary
+
+
+def argument_size(length, lp64):
+    """Bytes of an integer argument: the firmware writes 8-byte integers as a u64, anything else as a u32"""
+    if length in ("ll", "j"):
+        return 8
+    if length in ("l", "z", "t") and lp64:
+        return 8
+    return 4
+
+
+def format_record(fmt, args, lp64=False):
+    """Render fmt with the raw arguments of a record, returns None if they do not match"""
+    out = []
+    pos = 0
+    for spec in SPEC_RE.finditer(fmt):
+        out.append(fmt[pos:spec.start()])
+        pos = spec.end()
+        flags, width, precision, length, conv = spec.groups()
+        if conv == "%":
+            out.append("%")
+            continue
+        if width == "*" or precision == "*":
+            return None
+        pyspec = "%" + flags + (width or "") + ("." + precision if precision is not None else "")
+        if conv == "s":
+            if len(args) < 1 or len(args) < 1 + args[0]:
+                return None
+            value = bytes(args[1:1 + args[0]]).decode("latin-1")
+            args = args[1 + args[0]:]
+            out.append((pyspec + "s") % value)
+            continue
+        if conv not in "fFeEgGaAcp" and argument_size(length, lp64) == 8:
+            if len(args) < 8:
+                return None
+            word = struct.unpack_from("<Q", args)[0]
+            args = args[8:]
+            if conv in "di":
+                out.append((pyspec + "d") % struct.unpack("<q", struct.pack("<Q", word))[0])
+            else:
+                out.append((pyspec + conv) % word)
+            continue
+        if len(args) < 4:
+            return None
+        word = struct.unpack_from("<I", args)[0]
+        args = args[4:]
+        if conv in "fFeEgGaA":
+            value = struct.unpack("<f", struct.pack("<I", word))[0]
+            out.append((pyspec + ("f" if conv in "aA" else conv)) % value)
+        elif conv in "di":
+            out.append((pyspec + "d") % struct.unpack("<i", struct.pack("<I", word))[0])
+        elif conv == "c":
+            out.append((pyspec + "c") % chr(word & 0xFF))
+        elif conv == "p":
+            out.append("0x%08x" % word)
+        else:
+            out.append((pyspec + conv) % word)
+    out.append(fmt[pos:])
+    return "".join(out)
+
+
+class Decoder:
+    def __init__(self, dictionary, output, lp64=False):
+        self.dictionary = dictionary
+        self.output = output
+        self.lp64 = lp64
+        self.pending = bytearray()
+        self.line_start = True
+
+    def emit(self, text, timestamp_ms=None):
+        if timestamp_ms is not None and self.line_start:
+            text = "[%10.3f] %s" % (timestamp_ms / 1000.0, text)
+        if text:
+            self.output.write(text)
+            self.line_start = text.endswith("\n")
+
+    def decode_record(self, record):
+        level, record_id, timestamp_ms = struct.unpack_from("<BII", record)
+        args = record[HEADER_SIZE:]
+        if (level & ~ARRAY_FLAG) not in LEVEL_NAMES:
+            return False
+        if record_id == 0:
+            (count,) = struct.unpack_from("<I", args)
+            self.emit("<%u log records dropped>\n" % count, timestamp_ms)
+            return True
+        fmt = self.dictionary.get(record_id)
+        if fmt is None:
+            self.emit("<unknown log id 0x%08x, %u argument bytes>\n" % (record_id, len(args)), timestamp_ms)
+            return True
+        prefix = LEVEL_NAMES.get(level & ~ARRAY_FLAG, "?") + " "
+        if level & ARRAY_FLAG:
+            if len(args) < 1 or len(args) < 1 + args[0]:
+                return False
+            data = args[1:1 + args[0]]
+            self.emit(prefix + "%s - (%u bytes):\n" % (fmt, len(data)), timestamp_ms)
+            self.emit(" " + " ".join("%02X" % b for b in data) + "\n")
+            return True
+        text = format_record(fmt, args, self.lp64)
+        if text is None:
+            return False
+        self.emit(prefix + text, timestamp_ms)
+        return True
+
+    def feed(self, data):
+        self.pending += data
+        while self.pending:
+            sync = self.pending.find(SYNC)
+            if sync < 0:
+                self.emit(self.pending.decode("latin-1"))
+                self.pending.clear()
+                return
+            if sync > 0:
+                self.emit(self.pending[:sync].decode("latin-1"))
+                del self.pending[:sync]
+            if len(self.pending) < 2:
+                return
+            size = self.pending[1]
+            if size < HEADER_SIZE:
+                # Not a record: a 0xA5 byte in plain text
+                self.emit(self.pending[:1].decode("latin-1"))
+                del self.pending[:1]
+                continue
+            if len(self.pending) < 2 + size:
+                return
+            if not self.decode_record(bytes(self.pending[2:2 + size])):
+                self.emit(self.pending[:1].decode("latin-1"))
+                del self.pending[:1]
+                continue
+            del self.pending[:2 + size]
+
+    def flush(self):
+        if self.pending:
+            self.emit(self.pending.decode("latin-1"))
+            self.pending.clear()
+        self.output.flush()
+
+
+def main():
+    repo = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+    parser = argparse.ArgumentParser(description="Decode LBM_LOG_DEFERRED=1 log records")
+    parser.add_argument("capture", nargs="?", help="captured serial output (default: stdin)")
+    parser.add_argument("-s", "--source", action="append", help="source directory to scan (default: src/)")
+    parser.add_argument("--port", help="read a serial port instead of a file (needs pyserial)")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--lp64", action="store_true", help="records of a 64-bit host build (native env): 8-byte long")
+    parser.add_argument("--dump-dictionary", action="store_true", help="print the id -> format table and exit")
+    options = parser.parse_args()
+
+    dictionary = build_dictionary(options.source or [os.path.join(repo, "src")])
+    if options.dump_dictionary:
+        for record_id, fmt in sorted(dictionary.items()):
+            print("0x%08x %r" % (record_id, fmt))
+        return 0
+
+    decoder = Decoder(dictionary, sys.stdout, options.lp64)
+    try:
+        if options.port:
+            import serial
+
+            with serial.Serial(options.port, options.baud, timeout=0.1) as port:
+                while True:
+                    data = port.read(256)
+                    if data:
+                        decoder.feed(data)
+                        sys.stdout.flush()
+        else:
+            stream = open(options.capture, "rb") if options.capture else sys.stdin.buffer
+            with stream:
+                while True:
+                    data = stream.read(4096)
+                    if not data:
+                        break
+                    decoder.feed(data)
+    except KeyboardInterrupt:
+        pass
+    decoder.flush()
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())